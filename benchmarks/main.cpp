@@ -0,0 +1,18 @@
+#include <benchmark/benchmark.h>
+#include <wayfire/core.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * The benchmarks link only the parts of Wayfire they exercise. Some of these
+ * (for ex. wf::wl_timer in util.cpp) refer to the core, but the benchmarked
+ * code paths never reach it.
+ */
+wf::compositor_core_t& wf::get_core()
+{
+    fprintf(stderr, "wf::get_core() is not available in the benchmarks\n");
+    std::abort();
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,72 @@
+#include <benchmark/benchmark.h>
+#include <wayfire/util.hpp>
+
+namespace
+{
+/** A region of n rectangles in a grid, like the damage of many small views */
+wf::region_t make_grid(int n)
+{
+    wf::region_t region;
+    for (int i = 0; i < n; i++)
+    {
+        region |= wlr_box{(i % 16) * 120, (i / 16) * 90, 100, 70};
+    }
+
+    return region;
+}
+}
+
+static void region_union_box(benchmark::State& state)
+{
+    auto base = make_grid(state.range(0));
+    for (auto _ : state)
+    {
+        wf::region_t region = base;
+        region |= wlr_box{50, 50, 300, 200};
+        benchmark::DoNotOptimize(region.empty());
+    }
+}
+
+BENCHMARK(region_union_box)->Range(1, 256);
+
+static void region_intersect_box(benchmark::State& state)
+{
+    auto base = make_grid(state.range(0));
+    for (auto _ : state)
+    {
+        auto region = base & wlr_box{0, 0, 960, 540};
+        benchmark::DoNotOptimize(region.empty());
+    }
+}
+
+BENCHMARK(region_intersect_box)->Range(1, 256);
+
+static void region_subtract(benchmark::State& state)
+{
+    auto base = make_grid(state.range(0));
+    auto opaque = make_grid(state.range(0) / 2);
+    for (auto _ : state)
+    {
+        auto region = base ^ opaque;
+        benchmark::DoNotOptimize(region.empty());
+    }
+}
+
+BENCHMARK(region_subtract)->Range(2, 256);
+
+static void region_iterate(benchmark::State& state)
+{
+    auto base = make_grid(state.range(0));
+    for (auto _ : state)
+    {
+        int64_t area = 0;
+        for (const auto& box : base)
+        {
+            area += (int64_t)(box.x2 - box.x1) * (box.y2 - box.y1);
+        }
+
+        benchmark::DoNotOptimize(area);
+    }
+}
+
+BENCHMARK(region_iterate)->Range(1, 256);
@@ -0,0 +1,74 @@
+#include <benchmark/benchmark.h>
+#include <wayfire/nonstd/safe-list.hpp>
+
+#include <cstdint>
+
+namespace
+{
+wf::safe_list_t<int> make_list(int n)
+{
+    wf::safe_list_t<int> list;
+    for (int i = 0; i < n; i++)
+    {
+        list.push_back(i);
+    }
+
+    return list;
+}
+}
+
+static void safe_list_iterate(benchmark::State& state)
+{
+    auto list = make_list(state.range(0));
+    for (auto _ : state)
+    {
+        int64_t sum = 0;
+        list.for_each([&] (int value)
+        {
+            sum += value;
+        });
+        benchmark::DoNotOptimize(sum);
+    }
+}
+
+BENCHMARK(safe_list_iterate)->Range(1, 1024);
+
+/* Every other element removes itself and is added again at the end, like
+ * signal connections which reconnect from their own handler */
+static void safe_list_iterate_mutating(benchmark::State& state)
+{
+    auto list = make_list(state.range(0));
+    for (auto _ : state)
+    {
+        list.for_each([&] (int value)
+        {
+            if (value % 2 == 0)
+            {
+                list.remove_all(value);
+                list.push_back(value);
+            }
+        });
+    }
+
+    benchmark::DoNotOptimize(list.size());
+}
+
+BENCHMARK(safe_list_iterate_mutating)->Range(2, 1024);
+
+static void safe_list_remove(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        auto list = make_list(state.range(0));
+        state.ResumeTiming();
+        for (int i = 0; i < state.range(0); i += 2)
+        {
+            list.remove_all(i);
+        }
+
+        benchmark::DoNotOptimize(list.size());
+    }
+}
+
+BENCHMARK(safe_list_remove)->Range(2, 1024);
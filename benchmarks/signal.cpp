@@ -0,0 +1,82 @@
+#include <benchmark/benchmark.h>
+#include <wayfire/object.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace
+{
+class provider_t : public wf::signal_provider_t
+{};
+
+/** Connect n listeners to the given signal of the provider */
+std::vector<std::unique_ptr<wf::signal_connection_t>> connect_listeners(
+    provider_t& provider, const wf::signal_id_t& id, int n, int64_t& counter)
+{
+    std::vector<std::unique_ptr<wf::signal_connection_t>> connections;
+    for (int i = 0; i < n; i++)
+    {
+        connections.push_back(std::make_unique<wf::signal_connection_t>(
+            [&counter] (wf::signal_data_t*)
+        {
+            ++counter;
+        }));
+        provider.connect_signal(id, connections.back().get());
+    }
+
+    return connections;
+}
+}
+
+static void signal_emit_by_id(benchmark::State& state)
+{
+    provider_t provider;
+    int64_t counter = 0;
+    static const wf::signal_id_t id{"benchmark-signal"};
+    auto connections = connect_listeners(provider, id, state.range(0), counter);
+
+    wf::signal_data_t data;
+    for (auto _ : state)
+    {
+        provider.emit_signal(id, &data);
+    }
+
+    benchmark::DoNotOptimize(counter);
+}
+
+BENCHMARK(signal_emit_by_id)->Arg(0)->Range(1, 64);
+
+static void signal_emit_by_name(benchmark::State& state)
+{
+    provider_t provider;
+    int64_t counter = 0;
+    static const wf::signal_id_t id{"benchmark-signal"};
+    auto connections = connect_listeners(provider, id, state.range(0), counter);
+
+    wf::signal_data_t data;
+    for (auto _ : state)
+    {
+        provider.emit_signal("benchmark-signal", &data);
+    }
+
+    benchmark::DoNotOptimize(counter);
+}
+
+BENCHMARK(signal_emit_by_name)->Arg(0)->Range(1, 64);
+
+static void signal_connect_disconnect(benchmark::State& state)
+{
+    provider_t provider;
+    int64_t counter = 0;
+    static const wf::signal_id_t id{"benchmark-signal"};
+    auto connections = connect_listeners(provider, id, state.range(0), counter);
+
+    wf::signal_connection_t connection{[] (wf::signal_data_t*) {}};
+    for (auto _ : state)
+    {
+        provider.connect_signal(id, &connection);
+        provider.disconnect_signal(&connection);
+    }
+}
+
+BENCHMARK(signal_connect_disconnect)->Range(1, 64);
@@ -2,9 +2,11 @@
 #include <wayfire/output.hpp>
 #include <wayfire/signal-definitions.hpp>
 #include <wayfire/render-manager.hpp>
+#include <wayfire/performance-governor.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/nonstd/noncopyable.hpp>
 #include <type_traits>
+#include <algorithm>
 #include <map>
 #include <wayfire/core.hpp>
 #include "system_fade.hpp"
@@ -28,10 +30,99 @@ static constexpr const char *animate_custom_data_id = "animation-hook";
  * animation_t is which animation to use (i.e fire, zoom, etc). */
 struct animation_hook_base : public wf::custom_data_t
 {
+    /** Advance the animation by one frame */
+    virtual void step() = 0;
     virtual void stop_hook(bool)   = 0;
     virtual ~animation_hook_base() = default;
 };
 
+/**
+ * Steps all animations running on an output from a single pre-render hook.
+ *
+ * When many views are mapped or unmapped at once, for ex. when a session is
+ * restored, this avoids adding and removing a separate effect hook for each of
+ * them, and all animations of the frame are advanced together.
+ */
+class animation_batch_t : public wf::custom_data_t
+{
+  public:
+    static animation_batch_t *get(wf::output_t *output)
+    {
+        auto batch = output->get_data_safe<animation_batch_t>();
+        batch->output = output;
+
+        return batch.get();
+    }
+
+    void add(animation_hook_base *hook)
+    {
+        if (!hook_set)
+        {
+            output->render->add_effect(&step_hook, wf::OUTPUT_EFFECT_PRE);
+            hook_set = true;
+        }
+
+        hooks.push_back(hook);
+    }
+
+    void remove(animation_hook_base *hook)
+    {
+        auto it = std::find(hooks.begin(), hooks.end(), hook);
+        if (it == hooks.end())
+        {
+            return;
+        }
+
+        /* The list may be iterated right now, so only mark the entry */
+        *it = nullptr;
+        ++removed;
+        if (removed == hooks.size())
+        {
+            output->render->rem_effect(&step_hook);
+            hook_set = false;
+            if (!stepping)
+            {
+                hooks.clear();
+                removed = 0;
+            }
+        }
+    }
+
+    ~animation_batch_t()
+    {
+        if (hook_set)
+        {
+            output->render->rem_effect(&step_hook);
+        }
+    }
+
+  private:
+    wf::output_t *output = nullptr;
+    std::vector<animation_hook_base*> hooks;
+    size_t removed = 0;
+    bool stepping  = false;
+    bool hook_set  = false;
+
+    wf::effect_hook_t step_hook = [=] ()
+    {
+        /* Hooks added while stepping are advanced from the next frame on */
+        stepping = true;
+        const size_t count = hooks.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (hooks[i])
+            {
+                hooks[i]->step();
+            }
+        }
+
+        stepping = false;
+        hooks.erase(std::remove(hooks.begin(), hooks.end(), nullptr),
+            hooks.end());
+        removed = 0;
+    };
+};
+
 template<class animation_t>
 struct animation_hook : public animation_hook_base
 {
@@ -42,19 +133,22 @@ struct animation_hook : public animation_hook_base
     wayfire_view view;
     wf::output_t *current_output = nullptr;
     std::unique_ptr<animation_base> animation;
+    /* Where the view was shown in the previous frame, on current_output */
+    wf::animation_bounds_t bounds;
 
     /* Update animation right before each frame */
-    wf::effect_hook_t update_animation_hook = [=] ()
+    void step() override
     {
-        view->damage();
         bool result = animation->step();
         view->damage();
+        current_output->render->damage_animation_bounds(bounds,
+            view->get_bounding_box());
 
         if (!result)
         {
             stop_hook(false);
         }
-    };
+    }
 
     /**
      * Switch the output the view is being animated on, and update the lastly
@@ -64,13 +158,13 @@ struct animation_hook : public animation_hook_base
     {
         if (current_output)
         {
-            current_output->render->rem_effect(&update_animation_hook);
+            current_output->render->end_animation_bounds(bounds);
+            animation_batch_t::get(current_output)->remove(this);
         }
 
         if (new_output)
         {
-            new_output->render->add_effect(&update_animation_hook,
-                wf::OUTPUT_EFFECT_PRE);
+            animation_batch_t::get(new_output)->add(this);
         }
 
         current_output = new_output;
@@ -130,7 +224,7 @@ struct animation_hook : public animation_hook_base
     }
 };
 
-static void cleanup_views_on_output(wf::output_t *output)
+static void cleanup_views_on_output(wf::output_t *output, bool detached = true)
 {
     for (auto& view : wf::get_core().get_all_views())
     {
@@ -143,7 +237,7 @@ static void cleanup_views_on_output(wf::output_t *output)
         if (view->has_data(animate_custom_data_id))
         {
             view->get_data<animation_hook_base>(
-                animate_custom_data_id)->stop_hook(true);
+                animate_custom_data_id)->stop_hook(detached);
         }
     }
 }
@@ -189,6 +283,18 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
         output->connect_signal("view-pre-unmapped", &on_view_unmapped);
         output->connect_signal("start-rendering", &on_render_start);
         output->connect_signal("view-minimize-request", &on_minimize_request);
+        output->render->connect_signal("bypass-compositor", &on_bypass_compositor);
+    }
+
+    /**
+     * Animations are skipped while a fullscreen view bypasses the compositor,
+     * or when the performance governor asks for it.
+     */
+    bool animations_suspended()
+    {
+        return (output->render->get_bypass_compositor_view() != nullptr) ||
+               (wf::performance_governor_t::get().get_level() >=
+                   wf::PERFORMANCE_LEVEL_LOW);
     }
 
     struct view_animation_t
@@ -230,6 +336,12 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
     void set_animation(wayfire_view view,
         wf_animation_type type, int duration)
     {
+        if (wf::performance_governor_t::get().get_level() >=
+            wf::PERFORMANCE_LEVEL_REDUCED)
+        {
+            duration /= 2;
+        }
+
         view->store_data(
             std::make_unique<animation_hook<animation_t>>(view, duration, type),
             animate_custom_data_id);
@@ -240,6 +352,11 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
         [=] (wf::signal_data_t *ddata) -> void
     {
         auto view = get_signaled_view(ddata);
+        if (animations_suspended())
+        {
+            return;
+        }
+
         auto animation = get_animation_for_view(open_animation, view);
 
         if (animation.animation_name == "fade")
@@ -260,6 +377,11 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
     wf::signal_callback_t on_view_unmapped = [=] (wf::signal_data_t *data)
     {
         auto view = get_signaled_view(data);
+        if (animations_suspended())
+        {
+            return;
+        }
+
         auto animation = get_animation_for_view(close_animation, view);
 
         if (animation.animation_name == "fade")
@@ -280,6 +402,11 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
     wf::signal_callback_t on_minimize_request = [=] (wf::signal_data_t *data)
     {
         auto ev = static_cast<wf::view_minimize_request_signal*>(data);
+        if (animations_suspended())
+        {
+            return;
+        }
+
         if (ev->state)
         {
             ev->carried_out = true;
@@ -297,12 +424,22 @@ class wayfire_animation : public wf::singleton_plugin_t<animation_global_cleanup
         new wf_system_fade(output, startup_duration);
     };
 
+    /* Running animations are finished right away */
+    wf::signal_connection_t on_bypass_compositor = [=] (wf::signal_data_t *data)
+    {
+        if (static_cast<wf::bypass_compositor_signal*>(data)->view)
+        {
+            cleanup_views_on_output(output, false);
+        }
+    };
+
     void fini() override
     {
         output->disconnect_signal("view-mapped", &on_view_mapped);
         output->disconnect_signal("view-pre-unmapped", &on_view_unmapped);
         output->disconnect_signal("start-rendering", &on_render_start);
         output->disconnect_signal("view-minimize-request", &on_minimize_request);
+        on_bypass_compositor.disconnect();
 
         /* Clear up all active animations on the current output */
         cleanup_views_on_output(output);
@@ -1,47 +1,160 @@
 #include "particle.hpp"
 #include "shaders.hpp"
 #include <wayfire/core.hpp>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
-
-void Particle::update(float time)
+#include <cmath>
+
+/**
+ * A set of worker threads which is shared by all particle systems, and lives
+ * as long as at least one particle system exists. Using persistent threads
+ * avoids spawning hardware_concurrency() new threads per frame and window.
+ *
+ * The particles are split in chunks, which the workers (and the calling thread)
+ * claim with an atomic counter, so that no lock is taken while updating.
+ */
+class particle_worker_pool_t
 {
-    if (life <= 0) // ignore
+  public:
+    static std::shared_ptr<particle_worker_pool_t> get()
     {
-        return;
+        static std::weak_ptr<particle_worker_pool_t> instance;
+
+        auto pool = instance.lock();
+        if (!pool)
+        {
+            pool     = std::make_shared<particle_worker_pool_t>();
+            instance = pool;
+        }
+
+        return pool;
     }
 
-    const float slowdown = 0.8;
+    particle_worker_pool_t()
+    {
+        /* The thread which calls run() also does its share of the work */
+        int num_threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for (int i = 0; i < num_threads; i++)
+        {
+            threads.emplace_back([=] () { worker_loop(); });
+        }
+    }
 
-    pos   += speed * 0.2f * slowdown;
-    speed += g * 0.3f * slowdown;
+    ~particle_worker_pool_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
 
-    if (life != 0)
+        wake.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * Execute func on the range [0, count), split in chunks.
+     * Blocks until all chunks have been processed.
+     */
+    void run(int count, std::function<void(int, int)> func)
     {
-        color.a /= life;
+        const int num_chunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        if (threads.empty() || (num_chunks <= 1))
+        {
+            func(0, count);
+            return;
+        }
+
+        auto current = std::make_shared<job_t>();
+        current->func  = std::move(func);
+        current->count = count;
+        current->num_chunks = num_chunks;
+        current->chunks_left.store(num_chunks);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = current;
+            ++generation;
+        }
+
+        wake.notify_all();
+        process(*current);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] () { return current->chunks_left.load() == 0; });
     }
 
-    life    -= fade * 0.3 * slowdown;
-    radius   = base_radius * std::pow(life, 0.5);
-    color.a *= life;
+  private:
+    static constexpr int CHUNK_SIZE = 256;
 
-    if (start_pos.x < pos.x)
+    struct job_t
     {
-        g.x = -1;
-    } else
+        std::function<void(int, int)> func;
+        int count;
+        int num_chunks;
+        std::atomic<int> next_chunk{0};
+        std::atomic<int> chunks_left{0};
+    };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    /* Protected by mutex */
+    std::shared_ptr<job_t> job;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    void process(job_t& current)
     {
-        g.x = 1;
+        int chunk;
+        while ((chunk = current.next_chunk++) < current.num_chunks)
+        {
+            current.func(chunk * CHUNK_SIZE,
+                std::min(current.count, (chunk + 1) * CHUNK_SIZE));
+
+            if (--current.chunks_left == 0)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.notify_all();
+            }
+        }
     }
 
-    if (life <= 0)
+    void worker_loop()
     {
-        /* move outside */
-        pos = {-10000, -10000};
+        uint64_t seen_generation = 0;
+        while (true)
+        {
+            std::shared_ptr<job_t> current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] ()
+                {
+                    return stopping || (generation != seen_generation);
+                });
+
+                if (stopping)
+                {
+                    return;
+                }
+
+                seen_generation = generation;
+                current = job;
+            }
+
+            process(*current);
+        }
     }
-}
+};
 
 ParticleSystem::ParticleSystem(int particles, ParticleIniter init_func)
 {
     this->pinit_func = init_func;
+    this->workers    = particle_worker_pool_t::get();
 
     resize(particles);
     last_update_msec = wf::get_current_time();
@@ -59,13 +172,32 @@ ParticleSystem::~ParticleSystem()
 
 int ParticleSystem::spawn(int num)
 {
-    // TODO: multithread this
     int spawned = 0;
-    for (size_t i = 0; i < ps.size() && spawned < num; i++)
+    for (size_t i = 0; i < life.size() && spawned < num; i++)
     {
-        if (ps[i].life <= 0)
+        if (life[i] <= 0)
         {
-            pinit_func(ps[i]);
+            Particle p;
+            pinit_func(p);
+
+            life[i] = p.life;
+            fade[i] = p.fade;
+            base_radius[i] = p.base_radius;
+            radius[i]  = p.radius;
+            speed_x[i] = p.speed.x;
+            speed_y[i] = p.speed.y;
+            g_x[i]     = p.g.x;
+            g_y[i]     = p.g.y;
+            start_x[i] = p.start_pos.x;
+
+            center[2 * i]     = p.pos.x;
+            center[2 * i + 1] = p.pos.y;
+            for (int j = 0; j < 4; j++)
+            {
+                color[4 * i + j] = p.color[j];
+                dark_color[4 * i + j] = p.color[j] * 0.5;
+            }
+
             ++spawned;
             ++particles_alive;
         }
@@ -76,21 +208,27 @@ int ParticleSystem::spawn(int num)
 
 void ParticleSystem::resize(int num)
 {
-    if (num == (int)ps.size())
+    if (num == (int)life.size())
     {
         return;
     }
 
-    // TODO: multithread this
-    for (int i = num; i < (int)ps.size(); i++)
+    for (int i = num; i < (int)life.size(); i++)
     {
-        if (ps[i].life >= 0)
+        if (life[i] > 0)
         {
             --particles_alive;
         }
     }
 
-    ps.resize(num);
+    life.resize(num, -1);
+    fade.resize(num);
+    base_radius.resize(num);
+    speed_x.resize(num);
+    speed_y.resize(num);
+    g_x.resize(num);
+    g_y.resize(num);
+    start_x.resize(num);
 
     color.resize(color_per_particle * num);
     dark_color.resize(color_per_particle * num);
@@ -100,62 +238,56 @@ void ParticleSystem::resize(int num)
 
 int ParticleSystem::size()
 {
-    return ps.size();
+    return life.size();
 }
 
 void ParticleSystem::update_worker(float time, int start, int end)
 {
-    end = std::min(end, (int)ps.size());
+    const float slowdown = 0.8;
+    const float speed_step = 0.2f * slowdown;
+    const float g_step     = 0.3f * slowdown;
+    const float fade_step  = 0.3f * slowdown;
+
+    end = std::min(end, (int)life.size());
+
+    /* Deaths are counted locally, so that the workers do not contend on the
+     * shared counter */
+    int died = 0;
     for (int i = start; i < end; ++i)
     {
-        if (ps[i].life <= 0)
+        if (life[i] <= 0)
         {
             continue;
         }
 
-        // printf("%d\n", i);
-        ps[i].update(time);
+        center[2 * i]     += speed_x[i] * speed_step;
+        center[2 * i + 1] += speed_y[i] * speed_step;
+        speed_x[i] += g_x[i] * g_step;
+        speed_y[i] += g_y[i] * g_step;
+
+        /* Alpha is proportional to the remaining life */
+        float new_life = life[i] - fade[i] * fade_step;
+        color[4 * i + 3] *= new_life / life[i];
+        life[i] = new_life;
+
+        radius[i] = base_radius[i] * std::sqrt(std::max(new_life, 0.0f));
+        g_x[i]    = (start_x[i] < center[2 * i]) ? -1 : 1;
 
-        if (ps[i].life <= 0)
+        for (int j = 0; j < 4; j++)
         {
-            --particles_alive;
+            dark_color[4 * i + j] = color[4 * i + j] * 0.5;
         }
 
-        for (int j = 0; j < 4; j++) // maybe use memcpy?
+        if (new_life <= 0)
         {
-            color[4 * i + j] = ps[i].color[j];
-            dark_color[4 * i + j] = ps[i].color[j] * 0.5;
+            /* move outside */
+            center[2 * i]     = -10000;
+            center[2 * i + 1] = -10000;
+            ++died;
         }
-
-        // printf("center %d gets %f", 2 * i, ps[i].pos[0]);
-        center[2 * i]     = ps[i].pos[0];
-        center[2 * i + 1] = ps[i].pos[1];
-
-        radius[i] = ps[i].radius;
     }
-}
-
-void ParticleSystem::exec_worker_threads(std::function<void(int, int)> spawn_worker)
-{
-// return spawn_worker(0, ps.size());
-
-    const int num_threads = std::thread::hardware_concurrency();
-    const int worker_load = (ps.size() + num_threads - 1) / num_threads;
 
-    std::thread workers[num_threads];
-    for (int i = 0; i < num_threads; i++)
-    {
-        int thread_start = i * worker_load;
-        int thread_end   = (i + 1) * worker_load;
-        thread_end = std::min(thread_end, (int)ps.size());
-
-        workers[i] = std::thread([=] () { spawn_worker(thread_start, thread_end); });
-    }
-
-    for (auto& w : workers)
-    {
-        w.join();
-    }
+    particles_alive -= died;
 }
 
 void ParticleSystem::update()
@@ -164,7 +296,7 @@ void ParticleSystem::update()
     float time = (wf::get_current_time() - last_update_msec) / 16.0;
     last_update_msec = wf::get_current_time();
 
-    exec_worker_threads([=] (int start, int end)
+    workers->run(life.size(), [=] (int start, int end)
     {
         update_worker(time, start, end);
     });
@@ -210,8 +342,7 @@ void ParticleSystem::render(glm::mat4 matrix)
     program.attrib_pointer("color", 4, 0, dark_color.data());
     program.attrib_divisor("color", 1);
 
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA));
+    OpenGL::enable_blend(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
     program.uniform1f("smoothing", 0.7);
 
     // TODO: optimize shaders for this case
@@ -219,12 +350,12 @@ void ParticleSystem::render(glm::mat4 matrix)
 
     // particle color
     program.attrib_pointer("color", 4, 0, color.data());
-    GL_CALL(glBlendFunc(GL_SRC_ALPHA, GL_ONE));
+    OpenGL::enable_blend(GL_SRC_ALPHA, GL_ONE);
     program.uniform1f("smoothing", 0.5);
     GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, ps.size()));
 
-    GL_CALL(glDisable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    /* Reset gl state */
+    OpenGL::enable_blend();
 
     program.deactivate();
 }
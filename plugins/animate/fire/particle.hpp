@@ -4,8 +4,12 @@
 #include <wayfire/opengl.hpp>
 #include <functional>
 #include <atomic>
+#include <memory>
 #include <vector>
 
+/* The initial state of a particle, filled by the ParticleIniter.
+ * Internally, the ParticleSystem stores the particles as a structure of arrays,
+ * so that they can be updated in place and uploaded to the GPU directly. */
 struct Particle
 {
     float life = -1;
@@ -17,16 +21,13 @@ struct Particle
     glm::vec2 start_pos;
 
     glm::vec4 color{1.0, 1.0, 1.0, 1.0};
-
-    /* update the given particle
-     * time is the percentage of the frame which has elapsed
-     * must be thread-safe */
-    void update(float time);
 };
 
 /* a function to initialize a particle */
 using ParticleIniter = std::function<void (Particle&)>;
 
+class particle_worker_pool_t;
+
 class ParticleSystem
 {
   public:
@@ -65,8 +66,12 @@ class ParticleSystem
     uint32_t last_update_msec;
 
     std::atomic<int> particles_alive;
-    std::vector<Particle> ps;
 
+    /* Per-particle state, index i is the i-th particle */
+    std::vector<float> life, fade, base_radius;
+    std::vector<float> speed_x, speed_y, g_x, g_y, start_x;
+
+    /* Per-particle state which is also uploaded as vertex attributes */
     static constexpr int color_per_particle = 4;
     std::vector<float> color, dark_color;
 
@@ -76,8 +81,10 @@ class ParticleSystem
     static constexpr int center_per_particle = 2;
     std::vector<float> center;
 
+    /* Shared between all particle systems, see particle.cpp */
+    std::shared_ptr<particle_worker_pool_t> workers;
+
     OpenGL::program_t program;
-    void exec_worker_threads(std::function<void(int, int)> spawn_worker);
     void update_worker(float time, int start, int end);
     void create_program();
 };
@@ -43,7 +43,10 @@ class wf_system_fade
             fb.get_orthographic_projection());
         OpenGL::render_end();
 
-        if (!progression.running())
+        /* Don't keep a fullscreen view which bypasses the compositor from
+         * being scanned out */
+        if (!progression.running() ||
+            output->render->get_bypass_compositor_view())
         {
             finish();
         }
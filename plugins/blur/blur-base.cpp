@@ -1,5 +1,6 @@
 #include "blur.hpp"
 #include <wayfire/output.hpp>
+#include <wayfire/performance-governor.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/util/log.hpp>
 
@@ -11,12 +12,15 @@ attribute mediump vec2 position;
 varying mediump vec2 uvpos[2];
 
 uniform mat4 mvp;
+uniform vec2 bg_scale;
+uniform vec2 bg_offset;
 
 void main() {
 
     gl_Position = vec4(position.xy, 0.0, 1.0);
-    uvpos[0] = (position.xy + vec2(1.0, 1.0)) / 2.0;
-    uvpos[1] = vec4(mvp * vec4(uvpos[0] - 0.5, 0.0, 1.0)).xy + 0.5;
+    vec2 uv = (position.xy + vec2(1.0, 1.0)) / 2.0;
+    uvpos[0] = uv * bg_scale + bg_offset;
+    uvpos[1] = vec4(mvp * vec4(uv - 0.5, 0.0, 1.0)).xy + 0.5;
 })";
 
 static const char *blur_blend_fragment_shader =
@@ -58,11 +62,15 @@ wf_blur_base::wf_blur_base(wf::output_t *output, std::string name)
     this->degrade_opt.load_option("blur/" + algorithm_name + "_degrade");
     this->iterations_opt.load_option("blur/" + algorithm_name + "_iterations");
 
-    this->options_changed = [=] () { output->render->damage_whole(); };
-    this->saturation_opt.set_callback(options_changed);
-    this->offset_opt.set_callback(options_changed);
-    this->degrade_opt.set_callback(options_changed);
-    this->iterations_opt.set_callback(options_changed);
+    /* The offset, degrade and iterations are used together, so they are
+     * updated at once, with a single redraw */
+    this->options.add(saturation_opt);
+    this->options.add(offset_opt);
+    this->options.add(degrade_opt);
+    this->options.add(iterations_opt);
+    this->options.set_callback([=] () { output->render->damage_whole(); });
+    wf::get_core().connect_signal("performance-level-changed",
+        &on_performance_level_changed);
 
     OpenGL::render_begin();
     blend_program.compile(blur_blend_vertex_shader, blur_blend_fragment_shader);
@@ -80,9 +88,33 @@ wf_blur_base::~wf_blur_base()
     OpenGL::render_end();
 }
 
+int wf_blur_base::get_iterations()
+{
+    int iterations = iterations_opt;
+    if (wf::performance_governor_t::get().get_level() >=
+        wf::PERFORMANCE_LEVEL_REDUCED)
+    {
+        return (iterations + 1) / 2;
+    }
+
+    return iterations;
+}
+
+int wf_blur_base::get_degrade()
+{
+    int degrade = degrade_opt;
+    if (wf::performance_governor_t::get().get_level() >=
+        wf::PERFORMANCE_LEVEL_REDUCED)
+    {
+        return 2 * degrade;
+    }
+
+    return degrade;
+}
+
 int wf_blur_base::calculate_blur_radius()
 {
-    return offset_opt * degrade_opt * std::max(1, (int)iterations_opt);
+    return offset_opt * get_degrade() * std::max(1, get_iterations());
 }
 
 void wf_blur_base::render_iteration(wf::region_t blur_region,
@@ -94,7 +126,11 @@ void wf_blur_base::render_iteration(wf::region_t blur_region,
     width  = std::max(width, 1);
     height = std::max(height, 1);
 
-    out.allocate(width, height);
+    if (out.allocate(width, height))
+    {
+        wf::gpu_memory::set_owner(&out, "blur");
+    }
+
     out.bind();
 
     GL_CALL(glBindTexture(GL_TEXTURE_2D, in.tex));
@@ -148,15 +184,19 @@ wlr_box wf_blur_base::copy_region(wf::framebuffer_base_t& result,
 
     // Make sure that the box is aligned properly for degrading, otherwise,
     // we get a flickering
-    subbox = sanitize(subbox, degrade_opt, source_box);
-    int degraded_width  = subbox.width / degrade_opt;
-    int degraded_height = subbox.height / degrade_opt;
+    int degrade = get_degrade();
+    subbox = sanitize(subbox, degrade, source_box);
+    int degraded_width  = subbox.width / degrade;
+    int degraded_height = subbox.height / degrade;
 
     OpenGL::render_begin(source);
-    result.allocate(degraded_width, degraded_height);
+    if (result.allocate(degraded_width, degraded_height))
+    {
+        wf::gpu_memory::set_owner(&result, "blur");
+    }
 
-    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fb));
-    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, result.fb));
+    OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, source.fb);
+    OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, result.fb);
     GL_CALL(glBlitFramebuffer(
         subbox.x, source_box.height - subbox.y - subbox.height,
         subbox.x + subbox.width, source_box.height - subbox.y,
@@ -170,7 +210,7 @@ wlr_box wf_blur_base::copy_region(wf::framebuffer_base_t& result,
 void wf_blur_base::pre_render(wf::texture_t src_tex, wlr_box src_box,
     const wf::region_t& damage, const wf::framebuffer_t& target_fb)
 {
-    int degrade     = degrade_opt;
+    int degrade     = get_degrade();
     auto damage_box = copy_region(fb[0], target_fb, damage);
 
     /* As an optimization, we create a region that blur can use
@@ -189,36 +229,27 @@ void wf_blur_base::pre_render(wf::texture_t src_tex, wlr_box src_box,
 
     int r = blur_fb0(blur_damage, fb[0].viewport_width, fb[0].viewport_height);
 
-    /* Make sure the result is always fb[1], because that's what is used in render()
-     * */
+    /* Make sure the result is always fb[0], because that's what is used in
+     * render() */
     if (r != 0)
     {
         std::swap(fb[0], fb[1]);
     }
 
-    /* we subtract target_fb's position to so that
-     * view box is relative to framebuffer */
-    auto view_box = target_fb.framebuffer_box_from_geometry_box(src_box);
-
-    OpenGL::render_begin();
-    fb[1].allocate(view_box.width, view_box.height);
-    fb[1].bind();
-    GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, fb[0].fb));
-
-    /* Blit the blurred texture into an fb which has the size of the view,
-     * so that the view texture and the blurred background can be combined
-     * together in render()
+    /* Instead of blitting the blurred texture into a buffer with the size of
+     * the view, render() samples fb[0] directly. Calculate the mapping from
+     * view texture coordinates to fb[0] coordinates.
      *
-     * local_geometry is damage_box relative to view box */
+     * local_box is damage_box relative to view box, both are in framebuffer
+     * coordinates, and texture coordinates start at the bottom. */
+    auto view_box = target_fb.framebuffer_box_from_geometry_box(src_box);
     wlr_box local_box = damage_box + wf::point_t{-view_box.x, -view_box.y};
-    GL_CALL(glBlitFramebuffer(0, 0, fb[0].viewport_width, fb[0].viewport_height,
-        local_box.x,
-        view_box.height - local_box.y - local_box.height,
-        local_box.x + local_box.width,
-        view_box.height - local_box.y,
-        GL_COLOR_BUFFER_BIT, GL_LINEAR));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-    OpenGL::render_end();
+
+    bg_scale_x  = 1.0f * view_box.width / local_box.width;
+    bg_scale_y  = 1.0f * view_box.height / local_box.height;
+    bg_offset_x = -1.0f * local_box.x / local_box.width;
+    bg_offset_y = -1.0f * (view_box.height - local_box.y - local_box.height) /
+        local_box.height;
 }
 
 void wf_blur_base::render(wf::texture_t src_tex, wlr_box src_box,
@@ -246,14 +277,17 @@ void wf_blur_base::render(wf::texture_t src_tex, wlr_box src_box,
     /* XXX: core should give us the number of texture units used */
     blend_program.uniform1i("bg_texture", 1);
     blend_program.uniform1f("sat", saturation_opt);
+    blend_program.uniform2f("bg_scale", bg_scale_x, bg_scale_y);
+    blend_program.uniform2f("bg_offset", bg_offset_x, bg_offset_y);
 
     blend_program.set_active_texture(src_tex);
     GL_CALL(glActiveTexture(GL_TEXTURE0 + 1));
-    GL_CALL(glBindTexture(GL_TEXTURE_2D, fb[1].tex));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D, fb[0].tex));
     /* Render it to target_fb */
     target_fb.bind();
-    GL_CALL(glViewport(view_box.x, fb_geom.height - view_box.y - view_box.height,
-        view_box.width, view_box.height));
+    OpenGL::set_viewport(view_box.x,
+        fb_geom.height - view_box.y - view_box.height,
+        view_box.width, view_box.height);
     target_fb.logic_scissor(scissor_box);
 
     GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
@@ -287,6 +321,11 @@ std::unique_ptr<wf_blur_base> create_blur_from_name(wf::output_t *output,
         return create_kawase_blur(output);
     }
 
+    if (algorithm_name == "dual_kawase")
+    {
+        return create_dual_kawase_blur(output);
+    }
+
     if (algorithm_name == "gaussian")
     {
         return create_gaussian_blur(output);
@@ -6,9 +6,37 @@
 #include <wayfire/workspace-stream.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/kde-blur.hpp>
 
 #include "blur.hpp"
 
+/**
+ * @return The parts of the view which show the blurred background, in the
+ *   coordinates of its bounding box: everything which is not opaque, limited
+ *   to the region the client asked for with the KDE blur protocol.
+ */
+static wf::region_t get_translucent_region(wayfire_view view)
+{
+    auto bbox = view->get_bounding_box("blur");
+    wf::region_t region{bbox};
+
+    /* The requested region is relative to the main surface, which matches the
+     * bounding box only if the transformers below blur don't move the view */
+    wf::region_t requested;
+    if (get_kde_blur_region(view, requested) &&
+        (bbox == view->get_untransformed_bounding_box()))
+    {
+        region &= requested + wf::origin(view->get_output_geometry());
+    }
+
+    /* Only the pixels which are really opaque can be skipped, so the opaque
+     * region must not be shrunk by the blur padding here */
+    wf::surface_interface_t::set_opaque_shrink_constraint("blur", 0);
+    region ^= view->get_transformed_opaque_region();
+
+    return region;
+}
+
 using blur_algorithm_provider = std::function<nonstd::observer_ptr<wf_blur_base>()>;
 class wf_blur_transformer : public wf::view_transformer_t
 {
@@ -70,40 +98,31 @@ class wf_blur_transformer : public wf::view_transformer_t
     void render_with_damage(wf::texture_t src_tex, wlr_box src_box,
         const wf::region_t& damage, const wf::framebuffer_t& target_fb) override
     {
-        wf::region_t clip_damage = damage & src_box;
-
-        /* We want to check if the opaque region completely occludes
-         * the bounding box. If this is the case, we can skip blurring
-         * altogether and just render the surface. First we disable
-         * shrinking and get the opaque region without padding */
-        wf::surface_interface_t::set_opaque_shrink_constraint("blur", 0);
-        wf::region_t full_opaque = view->get_transformed_opaque_region();
-
-        /* Shrink the opaque region by the padding amount since the render
-         * chain expects this, as we have applied padding to damage in
-         * frame_pre_paint for this frame already */
+        wf::region_t clip_damage    = damage & src_box;
+        wf::region_t blurred_region = clip_damage & get_translucent_region(view);
+
+        /* Restore the padding which frame_pre_paint applied to the opaque
+         * regions for this frame, since the render chain expects it */
         int padding = std::ceil(provider()->calculate_blur_radius() /
             output->render->get_target_framebuffer().scale);
         wf::surface_interface_t::set_opaque_shrink_constraint("blur", padding);
 
-        wf::region_t bbox_region{src_box};
-        if ((bbox_region ^ full_opaque).empty())
+        if (blurred_region.empty())
         {
-            /* In case the whole surface is opaque, we can simply skip blurring */
+            /* In case nothing shows the background, we can simply skip
+             * blurring */
             direct_render(src_tex, src_box, damage, target_fb);
 
             return;
         }
 
-        wf::region_t opaque_region  = view->get_transformed_opaque_region();
-        wf::region_t blurred_region = clip_damage ^ opaque_region;
-
         provider()->pre_render(src_tex, src_box, blurred_region, target_fb);
         wf::view_transformer_t::render_with_damage(src_tex, src_box, blurred_region,
             target_fb);
 
-        /* Opaque non-blurred regions can be rendered directly without blending */
-        direct_render(src_tex, src_box, opaque_region & clip_damage, target_fb);
+        /* Opaque regions and translucent regions which the client doesn't want
+         * blurred are rendered directly */
+        direct_render(src_tex, src_box, clip_damage ^ blurred_region, target_fb);
     }
 
     void render_box(wf::texture_t src_tex, wlr_box src_box, wlr_box scissor_box,
@@ -205,6 +224,7 @@ class wayfire_blur : public wf::plugin_interface_t
     {
         blur_region.clear();
         auto views = output->workspace->get_views_in_layer(wf::ALL_LAYERS);
+        const auto& fb = output->render->get_target_framebuffer();
 
         for (auto& view : views)
         {
@@ -213,10 +233,12 @@ class wayfire_blur : public wf::plugin_interface_t
                 continue;
             }
 
-            auto bbox = view->get_bounding_box();
+            /* Damage up to the blur radius away from the blurred parts
+             * changes what they show */
+            auto region = expand_region(get_translucent_region(view), fb.scale);
             if (!view->sticky)
             {
-                blur_region |= bbox;
+                blur_region |= region;
             } else
             {
                 auto wsize = output->workspace->get_workspace_grid_size();
@@ -225,13 +247,64 @@ class wayfire_blur : public wf::plugin_interface_t
                     for (int j = 0; j < wsize.height; j++)
                     {
                         blur_region |=
-                            bbox + wf::origin(output->render->get_ws_box({i, j}));
+                            region + wf::origin(output->render->get_ws_box({i, j}));
                     }
                 }
             }
         }
     }
 
+    /** @return Whether the view should be blurred without user interaction */
+    bool should_blur(wayfire_view view)
+    {
+        wf::region_t requested;
+
+        return blur_by_default.matches(view) ||
+               get_kde_blur_region(view, requested);
+    }
+
+    /* Clients can ask for blur with the KDE blur protocol */
+    wf::signal_connection_t on_blur_region_changed = [=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        if (!view->is_mapped() ||
+            (view == output->render->get_bypass_compositor_view()))
+        {
+            return;
+        }
+
+        if (should_blur(view))
+        {
+            add_transformer(view);
+        } else
+        {
+            pop_transformer(view);
+        }
+
+        view->damage();
+    };
+
+    /* Whether the view which bypassed the compositor had been blurred */
+    bool bypass_view_blurred = false;
+
+    /* Blur would keep the fullscreen view from being scanned out directly */
+    wf::signal_connection_t on_bypass_compositor = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::bypass_compositor_signal*>(data);
+        if (ev->previous && bypass_view_blurred &&
+            (ev->previous->get_output() == output) && ev->previous->is_mapped())
+        {
+            add_transformer(ev->previous);
+        }
+
+        bypass_view_blurred = ev->view &&
+            ev->view->get_transformer(transformer_name);
+        if (ev->view)
+        {
+            pop_transformer(ev->view);
+        }
+    };
+
     /** Find the region of blurred views on the given workspace */
     wf::region_t get_blur_region(wf::point_t ws) const
     {
@@ -289,7 +362,7 @@ class wayfire_blur : public wf::plugin_interface_t
                 return;
             }
 
-            if (blur_by_default.matches(view))
+            if (should_blur(view))
             {
                 add_transformer(view);
             }
@@ -306,6 +379,8 @@ class wayfire_blur : public wf::plugin_interface_t
         output->connect_signal("view-attached", &view_attached);
         output->connect_signal("view-mapped", &view_attached);
         output->connect_signal("view-detached", &view_detached);
+        output->render->connect_signal("bypass-compositor", &on_bypass_compositor);
+        output->connect_signal("view-blur-region-changed", &on_blur_region_changed);
 
         /* frame_pre_paint is called before each frame has started.
          * It expands the damage by the blur radius.
@@ -354,14 +429,17 @@ class wayfire_blur : public wf::plugin_interface_t
 
             OpenGL::render_begin(target_fb);
             /* Initialize a place to store padded region pixels. */
-            saved_pixels.allocate(target_fb.viewport_width,
-                target_fb.viewport_height);
+            if (saved_pixels.allocate(target_fb.viewport_width,
+                target_fb.viewport_height))
+            {
+                wf::gpu_memory::set_owner(&saved_pixels, "blur");
+            }
 
             /* Setup framebuffer I/O. target_fb contains the pixels
              * from last frame at this point. We are writing them
              * to saved_pixels, bound as GL_DRAW_FRAMEBUFFER */
             saved_pixels.bind();
-            GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, target_fb.fb));
+            OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, target_fb.fb);
 
             /* Copy pixels in padded_region from target_fb to saved_pixels. */
             for (const auto& box : padded_region)
@@ -394,7 +472,7 @@ class wayfire_blur : public wf::plugin_interface_t
              * rendered with expanded damage and artifacts on the edges.
              * saved_pixels has the the padded region of pixels to overwrite the
              * artifacts that blurring has left behind. */
-            GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, saved_pixels.fb));
+            OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, saved_pixels.fb);
 
             /* Copy pixels back from saved_pixels to target_fb. */
             for (const auto& box : padded_region)
@@ -417,7 +495,8 @@ class wayfire_blur : public wf::plugin_interface_t
         for (auto& view :
              output->workspace->get_views_in_layer(wf::ALL_LAYERS))
         {
-            if (blur_by_default.matches(view))
+            if (should_blur(view) &&
+                (view != output->render->get_bypass_compositor_view()))
             {
                 add_transformer(view);
             }
@@ -432,6 +511,8 @@ class wayfire_blur : public wf::plugin_interface_t
         output->disconnect_signal("view-attached", &view_attached);
         output->disconnect_signal("view-mapped", &view_attached);
         output->disconnect_signal("view-detached", &view_detached);
+        on_bypass_compositor.disconnect();
+        on_blur_region_changed.disconnect();
         output->render->rem_effect(&frame_pre_paint);
         output->render->disconnect_signal("workspace-stream-pre",
             &workspace_stream_pre);
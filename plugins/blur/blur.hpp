@@ -97,6 +97,11 @@ class wf_blur_base
      * view texture */
     OpenGL::program_t blend_program;
 
+    /* maps view texture coordinates to the blurred background in fb[0],
+     * set by pre_render() */
+    float bg_scale_x  = 1.0f, bg_scale_y = 1.0f;
+    float bg_offset_x = 0.0f, bg_offset_y = 0.0f;
+
     /* used to get individual algorithm options from config
      * should be set by the constructor */
     std::string algorithm_name;
@@ -104,7 +109,13 @@ class wf_blur_base
     wf::option_wrapper_t<double> saturation_opt;
     wf::option_wrapper_t<double> offset_opt;
     wf::option_wrapper_t<int> degrade_opt, iterations_opt;
-    wf::config::option_base_t::updated_callback_t options_changed;
+    /* the options above and those of the algorithm, redraws when they change */
+    wf::option_snapshot_t options;
+    /* the performance governor changes the iterations and degrade too */
+    wf::signal_connection_t on_performance_level_changed = [=] (wf::signal_data_t*)
+    {
+        output->render->damage_whole();
+    };
 
     wf::output_t *output;
 
@@ -124,6 +135,12 @@ class wf_blur_base
      * returns the index of the fb where the result is stored (0 or 1) */
     virtual int blur_fb0(const wf::region_t& blur_region, int width, int height) = 0;
 
+    /* the iterations and degrade to use. When the performance governor asks
+     * for a cheaper blur, the iterations are halved and the degrade doubled,
+     * which keeps the blur radius roughly the same for most algorithms */
+    int get_iterations();
+    int get_degrade();
+
   public:
     wf_blur_base(wf::output_t *output, std::string name);
     virtual ~wf_blur_base();
@@ -140,6 +157,7 @@ class wf_blur_base
 std::unique_ptr<wf_blur_base> create_box_blur(wf::output_t *output);
 std::unique_ptr<wf_blur_base> create_bokeh_blur(wf::output_t *output);
 std::unique_ptr<wf_blur_base> create_kawase_blur(wf::output_t *output);
+std::unique_ptr<wf_blur_base> create_dual_kawase_blur(wf::output_t *output);
 std::unique_ptr<wf_blur_base> create_gaussian_blur(wf::output_t *output);
 
 std::unique_ptr<wf_blur_base> create_blur_from_name(wf::output_t *output,
@@ -67,7 +67,7 @@ class wf_bokeh_blur : public wf_blur_base
 
     int blur_fb0(const wf::region_t& blur_region, int width, int height) override
     {
-        int iterations = iterations_opt;
+        int iterations = get_iterations();
         float offset   = offset_opt;
 
         static const float vertexData[] = {
@@ -85,12 +85,11 @@ class wf_bokeh_blur : public wf_blur_base
         program[0].uniform1i("iterations", iterations);
 
         program[0].attrib_pointer("position", 2, 0, vertexData);
-        GL_CALL(glDisable(GL_BLEND));
+        OpenGL::disable_blend();
         render_iteration(blur_region, fb[0], fb[1], width, height);
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable_blend();
 
         program[0].deactivate();
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
@@ -101,7 +100,7 @@ class wf_bokeh_blur : public wf_blur_base
 
     int calculate_blur_radius() override
     {
-        return 5 * wf_blur_base::offset_opt*wf_blur_base::degrade_opt;
+        return 5 * offset_opt * get_degrade();
     }
 };
 
@@ -108,10 +108,10 @@ class wf_box_blur : public wf_blur_base
 
     int blur_fb0(const wf::region_t& blur_region, int width, int height) override
     {
-        int i, iterations = iterations_opt;
+        int i, iterations = get_iterations();
 
         OpenGL::render_begin();
-        GL_CALL(glDisable(GL_BLEND));
+        OpenGL::disable_blend();
         /* Enable our shader and pass some data to it. The shader
          * does box blur on the background texture in two passes,
          * one horizontal and one vertical */
@@ -128,8 +128,7 @@ class wf_box_blur : public wf_blur_base
         }
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable_blend();
 
         program[0].deactivate();
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
@@ -1,86 +1,156 @@
 #include "blur.hpp"
+#include <cmath>
+#include <locale>
+#include <map>
+#include <sstream>
 
 static const char *gaussian_vertex_shader =
     R"(
 #version 100
 
 attribute mediump vec2 position;
-uniform vec2 size;
-uniform float offset;
 
-varying highp vec2 blurcoord[5];
+varying highp vec2 texcoord;
 
 void main() {
     gl_Position = vec4(position.xy, 0.0, 1.0);
-
-    vec2 texcoord = (position.xy + vec2(1.0, 1.0)) / 2.0;
-
-    blurcoord[0] = texcoord;
-    blurcoord[1] = texcoord + vec2(1.5 * offset) / size;
-    blurcoord[2] = texcoord - vec2(1.5 * offset) / size;
-    blurcoord[3] = texcoord + vec2(3.5 * offset) / size;
-    blurcoord[4] = texcoord - vec2(3.5 * offset) / size;
+    texcoord = (position.xy + vec2(1.0, 1.0)) / 2.0;
 }
 )";
 
-static const char *gaussian_fragment_shader_horz =
-    R"(
-#version 100
-precision mediump float;
+/**
+ * A gaussian kernel in which pairs of neighbouring taps are merged into one
+ * linearly interpolated texture fetch.
+ */
+struct gaussian_kernel_t
+{
+    std::vector<float> offsets;
+    std::vector<float> weights;
+};
 
-uniform sampler2D bg_texture;
-uniform int mode;
+static gaussian_kernel_t generate_kernel(int radius, double sigma)
+{
+    std::vector<double> discrete(radius + 1);
+    double sum = 0;
+    for (int i = 0; i <= radius; i++)
+    {
+        discrete[i] = std::exp(-(i * i) / (2.0 * sigma * sigma));
+        sum += (i == 0 ? 1 : 2) * discrete[i];
+    }
+
+    gaussian_kernel_t kernel;
+    kernel.offsets.push_back(0);
+    kernel.weights.push_back(discrete[0] / sum);
+    for (int i = 1; i <= radius; i += 2)
+    {
+        double w1 = discrete[i];
+        double w2 = (i + 1 <= radius) ? discrete[i + 1] : 0.0;
+        kernel.offsets.push_back((i * w1 + (i + 1) * w2) / (w1 + w2));
+        kernel.weights.push_back((w1 + w2) / sum);
+    }
 
-varying highp vec2 blurcoord[5];
+    return kernel;
+}
 
-void main()
+/**
+ * Generate the fragment shader for one pass of the kernel.
+ * @param direction The GLSL expression for the direction of the pass.
+ */
+static std::string generate_fragment_shader(const gaussian_kernel_t& kernel,
+    const std::string& direction)
 {
-    vec2 uv = blurcoord[0];
-    vec4 bp = vec4(0.0);
-    bp += texture2D(bg_texture, vec2(blurcoord[0].x, uv.y)) * 0.204164;
-    bp += texture2D(bg_texture, vec2(blurcoord[1].x, uv.y)) * 0.304005;
-    bp += texture2D(bg_texture, vec2(blurcoord[2].x, uv.y)) * 0.304005;
-    bp += texture2D(bg_texture, vec2(blurcoord[3].x, uv.y)) * 0.093913;
-    bp += texture2D(bg_texture, vec2(blurcoord[4].x, uv.y)) * 0.093913;
-    gl_FragColor = bp;
-})";
-
-static const char *gaussian_fragment_shader_vert =
-    R"(
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    out << std::fixed;
+    out << R"(
 #version 100
 precision mediump float;
 
 uniform sampler2D bg_texture;
-uniform int mode;
+uniform vec2 size;
+uniform float offset;
 
-varying highp vec2 blurcoord[5];
+varying highp vec2 texcoord;
 
 void main()
 {
-    vec2 uv = blurcoord[0];
-    vec4 bp = vec4(0.0);
-    bp += texture2D(bg_texture, vec2(uv.x, blurcoord[0].y)) * 0.204164;
-    bp += texture2D(bg_texture, vec2(uv.x, blurcoord[1].y)) * 0.304005;
-    bp += texture2D(bg_texture, vec2(uv.x, blurcoord[2].y)) * 0.304005;
-    bp += texture2D(bg_texture, vec2(uv.x, blurcoord[3].y)) * 0.093913;
-    bp += texture2D(bg_texture, vec2(uv.x, blurcoord[4].y)) * 0.093913;
-    gl_FragColor = bp;
-})";
+    vec2 dir_step = )" << direction << R"( * offset / size;
+    vec4 bp = texture2D(bg_texture, texcoord) * )" << kernel.weights[0] << ";\n";
+
+    for (size_t i = 1; i < kernel.offsets.size(); i++)
+    {
+        out << "    bp += texture2D(bg_texture, texcoord + dir_step * " <<
+            kernel.offsets[i] << ") * " << kernel.weights[i] << ";\n";
+        out << "    bp += texture2D(bg_texture, texcoord - dir_step * " <<
+            kernel.offsets[i] << ") * " << kernel.weights[i] << ";\n";
+    }
+
+    out << "    gl_FragColor = bp;\n}";
+
+    return out.str();
+}
 
 class wf_gaussian_blur : public wf_blur_base
 {
+    wf::option_wrapper_t<int> radius_opt{"blur/gaussian_radius"};
+    wf::option_wrapper_t<double> sigma_opt{"blur/gaussian_sigma"};
+
+    /** The programs for the horizontal and the vertical pass of a kernel */
+    struct kernel_programs_t
+    {
+        OpenGL::program_t pass[2];
+        OpenGL::uniform_handle_t size[2], offset[2];
+    };
+
+    /* Programs are compiled once for each kernel that was used */
+    std::map<std::pair<int, double>, std::unique_ptr<kernel_programs_t>> kernels;
+
+    kernel_programs_t& get_kernel_programs()
+    {
+        int radius   = std::max((int)radius_opt, 1);
+        double sigma = std::max((double)sigma_opt, 0.1);
+
+        auto& programs = kernels[{radius, sigma}];
+        if (programs)
+        {
+            return *programs;
+        }
+
+        programs = std::make_unique<kernel_programs_t>();
+        auto kernel = generate_kernel(radius, sigma);
+        const std::string directions[2] = {"vec2(1.0, 0.0)", "vec2(0.0, 1.0)"};
+        for (int i = 0; i < 2; i++)
+        {
+            programs->pass[i].set_simple(OpenGL::compile_program(
+                gaussian_vertex_shader,
+                generate_fragment_shader(kernel, directions[i])));
+            programs->size[i]   = programs->pass[i].get_uniform("size");
+            programs->offset[i] = programs->pass[i].get_uniform("offset");
+        }
+
+        return *programs;
+    }
+
   public:
     wf_gaussian_blur(wf::output_t *output) : wf_blur_base(output, "gaussian")
+    {
+        options.add(radius_opt);
+        options.add(sigma_opt);
+    }
+
+    ~wf_gaussian_blur()
     {
         OpenGL::render_begin();
-        program[0].set_simple(OpenGL::compile_program(
-            gaussian_vertex_shader, gaussian_fragment_shader_horz));
-        program[1].set_simple(OpenGL::compile_program(
-            gaussian_vertex_shader, gaussian_fragment_shader_vert));
+        for (auto& kernel : kernels)
+        {
+            kernel.second->pass[0].free_resources();
+            kernel.second->pass[1].free_resources();
+        }
+
         OpenGL::render_end();
     }
 
-    void upload_data(int i, int width, int height)
+    void upload_data(kernel_programs_t& programs, int i, int width, int height)
     {
         float offset = offset_opt;
         static const float vertexData[] = {
@@ -90,45 +160,46 @@ class wf_gaussian_blur : public wf_blur_base
             -1.0f, 1.0f
         };
 
-        program[i].use(wf::TEXTURE_TYPE_RGBA);
-        program[i].uniform2f("size", width, height);
-        program[i].uniform1f("offset", offset);
-        program[i].attrib_pointer("position", 2, 0, vertexData);
+        programs.pass[i].use(wf::TEXTURE_TYPE_RGBA);
+        programs.pass[i].uniform2f(programs.size[i], width, height);
+        programs.pass[i].uniform1f(programs.offset[i], offset);
+        programs.pass[i].attrib_pointer("position", 2, 0, vertexData);
     }
 
-    void blur(const wf::region_t& blur_region, int i, int width, int height)
+    void blur(kernel_programs_t& programs, const wf::region_t& blur_region,
+        int i, int width, int height)
     {
-        program[i].use(wf::TEXTURE_TYPE_RGBA);
+        programs.pass[i].use(wf::TEXTURE_TYPE_RGBA);
         render_iteration(blur_region, fb[i], fb[!i], width, height);
     }
 
     int blur_fb0(const wf::region_t& blur_region, int width, int height) override
     {
-        int i, iterations = iterations_opt;
+        int i, iterations = get_iterations();
 
         OpenGL::render_begin();
-        GL_CALL(glDisable(GL_BLEND));
+        auto& programs = get_kernel_programs();
+        OpenGL::disable_blend();
         /* Enable our shader and pass some data to it. The shader
          * does gaussian blur on the background texture in two passes,
          * one horizontal and one vertical */
-        upload_data(0, width, height);
-        upload_data(1, width, height);
+        upload_data(programs, 0, width, height);
+        upload_data(programs, 1, width, height);
 
         for (i = 0; i < iterations; i++)
         {
             /* Blur horizontally */
-            blur(blur_region, 0, width, height);
+            blur(programs, blur_region, 0, width, height);
 
             /* Blur vertically */
-            blur(blur_region, 1, width, height);
+            blur(programs, blur_region, 1, width, height);
         }
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable_blend();
 
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-        program[1].deactivate();
+        programs.pass[1].deactivate();
         OpenGL::render_end();
 
         return 0;
@@ -136,7 +207,8 @@ class wf_gaussian_blur : public wf_blur_base
 
     int calculate_blur_radius() override
     {
-        return 4 * wf_blur_base::calculate_blur_radius();
+        return std::max((int)radius_opt, 1) *
+               wf_blur_base::calculate_blur_radius();
     }
 };
 
@@ -59,6 +59,8 @@ void main()
 
 class wf_kawase_blur : public wf_blur_base
 {
+    OpenGL::uniform_handle_t offset_uniform[2], halfpixel_uniform[2];
+
   public:
     wf_kawase_blur(wf::output_t *output) :
         wf_blur_base(output, "kawase")
@@ -69,11 +71,17 @@ class wf_kawase_blur : public wf_blur_base
         program[1].set_simple(OpenGL::compile_program(kawase_vertex_shader,
             kawase_fragment_shader_up));
         OpenGL::render_end();
+
+        for (int i = 0; i < 2; i++)
+        {
+            offset_uniform[i]    = program[i].get_uniform("offset");
+            halfpixel_uniform[i] = program[i].get_uniform("halfpixel");
+        }
     }
 
     int blur_fb0(const wf::region_t& blur_region, int width, int height) override
     {
-        int iterations = iterations_opt;
+        int iterations = get_iterations();
         float offset = offset_opt;
         int sampleWidth, sampleHeight;
 
@@ -92,8 +100,8 @@ class wf_kawase_blur : public wf_blur_base
         program[0].attrib_pointer("position", 2, 0, vertexData);
         /* Disable blending, because we may have transparent background, which
          * we want to render on uncleared framebuffer */
-        GL_CALL(glDisable(GL_BLEND));
-        program[0].uniform1f("offset", offset);
+        OpenGL::disable_blend();
+        program[0].uniform1f(offset_uniform[0], offset);
 
         for (int i = 0; i < iterations; i++)
         {
@@ -102,7 +110,7 @@ class wf_kawase_blur : public wf_blur_base
 
             auto region = blur_region * (1.0 / (1 << i));
 
-            program[0].uniform2f("halfpixel",
+            program[0].uniform2f(halfpixel_uniform[0],
                 0.5f / sampleWidth, 0.5f / sampleHeight);
             render_iteration(region, fb[i % 2], fb[1 - i % 2], sampleWidth,
                 sampleHeight);
@@ -113,7 +121,7 @@ class wf_kawase_blur : public wf_blur_base
         /* Upsample */
         program[1].use(wf::TEXTURE_TYPE_RGBA);
         program[1].attrib_pointer("position", 2, 0, vertexData);
-        program[1].uniform1f("offset", offset);
+        program[1].uniform1f(offset_uniform[1], offset);
         for (int i = iterations - 1; i >= 0; i--)
         {
             sampleWidth  = width / (1 << i);
@@ -121,15 +129,14 @@ class wf_kawase_blur : public wf_blur_base
 
             auto region = blur_region * (1.0 / (1 << i));
 
-            program[1].uniform2f("halfpixel",
+            program[1].uniform2f(halfpixel_uniform[1],
                 0.5f / sampleWidth, 0.5f / sampleHeight);
             render_iteration(region, fb[1 - i % 2], fb[i % 2], sampleWidth,
                 sampleHeight);
         }
 
         /* Reset gl state */
-        GL_CALL(glEnable(GL_BLEND));
-        GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+        OpenGL::enable_blend();
 
         program[1].deactivate();
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
@@ -140,7 +147,128 @@ class wf_kawase_blur : public wf_blur_base
 
     int calculate_blur_radius() override
     {
-        return pow(2, iterations_opt + 1) * offset_opt * degrade_opt;
+        return pow(2, get_iterations() + 1) * offset_opt * get_degrade();
+    }
+};
+
+/**
+ * Dual-filter kawase blur. Unlike wf_kawase_blur, every downsampling pass
+ * renders at half of the resolution of its input, and the upsampling passes
+ * go back up through the same chain of buffers. Each level of the chain has
+ * its own buffer, so buffers are not resized between the passes.
+ */
+class wf_dual_kawase_blur : public wf_blur_base
+{
+    /* levels[i] has 1/2^(i+1) of the size of fb[0] */
+    std::vector<wf::framebuffer_base_t> levels;
+    OpenGL::uniform_handle_t offset_uniform[2], halfpixel_uniform[2];
+
+  public:
+    wf_dual_kawase_blur(wf::output_t *output) :
+        wf_blur_base(output, "dual_kawase")
+    {
+        OpenGL::render_begin();
+        program[0].set_simple(OpenGL::compile_program(kawase_vertex_shader,
+            kawase_fragment_shader_down));
+        program[1].set_simple(OpenGL::compile_program(kawase_vertex_shader,
+            kawase_fragment_shader_up));
+        OpenGL::render_end();
+
+        for (int i = 0; i < 2; i++)
+        {
+            offset_uniform[i]    = program[i].get_uniform("offset");
+            halfpixel_uniform[i] = program[i].get_uniform("halfpixel");
+        }
+    }
+
+    ~wf_dual_kawase_blur()
+    {
+        OpenGL::render_begin();
+        for (auto& level : levels)
+        {
+            level.release();
+        }
+
+        OpenGL::render_end();
+    }
+
+    int blur_fb0(const wf::region_t& blur_region, int width, int height) override
+    {
+        int iterations = std::max(get_iterations(), 1);
+        float offset   = offset_opt;
+
+        if ((int)levels.size() < iterations)
+        {
+            levels.resize(iterations);
+        }
+
+        auto level_fb = [&] (int i) -> wf::framebuffer_base_t&
+        {
+            return i == 0 ? fb[0] : levels[i - 1];
+        };
+
+        /* Upload data to shader */
+        static const float vertexData[] = {
+            -1.0f, -1.0f,
+            1.0f, -1.0f,
+            1.0f, 1.0f,
+            -1.0f, 1.0f
+        };
+
+        OpenGL::render_begin();
+        /* Disable blending, because we may have transparent background, which
+         * we want to render on uncleared framebuffer */
+        OpenGL::disable_blend();
+
+        /* Downsample, from level i to level i + 1 */
+        program[0].use(wf::TEXTURE_TYPE_RGBA);
+        program[0].attrib_pointer("position", 2, 0, vertexData);
+        program[0].uniform1f(offset_uniform[0], offset);
+        for (int i = 0; i < iterations; i++)
+        {
+            int sample_width  = std::max(width / (1 << (i + 1)), 1);
+            int sample_height = std::max(height / (1 << (i + 1)), 1);
+
+            auto region = blur_region * (1.0 / (1 << (i + 1)));
+            program[0].uniform2f(halfpixel_uniform[0],
+                0.5f / sample_width, 0.5f / sample_height);
+            render_iteration(region, level_fb(i), level_fb(i + 1),
+                sample_width, sample_height);
+        }
+
+        program[0].deactivate();
+
+        /* Upsample, from level i + 1 to level i. The last pass renders to
+         * fb[1], so that fb[0] can be used as the next input. */
+        program[1].use(wf::TEXTURE_TYPE_RGBA);
+        program[1].attrib_pointer("position", 2, 0, vertexData);
+        program[1].uniform1f(offset_uniform[1], offset);
+        for (int i = iterations - 1; i >= 0; i--)
+        {
+            int sample_width  = std::max(width / (1 << i), 1);
+            int sample_height = std::max(height / (1 << i), 1);
+
+            auto region = blur_region * (1.0 / (1 << i));
+            program[1].uniform2f(halfpixel_uniform[1],
+                0.5f / sample_width, 0.5f / sample_height);
+            render_iteration(region, level_fb(i + 1),
+                i == 0 ? fb[1] : level_fb(i), sample_width, sample_height);
+        }
+
+        /* Reset gl state */
+        OpenGL::enable_blend();
+
+        program[1].deactivate();
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        OpenGL::render_end();
+
+        return 1;
+    }
+
+    int calculate_blur_radius() override
+    {
+        return pow(2, std::max(get_iterations(), 1) + 1) * offset_opt *
+               get_degrade();
     }
 };
 
@@ -148,3 +276,8 @@ std::unique_ptr<wf_blur_base> create_kawase_blur(wf::output_t *output)
 {
     return std::make_unique<wf_kawase_blur>(output);
 }
+
+std::unique_ptr<wf_blur_base> create_dual_kawase_blur(wf::output_t *output)
+{
+    return std::make_unique<wf_dual_kawase_blur>(output);
+}
@@ -2,6 +2,7 @@
 
 #include <wayfire/plugins/common/simple-texture.hpp>
 #include <cairo.h>
+#include <cstring>
 
 namespace wf
 {
@@ -9,28 +10,111 @@ struct simple_texture_t;
 }
 
 /**
- * Upload the data from the cairo surface to the OpenGL texture.
+ * Upload a part of the cairo surface to the OpenGL texture.
+ *
+ * The texture storage is reused while the size of the surface stays the same,
+ * in which case only the damaged part is uploaded. Otherwise, the texture is
+ * reallocated and the whole surface is uploaded.
  *
  * @param surface The source cairo surface.
  * @param buffer  The buffer to upload data to.
+ * @param damage  The part of the surface which changed, in surface coordinates.
+ * @param use_pbo Copy the data into a pixel unpack buffer first, so that the
+ *   driver can upload it without waiting for rendering which still uses the
+ *   texture. Useful for big surfaces which change often.
  */
-static void cairo_surface_upload_to_texture(
-    cairo_surface_t *surface, wf::simple_texture_t& buffer)
+static void cairo_surface_upload_to_texture(cairo_surface_t *surface,
+    wf::simple_texture_t& buffer, wf::geometry_t damage, bool use_pbo = false)
 {
-    buffer.width  = cairo_image_surface_get_width(surface);
-    buffer.height = cairo_image_surface_get_height(surface);
+    int width  = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    bool reallocate = (buffer.tex == (GLuint) - 1) ||
+        (buffer.width != width) || (buffer.height != height);
     if (buffer.tex == (GLuint) - 1)
     {
         GL_CALL(glGenTextures(1, &buffer.tex));
     }
 
-    auto src = cairo_image_surface_get_data(surface);
-
     GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
-    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
-    GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
-    GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-        buffer.width, buffer.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, src));
+    if (reallocate)
+    {
+        buffer.width  = width;
+        buffer.height = height;
+        damage = {0, 0, width, height};
+
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_BLUE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED));
+        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+            width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+        wf::gpu_memory::track(&buffer, size_t(width) * height * 4);
+    }
+
+    damage = wf::geometry_intersection(damage, {0, 0, width, height});
+    if ((damage.width <= 0) || (damage.height <= 0))
+    {
+        return;
+    }
+
+    cairo_surface_flush(surface);
+    auto src = cairo_image_surface_get_data(surface) +
+        size_t(damage.y) * stride + damage.x * 4;
+
+    void *mapped = nullptr;
+    size_t row   = size_t(damage.width) * 4;
+    if (use_pbo)
+    {
+        if (!buffer.pbo)
+        {
+            GL_CALL(glGenBuffers(1, &buffer.pbo));
+        }
+
+        /* Respecifying the storage orphans the data of the last upload, which
+         * may still be in use by the driver */
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.pbo));
+        GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, row * damage.height, NULL,
+            GL_STREAM_DRAW));
+        mapped = GL_CALL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+            row * damage.height, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!mapped)
+        {
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        }
+    }
+
+    if (mapped)
+    {
+        for (int y = 0; y < damage.height; y++)
+        {
+            std::memcpy((uint8_t*)mapped + y * row, src + y * stride, row);
+        }
+
+        GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, damage.x, damage.y,
+            damage.width, damage.height, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    } else
+    {
+        GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, stride / 4));
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, damage.x, damage.y,
+            damage.width, damage.height, GL_RGBA, GL_UNSIGNED_BYTE, src));
+        GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    }
+}
+
+/**
+ * Upload the data from the cairo surface to the OpenGL texture.
+ *
+ * @param surface The source cairo surface.
+ * @param buffer  The buffer to upload data to.
+ */
+static void cairo_surface_upload_to_texture(
+    cairo_surface_t *surface, wf::simple_texture_t& buffer)
+{
+    cairo_surface_upload_to_texture(surface, buffer, {0, 0,
+        cairo_image_surface_get_width(surface),
+        cairo_image_surface_get_height(surface)});
 }
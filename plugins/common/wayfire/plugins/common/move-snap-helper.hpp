@@ -5,6 +5,7 @@
 #include <wayfire/core.hpp>
 #include <wayfire/option-wrapper.hpp>
 #include <wayfire/plugins/wobbly/wobbly-signal.hpp>
+#include <wayfire/plugins/common/view-edge-index.hpp>
 #include <wayfire/util/log.hpp>
 #include <wayfire/debug.hpp>
 
@@ -17,6 +18,7 @@ namespace wf
  * 1. Interaction with the wobbly plugin
  * 2. Support for locking tiled views in-place until a certain threshold
  * 3. Ensuring view is grabbed at the correct place
+ * 4. Snapping to the edges of other views
  */
 class move_snap_helper_t : public wf::custom_data_t
 {
@@ -27,6 +29,8 @@ class move_snap_helper_t : public wf::custom_data_t
     wf::option_wrapper_t<bool> enable_snap_off{"move/enable_snap_off"};
     wf::option_wrapper_t<int> snap_off_threshold{"move/snap_off_threshold"};
     wf::option_wrapper_t<bool> join_views{"move/join_views"};
+    wf::option_wrapper_t<bool> snap_to_views{"move/snap_to_views"};
+    wf::option_wrapper_t<int> view_snap_threshold{"move/view_snap_threshold"};
 
     bool view_in_slot; /* Whether the view is held at its original position */
     double px, py; /* Percentage of the view width/height from the grab point
@@ -197,6 +201,14 @@ class move_snap_helper_t : public wf::custom_data_t
             int(last_grabbing_position.y - py * wmg.height),
         };
 
+        if (snap_to_views && view->get_output())
+        {
+            auto& index = view_edge_index_t::get(view->get_output());
+            auto snapped = index.snap({target_position.x, target_position.y,
+                wmg.width, wmg.height}, view_snap_threshold, enum_views(view));
+            target_position = {snapped.x, snapped.y};
+        }
+
         view->disconnect_signal("geometry-changed", &view_geometry_changed);
         view->move(target_position.x, target_position.y);
         view->connect_signal("geometry-changed", &view_geometry_changed);
@@ -1,12 +1,16 @@
+#pragma once
+
 #include <wayfire/geometry.hpp>
+#include <wayfire/output.hpp>
 #include <wayfire/render-manager.hpp>
-#include <wayfire/workspace-manager.hpp>
-#include <wayfire/compositor-view.hpp>
 
 #include "geometry-animation.hpp"
 #include <wayfire/option-wrapper.hpp>
 #include <wayfire/util/duration.hpp>
 
+#include <memory>
+#include <vector>
+
 namespace wf
 {
 using namespace wf::animation;
@@ -18,14 +22,15 @@ class preview_indication_animation_t : public geometry_animation_t
 };
 
 /**
- * A view which can be used to show previews for different actions on the
- * screen, for ex. when snapping a view
+ * A preview which can be used to show the target of different actions on the
+ * screen, for ex. when snapping a view. It is drawn as an overlay rectangle,
+ * see render_manager::add_overlay_rect().
+ *
+ * Previews are owned by their output. A preview is destroyed when the
+ * animation after closing it is over, or together with the output.
  */
-class preview_indication_view_t : public wf::color_rect_view_t
+class preview_indication_t
 {
-    wf::effect_hook_t pre_paint;
-    wf::output_t *output;
-
     /* Default colors */
     const wf::color_t base_color  = {0.5, 0.5, 1, 0.5};
     const wf::color_t base_border = {0.25, 0.25, 0.5, 0.8};
@@ -33,48 +38,65 @@ class preview_indication_view_t : public wf::color_rect_view_t
 
     preview_indication_animation_t animation;
     bool should_close = false;
+    wf::overlay_rect_t rect;
 
-  public:
-
-    /**
-     * Create a new indication preview on the indicated output.
-     *
-     * @param start_geometry The geometry the preview should have, relative to
-     *                       the output
-     */
-    preview_indication_view_t(wf::output_t *output, wf::geometry_t start_geometry) :
-        wf::color_rect_view_t(), animation(wf::create_option<int>(200))
+    preview_indication_t(wf::geometry_t start_geometry) :
+        animation(wf::create_option<int>(200))
     {
-        this->output = output;
-        set_output(output);
         animation.set_start(start_geometry);
         animation.set_end(start_geometry);
         animation.alpha.set(0, 1);
 
-        pre_paint = [=] () { update_animation(); };
-        get_output()->render->add_effect(&pre_paint, wf::OUTPUT_EFFECT_PRE);
-
-        set_color(base_color);
-        set_border_color(base_border);
-        set_border(base_border_w);
-
-        this->role = VIEW_ROLE_DESKTOP_ENVIRONMENT;
+        rect.geometry     = start_geometry;
+        rect.color        = base_color;
+        rect.border_color = base_border;
+        rect.border = base_border_w;
+        rect.color.a = rect.border_color.a = 0;
     }
 
-    void initialize() override
+    /**
+     * Update the rectangle to the current state of the animation.
+     *
+     * @return Whether the preview was closed and can be destroyed.
+     */
+    bool update_animation(wf::output_t *output)
     {
-        get_output()->workspace->add_view(self(), wf::LAYER_TOP);
+        wf::geometry_t current = animation;
+        double alpha = animation.alpha;
+        if ((current != rect.geometry) || (base_color.a * alpha != rect.color.a))
+        {
+            rect.geometry = current;
+            rect.color.a  = alpha * base_color.a;
+            rect.border_color.a = alpha * base_border.a;
+            output->render->update_overlay_rect(&rect);
+        }
+
+        return !animation.running() && should_close;
     }
 
+    friend class preview_indication_list_t;
+
+  public:
+    /**
+     * Create a new indication preview on the indicated output.
+     *
+     * @param start_geometry The geometry the preview should have, relative to
+     *                       the output
+     */
+    static nonstd::observer_ptr<preview_indication_t> create(
+        wf::output_t *output, wf::geometry_t start_geometry);
+
     /** A convenience wrapper around the full version */
-    preview_indication_view_t(wf::output_t *output, wf::point_t start) :
-        preview_indication_view_t(output, wf::geometry_t{start.x, start.y, 1, 1})
-    {}
+    static nonstd::observer_ptr<preview_indication_t> create(
+        wf::output_t *output, wf::point_t start)
+    {
+        return create(output, wf::geometry_t{start.x, start.y, 1, 1});
+    }
 
     /**
      * Animate the preview to the given target geometry and alpha.
      *
-     * @param close Whether the view should be closed when the target is
+     * @param close Whether the preview should be destroyed when the target is
      *              reached.
      */
     void set_target_geometry(wf::geometry_t target, float alpha, bool close = false)
@@ -97,37 +119,76 @@ class preview_indication_view_t : public wf::color_rect_view_t
         return set_target_geometry({point.x, point.y, 1, 1},
             alpha, should_close);
     }
+};
 
-    virtual ~preview_indication_view_t()
-    {
-        this->output->render->rem_effect(&pre_paint);
-    }
+/**
+ * The previews of an output. A single pre-paint hook animates all of them, and
+ * is active only while there are previews.
+ *
+ * The list is destroyed together with the output, after its render manager,
+ * so it must not use the render manager when destroyed.
+ */
+class preview_indication_list_t : public wf::custom_data_t
+{
+    wf::output_t *output;
+    std::vector<std::unique_ptr<preview_indication_t>> previews;
 
-  protected:
-    /** Update the current state */
-    void update_animation()
+    wf::effect_hook_t pre_paint = [=] ()
     {
-        wf::geometry_t current = animation;
-        if (current != geometry)
+        auto it = previews.begin();
+        while (it != previews.end())
         {
-            set_geometry(current);
+            if ((*it)->update_animation(output))
+            {
+                output->render->rem_overlay_rect(&(*it)->rect);
+                it = previews.erase(it);
+            } else
+            {
+                ++it;
+            }
         }
 
-        double alpha = animation.alpha;
-        if (base_color.a * alpha != _color.a)
+        if (previews.empty())
         {
-            _color.a = alpha * base_color.a;
-            _border_color.a = alpha * base_border.a;
-
-            set_color(_color);
-            set_border_color(_border_color);
+            output->render->rem_effect(&pre_paint);
+        } else
+        {
+            /* Make sure the end of the animations is reached */
+            output->render->schedule_redraw();
         }
+    };
 
-        /* The end of unmap animation, just exit */
-        if (!animation.running() && should_close)
+  public:
+    preview_indication_list_t(wf::output_t *output)
+    {
+        this->output = output;
+    }
+
+    nonstd::observer_ptr<preview_indication_t> add(
+        std::unique_ptr<preview_indication_t> preview)
+    {
+        if (previews.empty())
         {
-            close();
+            output->render->add_effect(&pre_paint, wf::OUTPUT_EFFECT_PRE);
         }
+
+        output->render->add_overlay_rect(&preview->rect);
+        previews.push_back(std::move(preview));
+
+        return nonstd::make_observer(previews.back().get());
     }
 };
+
+inline nonstd::observer_ptr<preview_indication_t> preview_indication_t::create(
+    wf::output_t *output, wf::geometry_t start_geometry)
+{
+    if (!output->has_data<preview_indication_list_t>())
+    {
+        output->store_data(std::make_unique<preview_indication_list_t>(output));
+    }
+
+    return output->get_data<preview_indication_list_t>()->add(
+        std::unique_ptr<preview_indication_t>(
+            new preview_indication_t(start_geometry)));
+}
 }
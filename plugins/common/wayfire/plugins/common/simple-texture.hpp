@@ -9,6 +9,8 @@ struct simple_texture_t : public noncopyable_t
     GLuint tex = -1;
     int width  = 0;
     int height = 0;
+    /** The pixel unpack buffer for staged uploads, or 0 */
+    GLuint pbo = 0;
 
     /**
      * Destroy the GL texture.
@@ -23,7 +25,14 @@ struct simple_texture_t : public noncopyable_t
 
         OpenGL::render_begin();
         GL_CALL(glDeleteTextures(1, &tex));
+        if (pbo)
+        {
+            GL_CALL(glDeleteBuffers(1, &pbo));
+            pbo = 0;
+        }
+
         OpenGL::render_end();
+        wf::gpu_memory::untrack(this);
         this->tex = -1;
     }
 
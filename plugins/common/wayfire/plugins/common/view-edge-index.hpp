@@ -0,0 +1,224 @@
+#pragma once
+
+#include <wayfire/output.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/workspace-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace wf
+{
+/**
+ * A sorted index of the window edges of the views on an output, so that the
+ * edges near a point can be found in O(log n) while moving a view.
+ *
+ * The index is updated incrementally when views are added to or removed from
+ * the output, and once per frame when their geometry changes. Whether a view
+ * is visible is checked only when querying.
+ */
+class view_edge_index_t : public wf::custom_data_t
+{
+    /** A vertical or horizontal edge, spanning [from, to) on the other axis */
+    struct edge_t
+    {
+        wf::view_interface_t *view;
+        int from, to;
+    };
+
+    using edge_map_t = std::multimap<int, edge_t>;
+
+    struct entry_t
+    {
+        /* Left and right edges in x_edges, top and bottom in y_edges */
+        edge_map_t::iterator edges[4];
+        wf::signal_connection_t on_geometry_changed;
+    };
+
+    wf::output_t *output;
+    edge_map_t x_edges, y_edges;
+    std::unordered_map<wf::view_interface_t*, std::unique_ptr<entry_t>> entries;
+
+    void insert_edges(wf::view_interface_t *view, entry_t& entry)
+    {
+        auto g = view->get_wm_geometry();
+        entry.edges[0] = x_edges.insert({g.x, {view, g.y, g.y + g.height}});
+        entry.edges[1] =
+            x_edges.insert({g.x + g.width, {view, g.y, g.y + g.height}});
+        entry.edges[2] = y_edges.insert({g.y, {view, g.x, g.x + g.width}});
+        entry.edges[3] =
+            y_edges.insert({g.y + g.height, {view, g.x, g.x + g.width}});
+    }
+
+    void erase_edges(entry_t& entry)
+    {
+        x_edges.erase(entry.edges[0]);
+        x_edges.erase(entry.edges[1]);
+        y_edges.erase(entry.edges[2]);
+        y_edges.erase(entry.edges[3]);
+    }
+
+    void add_view(wayfire_view view)
+    {
+        if (entries.count(view.get()))
+        {
+            return;
+        }
+
+        auto entry = std::make_unique<entry_t>();
+        auto raw   = view.get();
+        entry->on_geometry_changed.set_callback([=] (wf::signal_data_t*)
+        {
+            auto& e = *entries[raw];
+            erase_edges(e);
+            insert_edges(raw, e);
+        });
+
+        insert_edges(raw, *entry);
+        view->connect_signal("geometry-changed-frame",
+            &entry->on_geometry_changed);
+        entries[raw] = std::move(entry);
+    }
+
+    void remove_view(wayfire_view view)
+    {
+        auto it = entries.find(view.get());
+        if (it != entries.end())
+        {
+            erase_edges(*it->second);
+            entries.erase(it);
+        }
+    }
+
+    wf::signal_connection_t on_view_attached = [=] (wf::signal_data_t *data)
+    {
+        add_view(get_signaled_view(data));
+    };
+
+    wf::signal_connection_t on_view_detached = [=] (wf::signal_data_t *data)
+    {
+        remove_view(get_signaled_view(data));
+    };
+
+    bool can_snap_to(wf::view_interface_t *view,
+        const std::vector<wayfire_view>& exclude)
+    {
+        for (auto& v : exclude)
+        {
+            if (v.get() == view)
+            {
+                return false;
+            }
+        }
+
+        return view->is_mapped() && !view->minimized &&
+               (output->workspace->get_view_layer(view->self()) ==
+                   wf::LAYER_WORKSPACE);
+    }
+
+    /**
+     * Find the edge closest to value, within threshold, which overlaps the
+     * range [from, to) on the other axis.
+     *
+     * @return Whether such an edge was found. If so, value contains it.
+     */
+    bool find_closest(const edge_map_t& edges, int& value, int from, int to,
+        int threshold, const std::vector<wayfire_view>& exclude)
+    {
+        int best = threshold + 1;
+        int result = value;
+        auto it    = edges.lower_bound(value - threshold);
+        for (; (it != edges.end()) && (it->first <= value + threshold); ++it)
+        {
+            auto& edge = it->second;
+            if ((edge.from < to) && (from < edge.to) &&
+                (std::abs(it->first - value) < best) &&
+                can_snap_to(edge.view, exclude))
+            {
+                best   = std::abs(it->first - value);
+                result = it->first;
+            }
+        }
+
+        value = result;
+
+        return best <= threshold;
+    }
+
+  public:
+    view_edge_index_t(wf::output_t *output)
+    {
+        this->output = output;
+        for (auto& view : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
+        {
+            add_view(view);
+        }
+
+        output->connect_signal("view-layer-attached", &on_view_attached);
+        output->connect_signal("view-layer-detached", &on_view_detached);
+    }
+
+    /** @return The edge index of the output, created on first use. */
+    static view_edge_index_t& get(wf::output_t *output)
+    {
+        if (!output->has_data<view_edge_index_t>())
+        {
+            output->store_data(std::make_unique<view_edge_index_t>(output));
+        }
+
+        return *output->get_data<view_edge_index_t>();
+    }
+
+    /**
+     * Snap a box to the window edges of the other visible views on the
+     * workspace layer. Each axis is snapped separately, to the edge which is
+     * closest to either side of the box and overlaps it on the other axis.
+     *
+     * @param box The box to snap.
+     * @param threshold The maximal distance to an edge, in pixels.
+     * @param exclude Views whose edges should be ignored, for ex. the views
+     *   being moved.
+     *
+     * @return The snapped box.
+     */
+    wf::geometry_t snap(wf::geometry_t box, int threshold,
+        const std::vector<wayfire_view>& exclude)
+    {
+        int left  = box.x, right = box.x + box.width;
+        int top   = box.y, bottom = box.y + box.height;
+        bool snap_left = find_closest(x_edges, left, top, bottom, threshold,
+            exclude);
+        bool snap_right = find_closest(x_edges, right, top, bottom, threshold,
+            exclude);
+        if (snap_left && (!snap_right ||
+                          (std::abs(left - box.x) <=
+                           std::abs(right - box.x - box.width))))
+        {
+            box.x = left;
+        } else if (snap_right)
+        {
+            box.x = right - box.width;
+        }
+
+        bool snap_top = find_closest(y_edges, top, box.x, box.x + box.width,
+            threshold, exclude);
+        bool snap_bottom = find_closest(y_edges, bottom, box.x,
+            box.x + box.width, threshold, exclude);
+        if (snap_top && (!snap_bottom ||
+                         (std::abs(top - box.y) <=
+                          std::abs(bottom - box.y - box.height))))
+        {
+            box.y = top;
+        } else if (snap_bottom)
+        {
+            box.y = bottom - box.height;
+        }
+
+        return box;
+    }
+};
+}
@@ -4,9 +4,11 @@
 #include <wayfire/object.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/geometry.hpp>
+#include <wayfire/performance-governor.hpp>
 #include <wayfire/render-manager.hpp>
 #include <wayfire/workspace-stream.hpp>
 #include <wayfire/workspace-manager.hpp>
+#include <map>
 
 namespace wf
 {
@@ -15,6 +17,8 @@ namespace wf
  *
  * Using this interface allows all plugins to use the same OpenGL textures for
  * the workspaces, thereby reducing the memory overhead of a workspace stream.
+ * Streams are created when first used and destroyed when stopped, so big
+ * workspace grids cost only as much as the workspaces which are shown.
  */
 class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
 {
@@ -54,75 +58,101 @@ class workspace_stream_pool_t : public noncopyable_t, public wf::custom_data_t
     ~workspace_stream_pool_t()
     {
         OpenGL::render_begin();
-        for (auto& row : this->streams)
+        for (auto& stream : this->streams)
         {
-            for (auto& stream : row)
-            {
-                stream.buffer.release();
-            }
+            stream.second.buffer.release();
         }
 
         OpenGL::render_end();
     }
 
     /**
-     * Get the workspace stream for the given workspace
+     * Get the workspace stream for the given workspace. The reference stays
+     * valid until the stream is stopped.
      */
     wf::workspace_stream_t& get(wf::point_t workspace)
     {
-        return streams[workspace.x][workspace.y];
+        auto it = streams.find({workspace.x, workspace.y});
+        if (it == streams.end())
+        {
+            it = streams.emplace(std::piecewise_construct,
+                std::forward_as_tuple(workspace.x, workspace.y),
+                std::forward_as_tuple()).first;
+            it->second.ws = workspace;
+        }
+
+        return it->second;
     }
 
     /**
      * Update the contents of the given workspace.
      *
      * If the workspace has not been started before, it will be started.
+     *
+     * @param scale_x, scale_y The scale at which the workspace is going to be
+     *   shown, used to pick the level of detail of the stream. Note that all
+     *   users of the pool share the same streams. The performance governor
+     *   may halve the level of detail.
      */
-    void update(wf::point_t workspace)
+    void update(wf::point_t workspace, float scale_x = 1, float scale_y = 1)
     {
         auto& stream = get(workspace);
-        if (stream.running)
-        {
-            output->render->workspace_stream_update(stream);
-        } else
+        if (!stream.running)
         {
             output->render->workspace_stream_start(stream);
         }
+
+        if (wf::performance_governor_t::get().get_level() >=
+            wf::PERFORMANCE_LEVEL_LOW)
+        {
+            scale_x /= 2;
+            scale_y /= 2;
+        }
+
+        output->render->workspace_stream_update(stream, scale_x, scale_y);
     }
 
     /**
      * Stop the workspace stream.
+     *
+     * The buffer of the stream is freed too, so that workspaces which are no
+     * longer shown, e.g. after zooming into a workspace in expo, don't keep
+     * a buffer of up to the size of the output.
      */
     void stop(wf::point_t workspace)
     {
-        auto& stream = get(workspace);
+        auto it = streams.find({workspace.x, workspace.y});
+        if (it == streams.end())
+        {
+            return;
+        }
+
+        auto& stream = it->second;
         if (stream.running)
         {
             output->render->workspace_stream_stop(stream);
         }
+
+        if (stream.buffer.fb != (uint32_t)-1)
+        {
+            OpenGL::render_begin();
+            stream.buffer.release();
+            OpenGL::render_end();
+        }
+
+        streams.erase(it);
     }
 
   private:
     workspace_stream_pool_t(wf::output_t *output)
     {
         this->output = output;
-
-        auto wsize = this->output->workspace->get_workspace_grid_size();
-        this->streams.resize(wsize.width);
-        for (int i = 0; i < wsize.width; i++)
-        {
-            this->streams[i].resize(wsize.height);
-            for (int j = 0; j < wsize.height; j++)
-            {
-                this->streams[i][j].ws = {i, j};
-            }
-        }
     }
 
     /** Number of active users of this instance */
     uint32_t ref_count = 0;
 
     wf::output_t *output;
-    std::vector<std::vector<wf::workspace_stream_t>> streams;
+    std::map<std::pair<int, int>, wf::workspace_stream_t> streams;
 };
 }
@@ -2,6 +2,8 @@
 
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
 #include "workspace-stream-sharing.hpp"
 
 namespace wf
@@ -102,7 +104,8 @@ class workspace_wall_t : public wf::signal_provider_t
      */
     void render_wall(const wf::framebuffer_t& fb, wf::geometry_t geometry)
     {
-        update_streams();
+        update_streams(1.0 * geometry.width / std::max(1, viewport.width),
+            1.0 * geometry.height / std::max(1, viewport.height));
 
         OpenGL::render_begin(fb);
         fb.logic_scissor(geometry);
@@ -113,18 +116,24 @@ class workspace_wall_t : public wf::signal_provider_t
         /* After all transformations of the framebuffer, the workspace should
          * span the visible part of the OpenGL coordinate space. */
         const wf::geometry_t workspace_geometry = {-1, 1, 2, -2};
+        auto wall_projection = fb.get_orthographic_projection() * wall_matrix;
+
+        /* All visible workspaces are drawn in one batch, so that the GL state
+         * is set up once for the whole wall. */
+        wall_entries.clear();
         for (auto& ws : get_visible_workspaces(this->viewport))
         {
-            auto ws_matrix = calculate_workspace_matrix(ws);
-            OpenGL::render_transformed_texture(
-                streams->get(ws).buffer.tex, workspace_geometry,
-                fb.get_orthographic_projection() * wall_matrix * ws_matrix);
+            wall_entries.push_back({streams->get(ws).buffer.tex,
+                workspace_geometry,
+                wall_projection * calculate_workspace_matrix(ws)});
         }
 
+        OpenGL::render_transformed_texture_batch(wall_entries);
         OpenGL::render_end();
 
         wall_frame_event_t data{fb};
-        this->emit_signal("frame", &data);
+        static const wf::signal_id_t frame_signal{"frame"};
+        this->emit_signal(frame_signal, &data);
     }
 
     /**
@@ -202,13 +211,19 @@ class workspace_wall_t : public wf::signal_provider_t
 
     wf::geometry_t viewport = {0, 0, 0, 0};
     nonstd::observer_ptr<workspace_stream_pool_t> streams;
+    /* Reused between frames, see render_wall() */
+    std::vector<OpenGL::transformed_texture_entry_t> wall_entries;
 
-    /** Update or start visible streams */
-    void update_streams()
+    /**
+     * Update or start visible streams.
+     *
+     * @param scale_x, scale_y The scale at which workspaces are shown.
+     */
+    void update_streams(float scale_x, float scale_y)
     {
         for (auto& ws : get_visible_workspaces(viewport))
         {
-            streams->update(ws);
+            streams->update(ws, scale_x, scale_y);
         }
     }
 
@@ -219,9 +234,25 @@ class workspace_wall_t : public wf::signal_provider_t
     {
         std::vector<wf::point_t> visible;
         auto wsize = output->workspace->get_workspace_grid_size();
-        for (int i = 0; i < wsize.width; i++)
+        auto size  = output->get_screen_size();
+
+        /* Only the workspaces in the range covered by the viewport can
+         * intersect it, there is no need to test the whole grid. */
+        auto first = [] (int start, int pitch)
+        {
+            return (int)std::floor(1.0 * start / pitch);
+        };
+        int pitch_x = std::max(1, size.width + gap_size);
+        int pitch_y = std::max(1, size.height + gap_size);
+        int x1 = std::max(0, first(viewport.x, pitch_x));
+        int y1 = std::max(0, first(viewport.y, pitch_y));
+        int x2 = std::min(wsize.width - 1,
+            first(viewport.x + viewport.width - 1, pitch_x));
+        int y2 = std::min(wsize.height - 1,
+            first(viewport.y + viewport.height - 1, pitch_y));
+        for (int i = x1; i <= x2; i++)
         {
-            for (int j = 0; j < wsize.height; j++)
+            for (int j = y1; j <= y2; j++)
             {
                 if (viewport & get_workspace_rectangle({i, j}))
                 {
@@ -23,6 +23,9 @@
 #define ZOOM_MAX 10.0f
 #define ZOOM_MIN 0.1f
 
+/* Smallest scale at which a workspace stream is rendered */
+#define STREAM_SCALE_MIN 0.1f
+
 #ifdef USE_GLES32
     #include <GLES3/gl32.h>
 #endif
@@ -59,6 +62,11 @@ class wayfire_cube : public wf::plugin_interface_t
     std::string last_background_mode;
     std::unique_ptr<wf_cube_background_base> background;
 
+    /* The program and the background, freed by core when the cube has not
+     * been used for a while. The background is created again on the next
+     * frame. */
+    std::unique_ptr<wf::gpu_memory::releasable_t> gpu_resources;
+
     wf::option_wrapper_t<std::string> background_mode{"cube/background_mode"};
 
     void reload_background()
@@ -89,6 +97,19 @@ class wayfire_cube : public wf::plugin_interface_t
 
     bool tessellation_support;
 
+    /** How each side of the cube is shown in the current frame */
+    enum face_state_t
+    {
+        /* Outside of the screen, not drawn at all */
+        FACE_HIDDEN,
+        /* Facing away from the camera, drawn with the last contents */
+        FACE_BACK,
+        /* Facing the camera, its stream is updated */
+        FACE_FRONT,
+    };
+
+    std::vector<face_state_t> face_states;
+
     int get_num_faces()
     {
         return output->workspace->get_workspace_grid_size().width;
@@ -169,6 +190,23 @@ class wayfire_cube : public wf::plugin_interface_t
         OpenGL::render_begin(output->render->get_target_framebuffer());
         load_program();
         OpenGL::render_end();
+
+        /* The background image is usually about as large as the output */
+        auto og = output->get_relative_geometry();
+        gpu_resources = std::make_unique<wf::gpu_memory::releasable_t>(
+            size_t(og.width) * og.height * 4, [=] ()
+        {
+            OpenGL::render_begin();
+            program.free_resources();
+            OpenGL::render_end();
+            background.reset();
+            last_background_mode.clear();
+        }, [=] ()
+        {
+            OpenGL::render_begin();
+            load_program();
+            OpenGL::render_end();
+        });
     }
 
     void load_program()
@@ -206,7 +244,7 @@ class wayfire_cube : public wf::plugin_interface_t
             GL_CALL(glAttachShader(id, fss));
 
             GL_CALL(glLinkProgram(id));
-            GL_CALL(glUseProgram(id));
+            OpenGL::use_program(id);
 
             GL_CALL(glDeleteShader(vss));
             GL_CALL(glDeleteShader(fss));
@@ -270,6 +308,7 @@ class wayfire_cube : public wf::plugin_interface_t
             return false;
         }
 
+        gpu_resources->use();
         wf::get_core().connect_signal("pointer_motion", &on_motion_event);
         output->render->set_renderer(renderer);
         output->render->schedule_redraw();
@@ -429,12 +468,87 @@ class wayfire_cube : public wf::plugin_interface_t
         animation.view = zoom_translate * rotation * view;
     }
 
-    void update_workspace_streams()
+    /**
+     * Find out whether the i-th side of the cube is visible, and what part of
+     * the output it covers at most.
+     *
+     * @param scale Set to the fraction of the output size covered by the side.
+     */
+    face_state_t get_face_state(int i, const wf::framebuffer_t& dest, float& scale)
+    {
+        scale = 1.0f;
+        auto model = calculate_model_matrix(i, dest.transform);
+        auto mvp   = calculate_vp_matrix(dest) * model;
+
+        float min_x = 1e9, max_x = -1e9, min_y = 1e9, max_y = -1e9;
+        for (float x : {-0.5f, 0.5f})
+        {
+            for (float y : {-0.5f, 0.5f})
+            {
+                auto clip = mvp * glm::vec4{x, y, 0, 1};
+                if (clip.w <= 1e-3)
+                {
+                    /* Partly behind the camera, the projection doesn't help */
+                    return FACE_FRONT;
+                }
+
+                min_x = std::min(min_x, clip.x / clip.w);
+                max_x = std::max(max_x, clip.x / clip.w);
+                min_y = std::min(min_y, clip.y / clip.w);
+                max_y = std::max(max_y, clip.y / clip.w);
+            }
+        }
+
+        /* A deformed side may bulge out of its projected corners */
+        if (!(tessellation_support && use_deform) &&
+            ((max_x < -1) || (min_x > 1) || (max_y < -1) || (min_y > 1)))
+        {
+            return FACE_HIDDEN;
+        }
+
+        scale = std::max(max_x - min_x, max_y - min_y) / 2.0f;
+        scale = std::min(1.0f, std::max(scale, STREAM_SCALE_MIN));
+
+        /* Compare the outer normal of the side with the direction to the camera
+         * in the coordinate system of the cube */
+        float zoom_factor = animation.cube_animation.zoom;
+        auto scale_matrix = glm::scale(glm::mat4(1.0),
+            glm::vec3(1. / zoom_factor, 1. / zoom_factor, 1. / zoom_factor));
+        auto camera = glm::inverse(animation.view * scale_matrix) *
+            glm::vec4{0, 0, 0, 1};
+
+        auto side_model = model * dest.transform;
+        auto center     = side_model * glm::vec4{0, 0, 0, 1};
+        auto normal     = side_model * glm::vec4{0, 0, 1, 0};
+        if (glm::dot(glm::vec3(normal), glm::vec3(camera - center)) < 0)
+        {
+            return FACE_BACK;
+        }
+
+        return FACE_FRONT;
+    }
+
+    /**
+     * Update the streams of the visible sides, each at the resolution at which
+     * it is shown. Sides which face away from the camera are covered by the
+     * others, so their streams are kept as they are, unless they have never
+     * been rendered.
+     */
+    void update_workspace_streams(const wf::framebuffer_t& dest)
     {
         auto cws = output->workspace->get_current_workspace();
+        face_states.resize(get_num_faces());
         for (int i = 0; i < get_num_faces(); i++)
         {
-            streams->update({i, cws.y});
+            float scale;
+            face_states[i] = get_face_state(i, dest, scale);
+
+            wf::point_t ws = {(cws.x + i) % get_num_faces(), cws.y};
+            if ((face_states[i] == FACE_FRONT) ||
+                ((face_states[i] == FACE_BACK) && !streams->get(ws).running))
+            {
+                streams->update(ws, scale, scale);
+            }
         }
     }
 
@@ -479,6 +593,11 @@ class wayfire_cube : public wf::plugin_interface_t
         auto cws = output->workspace->get_current_workspace();
         for (int i = 0; i < get_num_faces(); i++)
         {
+            if (face_states[i] == FACE_HIDDEN)
+            {
+                continue;
+            }
+
             int index = (cws.x + i) % get_num_faces();
             GL_CALL(glBindTexture(GL_TEXTURE_2D,
                 streams->get({index, cws.y}).buffer.tex));
@@ -501,7 +620,8 @@ class wayfire_cube : public wf::plugin_interface_t
 
     void render(const wf::framebuffer_t& dest)
     {
-        update_workspace_streams();
+        gpu_resources->use();
+        update_workspace_streams(dest);
         if (program.get_program_id(wf::TEXTURE_TYPE_RGBA) == 0)
         {
             load_program();
@@ -652,6 +772,7 @@ class wayfire_cube : public wf::plugin_interface_t
 
         streams->unref();
 
+        gpu_resources.reset();
         OpenGL::render_begin();
         program.free_resources();
         OpenGL::render_end();
@@ -40,6 +40,14 @@ void wf_cube_background_cubemap::reload_texture()
 
     last_background_image = background_image;
 
+    /* Large images take a while to decode, so keep showing the old texture
+     * until the new one is ready */
+    image_loader.load(last_background_image,
+        [=] (const image_io::image_t *image) { upload_texture(image); });
+}
+
+void wf_cube_background_cubemap::upload_texture(const image_io::image_t *image)
+{
     OpenGL::render_begin();
     if (tex == (uint32_t)-1)
     {
@@ -49,10 +57,10 @@ void wf_cube_background_cubemap::reload_texture()
     }
 
     GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, tex));
-    if (!image_io::load_from_file(last_background_image, GL_TEXTURE_CUBE_MAP))
+    if (!image || !image_io::upload_image(*image, GL_TEXTURE_CUBE_MAP))
     {
-        LOGE("Failed to load cubemap background image from \"%s\".",
-            last_background_image.c_str());
+        LOGE("Failed to load cubemap background image from \"",
+            last_background_image, "\".");
 
         GL_CALL(glDeleteTextures(1, &tex));
         GL_CALL(glDeleteBuffers(1, &vbo_cube_vertices));
@@ -63,7 +71,7 @@ void wf_cube_background_cubemap::reload_texture()
     if (tex != (uint32_t)-1)
     {
         GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
-            GL_LINEAR));
+            GL_LINEAR_MIPMAP_LINEAR));
         GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER,
             GL_LINEAR));
         GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,
@@ -84,6 +92,15 @@ void wf_cube_background_cubemap::render_frame(const wf::framebuffer_t& fb,
     reload_texture();
 
     OpenGL::render_begin(fb);
+    if ((tex == (uint32_t)-1) && image_loader.is_loading())
+    {
+        GL_CALL(glClearColor(0, 0, 0, 1));
+        GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+        OpenGL::render_end();
+
+        return;
+    }
+
     if (tex == (uint32_t)-1)
     {
         GL_CALL(glClearColor(TEX_ERROR_FLAG_COLOR));
@@ -133,7 +150,7 @@ void wf_cube_background_cubemap::render_frame(const wf::framebuffer_t& fb,
 
     GLint vertex = glGetAttribLocation(program.get_program_id(
         wf::TEXTURE_TYPE_RGBA), "position");
-    glEnableVertexAttribArray(vertex);
+    OpenGL::enable_vertex_attrib(vertex);
     glVertexAttribPointer(vertex, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
     auto model = glm::rotate(glm::mat4(1.0),
@@ -2,6 +2,7 @@
 #define WF_CUBE_CUBEMAP_HPP
 
 #include "cube-background.hpp"
+#include <wayfire/img.hpp>
 
 class wf_cube_background_cubemap : public wf_cube_background_base
 {
@@ -14,6 +15,7 @@ class wf_cube_background_cubemap : public wf_cube_background_base
 
   private:
     void reload_texture();
+    void upload_texture(const image_io::image_t *image);
     void create_program();
 
     OpenGL::program_t program;
@@ -22,6 +24,8 @@ class wf_cube_background_cubemap : public wf_cube_background_base
     GLuint ibo_cube_indices;
 
     std::string last_background_image;
+    /* Decodes the image in the background, see reload_texture() */
+    image_io::async_image_loader_t image_loader;
     wf::option_wrapper_t<std::string> background_image{"cube/cubemap_image"};
 };
 
@@ -22,7 +22,12 @@ wf_cube_background_skydome::wf_cube_background_skydome(wf::output_t *output)
 wf_cube_background_skydome::~wf_cube_background_skydome()
 {
     OpenGL::render_begin();
-    program.deactivate();
+    program.free_resources();
+    if (tex != (uint32_t)-1)
+    {
+        GL_CALL(glDeleteTextures(1, &tex));
+    }
+
     OpenGL::render_end();
 }
 
@@ -41,6 +46,15 @@ void wf_cube_background_skydome::reload_texture()
     }
 
     last_background_image = background_image;
+
+    /* Large images take a while to decode, so keep showing the old texture
+     * until the new one is ready */
+    image_loader.load(last_background_image,
+        [=] (const image_io::image_t *image) { upload_texture(image); });
+}
+
+void wf_cube_background_skydome::upload_texture(const image_io::image_t *image)
+{
     OpenGL::render_begin();
 
     if (tex == (uint32_t)-1)
@@ -50,16 +64,16 @@ void wf_cube_background_skydome::reload_texture()
 
     GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
 
-    if (image_io::load_from_file(last_background_image, GL_TEXTURE_2D))
+    if (image && image_io::upload_image(*image, GL_TEXTURE_2D))
     {
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+            GL_LINEAR_MIPMAP_LINEAR));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     } else
     {
-        LOGE("Failed to load skydome image from \"%s\".",
-            last_background_image.c_str());
+        LOGE("Failed to load skydome image from \"", last_background_image, "\".");
         GL_CALL(glDeleteTextures(1, &tex));
         tex = -1;
     }
@@ -130,6 +144,14 @@ void wf_cube_background_skydome::render_frame(const wf::framebuffer_t& fb,
     fill_vertices();
     reload_texture();
 
+    if ((tex == (uint32_t)-1) && image_loader.is_loading())
+    {
+        GL_CALL(glClearColor(0, 0, 0, 1));
+        GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
+
+        return;
+    }
+
     if (tex == (uint32_t)-1)
     {
         GL_CALL(glClearColor(TEX_ERROR_FLAG_COLOR));
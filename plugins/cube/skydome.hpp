@@ -3,6 +3,7 @@
 
 #include "cube-background.hpp"
 #include "wayfire/output.hpp"
+#include <wayfire/img.hpp>
 #include <vector>
 
 class wf_cube_background_skydome : public wf_cube_background_base
@@ -20,6 +21,7 @@ class wf_cube_background_skydome : public wf_cube_background_base
     void load_program();
     void fill_vertices();
     void reload_texture();
+    void upload_texture(const image_io::image_t *image);
 
     OpenGL::program_t program;
     GLuint tex = -1;
@@ -29,6 +31,8 @@ class wf_cube_background_skydome : public wf_cube_background_base
     std::vector<GLuint> indices;
 
     std::string last_background_image;
+    /* Decodes the image in the background, see reload_texture() */
+    image_io::async_image_loader_t image_loader;
     int last_mirror = -1;
     wf::option_wrapper_t<std::string> background_image{"cube/skydome_texture"};
     wf::option_wrapper_t<bool> mirror_opt{"cube/skydome_mirror"};
@@ -1,7 +1,6 @@
 #include "deco-button.hpp"
 #include "deco-theme.hpp"
 #include <wayfire/opengl.hpp>
-#include <wayfire/plugins/common/cairo-util.hpp>
 
 #define HOVERED  1.0
 #define NORMAL   0.0
@@ -66,11 +65,14 @@ void button_t::set_pressed(bool is_pressed)
 void button_t::render(const wf::framebuffer_t& fb, wf::geometry_t geometry,
     wf::geometry_t scissor)
 {
-    OpenGL::render_begin(fb);
+    if (!button_texture)
+    {
+        return;
+    }
+
     fb.logic_scissor(scissor);
-    OpenGL::render_texture(button_texture.tex, fb, geometry, {1, 1, 1, 1},
+    OpenGL::render_texture(button_texture->tex, fb, geometry, {1, 1, 1, 1},
         OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
-    OpenGL::render_end();
 
     if (this->hover.running())
     {
@@ -93,11 +95,7 @@ void button_t::update_texture()
         .hover_progress = hover,
     };
 
-    auto surface = theme.get_button_surface(type, state);
-    OpenGL::render_begin();
-    cairo_surface_upload_to_texture(surface, this->button_texture);
-    OpenGL::render_end();
-    cairo_surface_destroy(surface);
+    this->button_texture = theme.get_button_texture(type, state);
 }
 
 void button_t::add_idle_damage()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <wayfire/util.hpp>
 #include <wayfire/opengl.hpp>
@@ -60,6 +61,7 @@ class button_t : public noncopyable_t
     /**
      * Render the button on the given framebuffer at the given coordinates.
      * Precondition: set_button_type() has been called, otherwise result is no-op
+     * Must be called between OpenGL::render_begin() and render_end().
      *
      * @param buffer The target framebuffer
      * @param geometry The geometry of the button, in logical coordinates
@@ -73,7 +75,7 @@ class button_t : public noncopyable_t
 
     /* Whether the button needs repaint */
     button_type_t type;
-    wf::simple_texture_t button_texture;
+    std::shared_ptr<wf::simple_texture_t> button_texture;
 
     /* Whether the button is currently being hovered */
     bool is_hovered = false;
@@ -3,6 +3,7 @@
 #include <wayfire/core.hpp>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
+#include <algorithm>
 
 #define BUTTON_ASPECT_RATIO (25.0 / 16.0)
 #define BUTTON_HEIGHT_PC 0.8
@@ -156,6 +157,77 @@ void decoration_layout_t::resize(int width, int height)
     border_geometry = {0, height - border_size, width, border_size};
     this->layout_areas.push_back(std::make_unique<decoration_area_t>(
         DECORATION_AREA_RESIZE_BOTTOM, border_geometry));
+
+    build_grid();
+    cursor_edges = -1;
+}
+
+void decoration_layout_t::build_grid()
+{
+    grid_x.clear();
+    grid_y.clear();
+    for (auto& area : layout_areas)
+    {
+        auto g = area->get_geometry();
+        grid_x.push_back(g.x);
+        grid_x.push_back(g.x + g.width);
+        grid_y.push_back(g.y);
+        grid_y.push_back(g.y + g.height);
+    }
+
+    for (auto coords : {&grid_x, &grid_y})
+    {
+        std::sort(coords->begin(), coords->end());
+        coords->erase(std::unique(coords->begin(), coords->end()),
+            coords->end());
+    }
+
+    grid.clear();
+    for (size_t j = 0; j + 1 < grid_y.size(); j++)
+    {
+        for (size_t i = 0; i + 1 < grid_x.size(); i++)
+        {
+            /* All points of a cell are covered by the same areas */
+            wf::point_t corner = {grid_x[i], grid_y[j]};
+            cell_t cell;
+            for (auto& area : layout_areas)
+            {
+                if (!(area->get_geometry() & corner))
+                {
+                    continue;
+                }
+
+                if (!cell.area)
+                {
+                    cell.area = area.get();
+                }
+
+                if (area->get_type() & DECORATION_AREA_RESIZE_BIT)
+                {
+                    cell.edges |= (area->get_type() & ~DECORATION_AREA_RESIZE_BIT);
+                }
+            }
+
+            grid.push_back(cell);
+        }
+    }
+}
+
+const decoration_layout_t::cell_t*decoration_layout_t::find_cell(
+    wf::point_t point) const
+{
+    auto x = std::upper_bound(grid_x.begin(), grid_x.end(), point.x);
+    auto y = std::upper_bound(grid_y.begin(), grid_y.end(), point.y);
+    if ((x == grid_x.begin()) || (x == grid_x.end()) ||
+        (y == grid_y.begin()) || (y == grid_y.end()))
+    {
+        return nullptr;
+    }
+
+    size_t i = x - grid_x.begin() - 1;
+    size_t j = y - grid_y.begin() - 1;
+
+    return &grid[j * (grid_x.size() - 1) + i];
 }
 
 /**
@@ -285,39 +357,29 @@ decoration_layout_t::action_response_t decoration_layout_t::handle_press_event(
 nonstd::observer_ptr<decoration_area_t> decoration_layout_t::find_area_at(
     wf::point_t point)
 {
-    for (auto& area : this->layout_areas)
-    {
-        if (area->get_geometry() & point)
-        {
-            return {area};
-        }
-    }
+    auto cell = find_cell(point);
 
-    return nullptr;
+    return cell ? nonstd::make_observer(cell->area) : nullptr;
 }
 
 /** Calculate resize edges based on @current_input */
 uint32_t decoration_layout_t::calculate_resize_edges() const
 {
-    uint32_t edges = 0;
-    for (auto& area : layout_areas)
-    {
-        if (area->get_geometry() & this->current_input)
-        {
-            if (area->get_type() & DECORATION_AREA_RESIZE_BIT)
-            {
-                edges |= (area->get_type() & ~DECORATION_AREA_RESIZE_BIT);
-            }
-        }
-    }
+    auto cell = find_cell(current_input);
 
-    return edges;
+    return cell ? cell->edges : 0;
 }
 
-/** Update the cursor based on @current_input */
-void decoration_layout_t::update_cursor() const
+/** Update the cursor based on @current_input, if it changed */
+void decoration_layout_t::update_cursor()
 {
-    uint32_t edges   = calculate_resize_edges();
+    uint32_t edges = calculate_resize_edges();
+    if (edges == cursor_edges)
+    {
+        return;
+    }
+
+    cursor_edges = edges;
     auto cursor_name = edges > 0 ?
         wlr_xcursor_get_resize_name((wlr_edges)edges) : "default";
     wf::get_core().set_cursor(cursor_name);
@@ -325,6 +387,8 @@ void decoration_layout_t::update_cursor() const
 
 void decoration_layout_t::handle_focus_lost()
 {
+    /* Other surfaces set their own cursor in the meantime */
+    cursor_edges = -1;
     if (is_grabbed)
     {
         this->is_grabbed = false;
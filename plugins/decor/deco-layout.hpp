@@ -149,6 +149,26 @@ class decoration_layout_t
 
     std::vector<std::unique_ptr<decoration_area_t>> layout_areas;
 
+    /**
+     * A lookup grid of the layout, built on resize(). The edges of the areas
+     * split the layout into cells, each of which is covered by the same areas.
+     */
+    struct cell_t
+    {
+        /* The first area covering the cell, as found by find_area_at() */
+        decoration_area_t *area = nullptr;
+        /* The resize edges of the areas covering the cell */
+        uint32_t edges = 0;
+    };
+
+    /* The sorted cell boundaries, and the cells, row by row */
+    std::vector<int> grid_x, grid_y;
+    std::vector<cell_t> grid;
+
+    /* The resize edges the cursor was last set for, or -1 if it needs to be
+     * set again */
+    int64_t cursor_edges = -1;
+
     bool is_grabbed = false;
     /* Position where the grab has started */
     wf::point_t grab_origin;
@@ -158,10 +178,15 @@ class decoration_layout_t
     /** Create buttons in the layout, and return their total geometry */
     wf::geometry_t create_buttons(int width, int height);
 
+    /** Build the lookup grid from the layout areas */
+    void build_grid();
+    /** @return The cell of the lookup grid at the given point, if any */
+    const cell_t *find_cell(wf::point_t point) const;
+
     /** Calculate resize edges based on @current_input */
     uint32_t calculate_resize_edges() const;
-    /** Update the cursor based on @current_input */
-    void update_cursor() const;
+    /** Update the cursor based on @current_input, if it changed */
+    void update_cursor();
 
     /**
      * Find the layout area at the given coordinates, if any
@@ -15,8 +15,6 @@
 #include "deco-layout.hpp"
 #include "deco-theme.hpp"
 
-#include <wayfire/plugins/common/cairo-util.hpp>
-
 #include <cairo.h>
 
 class simple_decoration_surface : public wf::surface_interface_t,
@@ -35,21 +33,29 @@ class simple_decoration_surface : public wf::surface_interface_t,
         }
     };
 
+    /* Title textures are rendered for widths in steps of this many logical
+     * pixels, so that they are not rasterized again on each resize */
+    static constexpr int TITLE_WIDTH_STEP = 128;
+
     void update_title(int width, int height, double scale)
     {
-        int target_width  = width * scale;
+        int bucket = std::max(1,
+            (width + TITLE_WIDTH_STEP - 1) / TITLE_WIDTH_STEP) * TITLE_WIDTH_STEP;
+        int target_width  = bucket * scale;
         int target_height = height * scale;
 
-        if ((title_texture.tex.width != target_width) ||
-            (title_texture.tex.height != target_height) ||
-            (title_texture.current_text != view->get_title()))
+        auto title = view->get_title();
+        if (!title_texture.tex ||
+            (title_texture.tex->width != target_width) ||
+            (title_texture.tex->height != target_height) ||
+            (title_texture.current_text != title))
         {
-            auto surface = theme.render_text(view->get_title(),
+            title_texture.tex = theme.get_text_texture(title,
                 target_width, target_height);
-            cairo_surface_upload_to_texture(surface, title_texture.tex);
-            cairo_surface_destroy(surface);
-            title_texture.current_text = view->get_title();
+            title_texture.current_text = std::move(title);
         }
+
+        title_texture.width = bucket;
     }
 
     int width = 100, height = 100;
@@ -58,8 +64,10 @@ class simple_decoration_surface : public wf::surface_interface_t,
 
     struct
     {
-        wf::simple_texture_t tex;
+        std::shared_ptr<wf::simple_texture_t> tex;
         std::string current_text = "";
+        /* The width of the texture in logical pixels */
+        int width = 0;
     } title_texture;
 
     wf::decor::decoration_theme_t theme;
@@ -100,11 +108,24 @@ class simple_decoration_surface : public wf::surface_interface_t,
         return {width, height};
     }
 
-    void render_title(const wf::framebuffer_t& fb,
-        wf::geometry_t geometry)
+    /**
+     * Render the title, which is left-aligned in its texture. The texture can
+     * be wider than the title area, so it is cut off at the end of the area.
+     */
+    void render_title(const wf::framebuffer_t& fb, wf::geometry_t geometry,
+        const wlr_box& scissor)
     {
-        update_title(geometry.width, geometry.height, fb.scale);
-        OpenGL::render_texture(title_texture.tex.tex, fb, geometry,
+        auto texture_geometry = geometry;
+        texture_geometry.width = title_texture.width;
+
+        auto clip = wf::geometry_intersection(geometry, scissor);
+        if ((clip.width <= 0) || (clip.height <= 0))
+        {
+            return;
+        }
+
+        fb.logic_scissor(clip);
+        OpenGL::render_texture(title_texture.tex->tex, fb, texture_geometry,
             glm::vec4(1.0f), OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
     }
 
@@ -116,15 +137,11 @@ class simple_decoration_surface : public wf::surface_interface_t,
         theme.render_background(fb, geometry, scissor, active);
 
         /* Draw title & buttons */
-        auto renderables = layout.get_renderable_areas();
-        for (auto item : renderables)
+        for (auto item : layout.get_renderable_areas())
         {
             if (item->get_type() == wf::decor::DECORATION_AREA_TITLE)
             {
-                OpenGL::render_begin(fb);
-                fb.logic_scissor(scissor);
-                render_title(fb, item->get_geometry() + origin);
-                OpenGL::render_end();
+                render_title(fb, item->get_geometry() + origin, scissor);
             } else // button
             {
                 item->as_button().render(fb,
@@ -138,11 +155,31 @@ class simple_decoration_surface : public wf::surface_interface_t,
     {
         wf::region_t frame = this->cached_region + wf::point_t{x, y};
         frame &= damage;
+        if (frame.empty())
+        {
+            return;
+        }
 
+        /* Uploads the title texture if needed, so it must happen outside of
+         * the render_begin()/render_end() block */
+        for (auto item : layout.get_renderable_areas())
+        {
+            if (item->get_type() == wf::decor::DECORATION_AREA_TITLE)
+            {
+                auto title_geometry = item->get_geometry();
+                update_title(title_geometry.width, title_geometry.height,
+                    fb.scale);
+            }
+        }
+
+        /* The whole frame is drawn in a single rendering block */
+        OpenGL::render_begin(fb);
         for (const auto& box : frame)
         {
             render_scissor_box(fb, {x, y}, wlr_box_from_pixman_box(box));
         }
+
+        OpenGL::render_end();
     }
 
     bool accepts_input(int32_t sx, int32_t sy) override
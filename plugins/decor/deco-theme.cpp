@@ -1,8 +1,12 @@
 #include "deco-theme.hpp"
 #include <wayfire/core.hpp>
 #include <wayfire/opengl.hpp>
+#include <wayfire/img.hpp>
+#include <wayfire/plugins/common/cairo-util.hpp>
 #include <config.h>
+#include <cmath>
 #include <map>
+#include <tuple>
 
 namespace wf
 {
@@ -27,7 +31,8 @@ int decoration_theme_t::get_border_size() const
 /**
  * Fill the given rectange with the background color(s).
  *
- * @param fb The target framebuffer, must have been bound already
+ * @param fb The target framebuffer. Must be called between
+ *   OpenGL::render_begin() and render_end().
  * @param rectangle The rectangle to redraw.
  * @param scissor The GL scissor rectangle to use.
  * @param active Whether to use active or inactive colors
@@ -36,10 +41,8 @@ void decoration_theme_t::render_background(const wf::framebuffer_t& fb,
     wf::geometry_t rectangle, const wf::geometry_t& scissor, bool active) const
 {
     wf::color_t color = active ? active_color : inactive_color;
-    OpenGL::render_begin(fb);
     fb.logic_scissor(scissor);
     OpenGL::render_rectangle(rectangle, color, fb.get_orthographic_projection());
-    OpenGL::render_end();
 }
 
 /**
@@ -72,6 +75,103 @@ cairo_surface_t*decoration_theme_t::render_text(std::string text,
     return surface;
 }
 
+/**
+ * A cache of textures which are shared between decorations. The cache holds
+ * only weak references, textures are freed when the last user drops them.
+ */
+template<class Key>
+class texture_cache_t : public noncopyable_t
+{
+  public:
+    std::shared_ptr<wf::simple_texture_t> get(const Key& key,
+        std::function<cairo_surface_t*()> render)
+    {
+        auto it = textures.find(key);
+        if (it != textures.end())
+        {
+            if (auto texture = it->second.lock())
+            {
+                return texture;
+            }
+        }
+
+        /* Drop entries whose textures are no longer used */
+        for (auto entry = textures.begin(); entry != textures.end();)
+        {
+            entry = entry->second.expired() ?
+                textures.erase(entry) : std::next(entry);
+        }
+
+        auto texture = std::make_shared<wf::simple_texture_t>();
+        auto surface = render();
+        OpenGL::render_begin();
+        cairo_surface_upload_to_texture(surface, *texture);
+        OpenGL::render_end();
+        cairo_surface_destroy(surface);
+
+        textures[key] = texture;
+        return texture;
+    }
+
+  private:
+    std::map<Key, std::weak_ptr<wf::simple_texture_t>> textures;
+};
+
+/** Titles are keyed by text, font, width and height */
+static texture_cache_t<std::tuple<std::string, std::string, int, int>>
+title_cache;
+
+std::shared_ptr<wf::simple_texture_t> decoration_theme_t::get_text_texture(
+    const std::string& text, int width, int height) const
+{
+    auto key = std::make_tuple(text, (std::string)font, width, height);
+    return title_cache.get(key, [&] ()
+    {
+        return render_text(text, width, height);
+    });
+}
+
+/**
+ * Convert an image decoded by image_io to a cairo surface, premultiplying its
+ * alpha.
+ */
+static cairo_surface_t *surface_from_image(const image_io::image_t& image)
+{
+    if (image.compressed_format)
+    {
+        return nullptr;
+    }
+
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+        image.width, image.height);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+    {
+        cairo_surface_destroy(surface);
+
+        return nullptr;
+    }
+
+    cairo_surface_flush(surface);
+    uint8_t *data = cairo_image_surface_get_data(surface);
+    int stride    = cairo_image_surface_get_stride(surface);
+    for (int y = 0; y < image.height; y++)
+    {
+        auto row = (uint32_t*)(data + y * stride);
+        for (int x = 0; x < image.width; x++)
+        {
+            const uint8_t *pixel =
+                &image.pixels[(size_t(y) * image.width + x) * image.channels];
+            uint32_t alpha = (image.channels == 4) ? pixel[3] : 255;
+            row[x] = (alpha << 24) | ((pixel[0] * alpha / 255) << 16) |
+                ((pixel[1] * alpha / 255) << 8) | (pixel[2] * alpha / 255);
+        }
+    }
+
+    cairo_surface_mark_dirty(surface);
+
+    return surface;
+}
+
 static struct icon_cache_t : public noncopyable_t
 {
     ~icon_cache_t()
@@ -107,8 +207,14 @@ static struct icon_cache_t : public noncopyable_t
                 assert(false);
             }
 
-            cached_icons[type] =
-                cairo_image_surface_create_from_png(resource_path.c_str());
+            /* Decoded through image_io, so that the icons share its cache */
+            auto image = image_io::decode_file(resource_path);
+            cached_icons[type] = image ? surface_from_image(*image) : nullptr;
+            if (!cached_icons[type])
+            {
+                cached_icons[type] =
+                    cairo_image_surface_create_from_png(resource_path.c_str());
+            }
         }
 
         return cached_icons[type];
@@ -161,5 +267,28 @@ cairo_surface_t*decoration_theme_t::get_button_surface(button_type_t button,
 
     return button_surface;
 }
+
+/** Buttons are keyed by type, size, border and hover progress */
+static texture_cache_t<std::tuple<button_type_t, int, int, int, int>>
+button_cache;
+
+std::shared_ptr<wf::simple_texture_t> decoration_theme_t::get_button_texture(
+    button_type_t button, const button_state_t& state) const
+{
+    /* Sharing textures is more important than following the hover animation
+     * exactly */
+    const int HOVER_STEPS = 32;
+    int hover = std::round(state.hover_progress * HOVER_STEPS);
+
+    button_state_t rounded = state;
+    rounded.hover_progress = 1.0 * hover / HOVER_STEPS;
+
+    auto key = std::make_tuple(button, state.width, state.height, state.border,
+        hover);
+    return button_cache.get(key, [&] ()
+    {
+        return get_button_surface(button, rounded);
+    });
+}
 }
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include <wayfire/render-manager.hpp>
+#include <wayfire/plugins/common/simple-texture.hpp>
+#include <memory>
 #include "deco-button.hpp"
 
 namespace wf
@@ -24,7 +26,8 @@ class decoration_theme_t
     /**
      * Fill the given rectange with the background color(s).
      *
-     * @param fb The target framebuffer, must have been bound already.
+     * @param fb The target framebuffer. Must be called between
+     *   OpenGL::render_begin() and render_end().
      * @param rectangle The rectangle to redraw.
      * @param scissor The GL scissor rectangle to use.
      * @param active Whether to use active or inactive colors
@@ -38,6 +41,16 @@ class decoration_theme_t
      */
     cairo_surface_t *render_text(std::string text, int width, int height) const;
 
+    /**
+     * Get a texture with the given text, as rendered by render_text().
+     *
+     * Textures are shared between all decorations which show the same text
+     * with the same font and size, for as long as any of them uses it.
+     * Must not be called between OpenGL::render_begin() and render_end().
+     */
+    std::shared_ptr<wf::simple_texture_t> get_text_texture(
+        const std::string& text, int width, int height) const;
+
     struct button_state_t
     {
         /** Button width */
@@ -61,6 +74,16 @@ class decoration_theme_t
     cairo_surface_t *get_button_surface(button_type_t button,
         const button_state_t& state) const;
 
+    /**
+     * Get a texture with the icon for the given button, as rendered by
+     * get_button_surface(). The hover progress is rounded, so that buttons in
+     * the same (or nearly the same) state share their texture.
+     *
+     * Must not be called between OpenGL::render_begin() and render_end().
+     */
+    std::shared_ptr<wf::simple_texture_t> get_button_texture(
+        button_type_t button, const button_state_t& state) const;
+
   private:
     wf::option_wrapper_t<std::string> font{"decoration/font"};
     wf::option_wrapper_t<int> title_height{"decoration/title_height"};
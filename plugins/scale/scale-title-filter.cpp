@@ -1,6 +1,10 @@
 #include <cctype>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
 #include <wayfire/plugin.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/signal-definitions.hpp>
@@ -41,6 +45,186 @@ struct scale_key_repeat_t
     }
 };
 
+/**
+ * Index of the case-folded titles and app ids of the views on an output.
+ *
+ * Each view is indexed by the trigrams (sequences of three bytes) of its title
+ * and app id, so a filter of at least three bytes is checked only against the
+ * views which contain all of its trigrams. A view is indexed again only after
+ * its title or app id has changed.
+ */
+class scale_title_index_t
+{
+  public:
+    using fold_t = std::function<void (std::string&)>;
+
+    scale_title_index_t(fold_t fold) : fold(fold)
+    {}
+
+    /** Forget all views, for ex. when the case folding rules have changed. */
+    void clear()
+    {
+        entries.clear();
+        postings.clear();
+    }
+
+    void remove(wayfire_view view)
+    {
+        auto it = entries.find(view.get());
+        if (it != entries.end())
+        {
+            unlink(view.get(), *it->second);
+            entries.erase(it);
+        }
+    }
+
+    /** Index the view, or index it again if its title or app id changed. */
+    void update(wayfire_view view)
+    {
+        auto& entry = entries[view.get()];
+        if (!entry)
+        {
+            entry = std::make_unique<entry_t>();
+            entry->on_changed.set_callback([raw = entry.get()] (wf::signal_data_t*)
+            {
+                raw->dirty = true;
+            });
+            view->connect_signal("title-changed", &entry->on_changed);
+            view->connect_signal("app-id-changed", &entry->on_changed);
+        }
+
+        if (!entry->dirty)
+        {
+            return;
+        }
+
+        unlink(view, *entry);
+        entry->title  = view->get_title();
+        entry->app_id = view->get_app_id();
+        fold(entry->title);
+        fold(entry->app_id);
+
+        entry->trigrams.clear();
+        add_trigrams(entry->title, entry->trigrams);
+        add_trigrams(entry->app_id, entry->trigrams);
+        std::sort(entry->trigrams.begin(), entry->trigrams.end());
+        entry->trigrams.erase(std::unique(entry->trigrams.begin(),
+            entry->trigrams.end()), entry->trigrams.end());
+        for (auto trigram : entry->trigrams)
+        {
+            postings[trigram].insert(view.get());
+        }
+
+        entry->dirty = false;
+    }
+
+    /**
+     * Find the views whose title or app id contains the folded filter.
+     *
+     * @param views The views to search if the filter is too short to use the
+     *   trigrams. They must have been updated before.
+     */
+    std::unordered_set<wf::view_interface_t*> find(const std::string& filter,
+        const std::vector<wayfire_view>& views) const
+    {
+        std::unordered_set<wf::view_interface_t*> result;
+        if (filter.length() < 3)
+        {
+            for (auto& view : views)
+            {
+                if (contains(view.get(), filter))
+                {
+                    result.insert(view.get());
+                }
+            }
+
+            return result;
+        }
+
+        /* Only the views with the rarest trigram of the filter can match */
+        std::vector<uint32_t> trigrams;
+        add_trigrams(filter, trigrams);
+        const std::unordered_set<wf::view_interface_t*> *candidates = nullptr;
+        for (auto trigram : trigrams)
+        {
+            auto it = postings.find(trigram);
+            if (it == postings.end())
+            {
+                return result;
+            }
+
+            if (!candidates || (it->second.size() < candidates->size()))
+            {
+                candidates = &it->second;
+            }
+        }
+
+        for (auto view : *candidates)
+        {
+            if (contains(view, filter))
+            {
+                result.insert(view);
+            }
+        }
+
+        return result;
+    }
+
+  private:
+    struct entry_t
+    {
+        bool dirty = true;
+        std::string title, app_id;
+        std::vector<uint32_t> trigrams;
+        wf::signal_connection_t on_changed;
+    };
+
+    fold_t fold;
+    std::unordered_map<wf::view_interface_t*, std::unique_ptr<entry_t>> entries;
+    std::unordered_map<uint32_t,
+        std::unordered_set<wf::view_interface_t*>> postings;
+
+    static void add_trigrams(const std::string& text, std::vector<uint32_t>& out)
+    {
+        for (size_t i = 0; i + 2 < text.length(); i++)
+        {
+            out.push_back(((uint32_t)(unsigned char)text[i] << 16) |
+                ((uint32_t)(unsigned char)text[i + 1] << 8) |
+                (uint32_t)(unsigned char)text[i + 2]);
+        }
+    }
+
+    bool contains(wf::view_interface_t *view, const std::string& filter) const
+    {
+        auto it = entries.find(view);
+        if (it == entries.end())
+        {
+            return false;
+        }
+
+        return (it->second->title.find(filter) != std::string::npos) ||
+               (it->second->app_id.find(filter) != std::string::npos);
+    }
+
+    void unlink(wf::view_interface_t *view, const entry_t& entry)
+    {
+        for (auto trigram : entry.trigrams)
+        {
+            auto it = postings.find(trigram);
+            if (it == postings.end())
+            {
+                continue;
+            }
+
+            it->second.erase(view);
+            if (it->second.empty())
+            {
+                postings.erase(it);
+            }
+        }
+    }
+};
+
 class scale_title_filter : public wf::plugin_interface_t
 {
     wf::option_wrapper_t<bool> case_sensitive{"scale-title-filter/case_sensitive"};
@@ -69,24 +253,13 @@ class scale_title_filter : public wf::plugin_interface_t
         std::transform(string.begin(), string.end(), string.begin(), transform);
     }
 
-    bool should_show_view(wayfire_view view)
-    {
-        if (title_filter.empty())
-        {
-            return true;
-        }
-
-        auto title  = view->get_title();
-        auto app_id = view->get_app_id();
-        auto filter = title_filter;
-
-        fix_case(title);
-        fix_case(app_id);
-        fix_case(filter);
+    scale_title_index_t index{[=] (std::string& string) { fix_case(string); }};
+    bool indexed_case_sensitive = false;
 
-        return (title.find(filter) != std::string::npos) ||
-               (app_id.find(filter) != std::string::npos);
-    }
+    wf::signal_connection_t on_view_disappeared = [=] (wf::signal_data_t *data)
+    {
+        index.remove(get_signaled_view(data));
+    };
 
   public:
     void init() override
@@ -96,6 +269,8 @@ class scale_title_filter : public wf::plugin_interface_t
 
         output->connect_signal("scale-filter", &view_filter);
         output->connect_signal("scale-end", &scale_end);
+        output->connect_signal("view-disappeared", &on_view_disappeared);
+        indexed_case_sensitive = case_sensitive;
     }
 
     void fini() override
@@ -104,6 +279,8 @@ class scale_title_filter : public wf::plugin_interface_t
         output->disconnect_signal(&view_filter);
         wf::get_core().disconnect_signal(&scale_key);
         output->disconnect_signal(&scale_end);
+        output->disconnect_signal(&on_view_disappeared);
+        index.clear();
     }
 
     wf::signal_connection_t view_filter{[this] (wf::signal_data_t *data)
@@ -114,10 +291,30 @@ class scale_title_filter : public wf::plugin_interface_t
                 scale_running = true;
             }
 
+            if (title_filter.empty())
+            {
+                return;
+            }
+
+            if (indexed_case_sensitive != case_sensitive)
+            {
+                indexed_case_sensitive = case_sensitive;
+                index.clear();
+            }
+
+            auto filter = title_filter;
+            fix_case(filter);
+
             auto signal = static_cast<scale_filter_signal*>(data);
-            scale_filter_views(signal, [this] (wayfire_view v)
+            for (auto& view : signal->views_shown)
+            {
+                index.update(view);
+            }
+
+            auto matching = index.find(filter, signal->views_shown);
+            scale_filter_views(signal, [&] (wayfire_view v)
             {
-                return !should_show_view(v);
+                return !matching.count(v.get());
             });
         }
     };
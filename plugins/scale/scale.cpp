@@ -12,6 +12,9 @@
 #include <wayfire/plugins/vswitch.hpp>
 #include <wayfire/touch/touch.hpp>
 #include <wayfire/plugins/scale-signal.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/util.hpp>
+#include <cmath>
 
 #include <linux/input-event-codes.h>
 
@@ -34,18 +37,172 @@ struct wf_scale_animation_attribs
     scale_animation_t scale_animation{duration};
 };
 
+/**
+ * Shared by the scale transformers of all outputs, so that the snapshots of
+ * many views are not all refreshed in the same frame.
+ */
+struct scale_snapshot_budget_t : public wf::custom_data_t
+{
+    wf::option_wrapper_t<int> budget{"scale/snapshot_budget"};
+    int used = 0;
+    wf::wl_idle_call reset;
+
+    /** @return Whether another snapshot may be refreshed in this frame */
+    bool take()
+    {
+        if ((budget > 0) && (used >= budget))
+        {
+            return false;
+        }
+
+        if (used++ == 0)
+        {
+            /* All outputs which repaint together do so before going idle */
+            reset.run_once([=] ()
+            {
+                used = 0;
+            });
+        }
+
+        return true;
+    }
+};
+
 class wf_scale : public wf::view_2D
 {
+    wf::option_wrapper_t<int> snapshot_rate{"scale/snapshot_rate"};
+
+    /* The view scaled down to about the size of its slot. Sampling the full
+     * size contents of every view on every frame is expensive, so the
+     * snapshot is drawn instead, and it is refreshed at most snapshot_rate
+     * times per second, unless the view is focused or hovered. */
+    wf::framebuffer_t snapshot;
+    bool has_snapshot = false;
+    uint32_t last_refresh = 0;
+    wf::wl_timer refresh_timer;
+    bool refresh_pending = false;
+
+    bool is_live()
+    {
+        return (snapshot_rate <= 0) || view->activated ||
+               (wf::get_core().get_cursor_focus_view() == view);
+    }
+
+    void release_snapshot()
+    {
+        if (snapshot.fb != uint32_t(-1))
+        {
+            OpenGL::render_begin();
+            snapshot.release();
+            OpenGL::render_end();
+        }
+
+        has_snapshot = false;
+    }
+
+    /**
+     * Make sure the snapshot has enough resolution for the given size, without
+     * reallocating it on every frame while the scale animation runs.
+     *
+     * @return true if the snapshot has to be drawn again.
+     */
+    bool resize_snapshot(int width, int height)
+    {
+        bool too_small = (snapshot.viewport_width < width) ||
+            (snapshot.viewport_height < height);
+        bool too_large = (snapshot.viewport_width > 2 * width) &&
+            (snapshot.viewport_height > 2 * height);
+        if (has_snapshot && !too_small && !too_large)
+        {
+            return false;
+        }
+
+        /* Leave some room for growing while zooming out */
+        OpenGL::render_begin();
+        if (snapshot.allocate(width * 3 / 2, height * 3 / 2))
+        {
+            wf::gpu_memory::set_owner(&snapshot, "scale");
+        }
+
+        OpenGL::render_end();
+
+        return true;
+    }
+
   public:
     wf_scale(wayfire_view view) : wf::view_2D(view)
     {}
     ~wf_scale()
-    {}
+    {
+        release_snapshot();
+    }
 
     uint32_t get_z_order() override
     {
         return wf::TRANSFORMER_HIGHLEVEL + 1;
     }
+
+    void render_with_damage(wf::texture_t src_tex, wlr_box src_box,
+        const wf::region_t& damage, const wf::framebuffer_t& target_fb) override
+    {
+        int width  = std::ceil(src_box.width * scale_x * target_fb.scale);
+        int height = std::ceil(src_box.height * scale_y * target_fb.scale);
+        if (is_live() || (width <= 0) || (height <= 0) ||
+            (width * 2 > src_box.width * target_fb.scale))
+        {
+            /* Not scaled down enough for a snapshot to be worth it */
+            release_snapshot();
+            view_2D::render_with_damage(src_tex, src_box, damage, target_fb);
+
+            return;
+        }
+
+        uint32_t now = wf::get_current_time();
+        uint32_t refresh_ms = 1000 / snapshot_rate;
+        bool resized = resize_snapshot(width, height);
+        bool due     = (now - last_refresh >= refresh_ms);
+        if (resized || (snapshot.geometry != src_box) ||
+            (due && wf::get_core().get_data_safe<scale_snapshot_budget_t>()->take()))
+        {
+            snapshot.geometry = src_box;
+            OpenGL::render_begin(snapshot);
+            snapshot.logic_scissor(src_box);
+            OpenGL::clear({0, 0, 0, 0});
+            OpenGL::render_texture(src_tex, snapshot, src_box);
+            OpenGL::render_end();
+
+            has_snapshot = true;
+            last_refresh = now;
+        } else if (!refresh_pending)
+        {
+            /* The contents may have changed meanwhile, show them once the
+             * snapshot may be refreshed again, or in one of the next frames
+             * if this frame's budget was used up. */
+            refresh_pending = true;
+            uint32_t wait = due ? 1 : refresh_ms - (now - last_refresh);
+            refresh_timer.set_timeout(wait, [=] ()
+            {
+                refresh_pending = false;
+                view->damage();
+
+                return false;
+            });
+        }
+
+        view_2D::render_with_damage(wf::texture_t{snapshot.tex}, src_box, damage,
+            target_fb);
+    }
+};
+
+/**
+ * name: scale-toggle-all-outputs
+ * on: core
+ * when: The toggle_all_outputs binding was activated on some output.
+ */
+struct scale_toggle_all_outputs_signal : public wf::signal_data_t
+{
+    /** Whether scale should be activated or deactivated on every output */
+    bool activate;
 };
 
 struct view_scale_data
@@ -62,6 +219,9 @@ struct view_scale_data
     };
 
     view_visibility_t visibility = view_visibility_t::VISIBLE;
+    /* Where the view was shown in the previous frame. Popping the transformer
+     * repaints the output, so the bounds don't need to be ended. */
+    wf::animation_bounds_t bounds;
 };
 
 class wayfire_scale : public wf::plugin_interface_t
@@ -128,6 +288,11 @@ class wayfire_scale : public wf::plugin_interface_t
         output->add_activator(
             wf::option_wrapper_t<wf::activatorbinding_t>{"scale/toggle_all"},
             &toggle_all_cb);
+        output->add_activator(
+            wf::option_wrapper_t<wf::activatorbinding_t>{"scale/toggle_all_outputs"},
+            &toggle_all_outputs_cb);
+        wf::get_core().connect_signal("scale-toggle-all-outputs",
+            &on_toggle_all_outputs);
         output->connect_signal("scale-update", &update_cb);
 
         grab_interface->callbacks.keyboard.key = [=] (uint32_t key, uint32_t state)
@@ -135,6 +300,16 @@ class wayfire_scale : public wf::plugin_interface_t
             process_key(key, state);
         };
 
+        grab_interface->callbacks.keyboard.repeat = [=] (uint32_t key)
+        {
+            /* Only moving the selection makes sense while a key is held */
+            if ((key == KEY_UP) || (key == KEY_DOWN) ||
+                (key == KEY_LEFT) || (key == KEY_RIGHT))
+            {
+                process_key(key, WLR_KEY_PRESSED);
+            }
+        };
+
         grab_interface->callbacks.cancel = [=] ()
         {
             finalize();
@@ -277,6 +452,35 @@ class wayfire_scale : public wf::plugin_interface_t
         return false;
     };
 
+    /* Activate or deactivate scale for all workspaces on every output */
+    wf::activator_callback toggle_all_outputs_cb = [=] (auto)
+    {
+        scale_toggle_all_outputs_signal data;
+        data.activate = !active || !all_workspaces;
+        wf::get_core().emit_signal("scale-toggle-all-outputs", &data);
+
+        return true;
+    };
+
+    wf::signal_connection_t on_toggle_all_outputs = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<scale_toggle_all_outputs_signal*>(data);
+        if (ev->activate && !active)
+        {
+            all_workspaces = true;
+            activate();
+        } else if (ev->activate && !all_workspaces)
+        {
+            all_workspaces = true;
+            switch_scale_modes();
+        } else if (!ev->activate && active)
+        {
+            deactivate();
+        }
+
+        output->render->schedule_redraw();
+    };
+
     wf::signal_connection_t update_cb{[=] (wf::signal_data_t*)
         {
             if (active)
@@ -668,7 +872,6 @@ class wayfire_scale : public wf::plugin_interface_t
                 continue;
             }
 
-            view->damage();
             view_data.transformer->scale_x =
                 view_data.animation.scale_animation.scale_x;
             view_data.transformer->scale_y =
@@ -679,6 +882,8 @@ class wayfire_scale : public wf::plugin_interface_t
                 view_data.animation.scale_animation.translation_y;
             view_data.transformer->alpha = view_data.fade_animation;
             view->damage();
+            output->render->damage_animation_bounds(view_data.bounds,
+                view->get_bounding_box());
 
             if ((view_data.visibility ==
                  view_scale_data::view_visibility_t::HIDING) &&
@@ -763,7 +968,9 @@ class wayfire_scale : public wf::plugin_interface_t
             views.begin(), views.end(), get_top_parent(view)) != views.end();
     }
 
-    /* Convenience assignment function */
+    /* Convenience assignment function. Animations which already have the
+     * given targets are left alone, so that laying out the views again doesn't
+     * restart the animations of the views whose slot didn't change. */
     void setup_view_transform(view_scale_data& view_data,
         double scale_x,
         double scale_y,
@@ -771,6 +978,21 @@ class wayfire_scale : public wf::plugin_interface_t
         double translation_y,
         double target_alpha)
     {
+        auto& animation = view_data.animation.scale_animation;
+        if ((animation.scale_x.end == scale_x) &&
+            (animation.scale_y.end == scale_y) &&
+            (animation.translation_x.end == translation_x) &&
+            (animation.translation_y.end == translation_y))
+        {
+            if (view_data.fade_animation.end != target_alpha)
+            {
+                view_data.fade_animation.animate(view_data.transformer->alpha,
+                    target_alpha);
+            }
+
+            return;
+        }
+
         view_data.animation.scale_animation.scale_x.set(
             view_data.transformer->scale_x, scale_x);
         view_data.animation.scale_animation.scale_y.set(
@@ -1100,18 +1322,25 @@ class wayfire_scale : public wf::plugin_interface_t
         }
     };
 
-    /* View geometry changed. Also called when workspace changes */
+    /* View geometry changed. Also called when workspace changes.
+     *
+     * Clients usually commit several geometry changes in a row in response to
+     * scale's own changes, so the views are laid out only once afterwards. */
+    wf::wl_idle_call idle_relayout;
     wf::signal_connection_t view_geometry_changed{[this] (wf::signal_data_t *data)
         {
-            auto views = get_views();
-            if (!views.size())
+            idle_relayout.run_once([=] ()
             {
-                deactivate();
+                auto views = get_views();
+                if (!views.size())
+                {
+                    deactivate();
 
-                return;
-            }
+                    return;
+                }
 
-            layout_slots(std::move(views));
+                layout_slots(std::move(views));
+            });
         }
     };
 
@@ -1195,13 +1424,15 @@ class wayfire_scale : public wf::plugin_interface_t
         transform_views();
     };
 
-    /* Keep rendering until all animation has finished */
+    /* Keep rendering until all animation has finished. The frame in which the
+     * animations finished already shows their end state, so no further frame
+     * is needed afterwards. */
     wf::effect_hook_t post_hook = [=] ()
     {
-        output->render->schedule_redraw();
-
         if (animation_running())
         {
+            output->render->schedule_redraw();
+
             return;
         }
 
@@ -1289,6 +1520,7 @@ class wayfire_scale : public wf::plugin_interface_t
         view_minimized.disconnect();
         workspace_changed.disconnect();
         view_geometry_changed.disconnect();
+        idle_relayout.disconnect();
 
         grab_interface->ungrab();
         output->deactivate_plugin(grab_interface);
@@ -1332,6 +1564,7 @@ class wayfire_scale : public wf::plugin_interface_t
         view_minimized.disconnect();
         workspace_changed.disconnect();
         view_geometry_changed.disconnect();
+        idle_relayout.disconnect();
         output->deactivate_plugin(grab_interface);
     }
 
@@ -1367,6 +1600,7 @@ class wayfire_scale : public wf::plugin_interface_t
         finalize();
         output->rem_binding(&toggle_cb);
         output->rem_binding(&toggle_all_cb);
+        output->rem_binding(&toggle_all_outputs_cb);
     }
 };
 
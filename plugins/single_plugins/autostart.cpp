@@ -1,12 +1,59 @@
 #include <wayfire/singleton-plugin.hpp>
 #include <wayfire/core.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/workspace-manager.hpp>
+#include <wayfire/util.hpp>
 #include <wayfire/util/log.hpp>
 #include <wayfire/option-wrapper.hpp>
 #include <config.h>
 
+#include <algorithm>
+#include <deque>
+
+/**
+ * Autostart commands are launched in stages, so that heavy applications don't
+ * compete with the startup of the compositor and the shell:
+ *
+ * - now: right away, while the outputs are being set up.
+ * - frame: after the first frame was rendered.
+ * - panel: after a panel, i.e. a desktop-environment view in the top layer,
+ *   has mapped, or after autostart/panel_timeout.
+ * - idle: a while after the panel stage, once the desktop has settled.
+ *
+ * A stage starts only after the previous one, so an entry depends on all
+ * earlier stages. Commands choose their stage with a "@stage " prefix, commands
+ * without one use autostart/default_stage.
+ */
 class wayfire_autostart
 {
     wf::option_wrapper_t<bool> autostart_wf_shell{"autostart/autostart_wf_shell"};
+    wf::option_wrapper_t<std::string> default_stage{"autostart/default_stage"};
+    wf::option_wrapper_t<int> panel_timeout{"autostart/panel_timeout"};
+    wf::option_wrapper_t<int> idle_delay{"autostart/idle_delay"};
+    wf::option_wrapper_t<int> launch_interval{"autostart/launch_interval"};
+
+    enum stage_t
+    {
+        STAGE_NOW,
+        STAGE_FRAME,
+        STAGE_PANEL,
+        STAGE_IDLE,
+        STAGE_COUNT,
+    };
+
+    const char *stage_names[STAGE_COUNT] = {"now", "frame", "panel", "idle"};
+
+    std::vector<std::string> commands[STAGE_COUNT];
+    bool ready[STAGE_COUNT] = {true, false, false, false};
+    /* The first stage which hasn't been launched yet */
+    int next_stage = STAGE_NOW;
+
+    uint32_t start_time = wf::get_current_time();
+    std::deque<std::string> launch_queue;
+    wf::wl_timer launch_timer, panel_timer, idle_timer;
 
   public:
     wayfire_autostart()
@@ -20,7 +67,7 @@ class wayfire_autostart
         for (const auto& command : section->get_registered_options())
         {
             auto cmd = command->get_value_str();
-            wf::get_core().run(cmd);
+            commands[parse_stage(cmd)].push_back(cmd);
 
             if (cmd.find("wf-panel") != std::string::npos)
             {
@@ -35,14 +82,151 @@ class wayfire_autostart
 
         if (autostart_wf_shell && !panel_manually_started)
         {
-            wf::get_core().run("wf-panel");
+            commands[STAGE_NOW].push_back("wf-panel");
         }
 
         if (autostart_wf_shell && !background_manually_started)
         {
-            wf::get_core().run("wf-background");
+            commands[STAGE_NOW].push_back("wf-background");
+        }
+
+        wf::get_core().connect_signal("startup-finished", &on_startup_finished);
+        advance();
+    }
+
+  private:
+    /** Remove the stage prefix of the command, if any, and return the stage */
+    stage_t parse_stage(std::string& cmd)
+    {
+        std::string name = default_stage;
+        if ((cmd.size() > 1) && (cmd[0] == '@'))
+        {
+            size_t end = cmd.find(' ');
+            name = cmd.substr(1, end == std::string::npos ? end : end - 1);
+            cmd  = (end == std::string::npos) ? "" : cmd.substr(end + 1);
+        }
+
+        for (int stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            if (name == stage_names[stage])
+            {
+                return (stage_t)stage;
+            }
+        }
+
+        LOGE("autostart: unknown stage ", name, " for command ", cmd);
+
+        return STAGE_NOW;
+    }
+
+    void mark_ready(stage_t stage)
+    {
+        ready[stage] = true;
+        advance();
+    }
+
+    /** Launch all stages which are ready, in order */
+    void advance()
+    {
+        while ((next_stage < STAGE_COUNT) && ready[next_stage])
+        {
+            auto stage = (stage_t)next_stage++;
+            LOGI("autostart: starting stage ", stage_names[stage], " with ",
+                commands[stage].size(), " commands after ",
+                wf::get_current_time() - start_time, "ms");
+            launch_queue.insert(launch_queue.end(),
+                commands[stage].begin(), commands[stage].end());
+
+            if (stage == STAGE_PANEL)
+            {
+                idle_timer.set_timeout(std::max(1, (int)idle_delay), [=] ()
+                {
+                    mark_ready(STAGE_IDLE);
+
+                    return false;
+                }, false);
+            }
+        }
+
+        if (!launch_timer.is_connected())
+        {
+            launch_next();
+        }
+    }
+
+    /** Run the queued commands, spaced by autostart/launch_interval */
+    void launch_next()
+    {
+        while (!launch_queue.empty())
+        {
+            auto cmd = launch_queue.front();
+            launch_queue.pop_front();
+            if (!cmd.empty())
+            {
+                wf::get_core().run(cmd);
+            }
+
+            if ((launch_interval > 0) && !launch_queue.empty())
+            {
+                launch_timer.set_timeout(launch_interval, [=] ()
+                {
+                    launch_timer.disconnect();
+                    launch_next();
+
+                    return false;
+                });
+
+                return;
+            }
         }
     }
+
+    wf::signal_connection_t on_startup_finished = [=] (wf::signal_data_t*)
+    {
+        /* Clients can't map anything before the event loop runs, which starts
+         * right after this signal */
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            output->render->connect_signal("frame-ready", &on_frame_ready);
+            output->connect_signal("view-mapped", &on_view_mapped);
+        }
+
+        /* Don't wait forever if there is no panel */
+        panel_timer.set_timeout(std::max(1, (int)panel_timeout), [=] ()
+        {
+            LOGI("autostart: no panel after ", (int)panel_timeout, "ms");
+            on_frame_ready.disconnect();
+            on_view_mapped.disconnect();
+            ready[STAGE_FRAME] = true;
+            mark_ready(STAGE_PANEL);
+
+            return false;
+        });
+    };
+
+    wf::signal_connection_t on_frame_ready = [=] (wf::signal_data_t*)
+    {
+        on_frame_ready.disconnect();
+        LOGI("autostart: first frame after ",
+            wf::get_current_time() - start_time, "ms");
+        mark_ready(STAGE_FRAME);
+    };
+
+    wf::signal_connection_t on_view_mapped = [=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        if ((view->role != wf::VIEW_ROLE_DESKTOP_ENVIRONMENT) ||
+            (view->get_output()->workspace->get_view_layer(view) != wf::LAYER_TOP))
+        {
+            return;
+        }
+
+        on_view_mapped.disconnect();
+        panel_timer.disconnect();
+        LOGI("autostart: desktop usable after ",
+            wf::get_current_time() - start_time, "ms");
+        mark_ready(STAGE_PANEL);
+    };
 };
 
 DECLARE_WAYFIRE_PLUGIN((wf::singleton_plugin_t<wayfire_autostart, false>));
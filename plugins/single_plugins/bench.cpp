@@ -0,0 +1,318 @@
+#include <wayfire/plugin.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+/*
+ * The bench plugin runs a script of plugin activations and reports frame time
+ * statistics of the output as JSON, so that the performance of different builds
+ * or configurations can be compared.
+ *
+ * It is meant to be used with a fixed setup, for ex. the headless backend
+ * (WLR_BACKENDS=headless WLR_HEADLESS_OUTPUTS=1) and a fixed set of clients.
+ */
+
+/* The number of instances which are running a script, so that the compositor
+ * exits only after all outputs have finished. */
+static int running_benchmarks = 0;
+
+class wayfire_bench : public wf::plugin_interface_t
+{
+    wf::option_wrapper_t<wf::activatorbinding_t> run_key{"bench/run"};
+    wf::option_wrapper_t<std::string> script{"bench/script"};
+    wf::option_wrapper_t<int> repeat{"bench/repeat"};
+    wf::option_wrapper_t<std::string> report_dir{"bench/report_dir"};
+    wf::option_wrapper_t<bool> run_on_start{"bench/run_on_start"};
+    wf::option_wrapper_t<bool> exit_when_done{"bench/exit_when_done"};
+
+    /* Collect frames more often than the profiler's ring buffer fills up */
+    static constexpr int COLLECT_INTERVAL = 250;
+
+    std::vector<std::string> steps;
+    size_t next_step = 0;
+    int iterations_left = 0;
+    bool running = false;
+    uint32_t start_time = 0;
+
+    wf::wl_timer step_timer;
+    wf::wl_timer collect_timer;
+    wf::wl_idle_call idle_step;
+
+    std::vector<wf::frame_stats_t> frames;
+    uint64_t last_frame_id = 0;
+
+  public:
+    void init() override
+    {
+        grab_interface->name = "bench";
+        grab_interface->capabilities = 0;
+
+        output->add_activator(run_key, &run_cb);
+        if (run_on_start)
+        {
+            idle_step.run_once([=] () { start(); });
+        }
+    }
+
+    wf::activator_callback run_cb = [=] (auto)
+    {
+        if (running)
+        {
+            return false;
+        }
+
+        start();
+
+        return true;
+    };
+
+    void start()
+    {
+        std::stringstream stream((std::string)script);
+        std::string step;
+        steps.clear();
+        while (stream >> step)
+        {
+            steps.push_back(step);
+        }
+
+        if (steps.empty())
+        {
+            LOGE("bench: no script set");
+
+            return;
+        }
+
+        running = true;
+        ++running_benchmarks;
+        iterations_left = std::max(1, (int)repeat);
+        next_step = 0;
+
+        /* Only the frames rendered while the script runs are reported */
+        frames.clear();
+        auto existing = output->render->get_frame_stats();
+        last_frame_id = existing.empty() ? 0 : existing.back().frame_id;
+        start_time    = wf::get_current_time();
+
+        collect_timer.set_timeout(COLLECT_INTERVAL, [=] ()
+        {
+            collect_frames(false);
+
+            return true;
+        });
+
+        run_next_step();
+    }
+
+    /**
+     * Run the steps until the next wait. Each step is either the name of an
+     * activator, like scale/toggle, or a number of milliseconds to wait.
+     */
+    void run_next_step()
+    {
+        while (running)
+        {
+            if (next_step >= steps.size())
+            {
+                next_step = 0;
+                if (--iterations_left <= 0)
+                {
+                    finish();
+
+                    return;
+                }
+            }
+
+            auto& step = steps[next_step++];
+            if (std::all_of(step.begin(), step.end(), ::isdigit))
+            {
+                /* Continue from an idle callback, a timer can't be rearmed
+                 * with a different timeout from its own callback */
+                step_timer.set_timeout(std::stoi(step), [=] ()
+                {
+                    idle_step.run_once([=] () { run_next_step(); });
+
+                    return false;
+                });
+
+                return;
+            }
+
+            wf::activator_data_t data;
+            data.source = wf::activator_source_t::PLUGIN;
+            data.activation_data = 0;
+            if (!output->call_plugin(step, data))
+            {
+                LOGW("bench: ", step, " was not handled on ", output->to_string());
+            }
+        }
+    }
+
+    /**
+     * Store the frames which have been repainted since the last collection.
+     *
+     * @param all Whether to also take the most recent frames, whose GPU time
+     *   may not be known yet.
+     */
+    void collect_frames(bool all)
+    {
+        /* GPU times arrive a few frames later */
+        const uint64_t GPU_DELAY = 4;
+
+        auto recent = output->render->get_frame_stats();
+        uint64_t newest = recent.empty() ? 0 : recent.back().frame_id;
+        for (auto& frame : recent)
+        {
+            if ((frame.frame_id > last_frame_id) &&
+                (all || (frame.frame_id + GPU_DELAY <= newest)))
+            {
+                frames.push_back(frame);
+                last_frame_id = frame.frame_id;
+            }
+        }
+    }
+
+    void finish()
+    {
+        collect_frames(true);
+        collect_timer.disconnect();
+        step_timer.disconnect();
+        running = false;
+
+        write_report(wf::get_current_time() - start_time);
+        if ((--running_benchmarks == 0) && exit_when_done)
+        {
+            wf::get_core().shutdown();
+        }
+    }
+
+    /** Write the percentiles of one frame_stats_t field in milliseconds. */
+    template<class Getter>
+    void write_percentiles(std::ostream& out, const std::string& name,
+        Getter get)
+    {
+        std::vector<int64_t> values;
+        for (auto& frame : frames)
+        {
+            auto value = get(frame);
+            if (value >= 0)
+            {
+                values.push_back(value);
+            }
+        }
+
+        out << "  \"" << name << "\": ";
+        if (values.empty())
+        {
+            out << "null";
+
+            return;
+        }
+
+        std::sort(values.begin(), values.end());
+        auto percentile = [&] (double p)
+        {
+            return values[std::min(values.size() - 1,
+                size_t(p * values.size()))] / 1e6;
+        };
+
+        out << "{\"p50\": " << percentile(0.5) << ", \"p90\": " <<
+            percentile(0.9) << ", \"p99\": " << percentile(0.99) <<
+            ", \"max\": " << values.back() / 1e6 << "}";
+    }
+
+    void write_report(int64_t duration_ms)
+    {
+        std::ostringstream out;
+        out << "{\n";
+        out << "  \"output\": \"" << output->to_string() << "\",\n";
+        out << "  \"duration_ms\": " << duration_ms << ",\n";
+        out << "  \"frames\": " << frames.size() << ",\n";
+
+        uint64_t damaged_pixels = 0;
+        size_t adaptive_sync_frames = 0;
+        size_t cursor_only_frames   = 0;
+        for (auto& frame : frames)
+        {
+            damaged_pixels       += frame.damaged_pixels;
+            adaptive_sync_frames += frame.adaptive_sync;
+            cursor_only_frames   += frame.cursor_only;
+        }
+
+        out << "  \"damaged_pixels_per_frame\": " <<
+            (frames.empty() ? 0 : damaged_pixels / frames.size()) << ",\n";
+        out << "  \"adaptive_sync_frames\": " << adaptive_sync_frames << ",\n";
+        out << "  \"cursor_only_frames\": " << cursor_only_frames << ",\n";
+
+        write_percentiles(out, "total_ms",
+            [] (auto& f) { return f.total_time; });
+        out << ",\n";
+        write_percentiles(out, "gpu_ms",
+            [] (auto& f) { return f.gpu_time; });
+        out << ",\n";
+        write_percentiles(out, "schedule_surfaces_ms",
+            [] (auto& f) { return f.schedule_surfaces_time; });
+        out << ",\n";
+        write_percentiles(out, "render_views_ms",
+            [] (auto& f) { return f.render_views_time; });
+        out << ",\n";
+        write_percentiles(out, "postprocessing_ms",
+            [] (auto& f) { return f.postprocessing_time; });
+        out << ",\n";
+        write_percentiles(out, "commit_ms",
+            [] (auto& f) { return f.commit_time; });
+        out << ",\n";
+
+        /* Only frames which were repainted after an input event count */
+        write_percentiles(out, "input_to_commit_ms", [] (auto& f)
+        {
+            return (f.input_time < 0) ? -1 :
+                   f.start_time + f.total_time - f.input_time;
+        });
+        out << ",\n";
+        write_percentiles(out, "input_to_present_ms", [] (auto& f)
+        {
+            return ((f.input_time < 0) || (f.present_time < 0)) ? -1 :
+                   f.present_time - f.input_time;
+        });
+        out << "\n}\n";
+
+        std::string dir = report_dir;
+        if (dir.empty())
+        {
+            LOGI("bench report:\n", out.str());
+
+            return;
+        }
+
+        auto path = dir + "/wayfire-bench-" + output->to_string() + ".json";
+        std::ofstream file{path};
+        file << out.str();
+        if (!file)
+        {
+            LOGE("bench: failed to write ", path);
+        } else
+        {
+            LOGI("bench: report written to ", path);
+        }
+    }
+
+    void fini() override
+    {
+        if (running)
+        {
+            --running_benchmarks;
+        }
+
+        output->rem_binding(&run_cb);
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(wayfire_bench);
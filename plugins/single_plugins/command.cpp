@@ -1,6 +1,7 @@
 #include <wayfire/plugin.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/core.hpp>
+#include <wayfire/util.hpp>
 #include <linux/input.h>
 #include <linux/input-event-codes.h>
 #include <wayfire/signal-definitions.hpp>
@@ -16,22 +17,6 @@ static bool begins_with(std::string word, std::string prefix)
     return word.substr(0, prefix.length()) == prefix;
 }
 
-/* Initial repeat delay passed */
-static int repeat_delay_timeout_handler(void *callback)
-{
-    (*reinterpret_cast<std::function<void()>*>(callback))();
-
-    return 1; // disconnect
-}
-
-/* Between each repeat */
-static int repeat_once_handler(void *callback)
-{
-    (*reinterpret_cast<std::function<void()>*>(callback))();
-
-    return 1; // continue timer
-}
-
 /* Provides a way to bind specific commands to activator bindings.
  *
  * It supports 2 modes:
@@ -56,7 +41,7 @@ class wayfire_command : public wf::plugin_interface_t
         std::string repeat_command;
     } repeat;
 
-    wl_event_source *repeat_source = NULL, *repeat_delay_source = NULL;
+    wf::wl_timer repeat_delay_timer, repeat_timer;
 
     enum binding_mode
     {
@@ -106,11 +91,21 @@ class wayfire_command : public wf::plugin_interface_t
             repeat.pressed_button = data.activation_data;
         }
 
-        repeat_delay_source = wl_event_loop_add_timer(wf::get_core().ev_loop,
-            repeat_delay_timeout_handler, &on_repeat_delay_timeout);
+        int repeat_delay = wf::option_wrapper_t<int>("input/kb_repeat_delay");
+        repeat_delay_timer.set_timeout(std::max(1, repeat_delay), [=] ()
+        {
+            if (repeat_once())
+            {
+                int repeat_rate =
+                    wf::option_wrapper_t<int>("input/kb_repeat_rate");
+                repeat_timer.set_timeout(1000 / repeat_rate, [=] ()
+                {
+                    return repeat_once();
+                });
+            }
 
-        wl_event_source_timer_update(repeat_delay_source,
-            wf::option_wrapper_t<int>("input/kb_repeat_delay"));
+            return false;
+        });
 
         wf::get_core().connect_signal("pointer_button", &on_button_event);
         wf::get_core().connect_signal("keyboard_key", &on_key_event);
@@ -118,39 +113,25 @@ class wayfire_command : public wf::plugin_interface_t
         return true;
     }
 
-    std::function<void()> on_repeat_delay_timeout = [=] ()
-    {
-        repeat_delay_source = NULL;
-        repeat_source = wl_event_loop_add_timer(wf::get_core().ev_loop,
-            repeat_once_handler, &on_repeat_once);
-        on_repeat_once();
-    };
-
-    std::function<void()> on_repeat_once = [=] ()
+    /** Run the repeated command once. @return Whether to continue repeating */
+    bool repeat_once()
     {
-        uint32_t repeat_rate = wf::option_wrapper_t<int>("input/kb_repeat_rate");
+        int repeat_rate = wf::option_wrapper_t<int>("input/kb_repeat_rate");
         if ((repeat_rate <= 0) || (repeat_rate > 1000))
         {
-            return reset_repeat();
+            reset_repeat();
+            return false;
         }
 
-        wl_event_source_timer_update(repeat_source, 1000 / repeat_rate);
         wf::get_core().run(repeat.repeat_command.c_str());
-    };
+
+        return true;
+    }
 
     void reset_repeat()
     {
-        if (repeat_delay_source)
-        {
-            wl_event_source_remove(repeat_delay_source);
-            repeat_delay_source = NULL;
-        }
-
-        if (repeat_source)
-        {
-            wl_event_source_remove(repeat_source);
-            repeat_source = NULL;
-        }
+        repeat_delay_timer.disconnect();
+        repeat_timer.disconnect();
 
         repeat.pressed_key = repeat.pressed_button = 0;
         output->deactivate_plugin(grab_interface);
@@ -270,8 +251,13 @@ class wayfire_command : public wf::plugin_interface_t
         using namespace std::placeholders;
 
         setup_bindings_from_config();
-        reload_config = [=] (wf::signal_data_t*)
+        reload_config = [=] (wf::signal_data_t *data)
         {
+            if (!wf::config_section_changed(data, "command"))
+            {
+                return;
+            }
+
             clear_bindings();
             setup_bindings_from_config();
         };
@@ -4,6 +4,7 @@
 #include <wayfire/view.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/util/log.hpp>
+#include <unordered_set>
 
 /*
  * This plugin provides abilities to switch between views.
@@ -112,13 +113,33 @@ class wayfire_fast_switcher : public wf::plugin_interface_t
 
     void update_views()
     {
-        views = output->workspace->get_views_on_workspace(
+        auto on_workspace = output->workspace->get_views_on_workspace(
             output->workspace->get_current_workspace(), wf::WM_LAYERS);
+        std::unordered_set<wf::view_interface_t*> candidates;
+        for (auto& view : on_workspace)
+        {
+            candidates.insert(view.get());
+        }
+
+        /* The focus history is already in the order we want, we only need to
+         * drop the views which aren't on the current workspace. */
+        views.clear();
+        for (auto& view : output->get_focus_history())
+        {
+            if (candidates.erase(view.get()))
+            {
+                views.push_back(view);
+            }
+        }
 
-        std::sort(views.begin(), views.end(), [] (wayfire_view& a, wayfire_view& b)
+        /* Views which were never focused go last, in stacking order */
+        for (auto& view : on_workspace)
         {
-            return a->last_focus_timestamp > b->last_focus_timestamp;
-        });
+            if (candidates.count(view.get()))
+            {
+                views.push_back(view);
+            }
+        }
     }
 
     bool do_switch(bool forward)
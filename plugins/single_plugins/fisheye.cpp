@@ -23,52 +23,38 @@
  */
 
 #include <wayfire/plugin.hpp>
+#include <wayfire/core.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/opengl.hpp>
 #include <wayfire/util/duration.hpp>
 #include <wayfire/render-manager.hpp>
 
-static const char *vertex_shader =
-    R"(
-#version 100
-
-attribute mediump vec2 position;
-
-void main() {
-
-    gl_Position = vec4(position.xy, 0.0, 1.0);
-}
-)";
+#include <cmath>
 
-static const char *fragment_shader =
+static const char *fisheye_snippet =
     R"(
-#version 100
-precision mediump float;
-
-uniform vec2 u_resolution;
-uniform vec2 u_mouse;
-uniform float u_radius;
-uniform float u_zoom;
-uniform sampler2D u_texture;
-
-const float PI = 3.1415926535;
+uniform vec2 fisheye_resolution;
+uniform vec2 fisheye_mouse;
+uniform float fisheye_radius;
+uniform float fisheye_zoom;
 
-void main()
+highp vec2 fisheye_coord(highp vec2 uvpos)
 {
-        float radius = u_radius;
+        const float PI = 3.1415926535;
 
-        float zoom = u_zoom;
-        float pw = 1.0 / u_resolution.x;
-        float ph = 1.0 / u_resolution.y;
+        float radius = fisheye_radius;
 
-        vec4 p0 = vec4(u_mouse.x, u_resolution.y - u_mouse.y, 1.0 / radius, 0.0);
+        float zoom = fisheye_zoom;
+        float pw = 1.0 / fisheye_resolution.x;
+        float ph = 1.0 / fisheye_resolution.y;
+
+        vec4 p0 = vec4(fisheye_mouse.x, fisheye_resolution.y - fisheye_mouse.y, 1.0 / radius, 0.0);
         vec4 p1 = vec4(pw, ph, PI / radius, (zoom - 1.0) * zoom);
         vec4 p2 = vec4(0, 0, -PI / 2.0, 0.0);
 
         vec4 t0, t1, t2, t3;
 
-        vec3 tc = vec3(1.0, 0.0, 0.0);
-        vec2 uv = vec2(gl_FragCoord.x, gl_FragCoord.y);
+        vec2 uv = uvpos * fisheye_resolution;
 
         t1 = p0.xyww - vec4(uv, 0.0, 0.0);
         t2.x = t2.y = t2.z = t2.w = 1.0 / sqrt(dot(t1.xyz, t1.xyz));
@@ -90,9 +76,7 @@ void main()
 
         t1 = t1 * p1 + p2;
 
-        tc = texture2D(u_texture, t1.xy).rgb;
-
-        gl_FragColor = vec4(tc, 1.0);
+        return t1.xy;
 }
 )";
 
@@ -106,7 +90,9 @@ class wayfire_fisheye : public wf::plugin_interface_t
     wf::option_wrapper_t<double> radius{"fisheye/radius"};
     wf::option_wrapper_t<double> zoom{"fisheye/zoom"};
 
-    OpenGL::program_t program;
+    wf::post_snippet_t snippet;
+    /* The cursor position used for the current frame */
+    wf::pointf_t cursor = {0, 0};
 
   public:
     void init() override
@@ -128,10 +114,16 @@ class wayfire_fisheye : public wf::plugin_interface_t
             }
         });
 
-        OpenGL::render_begin();
-        program.set_simple(
-            OpenGL::compile_program(vertex_shader, fragment_shader));
-        OpenGL::render_end();
+        snippet.type     = wf::post_snippet_t::POST_SNIPPET_COORD;
+        snippet.function = "fisheye_coord";
+        snippet.source   = fisheye_snippet;
+        /* Outside of the lens around the cursor, the image is unchanged */
+        snippet.sampling_radius = 0;
+        snippet.set_uniforms = [=] (OpenGL::program_t& program,
+                                    const wf::framebuffer_base_t& dest)
+        {
+            set_uniforms(program, dest);
+        };
     }
 
     wf::activator_callback toggle_cb = [=] (auto)
@@ -152,59 +144,68 @@ class wayfire_fisheye : public wf::plugin_interface_t
             if (!hook_set)
             {
                 hook_set = true;
-                output->render->add_post(&render_hook);
-                output->render->set_redraw_always();
+                output->render->add_post_snippet(&snippet);
+                output->render->add_effect(&update_lens, wf::OUTPUT_EFFECT_PRE);
+                wf::get_core().connect_signal("pointer_motion_post",
+                    &on_motion);
+                wf::get_core().connect_signal("pointer_motion_absolute_post",
+                    &on_motion);
+                wf::get_core().connect_signal("tablet_axis_post", &on_motion);
             }
         }
 
+        output->render->schedule_redraw();
+
         return true;
     };
 
-    wf::post_hook_t render_hook = [=] (const wf::framebuffer_base_t& source,
-                                       const wf::framebuffer_base_t& dest)
+    /* Only the lens is repainted when the cursor moves, see update_lens */
+    wf::signal_connection_t on_motion = [=] (wf::signal_data_t*)
     {
-        auto oc     = output->get_cursor_position();
-        wlr_box box = {(int)oc.x, (int)oc.y, 1, 1};
-        box = output->render->get_target_framebuffer().
-            framebuffer_box_from_geometry_box(box);
-        oc.x = box.x;
-        oc.y = box.y;
-
-        static const float vertexData[] = {
-            -1.0f, -1.0f,
-            1.0f, -1.0f,
-            1.0f, 1.0f,
-            -1.0f, 1.0f
-        };
-
-        OpenGL::render_begin(dest);
-        program.use(wf::TEXTURE_TYPE_RGBA);
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, source.tex));
-        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        output->render->schedule_redraw();
+    };
 
-        program.uniform2f("u_mouse", oc.x, oc.y);
-        program.uniform2f("u_resolution", dest.viewport_width, dest.viewport_height);
-        program.uniform1f("u_radius", radius);
-        program.uniform1f("u_zoom", progression);
+    /** Move the lens to the cursor at the start of each frame. */
+    wf::effect_hook_t update_lens = [=] ()
+    {
+        if (!active && !progression.running())
+        {
+            finalize();
 
-        program.attrib_pointer("position", 2, 0, vertexData);
+            return;
+        }
 
-        GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        cursor = output->get_cursor_position();
 
-        program.deactivate();
-        OpenGL::render_end();
+        /* The radius is in output pixels, leave a margin for rounding */
+        int r = std::ceil(radius / output->handle->scale) + 2;
+        snippet.local_box = {(int)cursor.x - r, (int)cursor.y - r, 2 * r, 2 * r};
 
-        if (!active && !progression.running())
+        if (progression.running())
         {
-            finalize();
+            output->render->schedule_redraw();
         }
     };
 
+    void set_uniforms(OpenGL::program_t& program,
+        const wf::framebuffer_base_t& dest)
+    {
+        wlr_box box = {(int)cursor.x, (int)cursor.y, 1, 1};
+        box = output->render->get_target_framebuffer().
+            framebuffer_box_from_geometry_box(box);
+
+        program.uniform2f("fisheye_mouse", box.x, box.y);
+        program.uniform2f("fisheye_resolution",
+            dest.viewport_width, dest.viewport_height);
+        program.uniform1f("fisheye_radius", radius);
+        program.uniform1f("fisheye_zoom", progression);
+    }
+
     void finalize()
     {
-        output->render->rem_post(&render_hook);
-        output->render->set_redraw_always(false);
+        output->render->rem_effect(&update_lens);
+        output->render->rem_post_snippet(&snippet);
+        on_motion.disconnect();
         hook_set = false;
     }
 
@@ -215,10 +216,6 @@ class wayfire_fisheye : public wf::plugin_interface_t
             finalize();
         }
 
-        OpenGL::render_begin();
-        program.free_resources();
-        OpenGL::render_end();
-
         output->rem_binding(&toggle_cb);
     }
 };
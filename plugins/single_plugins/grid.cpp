@@ -4,6 +4,7 @@
 #include <wayfire/view.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/render-manager.hpp>
+#include <wayfire/view-transform.hpp>
 #include <algorithm>
 #include <cmath>
 #include <linux/input-event-codes.h>
@@ -31,6 +32,12 @@ class wayfire_grid_view_cdata : public wf::custom_data_t
     wf::option_wrapper_t<int> animation_duration{"grid/duration"};
     wf::geometry_animation_t animation{animation_duration};
 
+    /* With the scale animation, the view gets its final geometry right away,
+     * and this transformer scales it from the animated geometry */
+    wf::view_2D *transformer = nullptr;
+    /* Where the scaled view was shown in the previous frame */
+    wf::animation_bounds_t bounds;
+
   public:
 
     wayfire_grid_view_cdata(wayfire_view view,
@@ -69,13 +76,26 @@ class wayfire_grid_view_cdata : public wf::custom_data_t
 
     void destroy()
     {
+        remove_transformer();
         view->erase_data<wayfire_grid_view_cdata>();
     }
 
+    void remove_transformer()
+    {
+        if (transformer)
+        {
+            view->pop_transformer(grid_view_id);
+            transformer = nullptr;
+        }
+    }
+
     void adjust_target_geometry(wf::geometry_t geometry, int32_t target_edges)
     {
-        animation.set_start(view->get_wm_geometry());
+        /* A running scale animation continues from where the view is shown */
+        animation.set_start(transformer ?
+            (wf::geometry_t)animation : view->get_wm_geometry());
         animation.set_end(geometry);
+        remove_transformer();
 
         /* Restore tiled edges if we don't need to set something special when
          * grid is ready */
@@ -112,12 +132,43 @@ class wayfire_grid_view_cdata : public wf::custom_data_t
             return destroy();
         }
 
+        if (type == "scale")
+        {
+            /* The client is resized once, instead of on every frame, and the
+             * live view is drawn scaled, without an offscreen pass */
+            set_end_state(geometry, tiled_edges);
+            transformer = new wf::view_2D(view);
+            view->add_transformer(std::unique_ptr<wf::view_2D>(transformer),
+                grid_view_id);
+
+            animation.start();
+            update_transformer();
+
+            return;
+        }
+
         view->set_tiled(wf::TILED_EDGES_ALL);
         view->set_moving(1);
         view->set_resizing(1);
         animation.start();
     }
 
+    /** Map the current geometry of the view to the animated geometry */
+    void update_transformer()
+    {
+        auto current = view->get_wm_geometry();
+        wf::geometry_t target = animation;
+
+        transformer->scale_x = 1.0 * target.width / std::max(1, current.width);
+        transformer->scale_y = 1.0 * target.height / std::max(1, current.height);
+        transformer->translation_x = (target.x + target.width / 2.0) -
+            (current.x + current.width / 2.0);
+        transformer->translation_y = (target.y + target.height / 2.0) -
+            (current.y + current.height / 2.0);
+        view->damage();
+        output->render->damage_animation_bounds(bounds, view->get_bounding_box());
+    }
+
     void set_end_state(wf::geometry_t geometry, int32_t edges)
     {
         if (edges >= 0)
@@ -130,6 +181,19 @@ class wayfire_grid_view_cdata : public wf::custom_data_t
 
     void adjust_geometry()
     {
+        if (transformer)
+        {
+            if (animation.running())
+            {
+                update_transformer();
+            } else
+            {
+                destroy();
+            }
+
+            return;
+        }
+
         if (!animation.running())
         {
             set_end_state(animation, tiled_edges);
@@ -5,6 +5,7 @@
 #include "wayfire/output-layout.hpp"
 #include "wayfire/workspace-manager.hpp"
 #include "wayfire/signal-definitions.hpp"
+#include "wayfire/util.hpp"
 #include "../cube/cube-control-signal.hpp"
 
 #include <cmath>
@@ -118,6 +119,9 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
     wf::option_wrapper_t<double> cube_rotate_speed{"idle/cube_rotate_speed"};
     wf::option_wrapper_t<double> cube_max_zoom{"idle/cube_max_zoom"};
     wf::option_wrapper_t<bool> disable_on_fullscreen{"idle/disable_on_fullscreen"};
+    wf::option_wrapper_t<int> screensaver_frame_rate{
+        "idle/screensaver_frame_rate"};
+    wf::option_wrapper_t<bool> dpms_first{"idle/dpms_first"};
 
     std::optional<wf::idle_inhibitor_t> fullscreen_inhibitor;
     bool has_fullscreen = false;
@@ -126,6 +130,12 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
     bool hook_set = false;
     bool output_inhibited = false;
     uint32_t last_time;
+    /* Whether the last frame already shows the current state of the cube */
+    bool settled = false;
+    /* Whether the outputs were turned off instead of starting the screensaver */
+    bool screensaver_dpms = false;
+
+    wf::frame_rate_cap_t frame_cap;
     wlr_idle_timeout *timeout_screensaver = NULL;
     wf::wl_listener_wrapper on_idle_screensaver, on_resume_screensaver;
 
@@ -205,7 +215,7 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
 
     void destroy_screensaver_timeout()
     {
-        if (state == CUBE_SCREENSAVER_RUNNING)
+        if ((state == CUBE_SCREENSAVER_RUNNING) || screensaver_dpms)
         {
             stop_screensaver();
         }
@@ -243,6 +253,25 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
         on_resume_screensaver.connect(&timeout_screensaver->events.resume);
     }
 
+    /** @return Whether the cube changes in the next screensaver frame. */
+    bool has_changes()
+    {
+        return (state == CUBE_SCREENSAVER_STOPPING) ||
+               screensaver_animation.running() || (cube_rotate_speed != 0.0);
+    }
+
+    /** Draw only screensaver_frame_rate frames per second. */
+    void start_frame_cap()
+    {
+        frame_cap.max_fps = std::max(0, (int)screensaver_frame_rate);
+        output->render->add_frame_rate_cap(&frame_cap);
+    }
+
+    void stop_frame_cap()
+    {
+        output->render->rem_frame_rate_cap(&frame_cap);
+    }
+
     void inhibit_output()
     {
         if (output_inhibited)
@@ -250,6 +279,7 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
             return;
         }
 
+        stop_frame_cap();
         if (hook_set)
         {
             output->render->rem_effect(&screensaver_frame);
@@ -284,6 +314,7 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
         data.carried_out = false;
 
         output->emit_signal("cube-control", &data);
+        stop_frame_cap();
         if (hook_set)
         {
             output->render->rem_effect(&screensaver_frame);
@@ -313,6 +344,16 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
             return;
         }
 
+        /* Nothing moves, so the cube doesn't need to be redrawn until the
+         * views on it are damaged */
+        bool changed = has_changes();
+        if (!changed && settled)
+        {
+            return;
+        }
+
+        settled = !changed;
+
         if (state == CUBE_SCREENSAVER_STOPPING)
         {
             rotation = screensaver_animation.rot;
@@ -349,6 +390,15 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
 
     void start_screensaver()
     {
+        if (dpms_first)
+        {
+            get_instance().set_state(wf::OUTPUT_IMAGE_SOURCE_SELF,
+                wf::OUTPUT_IMAGE_SOURCE_DPMS);
+            screensaver_dpms = true;
+
+            return;
+        }
+
         cube_control_signal data;
         data.angle = 0.0;
         data.zoom  = CUBE_ZOOM_BASE;
@@ -379,10 +429,21 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
         screensaver_animation.ease.set(0.0, 1.0);
         screensaver_animation.start();
         last_time = wf::get_current_time();
+        settled   = false;
+        start_frame_cap();
     }
 
     void stop_screensaver()
     {
+        if (screensaver_dpms)
+        {
+            get_instance().set_state(wf::OUTPUT_IMAGE_SOURCE_DPMS,
+                wf::OUTPUT_IMAGE_SOURCE_SELF);
+            screensaver_dpms = false;
+
+            return;
+        }
+
         if (state == CUBE_SCREENSAVER_DISABLED)
         {
             uninhibit_output();
@@ -390,6 +451,8 @@ class wayfire_idle_singleton : public wf::singleton_plugin_t<wayfire_idle>
             return;
         }
 
+        /* Stop smoothly, at the full frame rate */
+        stop_frame_cap();
         state = CUBE_SCREENSAVER_STOPPING;
 
         double end = rotation > M_PI ? M_PI * 2 : 0.0;
@@ -80,7 +80,7 @@ class wayfire_move : public wf::plugin_interface_t
 
     struct
     {
-        nonstd::observer_ptr<wf::preview_indication_view_t> preview;
+        nonstd::observer_ptr<wf::preview_indication_t> preview;
         int slot_id = 0;
     } slot;
 
@@ -495,16 +495,9 @@ class wayfire_move : public wf::plugin_interface_t
                 return;
             }
 
-            auto input   = get_input_coords();
-            auto preview = new wf::preview_indication_view_t(output,
-                {input.x, input.y, 1, 1});
-
-            wf::get_core().add_view(
-                std::unique_ptr<wf::view_interface_t>(preview));
-
-            preview->set_output(output);
-            preview->set_target_geometry(query.out_geometry, 1);
-            slot.preview = nonstd::make_observer(preview);
+            auto input = get_input_coords();
+            slot.preview = wf::preview_indication_t::create(output, input);
+            slot.preview->set_target_geometry(query.out_geometry, 1);
         }
 
         update_workspace_switch_timeout(new_slot_id);
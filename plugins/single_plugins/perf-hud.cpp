@@ -0,0 +1,370 @@
+#include <wayfire/plugin.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/workspace-manager.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/plugins/common/simple-texture.hpp>
+#include <wayfire/plugins/common/cairo-util.hpp>
+
+#include <algorithm>
+#include <cairo.h>
+#include <deque>
+#include <iomanip>
+#include <sstream>
+
+/*
+ * The perf-hud plugin shows the frame statistics of the output in a corner:
+ * a graph of the recent CPU and GPU frame times, the damaged area and the
+ * number of frames which took longer than the refresh interval.
+ *
+ * The HUD is drawn with cairo only a few times per second, in between the
+ * same texture is reused, so that the HUD itself costs almost nothing.
+ *
+ * Optionally, the repainted regions of each frame are flashed, so that
+ * unnecessary damage becomes visible.
+ */
+class wayfire_perf_hud : public wf::plugin_interface_t
+{
+    wf::option_wrapper_t<wf::activatorbinding_t> toggle_key{"perf-hud/toggle"};
+    wf::option_wrapper_t<int> update_interval{"perf-hud/update_interval"};
+    wf::option_wrapper_t<bool> show_damage{"perf-hud/show_damage"};
+
+    /* Size of the HUD in logical pixels */
+    static constexpr int HUD_WIDTH  = 300;
+    static constexpr int HUD_HEIGHT = 168;
+    static constexpr int HUD_MARGIN = 10;
+    static constexpr int GRAPH_HEIGHT = 60;
+    /* How long a repainted region is flashed, in milliseconds */
+    static constexpr int FLASH_DURATION = 300;
+
+    bool active = false;
+    wf::wl_timer update_timer;
+
+    cairo_t *cr = nullptr;
+    cairo_surface_t *surface = nullptr;
+    wf::simple_texture_t tex;
+    float hud_scale = 1;
+    /* The GL state changes at the last update of the HUD */
+    OpenGL::state_stats_t last_state_stats;
+
+    struct flash_t
+    {
+        wf::region_t region;
+        uint32_t start;
+    };
+
+    std::deque<flash_t> flashes;
+
+  public:
+    void init() override
+    {
+        grab_interface->name = "perf-hud";
+        grab_interface->capabilities = 0;
+
+        output->add_activator(toggle_key, &toggle_cb);
+    }
+
+    wf::activator_callback toggle_cb = [=] (auto)
+    {
+        if (active)
+        {
+            deactivate();
+        } else
+        {
+            activate();
+        }
+
+        return true;
+    };
+
+    wf::geometry_t get_hud_geometry()
+    {
+        return {HUD_MARGIN, HUD_MARGIN, HUD_WIDTH, HUD_HEIGHT};
+    }
+
+    void activate()
+    {
+        active = true;
+        output->render->add_effect(&render_hook, wf::OUTPUT_EFFECT_OVERLAY);
+        update_hud();
+        start_updates();
+        output->connect_signal("dormant-changed", &on_dormant_changed);
+    }
+
+    void start_updates()
+    {
+        update_timer.set_timeout(std::max(50, (int)update_interval), [=] ()
+        {
+            update_hud();
+
+            return true;
+        }, false);
+    }
+
+    /* Nothing is shown while the output is dormant */
+    wf::signal_connection_t on_dormant_changed = [=] (wf::signal_data_t *data)
+    {
+        if (static_cast<wf::output_dormant_changed_signal*>(data)->dormant)
+        {
+            update_timer.disconnect();
+        } else
+        {
+            update_hud();
+            start_updates();
+        }
+    };
+
+    void deactivate()
+    {
+        active = false;
+        update_timer.disconnect();
+        on_dormant_changed.disconnect();
+        output->render->rem_effect(&render_hook);
+        output->render->damage(get_hud_geometry());
+        for (auto& flash : flashes)
+        {
+            output->render->damage(flash.region);
+        }
+
+        flashes.clear();
+        cairo_free();
+        tex.release();
+    }
+
+    /** Format a time in nanoseconds as milliseconds. */
+    static std::string format_ms(int64_t ns)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << ns / 1e6 << "ms";
+
+        return out.str();
+    }
+
+    /** Draw the current statistics to the HUD texture. */
+    void update_hud()
+    {
+        auto frames = output->render->get_frame_stats();
+        int64_t refresh = output->handle->refresh > 0 ?
+            1'000'000'000'000ll / output->handle->refresh : 16'666'667;
+
+        int64_t max_cpu = 0, max_gpu = 0, total_cpu = 0, total_gpu = 0;
+        int gpu_frames = 0, over_budget = 0, transformed = 0;
+        uint64_t damaged_pixels = 0;
+        for (auto& frame : frames)
+        {
+            max_cpu    = std::max(max_cpu, frame.total_time);
+            total_cpu += frame.total_time;
+            damaged_pixels += frame.damaged_pixels;
+            if (frame.gpu_time >= 0)
+            {
+                max_gpu    = std::max(max_gpu, frame.gpu_time);
+                total_gpu += frame.gpu_time;
+                ++gpu_frames;
+            }
+
+            if (std::max(frame.total_time, frame.gpu_time) > refresh)
+            {
+                ++over_budget;
+            }
+        }
+
+        for (auto& view : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
+        {
+            transformed += view->has_transformer();
+        }
+
+        double output_pixels =
+            std::max(1, output->handle->width * output->handle->height);
+        double damage_percent = frames.empty() ? 0 :
+            100.0 * damaged_pixels / frames.size() / output_pixels;
+
+        hud_scale = output->handle->scale;
+        int width  = HUD_WIDTH * hud_scale;
+        int height = HUD_HEIGHT * hud_scale;
+        if (!surface || (cairo_image_surface_get_width(surface) != width) ||
+            (cairo_image_surface_get_height(surface) != height))
+        {
+            cairo_free();
+            surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width,
+                height);
+            cr = cairo_create(surface);
+        }
+
+        cairo_identity_matrix(cr);
+        cairo_scale(cr, hud_scale, hud_scale);
+        cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_rgba(cr, 0, 0, 0, 0.7);
+        cairo_paint(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+        /* The graph shows one bar per frame, scaled to two refresh intervals */
+        double bar_width = (double)HUD_WIDTH / 128;
+        double graph_y   = HUD_HEIGHT - GRAPH_HEIGHT;
+        auto bar_height  = [&] (int64_t time)
+        {
+            return std::min(1.0, time / (2.0 * refresh)) * GRAPH_HEIGHT;
+        };
+
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            double x = i * bar_width;
+            double h = bar_height(frames[i].total_time);
+            cairo_set_source_rgba(cr, 0.3, 0.8, 0.3, 0.9);
+            cairo_rectangle(cr, x, HUD_HEIGHT - h, bar_width, h);
+            cairo_fill(cr);
+
+            if (frames[i].gpu_time >= 0)
+            {
+                h = bar_height(frames[i].gpu_time);
+                cairo_set_source_rgba(cr, 0.3, 0.5, 1.0, 0.9);
+                cairo_rectangle(cr, x, HUD_HEIGHT - h, bar_width / 2, h);
+                cairo_fill(cr);
+            }
+        }
+
+        /* The refresh interval */
+        cairo_set_source_rgba(cr, 1, 0.3, 0.3, 0.9);
+        cairo_rectangle(cr, 0, graph_y + GRAPH_HEIGHT / 2, HUD_WIDTH, 1);
+        cairo_fill(cr);
+
+        std::string cpu_avg = frames.empty() ? "-" :
+            format_ms(total_cpu / frames.size());
+        std::string gpu_avg = gpu_frames ? format_ms(total_gpu / gpu_frames) : "-";
+        std::string gpu_max = gpu_frames ? format_ms(max_gpu) : "-";
+
+        auto state_stats = OpenGL::get_state_stats();
+        uint64_t issued  = state_stats.issued - last_state_stats.issued;
+        uint64_t elided  = state_stats.elided - last_state_stats.elided;
+        uint64_t state_changes = issued + elided;
+        last_state_stats = state_stats;
+        std::vector<std::string> lines = {
+            "cpu " + cpu_avg + "  max " + format_ms(max_cpu),
+            "gpu " + gpu_avg + "  max " + gpu_max,
+            "damage " + std::to_string((int)damage_percent) + "%  over budget " +
+            std::to_string(over_budget) + "/" + std::to_string(frames.size()),
+            "transformed " + std::to_string(transformed) + "  gpu memory " +
+            std::to_string(wf::gpu_memory::get_total() / (1024 * 1024)) + "MiB",
+            "gl state issued " + std::to_string(issued) + "  elided " +
+            std::to_string(state_changes ? 100 * elided / state_changes : 0) + "%",
+        };
+
+        cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL,
+            CAIRO_FONT_WEIGHT_NORMAL);
+        cairo_set_font_size(cr, 13);
+        cairo_set_source_rgba(cr, 1, 1, 1, 1);
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            cairo_move_to(cr, 6, 18 + 18 * i);
+            cairo_show_text(cr, lines[i].c_str());
+        }
+
+        cairo_surface_flush(surface);
+        OpenGL::render_begin();
+        cairo_surface_upload_to_texture(surface, tex);
+        OpenGL::render_end();
+
+        output->render->damage(get_hud_geometry());
+    }
+
+    /** Remember the regions which were repainted, except because of the HUD. */
+    void update_flashes()
+    {
+        uint32_t now = wf::get_current_time();
+        while (!flashes.empty() &&
+               (now - flashes.front().start > FLASH_DURATION))
+        {
+            /* Repaint once more without the flash */
+            output->render->damage(flashes.front().region);
+            flashes.pop_front();
+        }
+
+        wf::region_t own_damage = get_hud_geometry();
+        for (auto& flash : flashes)
+        {
+            own_damage |= flash.region;
+        }
+
+        auto fresh = output->render->get_scheduled_damage() ^ own_damage;
+        if (!fresh.empty())
+        {
+            flashes.push_back({fresh, now});
+        }
+
+        /* Keep repainting while the flashes fade out */
+        for (auto& flash : flashes)
+        {
+            output->render->damage(flash.region);
+        }
+    }
+
+    wf::effect_hook_t render_hook = [=] ()
+    {
+        if (tex.tex == (GLuint) - 1)
+        {
+            return;
+        }
+
+        if (show_damage)
+        {
+            update_flashes();
+        }
+
+        auto fb    = output->render->get_target_framebuffer();
+        auto ortho = fb.get_orthographic_projection();
+        auto damage = output->render->get_scheduled_damage();
+        uint32_t now = wf::get_current_time();
+
+        OpenGL::render_begin(fb);
+        for (auto& flash : flashes)
+        {
+            float alpha = 0.4 *
+                (1.0 - (now - flash.start) / (float)FLASH_DURATION);
+            for (auto& box : flash.region & damage)
+            {
+                fb.logic_scissor(wlr_box_from_pixman_box(box));
+                OpenGL::render_rectangle(output->get_relative_geometry(),
+                    {alpha, 0, alpha * 0.5f, alpha}, ortho);
+            }
+        }
+
+        auto geometry = get_hud_geometry();
+        for (auto& box : damage & geometry)
+        {
+            fb.logic_scissor(wlr_box_from_pixman_box(box));
+            OpenGL::render_transformed_texture(tex.tex, geometry, ortho,
+                glm::vec4(1.f), OpenGL::TEXTURE_TRANSFORM_INVERT_Y);
+        }
+
+        OpenGL::render_end();
+    };
+
+    void cairo_free()
+    {
+        if (cr)
+        {
+            cairo_destroy(cr);
+        }
+
+        if (surface)
+        {
+            cairo_surface_destroy(surface);
+        }
+
+        cr = nullptr;
+        surface = nullptr;
+    }
+
+    void fini() override
+    {
+        if (active)
+        {
+            deactivate();
+        }
+
+        output->rem_binding(&toggle_cb);
+    }
+};
+
+DECLARE_WAYFIRE_PLUGIN(wayfire_perf_hud);
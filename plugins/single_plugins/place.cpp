@@ -4,6 +4,161 @@
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+/**
+ * How many views cover each point of the workarea, with integrals over
+ * rectangles in constant time.
+ *
+ * The edges of the views split the workarea into a grid, and the number of
+ * views is constant in each cell. The integrals from the top-left corner of
+ * the workarea to each grid point are precomputed, so that the integral up to
+ * any point only needs the cell which contains it.
+ */
+class coverage_map_t
+{
+  public:
+    coverage_map_t(wf::geometry_t workarea,
+        const std::vector<wf::geometry_t>& boxes)
+    {
+        xs = {workarea.x, workarea.x + workarea.width};
+        ys = {workarea.y, workarea.y + workarea.height};
+        std::vector<wf::geometry_t> clipped;
+        for (auto& box : boxes)
+        {
+            auto c = wf::geometry_intersection(box, workarea);
+            if ((c.width > 0) && (c.height > 0))
+            {
+                clipped.push_back(c);
+                xs.push_back(c.x);
+                xs.push_back(c.x + c.width);
+                ys.push_back(c.y);
+                ys.push_back(c.y + c.height);
+            }
+        }
+
+        for (auto edges : {&xs, &ys})
+        {
+            std::sort(edges->begin(), edges->end());
+            edges->erase(std::unique(edges->begin(), edges->end()), edges->end());
+        }
+
+        nx = xs.size();
+        ny = ys.size();
+
+        /* Count the views in each cell with a 2D difference array */
+        std::vector<int64_t> diff(nx * ny, 0);
+        for (auto& c : clipped)
+        {
+            size_t x1 = index_of(xs, c.x), x2 = index_of(xs, c.x + c.width);
+            size_t y1 = index_of(ys, c.y), y2 = index_of(ys, c.y + c.height);
+            diff[at(x1, y1)]++;
+            diff[at(x2, y1)]--;
+            diff[at(x1, y2)]--;
+            diff[at(x2, y2)]++;
+        }
+
+        count.assign(nx * ny, 0);
+        for (size_t i = 0; i < nx; i++)
+        {
+            for (size_t j = 0; j < ny; j++)
+            {
+                count[at(i, j)] = diff[at(i, j)] +
+                    (i ? count[at(i - 1, j)] : 0) + (j ? count[at(i, j - 1)] : 0) -
+                    (i && j ? count[at(i - 1, j - 1)] : 0);
+            }
+        }
+
+        /* column[i, j]: integral over cell column i from ys[0] to ys[j],
+         * row[i, j]: integral over cell row j from xs[0] to xs[i],
+         * corner[i, j]: integral from (xs[0], ys[0]) to (xs[i], ys[j]) */
+        column.assign(nx * ny, 0);
+        row.assign(nx * ny, 0);
+        corner.assign(nx * ny, 0);
+        for (size_t i = 0; i < nx; i++)
+        {
+            for (size_t j = 0; j < ny; j++)
+            {
+                if (j > 0)
+                {
+                    column[at(i, j)] = column[at(i, j - 1)] +
+                        count[at(i, j - 1)] * (ys[j] - ys[j - 1]);
+                }
+
+                if (i > 0)
+                {
+                    row[at(i, j)] = row[at(i - 1, j)] +
+                        count[at(i - 1, j)] * (xs[i] - xs[i - 1]);
+                    corner[at(i, j)] = corner[at(i - 1, j)] +
+                        column[at(i - 1, j)] * (xs[i] - xs[i - 1]);
+                }
+            }
+        }
+    }
+
+    /** A coordinate and the grid cell it is in, see locate_x/y(). */
+    struct coordinate_t
+    {
+        int value;
+        size_t cell;
+    };
+
+    coordinate_t locate_x(int x) const
+    {
+        return locate(xs, x);
+    }
+
+    coordinate_t locate_y(int y) const
+    {
+        return locate(ys, y);
+    }
+
+    /** @return The covered area in the rectangle between the coordinates. */
+    int64_t overlap(coordinate_t x1, coordinate_t y1,
+        coordinate_t x2, coordinate_t y2) const
+    {
+        return integral(x2, y2) - integral(x1, y2) - integral(x2, y1) +
+               integral(x1, y1);
+    }
+
+  private:
+    std::vector<int> xs, ys;
+    size_t nx, ny;
+    std::vector<int64_t> count, column, row, corner;
+
+    size_t at(size_t i, size_t j) const
+    {
+        return i * ny + j;
+    }
+
+    static size_t index_of(const std::vector<int>& edges, int value)
+    {
+        return std::lower_bound(edges.begin(), edges.end(), value) -
+               edges.begin();
+    }
+
+    static coordinate_t locate(const std::vector<int>& edges, int value)
+    {
+        value = std::clamp(value, edges.front(), edges.back());
+        size_t cell = std::upper_bound(edges.begin(), edges.end(), value) -
+            edges.begin();
+
+        return {value, std::min(cell, edges.size() - 1) - 1};
+    }
+
+    /* The covered area between the top-left corner and the point */
+    int64_t integral(coordinate_t x, coordinate_t y) const
+    {
+        size_t i = x.cell, j = y.cell;
+        int64_t dx = x.value - xs[i], dy = y.value - ys[j];
+
+        return corner[at(i, j)] + dx * column[at(i, j)] + dy * row[at(i, j)] +
+               dx * dy * count[at(i, j)];
+    }
+};
+
 class wayfire_place_window : public wf::plugin_interface_t
 {
     wf::signal_connection_t created_cb = [=] (wf::signal_data_t *data)
@@ -30,6 +185,9 @@ class wayfire_place_window : public wf::plugin_interface_t
         } else if (mode == "random")
         {
             random(view, workarea);
+        } else if (mode == "smart")
+        {
+            smart(view, workarea);
         } else
         {
             center(view, workarea);
@@ -108,6 +266,100 @@ class wayfire_place_window : public wf::plugin_interface_t
         view->move(pos_x, pos_y);
     }
 
+    /**
+     * Place the view where it overlaps the least with the other views on the
+     * current workspace, preferring positions closer to the top-left corner.
+     *
+     * The candidate positions are those where the view touches an edge of
+     * the workarea or of another view. They include the corners of all
+     * maximal empty rectangles, so if the view fits somewhere without
+     * overlap, such a position is found.
+     */
+    void smart(wayfire_view & view, wf::geometry_t workarea)
+    {
+        wf::geometry_t window = view->get_wm_geometry();
+        if ((window.width > workarea.width) || (window.height > workarea.height))
+        {
+            center(view, workarea);
+
+            return;
+        }
+
+        std::vector<wf::geometry_t> boxes;
+        auto ws = output->workspace->get_current_workspace();
+        for (auto& v : output->workspace->get_views_on_workspace(ws,
+            wf::LAYER_WORKSPACE))
+        {
+            if ((v != view) && v->is_mapped() && !v->minimized)
+            {
+                boxes.push_back(v->get_wm_geometry());
+            }
+        }
+
+        coverage_map_t coverage{workarea, boxes};
+        auto candidates = [&] (int start, int size, int window_size,
+                               auto get_start, auto get_size)
+        {
+            std::vector<int> result = {start, start + size - window_size};
+            for (auto& box : boxes)
+            {
+                result.push_back(get_start(box) + get_size(box));
+                result.push_back(get_start(box) - window_size);
+            }
+
+            std::sort(result.begin(), result.end());
+            result.erase(std::unique(result.begin(), result.end()), result.end());
+            result.erase(std::remove_if(result.begin(), result.end(), [&] (int p)
+            {
+                return (p < start) || (p + window_size > start + size);
+            }), result.end());
+
+            return result;
+        };
+
+        auto xs = candidates(workarea.x, workarea.width, window.width,
+            [] (auto& b) { return b.x; }, [] (auto& b) { return b.width; });
+        auto ys = candidates(workarea.y, workarea.height, window.height,
+            [] (auto& b) { return b.y; }, [] (auto& b) { return b.height; });
+
+        /* Locate the edges of each candidate in the grid only once */
+        using coordinate_t = coverage_map_t::coordinate_t;
+        std::vector<std::pair<coordinate_t, coordinate_t>> cx, cy;
+        for (int x : xs)
+        {
+            cx.push_back({coverage.locate_x(x),
+                coverage.locate_x(x + window.width)});
+        }
+
+        for (int y : ys)
+        {
+            cy.push_back({coverage.locate_y(y),
+                coverage.locate_y(y + window.height)});
+        }
+
+        int64_t best = std::numeric_limits<int64_t>::max();
+        wf::point_t best_pos = {workarea.x, workarea.y};
+        for (auto& [y1, y2] : cy)
+        {
+            for (auto& [x1, x2] : cx)
+            {
+                int64_t overlap = coverage.overlap(x1, y1, x2, y2);
+                if (overlap < best)
+                {
+                    best     = overlap;
+                    best_pos = {x1.value, y1.value};
+                }
+            }
+
+            if (best == 0)
+            {
+                break;
+            }
+        }
+
+        view->move(best_pos.x, best_pos.y);
+    }
+
     void center(wayfire_view & view, wf::geometry_t workarea)
     {
         wf::geometry_t window = view->get_wm_geometry();
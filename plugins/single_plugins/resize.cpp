@@ -9,6 +9,10 @@
 #include <wayfire/plugins/common/view-change-viewport-signal.hpp>
 #include <wayfire/plugins/wobbly/wobbly-signal.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
+#include <wayfire/view-transform.hpp>
+#include <wayfire/util.hpp>
+
+static const std::string preview_transformer_name = "resize-preview";
 
 class wayfire_resize : public wf::plugin_interface_t
 {
@@ -23,6 +27,37 @@ class wayfire_resize : public wf::plugin_interface_t
 
     uint32_t edges;
     wf::option_wrapper_t<wf::buttonbinding_t> button{"resize/activate"};
+    wf::option_wrapper_t<bool> throttle{"resize/throttle"};
+    wf::option_wrapper_t<bool> preview{"resize/preview"};
+
+    /* A client which is slow to redraw would lag further and further behind
+     * if it got a configure for every pointer motion. So while the client
+     * hasn't committed the last requested size, newer sizes only replace the
+     * pending one. If the client doesn't react at all, for ex. because it
+     * can't get any smaller, the pending size is sent after a timeout. */
+    static constexpr uint32_t THROTTLE_TIMEOUT = 100;
+    bool waiting_for_client = false;
+    bool has_pending_size   = false;
+    wf::dimensions_t pending_size;
+    wf::wl_timer throttle_timeout;
+
+    wf::signal_connection_t on_view_geometry_changed = [=] (wf::signal_data_t*)
+    {
+        if (!waiting_for_client)
+        {
+            return;
+        }
+
+        waiting_for_client = false;
+        throttle_timeout.disconnect();
+        if (has_pending_size)
+        {
+            has_pending_size = false;
+            send_size(pending_size, false);
+        }
+
+        update_preview();
+    };
 
   public:
     void init() override
@@ -228,6 +263,7 @@ class wayfire_resize : public wf::plugin_interface_t
         }
 
         this->view = view;
+        view->connect_signal("geometry-changed", &on_view_geometry_changed);
 
         auto og = view->get_output_geometry();
         int anchor_x = og.x;
@@ -259,6 +295,22 @@ class wayfire_resize : public wf::plugin_interface_t
         grab_interface->ungrab();
         output->deactivate_plugin(grab_interface);
 
+        throttle_timeout.disconnect();
+        on_view_geometry_changed.disconnect();
+        waiting_for_client = false;
+        if (view)
+        {
+            /* The final size is always sent */
+            if (has_pending_size)
+            {
+                view->resize(pending_size.width, pending_size.height);
+            }
+
+            view->pop_transformer(preview_transformer_name);
+        }
+
+        has_pending_size = false;
+
         if (view)
         {
             if ((edges & WLR_EDGE_LEFT) ||
@@ -304,7 +356,100 @@ class wayfire_resize : public wf::plugin_interface_t
 
         height = std::max(height, 1);
         width  = std::max(width, 1);
-        view->resize(width, height);
+        request_size({width, height});
+    }
+
+    void request_size(wf::dimensions_t size)
+    {
+        if (throttle && waiting_for_client)
+        {
+            pending_size     = size;
+            has_pending_size = true;
+            update_preview();
+
+            return;
+        }
+
+        send_size(size, false);
+    }
+
+    /**
+     * Send the size to the client and start waiting for it to commit.
+     *
+     * @param from_timeout Whether this is called by the throttle timeout,
+     *   which then rearms itself.
+     */
+    void send_size(wf::dimensions_t size, bool from_timeout)
+    {
+        view->resize(size.width, size.height);
+
+        auto wm = view->get_wm_geometry();
+        waiting_for_client = (wf::dimensions(wm) != size);
+        if (waiting_for_client && !from_timeout)
+        {
+            throttle_timeout.set_timeout(THROTTLE_TIMEOUT, [=] ()
+            {
+                waiting_for_client = false;
+                if (has_pending_size)
+                {
+                    has_pending_size = false;
+                    send_size(pending_size, true);
+                }
+
+                update_preview();
+
+                return waiting_for_client;
+            });
+        }
+    }
+
+    /**
+     * While the client is lagging behind, optionally show its current contents
+     * stretched to the pending size.
+     */
+    void update_preview()
+    {
+        auto wm = view->get_wm_geometry();
+        if (!preview || !has_pending_size || (wm.width <= 0) || (wm.height <= 0))
+        {
+            view->pop_transformer(preview_transformer_name);
+
+            return;
+        }
+
+        wf::geometry_t box = {wm.x, wm.y, pending_size.width, pending_size.height};
+        if (edges & WLR_EDGE_LEFT)
+        {
+            box.x += wm.width - box.width;
+        }
+
+        if (edges & WLR_EDGE_TOP)
+        {
+            box.y += wm.height - box.height;
+        }
+
+        auto transformer = dynamic_cast<wf::view_2D*>(
+            view->get_transformer(preview_transformer_name).get());
+        if (!transformer)
+        {
+            auto tr = std::make_unique<wf::view_2D>(view);
+            transformer = tr.get();
+            view->add_transformer(std::move(tr), preview_transformer_name);
+        }
+
+        view->damage();
+
+        /* view_2D scales around the center of the view */
+        double scale_x = 1.0 * box.width / wm.width;
+        double scale_y = 1.0 * box.height / wm.height;
+        transformer->scale_x = scale_x;
+        transformer->scale_y = scale_y;
+        transformer->translation_x =
+            box.x - (wm.x + wm.width / 2.0 * (1 - scale_x));
+        transformer->translation_y =
+            box.y - (wm.y + wm.height / 2.0 * (1 - scale_y));
+
+        view->damage();
     }
 
     void fini() override
@@ -9,6 +9,7 @@
 
 #include <wayfire/render-manager.hpp>
 #include <wayfire/workspace-manager.hpp>
+#include <wayfire/util.hpp>
 
 #include <wayfire/util/duration.hpp>
 #include <wayfire/nonstd/reverse.hpp>
@@ -21,6 +22,8 @@
 constexpr const char *switcher_transformer = "switcher-3d";
 constexpr const char *switcher_transformer_background = "switcher-3d";
 constexpr float background_dim_factor = 0.6;
+/* How often the background snapshot is refreshed while switcher is shown */
+constexpr uint32_t background_refresh_ms = 500;
 
 using namespace wf::animation;
 class SwitcherPaintAttribs
@@ -102,6 +105,11 @@ class WayfireSwitcher : public wf::plugin_interface_t
     uint32_t activating_modifiers = 0;
     bool active = false;
 
+    /* The background and bottom layers, rendered once and shown dimmed */
+    wf::framebuffer_base_t background_snapshot;
+    uint32_t background_snapshot_time = 0;
+    bool has_background_snapshot = false;
+
   public:
 
     void init() override
@@ -140,6 +148,13 @@ class WayfireSwitcher : public wf::plugin_interface_t
 
     wf::effect_hook_t damage = [=] ()
     {
+        /* The transformers are updated without damaging the views, so make
+         * sure that their cached intermediate buffers are redrawn too */
+        for (auto& sv : views)
+        {
+            sv.view->damage();
+        }
+
         output->render->damage_whole();
     };
 
@@ -248,6 +263,11 @@ class WayfireSwitcher : public wf::plugin_interface_t
         output->render->set_renderer(nullptr);
         output->render->set_redraw_always(false);
 
+        OpenGL::render_begin();
+        background_snapshot.release();
+        OpenGL::render_end();
+        has_background_snapshot = false;
+
         for (auto& view : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
         {
             view->pop_transformer(switcher_transformer);
@@ -513,26 +533,51 @@ class WayfireSwitcher : public wf::plugin_interface_t
             output->workspace->get_current_workspace(), wf::ABOVE_LAYERS);
     }
 
-    void dim_background(float dim)
+    /**
+     * Render the background views on the framebuffer, dimmed by the given
+     * factor. They are drawn from a snapshot which is refreshed only every
+     * background_refresh_ms, because the background rarely changes and is
+     * dimmed anyway.
+     */
+    void render_background(const wf::framebuffer_t& fb, float dim)
     {
-        for (auto view : get_background_views())
+        uint32_t now = wf::get_current_time();
+        bool resized = (background_snapshot.viewport_width != fb.viewport_width) ||
+            (background_snapshot.viewport_height != fb.viewport_height);
+        if (!has_background_snapshot || resized ||
+            (now - background_snapshot_time >= background_refresh_ms))
         {
-            if (dim == 1.0)
+            OpenGL::render_begin();
+            if (background_snapshot.allocate(fb.viewport_width,
+                fb.viewport_height))
             {
-                view->pop_transformer(switcher_transformer_background);
-            } else
-            {
-                if (!view->get_transformer(switcher_transformer_background))
-                {
-                    view->add_transformer(std::make_unique<wf::view_3D>(view),
-                        switcher_transformer_background);
-                }
+                wf::gpu_memory::set_owner(&background_snapshot, "switcher");
+            }
+
+            OpenGL::render_end();
 
-                auto tr = dynamic_cast<wf::view_3D*>(
-                    view->get_transformer(switcher_transformer_background).get());
-                tr->color[0] = tr->color[1] = tr->color[2] = dim;
+            /* Same layout as the output framebuffer, so that the snapshot
+             * can be copied to it as it is */
+            wf::framebuffer_t target = fb;
+            target.fb  = background_snapshot.fb;
+            target.tex = background_snapshot.tex;
+
+            OpenGL::render_begin(target);
+            OpenGL::clear({0, 0, 0, 1});
+            OpenGL::render_end();
+            for (auto view : get_background_views())
+            {
+                view->render_transformed(target, target.geometry);
             }
+
+            background_snapshot_time = now;
+            has_background_snapshot  = true;
         }
+
+        OpenGL::render_begin(fb);
+        OpenGL::render_transformed_texture(wf::texture_t{background_snapshot.tex},
+            wf::geometry_t{-1, 1, 2, -2}, glm::mat4(1.0), {dim, dim, dim, 1});
+        OpenGL::render_end();
     }
 
     SwitcherView create_switcher_view(wayfire_view view)
@@ -577,15 +622,7 @@ class WayfireSwitcher : public wf::plugin_interface_t
 
     wf::render_hook_t switcher_renderer = [=] (const wf::framebuffer_t& fb)
     {
-        OpenGL::render_begin(fb);
-        OpenGL::clear({0, 0, 0, 1});
-        OpenGL::render_end();
-
-        dim_background(background_dim);
-        for (auto view : get_background_views())
-        {
-            view->render_transformed(fb, fb.geometry);
-        }
+        render_background(fb, background_dim);
 
         /* Render in the reverse order because we don't use depth testing */
         for (auto& view : wf::reverse(views))
@@ -14,8 +14,10 @@
 
 #include <cmath>
 #include <utility>
+#include <algorithm>
 
 #include <wayfire/plugins/common/workspace-wall.hpp>
+#include <wayfire/plugins/common/workspace-stream-sharing.hpp>
 #include <wayfire/plugins/common/geometry-animation.hpp>
 #include "vswipe-processing.hpp"
 
@@ -90,6 +92,75 @@ class vswipe : public wf::plugin_interface_t
     wf::option_wrapper_t<double> delta_threshold{"vswipe/delta_threshold"};
     wf::option_wrapper_t<double> speed_factor{"vswipe/speed_factor"};
     wf::option_wrapper_t<double> speed_cap{"vswipe/speed_cap"};
+    wf::option_wrapper_t<bool> prerender{"vswipe/prerender"};
+
+    /* Keep the streams of the adjacent workspaces up to date while no swipe
+     * is running, so that the first frame of a swipe doesn't have to render
+     * them from scratch. Streams are only repainted where they were damaged,
+     * and the frame damage is complete before the output is repainted. */
+    nonstd::observer_ptr<wf::workspace_stream_pool_t> streams;
+    std::vector<wf::point_t> prerendered;
+    wf::effect_hook_t prerender_hook = [=] ()
+    {
+        if (output->is_plugin_active(grab_interface->name))
+        {
+            /* The wall takes care of the streams during the swipe */
+            return;
+        }
+
+        std::vector<wf::point_t> neighbours;
+        if (prerender)
+        {
+            neighbours = get_swipe_neighbours();
+        }
+
+        for (auto& ws : prerendered)
+        {
+            if (std::find(neighbours.begin(), neighbours.end(), ws) ==
+                neighbours.end())
+            {
+                streams->stop(ws);
+            }
+        }
+
+        for (auto& ws : neighbours)
+        {
+            streams->update(ws);
+        }
+
+        prerendered = std::move(neighbours);
+    };
+
+    std::vector<wf::point_t> get_swipe_neighbours()
+    {
+        auto grid = output->workspace->get_workspace_grid_size();
+        auto cws  = output->workspace->get_current_workspace();
+
+        std::vector<wf::point_t> candidates;
+        if (enable_horizontal)
+        {
+            candidates.push_back({cws.x - 1, cws.y});
+            candidates.push_back({cws.x + 1, cws.y});
+        }
+
+        if (enable_vertical)
+        {
+            candidates.push_back({cws.x, cws.y - 1});
+            candidates.push_back({cws.x, cws.y + 1});
+        }
+
+        std::vector<wf::point_t> neighbours;
+        for (auto& ws : candidates)
+        {
+            if ((ws.x >= 0) && (ws.y >= 0) &&
+                (ws.x < grid.width) && (ws.y < grid.height))
+            {
+                neighbours.push_back(ws);
+            }
+        }
+
+        return neighbours;
+    }
 
   public:
     void init() override
@@ -104,6 +175,9 @@ class vswipe : public wf::plugin_interface_t
 
         wall = std::make_unique<wf::workspace_wall_t>(output);
         wall->connect_signal("frame", &this->on_frame);
+
+        streams = wf::workspace_stream_pool_t::ensure_pool(output);
+        output->render->add_effect(&prerender_hook, wf::OUTPUT_EFFECT_PRE);
     }
 
     wf::signal_connection_t on_frame = {[=] (wf::signal_data_t*)
@@ -378,6 +452,14 @@ class vswipe : public wf::plugin_interface_t
         wf::get_core().disconnect_signal("pointer_swipe_begin", &on_swipe_begin);
         wf::get_core().disconnect_signal("pointer_swipe_update", &on_swipe_update);
         wf::get_core().disconnect_signal("pointer_swipe_end", &on_swipe_end);
+
+        output->render->rem_effect(&prerender_hook);
+        for (auto& ws : prerendered)
+        {
+            streams->stop(ws);
+        }
+
+        streams->unref();
     }
 };
 
@@ -1,9 +1,23 @@
 #include <wayfire/plugin.hpp>
+#include <wayfire/core.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/opengl.hpp>
 #include <wayfire/render-manager.hpp>
 #include <wayfire/util/duration.hpp>
 
+#include <cmath>
+
+static const char *zoom_snippet =
+    R"(
+uniform highp vec2 zoom_offset;
+uniform highp float zoom_scale;
+
+highp vec2 zoom_coord(highp vec2 uv)
+{
+    return zoom_offset + uv * zoom_scale;
+}
+)";
+
 class wayfire_zoom_screen : public wf::plugin_interface_t
 {
     wf::option_wrapper_t<wf::keybinding_t> modifier{"zoom/modifier"};
@@ -11,6 +25,9 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
     wf::option_wrapper_t<int> smoothing_duration{"zoom/smoothing_duration"};
     wf::animation::simple_animation_t progression{smoothing_duration};
     bool hook_set = false;
+    wf::post_snippet_t snippet;
+    /* The output-local point around which the output is magnified */
+    wf::pointf_t center = {0, 0};
 
   public:
     void init() override
@@ -20,6 +37,15 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
 
         progression.set(1, 1);
 
+        snippet.type     = wf::post_snippet_t::POST_SNIPPET_COORD;
+        snippet.function = "zoom_coord";
+        snippet.source   = zoom_snippet;
+        snippet.set_uniforms = [=] (OpenGL::program_t& program,
+                                    const wf::framebuffer_base_t& destination)
+        {
+            set_uniforms(program, destination);
+        };
+
         output->add_axis(modifier, &axis);
     }
 
@@ -36,12 +62,56 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
             if (!hook_set)
             {
                 hook_set = true;
-                output->render->add_post(&render_hook);
-                output->render->set_redraw_always();
+                output->render->add_post_snippet(&snippet);
+                output->render->add_effect(&update_viewport,
+                    wf::OUTPUT_EFFECT_PRE);
+                wf::get_core().connect_signal("pointer_motion_post",
+                    &on_motion);
+                wf::get_core().connect_signal("pointer_motion_absolute_post",
+                    &on_motion);
+                wf::get_core().connect_signal("tablet_axis_post", &on_motion);
             }
+
+            output->render->schedule_redraw();
         }
     }
 
+    /* The output is repainted only when it is damaged or when the magnified
+     * part changes, so follow the cursor also when nothing else happens */
+    wf::signal_connection_t on_motion = [=] (wf::signal_data_t*)
+    {
+        output->render->schedule_redraw();
+    };
+
+    /**
+     * Update the magnified part of the output at the start of each frame, so
+     * that the render manager composites only what is going to be visible.
+     */
+    wf::effect_hook_t update_viewport = [=] ()
+    {
+        if (!progression.running() && (progression - 1 <= 0.01))
+        {
+            unset_hook();
+
+            return;
+        }
+
+        auto oc = output->get_cursor_position();
+        wlr_box b = output->get_relative_geometry();
+        wlr_box_closest_point(&b, oc.x, oc.y, &center.x, &center.y);
+        /* The shader works with whole pixels */
+        center = {std::floor(center.x), std::floor(center.y)};
+
+        const double scale = progression;
+        output->render->set_magnified_viewport(
+            {center.x - center.x / scale, center.y - center.y / scale}, scale);
+
+        if (progression.running())
+        {
+            output->render->schedule_redraw();
+        }
+    };
+
     wf::axis_callback axis = [=] (wlr_event_pointer_axis *ev)
     {
         if (!output->can_activate_plugin(grab_interface))
@@ -59,47 +129,35 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
         return true;
     };
 
-    wf::post_hook_t render_hook = [=] (const wf::framebuffer_base_t& source,
-                                       const wf::framebuffer_base_t& destination)
+    void set_uniforms(OpenGL::program_t& program,
+        const wf::framebuffer_base_t& destination)
     {
         auto w = destination.viewport_width;
         auto h = destination.viewport_height;
-        auto oc = output->get_cursor_position();
-        double x, y;
-        wlr_box b = output->get_relative_geometry();
-        wlr_box_closest_point(&b, oc.x, oc.y, &x, &y);
 
         /* get rotation & scale */
-        wlr_box box = {int(x), int(y), 1, 1};
+        wlr_box box = {int(center.x), int(center.y), 1, 1};
         box = output->render->get_target_framebuffer().
             framebuffer_box_from_geometry_box(box);
 
-        x = box.x;
-        y = h - box.y;
+        double x = box.x;
+        double y = h - box.y;
 
         const float scale = (progression - 1) / progression;
 
-        const float tw = w / progression, th = h / progression;
         const float x1 = x * scale;
         const float y1 = y * scale;
 
-        OpenGL::render_begin(source);
-        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, source.fb));
-        GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination.fb));
-        GL_CALL(glBlitFramebuffer(x1, y1, x1 + tw, y1 + th, 0, 0, w, h,
-            GL_COLOR_BUFFER_BIT, GL_LINEAR));
-        OpenGL::render_end();
-
-        if (!progression.running() && (progression - 1 <= 0.01))
-        {
-            unset_hook();
-        }
-    };
+        program.uniform2f("zoom_offset", x1 / w, y1 / h);
+        program.uniform1f("zoom_scale", 1.0 / progression);
+    }
 
     void unset_hook()
     {
-        output->render->set_redraw_always(false);
-        output->render->rem_post(&render_hook);
+        output->render->rem_effect(&update_viewport);
+        output->render->rem_post_snippet(&snippet);
+        output->render->set_magnified_viewport({0, 0}, 1);
+        on_motion.disconnect();
         hook_set = false;
     }
 
@@ -107,7 +165,7 @@ class wayfire_zoom_screen : public wf::plugin_interface_t
     {
         if (hook_set)
         {
-            output->render->rem_post(&render_hook);
+            unset_hook();
         }
 
         output->rem_binding(&axis);
@@ -4,7 +4,9 @@
 #include <wayfire/matcher.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/view-transaction.hpp>
 #include <wayfire/plugins/common/view-change-viewport-signal.hpp>
+#include <optional>
 
 #include "tree-controller.hpp"
 
@@ -86,6 +88,7 @@ class tile_plugin_t : public wf::plugin_interface_t
 
     void update_root_size(wf::geometry_t workarea)
     {
+        wf::view_transaction_t tx;
         auto output_geometry = output->get_relative_geometry();
         auto wsize = output->workspace->get_workspace_grid_size();
         for (int i = 0; i < wsize.width; i++)
@@ -111,6 +114,7 @@ class tile_plugin_t : public wf::plugin_interface_t
             .internal = inner_gaps,
         };
 
+        wf::view_transaction_t tx;
         for (auto& col : roots)
         {
             for (auto& root : col)
@@ -249,6 +253,14 @@ class tile_plugin_t : public wf::plugin_interface_t
             vp = output->workspace->get_current_workspace();
         }
 
+        /* The other views in the tree make room for the new one. Views moved
+         * here together are all added in the transaction of the group. */
+        std::optional<wf::view_transaction_t> tx;
+        if (!batch_tx)
+        {
+            tx.emplace();
+        }
+
         auto view_node = std::make_unique<wf::tile::view_node_t>(view);
         roots[vp.x][vp.y]->as_split_node()->add_child(std::move(view_node));
         output->workspace->add_view_to_sublayer(view, tiled_sublayer[vp.x][vp.y]);
@@ -285,6 +297,23 @@ class tile_plugin_t : public wf::plugin_interface_t
         }
     };
 
+    /* Open while a group of views is moved to this output */
+    std::unique_ptr<wf::view_transaction_t> batch_tx;
+
+    signal_connection_t on_views_pre_moved_to_output = [=] (signal_data_t *data)
+    {
+        auto ev = static_cast<wf::views_pre_moved_to_output_signal*>(data);
+        if (ev->new_output == this->output)
+        {
+            batch_tx = std::make_unique<wf::view_transaction_t>();
+        }
+    };
+
+    signal_connection_t on_views_moved_to_output = [=] (signal_data_t *data)
+    {
+        batch_tx.reset();
+    };
+
     /** Remove the given view from its tiling container */
     void detach_view(nonstd::observer_ptr<tile::view_node_t> view,
         bool reinsert = true)
@@ -292,6 +321,7 @@ class tile_plugin_t : public wf::plugin_interface_t
         stop_controller(true);
         auto wview = view->view;
 
+        wf::view_transaction_t tx;
         view->parent->remove_child(view);
         /* View node is invalid now */
         flatten_roots();
@@ -338,9 +368,11 @@ class tile_plugin_t : public wf::plugin_interface_t
 
     void set_view_fullscreen(wayfire_view view, bool fullscreen)
     {
-        /* Set fullscreen, and trigger resizing of the views */
+        /* Set fullscreen, and trigger resizing of the view. The geometry of
+         * the other nodes doesn't depend on it. */
         view->set_fullscreen(fullscreen);
-        update_root_size(output->workspace->get_workarea());
+        auto node = tile::view_node_t::get_node(view);
+        node->set_geometry(node->geometry);
     }
 
     signal_callback_t on_fullscreen_request = [=] (signal_data_t *data)
@@ -566,6 +598,10 @@ class tile_plugin_t : public wf::plugin_interface_t
         output->connect_signal("view-minimize-request", &on_view_minimized);
         wf::get_core().connect_signal("view-pre-moved-to-output",
             &on_view_pre_moved_to_output);
+        wf::get_core().connect_signal("views-pre-moved-to-output",
+            &on_views_pre_moved_to_output);
+        wf::get_core().connect_signal("views-moved-to-output",
+            &on_views_moved_to_output);
         setup_callbacks();
     }
 
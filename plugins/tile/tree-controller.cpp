@@ -211,6 +211,44 @@ move_view_controller_t::move_view_controller_t(
         this->output = this->grabbed_view->view->get_output();
         this->current_input = grab;
     }
+
+    std::function<void(nonstd::observer_ptr<tree_node_t>)> collect;
+    collect = [&] (nonstd::observer_ptr<tree_node_t> node)
+    {
+        if (node->as_view_node())
+        {
+            drop_zones.push_back({node->geometry, node->as_view_node()});
+        }
+
+        for (auto& child : node->children)
+        {
+            collect(child);
+        }
+    };
+    collect(root);
+}
+
+nonstd::observer_ptr<view_node_t> move_view_controller_t::find_zone_at(
+    wf::point_t input)
+{
+    /* Consecutive motion events are usually over the same view */
+    if ((last_zone < drop_zones.size()) &&
+        (drop_zones[last_zone].geometry & input))
+    {
+        return drop_zones[last_zone].node;
+    }
+
+    for (size_t i = 0; i < drop_zones.size(); i++)
+    {
+        if (drop_zones[i].geometry & input)
+        {
+            last_zone = i;
+
+            return drop_zones[i].node;
+        }
+    }
+
+    return nullptr;
 }
 
 move_view_controller_t::~move_view_controller_t()
@@ -225,7 +263,7 @@ move_view_controller_t::~move_view_controller_t()
 nonstd::observer_ptr<view_node_t> move_view_controller_t::check_drop_destination(
     wf::point_t input)
 {
-    auto dropped_at = find_view_at(this->root, this->current_input);
+    auto dropped_at = find_zone_at(input);
     if (!dropped_at || (dropped_at == this->grabbed_view))
     {
         return nullptr;
@@ -241,10 +279,7 @@ void move_view_controller_t::ensure_preview(wf::point_t start)
         return;
     }
 
-    auto view = std::make_unique<wf::preview_indication_view_t>(output, start);
-
-    this->preview = {view};
-    wf::get_core().add_view(std::move(view));
+    this->preview = wf::preview_indication_t::create(output, start);
 }
 
 void move_view_controller_t::input_motion(wf::point_t input)
@@ -255,7 +290,16 @@ void move_view_controller_t::input_motion(wf::point_t input)
     }
 
     this->current_input = input;
-    auto view = check_drop_destination(input);
+    auto view  = check_drop_destination(input);
+    auto split = view ? calculate_insert_type(view, input) : INSERT_NONE;
+    if ((view == preview_target) && (split == preview_split))
+    {
+        /* The preview is already animating towards the right place */
+        return;
+    }
+
+    preview_target = view;
+    preview_split  = split;
     if (!view)
     {
         /* No view, no preview */
@@ -268,7 +312,6 @@ void move_view_controller_t::input_motion(wf::point_t input)
         return;
     }
 
-    auto split = calculate_insert_type(view, input);
     ensure_preview(get_output_local_coordinates(output, input));
 
     auto preview_geometry = calculate_split_preview(view, split);
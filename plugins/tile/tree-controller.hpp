@@ -7,7 +7,7 @@
 /* Contains functions which are related to manipulating the tiling tree */
 namespace wf
 {
-class preview_indication_view_t;
+class preview_indication_t;
 namespace tile
 {
 /**
@@ -89,7 +89,7 @@ class move_view_controller_t : public tile_controller_t
     wf::output_t *output;
     wf::point_t current_input;
 
-    nonstd::observer_ptr<wf::preview_indication_view_t> preview;
+    nonstd::observer_ptr<wf::preview_indication_t> preview;
     /**
      * Create preview if it doesn't exist
      *
@@ -102,6 +102,29 @@ class move_view_controller_t : public tile_controller_t
      * Return the node under the input which is suitable for dropping on.
      */
     nonstd::observer_ptr<view_node_t> check_drop_destination(wf::point_t input);
+
+    /**
+     * The leaves of the tree with their geometry. The tree doesn't change
+     * during the drag (the controller is stopped if it does), so they are
+     * collected once instead of walking the tree on each motion.
+     */
+    struct drop_zone_t
+    {
+        wf::geometry_t geometry;
+        nonstd::observer_ptr<view_node_t> node;
+    };
+
+    std::vector<drop_zone_t> drop_zones;
+    /* The zone which contained the input last time, it is checked first */
+    size_t last_zone = 0;
+
+    /** Find the leaf at the given point, or null */
+    nonstd::observer_ptr<view_node_t> find_zone_at(wf::point_t input);
+
+    /* What the preview currently shows, so that it is updated only when the
+     * drop target changes */
+    nonstd::observer_ptr<view_node_t> preview_target;
+    split_insertion_t preview_split = INSERT_NONE;
 };
 
 class resize_view_controller_t : public tile_controller_t
@@ -192,6 +192,12 @@ std::unique_ptr<tree_node_t> split_node_t::remove_child(
 
 void split_node_t::set_geometry(wf::geometry_t geometry)
 {
+    /* The children keep their proportions, so they wouldn't change either */
+    if (geometry == this->geometry)
+    {
+        return;
+    }
+
     tree_node_t::set_geometry(geometry);
     recalculate_children(geometry);
 }
@@ -308,16 +314,20 @@ view_node_t::view_node_t(wayfire_view view)
     this->on_geometry_changed   = [=] (wf::signal_data_t*) {update_transformer(); };
     this->on_decoration_changed = [=] (wf::signal_data_t*)
     {
+        /* The target geometry is the same, but the view has to recalculate
+         * its size with the new decoration */
+        last_target = {0, 0, -1, -1};
         set_geometry(geometry);
     };
-    view->connect_signal("geometry-changed", &on_geometry_changed);
+    /* The transformer only has to be right when the view is repainted */
+    view->connect_signal("geometry-changed-frame", &on_geometry_changed);
     view->connect_signal("decoration-changed", &on_decoration_changed);
 }
 
 view_node_t::~view_node_t()
 {
     view->pop_transformer(scale_transformer_name);
-    view->disconnect_signal("geometry-changed", &on_geometry_changed);
+    view->disconnect_signal("geometry-changed-frame", &on_geometry_changed);
     view->disconnect_signal("decoration-changed", &on_decoration_changed);
     view->erase_data<view_node_custom_data_t>();
 }
@@ -384,8 +394,19 @@ void view_node_t::set_geometry(wf::geometry_t geometry)
         return;
     }
 
-    view->set_tiled(TILED_EDGES_ALL);
-    view->set_geometry(calculate_target_geometry());
+    /* Both of these send configure events to the client, so avoid them if
+     * nothing has changed */
+    if (view->tiled_edges != TILED_EDGES_ALL)
+    {
+        view->set_tiled(TILED_EDGES_ALL);
+    }
+
+    auto target = calculate_target_geometry();
+    if ((target != last_target) || (target != view->get_wm_geometry()))
+    {
+        last_target = target;
+        view->set_geometry(target);
+    }
 }
 
 void view_node_t::update_transformer()
@@ -98,6 +98,8 @@ struct split_node_t : public tree_node_t
      * Set the total geometry available to the node. This will recursively
      * resize the children nodes, so that they fit inside the new geometry and
      * have a size proportional to their old size.
+     *
+     * If the geometry doesn't change, the children are left as they are.
      */
     void set_geometry(wf::geometry_t geometry) override;
 
@@ -152,6 +154,8 @@ struct view_node_t : public tree_node_t
      * Note that the resulting view geometry will not always be equal to the
      * geometry of the node. For example, a fullscreen view will always have
      * the geometry of the whole output.
+     *
+     * The view is reconfigured only if its target geometry changed.
      */
     void set_geometry(wf::geometry_t geometry) override;
 
@@ -169,6 +173,9 @@ struct view_node_t : public tree_node_t
     nonstd::observer_ptr<scale_transformer_t> transformer;
     signal_callback_t on_geometry_changed, on_decoration_changed;
 
+    /* The last geometry requested for the view */
+    wf::geometry_t last_target = {0, 0, -1, -1};
+
     wf::geometry_t calculate_target_geometry();
     void update_transformer();
 };
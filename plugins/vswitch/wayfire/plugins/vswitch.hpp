@@ -26,6 +26,10 @@ class workspace_animation_t : public duration_t
  * Represents the action of switching workspaces with the vswitch algorithm.
  *
  * The workspace is actually switched at the end of the animation
+ *
+ * The workspaces are captured into workspace streams when they first become
+ * visible, and each frame of the animation draws one textured quad per
+ * visible workspace. The streams are repainted only where they get damage.
  */
 class workspace_switch_t
 {
@@ -203,6 +207,10 @@ class workspace_switch_t
             tr->alpha = smoothing_amount;
         }
 
+        /* The wall repaints the whole output on each frame, and the
+         * transformer applies the alpha on its own. Damaging the view here
+         * would only make it render its surfaces again, and the stream of
+         * its workspace repaint the area below it. */
         auto all_views = overlay_view->enumerate_views();
         for (auto v : wf::reverse(all_views))
         {
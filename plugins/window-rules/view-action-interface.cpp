@@ -12,6 +12,8 @@
 #include <cfloat>
 #include <iostream>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 namespace wf
@@ -19,8 +21,83 @@ namespace wf
 view_action_interface_t::~view_action_interface_t()
 {}
 
+namespace
+{
+using compiled_action_t = view_action_interface_t::compiled_action_t;
+
+/**
+ * Call a method of the action interface with arguments converted at compile
+ * time. Methods returning bool report errors, like execute().
+ */
+template<class Result, class... Args>
+class bound_action_t : public compiled_action_t
+{
+  public:
+    using method_t = Result (view_action_interface_t::*)(Args...);
+
+    bound_action_t(method_t method, Args... args) :
+        method(method), args(args...)
+    {}
+
+    bool run(view_action_interface_t& iface) override
+    {
+        return std::apply([&] (auto&... bound)
+        {
+            if constexpr (std::is_same_v<Result, bool>)
+            {
+                return (iface.*method)(bound...);
+            } else
+            {
+                (iface.*method)(bound...);
+                return false;
+            }
+        }, args);
+    }
+
+  private:
+    method_t method;
+    std::tuple<Args...> args;
+};
+
+/** An action which failed to compile, the error was logged then. */
+class invalid_action_t : public compiled_action_t
+{
+  public:
+    bool run(view_action_interface_t&) override
+    {
+        return true;
+    }
+};
+
+template<class Result, class... Args>
+std::unique_ptr<compiled_action_t> bind_action(
+    Result (view_action_interface_t::*method)(Args...), Args... args)
+{
+    return std::make_unique<bound_action_t<Result, Args...>>(method, args...);
+}
+}
+
 bool view_action_interface_t::execute(const std::string & name,
     const std::vector<variant_t> & args)
+{
+    auto& entry = _compiled[&args];
+    if (!entry.action || (entry.name != name) || (entry.args != args))
+    {
+        entry.name   = name;
+        entry.args   = args;
+        entry.action = compile(name, args);
+    }
+
+    return entry.action->run(*this);
+}
+
+void view_action_interface_t::clear_compiled_actions()
+{
+    _compiled.clear();
+}
+
+std::unique_ptr<compiled_action_t> view_action_interface_t::compile(
+    const std::string & name, const std::vector<variant_t> & args)
 {
     if (name == "set")
     {
@@ -29,7 +106,7 @@ bool view_action_interface_t::execute(const std::string & name,
             LOGE(
                 "View action interface: Set execution requires at least 2 arguments, the first of which should be an identifier.");
 
-            return true;
+            return std::make_unique<invalid_action_t>();
         }
 
         auto id = wf::get_string(args.at(0));
@@ -39,14 +116,16 @@ bool view_action_interface_t::execute(const std::string & name,
             auto alpha = _validate_alpha(args);
             if (std::get<0>(alpha))
             {
-                _set_alpha(std::get<1>(alpha));
+                return bind_action(&view_action_interface_t::_set_alpha,
+                    std::get<1>(alpha));
             }
         } else if (id == "geometry")
         {
             auto geometry = _validate_geometry(args);
             if (std::get<0>(geometry))
             {
-                _set_geometry(std::get<1>(geometry), std::get<2>(geometry),
+                return bind_action(&view_action_interface_t::_set_geometry,
+                    std::get<1>(geometry), std::get<2>(geometry),
                     std::get<3>(geometry), std::get<4>(geometry));
             }
         } else
@@ -54,30 +133,23 @@ bool view_action_interface_t::execute(const std::string & name,
             LOGE("View action interface: Unsupported set operation to identifier ",
                 id);
 
-            return true;
+            return std::make_unique<invalid_action_t>();
         }
 
-        return false;
+        /* Invalid arguments were not an error before */
+        return bind_action(&view_action_interface_t::_do_nothing);
     } else if (name == "maximize")
     {
-        _maximize();
-
-        return false;
+        return bind_action(&view_action_interface_t::_maximize);
     } else if (name == "unmaximize")
     {
-        _unmaximize();
-
-        return false;
+        return bind_action(&view_action_interface_t::_unmaximize);
     } else if (name == "minimize")
     {
-        _minimize();
-
-        return false;
+        return bind_action(&view_action_interface_t::_minimize);
     } else if (name == "unminimize")
     {
-        _unminimize();
-
-        return false;
+        return bind_action(&view_action_interface_t::_unminimize);
     } else if (name == "snap")
     {
         if ((args.size() < 1) || (wf::is_string(args.at(0)) == false))
@@ -85,91 +157,77 @@ bool view_action_interface_t::execute(const std::string & name,
             LOGE(
                 "View action interface: Snap execution requires 1 string as argument.");
 
-            return true;
-        }
-
-        auto output = _view->get_output();
-        if (output == nullptr)
-        {
-            LOGE("View action interface: Output associated with view was null.");
-
-            return true;
+            return std::make_unique<invalid_action_t>();
         }
 
         auto location = wf::get_string(args.at(0));
-
-        snap_signal data;
-        data.view = _view;
+        slot_type slot;
 
         if (location == "top")
         {
-            data.slot = SLOT_TOP;
+            slot = SLOT_TOP;
         } else if (location == "top_right")
         {
-            data.slot = SLOT_TR;
+            slot = SLOT_TR;
         } else if (location == "right")
         {
-            data.slot = SLOT_RIGHT;
+            slot = SLOT_RIGHT;
         } else if (location == "bottom_right")
         {
-            data.slot = SLOT_BR;
+            slot = SLOT_BR;
         } else if (location == "bottom")
         {
-            data.slot = SLOT_BOTTOM;
+            slot = SLOT_BOTTOM;
         } else if (location == "bottom_left")
         {
-            data.slot = SLOT_BL;
+            slot = SLOT_BL;
         } else if (location == "left")
         {
-            data.slot = SLOT_LEFT;
+            slot = SLOT_LEFT;
         } else if (location == "top_left")
         {
-            data.slot = SLOT_TL;
+            slot = SLOT_TL;
         } else if (location == "center")
         {
-            data.slot = SLOT_CENTER;
+            slot = SLOT_CENTER;
         } else
         {
             LOGE(
                 "View action interface: Incorrect string literal for snap location: ", location,
                 ".");
 
-            return true;
+            return std::make_unique<invalid_action_t>();
         }
 
-        LOGI("View action interface: Snap to ", location, ".");
-
-        output->emit_signal("view-snap", &data);
-
-        return false;
+        return bind_action(&view_action_interface_t::_snap, (int)slot, location);
     } else if (name == "move")
     {
         auto position = _validate_position(args);
         if (std::get<0>(position))
         {
-            _move(std::get<1>(position), std::get<2>(position));
-            return false;
+            return bind_action(&view_action_interface_t::_move,
+                std::get<1>(position), std::get<2>(position));
         }
 
         LOGE("View action interface: invalid arguments for move");
-        return true;
+        return std::make_unique<invalid_action_t>();
     } else if (name == "resize")
     {
         auto size = _validate_size(args);
         if (std::get<0>(size))
         {
-            _resize(std::get<1>(size), std::get<2>(size));
-            return false;
+            return bind_action(&view_action_interface_t::_resize,
+                std::get<1>(size), std::get<2>(size));
         }
 
         LOGE("View action interface: invalid arguments for resize");
-        return true;
+        return std::make_unique<invalid_action_t>();
     }
 
     LOGE("View action interface: Unsupported action execution requested. Name: ",
         name, ".");
 
-    return true;
+    return std::make_unique<invalid_action_t>();
 }
 
 void view_action_interface_t::set_view(wayfire_view view)
@@ -177,6 +235,30 @@ void view_action_interface_t::set_view(wayfire_view view)
     _view = view;
 }
 
+void view_action_interface_t::_do_nothing()
+{}
+
+bool view_action_interface_t::_snap(int slot, std::string location)
+{
+    auto output = _view->get_output();
+    if (output == nullptr)
+    {
+        LOGE("View action interface: Output associated with view was null.");
+
+        return true;
+    }
+
+    snap_signal data;
+    data.view = _view;
+    data.slot = (slot_type)slot;
+
+    LOGI("View action interface: Snap to ", location, ".");
+
+    output->emit_signal("view-snap", &data);
+
+    return false;
+}
+
 void view_action_interface_t::_maximize()
 {
     _view->tile_request(wf::TILED_EDGES_ALL);
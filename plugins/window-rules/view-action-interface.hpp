@@ -3,8 +3,10 @@
 
 #include "wayfire/action/action_interface.hpp"
 #include "wayfire/view.hpp"
+#include <memory>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace wf
@@ -19,7 +21,41 @@ class view_action_interface_t : public action_interface_t
 
     void set_view(wayfire_view view);
 
+    /** Forget the compiled actions, needed when the rules are replaced. */
+    void clear_compiled_actions();
+
+    /**
+     * An action whose name was resolved and whose arguments were validated
+     * and converted once, so that executing it is a single virtual call.
+     */
+    class compiled_action_t
+    {
+      public:
+        virtual ~compiled_action_t() = default;
+        /** @return True on error, like execute() */
+        virtual bool run(view_action_interface_t& iface) = 0;
+    };
+
   private:
+    /** @return The action, or an action which fails if the arguments are wrong */
+    std::unique_ptr<compiled_action_t> compile(const std::string & name,
+        const std::vector<variant_t> & args);
+
+    struct cache_entry_t
+    {
+        std::string name;
+        std::vector<variant_t> args;
+        std::unique_ptr<compiled_action_t> action;
+    };
+
+    /**
+     * Compiled actions, by the address of their arguments. Rules keep their
+     * arguments for their whole lifetime, so each rule action is compiled the
+     * first time it is executed. The name and the arguments are compared
+     * anyway, in case the rule passes a temporary.
+     */
+    std::unordered_map<const std::vector<variant_t>*, cache_entry_t> _compiled;
+
     void _maximize();
     void _unmaximize();
     void _minimize();
@@ -43,6 +79,7 @@ class view_action_interface_t : public action_interface_t
     void _set_geometry(int x, int y, int w, int h);
     void _move(int x, int y);
     void _resize(int w, int h);
+    bool _snap(int slot, std::string location);
 
     wf::geometry_t _get_workspace_grid_geometry(wf::output_t *output) const;
 
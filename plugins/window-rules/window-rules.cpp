@@ -60,9 +60,12 @@ class wayfire_window_rules_t : public wf::plugin_interface_t
     };
 
     // Auto-reload on changes to config file
-    wf::signal_connection_t _reload_config = [=] (wf::signal_data_t*)
+    wf::signal_connection_t _reload_config = [=] (wf::signal_data_t *data)
     {
-        setup_rules_from_config();
+        if (wf::config_section_changed(data, "window-rules"))
+        {
+            setup_rules_from_config();
+        }
     };
 
     std::vector<std::shared_ptr<wf::rule_t>> _rules;
@@ -124,10 +127,12 @@ void wayfire_window_rules_t::apply(const std::string & signal,
         return;
     }
 
+    // The access interface caches the view's strings, so it is shared by all
+    // rules for this signal.
+    _access_interface.set_view(view);
+    _action_interface.set_view(view);
     for (const auto & rule : _rules)
     {
-        _access_interface.set_view(view);
-        _action_interface.set_view(view);
         auto error = rule->apply(signal, _access_interface, _action_interface);
         if (error)
         {
@@ -144,7 +149,6 @@ void wayfire_window_rules_t::apply(const std::string & signal,
         bool error = false;
 
         // Assume we will use the view access interface.
-        _access_interface.set_view(view);
         wf::access_interface_t & access_iface = _access_interface;
 
         // If a custom access interface is set in the regoistration, use this one.
@@ -193,6 +197,7 @@ void wayfire_window_rules_t::apply(const std::string & signal,
 void wayfire_window_rules_t::setup_rules_from_config()
 {
     _rules.clear();
+    _action_interface.clear_compiled_actions();
 
     // Build rule list.
     auto section = wf::get_core().config.get_section("window-rules");
@@ -370,40 +370,6 @@ static int modelStep(Model *model, float friction, float k, float time)
     return wobbly;
 }
 
-static void bezierPatchEvaluate (Model *model, float u, float v,
-        float *patchX, float *patchY)
-{
-    float coeffsU[4], coeffsV[4];
-    float x, y;
-    int   i, j;
-
-    coeffsU[0] = (1 - u) * (1 - u) * (1 - u);
-    coeffsU[1] = 3 * u * (1 - u) * (1 - u);
-    coeffsU[2] = 3 * u * u * (1 - u);
-    coeffsU[3] = u * u * u;
-
-    coeffsV[0] = (1 - v) * (1 - v) * (1 - v);
-    coeffsV[1] = 3 * v * (1 - v) * (1 - v);
-    coeffsV[2] = 3 * v * v * (1 - v);
-    coeffsV[3] = v * v * v;
-
-    x = y = 0.0f;
-
-    for (i = 0; i < 4; i++)
-    {
-        for (j = 0; j < 4; j++)
-        {
-            x += coeffsU[i] * coeffsV[j] *
-                model->objects[j * GRID_WIDTH + i].position.x;
-            y += coeffsU[i] * coeffsV[j] *
-                model->objects[j * GRID_HEIGHT + i].position.y;
-        }
-    }
-
-    *patchX = x;
-    *patchY = y;
-}
-
 static int wobblyEnsureModel(struct wobbly_surface *surface)
 {
     WobblyWindow *ww = surface->ww;
@@ -548,13 +514,23 @@ void wobbly_done_paint(struct wobbly_surface *surface)
     }
 }
 
+/* Bernstein coefficients of the cubic bezier curve at t */
+static void bezierCoefficients(float t, float coeffs[4])
+{
+    coeffs[0] = (1 - t) * (1 - t) * (1 - t);
+    coeffs[1] = 3 * t * (1 - t) * (1 - t);
+    coeffs[2] = 3 * t * t * (1 - t);
+    coeffs[3] = t * t * t;
+}
+
 void wobbly_add_geometry(struct wobbly_surface *surface)
 {
     WobblyWindow *ww = surface->ww;
 
     float    width, height;
-    float    deformedX, deformedY;
-    int      x, y, iw, ih;
+    float    coeffsU[4], coeffsV[4];
+    float    rowX[4], rowY[4];
+    int      x, y, i, j, iw, ih;
     float    cell_w, cell_h;
     GLfloat  *v, *uv;
 
@@ -569,22 +545,46 @@ void wobbly_add_geometry(struct wobbly_surface *surface)
         iw = surface->x_cells + 1;
         ih = surface->y_cells + 1;
 
-        v = realloc(surface->v, sizeof(GLfloat) * 2 * iw * ih);
-        uv = realloc(surface->uv, sizeof(GLfloat) * 2 * iw * ih);
+        /* The vertex arrays are reused as long as the grid resolution stays
+         * the same */
+        if (!surface->v || !surface->uv || surface->vertex_count != iw * ih)
+        {
+            v = realloc(surface->v, sizeof(GLfloat) * 2 * iw * ih);
+            uv = realloc(surface->uv, sizeof(GLfloat) * 2 * iw * ih);
 
-        surface->v = v;
-        surface->uv = uv;
+            surface->v = v;
+            surface->uv = uv;
+            surface->vertex_count = iw * ih;
+        }
+
+        v = surface->v;
+        uv = surface->uv;
 
         for (y = 0; y < ih; y++)
         {
+            /* Collapse the patch to a single bezier curve for this row, so
+             * that each vertex needs only 4 control points instead of 16 */
+            bezierCoefficients((y * cell_h) / height, coeffsV);
+            for (i = 0; i < 4; i++)
+            {
+                rowX[i] = rowY[i] = 0.0f;
+                for (j = 0; j < 4; j++)
+                {
+                    rowX[i] += coeffsV[j] *
+                        ww->model->objects[j * GRID_WIDTH + i].position.x;
+                    rowY[i] += coeffsV[j] *
+                        ww->model->objects[j * GRID_WIDTH + i].position.y;
+                }
+            }
+
             for (x = 0; x < iw; x++)
             {
-                bezierPatchEvaluate(ww->model,
-                        (x * cell_w) / width, (y * cell_h) / height,
-                        &deformedX, &deformedY);
+                bezierCoefficients((x * cell_w) / width, coeffsU);
 
-                *v++ = deformedX;
-                *v++ = deformedY;
+                *v++ = coeffsU[0] * rowX[0] + coeffsU[1] * rowX[1] +
+                    coeffsU[2] * rowX[2] + coeffsU[3] * rowX[3];
+                *v++ = coeffsU[0] * rowY[0] + coeffsU[1] * rowY[1] +
+                    coeffsU[2] * rowY[2] + coeffsU[3] * rowY[3];
 
                 *uv++ = (x * cell_w) / width;
                 *uv++ = 1.0 - ((y * cell_h) / height);
@@ -754,6 +754,7 @@ void wobbly_fini(struct wobbly_surface *surface)
         free(ww->model->objects);
         free(ww->model);
         free(surface->v);
+        free(surface->uv);
     }
 
     free (ww);
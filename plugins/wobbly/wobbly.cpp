@@ -4,6 +4,7 @@
 #include <wayfire/view-transform.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/render-manager.hpp>
+#include <wayfire/performance-governor.hpp>
 
 extern "C"
 {
@@ -77,27 +78,17 @@ void prepare_geometry(wobbly_surface *model, wf::geometry_t src_box,
     std::vector<float>& vert, std::vector<float>& uv)
 {
     float x = src_box.x, y = src_box.y, w = src_box.width, h = src_box.height;
-    std::vector<int> idx;
-
     int per_row = model->x_cells + 1;
 
-    for (int j = 0; j < model->y_cells; j++)
-    {
-        for (int i = 0; i < model->x_cells; i++)
-        {
-            idx.push_back(i * per_row + j);
-            idx.push_back((i + 1) * per_row + j + 1);
-            idx.push_back(i * per_row + j + 1);
-
-            idx.push_back(i * per_row + j);
-            idx.push_back((i + 1) * per_row + j);
-            idx.push_back((i + 1) * per_row + j + 1);
-        }
-    }
+    /* The vectors are reused between frames, keep their capacity */
+    vert.clear();
+    uv.clear();
+    vert.reserve(2 * 6 * model->x_cells * model->y_cells);
+    uv.reserve(2 * 6 * model->x_cells * model->y_cells);
 
-    if (!model->v || !model->uv)
+    auto add_vertex = [&] (int id)
     {
-        for (auto id : idx)
+        if (!model->v || !model->uv)
         {
             float tile_w = w / model->x_cells;
             float tile_h = h / model->y_cells;
@@ -110,16 +101,27 @@ void prepare_geometry(wobbly_surface *model, wf::geometry_t src_box,
 
             uv.push_back(1.0f * i / model->x_cells);
             uv.push_back(1.0f - 1.0f * j / model->y_cells);
+        } else
+        {
+            vert.push_back(model->v[2 * id]);
+            vert.push_back(model->v[2 * id + 1]);
+
+            uv.push_back(model->uv[2 * id]);
+            uv.push_back(model->uv[2 * id + 1]);
         }
-    } else
+    };
+
+    for (int j = 0; j < model->y_cells; j++)
     {
-        for (auto i : idx)
+        for (int i = 0; i < model->x_cells; i++)
         {
-            vert.push_back(model->v[2 * i]);
-            vert.push_back(model->v[2 * i + 1]);
+            add_vertex(i * per_row + j);
+            add_vertex((i + 1) * per_row + j + 1);
+            add_vertex(i * per_row + j + 1);
 
-            uv.push_back(model->uv[2 * i]);
-            uv.push_back(model->uv[2 * i + 1]);
+            add_vertex(i * per_row + j);
+            add_vertex((i + 1) * per_row + j);
+            add_vertex((i + 1) * per_row + j + 1);
         }
     }
 }
@@ -135,11 +137,10 @@ void render_triangles(wf::texture_t tex, glm::mat4 mat, float *pos, float *uv,
     program.attrib_pointer("uvPosition", 2, 0, uv);
     program.uniformMatrix4f("MVP", mat);
 
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    OpenGL::enable_blend();
 
     GL_CALL(glDrawArrays(GL_TRIANGLES, 0, 3 * cnt));
-    GL_CALL(glDisable(GL_BLEND));
+    OpenGL::disable_blend();
 
     program.deactivate();
 }
@@ -534,6 +535,11 @@ class wf_wobbly : public wf::view_transformer_t
     std::unique_ptr<wf::iwobbly_state_t> state;
     uint32_t last_frame;
 
+    /* The triangles from the last prepare_geometry() */
+    std::vector<float> vert, uv;
+    wf::geometry_t geometry_src_box;
+    bool geometry_dirty = true;
+
     void init_model()
     {
         model = std::make_unique<wobbly_surface>();
@@ -625,6 +631,7 @@ class wf_wobbly : public wf::view_transformer_t
         last_frame = now;
         wobbly_add_geometry(model.get());
         wobbly_done_paint(model.get());
+        geometry_dirty = true;
         view->damage();
 
         if (state->is_wobbly_done())
@@ -639,8 +646,15 @@ class wf_wobbly : public wf::view_transformer_t
         OpenGL::render_begin(target_fb);
         target_fb.logic_scissor(scissor_box);
 
-        std::vector<float> vert, uv;
-        wobbly_graphics::prepare_geometry(model.get(), src_box, vert, uv);
+        /* render_box() is called once per damaged rectangle, the triangles
+         * stay the same until the model is updated */
+        if (geometry_dirty || (src_box != geometry_src_box))
+        {
+            wobbly_graphics::prepare_geometry(model.get(), src_box, vert, uv);
+            geometry_src_box = src_box;
+            geometry_dirty   = false;
+        }
+
         wobbly_graphics::render_triangles(src_tex,
             target_fb.get_orthographic_projection(),
             vert.data(), uv.data(),
@@ -821,8 +835,12 @@ class wayfire_wobbly : public wf::plugin_interface_t
             return;
         }
 
+        /* When the performance governor asks for it, no new views start
+         * wobbling, but those which already wobble settle down as usual */
+        bool allowed = wf::performance_governor_t::get().get_level() <
+            wf::PERFORMANCE_LEVEL_LOW;
         if ((data->events & (WOBBLY_EVENT_GRAB | WOBBLY_EVENT_ACTIVATE)) &&
-            (data->view->get_transformer("wobbly") == nullptr))
+            (data->view->get_transformer("wobbly") == nullptr) && allowed)
         {
             data->view->add_transformer(
                 std::make_unique<wf_wobbly>(data->view),
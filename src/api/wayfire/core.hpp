@@ -239,6 +239,13 @@ class compositor_core_t : public wf::object_base_t
      */
     virtual std::vector<wayfire_view> get_all_views() = 0;
 
+    /**
+     * @return The view with the given id, see object_base_t::get_id(), or
+     *   nullptr if there is no such view. To find the view of a surface, use
+     *   wl_surface_to_wayfire_view().
+     */
+    virtual wayfire_view find_view(uint32_t id) = 0;
+
     /**
      * Set the keyboard focus view. The stacking order on the view's output
      * won't be changed.
@@ -270,6 +277,17 @@ class compositor_core_t : public wf::object_base_t
     virtual void move_view_to_output(wayfire_view v,
         wf::output_t *new_output, bool reconfigure) = 0;
 
+    /**
+     * Move several views to new_output, as with move_view_to_output().
+     *
+     * The views are moved in the given order, which should be from the bottom
+     * to the top of the stack, and the new geometry of all of them is shown at
+     * once. Only the last view is focused. The views-pre-moved-to-output and
+     * views-moved-to-output signals are emitted around the whole operation.
+     */
+    virtual void move_views_to_output(const std::vector<wayfire_view>& views,
+        wf::output_t *new_output, bool reconfigure) = 0;
+
     /**
      * Add a request to focus the given layer, or update an existing request.
      * Returns the UID of the request which was added/modified.
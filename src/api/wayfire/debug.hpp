@@ -7,6 +7,56 @@
 
 #define nonull(x) ((x) ? (x) : ("nil"))
 #include <wayfire/util/log.hpp>
+#include <bitset>
+
+/**
+ * Builds which should never print category debug messages can define
+ * WF_ENABLE_CATEGORY_LOGS to 0, so that LOGC() calls are compiled out.
+ */
+#ifndef WF_ENABLE_CATEGORY_LOGS
+    #define WF_ENABLE_CATEGORY_LOGS 1
+#endif
+
+namespace wf
+{
+namespace log
+{
+/**
+ * Categories of debug messages which can be enabled separately, with
+ * --debug=category1,category2,...
+ */
+enum class logging_category : size_t
+{
+    /* Output repainting and scanout */
+    RENDER = 0,
+    /* Input devices, focus and seat events */
+    INPUT  = 1,
+    /* Output configuration and power management */
+    OUTPUT = 2,
+    /* View creation, stacking and focus */
+    VIEW   = 3,
+    /* Plugin loading and activation */
+    PLUGIN = 4,
+    TOTAL,
+};
+
+/** The categories whose debug messages are printed. */
+extern std::bitset<(size_t)logging_category::TOTAL> enabled_categories;
+}
+}
+
+/**
+ * Print a debug message of the given category, for ex. LOGC(RENDER, ...).
+ * If the category is disabled, the arguments are not evaluated at all.
+ */
+#define LOGC(CATEGORY, ...) \
+    do { \
+        if (WF_ENABLE_CATEGORY_LOGS && wf::log::enabled_categories[ \
+            (size_t)wf::log::logging_category::CATEGORY]) \
+        { \
+            LOGD("[", #CATEGORY, "] ", __VA_ARGS__); \
+        } \
+    } while (0)
 
 namespace wf
 {
@@ -1,20 +1,169 @@
 #ifndef IMG_HPP_
 #define IMG_HPP_
 
-#include <GLES2/gl2.h>
+#include <GLES3/gl3.h>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
+#include <wayfire/nonstd/noncopyable.hpp>
 
 namespace image_io
 {
+/**
+ * An image decoded from a file, ready to be uploaded to a texture.
+ */
+struct image_t
+{
+    int width  = 0;
+    int height = 0;
+
+    /**
+     * For regular images: the pixels, in rows from top to bottom, with the
+     * given number of channels (3 for rgb, 4 for rgba)
+     */
+    std::vector<uint8_t> pixels;
+    int channels = 4;
+
+    /**
+     * For compressed textures (KTX2 files): the GL internal format, and the
+     * data of each face of each mipmap level, face after face, level after
+     * level.
+     */
+    GLenum compressed_format = 0;
+    int faces = 1;
+    std::vector<std::vector<uint8_t>> levels;
+};
+
+/**
+ * Decode the image in the given file. The format is detected from the first
+ * bytes of the file. Doesn't use GL, so it can be called from any thread.
+ *
+ * Recently decoded images are cached until their file is modified, so
+ * decoding the same file again returns the same image.
+ *
+ * @return The decoded image, or nullptr if it could not be decoded.
+ */
+std::shared_ptr<const image_t> decode_file(const std::string& name);
+
+/**
+ * Upload a decoded image to the bound texture of the given target, which is
+ * GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP. Cubemaps from regular images are
+ * expected in the cross layout, see load_data_as_cubemap().
+ *
+ * Mipmaps of regular images are generated on the GPU, compressed textures use
+ * the levels from their file. Either way, the texture is complete when used
+ * with a mipmapping filter. Beside the texture itself, doesn't change any GL
+ * state except pixel unpacking.
+ *
+ * @return Whether the image could be uploaded.
+ */
+bool upload_image(const image_t& image, GLuint target);
+
 /* Load the image from the given file, binding it to the given GL texture target
  * Bind the texture before you call this function
+ * Images which are not cached are decoded straight into a pixel buffer
  * Guaranteed: doesn't change any GL state except pixel packing */
 bool load_from_file(std::string name, GLuint target);
 
+/**
+ * Decodes image files on a background thread, so that large images do not
+ * block the compositor. Only uploading the decoded image needs to happen on
+ * the compositor thread.
+ */
+class async_image_loader_t : public noncopyable_t
+{
+  public:
+    /**
+     * Called on the compositor thread with the decoded image, or with nullptr
+     * if the image could not be decoded. The image is valid only during the
+     * call.
+     */
+    using callback_t = std::function<void (const image_t *image)>;
+
+    async_image_loader_t() = default;
+
+    /**
+     * Start decoding the given file. A load which is still running is
+     * cancelled, that is, its callback is not called.
+     */
+    void load(std::string name, callback_t callback);
+
+    /** Cancel the running load, if any. */
+    void cancel();
+
+    /** @return Whether a load is running. */
+    bool is_loading() const;
+
+  private:
+    struct request_t
+    {
+        callback_t callback;
+    };
+
+    /* The callback of the running load. The background thread only has a weak
+     * reference to it, so destroying the loader cancels the load. */
+    std::shared_ptr<request_t> pending;
+};
+
 /* Function that saves the given pixels(in rgba format) to a (currently) png file */
 void write_to_file(std::string name, uint8_t *pixels, int w, int h,
     std::string type);
 
+/**
+ * Like write_to_file(), but the image is encoded and written on a background
+ * thread, so that the compositor does not block.
+ *
+ * @param pixels The pixels in rgba format, moved to the background thread.
+ */
+void write_to_file_async(std::string name, std::vector<uint8_t> pixels,
+    int w, int h, std::string type);
+
+/**
+ * Reads back pixels from a framebuffer without stalling the GPU pipeline, by
+ * copying them to a pixel buffer object and waiting for a fence.
+ *
+ * All methods must be called inside a rendering block guarded by
+ * OpenGL::render_begin/end().
+ */
+class async_readback_t : public noncopyable_t
+{
+  public:
+    async_readback_t() = default;
+    ~async_readback_t();
+
+    /**
+     * Start reading back the given rectangle (in GL coordinates) from the
+     * currently bound read framebuffer. Any previous readback is discarded.
+     */
+    void start(int x, int y, int width, int height);
+
+    /** @return Whether a started readback has completed. Does not block. */
+    bool is_ready();
+
+    /**
+     * Get the read pixels in rgba format and finish the readback.
+     * Blocks until the readback has completed.
+     */
+    std::vector<uint8_t> get_pixels();
+
+    int get_width() const
+    {
+        return width;
+    }
+
+    int get_height() const
+    {
+        return height;
+    }
+
+  private:
+    GLuint pbo   = 0;
+    GLsync fence = 0;
+    int width  = 0;
+    int height = 0;
+};
+
 /* Initializes all backends, called at startup */
 void init();
 }
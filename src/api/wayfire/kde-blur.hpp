@@ -0,0 +1,17 @@
+#pragma once
+
+#include <wayfire/view.hpp>
+#include <wayfire/util.hpp>
+
+/**
+ * Get the region behind the view which its client asked to be blurred with
+ * the KDE blur protocol (org_kde_kwin_blur), in surface-local coordinates of
+ * the view's main surface.
+ *
+ * When the region changes, blur-region-changed is emitted on the view.
+ *
+ * @param region Set to the requested region. If the client did not give a
+ *   region, it is the whole main surface.
+ * @return Whether the client asked for blur behind the view.
+ */
+bool get_kde_blur_region(wayfire_view view, wf::region_t& region);
@@ -1,68 +1,109 @@
 #ifndef WF_SAFE_LIST_HPP
 #define WF_SAFE_LIST_HPP
 
-#include <list>
-#include <memory>
+#include <vector>
+#include <optional>
 #include <algorithm>
 #include <functional>
-
-#include <wayland-server.h>
+#include <stdexcept>
+#include <cstdint>
 
 #include "reverse.hpp"
 
-/* This is a trimmed-down wrapper of std::list<T>.
+/* This is a trimmed-down list, stored contiguously in a vector.
  *
  * It supports safe iteration over all elements in the collection, where any
  * element can be deleted from the list at any given time (i.e even in a
  * for-each-like loop) */
 namespace wf
 {
-/* The object type depends on the safe list type, and the safe list type
- * needs access to the event loop. However, the event loop is typically
- * available from core.hpp. Because we can't resolve this circular dependency,
- * we provide a link to the event loop specially for the safe list */
-namespace _safe_list_detail
-{
-/* In main.cpp, and initialized there */
-extern wl_event_loop *event_loop;
-void idle_cleanup_func(void *data);
-}
-
 template<class T>
 class safe_list_t
 {
-    std::list<std::unique_ptr<T>> list;
-    wl_event_source *idle_cleanup_source = NULL;
+    struct slot_t
+    {
+        /* Empty after the element has been removed during an iteration */
+        std::optional<T> value;
+        /* The value of next_generation when the element was added. Elements
+         * added during an iteration are not visited by it. */
+        uint64_t generation;
+    };
+
+    /* The position of a running iteration, moved when elements are inserted
+     * before it. Reverse iterations keep pos one past the current element. */
+    struct cursor_t
+    {
+        size_t pos;
+        size_t end;
+        bool reverse;
+    };
+
+    std::vector<slot_t> slots;
+    uint64_t next_generation = 0;
+    size_t removed = 0;
+
+    /* The running iterations, innermost last. Removed elements are only
+     * erased from the vector when the outermost iteration is done. */
+    mutable std::vector<cursor_t*> cursors;
 
-    /* Remove all invalidated elements in the list */
-    std::function<void()> do_cleanup = [&] ()
+    class iteration_t
     {
-        auto it = list.begin();
-        while (it != list.end())
+      public:
+        iteration_t(const safe_list_t *list, cursor_t *cursor) : list(list)
         {
-            if (*it)
-            {
-                ++it;
-            } else
+            list->cursors.push_back(cursor);
+        }
+
+        ~iteration_t()
+        {
+            list->cursors.pop_back();
+            if (list->cursors.empty() && list->removed)
             {
-                it = list.erase(it);
+                const_cast<safe_list_t*>(list)->compact();
             }
         }
 
-        idle_cleanup_source = NULL;
+      private:
+        const safe_list_t *list;
     };
 
-    /* Return whether the list has invalidated elements */
-    bool is_dirty() const
+    /* Erase all removed elements from the vector */
+    void compact()
+    {
+        slots.erase(std::remove_if(slots.begin(), slots.end(),
+            [] (const slot_t& slot) { return !slot.value; }), slots.end());
+        removed = 0;
+    }
+
+    void insert(size_t pos, T&& value)
+    {
+        for (auto& cursor : cursors)
+        {
+            cursor->pos += cursor->reverse ? (pos < cursor->pos) :
+                (pos <= cursor->pos);
+            cursor->end += (pos < cursor->end);
+        }
+
+        slots.insert(slots.begin() + pos,
+            slot_t{std::move(value), next_generation++});
+    }
+
+    template<class Func>
+    void visit(const slot_t& slot, uint64_t generation, Func& func) const
     {
-        return idle_cleanup_source;
+        if (slot.value && (slot.generation < generation))
+        {
+            /* func may add elements, which can move the vector's storage */
+            T copy = *slot.value;
+            func(copy);
+        }
     }
 
   public:
     safe_list_t()
     {}
 
-    /* Copy the not-erased elements from other, but do not copy the idle source */
+    /* Copy the not-erased elements from other */
     safe_list_t(const safe_list_t& other)
     {
         *this = other;
@@ -70,73 +111,49 @@ class safe_list_t
 
     safe_list_t& operator =(const safe_list_t& other)
     {
-        this->idle_cleanup_source = NULL;
-        other.for_each([&] (auto& el)
+        if (this != &other)
         {
-            this->push_back(el);
-        });
+            slots.clear();
+            removed = 0;
+            other.for_each([&] (auto& el)
+            {
+                this->push_back(el);
+            });
+        }
+
+        return *this;
     }
 
     safe_list_t(safe_list_t&& other) = default;
     safe_list_t& operator =(safe_list_t&& other) = default;
 
-    ~safe_list_t()
-    {
-        if (idle_cleanup_source)
-        {
-            wl_event_source_remove(idle_cleanup_source);
-        }
-    }
-
     T& back()
     {
-        /* No invalidated elements */
-        if (!is_dirty())
-        {
-            return *list.back();
-        }
-
-        auto it = list.rbegin();
-        while (it != list.rend() && (*it) == nullptr)
-        {
-            ++it;
-        }
-
-        if (it == list.rend())
+        auto it = std::find_if(slots.rbegin(), slots.rend(),
+            [] (const slot_t& slot) { return bool(slot.value); });
+        if (it == slots.rend())
         {
             throw std::out_of_range("back() called on an empty list!");
         }
 
-        return **it;
+        return *it->value;
     }
 
     size_t size() const
     {
-        if (!is_dirty())
-        {
-            return list.size();
-        }
-
-        /* Count non-null elements, because that's the real size */
-        size_t sz = 0;
-        for (auto& it : list)
-        {
-            sz += (it != nullptr);
-        }
-
-        return sz;
+        return slots.size() - removed;
     }
 
     /* Push back by copying */
     void push_back(T value)
     {
-        list.push_back(std::make_unique<T>(std::move(value)));
+        insert(slots.size(), std::move(value));
     }
 
     /* Push back by moving */
     void emplace_back(T&& value)
     {
-        list.push_back(std::make_unique<T>(value));
+        insert(slots.size(), std::move(value));
     }
 
     enum insert_place_t
@@ -149,72 +166,70 @@ class safe_list_t
     /* Insert the given value at a position in the list, determined by the
      * check function. The value is inserted at the first position that
      * check indicates, or at the end of the list otherwise */
-    void emplace_at(T&& value, std::function<insert_place_t(T&)> check)
+    template<class Check>
+    void emplace_at(T&& value, Check check)
     {
-        auto it = list.begin();
-        while (it != list.end())
+        for (size_t i = 0; i < slots.size(); i++)
         {
             /* Skip empty elements */
-            if (*it == nullptr)
+            if (!slots[i].value)
             {
-                ++it;
                 continue;
             }
 
-            auto place = check(**it);
+            auto place = check(*slots[i].value);
             switch (place)
             {
               case INSERT_AFTER:
-                /* We can safely increment it, because it points to an
-                 * element in the list */
-                ++it;
+                insert(i + 1, std::move(value));
+
+                return;
 
-              // fall through
               case INSERT_BEFORE:
-                list.emplace(it, std::make_unique<T>(value));
+                insert(i, std::move(value));
 
                 return;
 
               default:
                 break;
             }
-
-            ++it;
         }
 
         /* If no place found, insert at the end */
         emplace_back(std::move(value));
     }
 
-    void insert_at(T value, std::function<insert_place_t(T&)> check)
+    template<class Check>
+    void insert_at(T value, Check check)
     {
         emplace_at(std::move(value), check);
     }
 
-    /* Call func for each non-erased element of the list */
-    void for_each(std::function<void(T&)> func) const
+    /* Call func for each non-erased element of the list. func is a template
+     * parameter, so that the lists in hot paths don't go through
+     * std::function. */
+    template<class Func>
+    void for_each(Func func) const
     {
-        /* Go through all elements currently in the list */
-        auto it = list.begin();
-        for (int size = list.size(); size > 0; size--, it++)
+        cursor_t cursor{0, slots.size(), false};
+        iteration_t iteration{this, &cursor};
+        uint64_t generation = next_generation;
+        for (; cursor.pos < cursor.end; cursor.pos++)
         {
-            if (*it)
-            {
-                func(**it);
-            }
+            visit(slots[cursor.pos], generation, func);
         }
     }
 
     /* Call func for each non-erased element of the list in reversed order */
-    void for_each_reverse(std::function<void(T&)> func) const
+    template<class Func>
+    void for_each_reverse(Func func) const
     {
-        auto it = list.rbegin();
-        for (int size = list.size(); size > 0; size--, it++)
+        cursor_t cursor{slots.size(), slots.size(), true};
+        iteration_t iteration{this, &cursor};
+        uint64_t generation = next_generation;
+        for (; cursor.pos > 0; cursor.pos--)
         {
-            if (*it)
-            {
-                func(**it);
-            }
+            visit(slots[cursor.pos - 1], generation, func);
         }
     }
 
@@ -231,29 +246,27 @@ class safe_list_t
     }
 
     /* Remove all elements satisfying a given condition.
-     * This function resets their pointers and scheduling a cleanup operation */
-    void remove_if(std::function<bool(const T&)> predicate)
+     * The elements are reset right away, and erased from the vector at the
+     * end of the outermost iteration, or of this function. */
+    template<class Predicate>
+    void remove_if(Predicate predicate)
     {
-        bool actually_removed = false;
-        for (auto& it : list)
+        /* Freeing the elements may modify the list again */
+        cursor_t cursor{0, slots.size(), false};
+        iteration_t iteration{this, &cursor};
+        for (; cursor.pos < cursor.end; cursor.pos++)
         {
-            if (it && predicate(*it))
+            auto& slot = slots[cursor.pos];
+            if (slot.value && predicate(*slot.value))
             {
-                actually_removed = true;
-                /* First reset the element in the list, and then free resources */
-                auto copy = std::move(it);
-                it = nullptr;
+                /* First reset the element in the list, and then free
+                 * resources */
+                std::optional<T> copy;
+                copy.swap(slot.value);
+                ++removed;
                 /* Now copy goes out of scope */
             }
         }
-
-        /* Schedule a clean-up, but be careful to not schedule it twice */
-        if (!idle_cleanup_source && actually_removed)
-        {
-            idle_cleanup_source = wl_event_loop_add_idle(
-                _safe_list_detail::event_loop,
-                _safe_list_detail::idle_cleanup_func, &do_cleanup);
-        }
     }
 };
 }
@@ -43,6 +43,7 @@ extern "C"
     #include <wlr/types/wlr_xdg_decoration_v1.h>
 #endif
 #include <wlr/types/wlr_surface.h>
+#include <wlr/types/wlr_region.h>
 
 #include <wlr/types/wlr_foreign_toplevel_management_v1.h>
 #include <wlr/types/wlr_server_decoration.h>
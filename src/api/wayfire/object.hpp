@@ -4,10 +4,20 @@
 #include <typeinfo>
 #include <memory>
 #include <string>
+#include <functional>
+#include <cstdint>
 
 #include <wayfire/nonstd/observer_ptr.h>
 #include <wayfire/nonstd/noncopyable.hpp>
 
+// WF_USE_CONFIG_H is set only when building Wayfire itself, external plugins
+// need to use <wayfire/config.h>
+#ifdef WF_USE_CONFIG_H
+    #include <config.h>
+#else
+    #include <wayfire/config.h>
+#endif
+
 namespace wf
 {
 /**
@@ -22,6 +32,49 @@ struct signal_data_t
 using signal_callback_t = std::function<void (signal_data_t*)>;
 class signal_provider_t;
 
+/**
+ * An interned signal name.
+ *
+ * Creating a signal ID looks up the signal name in a global registry once.
+ * Afterwards, the ID can be used to connect to and emit signals without hashing
+ * the name again. Signal IDs are therefore best created once and stored, for
+ * example as static variables near the code which emits frequent signals.
+ *
+ * Signal IDs and signal names are interchangeable: connecting with a name and
+ * emitting with the ID of the same name (or vice versa) works as expected.
+ */
+class signal_id_t
+{
+  public:
+    /** Find or register the ID for the given signal name. */
+    explicit signal_id_t(const std::string& name);
+    /** Find or register the ID for the given signal name. */
+    explicit signal_id_t(const char *name) : signal_id_t(std::string(name))
+    {}
+
+    /** @return The numeric value of the ID, unique for each signal name. */
+    uint32_t get_id() const
+    {
+        return id;
+    }
+
+    /** @return The name of the signal. */
+    const std::string& get_name() const;
+
+    bool operator ==(const signal_id_t& other) const
+    {
+        return id == other.id;
+    }
+
+    bool operator !=(const signal_id_t& other) const
+    {
+        return id != other.id;
+    }
+
+  private:
+    uint32_t id;
+};
+
 /**
  * Provides an interface to connect to signal providers.
  *
@@ -68,22 +121,43 @@ class signal_provider_t
   public:
     /** Register a connection to be called when the given signal is emitted. */
     void connect_signal(std::string name, signal_connection_t *callback);
-    /** Unregister a connection. */
+    /** Register a connection to be called when the given signal is emitted. */
+    void connect_signal(const signal_id_t& id, signal_connection_t *callback);
+    /**
+     * Unregister a connection. Only the signals the connection is actually
+     * connected to are visited.
+     */
     void disconnect_signal(signal_connection_t *callback);
 
+#ifdef WF_DEPRECATED_SIGNALS
     /**
-     * Deprecated.
+     * Deprecated, only available if Wayfire is built with the
+     * deprecated_signals option.
      * Register a callback to be called whenever the given signal is emitted
      */
     void connect_signal(std::string name, signal_callback_t *callback);
     /**
-     * Deprecated.
+     * Deprecated, only available if Wayfire is built with the
+     * deprecated_signals option.
      * Unregister a registered callback.
      */
     void disconnect_signal(std::string name, signal_callback_t *callback);
+#endif
+
+    /**
+     * @return Whether anything is connected to the given signal. Checking this
+     *   does not hash the ID, so it can be used to avoid building the signal
+     *   data of frequent signals.
+     */
+    bool has_listeners(const signal_id_t& id) const;
 
     /** Emit the given signal. No type checking for data is required */
     void emit_signal(std::string name, signal_data_t *data);
+    /**
+     * Emit the given signal. No type checking for data is required.
+     * Emitting a signal which has no listeners does not hash the ID.
+     */
+    void emit_signal(const signal_id_t& id, signal_data_t *data);
 
     virtual ~signal_provider_t();
 
@@ -101,8 +175,12 @@ class signal_provider_t
 class custom_data_t
 {
   public:
-    virtual ~custom_data_t()
-    {}
+    virtual ~custom_data_t();
+
+  private:
+    friend class object_base_t;
+    /* The type the data is counted as, once it has been stored on an object */
+    const char *counted_type = nullptr;
 };
 
 /**
@@ -118,6 +196,28 @@ class object_base_t : public signal_provider_t
     /** Get the ID of the object. Each object has a unique ID */
     uint32_t get_id() const;
 
+    /**
+     * Retrieve custom data stored for the type T. If no such data exists,
+     * then it is created with the default constructor.
+     *
+     * REQUIRES a default constructor
+     * If your type doesn't have one, use store_data + get_data
+     */
+    template<class T>
+    nonstd::observer_ptr<T> get_data_safe()
+    {
+        auto data = get_data<T>();
+        if (data)
+        {
+            return data;
+        } else
+        {
+            store_data<T>(std::make_unique<T>());
+
+            return get_data<T>();
+        }
+    }
+
     /**
      * Retrieve custom data stored with the given name. If no such data exists,
      * then it is created with the default constructor.
@@ -126,8 +226,7 @@ class object_base_t : public signal_provider_t
      * If your type doesn't have one, use store_data + get_data
      */
     template<class T>
-    nonstd::observer_ptr<T> get_data_safe(
-        std::string name = typeid(T).name())
+    nonstd::observer_ptr<T> get_data_safe(std::string name)
     {
         auto data = get_data<T>(name);
         if (data)
@@ -141,28 +240,43 @@ class object_base_t : public signal_provider_t
         }
     }
 
+    /* Retrieve custom data stored for the type T. If no such
+     * data exists, NULL is returned */
+    template<class T>
+    nonstd::observer_ptr<T> get_data()
+    {
+        /* Only data of type T can be stored in the slot of T */
+        return nonstd::make_observer(
+            static_cast<T*>(_fetch_slot(_data_slot<T>())));
+    }
+
     /* Retrieve custom data stored with the given name. If no such
      * data exists, NULL is returned */
     template<class T>
-    nonstd::observer_ptr<T> get_data(
-        std::string name = typeid(T).name())
+    nonstd::observer_ptr<T> get_data(std::string name)
     {
         return nonstd::make_observer(dynamic_cast<T*>(_fetch_data(name)));
     }
 
+    /* Assigns the given data to the type T */
+    template<class T>
+    void store_data(std::unique_ptr<T> stored_data)
+    {
+        _store_slot(std::move(stored_data), _data_slot<T>());
+    }
+
     /* Assigns the given data to the given name */
     template<class T>
-    void store_data(std::unique_ptr<T> stored_data,
-        std::string name = typeid(T).name())
+    void store_data(std::unique_ptr<T> stored_data, std::string name)
     {
         _store_data(std::move(stored_data), name);
     }
 
-    /* Returns true if there is saved data under the given name */
+    /* Returns true if there is saved data for the type T */
     template<class T>
     bool has_data()
     {
-        return has_data(typeid(T).name());
+        return _fetch_slot(_data_slot<T>()) != nullptr;
     }
 
     /** @return true if there is saved data with the given name */
@@ -175,13 +289,21 @@ class object_base_t : public signal_provider_t
     template<class T>
     void erase_data()
     {
-        erase_data(typeid(T).name());
+        std::unique_ptr<custom_data_t> data{_release_slot(_data_slot<T>())};
+    }
+
+    /* Erase the saved data for the type T from the store and return the
+     * pointer */
+    template<class T>
+    std::unique_ptr<T> release_data()
+    {
+        return std::unique_ptr<T>(
+            static_cast<T*>(_release_slot(_data_slot<T>())));
     }
 
     /* Erase the saved data from the store and return the pointer */
     template<class T>
-    std::unique_ptr<T> release_data(
-        std::string name = typeid(T).name())
+    std::unique_ptr<T> release_data(std::string name)
     {
         if (!has_data(name))
         {
@@ -202,6 +324,33 @@ class object_base_t : public signal_provider_t
     void _clear_data();
 
   private:
+    /**
+     * Get the slot index of the type T. The index is registered the first
+     * time data of the type is accessed, afterwards the typed accessors are
+     * plain array lookups.
+     */
+    template<class T>
+    static uint32_t _data_slot()
+    {
+        static const uint32_t slot = _register_data_slot(typeid(T).name());
+
+        return slot;
+    }
+
+    /**
+     * Find or register the slot index for the given name. Names used with
+     * the string overloads are the same slots as the types whose
+     * typeid(T).name() they match.
+     */
+    static uint32_t _register_data_slot(const std::string& name);
+
+    /** Get the data in the given slot, or nullptr, if it is empty */
+    custom_data_t *_fetch_slot(uint32_t slot);
+    /** Store the given data in the given slot */
+    void _store_slot(std::unique_ptr<custom_data_t> data, uint32_t slot);
+    /** Empty the given slot and return the pointer it held */
+    custom_data_t *_release_slot(uint32_t slot);
+
     /** Just get the data under the given name, or nullptr, if it does not exist */
     custom_data_t *_fetch_data(std::string name);
     /** Get the data under the given name, and release the pointer, deleting
@@ -9,6 +9,9 @@
 #include <wayfire/nonstd/wlroots.hpp>
 
 #include <wayfire/geometry.hpp>
+#include <functional>
+#include <string>
+#include <vector>
 
 #define GLM_FORCE_RADIANS
 #include <glm/mat4x4.hpp>
@@ -118,6 +121,100 @@ struct framebuffer_t : public framebuffer_base_t
      */
     void logic_scissor(wlr_box box) const;
 };
+
+/**
+ * Accounting of the GPU memory used by framebuffers and textures.
+ *
+ * framebuffer_base_t reports its own allocations. Code which creates other
+ * textures should report them with track() and untrack(). Each allocation can
+ * be labelled with its owner, for ex. the plugin which uses it.
+ *
+ * If the total exceeds core/gpu_memory_soft_limit, the pressure callbacks
+ * are run, so that caches can free what they can regenerate.
+ */
+namespace gpu_memory
+{
+struct allocation_t
+{
+    /** Who the allocation belongs to, or "unknown" */
+    std::string owner;
+    /** Approximate size in bytes */
+    size_t bytes;
+    /** When the allocation was made or last resized, see get_current_time() */
+    uint32_t since;
+};
+
+/**
+ * Record that the object uses the given amount of GPU memory. Tracking an
+ * object again updates its size.
+ */
+void track(const void *object, size_t bytes);
+/** Forget the allocation of the object. No-op if it isn't tracked. */
+void untrack(const void *object);
+/** Set the owner of a tracked allocation. No-op if it isn't tracked. */
+void set_owner(const void *object, const std::string& owner);
+
+/** @return The total tracked GPU memory in bytes. */
+size_t get_total();
+/** @return All tracked allocations. */
+std::vector<allocation_t> get_allocations();
+
+/**
+ * Add a callback which frees memory when the soft limit is exceeded. The
+ * callbacks are run from an idle callback, outside of render_begin/end.
+ */
+void add_pressure_callback(std::function<void()> *callback);
+void rem_pressure_callback(std::function<void()> *callback);
+
+/**
+ * A GPU resource which its owner can re-create, for ex. the programs and
+ * textures of a plugin which is used only now and then.
+ *
+ * Core releases the resource when it has not been used for
+ * core/gpu_idle_release_timeout minutes, and, least recently used first, when
+ * the soft limit is still exceeded after the pressure callbacks. Resources
+ * used in the last few seconds are never released under pressure.
+ *
+ * The callbacks are run outside of render_begin/end.
+ */
+class releasable_t : public noncopyable_t
+{
+  public:
+    /**
+     * Register a resource, which has already been allocated.
+     *
+     * @param cost The approximate size of the resource in bytes.
+     * @param release Frees the resource.
+     * @param recreate Allocates the resource again, called from use().
+     */
+    releasable_t(size_t cost, std::function<void()> release,
+        std::function<void()> recreate);
+    /** Unregister the resource. The owner has to free it itself. */
+    ~releasable_t();
+
+    /**
+     * Re-create the resource if it has been released, and mark it as used
+     * now. Must be called outside of render_begin/end.
+     */
+    void use();
+    /** Release the resource now. No-op if it has already been released. */
+    void release();
+    /** @return Whether the resource has been released */
+    bool is_released() const;
+
+    /** Update the approximate size of the resource */
+    void set_cost(size_t cost);
+    size_t get_cost() const;
+    /** @return The time of the last use, see get_current_time() */
+    uint32_t get_last_use() const;
+
+  private:
+    size_t cost;
+    std::function<void()> release_callback, recreate_callback;
+    bool released = false;
+    uint32_t last_use;
+};
+}
 }
 
 namespace wf
@@ -188,6 +285,54 @@ void render_end();
 /* Clear the currently bound framebuffer with the given color */
 void clear(wf::color_t color, uint32_t mask = GL_COLOR_BUFFER_BIT);
 
+/**
+ * Wrappers for often changed GL state. The state set through them is tracked,
+ * and calls which would not change it are skipped. The tracked state is reset
+ * by render_begin() and render_end().
+ *
+ * Code which changes the same state directly, or via wlr_renderer functions,
+ * inside a rendering block must call invalidate_state() afterwards.
+ */
+void bind_framebuffer(GLenum target, GLuint fb);
+void set_viewport(int x, int y, int width, int height);
+void use_program(GLuint program);
+void enable_blend(GLenum sfactor = GL_ONE,
+    GLenum dfactor = GL_ONE_MINUS_SRC_ALPHA);
+void disable_blend();
+void enable_vertex_attrib(GLuint location);
+void disable_vertex_attrib(GLuint location);
+
+/**
+ * Attach a depth buffer of the given size to the framebuffer, unless it has
+ * one of that size already. Depth buffers are pooled by size, so all
+ * framebuffers of the same size share one, and its contents are undefined
+ * at the start of each pass which uses it. The buffer is released together
+ * with the framebuffer, see framebuffer_base_t::release().
+ */
+void attach_depth_buffer(GLuint fb, int width, int height);
+
+/**
+ * Tell the driver that the contents of the framebuffer are not needed anymore,
+ * so that tile-based GPUs do not write them back to memory, or load them at
+ * the start of the next pass. The depth buffer is discarded if one was
+ * attached with attach_depth_buffer(), the color buffer only if color is set.
+ *
+ * Uses glInvalidateFramebuffer on GLES 3, or GL_EXT_discard_framebuffer, and
+ * is a no-op if neither is available. Must be called in a rendering block.
+ */
+void discard_framebuffer(GLuint fb, bool color);
+
+/** Forget the tracked state, so that the next changes are issued. */
+void invalidate_state();
+
+/** How many state changes were issued and skipped since startup */
+struct state_stats_t
+{
+    uint64_t issued = 0;
+    uint64_t elided = 0;
+};
+
+state_stats_t get_state_stats();
 
 enum texture_rendering_flags_t
 {
@@ -197,6 +342,12 @@ enum texture_rendering_flags_t
     TEXTURE_TRANSFORM_INVERT_Y = (1 << 1),
     /* Use a subrectangle of the texture to render */
     TEXTURE_USE_TEX_GEOMETRY   = (1 << 2),
+    /*
+     * The rendered part of the texture is fully opaque, so it can be drawn
+     * without blending if the color multiplier is opaque too. Implied for
+     * RGBX textures.
+     */
+    TEXTURE_OPAQUE = (1 << 3),
 };
 
 /**
@@ -254,6 +405,76 @@ void render_texture(wf::texture_t texture,
     glm::vec4 color = glm::vec4(1.f),
     uint32_t bits   = 0);
 
+/**
+ * Render a textured quad on the given framebuffer, clipped to the given damage.
+ *
+ * Instead of drawing the whole quad once for each damaged rectangle with a
+ * scissor box, a sub-quad is generated for each rectangle and all of them are
+ * drawn with a single draw call.
+ *
+ * @param texture   The texture to render.
+ * @param fb        The framebuffer to render onto.
+ *                  It should have been already bound.
+ * @param geometry  The geometry of the quad to render, in the same coordinate
+ *                    system as the framebuffer geometry.
+ * @param damage    The region to render, in the same coordinate system as the
+ *                    framebuffer geometry.
+ * @param color     A color multiplier for each channel of the texture.
+ * @param bits      A bitwise OR of texture_rendering_flags_t. In this variant,
+ *                    TEX_GEOMETRY flag is ignored.
+ */
+void render_texture_damage(wf::texture_t texture,
+    const wf::framebuffer_t& framebuffer,
+    const wf::geometry_t& geometry,
+    const wf::region_t& damage,
+    glm::vec4 color = glm::vec4(1.f),
+    uint32_t bits   = 0);
+
+/** A quad showing a part of a texture, see render_texture_batch() */
+struct texture_batch_entry_t
+{
+    /* The geometry of the quad, in the same coordinate system as the
+     * framebuffer geometry */
+    wf::geometry_t geometry;
+    /* The part of the texture shown in the quad, in texture coordinates */
+    gl_geometry texture_box;
+    /* The region of the quad to render */
+    const wf::region_t *damage;
+};
+
+/**
+ * Render several quads showing parts of the same texture, each clipped to its
+ * damage, with a single draw call. The quads are drawn in the given order.
+ *
+ * The texture's viewport and Y inversion are ignored, the texture boxes are
+ * used as they are. Like render_texture_damage(), the framebuffer should be
+ * bound, and it must not have a fractional scale or a nonstandard transform.
+ */
+void render_texture_batch(const wf::texture_t& texture,
+    const wf::framebuffer_t& framebuffer,
+    const std::vector<texture_batch_entry_t>& entries,
+    glm::vec4 color = glm::vec4(1.f));
+
+/** A textured quad, see render_transformed_texture_batch() */
+struct transformed_texture_entry_t
+{
+    wf::texture_t texture;
+    /* The initial coordinates of the quad */
+    wf::geometry_t geometry;
+    /* The matrix transformation to apply to the quad */
+    glm::mat4 transform;
+};
+
+/**
+ * Render several quads, each with its own texture and transformation, like
+ * render_transformed_texture() without flags. The vertices of all quads are
+ * uploaded at once and the program is set up once, so that drawing each quad
+ * only binds its texture. The quads are drawn in the given order.
+ */
+void render_transformed_texture_batch(
+    const std::vector<transformed_texture_entry_t>& entries,
+    glm::vec4 color = glm::vec4(1.f));
+
 /* Compiles the given shader source */
 GLuint compile_shader(std::string source, GLuint type);
 
@@ -274,6 +495,17 @@ GLuint compile_program(std::string vertex_source, std::string frag_source);
  */
 void render_rectangle(wf::geometry_t box, wf::color_t color, glm::mat4 matrix);
 
+/**
+ * A handle to a uniform of a program_t, obtained with program_t::get_uniform().
+ *
+ * Setting uniforms via handles avoids looking up the uniform by its name on
+ * every draw. A handle stays valid when the program is recompiled.
+ */
+struct uniform_handle_t
+{
+    int index = -1;
+};
+
 /**
  * An OpenGL program for rendering texture_t.
  * It contains multiple programs for the different texture types.
@@ -338,6 +570,25 @@ class program_t : public noncopyable_t
     /** Set the given uniform for the currently used program. */
     void uniformMatrix4f(const std::string& name, const glm::mat4& value);
 
+    /**
+     * Get a handle to the uniform with the given name. The uniform location is
+     * resolved lazily, once for each texture type of the program.
+     */
+    uniform_handle_t get_uniform(const std::string& name);
+
+    /** Set the given uniform for the currently used program. */
+    void uniform1i(uniform_handle_t uniform, int value);
+    /** Set the given uniform for the currently used program. */
+    void uniform1f(uniform_handle_t uniform, float value);
+    /** Set the given uniform for the currently used program. */
+    void uniform2f(uniform_handle_t uniform, float x, float y);
+    /** Set the given uniform for the currently used program. */
+    void uniform3f(uniform_handle_t uniform, float x, float y, float z);
+    /** Set the given uniform for the currently used program. */
+    void uniform4f(uniform_handle_t uniform, const glm::vec4& value);
+    /** Set the given uniform for the currently used program. */
+    void uniformMatrix4f(uniform_handle_t uniform, const glm::mat4& value);
+
     /*
      * Set the attribute pointer and active the attribute.
      *
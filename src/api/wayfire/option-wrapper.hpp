@@ -4,11 +4,22 @@
 #include <wayfire/config/option.hpp>
 #include <wayfire/config/option-wrapper.hpp>
 #include <wayfire/core.hpp>
+#include <wayfire/util.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+#include <vector>
 
 namespace wf
 {
+class option_snapshot_t;
+
 /**
  * A simple wrapper around a config option.
+ *
+ * The wrapper keeps a copy of the option's value, which is updated whenever
+ * the option changes, so reading the wrapper does not go through the option.
  */
 template<class Type>
 class option_wrapper_t : public base_option_wrapper_t<Type>
@@ -26,10 +37,183 @@ class option_wrapper_t : public base_option_wrapper_t<Type>
     option_wrapper_t() : wf::base_option_wrapper_t<Type>()
     {}
 
+    ~option_wrapper_t();
+
+    /**
+     * @return The cached value of the option. The option must have been
+     *   loaded.
+     */
+    operator Type() const
+    {
+        return *value;
+    }
+
   protected:
     std::shared_ptr<config::option_base_t> load_raw_option(const std::string& name)
     {
-        return wf::get_core().config.get_option(name);
+        auto raw = wf::get_core().config.get_option(name);
+        typed_option = std::dynamic_pointer_cast<config::option_t<Type>>(raw);
+        if (typed_option)
+        {
+            /* Added before the handler of the base wrapper, so the callback
+             * of the wrapper already sees the new value */
+            value = typed_option->get_value();
+            typed_option->add_updated_handler(&update_cache);
+        }
+
+        return raw;
+    }
+
+  private:
+    friend class option_snapshot_t;
+
+    std::shared_ptr<config::option_t<Type>> typed_option;
+    std::optional<Type> value;
+
+    /* The snapshot this wrapper is part of, if any */
+    option_snapshot_t *snapshot = nullptr;
+
+    config::option_base_t::updated_callback_t update_cache = [=] ()
+    {
+        if (snapshot)
+        {
+            mark_snapshot_dirty();
+        } else
+        {
+            refresh();
+        }
+    };
+
+    void refresh()
+    {
+        value = typed_option->get_value();
     }
+
+    void mark_snapshot_dirty();
 };
+
+/**
+ * A group of option wrappers whose cached values are updated together.
+ *
+ * When the configuration is reloaded, the values of all options in the
+ * snapshot are updated at once, and a single callback is invoked afterwards,
+ * instead of one callback per changed option. Changes which do not come with
+ * a reload, for example from IPC, are applied on the next idle.
+ *
+ * Until then, reading any of the wrappers returns the old value. The
+ * callbacks of the individual wrappers are still called when their option
+ * changes, but they will also see the old value.
+ */
+class option_snapshot_t : public noncopyable_t
+{
+  public:
+    option_snapshot_t()
+    {
+        idle_update.set_callback([=] () { update(); });
+        wf::get_core().connect_signal("reload-config", &on_reload_config);
+    }
+
+    ~option_snapshot_t()
+    {
+        for (auto& member : members)
+        {
+            member.detach();
+        }
+    }
+
+    /**
+     * Add a wrapper to the snapshot. The wrapper must have been loaded, must
+     * not be part of another snapshot and must not be destroyed before it is
+     * removed or the snapshot is destroyed.
+     */
+    template<class Type>
+    void add(option_wrapper_t<Type>& wrapper)
+    {
+        wrapper.snapshot = this;
+        members.push_back({&wrapper,
+            [&wrapper] () { wrapper.refresh(); },
+            [&wrapper] () { wrapper.snapshot = nullptr; }});
+    }
+
+    /** Remove a wrapper from the snapshot. No-op if it isn't part of it. */
+    template<class Type>
+    void remove(option_wrapper_t<Type>& wrapper)
+    {
+        auto it = std::remove_if(members.begin(), members.end(),
+            [&] (const member_t& member) { return member.wrapper == &wrapper; });
+        std::for_each(it, members.end(), [] (auto& member) { member.detach(); });
+        members.erase(it, members.end());
+    }
+
+    /** Set the callback to call after the values have been updated. */
+    void set_callback(std::function<void()> callback)
+    {
+        this->callback = callback;
+    }
+
+  private:
+    template<class Type> friend class option_wrapper_t;
+
+    struct member_t
+    {
+        void *wrapper;
+        std::function<void()> refresh;
+        std::function<void()> detach;
+    };
+
+    std::vector<member_t> members;
+    std::function<void()> callback;
+    bool dirty = false;
+
+    wf::wl_idle_call idle_update;
+
+    wf::signal_connection_t on_reload_config = [=] (wf::signal_data_t*)
+    {
+        if (dirty)
+        {
+            idle_update.disconnect();
+            update();
+        }
+    };
+
+    void schedule_update()
+    {
+        dirty = true;
+        idle_update.run_once();
+    }
+
+    void update()
+    {
+        dirty = false;
+        for (auto& member : members)
+        {
+            member.refresh();
+        }
+
+        if (callback)
+        {
+            callback();
+        }
+    }
+};
+
+template<class Type>
+option_wrapper_t<Type>::~option_wrapper_t()
+{
+    if (snapshot)
+    {
+        snapshot->remove(*this);
+    }
+
+    if (typed_option)
+    {
+        typed_option->rem_updated_handler(&update_cache);
+    }
+}
+
+template<class Type>
+void option_wrapper_t<Type>::mark_snapshot_dirty()
+{
+    snapshot->schedule_update();
+}
 }
@@ -173,6 +173,14 @@ class output_t : public wf::object_base_t
      */
     virtual wayfire_view get_active_view() const = 0;
 
+    /**
+     * @return The views on this output which have been focused at least once,
+     * most recently focused first. The list is updated on each focus change,
+     * so it is an alternative to sorting by last_focus_timestamp. Views in
+     * every layer and on every workspace are included.
+     */
+    virtual std::vector<wayfire_view> get_focus_history() const = 0;
+
     /**
      * Attempt to give keyboard focus to the given view and set it as the
      * output's active view.
@@ -0,0 +1,77 @@
+#ifndef WF_PERFORMANCE_GOVERNOR_HPP
+#define WF_PERFORMANCE_GOVERNOR_HPP
+
+#include <wayfire/object.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <memory>
+
+namespace wf
+{
+/**
+ * The degradation levels of the performance governor. Each level includes the
+ * degradations of the levels below it.
+ */
+enum performance_level_t
+{
+    /** Effects are rendered as configured */
+    PERFORMANCE_LEVEL_FULL    = 0,
+    /** Cheaper blur, shorter animations */
+    PERFORMANCE_LEVEL_REDUCED = 1,
+    /**
+     * No new wobbly effects and no animations, workspace streams (expo, cube)
+     * at half their level of detail
+     */
+    PERFORMANCE_LEVEL_LOW     = 2,
+    /** The repaint rate of all outputs is capped, see core/governor_max_fps */
+    PERFORMANCE_LEVEL_MINIMAL = 3,
+};
+
+/**
+ * name: performance-level-changed
+ * on: core
+ * when: When the performance governor changes the degradation level. Plugins
+ *   with expensive effects should check the level when they start them, and
+ *   update the running ones.
+ */
+struct performance_level_changed_signal : public wf::signal_data_t
+{
+    performance_level_t level;
+    performance_level_t old_level;
+};
+
+/**
+ * The performance governor watches how long the outputs take to repaint
+ * their frames, and whether the system runs on battery, and lowers the
+ * quality of the effects of plugins when the frame budget is missed.
+ *
+ * When core/performance_governor is enabled, the frames of all outputs are
+ * checked twice a second. A frame misses its budget if its CPU or GPU render
+ * time is longer than the refresh interval of the output. When too many frames
+ * miss their budget for a second, the level is raised by one, up to
+ * core/governor_max_level. It is lowered by one again only after five seconds
+ * with almost no missed frames, so that the effects don't flicker between
+ * levels. On battery, the level is at least
+ * core/governor_battery_level.
+ */
+class performance_governor_t : public noncopyable_t
+{
+  public:
+    static performance_governor_t& get();
+
+    /** @return The current degradation level. */
+    performance_level_t get_level() const;
+
+    /** Start watching the outputs. Called once by core at startup. */
+    void init();
+
+  private:
+    performance_governor_t();
+    ~performance_governor_t();
+
+    class impl;
+    std::unique_ptr<impl> priv;
+};
+}
+
+#endif /* end of include guard: WF_PERFORMANCE_GOVERNOR_HPP */
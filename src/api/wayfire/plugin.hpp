@@ -86,6 +86,11 @@ struct plugin_grab_interface_t
         {
             std::function<void(uint32_t, uint32_t)> key; // button, state
             std::function<void(uint32_t, uint32_t)> mod; // modifier, state
+            /**
+             * If set, keys held during the grab are repeated by core with the
+             * configured repeat rate and delay. Called with the held key.
+             */
+            std::function<void(uint32_t)> repeat;
         } keyboard;
 
         struct
@@ -3,6 +3,12 @@
 
 #include "wayfire/output.hpp"
 #include "wayfire/object.hpp"
+#include <vector>
+
+namespace OpenGL
+{
+class program_t;
+}
 
 namespace wf
 {
@@ -56,6 +62,213 @@ enum output_effect_type_t
 using post_hook_t = std::function<void (const wf::framebuffer_base_t& source,
     const wf::framebuffer_base_t& destination)>;
 
+/**
+ * A postprocessing effect which can be merged with other such effects into a
+ * single fullscreen pass, instead of rendering to a buffer of its own.
+ *
+ * Coordinate effects remap the position at which the output image is sampled,
+ * color effects change the sampled color. The render manager compiles all
+ * active snippets into one program and runs it after the regular post hooks.
+ */
+struct post_snippet_t
+{
+    enum type_t
+    {
+        /** source defines `vec2 <function>(highp vec2 uv)` */
+        POST_SNIPPET_COORD,
+        /** source defines `vec4 <function>(vec4 color)` */
+        POST_SNIPPET_COLOR,
+    };
+
+    type_t type;
+
+    /** The name of the function defined by the snippet */
+    std::string function;
+
+    /**
+     * GLSL ES 1.00 code which defines the snippet's function and the uniforms
+     * it uses. UV coordinates are in the [0, 1] range. Since all snippets are
+     * put in the same shader, the identifiers should be prefixed with the
+     * plugin name.
+     */
+    std::string source;
+
+    /**
+     * Called every frame with the fused program in use to set the snippet's
+     * uniforms. The destination is the framebuffer the pass renders to.
+     */
+    std::function<void(OpenGL::program_t& program,
+        const wf::framebuffer_base_t& destination)> set_uniforms;
+
+    /**
+     * How far, in output pixels, the snippet samples around the pixel it
+     * computes. 0 means the effect is pointwise, -1 that the footprint is
+     * unbounded, e.g. for effects which move the whole image.
+     *
+     * While only snippets with bounded footprints are active, the output is
+     * postprocessed only where it was damaged, instead of in full.
+     */
+    int sampling_radius = -1;
+
+    /**
+     * For snippets which change only a part of the output, for ex. a lens
+     * around the cursor: the output-local box outside of which the snippet
+     * leaves the image unchanged, and outside of which it does not sample.
+     * The sampling radius then applies only outside of the box.
+     *
+     * Damage touching the box repaints all of it, and when the box changes,
+     * its old and new area are repainted. A box with zero size means that the
+     * snippet may change the whole output.
+     */
+    wf::geometry_t local_box = {0, 0, 0, 0};
+};
+
+/**
+ * A rectangle with a border, drawn on top of the views of an output, for ex.
+ * to preview where a view is going to be snapped. Unlike a compositor view, it
+ * does not take part in stacking or in surface scheduling, and damages only
+ * itself when it changes.
+ *
+ * Colors are not premultiplied.
+ */
+struct overlay_rect_t
+{
+    /** The geometry of the rectangle, in output-local coordinates */
+    wf::geometry_t geometry = {0, 0, 0, 0};
+    wf::color_t color;
+    wf::color_t border_color;
+    /** The width of the border, in logical pixels */
+    int border = 0;
+};
+
+/**
+ * The part of an output which an animated object, for ex. a view with a
+ * transformer, covered when it was last damaged, see
+ * render_manager::damage_animation_bounds().
+ */
+struct animation_bounds_t
+{
+    /** The damaged region, in output-local coordinates */
+    wf::region_t damaged;
+};
+
+/**
+ * A limit of the repaint rate of an output, see
+ * render_manager::add_frame_rate_cap().
+ */
+struct frame_rate_cap_t
+{
+    /** The maximal number of frames per second, 0 for no limit */
+    int max_fps = 0;
+};
+
+/**
+ * Statistics collected by the render manager for a single repainted frame.
+ * Durations are in nanoseconds.
+ */
+struct frame_stats_t
+{
+    /** The sequence number of the frame on its output */
+    uint64_t frame_id = 0;
+    /** The time when the repaint started, using CLOCK_MONOTONIC */
+    int64_t start_time = 0;
+    /** The repaint delay which was used for the frame, in milliseconds */
+    int repaint_delay = 0;
+    /**
+     * The render time which the repaint scheduler predicted for the frame,
+     * or -1 if the delay was not based on a prediction.
+     */
+    int64_t predicted_render_time = -1;
+    /**
+     * Whether the frame was repainted without delay, because a fullscreen view
+     * was shown on an adaptive sync output.
+     */
+    bool adaptive_sync = false;
+    /**
+     * Whether only the software cursors were repainted, from the pixels saved
+     * under them in earlier frames.
+     */
+    bool cursor_only = false;
+
+    /** CPU time spent deciding which surfaces to repaint */
+    int64_t schedule_surfaces_time = 0;
+    /** CPU time spent clearing the background of workspace streams */
+    int64_t clear_empty_areas_time = 0;
+    /** CPU time spent rendering surfaces and views */
+    int64_t render_views_time = 0;
+    /** CPU time spent in postprocessing effects */
+    int64_t postprocessing_time = 0;
+    /** CPU time spent for the whole repaint, including all of the above */
+    int64_t total_time = 0;
+
+    /**
+     * GPU time for the whole frame, or -1 if it is not (yet) known.
+     * GPU timings are available only if the driver supports
+     * GL_EXT_disjoint_timer_query, and they arrive a few frames later.
+     */
+    int64_t gpu_time = -1;
+    /**
+     * CPU time spent committing the frame to the output, or -1 if it is not
+     * known. On outputs driven by a secondary GPU, the DRM backend copies the
+     * frame to that GPU during the commit, so this is the cost of the copy.
+     */
+    int64_t commit_time = -1;
+
+    /** The number of output pixels which were repainted */
+    uint64_t damaged_pixels = 0;
+    /** The number of rectangles in the repainted region */
+    uint32_t damage_rects = 0;
+    /**
+     * The number of damage rectangles which were merged into bigger ones
+     * since the previous frame, see the core/max_damage_rects option.
+     */
+    uint32_t coalesced_damage_rects = 0;
+
+    /**
+     * When the most recent input event before the repaint was handled, using
+     * CLOCK_MONOTONIC, or -1 if no input event was handled since the previous
+     * repaint of the output.
+     */
+    int64_t input_time = -1;
+    /**
+     * How long the repaint was postponed, because input events were waiting
+     * to be read when it was due, see core/max_input_yield.
+     */
+    int64_t input_yield_time = 0;
+    /** The number of input events handled while the repaint was postponed */
+    uint32_t input_yield_events = 0;
+    /**
+     * When the frame was presented, in nanoseconds of the presentation clock,
+     * or -1 if it is not (yet) known.
+     */
+    int64_t present_time = -1;
+};
+
+/**
+ * name: frame-ready
+ * on: render-manager
+ * when: After a frame has been completely drawn, including postprocessing
+ *   effects and software cursors, right before it is committed to the output.
+ *   The signal is emitted only for frames which are actually repainted, so
+ *   consumers such as remote desktop encoders get no frames while the output
+ *   does not change.
+ */
+struct frame_ready_signal : public wf::signal_data_t
+{
+    frame_ready_signal(const wf::framebuffer_base_t& _fb,
+        const wf::region_t& _damage) :
+        fb(_fb), damage(_damage)
+    {}
+
+    /**
+     * The framebuffer of the output. It has no texture, so listeners can only
+     * read or blit from it, between OpenGL::render_begin() and render_end().
+     */
+    const wf::framebuffer_base_t& fb;
+    /** The repainted region, in the coordinates of get_swap_damage() */
+    const wf::region_t& damage;
+};
+
 /** Render manager
  *
  * Each output has a render manager, which is responsible for all rendering
@@ -88,18 +301,95 @@ class render_manager : public wf::signal_provider_t
      */
     void set_redraw_always(bool always = true);
 
+    /**
+     * Tell the render manager that a postprocessing effect magnifies a part of
+     * the output to the whole output, for ex. zoom: each output-local point p
+     * shows what is at origin + p / scale. While a viewport is set, the scene
+     * is composited only inside the visible part, and the damage there is
+     * scaled up to the output, instead of repainting the whole output.
+     *
+     * The viewport is used only while postprocessing effects are active.
+     *
+     * @param origin The output-local point shown in the top-left corner.
+     * @param scale The magnification. Values <= 1 remove the viewport and
+     *   repaint the whole output.
+     */
+    void set_magnified_viewport(wf::pointf_t origin, double scale);
+
+    /**
+     * @return The fullscreen view on top of the current workspace, if it asks
+     *   to bypass the compositor, or null otherwise. Optional effects should be
+     *   suspended while it is set, see the bypass-compositor signal.
+     */
+    wayfire_view get_bypass_compositor_view();
+
+    /**
+     * @return Whether the last frame of the output showed the buffer of the
+     *   view directly, without compositing.
+     */
+    bool is_scanned_out(wayfire_view view);
+
     /**
      * Schedule a frame for the output. Note that if there is no damage for
      * the next frame, nothing will be redrawn
      */
     void schedule_redraw();
 
+    /**
+     * Send frame callbacks to the surfaces on the output at about the next
+     * vblank. Unlike schedule_redraw(), this does not repaint the output if
+     * it has no damage by then.
+     */
+    void schedule_frame_done();
+
     /**
      * Inhibit rendering to the output. An inhibited output will show a
      * fully black image. Used mainly for compositor fade in/out on startup.
      */
     void add_inhibit(bool add);
 
+    /**
+     * Put the output in the dormant state, or wake it up. The output layout
+     * does this when the output is powered off (DPMS) and on again.
+     *
+     * A dormant output has no frames: its damage is dropped, repaints aren't
+     * scheduled, so effect hooks and workspace streams don't run, and its
+     * views get no frame callbacks and are marked occluded. On wake, the whole
+     * output is repainted. Plugins can pause their own timers with the
+     * dormant-changed signal.
+     */
+    void set_dormant(bool dormant);
+
+    /** @return Whether the output is dormant, see set_dormant(). */
+    bool is_dormant() const;
+
+    /**
+     * Hold back new frames on the output. While held, the output keeps showing
+     * its last frame, and the damage collected so far is drawn once the last
+     * hold is released. Used by view transactions, see view-transaction.hpp.
+     */
+    void add_frame_hold(bool add);
+
+    /**
+     * Limit how often the output is repainted, for ex. while a plugin shows
+     * something which doesn't need the full refresh rate. The output is
+     * repainted at most as often as the lowest of the added caps and of the
+     * max_render_fps option of the output allow. Frame callbacks are sent
+     * only with the repainted frames, so clients are throttled to match.
+     *
+     * @param cap The cap to add. Its max_fps can be changed while it is added
+     *   and is used from the next frame on. It must stay valid until it is
+     *   removed.
+     */
+    void add_frame_rate_cap(frame_rate_cap_t *cap);
+
+    /**
+     * Remove an added frame rate cap.
+     *
+     * @param cap The cap to be removed. No-op if it wasn't added.
+     */
+    void rem_frame_rate_cap(frame_rate_cap_t *cap);
+
     /**
      * Add a new effect hook.
      * @param hook The hook callback
@@ -112,6 +402,24 @@ class render_manager : public wf::signal_provider_t
      */
     void rem_effect(effect_hook_t *hook);
 
+    /**
+     * Run the callback once, before the next frame of the output is painted,
+     * for work which has to be done only before the output is drawn again.
+     * A repaint is scheduled. Scheduling a pending callback again has no
+     * effect.
+     *
+     * Callbacks added while painting a frame run before the next frame.
+     *
+     * @param callback The callback, which must stay valid until it has run
+     *   or was removed.
+     */
+    void run_before_paint(effect_hook_t *callback);
+    /**
+     * Remove a callback added with run_before_paint(). No-op if it isn't
+     * pending.
+     */
+    void rem_before_paint(effect_hook_t *callback);
+
     /**
      * Add a new post hook.
      *
@@ -126,6 +434,68 @@ class render_manager : public wf::signal_provider_t
      */
     void rem_post(post_hook_t *hook);
 
+    /**
+     * Add a new fusable postprocessing effect. Snippets are applied in the
+     * order they were added, after all post hooks.
+     *
+     * @param snippet The effect to be added.
+     */
+    void add_post_snippet(post_snippet_t *snippet);
+
+    /**
+     * Remove a fusable postprocessing effect. No-op if it isn't active.
+     *
+     * @param snippet The effect to be removed.
+     */
+    void rem_post_snippet(post_snippet_t *snippet);
+
+    /**
+     * Start drawing an overlay rectangle. Overlay rectangles are drawn in the
+     * order they were added, after the views and before overlay effects. They
+     * are not drawn while a custom renderer is set.
+     *
+     * @param rect The rectangle to draw. It must stay valid until it is
+     *   removed.
+     */
+    void add_overlay_rect(overlay_rect_t *rect);
+
+    /**
+     * Repaint an overlay rectangle after its geometry or colors were changed.
+     * Both its previous and its new geometry are damaged.
+     *
+     * @param rect The changed rectangle. No-op if it isn't being drawn.
+     */
+    void update_overlay_rect(overlay_rect_t *rect);
+
+    /**
+     * Stop drawing an overlay rectangle and damage the area it covered.
+     *
+     * @param rect The rectangle to be removed. No-op if it isn't being drawn.
+     */
+    void rem_overlay_rect(overlay_rect_t *rect);
+
+    /**
+     * Damage the area which an animated object covered when this was last
+     * called for it and the area it covers now. Plugins which animate a few
+     * views or other objects should call this on every frame of the animation
+     * after updating them, instead of damaging the whole output, so that the
+     * rest of the output is not repainted.
+     *
+     * @param bounds The state of the object, kept by the plugin. Initially
+     *   empty.
+     * @param current The area the object covers now, in output-local
+     *   coordinates.
+     */
+    void damage_animation_bounds(animation_bounds_t& bounds,
+        const wf::region_t& current);
+
+    /**
+     * Damage the area which an animated object covered when it was last
+     * damaged, and reset its bounds. Call when the animation is over, or when
+     * the object moves to another output.
+     */
+    void end_animation_bounds(animation_bounds_t& bounds);
+
     /**
      * @return The damaged region on the current output for the current
      * frame that is used when swapping buffers. This function should
@@ -148,9 +518,9 @@ class render_manager : public wf::signal_provider_t
     void damage_whole();
 
     /**
-     * Same as damage_whole() but the output will actually be damaged on the
-     * next time the event loop goes idle. This is safe to use inside render
-     * hooks, transformers, etc.
+     * Same as damage_whole() but the output will be damaged again before the
+     * next frame is painted. This is safe to use inside render hooks,
+     * transformers, etc.
      */
     void damage_whole_idle();
 
@@ -194,9 +564,15 @@ class render_manager : public wf::signal_provider_t
      * This function should be called inside the rendering cycle, i.e in a
      * render or an overlay hook.
      *
+     * Streams which have their own buffer can be rendered at a reduced
+     * level of detail, which is useful when the stream is shown smaller than
+     * the output. The requested scale is rounded up to a power of two (down
+     * to 1/8), and the stream buffer is resized accordingly. The resulting
+     * scale is stored in the stream's scale_x/scale_y.
+     *
      * @param stream The workspace stream to update
-     * @param scale_x Unused for now
-     * @param scale_y Unused for now
+     * @param scale_x The horizontal scale the stream is going to be shown at
+     * @param scale_y The vertical scale the stream is going to be shown at
      */
     void workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1);
@@ -208,6 +584,26 @@ class render_manager : public wf::signal_provider_t
      */
     void workspace_stream_stop(workspace_stream_t& stream);
 
+    /**
+     * Get the views in the visible layers of the output, from top to bottom,
+     * as they are used to render workspace streams. The list is built at most
+     * once per frame and shared by all streams, so plugins which render
+     * several workspaces can use it instead of querying the workspace manager
+     * for each of them.
+     *
+     * The views still need to be checked for visibility on a workspace. The
+     * list is only valid until the stacking order changes or the next frame.
+     */
+    const std::vector<wayfire_view>& get_render_views();
+
+    /**
+     * Get statistics about the most recently repainted frames. Skipped and
+     * directly scanned out frames are not included.
+     *
+     * @return The statistics of up to the last 128 frames, oldest first.
+     */
+    std::vector<frame_stats_t> get_frame_stats() const;
+
   private:
     class impl;
     std::unique_ptr<impl> pimpl;
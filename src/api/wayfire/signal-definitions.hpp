@@ -3,6 +3,7 @@
 
 #include "wayfire/view.hpp"
 #include "wayfire/output.hpp"
+#include <set>
 
 /**
  * Documentation of signals emitted from core components.
@@ -119,8 +120,22 @@ struct surface_map_state_changed_signal : public wf::signal_data_t
  * name: reload-config
  * on: core
  * when: When the config file is reloaded
- * argument: unused
+ * argument: A reload_config_signal if the config backend knows which options
+ *   have changed, or nullptr, in which case any option may have changed.
  */
+struct reload_config_signal : public wf::signal_data_t
+{
+    /** The options whose value has changed */
+    std::vector<std::shared_ptr<wf::config::option_base_t>> changed_options;
+    /** The sections which contain changed options, or which were added */
+    std::set<std::string> changed_sections;
+};
+
+/**
+ * @param data The data of a reload-config signal.
+ * @return Whether an option in the given section may have changed.
+ */
+bool config_section_changed(wf::signal_data_t *data, const std::string& section);
 
 /**
  * name: keyboard-focus-changed
@@ -225,6 +240,18 @@ using output_gain_focus_signal = _output_signal;
  */
 using output_start_rendering_signal = _output_signal;
 
+/**
+ * name: dormant-changed
+ * on: output, core(output-)
+ * when: After the output enters or leaves the dormant state, see
+ *   render_manager::set_dormant().
+ */
+struct output_dormant_changed_signal : public _output_signal
+{
+    /** Whether the output is dormant now */
+    bool dormant;
+};
+
 /* ----------------------------------------------------------------------------/
  * Output workspace signals
  * -------------------------------------------------------------------------- */
@@ -281,6 +308,23 @@ struct workarea_changed_signal : public wf::signal_data_t
     wf::geometry_t new_workarea;
 };
 
+/**
+ * name: bypass-compositor
+ * on: render-manager
+ * when: Whenever the fullscreen view on top of the current workspace starts or
+ *   stops asking to bypass the compositor, see
+ *   view_interface_t::should_bypass_compositor(). Plugins which show optional
+ *   effects on the output, like blur or animations, should suspend them while
+ *   a view bypasses the compositor, so that it can be scanned out directly.
+ */
+struct bypass_compositor_signal : public wf::signal_data_t
+{
+    /** The view which bypasses the compositor now, or null */
+    wayfire_view view;
+    /** The view which bypassed the compositor before, or null */
+    wayfire_view previous;
+};
+
 /**
  * name: fullscreen-layer-focused
  * on: output
@@ -390,6 +434,18 @@ struct view_minimized_signal : public _view_signal
     bool state;
 };
 
+/**
+ * name: visibility-changed
+ * on: view, output(view-)
+ * when: After the visibility state of the view changes. It is updated after
+ *   each frame of the view's output, see view_interface_t::get_visibility_state()
+ */
+struct view_visibility_changed_signal : public _view_signal
+{
+    wf::view_visibility_t old_state;
+    wf::view_visibility_t state;
+};
+
 /**
  * name: view-minimize-request
  * on: output
@@ -519,13 +575,29 @@ struct view_focus_request_signal : public _view_signal
  */
 using view_set_sticky_signal = _view_signal;
 
+/**
+ * name: transformer-changed
+ * on: view
+ * when: After a transformer has been added to or removed from the view.
+ */
+using view_transformer_changed_signal = _view_signal;
+
 /**
  * name: title-changed
  * on: view
- * when: After the view's title has changed.
+ * when: After the view's title has changed. Frequent changes are coalesced,
+ *   so that the signal is emitted at most once per output frame.
  */
 using title_changed_signal = _view_signal;
 
+/**
+ * name: bypass-compositor-changed
+ * on: view
+ * when: After the value of view_interface_t::should_bypass_compositor() has
+ *   changed.
+ */
+using bypass_compositor_changed_signal = _view_signal;
+
 /**
  * name: app-id-changed
  * on: view
@@ -548,6 +620,16 @@ struct view_show_window_menu_signal : public _view_signal
  * name: geometry-changed
  * on: view, output(view-), core(view-)
  * when: Whenever the view's wm geometry changes.
+ *
+ * name: geometry-changed-frame
+ * on: view
+ * when: At most once per frame, before the view's output is repainted (or
+ *   when idle, if the view has no output), if the wm geometry has changed
+ *   since the last time. A series of changes, for ex. during an interactive
+ *   move, results in a single signal, so handlers which only need the final
+ *   geometry should prefer it over geometry-changed.
+ *   old_geometry is the geometry before the first of the changes, and the
+ *   final one is the current wm geometry.
  */
 struct view_geometry_changed_signal : public _view_signal
 {
@@ -570,6 +652,14 @@ struct view_geometry_changed_signal : public _view_signal
  */
 using view_decoration_state_updated_signal = _view_signal;
 
+/**
+ * name: blur-region-changed
+ * on: view, output(view-)
+ * when: Whenever the client changes the region which should be blurred behind
+ *   the view, see get_kde_blur_region().
+ */
+using blur_region_changed_signal = _view_signal;
+
 /**
  * name: decoration-changed
  * on: view
@@ -648,6 +738,29 @@ struct view_pre_moved_to_output_signal : public signal_data_t
  */
 using view_moved_to_output_signal = view_pre_moved_to_output_signal;
 
+/**
+ * name: views-pre-moved-to-output
+ * on: core
+ * when: Once before a group of views is moved to another output with
+ *   compositor_core_t::move_views_to_output(), before the signals of the
+ *   individual views. Plugins may use it to handle the whole group at once,
+ *   for example by relayouting only after views-moved-to-output.
+ */
+struct views_pre_moved_to_output_signal : public signal_data_t
+{
+    /* The views being moved, from the bottom to the top of the stack */
+    std::vector<wayfire_view> views;
+    /* The output the views are being moved to. */
+    wf::output_t *new_output;
+};
+
+/**
+ * name: views-moved-to-output
+ * on: core
+ * when: Once after all views of a group have been moved to the new output.
+ */
+using views_moved_to_output_signal = views_pre_moved_to_output_signal;
+
 /**
  * name: view-disappeared
  * on: output
@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include <wayfire/nonstd/wlroots.hpp>
 #include <wayfire/nonstd/observer_ptr.h>
@@ -93,6 +94,28 @@ class surface_interface_t : public wf::object_base_t
     virtual std::vector<surface_iterator_t> enumerate_surfaces(
         wf::point_t surface_origin = {0, 0});
 
+    using surface_callback_t = std::function<void (const surface_iterator_t&)>;
+
+    /**
+     * Call the callback for each mapped surface in the surface tree, in the
+     * same order as enumerate_surfaces(), without building a list.
+     *
+     * @param surface_origin The coordinates of the top-left corner of the
+     * surface.
+     */
+    template<class Callback>
+    void for_each_surface(Callback&& callback, wf::point_t surface_origin = {0, 0})
+    {
+        /* std::function doesn't allocate when wrapping a reference_wrapper */
+        visit_surfaces(std::ref(callback), surface_origin);
+    }
+
+    /**
+     * @return true if any of the direct subsurfaces of the surface is mapped,
+     * i.e. if enumerate_surfaces() would return more than this surface.
+     */
+    bool has_mapped_subsurfaces();
+
     /**
      * @return The output the surface is currently attached to. Note this
      * doesn't necessarily mean that it is visible.
@@ -185,6 +208,10 @@ class surface_interface_t : public wf::object_base_t
     class impl;
     std::unique_ptr<impl> priv;
 
+  private:
+    void visit_surfaces(const surface_callback_t& callback,
+        wf::point_t surface_origin);
+
   protected:
     /** Construct a new surface. */
     surface_interface_t();
@@ -0,0 +1,68 @@
+#ifndef WF_TASK_EXECUTOR_HPP
+#define WF_TASK_EXECUTOR_HPP
+
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <functional>
+#include <memory>
+
+namespace wf
+{
+enum task_priority_t
+{
+    TASK_PRIORITY_LOW    = 0,
+    TASK_PRIORITY_NORMAL = 1,
+    TASK_PRIORITY_HIGH   = 2,
+};
+
+/**
+ * A task which runs on the thread pool of the compositor, for work which
+ * should not block the event loop, like decoding images or rasterizing text.
+ *
+ * The pool has a thread per CPU core except one, and is started when the
+ * first task is submitted. Each thread has its own queues, and takes tasks
+ * from the other threads when its queues are empty. Tasks with a higher
+ * priority are started first.
+ *
+ * Like signal_connection_t and wl_timer, the object is meant to be a member of
+ * the plugin which uses it: destroying it cancels the task, and waits for it
+ * if it is running, so that no code of an unloaded plugin can run afterwards.
+ *
+ * All methods must be called on the compositor thread.
+ */
+class background_task_t : public noncopyable_t
+{
+  public:
+    background_task_t();
+    /** Cancels the task, see cancel() */
+    ~background_task_t();
+
+    /**
+     * Submit a new task, cancelling the previous one if it is still pending.
+     *
+     * @param work Runs on a thread of the pool. It must not wait for the
+     *   compositor thread.
+     * @param done Runs on the compositor thread, from the event loop, after
+     *   work has returned. Optional.
+     * @param priority The priority of the task.
+     */
+    void submit(std::function<void()> work, std::function<void()> done = {},
+        task_priority_t priority = TASK_PRIORITY_NORMAL);
+
+    /**
+     * Cancel the task: if it hasn't started yet, it won't, and its completion
+     * callback won't be called. If it is running, wait until it returns.
+     */
+    void cancel();
+
+    /** @return Whether the task has been submitted and not completed yet. */
+    bool is_pending() const;
+
+    struct state_t;
+
+  private:
+    std::shared_ptr<state_t> state;
+};
+}
+
+#endif /* end of include guard: WF_TASK_EXECUTOR_HPP */
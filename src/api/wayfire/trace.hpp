@@ -0,0 +1,134 @@
+#ifndef WF_TRACE_HPP
+#define WF_TRACE_HPP
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace wf
+{
+/**
+ * A simple tracing facility for finding out where the time of a frame goes.
+ *
+ * Code marks interesting sections with WF_TRACE_SCOPE(). While a recording is
+ * running, each time a section is left, its name, start time and duration are
+ * stored. When the recording stops, the events are written as a Chrome trace
+ * (JSON), which can be opened in chrome://tracing or in the Perfetto UI.
+ *
+ * Recordings can be toggled by sending SIGUSR2 to the compositor. The trace
+ * is then written to $WAYFIRE_TRACE_FILE, or to wayfire-trace-<pid>.json in
+ * $XDG_RUNTIME_DIR (or /tmp) if it is not set.
+ *
+ * The stall watchdog additionally keeps the last events in a ring buffer, the
+ * flight recorder, also while no recording is running.
+ *
+ * When neither is running, a trace scope costs a single branch.
+ */
+namespace trace
+{
+/** Whether a recording is running. Use is_recording() instead. */
+extern bool recording;
+/** Whether events are collected at all. Use is_active() instead. */
+extern bool active;
+
+/** @return Whether a recording is running. */
+inline bool is_recording()
+{
+    return recording;
+}
+
+/** @return Whether a recording or the flight recorder is running. */
+inline bool is_active()
+{
+    return active;
+}
+
+/** Start a new recording, discarding the events of a previous one. */
+void start_recording();
+
+/**
+ * Stop the current recording and write it to the given file.
+ *
+ * @return Whether the trace could be written.
+ */
+bool stop_recording(const std::string& path);
+
+/**
+ * Record a section which has already happened.
+ *
+ * @param name The name of the section. It must stay valid until the
+ *   recording is stopped, for ex. a string literal.
+ * @param start The start of the section, see get_time().
+ * @param end The end of the section, see get_time().
+ */
+void add_event(const char *name, int64_t start, int64_t end);
+
+/** @return The current time in nanoseconds, on the clock used for traces. */
+int64_t get_time();
+
+/**
+ * Start keeping the last events in the flight recorder. There is no way to
+ * stop it, as it is meant to run for the whole session.
+ */
+void start_flight_recorder();
+
+struct event_t
+{
+    const char *name;
+    int64_t start;
+    int64_t end;
+};
+
+/**
+ * Copy the newest events of the flight recorder, oldest first. May be called
+ * from any thread. Events which are overwritten while they are copied are
+ * left out.
+ *
+ * @return The number of copied events, at most max.
+ */
+size_t get_last_events(event_t *events, size_t max);
+
+/**
+ * Records the time between its construction and its destruction, if a
+ * recording is running when it is constructed.
+ */
+class scope_t
+{
+  public:
+    scope_t(const char *name) : name(name)
+    {
+        if (is_active())
+        {
+            start = get_time();
+        }
+    }
+
+    ~scope_t()
+    {
+        if ((start >= 0) && is_active())
+        {
+            add_event(name, start, get_time());
+        }
+    }
+
+    scope_t(const scope_t&) = delete;
+    scope_t& operator =(const scope_t&) = delete;
+
+  private:
+    const char *name;
+    int64_t start = -1;
+};
+}
+}
+
+#define WF_TRACE_CONCAT_DETAIL(a, b) a ## b
+#define WF_TRACE_CONCAT(a, b) WF_TRACE_CONCAT_DETAIL(a, b)
+
+/**
+ * Trace the rest of the current scope under the given name, which must stay
+ * valid until the recording is stopped.
+ */
+#define WF_TRACE_SCOPE(name) \
+    wf::trace::scope_t WF_TRACE_CONCAT(_wf_trace_scope_, __LINE__){name}
+
+#endif /* end of include guard: WF_TRACE_HPP */
@@ -11,6 +11,13 @@
 /* ---------------------- pixman utility functions -------------------------- */
 namespace wf
 {
+/**
+ * A region of integer coordinates, backed by a pixman region.
+ *
+ * Pixman stores regions consisting of a single rectangle inline, without any
+ * allocations. Most damage regions are like that, so the operations which are
+ * common in the repaint path handle this case without going through pixman.
+ */
 struct region_t
 {
     region_t();
@@ -37,6 +44,12 @@ struct region_t
     region_t operator +(const point_t& vector) const;
     region_t& operator +=(const point_t& vector);
 
+    /**
+     * Subtract the other region, translated by the given vector. Equivalent
+     * to `*this ^= other + vector`, without making a copy of other.
+     */
+    region_t& subtract_translated(const region_t& other, const point_t& vector);
+
     region_t operator *(float scale) const;
     region_t& operator *=(float scale);
 
@@ -134,8 +147,24 @@ struct wl_listener_wrapper : public noncopyable_t
     wrapper _wrap;
 };
 
+/** The order in which pending idle calls run, see wl_idle_call */
+enum idle_priority_t
+{
+    /* Work which other idle calls may depend on */
+    IDLE_PRIORITY_HIGH   = 0,
+    IDLE_PRIORITY_NORMAL = 1,
+    /* Cleanups which can wait until everything else is done */
+    IDLE_PRIORITY_LOW    = 2,
+};
+
+class idle_queue_t;
+
 /**
- * A wrapper for adding idle callbacks to the event loop
+ * A wrapper for adding idle callbacks to the event loop.
+ *
+ * Idle calls on the default event loop share a single queue, which is
+ * drained once each time the loop goes idle. Pending calls run by priority,
+ * and calls with the same priority in the order they were scheduled.
  */
 class wl_idle_call : public noncopyable_t
 {
@@ -169,17 +198,39 @@ class wl_idle_call : public noncopyable_t
     /** @return true if the event source is active */
     bool is_connected();
 
+    /** Set the priority of the call. Takes effect the next time it is
+     * scheduled with run_once() */
+    void set_priority(idle_priority_t priority);
+
     /** execute the callback now. do not use manually! */
     void execute();
 
   private:
+    friend class idle_queue_t;
+
     callback_t call;
     wl_event_loop *loop     = NULL;
     wl_event_source *source = NULL;
+    idle_priority_t priority = IDLE_PRIORITY_NORMAL;
+
+    /* The position in the idle queue, if the call is pending there */
+    struct queue_link
+    {
+        wl_list link;
+        wl_idle_call *self;
+    };
+
+    queue_link _link;
 };
 
+class timer_wheel_t;
+
 /**
- * A wrapper for wl_event_loop_add_timer / wl_event_loop_timer_update
+ * A timer on the event loop.
+ *
+ * All timers share a single timerfd, multiplexed by a hierarchical timer
+ * wheel, so that arming and removing a timer is O(1) and usually does not
+ * need a syscall. Timers have a resolution of one millisecond.
  */
 class wl_timer
 {
@@ -187,16 +238,24 @@ class wl_timer
     // Return true if the timer should be fired again after the same amount of time
     using callback_t = std::function<bool ()>;
 
+    wl_timer();
     /** Disconnects the timer if connected */
     ~wl_timer();
 
-    /** Execute call after a timeout of timeout_ms */
-    void set_timeout(uint32_t timeout_ms, callback_t call);
+    /**
+     * Execute call after a timeout of timeout_ms.
+     *
+     * @param precise If false, the timer may fire later, by up to 1/16 of the
+     *   timeout, so that it can share wakeups with other timers. Use this for
+     *   timeouts which don't have to be exact, like idle timeouts.
+     */
+    void set_timeout(uint32_t timeout_ms, callback_t call, bool precise = true);
 
     /** If a timeout has been registered, but not fired yet, remove the
      * timeout. Otherwise no-op */
     void disconnect();
-    /** @return true if the event source is active */
+    /** @return true if a timeout has been registered and the timer has not
+     * been disconnected since, even if it has already fired */
     bool is_connected();
 
     /* Run the stored call now, regardless of the timeout. No-op if not
@@ -204,9 +263,22 @@ class wl_timer
     void execute();
 
   private:
+    friend class timer_wheel_t;
+
     callback_t call;
-    wl_event_source *source = NULL;
     uint32_t timeout = -1;
+    bool precise     = true;
+    bool connected   = false;
+
+    /* The position in the timer wheel, if the timer is pending */
+    struct wheel_link
+    {
+        wl_list link;
+        wl_timer *self;
+    };
+
+    wheel_link _link;
+    uint64_t expires = 0;
 };
 }
 
@@ -2,6 +2,7 @@
 
 #include "wayfire/condition/access_interface.hpp"
 #include "wayfire/view.hpp"
+#include <optional>
 #include <string>
 #include <tuple>
 
@@ -31,6 +32,9 @@ namespace wf
  * "maximized" -> bool
  * "floating" -> bool
  * "type" -> std::string (This will return a type string like the matcher plugin did)
+ *
+ * The app_id and the title are read from the view only once after each
+ * set_view(), because they don't change while a set of rules is evaluated.
  */
 class view_access_interface_t : public access_interface_t
 {
@@ -66,5 +70,15 @@ class view_access_interface_t : public access_interface_t
      * @brief _view The view to interrogate.
      */
     wayfire_view _view;
+
+    /**
+     * @brief _app_id, _title Cached string properties of the view.
+     */
+    std::optional<std::string> _app_id, _title;
+
+    /**
+     * @brief get_type Compute the value of the "type" property.
+     */
+    std::string get_type();
 };
 } // End namespace wf.
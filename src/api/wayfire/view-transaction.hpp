@@ -0,0 +1,54 @@
+#ifndef WF_VIEW_TRANSACTION_HPP
+#define WF_VIEW_TRANSACTION_HPP
+
+#include <wayfire/view.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+#include <memory>
+
+namespace wf
+{
+/**
+ * A view transaction groups the geometry changes of several views, so that
+ * they appear on the screen in a single frame, instead of one view at a time
+ * as the clients commit their new sizes.
+ *
+ * A transaction is open from its creation until its destruction. While it is
+ * open, every view_interface_t::set_geometry() call which changes the size of
+ * a mapped view becomes part of it. The configure requests are sent to the
+ * clients right away. When the transaction is closed, the outputs of the
+ * affected views stop showing new frames until all views have committed their
+ * new sizes, or until core/transaction_timeout milliseconds have passed.
+ *
+ * Transactions may be nested, views are added to the innermost one.
+ *
+ * Example:
+ *
+ * {
+ *     wf::view_transaction_t tx;
+ *     view1->set_geometry(g1);
+ *     view2->set_geometry(g2);
+ * } // Both views appear with their new geometry at the same time
+ */
+class view_transaction_t : public noncopyable_t
+{
+  public:
+    view_transaction_t();
+    ~view_transaction_t();
+
+    /**
+     * Add a view to the transaction, which is being resized to the given size.
+     * Views which already have this size are ignored.
+     */
+    void add_view(wayfire_view view, wf::dimensions_t size);
+
+    /** @return The innermost open transaction, or nullptr if there is none. */
+    static view_transaction_t *get_open();
+
+    class impl;
+
+  private:
+    std::unique_ptr<impl> priv;
+};
+}
+
+#endif /* end of include guard: WF_VIEW_TRANSACTION_HPP */
@@ -3,6 +3,8 @@
 
 #include <wayfire/view.hpp>
 #include <wayfire/opengl.hpp>
+#include <glm/mat2x2.hpp>
+#include <optional>
 
 namespace wf
 {
@@ -19,6 +21,19 @@ enum transformer_z_order_t
     TRANSFORMER_BLUR      = 999,
 };
 
+/**
+ * An affine transformation of the plane together with an alpha multiplier.
+ */
+struct affine_transform_t
+{
+    /**
+     * Maps output-local coordinates before the transformation to output-local
+     * coordinates after it. The Z coordinate is ignored.
+     */
+    glm::mat4 matrix{1.0};
+    float alpha = 1.0f;
+};
+
 class view_transformer_t
 {
   public:
@@ -107,6 +122,26 @@ class view_transformer_t
         wlr_box scissor_box, const wf::framebuffer_t& target_fb)
     {}
 
+    /**
+     * Get the transformation as an affine transform, if it is one.
+     *
+     * If all transformers of a view are affine, the surfaces of the view are
+     * rendered directly to the target framebuffer, instead of rendering the
+     * view to an offscreen buffer first. In that case, render_with_damage()
+     * is not called. Note that the alpha is then applied to each surface
+     * separately, so overlapping translucent surfaces blend with each other.
+     *
+     * @param view The bounding box of the view up to this transformer.
+     *
+     * @return The transformation, or nothing if it is not affine. The default
+     *   implementation returns nothing.
+     */
+    virtual std::optional<affine_transform_t> get_affine_transform(
+        wf::geometry_t view)
+    {
+        return {};
+    }
+
     virtual ~view_transformer_t()
     {}
 };
@@ -138,6 +173,23 @@ class view_2D : public view_transformer_t
         wf::geometry_t view, wf::pointf_t point) override;
     void render_box(wf::texture_t src_tex, wlr_box src_box,
         wlr_box scissor_box, const wf::framebuffer_t& target_fb) override;
+    std::optional<affine_transform_t> get_affine_transform(
+        wf::geometry_t view) override;
+    /** Exact if the view is opaque and not rotated, empty otherwise */
+    wf::region_t transform_opaque_region(
+        wf::geometry_t box, wf::region_t region) override;
+
+  private:
+    /* The rotation and scaling, and the parameters they were computed for.
+     * Plugins set the parameters directly, so they are compared on use. */
+    struct
+    {
+        float angle   = 0.0f;
+        float scale_x = 1.0f, scale_y = 1.0f;
+        glm::mat2 matrix{1.0f}, inverse{1.0f};
+    } linear;
+
+    void update_linear();
 };
 
 /* Those are centered relative to the view's bounding box */
@@ -166,10 +218,23 @@ class view_3D : public view_transformer_t
         wf::geometry_t view, wf::pointf_t point) override;
     void render_box(wf::texture_t src_tex, wlr_box src_box,
         wlr_box scissor_box, const wf::framebuffer_t& target_fb) override;
+    /** Exact if the view is opaque and stays axis-aligned, else empty */
+    wf::region_t transform_opaque_region(
+        wf::geometry_t box, wf::region_t region) override;
 
     static const float fov; // PI / 8
     static glm::mat4 default_view_matrix();
     static glm::mat4 default_proj_matrix();
+
+  private:
+    /* The last total transform and what it was computed from */
+    struct
+    {
+        bool valid = false;
+        glm::mat4 view_proj, translation, rotation, scaling;
+        int output_size;
+        glm::mat4 total;
+    } cached;
 };
 
 /* create a matrix which corresponds to the inverse of the given transform */
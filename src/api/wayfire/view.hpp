@@ -36,6 +36,25 @@ enum view_role_t
     VIEW_ROLE_DESKTOP_ENVIRONMENT,
 };
 
+/**
+ * How much of a view is shown on its output, see
+ * view_interface_t::get_visibility_state().
+ */
+enum view_visibility_t
+{
+    /** The whole view is shown. */
+    VIEW_VISIBILITY_VISIBLE,
+    /** Parts of the view are covered by other views or are outside the output. */
+    VIEW_VISIBILITY_PARTIAL,
+    /**
+     * The view is on the current workspace, but fully covered by opaque views,
+     * or its output is dormant.
+     */
+    VIEW_VISIBILITY_OCCLUDED,
+    /** The view is on another workspace or minimized. */
+    VIEW_VISIBILITY_OFF_WORKSPACE,
+};
+
 /**
  * A bitmask consisting of all tiled edges.
  * This corresponds to a maximized state.
@@ -72,6 +91,19 @@ class view_interface_t : public surface_interface_t
      */
     std::vector<wayfire_view> enumerate_views(bool mapped_only = true);
 
+    /**
+     * Call the callback for each view in the view's tree, in the same order
+     * as enumerate_views(), without building a list.
+     *
+     * @param mapped_only Whether to include only mapped views.
+     */
+    template<class Callback>
+    void for_each_view(Callback&& callback, bool mapped_only = true)
+    {
+        /* std::function doesn't allocate when wrapping a reference_wrapper */
+        visit_views(std::ref(callback), mapped_only);
+    }
+
     /**
      * Set the toplevel parent of the view, and adjust the children's list of
      * the parent.
@@ -282,6 +314,20 @@ class view_interface_t : public surface_interface_t
      */
     virtual void set_visible(bool visible);
 
+    /**
+     * @return How much of the view was shown in the last frame of its output.
+     *   Views are considered visible until their output has repainted once.
+     *   While a custom renderer is active, all views which are not minimized
+     *   are considered visible.
+     */
+    view_visibility_t get_visibility_state() const;
+
+    /**
+     * Set the visibility state of the view and emit visibility-changed if it
+     * changed. Called by core after each frame, plugins shouldn't call it.
+     */
+    virtual void set_visibility_state(view_visibility_t state);
+
     /** Damage the whole view and add the damage to its output */
     virtual void damage();
 
@@ -314,6 +360,14 @@ class view_interface_t : public surface_interface_t
     /** @return true if the view needs decorations */
     virtual bool should_be_decorated();
 
+    /**
+     * @return true if the client asked to be shown without composition while
+     *   it is fullscreen, for ex. X11 windows with _NET_WM_BYPASS_COMPOSITOR
+     *   set to 1. When it changes, bypass-compositor-changed is emitted on the
+     *   view.
+     */
+    virtual bool should_bypass_compositor();
+
     /**
      * Set the decoration surface for the view.
      *
@@ -463,6 +517,10 @@ class view_interface_t : public surface_interface_t
      */
     uint64_t last_focus_timestamp = 0;
 
+  private:
+    void visit_views(const std::function<void(wayfire_view)>& callback,
+        bool mapped_only);
+
   protected:
     view_interface_t();
 
@@ -220,9 +220,19 @@ class workspace_manager
      */
     std::vector<wayfire_view> get_views_in_layer(uint32_t layers_mask);
 
+    /**
+     * @return A counter which changes whenever the stacking order of the views
+     * on the output changes, including views being added to or removed from
+     * the layers. Plugins may cache lists of views until it changes.
+     */
+    uint64_t get_stacking_generation();
+
     /**
      * Get a list of reordered fullscreen views as explained in
      * get_views_in_layer().
+     *
+     * The list is maintained when the stacking order or the fullscreen state
+     * of views changes, so this doesn't need to go over all views.
      */
     std::vector<wayfire_view> get_promoted_views();
 
@@ -376,6 +386,13 @@ class workspace_manager
      */
     void reflow_reserved_areas();
 
+    /**
+     * Recalculate the reserved areas once the compositor is idle, so that
+     * many changes in a row cause only a single reflow. Until then,
+     * get_workarea() returns the workarea of the last reflow.
+     */
+    void schedule_reflow_reserved_areas();
+
     /**
      * @return The free space of the output after reserving the space for panels
      */
@@ -14,6 +14,8 @@ struct workspace_stream_t
     wf::framebuffer_base_t buffer;
     bool running = false;
 
+    /* The level of detail of the stream buffer, relative to the output
+     * resolution. Set by the render manager on workspace_stream_update(). */
     float scale_x = 1.0;
     float scale_y = 1.0;
 
@@ -26,6 +28,15 @@ struct workspace_stream_t
      * it is not set (alpha = -1.0) it will fallback to the default
      * user configurable color. */
     wf::color_t background = {0.0f, 0.0f, 0.0f, -1.0f};
+
+    /* The workspace, its damage serial and the background at the time the
+     * stream was last rendered. They are managed by the render manager, so
+     * that streams which have not been damaged since their last repaint (for
+     * example, when they are restarted or updated by several plugins in the
+     * same frame) can be reused without repainting. */
+    wf::point_t rendered_ws = {0, 0};
+    uint64_t rendered_serial = 0;
+    wf::color_t rendered_background = {0.0f, 0.0f, 0.0f, -1.0f};
 };
 
 /**
@@ -0,0 +1,243 @@
+#include "client-accounting.hpp"
+#include <wayfire/core.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <sys/ioctl.h>
+#include <wayland-server.h>
+
+namespace
+{
+/* The length of the window in which commits are counted */
+constexpr uint32_t RATE_WINDOW_MS = 1000;
+/* Checking the socket is a syscall, don't do it for every motion event */
+constexpr uint32_t QUEUE_CHECK_MS = 10;
+/* A longer pause starts a new cadence */
+constexpr int64_t CADENCE_RESET_US = 500'000;
+/* The commits, and the deviation from the average interval in percent, after
+ * which the cadence of a client is steady. Content which is presented on the
+ * vblanks of a faster output alternates between two intervals, for ex. 33 and
+ * 50ms for 24fps at 60Hz, which is a deviation of 20%. */
+constexpr int CADENCE_MIN_COMMITS   = 16;
+constexpr int CADENCE_MAX_DEVIATION = 25;
+
+struct client_entry_t
+{
+    wf::client_accounting::client_stats_t stats;
+    wl_listener destroy;
+
+    uint32_t window_start;
+    int window_commits = 0;
+    uint32_t last_queue_check;
+    bool queue_checked = false;
+
+    int64_t last_commit_us = 0;
+    /* Running averages of the interval and of its deviation */
+    double interval_us  = 0;
+    double deviation_us = 0;
+    int cadence_commits = 0;
+};
+
+struct state_t
+{
+    wf::option_wrapper_t<int> max_commit_rate{"core/client_max_commit_rate"};
+    wf::option_wrapper_t<int> max_queued_kb{"core/client_max_queued_kb"};
+    std::unordered_map<wl_client*, std::unique_ptr<client_entry_t>> clients;
+};
+
+state_t& get_state()
+{
+    static state_t state;
+    return state;
+}
+
+void handle_client_destroy(wl_listener *listener, void*)
+{
+    client_entry_t *entry = wl_container_of(listener, entry, destroy);
+    wl_list_remove(&entry->destroy.link);
+    get_state().clients.erase(entry->stats.client);
+}
+
+client_entry_t& get_entry(wl_client *client)
+{
+    auto& entry = get_state().clients[client];
+    if (!entry)
+    {
+        entry = std::make_unique<client_entry_t>();
+        entry->stats        = {};
+        entry->stats.client = client;
+        wl_client_get_credentials(client, &entry->stats.pid, nullptr, nullptr);
+        entry->window_start   = wf::get_current_time();
+        entry->destroy.notify = handle_client_destroy;
+        wl_client_add_destroy_listener(client, &entry->destroy);
+    }
+
+    return *entry;
+}
+
+/** @return The bytes in the socket of the client which it hasn't read yet. */
+int get_queued_bytes(wl_client *client)
+{
+    int bytes = 0;
+#if defined(TIOCOUTQ)
+    ioctl(wl_client_get_fd(client), TIOCOUTQ, &bytes);
+#elif defined(FIONWRITE)
+    ioctl(wl_client_get_fd(client), FIONWRITE, &bytes);
+#endif
+
+    return bytes;
+}
+
+/** Update the cadence of the client with a new commit. */
+void account_cadence(client_entry_t& entry)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t interval = now - entry.last_commit_us;
+    entry.last_commit_us = now;
+
+    if ((interval > CADENCE_RESET_US) || (entry.cadence_commits == 0))
+    {
+        entry.cadence_commits = 1;
+        entry.interval_us  = 0;
+        entry.deviation_us = 0;
+    } else if (entry.cadence_commits++ == 1)
+    {
+        entry.interval_us = interval;
+    } else
+    {
+        /* The averages follow a change of the rate within a few frames */
+        entry.deviation_us +=
+            (std::abs(interval - entry.interval_us) - entry.deviation_us) / 8;
+        entry.interval_us += (interval - entry.interval_us) / 8;
+    }
+
+    entry.stats.commit_interval_us = (int64_t)entry.interval_us;
+    entry.stats.steady_cadence     =
+        (entry.cadence_commits >= CADENCE_MIN_COMMITS) &&
+        (entry.deviation_us * 100 <= entry.interval_us * CADENCE_MAX_DEVIATION);
+}
+
+void report_limited(client_entry_t& entry, const std::string& reason)
+{
+    ++entry.stats.times_limited;
+    LOGD("Client with pid ", entry.stats.pid, " is limited: ", reason);
+
+    wf::client_accounting::client_limited_signal data;
+    data.stats  = entry.stats;
+    data.reason = reason;
+    wf::get_core().emit_signal("client-limited", &data);
+}
+}
+
+bool wf::client_accounting::account_commit(wl_client *client)
+{
+    if (!client)
+    {
+        return false;
+    }
+
+    auto& entry = get_entry(client);
+    account_cadence(entry);
+
+    int limit = get_state().max_commit_rate;
+    if (limit <= 0)
+    {
+        ++entry.stats.commits;
+        entry.stats.rate_limited = false;
+
+        return false;
+    }
+
+    uint32_t now = wf::get_current_time();
+    if (now - entry.window_start >= RATE_WINDOW_MS)
+    {
+        /* A client which was idle for a while did not commit at all since the
+         * last window */
+        entry.stats.commit_rate = (now - entry.window_start < 2 * RATE_WINDOW_MS) ?
+            entry.window_commits : 0;
+        entry.window_start   = now;
+        entry.window_commits = 0;
+    }
+
+    ++entry.window_commits;
+    ++entry.stats.commits;
+
+    /* Keep merging for a whole window after the client exceeded the limit, so
+     * that a client committing steadily at a high rate is limited steadily */
+    bool limited = (entry.window_commits > limit) ||
+        (entry.stats.commit_rate > limit);
+    if (limited && !entry.stats.rate_limited)
+    {
+        entry.stats.rate_limited = true;
+        report_limited(entry, "commit-rate");
+    }
+
+    entry.stats.rate_limited = limited;
+    if (limited)
+    {
+        ++entry.stats.merged_commits;
+    }
+
+    return limited;
+}
+
+bool wf::client_accounting::is_backlogged(wl_client *client)
+{
+    int limit_kb = get_state().max_queued_kb;
+    if (!client || (limit_kb <= 0))
+    {
+        return false;
+    }
+
+    auto& entry = get_entry(client);
+    uint32_t now = wf::get_current_time();
+    if (entry.queue_checked && (now - entry.last_queue_check < QUEUE_CHECK_MS))
+    {
+        return entry.stats.backlogged;
+    }
+
+    entry.queue_checked      = true;
+    entry.last_queue_check   = now;
+    entry.stats.queued_bytes = get_queued_bytes(client);
+    entry.stats.peak_queued_bytes =
+        std::max(entry.stats.peak_queued_bytes, entry.stats.queued_bytes);
+
+    bool backlogged = entry.stats.queued_bytes > limit_kb * 1024;
+    if (backlogged && !entry.stats.backlogged)
+    {
+        entry.stats.backlogged = true;
+        report_limited(entry, "queue");
+    }
+
+    entry.stats.backlogged = backlogged;
+
+    return backlogged;
+}
+
+std::vector<wf::client_accounting::client_stats_t> wf::client_accounting::
+get_client_stats()
+{
+    std::vector<client_stats_t> result;
+    for (auto& [client, entry] : get_state().clients)
+    {
+        result.push_back(entry->stats);
+    }
+
+    return result;
+}
+
+const wf::client_accounting::client_stats_t*wf::client_accounting::
+find_client_stats(wl_client *client)
+{
+    auto& clients = get_state().clients;
+    auto it = clients.find(client);
+
+    return (it == clients.end()) ? nullptr : &it->second->stats;
+}
@@ -0,0 +1,86 @@
+#ifndef WF_CLIENT_ACCOUNTING_HPP
+#define WF_CLIENT_ACCOUNTING_HPP
+
+#include <wayfire/object.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct wl_client;
+
+namespace wf
+{
+/**
+ * Accounting of the commits and the unread events of each Wayland client, so
+ * that misbehaving clients don't make the compositor do extra work.
+ *
+ * A client which commits more than core/client_max_commit_rate times in a
+ * second (in total over all its surfaces) is rate limited: the damage of its
+ * excess commits is merged and applied once, right before the next repaint of
+ * the output, instead of on every commit.
+ *
+ * A client which has more than core/client_max_queued_kb of events in its
+ * socket which it hasn't read yet is backlogged: pointer motion sent to it is
+ * coalesced to once per frame, as with input/coalesce_motion.
+ *
+ * Each time a client becomes rate limited or backlogged, the core emits
+ * client-limited with client_limited_signal, and the offenders can be listed
+ * over IPC.
+ *
+ * The interval between the commits of each client is also tracked, so that
+ * outputs can match their refresh rate to clients which present at a steady
+ * rate, like video players.
+ */
+namespace client_accounting
+{
+struct client_stats_t
+{
+    wl_client *client;
+    pid_t pid;
+    /* The commits in the last full second */
+    int commit_rate;
+    int64_t commits;
+    /* Commits whose damage was merged into the next repaint */
+    int64_t merged_commits;
+    /* Bytes in the socket, not yet read by the client, at the last check */
+    int queued_bytes;
+    int peak_queued_bytes;
+    bool rate_limited;
+    bool backlogged;
+    /* How many times the client became rate limited or backlogged */
+    int64_t times_limited;
+    /* The average interval between the commits with new contents */
+    int64_t commit_interval_us;
+    /* Whether the recent commits came at about the same interval */
+    bool steady_cadence;
+};
+
+/** reason is "commit-rate" or "queue" */
+struct client_limited_signal : public wf::signal_data_t
+{
+    client_stats_t stats;
+    std::string reason;
+};
+
+/**
+ * Count a commit of the client.
+ *
+ * @return Whether the client is rate limited, and the damage of the commit
+ *   should be merged into the next repaint.
+ */
+bool account_commit(wl_client *client);
+
+/** @return Whether the client is not reading its events fast enough. */
+bool is_backlogged(wl_client *client);
+
+/** @return The statistics of the clients which have committed or got input. */
+std::vector<client_stats_t> get_client_stats();
+
+/** @return The statistics of the client, or null if it hasn't committed yet. */
+const client_stats_t *find_client_stats(wl_client *client);
+}
+}
+
+#endif /* end of include guard: WF_CLIENT_ACCOUNTING_HPP */
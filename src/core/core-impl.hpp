@@ -3,13 +3,17 @@
 
 #include "wayfire/core.hpp"
 #include "wayfire/util.hpp"
+#include <wayfire/option-wrapper.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
 
+#include <list>
 #include <set>
 #include <unordered_map>
 
 class input_method_relay;
 struct wayfire_shell;
+struct wayfire_thumbnail;
+struct wf_kde_blur;
 struct wf_gtk_shell;
 
 namespace wf
@@ -46,7 +50,9 @@ class compositor_core_impl_t : public compositor_core_t
     void post_init();
 
     wayfire_shell *wf_shell;
+    wayfire_thumbnail *wf_thumbnail;
     wf_gtk_shell *gtk_shell;
+    wf_kde_blur *kde_blur;
 
     /**
      * Remove a view from the compositor list. This is called when the view's
@@ -82,10 +88,13 @@ class compositor_core_impl_t : public compositor_core_t
 
     void add_view(std::unique_ptr<wf::view_interface_t> view) override;
     std::vector<wayfire_view> get_all_views() override;
+    wayfire_view find_view(uint32_t id) override;
     void set_active_view(wayfire_view v) override;
     void focus_view(wayfire_view win) override;
     void move_view_to_output(wayfire_view v, wf::output_t *new_output,
         bool reconfigure) override;
+    void move_views_to_output(const std::vector<wayfire_view>& views,
+        wf::output_t *new_output, bool reconfigure) override;
 
     void focus_output(wf::output_t *o) override;
     wf::output_t *get_active_output() override;
@@ -107,8 +116,14 @@ class compositor_core_impl_t : public compositor_core_t
     wf::wl_listener_wrapper pointer_constraint_added;
     wf::wl_listener_wrapper idle_inhibitor_created;
 
+    /* Warn about signal handlers which are slower than this */
+    wf::option_wrapper_t<int> slow_signal_handler_ms;
+
     wf::output_t *active_output = nullptr;
-    std::vector<std::unique_ptr<wf::view_interface_t>> views;
+    /* All views in the order they were added, and an index by view id, so
+     * that views can be found and erased in constant time */
+    std::list<std::unique_ptr<wf::view_interface_t>> views;
+    std::unordered_map<uint32_t, decltype(views)::iterator> views_by_id;
 
     /* pairs (layer, request_id) */
     std::set<std::pair<uint32_t, int>> layer_focus_requests;
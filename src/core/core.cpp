@@ -1,19 +1,28 @@
-/* Needed for pipe2 */
+/* Needed for environ */
 #ifndef _GNU_SOURCE
     #define _GNU_SOURCE
 #endif
 
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <spawn.h>
+#include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <float.h>
+#include <cstring>
+#include <map>
+#include <algorithm>
 
 #include <wayfire/img.hpp>
 #include <wayfire/output.hpp>
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
+#include <wayfire/trace.hpp>
 #include <wayfire/output-layout.hpp>
 #include <wayfire/workspace-manager.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include <wayfire/view-transaction.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
 
 #include "seat/keyboard.hpp"
@@ -25,10 +34,13 @@
 #include "seat/cursor.hpp"
 #include "../view/view-impl.hpp"
 #include "../output/wayfire-shell.hpp"
+#include "../output/wayfire-thumbnail.hpp"
 #include "../output/output-impl.hpp"
 #include "../output/gtk-shell.hpp"
+#include "../output/kde-blur.hpp"
 
 #include "core-impl.hpp"
+#include "signal-accounting.hpp"
 
 /* decorations impl */
 struct wf_server_decoration_t
@@ -170,9 +182,75 @@ struct wlr_idle_inhibitor_t : public wf::idle_inhibitor_t
     }
 };
 
+/** Start or stop a trace recording, see wayfire/trace.hpp */
+/** Log the tracked GPU memory, grouped by owner. */
+static void log_gpu_memory()
+{
+    struct owner_total_t
+    {
+        size_t bytes   = 0;
+        int count      = 0;
+        uint32_t since = UINT32_MAX;
+    };
+
+    std::map<std::string, owner_total_t> owners;
+    for (auto& allocation : wf::gpu_memory::get_allocations())
+    {
+        auto& total = owners[allocation.owner];
+        total.bytes += allocation.bytes;
+        total.count++;
+        total.since = std::min(total.since, allocation.since);
+    }
+
+    uint32_t now = wf::get_current_time();
+    LOGI("GPU memory: ", wf::gpu_memory::get_total() / 1024, "KiB in total");
+    for (auto& [owner, total] : owners)
+    {
+        LOGI("GPU memory: ", owner, ": ", total.bytes / 1024, "KiB in ",
+            total.count, " allocations, oldest ", (now - total.since) / 1000, "s");
+    }
+}
+
+static int handle_trace_signal(int, void*)
+{
+    if (!wf::trace::is_recording())
+    {
+        LOGI("trace: recording started");
+        wf::signal_accounting::reset_totals();
+        wf::trace::start_recording();
+
+        return 0;
+    }
+
+    std::string path;
+    if (getenv("WAYFIRE_TRACE_FILE"))
+    {
+        path = getenv("WAYFIRE_TRACE_FILE");
+    } else
+    {
+        const char *dir = getenv("XDG_RUNTIME_DIR");
+        path = std::string(dir ? dir : "/tmp") + "/wayfire-trace-" +
+            std::to_string(getpid()) + ".json";
+    }
+
+    wf::trace::stop_recording(path);
+    wf::signal_accounting::log_totals();
+    log_gpu_memory();
+
+    return 0;
+}
+
 void wf::compositor_core_impl_t::init()
 {
     wlr_renderer_init_wl_display(renderer, display);
+    wl_event_loop_add_signal(ev_loop, SIGUSR2, handle_trace_signal, NULL);
+
+    slow_signal_handler_ms.load_option("core/slow_signal_handler_ms");
+    slow_signal_handler_ms.set_callback([=] ()
+    {
+        wf::signal_accounting::set_warning_threshold(slow_signal_handler_ms);
+    });
+    wf::signal_accounting::set_warning_threshold(slow_signal_handler_ms);
 
     /* Order here is important:
      * 1. init_desktop_apis() must come after wlr_compositor_create(),
@@ -304,6 +382,8 @@ void wf::compositor_core_impl_t::init()
 
     wf_shell  = wayfire_shell_create(display);
     gtk_shell = wf_gtk_shell_create(display);
+    wf_thumbnail = wayfire_thumbnail_create(display);
+    kde_blur     = wf_kde_blur_create(display);
 
     image_io::init();
     OpenGL::init();
@@ -515,7 +595,7 @@ void wf::compositor_core_impl_t::focus_output(wf::output_t *wo)
 
     if (wo)
     {
-        LOGD("focus output: ", wo->handle->name);
+        LOGC(OUTPUT, "focus output: ", wo->handle->name);
         /* Move to the middle of the output if this is the first output */
         wo->ensure_pointer((active_output == nullptr));
     }
@@ -594,7 +674,7 @@ int wf::compositor_core_impl_t::focus_layer(uint32_t layer, int32_t request_uid_
     auto request_uid = request_uid_hint < 0 ?
         ++last_request_uid : request_uid_hint;
     layer_focus_requests.insert({layer, request_uid});
-    LOGD("focusing layer ", get_focused_layer());
+    LOGC(VIEW, "focusing layer ", get_focused_layer());
 
     if (active_output)
     {
@@ -621,7 +701,7 @@ void wf::compositor_core_impl_t::unfocus_layer(int request)
         if (freq.second == request)
         {
             layer_focus_requests.erase(freq);
-            LOGD("focusing layer ", get_focused_layer());
+            LOGC(VIEW, "focusing layer ", get_focused_layer());
 
             active_output->refocus(nullptr);
 
@@ -635,6 +715,7 @@ void wf::compositor_core_impl_t::add_view(
 {
     auto v = view->self(); /* non-owning copy */
     views.push_back(std::move(view));
+    views_by_id[v->get_id()] = std::prev(views.end());
 
     assert(active_output);
     if (!v->get_output())
@@ -648,6 +729,7 @@ void wf::compositor_core_impl_t::add_view(
 std::vector<wayfire_view> wf::compositor_core_impl_t::get_all_views()
 {
     std::vector<wayfire_view> result;
+    result.reserve(views.size());
     for (auto& view : this->views)
     {
         result.push_back({view});
@@ -656,6 +738,13 @@ std::vector<wayfire_view> wf::compositor_core_impl_t::get_all_views()
     return result;
 }
 
+wayfire_view wf::compositor_core_impl_t::find_view(uint32_t id)
+{
+    auto it = views_by_id.find(id);
+
+    return (it == views_by_id.end()) ? nullptr : it->second->get()->self();
+}
+
 /* sets the "active" view and gives it keyboard focus
  *
  * It maintains two different classes of "active views"
@@ -742,67 +831,147 @@ void wf::compositor_core_impl_t::erase_view(wayfire_view v)
         v->set_output(nullptr);
     }
 
-    auto it = std::find_if(views.begin(), views.end(),
-        [&v] (const auto& view) { return view.get() == v.get(); });
+    auto it = views_by_id.find(v->get_id());
+    assert(it != views_by_id.end());
 
+    auto view_it = it->second;
+    views_by_id.erase(it);
     v->deinitialize();
-    views.erase(it);
+    views.erase(view_it);
 }
 
-pid_t wf::compositor_core_impl_t::run(std::string command)
+namespace
 {
-    static constexpr size_t READ_END  = 0;
-    static constexpr size_t WRITE_END = 1;
-    pid_t pid;
-    int pipe_fd[2];
-    pipe2(pipe_fd, O_CLOEXEC);
-
-    /* The following is a "hack" for disowning the child processes,
-     * otherwise they will simply stay as zombie processes */
-    pid = fork();
-    if (!pid)
+/**
+ * Reaps the processes started by run() when they exit, so that they do not
+ * stay as zombie processes, without blocking the event loop.
+ */
+class child_reaper_t
+{
+  public:
+    static void add(pid_t pid)
     {
-        pid = fork();
-        if (!pid)
+        reap_finished();
+
+        int fd = -1;
+#ifdef SYS_pidfd_open
+        fd = syscall(SYS_pidfd_open, pid, 0);
+#endif
+        if (fd < 0)
         {
-            close(pipe_fd[READ_END]);
-            close(pipe_fd[WRITE_END]);
+            /* pidfds are not supported, the child is reaped by a later run() */
+            unwatched.push_back(pid);
+
+            return;
+        }
+
+        auto child = new child_t{pid, fd, nullptr};
+        child->source = wl_event_loop_add_fd(wf::get_core().ev_loop, fd,
+            WL_EVENT_READABLE, handle_exit, child);
+    }
+
+  private:
+    struct child_t
+    {
+        pid_t pid;
+        int fd;
+        wl_event_source *source;
+    };
+
+    static inline std::vector<pid_t> unwatched;
+
+    static int handle_exit(int, uint32_t, void *data)
+    {
+        auto child = static_cast<child_t*>(data);
+        waitpid(child->pid, NULL, WNOHANG);
+        wl_event_source_remove(child->source);
+        close(child->fd);
+        delete child;
 
-            setenv("_JAVA_AWT_WM_NONREPARENTING", "1", 1);
-            setenv("WAYLAND_DISPLAY", wayland_display.c_str(), 1);
+        return 0;
+    }
+
+    static void reap_finished()
+    {
+        unwatched.erase(std::remove_if(unwatched.begin(), unwatched.end(),
+            [] (pid_t pid) { return waitpid(pid, NULL, WNOHANG) != 0; }),
+            unwatched.end());
+    }
+};
+}
+
+pid_t wf::compositor_core_impl_t::run(std::string command)
+{
+    std::map<std::string, std::string> overrides;
+    overrides["_JAVA_AWT_WM_NONREPARENTING"] = "1";
+    overrides["WAYLAND_DISPLAY"] = wayland_display;
 #if WF_HAS_XWAYLAND
-            if (!xwayland_get_display().empty())
-            {
-                setenv("DISPLAY", xwayland_get_display().c_str(), 1);
-            }
+    if (!xwayland_get_display().empty())
+    {
+        overrides["DISPLAY"] = xwayland_get_display();
+    }
 
 #endif
-            int dev_null = open("/dev/null", O_WRONLY);
-            dup2(dev_null, 1);
-            dup2(dev_null, 2);
 
-            _exit(execl("/bin/sh", "/bin/sh", "-c", command.c_str(), NULL));
-        } else
+    std::vector<std::string> env;
+    for (char **var = environ; *var; var++)
+    {
+        std::string entry = *var;
+        if (!overrides.count(entry.substr(0, entry.find('='))))
         {
-            close(pipe_fd[READ_END]);
-            write(pipe_fd[WRITE_END], (void*)(&pid), sizeof(pid));
-            close(pipe_fd[WRITE_END]);
-            _exit(0);
+            env.push_back(entry);
         }
-    } else
+    }
+
+    for (auto& [name, value] : overrides)
+    {
+        env.push_back(name + "=" + value);
+    }
+
+    std::vector<char*> envp;
+    for (auto& entry : env)
     {
-        close(pipe_fd[WRITE_END]);
+        envp.push_back(entry.data());
+    }
 
-        int status;
-        waitpid(pid, &status, 0);
+    envp.push_back(NULL);
+
+    /* posix_spawn() does not copy the address space of the compositor, unlike
+     * fork(), and it returns as soon as the child has been started */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+        POSIX_SPAWN_SETSIGDEF);
+
+    char *argv[] = {
+        (char*)"/bin/sh", (char*)"-c", command.data(), NULL
+    };
 
-        pid_t child_pid;
-        read(pipe_fd[READ_END], &child_pid, sizeof(child_pid));
+    pid_t pid;
+    int error = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, envp.data());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
 
-        close(pipe_fd[READ_END]);
+    if (error)
+    {
+        LOGE("Failed to run \"", command, "\": ", strerror(error));
 
-        return child_pid;
+        return -1;
     }
+
+    child_reaper_t::add(pid);
+
+    return pid;
 }
 
 std::string wf::compositor_core_impl_t::get_xwayland_display()
@@ -813,56 +982,101 @@ std::string wf::compositor_core_impl_t::get_xwayland_display()
 void wf::compositor_core_impl_t::move_view_to_output(wayfire_view v,
     wf::output_t *new_output, bool reconfigure)
 {
-    auto old_output = v->get_output();
-    wf::view_pre_moved_to_output_signal data;
-    data.view = v;
-    data.old_output = old_output;
-    data.new_output = new_output;
-    this->emit_signal("view-pre-moved-to-output", &data);
+    move_views_to_output({v}, new_output, reconfigure);
+}
 
+namespace
+{
+/* The state of a view which is adjusted to the new output after the move */
+struct moved_view_state_t
+{
     uint32_t edges;
     bool fullscreen;
-    wf::geometry_t view_g;
-    wf::geometry_t old_output_g;
-    wf::geometry_t new_output_g;
+    wf::geometry_t geometry;
+};
 
-    if (reconfigure)
+moved_view_state_t scale_to_output(wayfire_view v, wf::output_t *new_output)
+{
+    moved_view_state_t state;
+    state.edges      = v->tiled_edges;
+    state.fullscreen = v->fullscreen;
+    state.geometry   = v->get_wm_geometry();
+
+    auto old_output_g = v->get_output()->get_relative_geometry();
+    auto new_output_g = new_output->get_relative_geometry();
+    auto ratio_x = (double)new_output_g.width / old_output_g.width;
+    auto ratio_y = (double)new_output_g.height / old_output_g.height;
+    state.geometry.x     *= ratio_x;
+    state.geometry.y     *= ratio_y;
+    state.geometry.width *= ratio_x;
+    state.geometry.height *= ratio_y;
+
+    return state;
+}
+}
+
+void wf::compositor_core_impl_t::move_views_to_output(
+    const std::vector<wayfire_view>& views, wf::output_t *new_output,
+    bool reconfigure)
+{
+    assert(new_output);
+    if (views.empty())
     {
-        edges = v->tiled_edges;
-        fullscreen = v->fullscreen;
-        view_g     = v->get_wm_geometry();
-        old_output_g = old_output->get_relative_geometry();
-        new_output_g = new_output->get_relative_geometry();
-        auto ratio_x = (double)new_output_g.width / old_output_g.width;
-        auto ratio_y = (double)new_output_g.height / old_output_g.height;
-        view_g.x     *= ratio_x;
-        view_g.y     *= ratio_y;
-        view_g.width *= ratio_x;
-        view_g.height *= ratio_y;
+        return;
     }
 
-    assert(new_output);
-    v->set_output(new_output);
-    new_output->workspace->add_view(v,
-        v->minimized ? wf::LAYER_MINIMIZED : wf::LAYER_WORKSPACE);
-    new_output->focus_view(v);
+    wf::views_pre_moved_to_output_signal batch;
+    batch.views = views;
+    batch.new_output = new_output;
+    this->emit_signal("views-pre-moved-to-output", &batch);
 
-    if (reconfigure)
+    /* All views appear with their new geometry together */
+    wf::view_transaction_t tx;
+    for (auto& v : views)
     {
-        if (fullscreen)
+        wf::view_pre_moved_to_output_signal data;
+        data.view = v;
+        data.old_output = v->get_output();
+        data.new_output = new_output;
+        this->emit_signal("view-pre-moved-to-output", &data);
+
+        moved_view_state_t state;
+        if (reconfigure)
         {
-            v->fullscreen_request(new_output, true);
-        } else if (edges)
+            state = scale_to_output(v, new_output);
+        }
+
+        v->set_output(new_output);
+        new_output->workspace->add_view(v,
+            v->minimized ? wf::LAYER_MINIMIZED : wf::LAYER_WORKSPACE);
+
+        /* Each view is added on top of the previous ones, so focusing only
+         * the last one results in the same stacking order */
+        if (v == views.back())
         {
-            v->tile_request(edges);
-        } else
+            new_output->focus_view(v);
+        }
+
+        if (reconfigure)
         {
-            auto new_g = wf::clamp(view_g, new_output->workspace->get_workarea());
-            v->set_geometry(new_g);
+            if (state.fullscreen)
+            {
+                v->fullscreen_request(new_output, true);
+            } else if (state.edges)
+            {
+                v->tile_request(state.edges);
+            } else
+            {
+                auto new_g = wf::clamp(state.geometry,
+                    new_output->workspace->get_workarea());
+                v->set_geometry(new_g);
+            }
         }
+
+        this->emit_signal("view-moved-to-output", &data);
     }
 
-    this->emit_signal("view-moved-to-output", &data);
+    this->emit_signal("views-moved-to-output", &batch);
 }
 
 wf::compositor_core_t::compositor_core_t()
@@ -876,6 +1090,7 @@ wf::compositor_core_impl_t::~compositor_core_impl_t()
 {
     /* Unloading order is important. First we want to free any remaining views,
      * then we destroy the input manager, and finally the rest is auto-freed */
+    views_by_id.clear();
     views.clear();
     input.reset();
     output_layout.reset();
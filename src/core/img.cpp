@@ -1,6 +1,8 @@
 #include <wayfire/util/log.hpp>
 #include "wayfire/img.hpp"
 #include "wayfire/opengl.hpp"
+#include "wayfire/core.hpp"
+#include "wayfire/option-wrapper.hpp"
 
 #include <config.h>
 
@@ -10,24 +12,328 @@
     #include <jerror.h>
 #endif
 
+#include <GLES2/gl2ext.h>
+#include <wayland-server-core.h>
+
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <unordered_map>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <cstring>
 
 #define TEXTURE_LOAD_ERROR 0
 
 namespace image_io
 {
-using Loader = std::function<bool (const char*, GLuint)>;
+/**
+ * Where a decoder writes the rows of a regular image. Called once the size and
+ * the channels of the image are known, returns memory for its tightly packed
+ * rows, or nullptr to decode into image_t::pixels.
+ */
+using pixel_sink_t = std::function<uint8_t*(const image_t& image)>;
+using Decoder = std::function<std::unique_ptr<image_t> (const char*,
+    const pixel_sink_t&)>;
 using Writer = std::function<void (const char*name, uint8_t*pixels, unsigned long,
     unsigned long)>;
 namespace
 {
-std::unordered_map<std::string, Loader> loaders;
+/** A decoder, and the bytes which the files it can decode start with */
+struct decoder_info_t
+{
+    std::vector<uint8_t> magic;
+    Decoder decode;
+};
+
+std::vector<decoder_info_t> decoders;
 std::unordered_map<std::string, Writer> writers;
+
+/** @return The memory to decode the pixels of the image into. */
+uint8_t *get_pixel_destination(image_t& image, const pixel_sink_t& sink)
+{
+    uint8_t *destination = sink ? sink(image) : nullptr;
+    if (!destination)
+    {
+        image.pixels.resize(size_t(image.width) * image.height * image.channels);
+        destination = image.pixels.data();
+    }
+
+    return destination;
+}
+
+/** @return The size of the decoded image in memory. */
+size_t get_image_size(const image_t& image)
+{
+    size_t size = image.pixels.size();
+    for (auto& level : image.levels)
+    {
+        size += level.size();
+    }
+
+    return size;
+}
+
+/**
+ * A small cache of decoded images, keyed by path and modification time, so
+ * that for ex. the backgrounds of the cube on each output are decoded only
+ * once. The least recently used images are dropped when the cache exceeds its
+ * budget. Can be used from any thread.
+ */
+class image_cache_t
+{
+  public:
+    /** @return The cached image of the given file, if it hasn't changed. */
+    std::shared_ptr<const image_t> find(const std::string& path,
+        const struct stat& st)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->path != path)
+            {
+                continue;
+            }
+
+            if (!is_same_file(*it, st))
+            {
+                used -= it->bytes;
+                entries.erase(it);
+
+                return nullptr;
+            }
+
+            entries.splice(entries.begin(), entries, it);
+
+            return it->image;
+        }
+
+        return nullptr;
+    }
+
+    void insert(const std::string& path, const struct stat& st,
+        std::shared_ptr<const image_t> image)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->path == path)
+            {
+                used -= it->bytes;
+                entries.erase(it);
+                break;
+            }
+        }
+
+        size_t bytes = get_image_size(*image);
+        if (bytes > budget)
+        {
+            return;
+        }
+
+        entries.push_front({path, st.st_mtim, st.st_size, std::move(image),
+            bytes});
+        used += bytes;
+        trim();
+    }
+
+    /** Set the maximal size of the cached images, in bytes. */
+    void set_budget(size_t bytes)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        budget = bytes;
+        trim();
+    }
+
+  private:
+    struct entry_t
+    {
+        std::string path;
+        struct timespec mtime;
+        off_t size;
+        std::shared_ptr<const image_t> image;
+        size_t bytes;
+    };
+
+    static bool is_same_file(const entry_t& entry, const struct stat& st)
+    {
+        return (entry.mtime.tv_sec == st.st_mtim.tv_sec) &&
+               (entry.mtime.tv_nsec == st.st_mtim.tv_nsec) &&
+               (entry.size == st.st_size);
+    }
+
+    void trim()
+    {
+        while (used > budget)
+        {
+            used -= entries.back().bytes;
+            entries.pop_back();
+        }
+    }
+
+    /* Most recently used first */
+    std::list<entry_t> entries;
+    size_t used   = 0;
+    size_t budget = 0;
+    std::mutex mutex;
+};
+
+image_cache_t image_cache;
+
+/**
+ * Update the budget of the cache from the config, on the compositor thread.
+ * Called at startup and whenever images are loaded from the compositor thread.
+ */
+void update_cache_budget()
+{
+    static wf::option_wrapper_t<int> cache_size{"core/image_cache_size"};
+    image_cache.set_budget(size_t(std::max(0, (int)cache_size)) << 20);
+}
+
+/**
+ * Runs callbacks from background threads on the compositor thread. The event
+ * loop is woken up through a pipe.
+ */
+class main_thread_queue_t
+{
+  public:
+    /** Must be called on the compositor thread before the first push() */
+    void ensure_started()
+    {
+        if (fds[0] >= 0)
+        {
+            return;
+        }
+
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0)
+        {
+            LOGE("image_io: failed to create a pipe: ", strerror(errno));
+            fds[0] = fds[1] = -1;
+
+            return;
+        }
+
+        wl_event_loop_add_fd(wf::get_core().ev_loop, fds[0], WL_EVENT_READABLE,
+            handle_readable, this);
+    }
+
+    /** Run the callback on the compositor thread. Can be called from any thread. */
+    void push(std::function<void()> callback)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        callbacks.push_back(std::move(callback));
+
+        char byte = 0;
+        if (write(fds[1], &byte, 1) < 0)
+        {
+            /* The pipe is full, so the compositor will wake up anyway */
+        }
+    }
+
+  private:
+    static int handle_readable(int fd, uint32_t, void *data)
+    {
+        char buffer[64];
+        while (read(fd, buffer, sizeof(buffer)) > 0)
+        {}
+
+        auto self = static_cast<main_thread_queue_t*>(data);
+        std::deque<std::function<void()>> ready;
+        {
+            std::unique_lock<std::mutex> lock(self->mutex);
+            ready.swap(self->callbacks);
+        }
+
+        for (auto& callback : ready)
+        {
+            callback();
+        }
+
+        return 0;
+    }
+
+    int fds[2] = {-1, -1};
+    std::mutex mutex;
+    std::deque<std::function<void()>> callbacks;
+};
+
+/**
+ * A background thread which runs jobs in order.
+ * Pending jobs are finished when the worker is destroyed at exit.
+ */
+class background_worker_t
+{
+  public:
+    void push(std::function<void()> job)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!thread.joinable())
+        {
+            thread = std::thread([=] () { run(); });
+        }
+
+        jobs.push_back(std::move(job));
+        cond.notify_one();
+    }
+
+    ~background_worker_t()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            quit = true;
+            cond.notify_one();
+        }
+
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            cond.wait(lock, [=] () { return quit || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::function<void()>> jobs;
+    std::thread thread;
+    bool quit = false;
+};
+
+/* The queue is declared first, so that it outlives the workers at exit */
+main_thread_queue_t main_queue;
+background_worker_t write_worker;
+background_worker_t decode_worker;
 }
 
 bool load_data_as_cubemap(unsigned char *data, int width, int height, int channels)
@@ -120,37 +426,51 @@ bool load_data_as_cubemap(unsigned char *data, int width, int height, int channe
 #ifdef BUILD_WITH_IMAGEIO
 /* All backend functions are taken from the internet.
  * If you want to be credited, contact me */
-bool texture_from_png(const char *filename, GLuint target)
+std::unique_ptr<image_t> decode_png(const char *filename,
+    const pixel_sink_t& sink)
 {
     FILE *fp = fopen(filename, "rb");
-    int width, height;
+    if (!fp)
+    {
+        return nullptr;
+    }
+
     png_byte color_type;
     png_byte bit_depth;
-    png_bytep *row_pointers;
+
+    /* Declared before setjmp(), so that nothing is skipped when libpng jumps
+     * back on errors */
+    auto image = std::make_unique<image_t>();
+    std::vector<png_bytep> row_pointers;
 
     png_structp png =
         png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png)
     {
-        return false;
+        fclose(fp);
+        return nullptr;
     }
 
     png_infop infos = png_create_info_struct(png);
     if (!infos)
     {
-        return false;
+        png_destroy_read_struct(&png, NULL, NULL);
+        fclose(fp);
+        return nullptr;
     }
 
     if (setjmp(png_jmpbuf(png)))
     {
-        return false;
+        png_destroy_read_struct(&png, &infos, NULL);
+        fclose(fp);
+        return nullptr;
     }
 
     png_init_io(png, fp);
     png_read_info(png, infos);
 
-    width  = png_get_image_width(png, infos);
-    height = png_get_image_height(png, infos);
+    image->width  = png_get_image_width(png, infos);
+    image->height = png_get_image_height(png, infos);
     color_type = png_get_color_type(png, infos);
     bit_depth  = png_get_bit_depth(png, infos);
 
@@ -191,40 +511,21 @@ bool texture_from_png(const char *filename, GLuint target)
 
     png_read_update_info(png, infos);
 
-    row_pointers = new png_bytep[height];
-    png_byte *data = new png_byte[height * png_get_rowbytes(png, infos)];
-
-    for (int i = 0; i < height; i++)
+    size_t row_bytes = png_get_rowbytes(png, infos);
+    image->channels = png_get_channels(png, infos);
+    uint8_t *destination = get_pixel_destination(*image, sink);
+    row_pointers.resize(image->height);
+    for (int i = 0; i < image->height; i++)
     {
-        row_pointers[i] = data + i * png_get_rowbytes(png, infos);
+        row_pointers[i] = destination + i * row_bytes;
     }
 
-    png_read_image(png, row_pointers);
-
-    if (target == GL_TEXTURE_CUBE_MAP)
-    {
-        if (!load_data_as_cubemap(data, width, height,
-            png_get_channels(png, infos)))
-        {
-            png_destroy_read_struct(&png, &infos, NULL);
-            delete[] row_pointers;
-            delete[] data;
-            fclose(fp);
-            return false;
-        }
-    } else if (target == GL_TEXTURE_2D)
-    {
-        GL_CALL(glTexImage2D(target, 0, GL_RGBA, width, height, 0,
-            GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)data));
-    }
+    png_read_image(png, row_pointers.data());
 
     png_destroy_read_struct(&png, &infos, NULL);
-    delete[] row_pointers;
-    delete[] data;
-
     fclose(fp);
 
-    return true;
+    return image;
 }
 
 void texture_to_png(const char *name, uint8_t *pixels, int w, int h)
@@ -273,115 +574,509 @@ void texture_to_png(const char *name, uint8_t *pixels, int w, int h)
     png_bytepp rows = (png_bytepp)png_malloc(png, h * sizeof(png_bytep));
     for (int i = 0; i < h; ++i)
     {
-        rows[i] = (png_bytep)(pixels + (h - i) * w * 4);
+        rows[i] = (png_bytep)(pixels + (h - i - 1) * w * 4);
     }
 
     png_write_image(png, rows);
     png_write_end(png, infot);
     png_free(png, palette);
+    png_free(png, rows);
     png_destroy_write_struct(&png, &infot);
 
     fclose(fp);
-    delete[] rows;
 }
 
-bool texture_from_jpeg(const char *FileName, GLuint target)
+std::unique_ptr<image_t> decode_jpeg(const char *FileName,
+    const pixel_sink_t& sink)
 {
-    unsigned long data_size;
     unsigned char *rowptr[1];
-    unsigned char *jdata;
     struct jpeg_decompress_struct infot;
     struct jpeg_error_mgr err;
 
     std::FILE *file = fopen(FileName, "rb");
-    infot.err = jpeg_std_error(&err);
-    jpeg_create_decompress(&infot);
-
     if (!file)
     {
         LOGE("failed to read JPEG file ", FileName);
 
-        return false;
+        return nullptr;
     }
 
+    infot.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&infot);
+
     jpeg_stdio_src(&infot, file);
     jpeg_read_header(&infot, TRUE);
+    /* The pixels are uploaded as rgb */
+    infot.out_color_space = JCS_RGB;
     jpeg_start_decompress(&infot);
 
-    data_size = infot.output_width * infot.output_height * 3;
-
-    jdata = new unsigned char [data_size];
+    auto image = std::make_unique<image_t>();
+    image->width    = infot.output_width;
+    image->height   = infot.output_height;
+    image->channels = 3;
+    uint8_t *destination = get_pixel_destination(*image, sink);
     while (infot.output_scanline < infot.output_height)
     {
-        rowptr[0] = (unsigned char*)jdata + 3 * infot.output_width *
+        rowptr[0] = destination + size_t(3) * infot.output_width *
             infot.output_scanline;
         jpeg_read_scanlines(&infot, rowptr, 1);
     }
 
     jpeg_finish_decompress(&infot);
+    jpeg_destroy_decompress(&infot);
+    fclose(file);
 
-    GLint width  = infot.output_width;
-    GLint height = infot.output_height;
+    return image;
+}
 
-    if (target == GL_TEXTURE_CUBE_MAP)
+#endif
+
+namespace
+{
+/* Read a little-endian integer from the given position */
+template<class T>
+T read_le(const std::vector<uint8_t>& data, size_t offset)
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+        value |= T(data[offset + i]) << (8 * i);
+    }
+
+    return value;
+}
+
+/**
+ * @return The GL format for the given Vulkan format of a KTX2 file, or 0 if
+ *   the format isn't supported.
+ */
+GLenum gl_format_from_vk_format(uint32_t vk_format)
+{
+    switch (vk_format)
+    {
+      case 147: /* VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK */
+        return GL_COMPRESSED_RGB8_ETC2;
+
+      case 148: /* VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK */
+        return GL_COMPRESSED_SRGB8_ETC2;
+
+      case 149: /* VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK */
+        return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+
+      case 150: /* VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK */
+        return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+
+      case 151: /* VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK */
+        return GL_COMPRESSED_RGBA8_ETC2_EAC;
+
+      case 152: /* VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK */
+        return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+    }
+
+    /* VK_FORMAT_ASTC_4x4_UNORM_BLOCK up to VK_FORMAT_ASTC_12x12_SRGB_BLOCK
+     * alternate between UNORM and SRGB, in the same order of block sizes as
+     * the GL formats */
+    if ((vk_format >= 157) && (vk_format <= 184))
+    {
+        uint32_t block = (vk_format - 157) / 2;
+        bool srgb = (vk_format - 157) % 2;
+
+        return (srgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR :
+            GL_COMPRESSED_RGBA_ASTC_4x4_KHR) + block;
+    }
+
+    return 0;
+}
+
+bool is_astc_format(GLenum format)
+{
+    return ((format >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR) &&
+        (format <= GL_COMPRESSED_RGBA_ASTC_12x12_KHR)) ||
+           ((format >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR) &&
+        (format <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR));
+}
+
+/**
+ * @return Whether the GL context supports the given compressed format. ETC2
+ *   is part of GLES 3.0, ASTC needs an extension.
+ */
+bool is_compressed_format_supported(GLenum format)
+{
+    if (!is_astc_format(format))
+    {
+        return true;
+    }
+
+    auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+
+    return extensions &&
+           strstr(extensions, "GL_KHR_texture_compression_astc_ldr");
+}
+}
+
+static const std::vector<uint8_t> png_signature = {
+    0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+};
+static const std::vector<uint8_t> jpeg_signature = {0xFF, 0xD8, 0xFF};
+static const std::vector<uint8_t> ktx2_identifier = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+/**
+ * Decode a KTX2 file without supercompression, containing a 2D texture or a
+ * cubemap in one of the ETC2 or ASTC formats. The compressed data is always
+ * kept in memory.
+ */
+std::unique_ptr<image_t> decode_ktx2(const char *filename, const pixel_sink_t&)
+{
+    static constexpr size_t HEADER_SIZE = 80;
+    static constexpr size_t LEVEL_INDEX_ENTRY_SIZE = 24;
+
+    std::ifstream file{filename, std::ios::binary};
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+        std::istreambuf_iterator<char>()};
+    if ((data.size() < HEADER_SIZE) ||
+        memcmp(data.data(), ktx2_identifier.data(), ktx2_identifier.size()))
     {
-        if (!load_data_as_cubemap(jdata, width, height, 3))
+        LOGE("not a KTX2 file: ", filename);
+
+        return nullptr;
+    }
+
+    auto image = std::make_unique<image_t>();
+    uint32_t vk_format = read_le<uint32_t>(data, 12);
+    image->width  = read_le<uint32_t>(data, 20);
+    image->height = read_le<uint32_t>(data, 24);
+    uint32_t depth  = read_le<uint32_t>(data, 28);
+    uint32_t layers = read_le<uint32_t>(data, 32);
+    image->faces = read_le<uint32_t>(data, 36);
+    uint32_t level_count = std::max(1u, read_le<uint32_t>(data, 40));
+    uint32_t supercompression = read_le<uint32_t>(data, 44);
+
+    image->compressed_format = gl_format_from_vk_format(vk_format);
+    if (!image->compressed_format)
+    {
+        LOGE("KTX2 file ", filename, " has unsupported format ", vk_format);
+
+        return nullptr;
+    }
+
+    if ((depth > 0) || (layers > 1) || supercompression ||
+        ((image->faces != 1) && (image->faces != 6)))
+    {
+        LOGE("KTX2 file ", filename, " is not a plain 2D texture or cubemap");
+
+        return nullptr;
+    }
+
+    if (data.size() < HEADER_SIZE + level_count * LEVEL_INDEX_ENTRY_SIZE)
+    {
+        LOGE("KTX2 file ", filename, " is truncated");
+
+        return nullptr;
+    }
+
+    for (uint32_t level = 0; level < level_count; level++)
+    {
+        size_t entry  = HEADER_SIZE + level * LEVEL_INDEX_ENTRY_SIZE;
+        size_t offset = read_le<uint64_t>(data, entry);
+        size_t length = read_le<uint64_t>(data, entry + 8);
+        if ((offset > data.size()) || (length > data.size() - offset) ||
+            (length % image->faces))
+        {
+            LOGE("KTX2 file ", filename, " has an invalid level ", level);
+
+            return nullptr;
+        }
+
+        size_t face_length = length / image->faces;
+        for (int face = 0; face < image->faces; face++)
+        {
+            auto start = data.begin() + offset + face * face_length;
+            image->levels.emplace_back(start, start + face_length);
+        }
+    }
+
+    return image;
+}
+
+/**
+ * Find the decoder for the given file by its first bytes.
+ *
+ * @param st Set to the status of the file.
+ */
+static const decoder_info_t *find_decoder(const std::string& name,
+    struct stat& st)
+{
+    FILE *file = name.empty() ? nullptr : fopen(name.c_str(), "rb");
+    if (!file || (fstat(fileno(file), &st) < 0))
+    {
+        if (!name.empty())
+        {
+            LOGE(__func__, "() cannot access ", name);
+        }
+
+        if (file)
         {
             fclose(file);
-            delete[] jdata;
+        }
+
+        return nullptr;
+    }
+
+    uint8_t header[16];
+    size_t length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+
+    for (auto& decoder : decoders)
+    {
+        if ((decoder.magic.size() <= length) &&
+            !memcmp(header, decoder.magic.data(), decoder.magic.size()))
+        {
+            return &decoder;
+        }
+    }
+
+    LOGE(__func__, "() called with a file of unsupported format: ", name);
+
+    return nullptr;
+}
+
+std::shared_ptr<const image_t> decode_file(const std::string& name)
+{
+    struct stat st;
+    auto decoder = find_decoder(name, st);
+    if (!decoder)
+    {
+        return nullptr;
+    }
+
+    if (auto cached = image_cache.find(name, st))
+    {
+        return cached;
+    }
+
+    std::shared_ptr<const image_t> image = decoder->decode(name.c_str(), nullptr);
+    if (image)
+    {
+        image_cache.insert(name, st, image);
+    }
+
+    return image;
+}
+
+static bool upload_compressed_image(const image_t& image, GLuint target)
+{
+    int faces = (target == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+    if ((image.faces != faces) || image.levels.empty())
+    {
+        LOGE("compressed texture has ", image.faces, " faces, expected ", faces);
+
+        return false;
+    }
+
+    if (!is_compressed_format_supported(image.compressed_format))
+    {
+        LOGE("compressed texture format ", image.compressed_format,
+            " is not supported by the GPU");
+
+        return false;
+    }
+
+    int level_count = image.levels.size() / faces;
+    for (int level = 0; level < level_count; level++)
+    {
+        int width  = std::max(1, image.width >> level);
+        int height = std::max(1, image.height >> level);
+        for (int face = 0; face < faces; face++)
+        {
+            GLenum face_target = (faces == 6) ?
+                GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+            auto& level_data = image.levels[level * faces + face];
+            GL_CALL(glCompressedTexImage2D(face_target, level,
+                image.compressed_format, width, height, 0, level_data.size(),
+                level_data.data()));
+        }
+    }
+
+    /* Compressed mipmaps can't be generated, so make the texture complete
+     * with the levels it has */
+    GL_CALL(glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, level_count - 1));
+
+    return true;
+}
+
+/**
+ * Upload the pixels of a regular image. They are read from the bound pixel
+ * unpack buffer if pixels is an offset into it.
+ */
+static bool upload_pixels(const image_t& image, const uint8_t *pixels,
+    GLuint target)
+{
+    if (target == GL_TEXTURE_CUBE_MAP)
+    {
+        if (!load_data_as_cubemap((unsigned char*)pixels,
+            image.width, image.height, image.channels))
+        {
             return false;
         }
     } else if (target == GL_TEXTURE_2D)
     {
-        GL_CALL(glTexImage2D(target, 0, GL_RGBA, width, height, 0,
-            GL_RGBA, GL_UNSIGNED_BYTE, jdata));
+        auto format = (image.channels == 4 ? GL_RGBA : GL_RGB);
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        GL_CALL(glTexImage2D(target, 0, format, image.width, image.height, 0,
+            format, GL_UNSIGNED_BYTE, pixels));
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    } else
+    {
+        return false;
     }
 
-    fclose(file);
-    delete[] jdata;
+    GL_CALL(glGenerateMipmap(target));
 
     return true;
 }
 
-#endif
+bool upload_image(const image_t& image, GLuint target)
+{
+    if (image.compressed_format)
+    {
+        return upload_compressed_image(image, target);
+    }
 
-bool load_from_file(std::string name, GLuint target)
+    return upload_pixels(image, image.pixels.data(), target);
+}
+
+/**
+ * A pixel unpack buffer which a decoder writes the image into, so that the
+ * pixels are not copied once more when uploading.
+ */
+class upload_buffer_t : public noncopyable_t
 {
-    if (access(name.c_str(), F_OK) == -1)
+  public:
+    ~upload_buffer_t()
     {
-        if (!name.empty())
+        if (mapped)
         {
-            LOGE(__func__, "() cannot access ", name);
+            GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
         }
 
-        return false;
+        if (pbo)
+        {
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            GL_CALL(glDeleteBuffers(1, &pbo));
+        }
     }
 
-    int len = name.length();
-    if ((len < 4) || (name[len - 4] != '.'))
+    /** @return Memory for the pixels of the image, or nullptr on errors. */
+    uint8_t *map(const image_t& image)
     {
-        LOGE(
-            "load_from_file() called with file without extension or with invalid extension!");
+        size_t size = size_t(image.width) * image.height * image.channels;
+        GL_CALL(glGenBuffers(1, &pbo));
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo));
+        GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+        mapped = (uint8_t*)GL_CALL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+            size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!mapped)
+        {
+            /* Decode into memory instead, which is uploaded without a buffer */
+            GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+            GL_CALL(glDeleteBuffers(1, &pbo));
+            pbo = 0;
+        }
 
-        return false;
+        return mapped;
     }
 
-    auto ext = name.substr(len - 3, 3);
-    for (int i = 0; i < 3; i++)
+    /**
+     * Finish writing to the buffer.
+     *
+     * @return Whether the pixels written to the buffer are intact.
+     */
+    bool unmap()
     {
-        ext[i] = std::tolower(ext[i]);
+        bool intact = GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+        mapped = nullptr;
+
+        return intact;
     }
 
-    auto it = loaders.find(ext);
-    if (it == loaders.end())
+    bool is_mapped() const
     {
-        LOGE("load_from_file() called with unsupported extension ", ext);
+        return mapped;
+    }
+
+  private:
+    GLuint pbo = 0;
+    uint8_t *mapped = nullptr;
+};
 
+bool load_from_file(std::string name, GLuint target)
+{
+    update_cache_budget();
+
+    struct stat st;
+    auto decoder = find_decoder(name, st);
+    if (!decoder)
+    {
         return false;
-    } else
+    }
+
+    if (auto cached = image_cache.find(name, st))
+    {
+        return upload_image(*cached, target);
+    }
+
+    /* Not cached, so nothing else needs the pixels in memory. Decode them
+     * straight into a pixel buffer instead. */
+    upload_buffer_t buffer;
+    auto image = decoder->decode(name.c_str(), [&] (const image_t& header)
+    {
+        return buffer.map(header);
+    });
+
+    if (!buffer.is_mapped())
     {
-        return it->second(name.c_str(), target);
+        return image && upload_image(*image, target);
     }
+
+    return buffer.unmap() && image && upload_pixels(*image, nullptr, target);
+}
+
+void async_image_loader_t::load(std::string name, callback_t callback)
+{
+    main_queue.ensure_started();
+    update_cache_budget();
+
+    pending = std::make_shared<request_t>();
+    pending->callback = std::move(callback);
+
+    std::weak_ptr<request_t> request = pending;
+    decode_worker.push([=] ()
+    {
+        auto image = decode_file(name);
+        main_queue.push([=] ()
+        {
+            auto current = request.lock();
+            if (current && current->callback)
+            {
+                /* The callback may start a new load or destroy the loader */
+                auto callback = std::move(current->callback);
+                current->callback = nullptr;
+                callback(image.get());
+            }
+        });
+    });
+}
+
+void async_image_loader_t::cancel()
+{
+    pending.reset();
+}
+
+bool async_image_loader_t::is_loading() const
+{
+    return pending && pending->callback;
 }
 
 void write_to_file(std::string name, uint8_t *pixels, int w, int h, std::string type)
@@ -397,13 +1092,118 @@ void write_to_file(std::string name, uint8_t *pixels, int w, int h, std::string
     }
 }
 
+void write_to_file_async(std::string name, std::vector<uint8_t> pixels,
+    int w, int h, std::string type)
+{
+    auto it = writers.find(type);
+    if (it == writers.end())
+    {
+        LOGE("unsupported image_writer backend");
+        return;
+    }
+
+    auto writer = it->second;
+    auto data   = std::make_shared<std::vector<uint8_t>>(std::move(pixels));
+    write_worker.push([=] ()
+    {
+        writer(name.c_str(), data->data(), w, h);
+    });
+}
+
+async_readback_t::~async_readback_t()
+{
+    if (fence)
+    {
+        GL_CALL(glDeleteSync(fence));
+    }
+
+    if (pbo)
+    {
+        GL_CALL(glDeleteBuffers(1, &pbo));
+    }
+}
+
+void async_readback_t::start(int x, int y, int width, int height)
+{
+    if (fence)
+    {
+        GL_CALL(glDeleteSync(fence));
+    }
+
+    if (!pbo)
+    {
+        GL_CALL(glGenBuffers(1, &pbo));
+    }
+
+    this->width  = width;
+    this->height = height;
+
+    GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo));
+    GL_CALL(glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL,
+        GL_STREAM_READ));
+    /* With a bound pack buffer, glReadPixels only schedules the copy */
+    GL_CALL(glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0));
+    GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    fence = GL_CALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    GL_CALL(glFlush());
+}
+
+bool async_readback_t::is_ready()
+{
+    if (!fence)
+    {
+        return false;
+    }
+
+    GLint status = GL_UNSIGNALED;
+    GL_CALL(glGetSynciv(fence, GL_SYNC_STATUS, sizeof(status), NULL, &status));
+
+    return status == GL_SIGNALED;
+}
+
+std::vector<uint8_t> async_readback_t::get_pixels()
+{
+    if (!fence)
+    {
+        return {};
+    }
+
+    GL_CALL(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+        GL_TIMEOUT_IGNORED));
+    GL_CALL(glDeleteSync(fence));
+    fence = 0;
+
+    size_t size = width * height * 4;
+    std::vector<uint8_t> pixels(size);
+
+    GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo));
+    void *mapped = GL_CALL(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+        GL_MAP_READ_BIT));
+    if (mapped)
+    {
+        std::memcpy(pixels.data(), mapped, size);
+        GL_CALL(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    } else
+    {
+        LOGE("Failed to map the readback buffer");
+        pixels.clear();
+    }
+
+    GL_CALL(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+    return pixels;
+}
+
 void init()
 {
     LOGD("init ImageIO");
 #ifdef BUILD_WITH_IMAGEIO
-    loaders["png"] = Loader(texture_from_png);
-    loaders["jpg"] = Loader(texture_from_jpeg);
+    decoders.push_back({png_signature, decode_png});
+    decoders.push_back({jpeg_signature, decode_jpeg});
     writers["png"] = Writer(texture_to_png);
 #endif
+    decoders.push_back({ktx2_identifier, decode_ktx2});
+    update_cache_budget();
 }
 }
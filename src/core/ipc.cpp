@@ -0,0 +1,1080 @@
+#include "ipc.hpp"
+#include "client-accounting.hpp"
+#include "memory-accounting.hpp"
+#include <wayfire/core.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/workspace-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+namespace
+{
+/* Requests which are bigger are a protocol error */
+constexpr uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+/**
+ * A parsed JSON value. Requests are small, so a plain tree is good enough.
+ */
+struct json_t
+{
+    enum type_t
+    {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT,
+    };
+
+    type_t type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<json_t> array;
+    std::map<std::string, json_t> object;
+
+    /** @return The member with the given name, or null */
+    const json_t *get(const std::string& name) const
+    {
+        auto it = object.find(name);
+        return it == object.end() ? nullptr : &it->second;
+    }
+};
+
+class json_parser_t
+{
+  public:
+    json_parser_t(const std::string& text) : text(text)
+    {}
+
+    /** @return Whether the whole text is a single valid JSON value */
+    bool parse(json_t& value)
+    {
+        if (!parse_value(value, 0))
+        {
+            return false;
+        }
+
+        skip_whitespace();
+
+        return pos == text.size();
+    }
+
+  private:
+    static constexpr int MAX_DEPTH = 32;
+    const std::string& text;
+    size_t pos = 0;
+
+    void skip_whitespace()
+    {
+        while ((pos < text.size()) && strchr(" \t\r\n", text[pos]))
+        {
+            ++pos;
+        }
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t len = strlen(literal);
+        if (text.compare(pos, len, literal) != 0)
+        {
+            return false;
+        }
+
+        pos += len;
+
+        return true;
+    }
+
+    bool parse_value(json_t& value, int depth)
+    {
+        skip_whitespace();
+        if ((pos >= text.size()) || (depth > MAX_DEPTH))
+        {
+            return false;
+        }
+
+        switch (text[pos])
+        {
+          case '{':
+            value.type = json_t::JSON_OBJECT;
+            return parse_object(value, depth);
+
+          case '[':
+            value.type = json_t::JSON_ARRAY;
+            return parse_array(value, depth);
+
+          case '"':
+            value.type = json_t::JSON_STRING;
+            return parse_string(value.string);
+
+          case 't':
+            value.type = json_t::JSON_BOOL;
+            value.boolean = true;
+            return consume("true");
+
+          case 'f':
+            value.type = json_t::JSON_BOOL;
+            return consume("false");
+
+          case 'n':
+            return consume("null");
+
+          default:
+            value.type = json_t::JSON_NUMBER;
+            return parse_number(value.number);
+        }
+    }
+
+    bool parse_object(json_t& value, int depth)
+    {
+        ++pos;
+        skip_whitespace();
+        if (consume("}"))
+        {
+            return true;
+        }
+
+        while (true)
+        {
+            std::string name;
+            skip_whitespace();
+            if ((pos >= text.size()) || (text[pos] != '"') || !parse_string(name))
+            {
+                return false;
+            }
+
+            skip_whitespace();
+            if (!consume(":") || !parse_value(value.object[name], depth + 1))
+            {
+                return false;
+            }
+
+            skip_whitespace();
+            if (consume("}"))
+            {
+                return true;
+            }
+
+            if (!consume(","))
+            {
+                return false;
+            }
+        }
+    }
+
+    bool parse_array(json_t& value, int depth)
+    {
+        ++pos;
+        skip_whitespace();
+        if (consume("]"))
+        {
+            return true;
+        }
+
+        while (true)
+        {
+            value.array.emplace_back();
+            if (!parse_value(value.array.back(), depth + 1))
+            {
+                return false;
+            }
+
+            skip_whitespace();
+            if (consume("]"))
+            {
+                return true;
+            }
+
+            if (!consume(","))
+            {
+                return false;
+            }
+        }
+    }
+
+    /* Escaped characters outside of ASCII are replaced by '?', none of the
+     * requests need them */
+    bool parse_string(std::string& result)
+    {
+        ++pos;
+        while (pos < text.size())
+        {
+            char c = text[pos++];
+            if (c == '"')
+            {
+                return true;
+            }
+
+            if (c != '\\')
+            {
+                result += c;
+                continue;
+            }
+
+            if (pos >= text.size())
+            {
+                return false;
+            }
+
+            c = text[pos++];
+            switch (c)
+            {
+              case 'n':
+                result += '\n';
+                break;
+
+              case 't':
+                result += '\t';
+                break;
+
+              case 'r':
+                result += '\r';
+                break;
+
+              case 'b':
+                result += '\b';
+                break;
+
+              case 'f':
+                result += '\f';
+                break;
+
+              case 'u':
+              {
+                if (pos + 4 > text.size())
+                {
+                    return false;
+                }
+
+                long code = strtol(text.substr(pos, 4).c_str(), nullptr, 16);
+                result += (code < 0x80) ? (char)code : '?';
+                pos    += 4;
+                break;
+              }
+
+              default:
+                result += c;
+            }
+        }
+
+        return false;
+    }
+
+    bool parse_number(double& number)
+    {
+        const char *start = text.c_str() + pos;
+        char *end;
+        number = strtod(start, &end);
+        if ((end == start) || !std::isfinite(number))
+        {
+            return false;
+        }
+
+        pos += end - start;
+
+        return true;
+    }
+};
+
+std::string json_quote(const std::string& str)
+{
+    std::string result = "\"";
+    for (unsigned char c : str)
+    {
+        switch (c)
+        {
+          case '"':
+            result += "\\\"";
+            break;
+
+          case '\\':
+            result += "\\\\";
+            break;
+
+          case '\n':
+            result += "\\n";
+            break;
+
+          default:
+            if (c < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                result += escaped;
+            } else
+            {
+                result += c;
+            }
+        }
+    }
+
+    return result + "\"";
+}
+
+std::string json_bool(bool value)
+{
+    return value ? "true" : "false";
+}
+
+std::string json_geometry(wf::geometry_t g)
+{
+    return "{\"x\":" + std::to_string(g.x) + ",\"y\":" + std::to_string(g.y) +
+           ",\"width\":" + std::to_string(g.width) +
+           ",\"height\":" + std::to_string(g.height) + "}";
+}
+
+std::string json_point(wf::point_t p)
+{
+    return "{\"x\":" + std::to_string(p.x) + ",\"y\":" + std::to_string(p.y) + "}";
+}
+
+std::string output_name(wf::output_t *output)
+{
+    return output ? json_quote(output->handle->name) : "null";
+}
+
+std::string describe_view(wayfire_view view)
+{
+    static const char *roles[] = {"toplevel", "unmanaged", "desktop-environment"};
+
+    return "{\"id\":" + std::to_string(view->get_id()) +
+           ",\"title\":" + json_quote(view->get_title()) +
+           ",\"app-id\":" + json_quote(view->get_app_id()) +
+           ",\"role\":" + json_quote(roles[view->role]) +
+           ",\"output\":" + output_name(view->get_output()) +
+           ",\"geometry\":" + json_geometry(view->get_wm_geometry()) +
+           ",\"mapped\":" + json_bool(view->is_mapped()) +
+           ",\"activated\":" + json_bool(view->activated) +
+           ",\"minimized\":" + json_bool(view->minimized) +
+           ",\"fullscreen\":" + json_bool(view->fullscreen) +
+           ",\"sticky\":" + json_bool(view->sticky) +
+           ",\"tiled-edges\":" + std::to_string(view->tiled_edges) + "}";
+}
+
+std::string describe_output(wf::output_t *output)
+{
+    auto grid = output->workspace->get_workspace_grid_size();
+    bool focused = (output == wf::get_core().get_active_output());
+
+    return "{\"name\":" + output_name(output) +
+           ",\"geometry\":" + json_geometry(output->get_layout_geometry()) +
+           ",\"scale\":" + std::to_string(output->handle->scale) +
+           ",\"focused\":" + json_bool(focused) +
+           ",\"workspace\":" +
+           json_point(output->workspace->get_current_workspace()) +
+           ",\"grid\":{\"width\":" + std::to_string(grid.width) +
+           ",\"height\":" + std::to_string(grid.height) + "}}";
+}
+
+std::string describe_memory_usage()
+{
+    std::string heap;
+    for (auto& usage : wf::memory_accounting::get_heap_usage())
+    {
+        heap += (heap.empty() ? "" : ",");
+        heap += "{\"owner\":" + json_quote(usage.owner) +
+            ",\"bytes\":" + std::to_string(usage.bytes) +
+            ",\"allocations\":" + std::to_string(usage.allocations) + "}";
+    }
+
+    std::string data;
+    for (auto& usage : wf::memory_accounting::get_custom_data_usage())
+    {
+        data += (data.empty() ? "" : ",");
+        data += "{\"type\":" + json_quote(usage.type) +
+            ",\"count\":" + std::to_string(usage.count) + "}";
+    }
+
+    return "{\"heap-accounting\":" +
+           json_bool(wf::memory_accounting::heap_accounting_enabled()) +
+           ",\"heap\":[" + heap + "],\"custom-data\":[" + data + "]}";
+}
+
+std::string describe_client(const wf::client_accounting::client_stats_t& stats)
+{
+    return "{\"pid\":" + std::to_string(stats.pid) +
+           ",\"commit-rate\":" + std::to_string(stats.commit_rate) +
+           ",\"commits\":" + std::to_string(stats.commits) +
+           ",\"merged-commits\":" + std::to_string(stats.merged_commits) +
+           ",\"queued-bytes\":" + std::to_string(stats.queued_bytes) +
+           ",\"peak-queued-bytes\":" + std::to_string(stats.peak_queued_bytes) +
+           ",\"rate-limited\":" + json_bool(stats.rate_limited) +
+           ",\"backlogged\":" + json_bool(stats.backlogged) +
+           ",\"times-limited\":" + std::to_string(stats.times_limited) + "}";
+}
+}
+
+class wf::ipc_server_t::impl
+{
+  public:
+    ~impl()
+    {
+        stop();
+    }
+
+    void init()
+    {
+        if (!enabled)
+        {
+            return;
+        }
+
+        const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+        if (!runtime_dir)
+        {
+            LOGE("XDG_RUNTIME_DIR is not set, cannot create the IPC socket");
+
+            return;
+        }
+
+        path = std::string(runtime_dir) + "/wayfire-" +
+            wf::get_core().wayland_display + ".socket";
+
+        sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            LOGE("The IPC socket path ", path, " is too long");
+
+            return;
+        }
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+
+        /* A socket left behind by a crashed instance with the same display */
+        unlink(path.c_str());
+        if ((listen_fd < 0) ||
+            (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) ||
+            (listen(listen_fd, 16) < 0))
+        {
+            LOGE("Failed to create the IPC socket ", path, ": ", strerror(errno));
+            stop();
+
+            return;
+        }
+
+        listen_source = wl_event_loop_add_fd(wf::get_core().ev_loop, listen_fd,
+            WL_EVENT_READABLE, [] (int, uint32_t, void *data)
+        {
+            ((impl*)data)->accept_client();
+            return 0;
+        }, this);
+
+        setenv("WAYFIRE_SOCKET", path.c_str(), 1);
+        LOGI("IPC socket at ", path);
+
+        on_output_added.set_callback([=] (wf::signal_data_t *data)
+        {
+            auto output = wf::get_signaled_output(data);
+            connect_output(output);
+            push_event("output-added", "output",
+                "{\"event\":\"output-added\",\"output\":" +
+                describe_output(output) + "}");
+        });
+        on_output_removed.set_callback([=] (wf::signal_data_t *data)
+        {
+            auto output = wf::get_signaled_output(data);
+            push_event("output-removed", "output",
+                "{\"event\":\"output-removed\",\"output\":" +
+                output_name(output) + "}");
+        });
+        wf::get_core().output_layout->connect_signal("output-added",
+            &on_output_added);
+        wf::get_core().output_layout->connect_signal("output-removed",
+            &on_output_removed);
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            connect_output(output);
+        }
+
+        wf::get_core().connect_signal("keyboard-focus-changed", &on_focus_changed);
+        wf::get_core().connect_signal("view-geometry-changed",
+            &on_geometry_changed);
+        wf::get_core().connect_signal("client-limited", &on_client_limited);
+        wf::get_core().connect_signal("shutdown", &on_shutdown);
+
+        flush_idle.set_callback([=] ()
+        {
+            flush_events();
+        });
+    }
+
+  private:
+    wf::option_wrapper_t<bool> enabled{"core/ipc"};
+    wf::option_wrapper_t<int> max_queued_events{"core/ipc_max_queued_events"};
+
+    std::string path;
+    int listen_fd = -1;
+    wl_event_source *listen_source = nullptr;
+
+    struct message_t
+    {
+        std::string data;
+        /* Only event messages may be dropped, responses never are */
+        bool is_event;
+    };
+
+    struct client_t
+    {
+        int fd;
+        wl_event_source *source = nullptr;
+        /* Received bytes which don't form a whole message yet */
+        std::string input;
+        std::deque<message_t> queue;
+        /* How much of the first queued message has been written */
+        size_t written = 0;
+        /* The number of queued event messages */
+        size_t queued_events = 0;
+        uint64_t dropped = 0;
+
+        std::set<std::string> subscriptions;
+        /* Events for the next batch, and the index of the coalesced ones */
+        std::vector<std::string> batch;
+        std::map<std::string, size_t> coalesced;
+    };
+
+    std::vector<std::unique_ptr<client_t>> clients;
+    /* How many clients subscribe to each event, to avoid describing views
+     * and outputs for events nobody receives */
+    std::map<std::string, int> subscribers;
+    wf::wl_idle_call flush_idle;
+
+    void stop()
+    {
+        while (!clients.empty())
+        {
+            disconnect(clients.back().get());
+        }
+
+        if (listen_source)
+        {
+            wl_event_source_remove(listen_source);
+            listen_source = nullptr;
+        }
+
+        if (listen_fd >= 0)
+        {
+            close(listen_fd);
+            unlink(path.c_str());
+            listen_fd = -1;
+        }
+    }
+
+    void accept_client()
+    {
+        int fd = accept4(listen_fd, nullptr, nullptr,
+            SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        auto client = std::make_unique<client_t>();
+        client->fd     = fd;
+        client->source = wl_event_loop_add_fd(wf::get_core().ev_loop, fd,
+            WL_EVENT_READABLE, [] (int fd, uint32_t mask, void *data)
+        {
+            auto self = (impl*)data;
+            for (auto& client : self->clients)
+            {
+                if (client->fd == fd)
+                {
+                    self->handle_client(client.get(), mask);
+                    break;
+                }
+            }
+
+            return 0;
+        }, this);
+        clients.push_back(std::move(client));
+    }
+
+    void disconnect(client_t *client)
+    {
+        for (auto& event : client->subscriptions)
+        {
+            --subscribers[event];
+        }
+
+        wl_event_source_remove(client->source);
+        close(client->fd);
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+            [=] (const auto& c) { return c.get() == client; }), clients.end());
+    }
+
+    void handle_client(client_t *client, uint32_t mask)
+    {
+        if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+        {
+            disconnect(client);
+
+            return;
+        }
+
+        if (mask & WL_EVENT_WRITABLE)
+        {
+            if (!write_queue(client))
+            {
+                disconnect(client);
+
+                return;
+            }
+        }
+
+        if (mask & WL_EVENT_READABLE)
+        {
+            read_requests(client);
+        }
+    }
+
+    void read_requests(client_t *client)
+    {
+        char buffer[4096];
+        while (true)
+        {
+            ssize_t len = read(client->fd, buffer, sizeof(buffer));
+            if (len > 0)
+            {
+                client->input.append(buffer, len);
+                continue;
+            }
+
+            if ((len == 0) || ((errno != EAGAIN) && (errno != EINTR)))
+            {
+                disconnect(client);
+
+                return;
+            }
+
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+        }
+
+        size_t offset = 0;
+        while (client->input.size() - offset >= 4)
+        {
+            auto bytes = (const uint8_t*)client->input.data() + offset;
+            uint32_t size = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+                ((uint32_t)bytes[3] << 24);
+            if (size > MAX_REQUEST_SIZE)
+            {
+                LOGW("IPC client sent a too big request, disconnecting it");
+                disconnect(client);
+
+                return;
+            }
+
+            if (client->input.size() - offset - 4 < size)
+            {
+                break;
+            }
+
+            handle_request(client, client->input.substr(offset + 4, size));
+            offset += 4 + size;
+        }
+
+        client->input.erase(0, offset);
+        if (!write_queue(client))
+        {
+            disconnect(client);
+        }
+    }
+
+    void handle_request(client_t *client, const std::string& text)
+    {
+        json_t request;
+        json_parser_t parser{text};
+        std::string response;
+        if (!parser.parse(request) || (request.type != json_t::JSON_OBJECT))
+        {
+            response = "{\"error\":\"invalid JSON\"";
+        } else
+        {
+            response = call_method(client, request);
+            auto id = request.get("id");
+            if (id && (id->type == json_t::JSON_NUMBER))
+            {
+                response += ",\"id\":" + std::to_string((int64_t)id->number);
+            }
+        }
+
+        client->queue.push_back({response + "}", false});
+    }
+
+    /** @return The response, without the closing brace */
+    std::string call_method(client_t *client, const json_t& request)
+    {
+        auto method = request.get("method");
+        if (!method || (method->type != json_t::JSON_STRING))
+        {
+            return "{\"error\":\"missing method\"";
+        }
+
+        if (method->string == "list-views")
+        {
+            std::string result;
+            for (auto& view : wf::get_core().get_all_views())
+            {
+                result += (result.empty() ? "" : ",") + describe_view(view);
+            }
+
+            return "{\"result\":[" + result + "]";
+        }
+
+        if (method->string == "list-outputs")
+        {
+            std::string result;
+            for (auto output : wf::get_core().output_layout->get_outputs())
+            {
+                result += (result.empty() ? "" : ",") + describe_output(output);
+            }
+
+            return "{\"result\":[" + result + "]";
+        }
+
+        if (method->string == "get-view")
+        {
+            auto id = request.get("view");
+            for (auto& view : wf::get_core().get_all_views())
+            {
+                if (id && (id->type == json_t::JSON_NUMBER) &&
+                    (view->get_id() == id->number))
+                {
+                    return "{\"result\":" + describe_view(view);
+                }
+            }
+
+            return "{\"error\":\"no such view\"";
+        }
+
+        if (method->string == "memory-usage")
+        {
+            return "{\"result\":" + describe_memory_usage();
+        }
+
+        if (method->string == "client-offenders")
+        {
+            std::string result;
+            for (auto& stats : wf::client_accounting::get_client_stats())
+            {
+                if (stats.times_limited > 0)
+                {
+                    result += (result.empty() ? "" : ",") + describe_client(stats);
+                }
+            }
+
+            return "{\"result\":[" + result + "]";
+        }
+
+        if (method->string == "subscribe")
+        {
+            static const std::set<std::string> known = {
+                "view-mapped", "view-unmapped", "view-focused",
+                "view-geometry-changed", "workspace-changed",
+                "output-added", "output-removed", "client-limited"
+            };
+
+            auto events = request.get("events");
+            if (!events || (events->type != json_t::JSON_ARRAY))
+            {
+                return "{\"error\":\"missing events\"";
+            }
+
+            for (auto& event : events->array)
+            {
+                if ((event.type != json_t::JSON_STRING) ||
+                    !known.count(event.string))
+                {
+                    return "{\"error\":\"unknown event\"";
+                }
+            }
+
+            for (auto& event : events->array)
+            {
+                if (client->subscriptions.insert(event.string).second)
+                {
+                    ++subscribers[event.string];
+                }
+            }
+
+            return "{\"result\":true";
+        }
+
+        return "{\"error\":\"unknown method\"";
+    }
+
+    /**
+     * Write as much of the queue as the socket takes.
+     *
+     * @return False if the client has to be disconnected.
+     */
+    bool write_queue(client_t *client)
+    {
+        while (!client->queue.empty())
+        {
+            auto& message = client->queue.front();
+            if (client->written == 0)
+            {
+                /* The length is written together with the message */
+                uint32_t size = message.data.size();
+                char prefix[4] = {(char)size, (char)(size >> 8),
+                    (char)(size >> 16), (char)(size >> 24)};
+                message.data.insert(0, prefix, 4);
+            }
+
+            ssize_t len = send(client->fd, message.data.data() + client->written,
+                message.data.size() - client->written, MSG_NOSIGNAL);
+            if (len < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (errno != EAGAIN)
+                {
+                    return false;
+                }
+
+                break;
+            }
+
+            client->written += len;
+            if (client->written == message.data.size())
+            {
+                client->queued_events -= message.is_event;
+                client->queue.pop_front();
+                client->written = 0;
+            }
+        }
+
+        /* Wait for the socket to become writable only while needed */
+        wl_event_source_fd_update(client->source, WL_EVENT_READABLE |
+            (client->queue.empty() ? 0 : WL_EVENT_WRITABLE));
+
+        return true;
+    }
+
+    /**
+     * Add an event to the next batch of each subscribed client.
+     *
+     * @param key Events with the same key replace each other in a batch, or
+     *   empty if the event is never coalesced.
+     */
+    template<class Describe>
+    void push_event(const std::string& name, const std::string& key,
+        Describe describe)
+    {
+        if (subscribers[name] <= 0)
+        {
+            return;
+        }
+
+        std::string event = describe();
+        for (auto& client : clients)
+        {
+            if (!client->subscriptions.count(name))
+            {
+                continue;
+            }
+
+            auto it = key.empty() ? client->coalesced.end() :
+                client->coalesced.find(key);
+            if (it != client->coalesced.end())
+            {
+                client->batch[it->second] = event;
+            } else
+            {
+                if (!key.empty())
+                {
+                    client->coalesced[key] = client->batch.size();
+                }
+
+                client->batch.push_back(event);
+            }
+        }
+
+        flush_idle.run_once();
+    }
+
+    void push_event(const std::string& name, const std::string& key,
+        const std::string& event)
+    {
+        push_event(name, key, [&] () { return event; });
+    }
+
+    void flush_events()
+    {
+        std::vector<client_t*> failed;
+        for (auto& client : clients)
+        {
+            if (client->batch.empty())
+            {
+                continue;
+            }
+
+            std::string message = "{\"events\":[";
+            for (size_t i = 0; i < client->batch.size(); i++)
+            {
+                message += (i > 0 ? "," : "") + client->batch[i];
+            }
+
+            client->batch.clear();
+            client->coalesced.clear();
+            enqueue_event(client.get(), message + "],\"dropped\":" +
+                std::to_string(client->dropped) + "}");
+            if (!write_queue(client.get()))
+            {
+                failed.push_back(client.get());
+            }
+        }
+
+        for (auto client : failed)
+        {
+            disconnect(client);
+        }
+    }
+
+    /** Queue an event message, dropping the oldest ones if the queue is full */
+    void enqueue_event(client_t *client, std::string message)
+    {
+        size_t limit = std::max(1, (int)max_queued_events);
+        /* The first message may be partially written already */
+        auto it = client->queue.begin() + (client->written > 0 ? 1 : 0);
+        while ((client->queued_events >= limit) && (it != client->queue.end()))
+        {
+            if (it->is_event)
+            {
+                it = client->queue.erase(it);
+                --client->queued_events;
+                ++client->dropped;
+            } else
+            {
+                ++it;
+            }
+        }
+
+        client->queue.push_back({std::move(message), true});
+        ++client->queued_events;
+    }
+
+    wf::signal_connection_t on_output_added, on_output_removed;
+
+    void connect_output(wf::output_t *output)
+    {
+        output->connect_signal("view-mapped", &on_view_mapped);
+        output->connect_signal("view-unmapped", &on_view_unmapped);
+        output->connect_signal("workspace-changed", &on_workspace_changed);
+    }
+
+    wf::signal_connection_t on_view_mapped = [=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        push_event("view-mapped", "", [&] ()
+        {
+            return "{\"event\":\"view-mapped\",\"view\":" +
+                   describe_view(view) + "}";
+        });
+    };
+
+    wf::signal_connection_t on_view_unmapped = [=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        push_event("view-unmapped", "", [&] ()
+        {
+            return "{\"event\":\"view-unmapped\",\"view\":" +
+                   std::to_string(view->get_id()) + "}";
+        });
+    };
+
+    wf::signal_connection_t on_focus_changed = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::keyboard_focus_changed_signal*>(data);
+        push_event("view-focused", "focus", [&] ()
+        {
+            return "{\"event\":\"view-focused\",\"view\":" +
+                   (ev->view ? describe_view(ev->view) : "null") + "}";
+        });
+    };
+
+    wf::signal_connection_t on_geometry_changed = [=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        push_event("view-geometry-changed",
+            "geometry-" + std::to_string(view->get_id()), [&] ()
+        {
+            return "{\"event\":\"view-geometry-changed\",\"view\":" +
+                   describe_view(view) + "}";
+        });
+    };
+
+    wf::signal_connection_t on_workspace_changed = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::workspace_changed_signal*>(data);
+        push_event("workspace-changed", "workspace-" + ev->output->handle->name,
+            [&] ()
+        {
+            return "{\"event\":\"workspace-changed\",\"output\":" +
+                   output_name(ev->output) + ",\"workspace\":" +
+                   json_point(ev->new_viewport) + "}";
+        });
+    };
+
+    wf::signal_connection_t on_client_limited = [=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::client_accounting::client_limited_signal*>(data);
+        push_event("client-limited", "", [&] ()
+        {
+            return "{\"event\":\"client-limited\",\"reason\":" +
+                   json_quote(ev->reason) + ",\"client\":" +
+                   describe_client(ev->stats) + "}";
+        });
+    };
+
+    wf::signal_connection_t on_shutdown = [=] (wf::signal_data_t*)
+    {
+        stop();
+    };
+};
+
+wf::ipc_server_t& wf::ipc_server_t::get()
+{
+    static ipc_server_t server;
+    return server;
+}
+
+wf::ipc_server_t::ipc_server_t() : priv(std::make_unique<impl>())
+{}
+
+wf::ipc_server_t::~ipc_server_t() = default;
+
+void wf::ipc_server_t::init()
+{
+    priv->init();
+}
@@ -0,0 +1,57 @@
+#ifndef WF_IPC_HPP
+#define WF_IPC_HPP
+
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <memory>
+
+namespace wf
+{
+/**
+ * A Unix socket which lets scripts and tools query the state of the compositor
+ * and subscribe to its events, enabled with core/ipc.
+ *
+ * The socket is created in $XDG_RUNTIME_DIR, and its path is exported as
+ * WAYFIRE_SOCKET to the clients started by Wayfire. Each message in either
+ * direction is a JSON object, prefixed by its length in bytes as a 32-bit
+ * little-endian integer.
+ *
+ * Requests have a "method" and optionally an "id", which is copied to the
+ * response. The methods are:
+ * - list-views, list-outputs: the result is an array of views/outputs.
+ * - get-view {"view": id}: the result is a single view.
+ * - memory-usage: the heap usage per plugin, if accounted, and the number of
+ *   custom data objects by type, see memory-accounting.hpp.
+ * - client-offenders: the Wayland clients which have been rate limited or
+ *   backlogged, with their commit and queue statistics, see
+ *   client-accounting.hpp.
+ * - subscribe {"events": [names]}: start receiving the given events, out of
+ *   view-mapped, view-unmapped, view-focused, view-geometry-changed,
+ *   workspace-changed, output-added, output-removed and client-limited.
+ *
+ * Events are collected while the compositor is busy, and sent in a single
+ * {"events": [...]} message when the event loop becomes idle, usually once per
+ * frame. Repeated geometry and workspace changes of the same view or output
+ * are coalesced to the last one. Sockets are never written to with blocking
+ * writes: if a client doesn't read its messages, at most
+ * core/ipc_max_queued_events event messages are queued for it, the oldest
+ * ones are dropped, and the next message reports how many in "dropped".
+ */
+class ipc_server_t : public noncopyable_t
+{
+  public:
+    static ipc_server_t& get();
+
+    /** Create the socket. Called once, after the backend has started. */
+    void init();
+
+  private:
+    ipc_server_t();
+    ~ipc_server_t();
+
+    class impl;
+    std::unique_ptr<impl> priv;
+};
+}
+
+#endif /* end of include guard: WF_IPC_HPP */
@@ -0,0 +1,261 @@
+#include "memory-accounting.hpp"
+#include "signal-accounting.hpp"
+#include <config.h>
+
+#ifdef WF_MEMORY_ACCOUNTING
+    #include <algorithm>
+    #include <atomic>
+    #include <cstdlib>
+    #include <new>
+
+namespace
+{
+/**
+ * The header in front of each allocation. It is 16 bytes long, so that
+ * allocations stay aligned for any fundamental type.
+ */
+struct alignas(16) header_t
+{
+    /* The index of the owner in the owner table */
+    uint32_t owner;
+    /* Where the allocation starts, relative to the end of the header */
+    uint32_t offset;
+    uint64_t size;
+};
+
+struct owner_counters_t
+{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> bytes{0};
+    std::atomic<int64_t> allocations{0};
+};
+
+/*
+ * The table can't use the heap itself, so it has a fixed size. Owners are
+ * interned strings which are never freed, so they are compared by address.
+ * Entry 0 is the core, and owners which don't fit are charged to it.
+ */
+constexpr uint32_t MAX_OWNERS = 256;
+owner_counters_t owners[MAX_OWNERS];
+std::atomic<uint32_t> owner_count{1};
+
+uint32_t find_owner(const char *name)
+{
+    if (!name)
+    {
+        return 0;
+    }
+
+    /* Most allocations in a row are made by the same owner */
+    static std::atomic<uint32_t> last{0};
+    uint32_t cached = last.load(std::memory_order_relaxed);
+    if (owners[cached].name.load(std::memory_order_relaxed) == name)
+    {
+        return cached;
+    }
+
+    uint32_t count = owner_count.load();
+    for (uint32_t i = 1; i < count; i++)
+    {
+        if (owners[i].name.load() == name)
+        {
+            last = i;
+
+            return i;
+        }
+    }
+
+    uint32_t index = owner_count.fetch_add(1);
+    if (index >= MAX_OWNERS)
+    {
+        owner_count = MAX_OWNERS;
+
+        return 0;
+    }
+
+    owners[index].name = name;
+    last = index;
+
+    return index;
+}
+
+void *allocate(size_t size, size_t alignment = alignof(header_t))
+{
+    size_t offset = std::max(alignment, sizeof(header_t));
+    void *base;
+    if (alignment <= alignof(header_t))
+    {
+        base = std::malloc(size + offset);
+    } else if (posix_memalign(&base, alignment, size + offset) != 0)
+    {
+        base = nullptr;
+    }
+
+    if (!base)
+    {
+        return nullptr;
+    }
+
+    auto user = (char*)base + offset;
+    auto header = (header_t*)user - 1;
+    header->owner  = find_owner(wf::signal_accounting::get_current_owner());
+    header->offset = offset;
+    header->size   = size;
+
+    auto& counters = owners[header->owner];
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+
+    return user;
+}
+
+void deallocate(void *ptr)
+{
+    if (!ptr)
+    {
+        return;
+    }
+
+    auto header = (header_t*)ptr - 1;
+    auto& counters = owners[header->owner];
+    counters.bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    counters.allocations.fetch_sub(1, std::memory_order_relaxed);
+    std::free((char*)ptr - header->offset);
+}
+
+void *allocate_or_throw(size_t size, size_t alignment = alignof(header_t))
+{
+    while (true)
+    {
+        if (void *ptr = allocate(size, alignment))
+        {
+            return ptr;
+        }
+
+        auto handler = std::get_new_handler();
+        if (!handler)
+        {
+            throw std::bad_alloc();
+        }
+
+        handler();
+    }
+}
+}
+
+void *operator new(size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return allocate_or_throw(size, (size_t)alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocate_or_throw(size, (size_t)alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment,
+    const std::nothrow_t&) noexcept
+{
+    return allocate(size, (size_t)alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment,
+    const std::nothrow_t&) noexcept
+{
+    return allocate(size, (size_t)alignment);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    deallocate(ptr);
+}
+
+bool wf::memory_accounting::heap_accounting_enabled()
+{
+    return true;
+}
+
+std::vector<wf::memory_accounting::heap_usage_t> wf::memory_accounting::
+get_heap_usage()
+{
+    std::vector<heap_usage_t> usage;
+    uint32_t count = std::min(owner_count.load(), MAX_OWNERS);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const char *name = owners[i].name;
+        usage.push_back({name ? name : "core", owners[i].bytes,
+            owners[i].allocations});
+    }
+
+    return usage;
+}
+
+#else
+
+bool wf::memory_accounting::heap_accounting_enabled()
+{
+    return false;
+}
+
+std::vector<wf::memory_accounting::heap_usage_t> wf::memory_accounting::
+get_heap_usage()
+{
+    return {};
+}
+
+#endif
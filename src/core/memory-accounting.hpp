@@ -0,0 +1,55 @@
+#ifndef WF_MEMORY_ACCOUNTING_HPP
+#define WF_MEMORY_ACCOUNTING_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wf
+{
+/**
+ * Accounting of heap memory per plugin, for finding out which plugin makes a
+ * long-running session grow.
+ *
+ * When built with the memory_accounting option, the global operator new and
+ * delete of the whole process, including plugins, are replaced. Each
+ * allocation is charged to the owner known to signal accounting (see
+ * signal-accounting.hpp): the plugin which is being initialized, or whose
+ * signal handler is running. Everything else is charged to the core. Freeing
+ * memory credits the owner which allocated it, whoever frees it.
+ *
+ * Independently of the build option, the custom data stored on objects is
+ * counted by type.
+ */
+namespace memory_accounting
+{
+struct heap_usage_t
+{
+    /* The plugin, or "core" */
+    std::string owner;
+    /* Bytes currently allocated, without the accounting overhead */
+    int64_t bytes;
+    /* Allocations which have not been freed yet */
+    int64_t allocations;
+};
+
+struct custom_data_usage_t
+{
+    /* The (mangled) name of the type */
+    std::string type;
+    /* The number of objects of the type which exist */
+    int64_t count;
+};
+
+/** @return Whether heap allocations are accounted in this build. */
+bool heap_accounting_enabled();
+
+/** @return The heap usage of each owner, empty if it is not accounted. */
+std::vector<heap_usage_t> get_heap_usage();
+
+/** @return The number of custom data objects which exist, by type. */
+std::vector<custom_data_usage_t> get_custom_data_usage();
+}
+}
+
+#endif /* end of include guard: WF_MEMORY_ACCOUNTING_HPP */
@@ -0,0 +1,650 @@
+#include "metrics.hpp"
+#include "memory-accounting.hpp"
+#include <wayfire/core.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+namespace
+{
+/*
+ * The frame statistics of an output are kept for the last 128 frames, so they
+ * are collected at the latest after this many frames. A frame is counted once
+ * its GPU time and presentation are known, or once this many newer frames
+ * exist.
+ */
+constexpr int COLLECT_FRAMES = 64;
+constexpr uint64_t SETTLE_FRAMES = 8;
+
+/** A histogram with fixed bucket bounds, in seconds */
+struct histogram_t
+{
+    histogram_t(const std::vector<double>& _bounds) :
+        bounds(_bounds), counts(_bounds.size())
+    {}
+
+    std::vector<double> bounds;
+    /* The number of values up to each bound, not cumulative */
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    double sum = 0;
+
+    void add(double value)
+    {
+        auto it = std::lower_bound(bounds.begin(), bounds.end(), value);
+        if (it != bounds.end())
+        {
+            ++counts[it - bounds.begin()];
+        }
+
+        ++count;
+        sum += value;
+    }
+};
+
+const std::vector<double> frame_time_bounds = {
+    0.001, 0.002, 0.004, 0.008, 0.016, 0.033, 0.066,
+};
+
+const std::vector<double> latency_bounds = {
+    0.004, 0.008, 0.016, 0.025, 0.033, 0.050, 0.100, 0.200,
+};
+
+struct output_metrics_t
+{
+    std::string name;
+    /* The last frame which was counted */
+    uint64_t last_frame_id = 0;
+    int frames_since_collect = 0;
+
+    uint64_t frames = 0;
+    uint64_t missed_frames = 0;
+    uint64_t cursor_only_frames = 0;
+    uint64_t damaged_pixels = 0;
+    histogram_t cpu_time{frame_time_bounds};
+    histogram_t gpu_time{frame_time_bounds};
+    histogram_t input_latency{latency_bounds};
+    /* Repaints postponed for pending input, and the events handled meanwhile */
+    histogram_t input_yield{frame_time_bounds};
+    uint64_t input_yield_events = 0;
+
+    wf::signal_connection_t on_frame_ready;
+};
+
+/** Quote a label value, see the OpenMetrics specification */
+std::string label(const std::string& value)
+{
+    std::string result = "\"";
+    for (char c : value)
+    {
+        if (c == '\n')
+        {
+            result += "\\n";
+        } else
+        {
+            if ((c == '"') || (c == '\\'))
+            {
+                result += '\\';
+            }
+
+            result += c;
+        }
+    }
+
+    return result + "\"";
+}
+
+class metrics_writer_t
+{
+  public:
+    std::ostringstream out;
+
+    void family(const std::string& name, const std::string& type,
+        const std::string& help)
+    {
+        out << "# TYPE " << name << " " << type << "\n";
+        out << "# HELP " << name << " " << help << "\n";
+    }
+
+    template<class T>
+    void sample(const std::string& name, const std::string& labels, T value)
+    {
+        out << name;
+        if (!labels.empty())
+        {
+            out << "{" << labels << "}";
+        }
+
+        out << " " << value << "\n";
+    }
+
+    void histogram(const std::string& name, const std::string& labels,
+        const histogram_t& hist)
+    {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < hist.bounds.size(); i++)
+        {
+            cumulative += hist.counts[i];
+            std::ostringstream le;
+            le << hist.bounds[i];
+            sample(name + "_bucket", prefix + "le=" + label(le.str()), cumulative);
+        }
+
+        sample(name + "_bucket", prefix + "le=\"+Inf\"", hist.count);
+        sample(name + "_count", labels, hist.count);
+        sample(name + "_sum", labels, hist.sum);
+    }
+};
+}
+
+class wf::metrics_server_t::impl
+{
+  public:
+    ~impl()
+    {
+        stop();
+    }
+
+    void init()
+    {
+        if (!enabled)
+        {
+            return;
+        }
+
+        const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+        if (!runtime_dir)
+        {
+            LOGE("XDG_RUNTIME_DIR is not set, cannot create the metrics socket");
+
+            return;
+        }
+
+        path = std::string(runtime_dir) + "/wayfire-" +
+            wf::get_core().wayland_display + "-metrics.socket";
+
+        sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path))
+        {
+            LOGE("The metrics socket path ", path, " is too long");
+
+            return;
+        }
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path.c_str());
+
+        unlink(path.c_str());
+        if ((listen_fd < 0) ||
+            (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) ||
+            (listen(listen_fd, 16) < 0) ||
+            (pipe2(wake_fds, O_CLOEXEC) < 0))
+        {
+            LOGE("Failed to create the metrics socket ", path, ": ",
+                strerror(errno));
+            stop();
+
+            return;
+        }
+
+        on_output_added.set_callback([=] (wf::signal_data_t *data)
+        {
+            connect_output(wf::get_signaled_output(data));
+        });
+        on_output_removed.set_callback([=] (wf::signal_data_t *data)
+        {
+            outputs.erase(wf::get_signaled_output(data));
+        });
+        wf::get_core().output_layout->connect_signal("output-added",
+            &on_output_added);
+        wf::get_core().output_layout->connect_signal("output-removed",
+            &on_output_removed);
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            connect_output(output);
+        }
+
+        wf::get_core().connect_signal("shutdown", &on_shutdown);
+
+        publish();
+        publish_timer.set_timeout(std::max(100, (int)interval), [=] ()
+        {
+            for (auto& output : outputs)
+            {
+                collect(output.first, *output.second);
+            }
+
+            publish();
+
+            return true;
+        }, false);
+
+        server_thread = std::thread([=] ()
+        {
+            serve();
+        });
+
+        setenv("WAYFIRE_METRICS_SOCKET", path.c_str(), 1);
+        LOGI("Metrics socket at ", path);
+    }
+
+  private:
+    wf::option_wrapper_t<bool> enabled{"core/metrics"};
+    wf::option_wrapper_t<int> interval{"core/metrics_interval"};
+
+    std::string path;
+    int listen_fd = -1;
+    /* Written to by the main thread to stop the server thread */
+    int wake_fds[2] = {-1, -1};
+    std::thread server_thread;
+    wf::wl_timer publish_timer;
+
+    std::map<wf::output_t*, std::unique_ptr<output_metrics_t>> outputs;
+
+    /*
+     * The latest snapshot, and the one the server thread is writing out. The
+     * server thread never frees snapshots. Replaced snapshots are retired, and
+     * the main thread frees them once the server thread isn't reading them.
+     */
+    std::atomic<const std::string*> published{nullptr};
+    std::atomic<const std::string*> reading{nullptr};
+    std::vector<const std::string*> retired;
+
+    void stop()
+    {
+        publish_timer.disconnect();
+        if (server_thread.joinable())
+        {
+            char c = 0;
+            while ((write(wake_fds[1], &c, 1) < 0) && (errno == EINTR))
+            {}
+
+            server_thread.join();
+        }
+
+        for (int& fd : wake_fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        if (listen_fd >= 0)
+        {
+            close(listen_fd);
+            unlink(path.c_str());
+            listen_fd = -1;
+        }
+
+        outputs.clear();
+        retired.push_back(published.exchange(nullptr));
+        for (auto snapshot : retired)
+        {
+            delete snapshot;
+        }
+
+        retired.clear();
+    }
+
+    void connect_output(wf::output_t *output)
+    {
+        auto& metrics = outputs[output];
+        metrics = std::make_unique<output_metrics_t>();
+        metrics->name = output->handle->name;
+
+        auto ptr = metrics.get();
+        metrics->on_frame_ready.set_callback([=] (wf::signal_data_t*)
+        {
+            if (++ptr->frames_since_collect >= COLLECT_FRAMES)
+            {
+                collect(output, *ptr);
+            }
+        });
+        output->render->connect_signal("frame-ready", &metrics->on_frame_ready);
+    }
+
+    /** Count the frames of the output which are complete now */
+    void collect(wf::output_t *output, output_metrics_t& metrics)
+    {
+        metrics.frames_since_collect = 0;
+        auto frames = output->render->get_frame_stats();
+        if (frames.empty())
+        {
+            return;
+        }
+
+        uint64_t newest = frames.back().frame_id;
+        int64_t refresh = output->handle->refresh > 0 ?
+            1'000'000'000'000ll / output->handle->refresh : 16'666'667;
+        for (auto& frame : frames)
+        {
+            if (frame.frame_id <= metrics.last_frame_id)
+            {
+                continue;
+            }
+
+            bool complete = (frame.gpu_time >= 0) && (frame.present_time >= 0);
+            if (!complete && (frame.frame_id + SETTLE_FRAMES > newest))
+            {
+                break;
+            }
+
+            metrics.last_frame_id = frame.frame_id;
+            ++metrics.frames;
+            metrics.cursor_only_frames += frame.cursor_only;
+            metrics.damaged_pixels     += frame.damaged_pixels;
+            metrics.cpu_time.add(frame.total_time / 1e9);
+            if (frame.gpu_time >= 0)
+            {
+                metrics.gpu_time.add(frame.gpu_time / 1e9);
+            }
+
+            if (std::max(frame.total_time, frame.gpu_time) > refresh)
+            {
+                ++metrics.missed_frames;
+            }
+
+            if (frame.input_yield_time > 0)
+            {
+                metrics.input_yield.add(frame.input_yield_time / 1e9);
+                metrics.input_yield_events += frame.input_yield_events;
+            }
+
+            /* Both are CLOCK_MONOTONIC with the DRM backend */
+            if ((frame.input_time >= 0) && (frame.present_time >= frame.input_time))
+            {
+                metrics.input_latency.add(
+                    (frame.present_time - frame.input_time) / 1e9);
+            }
+        }
+    }
+
+    std::string describe()
+    {
+        metrics_writer_t w;
+
+        w.family("wayfire_frames", "counter", "Frames repainted");
+        for (auto& [output, m] : outputs)
+        {
+            w.sample("wayfire_frames_total", "output=" + label(m->name),
+                m->frames);
+        }
+
+        w.family("wayfire_missed_frames", "counter",
+            "Frames whose CPU or GPU time exceeded the refresh interval");
+        for (auto& [output, m] : outputs)
+        {
+            w.sample("wayfire_missed_frames_total", "output=" + label(m->name),
+                m->missed_frames);
+        }
+
+        w.family("wayfire_cursor_only_frames", "counter",
+            "Frames in which only the software cursors were repainted");
+        for (auto& [output, m] : outputs)
+        {
+            w.sample("wayfire_cursor_only_frames_total",
+                "output=" + label(m->name), m->cursor_only_frames);
+        }
+
+        w.family("wayfire_damaged_pixels", "counter", "Output pixels repainted");
+        for (auto& [output, m] : outputs)
+        {
+            w.sample("wayfire_damaged_pixels_total", "output=" + label(m->name),
+                m->damaged_pixels);
+        }
+
+        w.family("wayfire_frame_cpu_seconds", "histogram",
+            "CPU time of the repaints");
+        for (auto& [output, m] : outputs)
+        {
+            w.histogram("wayfire_frame_cpu_seconds", "output=" + label(m->name),
+                m->cpu_time);
+        }
+
+        w.family("wayfire_frame_gpu_seconds", "histogram",
+            "GPU time of the repaints, if the driver can measure it");
+        for (auto& [output, m] : outputs)
+        {
+            w.histogram("wayfire_frame_gpu_seconds", "output=" + label(m->name),
+                m->gpu_time);
+        }
+
+        w.family("wayfire_input_latency_seconds", "histogram",
+            "Time from the last input event before a repaint to its presentation");
+        for (auto& [output, m] : outputs)
+        {
+            w.histogram("wayfire_input_latency_seconds",
+                "output=" + label(m->name), m->input_latency);
+        }
+
+        w.family("wayfire_input_yield_seconds", "histogram",
+            "Time repaints waited for pending input to be handled");
+        for (auto& [output, m] : outputs)
+        {
+            w.histogram("wayfire_input_yield_seconds",
+                "output=" + label(m->name), m->input_yield);
+        }
+
+        w.family("wayfire_input_yield_events", "counter",
+            "Input events handled while repaints waited for them");
+        for (auto& [output, m] : outputs)
+        {
+            w.sample("wayfire_input_yield_events_total",
+                "output=" + label(m->name), m->input_yield_events);
+        }
+
+        w.family("wayfire_gpu_memory_bytes", "gauge",
+            "GPU memory used by framebuffers and textures");
+        w.sample("wayfire_gpu_memory_bytes", "", wf::gpu_memory::get_total());
+
+        int clients = 0;
+        wl_client *client;
+        wl_client_for_each(client,
+            wl_display_get_client_list(wf::get_core().display))
+        {
+            ++clients;
+        }
+
+        w.family("wayfire_clients", "gauge", "Connected Wayland clients");
+        w.sample("wayfire_clients", "", clients);
+        w.family("wayfire_views", "gauge", "Existing views");
+        w.sample("wayfire_views", "", wf::get_core().get_all_views().size());
+
+        if (wf::memory_accounting::heap_accounting_enabled())
+        {
+            w.family("wayfire_heap_bytes", "gauge", "Heap memory per plugin");
+            for (auto& usage : wf::memory_accounting::get_heap_usage())
+            {
+                w.sample("wayfire_heap_bytes", "owner=" + label(usage.owner),
+                    usage.bytes);
+            }
+        }
+
+        w.out << "# EOF\n";
+
+        return w.out.str();
+    }
+
+    /** Replace the snapshot, and free the retired ones which aren't read */
+    void publish()
+    {
+        auto old = published.exchange(new std::string(describe()));
+        if (old)
+        {
+            retired.push_back(old);
+        }
+
+        auto in_use = reading.load();
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+            [=] (const std::string *snapshot)
+        {
+            if (snapshot == in_use)
+            {
+                return false;
+            }
+
+            delete snapshot;
+
+            return true;
+        }), retired.end());
+    }
+
+    /*
+     * The server thread. It doesn't allocate memory and doesn't call into
+     * the compositor, it only writes out the published snapshots.
+     */
+    void serve()
+    {
+        pollfd fds[2] = {
+            {listen_fd, POLLIN, 0},
+            {wake_fds[0], POLLIN, 0},
+        };
+
+        while (true)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                return;
+            }
+
+            if (fds[1].revents)
+            {
+                return;
+            }
+
+            if (fds[0].revents & POLLIN)
+            {
+                int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                {
+                    serve_client(fd);
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    void serve_client(int fd)
+    {
+        /* Scrapers which don't read their data may not block the thread */
+        timeval timeout = {1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        /* An HTTP request comes right away, plain clients may send nothing */
+        char request[1024];
+        ssize_t received = 0;
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) > 0)
+        {
+            received = recv(fd, request, sizeof(request), MSG_DONTWAIT);
+        }
+
+        /* Protect the snapshot from being freed while it is written out */
+        auto snapshot = published.load();
+        while (true)
+        {
+            reading = snapshot;
+            auto current = published.load();
+            if (current == snapshot)
+            {
+                break;
+            }
+
+            snapshot = current;
+        }
+
+        if (snapshot)
+        {
+            if ((received >= 4) && !strncmp(request, "GET ", 4))
+            {
+                char header[256];
+                int len = snprintf(header, sizeof(header),
+                    "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: application/openmetrics-text; "
+                    "version=1.0.0; charset=utf-8\r\n"
+                    "Content-Length: %zu\r\n\r\n", snapshot->size());
+                write_all(fd, header, len);
+            }
+
+            write_all(fd, snapshot->data(), snapshot->size());
+        }
+
+        reading = nullptr;
+    }
+
+    static void write_all(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                return;
+            }
+
+            data += written;
+            size -= written;
+        }
+    }
+
+    wf::signal_connection_t on_output_added;
+    wf::signal_connection_t on_output_removed;
+    wf::signal_connection_t on_shutdown = [=] (wf::signal_data_t*)
+    {
+        stop();
+    };
+};
+
+wf::metrics_server_t& wf::metrics_server_t::get()
+{
+    static metrics_server_t server;
+    return server;
+}
+
+wf::metrics_server_t::metrics_server_t() : priv(std::make_unique<impl>())
+{}
+
+wf::metrics_server_t::~metrics_server_t() = default;
+
+void wf::metrics_server_t::init()
+{
+    priv->init();
+}
@@ -0,0 +1,51 @@
+#ifndef WF_METRICS_HPP
+#define WF_METRICS_HPP
+
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <memory>
+
+namespace wf
+{
+/**
+ * A Unix socket which serves the performance counters of the compositor in
+ * the OpenMetrics (Prometheus) text format, enabled with core/metrics, so that
+ * many machines can be monitored remotely.
+ *
+ * The socket is created in $XDG_RUNTIME_DIR, and its path is exported as
+ * WAYFIRE_METRICS_SOCKET. A client which sends an HTTP GET request gets an
+ * HTTP response, any other client just the metrics, and the connection is
+ * closed afterwards.
+ *
+ * The main thread turns the frame statistics of the outputs into counters and
+ * histograms, and every core/metrics_interval milliseconds it publishes a
+ * text snapshot of them. The socket is served by a separate thread, which
+ * only writes out the latest snapshot, so scraping never waits for, or wakes
+ * up, the event loop.
+ *
+ * The exported metrics are, per output, the repainted frames, the frames
+ * which took longer than a refresh, CPU and GPU time histograms, the repainted
+ * pixels, a histogram of the time from the last input event before a repaint
+ * to the presentation of the frame, and how long repaints waited for pending
+ * input and for how many events; and globally, the GPU memory, the number of
+ * clients and views, and the heap usage per plugin if it is accounted (see
+ * memory-accounting.hpp).
+ */
+class metrics_server_t : public noncopyable_t
+{
+  public:
+    static metrics_server_t& get();
+
+    /** Create the socket. Called once, after the backend has started. */
+    void init();
+
+  private:
+    metrics_server_t();
+    ~metrics_server_t();
+
+    class impl;
+    std::unique_ptr<impl> priv;
+};
+}
+
+#endif /* end of include guard: WF_METRICS_HPP */
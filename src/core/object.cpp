@@ -1,22 +1,196 @@
 #include "wayfire/object.hpp"
 #include "wayfire/nonstd/safe-list.hpp"
+#include "wayfire/trace.hpp"
+#include "signal-accounting.hpp"
+#include "memory-accounting.hpp"
+#include <wayfire/util/log.hpp>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <typeinfo>
 #include <unordered_map>
-#include <set>
+#include <unordered_set>
+#include <vector>
 
 /* Implementation note: because of circular dependencies between
  * signal_connection_t and signal_provider_t, the chosen way to resolve
  * them is to have signal_provider_t directly modify signal_connection_t
  * private data when needed. */
 
+namespace
+{
+/** Maps signal names to their interned IDs and back. */
+struct signal_registry_t
+{
+    std::unordered_map<std::string, uint32_t> ids;
+    /* A deque, so that the names are never moved when new ones are added */
+    std::deque<std::string> names;
+
+    static signal_registry_t& get()
+    {
+        static signal_registry_t registry;
+        return registry;
+    }
+};
+}
+
+wf::signal_id_t::signal_id_t(const std::string& name)
+{
+    auto& registry = signal_registry_t::get();
+    auto it = registry.ids.find(name);
+    if (it != registry.ids.end())
+    {
+        this->id = it->second;
+    } else
+    {
+        this->id = registry.names.size();
+        registry.ids[name] = this->id;
+        registry.names.push_back(name);
+    }
+}
+
+const std::string& wf::signal_id_t::get_name() const
+{
+    return signal_registry_t::get().names[id];
+}
+
+namespace
+{
+struct handler_totals_t
+{
+    int64_t time  = 0;
+    uint64_t calls = 0;
+};
+
+/*
+ * The plugin whose connections are being created or run. It is a plain
+ * variable rather than a member of the state, because the heap accounting
+ * reads it from operator new, even while the state is being constructed.
+ *
+ * It and the signal being emitted are atomic, so that the stall watchdog can
+ * read them from its thread. Relaxed accesses compile to plain loads and
+ * stores.
+ */
+std::atomic<const char*> current_owner{nullptr};
+std::atomic<const char*> current_signal{nullptr};
+
+void set_current_owner(const char *owner)
+{
+    current_owner.store(owner, std::memory_order_relaxed);
+}
+
+/** The state of the signal accounting, see signal-accounting.hpp */
+struct accounting_state_t
+{
+    int64_t warning_threshold = 0;
+
+    /* Interned strings, whose nodes and thus c_str() are never moved */
+    std::unordered_set<std::string> owners;
+    std::unordered_set<std::string> trace_names;
+
+    /* Keyed by (owner, signal ID) */
+    std::map<std::pair<const char*, uint32_t>, handler_totals_t> totals;
+    std::map<std::pair<const char*, uint32_t>, const char*> trace_name_cache;
+
+    static accounting_state_t& get()
+    {
+        static accounting_state_t state;
+        return state;
+    }
+
+    const char *get_trace_name(const char *owner, const wf::signal_id_t& id)
+    {
+        auto& name = trace_name_cache[{owner, id.get_id()}];
+        if (!name)
+        {
+            name = trace_names.insert(
+                std::string(owner) + ": " + id.get_name()).first->c_str();
+        }
+
+        return name;
+    }
+};
+}
+
+wf::signal_accounting::owner_guard_t::owner_guard_t(const std::string& owner)
+{
+    auto& state = accounting_state_t::get();
+    this->previous = wf::signal_accounting::get_current_owner();
+    set_current_owner(state.owners.insert(owner).first->c_str());
+}
+
+wf::signal_accounting::owner_guard_t::~owner_guard_t()
+{
+    set_current_owner(previous);
+}
+
+const char*wf::signal_accounting::get_current_owner()
+{
+    return current_owner.load(std::memory_order_relaxed);
+}
+
+const char*wf::signal_accounting::get_current_signal()
+{
+    return current_signal.load(std::memory_order_relaxed);
+}
+
+void wf::signal_accounting::set_warning_threshold(int milliseconds)
+{
+    accounting_state_t::get().warning_threshold = milliseconds * 1'000'000ll;
+}
+
+void wf::signal_accounting::reset_totals()
+{
+    accounting_state_t::get().totals.clear();
+}
+
+void wf::signal_accounting::log_totals()
+{
+    auto& state = accounting_state_t::get();
+    std::vector<std::pair<std::pair<const char*, uint32_t>, handler_totals_t>>
+    sorted(state.totals.begin(), state.totals.end());
+    std::sort(sorted.begin(), sorted.end(), [] (auto& a, auto& b)
+    {
+        return a.second.time > b.second.time;
+    });
+
+    std::map<std::string, int64_t> per_owner;
+    for (auto& [key, totals] : sorted)
+    {
+        per_owner[key.first] += totals.time;
+    }
+
+    for (auto& [owner, time] : per_owner)
+    {
+        LOGI("signal handlers of ", owner, ": ", time / 1e6, "ms");
+    }
+
+    for (auto& [key, totals] : sorted)
+    {
+        LOGI("signal handlers of ", key.first, " for ",
+            signal_registry_t::get().names[key.second], ": ", totals.time / 1e6, "ms in ",
+            totals.calls, " calls");
+    }
+}
+
 class wf::signal_connection_t::impl
 {
   public:
     signal_callback_t callback;
-    std::set<nonstd::observer_ptr<signal_provider_t>> connected_providers;
+    /* The plugin which owns the connection, if any */
+    const char *owner = wf::signal_accounting::get_current_owner();
+
+    /**
+     * The providers this connection is connected to, together with the IDs of
+     * the signals it is connected to on each of them.
+     */
+    std::unordered_map<signal_provider_t*, std::vector<uint32_t>>
+    connected_providers;
 
-    void add(signal_provider_t *provider)
+    void add(signal_provider_t *provider, uint32_t signal)
     {
-        connected_providers.insert(provider);
+        connected_providers[provider].push_back(signal);
     }
 
     void remove(signal_provider_t *provider)
@@ -50,7 +224,12 @@ void wf::signal_connection_t::emit(signal_data_t *data)
 
 void wf::signal_connection_t::disconnect()
 {
-    auto connected = this->priv->connected_providers;
+    std::vector<signal_provider_t*> connected;
+    for (auto& provider : this->priv->connected_providers)
+    {
+        connected.push_back(provider.first);
+    }
+
     for (auto& provider : connected)
     {
         provider->disconnect_signal(this);
@@ -60,11 +239,58 @@ void wf::signal_connection_t::disconnect()
 class wf::signal_provider_t::sprovider_impl
 {
   public:
-    std::unordered_map<std::string,
-        wf::safe_list_t<signal_connection_t*>> signals;
+    /** Everything connected to a single signal */
+    struct listeners_t
+    {
+        wf::safe_list_t<signal_connection_t*> connections;
+#ifdef WF_DEPRECATED_SIGNALS
+        wf::safe_list_t<signal_callback_t*> deprecated;
+#endif
 
-    std::unordered_map<std::string,
-        wf::safe_list_t<signal_callback_t*>> deprecated_signals;
+        bool empty() const
+        {
+#ifdef WF_DEPRECATED_SIGNALS
+            return connections.size() == 0 && deprecated.size() == 0;
+#else
+            return connections.size() == 0;
+#endif
+        }
+    };
+
+    std::unordered_map<uint32_t, listeners_t> signals;
+
+    /**
+     * A bit for each signal ID which has listeners. Signal IDs are small and
+     * dense, so this is checked before looking up the listeners in the map.
+     */
+    std::vector<uint64_t> listened;
+
+    bool is_listened(uint32_t id) const
+    {
+        return (id / 64 < listened.size()) &&
+               (listened[id / 64] & (1ull << (id % 64)));
+    }
+
+    listeners_t& connect(uint32_t id)
+    {
+        if (id / 64 >= listened.size())
+        {
+            listened.resize(id / 64 + 1, 0);
+        }
+
+        listened[id / 64] |= 1ull << (id % 64);
+
+        return signals[id];
+    }
+
+    /** Clear the bit of the signal, if nothing is connected to it anymore */
+    void update_listened(uint32_t id, const listeners_t& listeners)
+    {
+        if (listeners.empty() && (id / 64 < listened.size()))
+        {
+            listened[id / 64] &= ~(1ull << (id % 64));
+        }
+    }
 };
 
 wf::signal_provider_t::signal_provider_t()
@@ -76,7 +302,7 @@ wf::signal_provider_t::~signal_provider_t()
 {
     for (auto& s : sprovider_priv->signals)
     {
-        s.second.for_each([=] (signal_connection_t *connection)
+        s.second.connections.for_each([=] (signal_connection_t *connection)
         {
             connection->priv->remove(this);
         });
@@ -86,60 +312,193 @@ wf::signal_provider_t::~signal_provider_t()
 void wf::signal_provider_t::connect_signal(std::string name,
     signal_connection_t *callback)
 {
-    sprovider_priv->signals[name].push_back(callback);
-    callback->priv->add(this);
+    connect_signal(signal_id_t{name}, callback);
+}
+
+void wf::signal_provider_t::connect_signal(const signal_id_t& id,
+    signal_connection_t *callback)
+{
+    sprovider_priv->connect(id.get_id()).connections.push_back(callback);
+    callback->priv->add(this, id.get_id());
 }
 
 void wf::signal_provider_t::disconnect_signal(signal_connection_t *connection)
 {
-    for (auto& s : sprovider_priv->signals)
+    auto& providers = connection->priv->connected_providers;
+    auto it = providers.find(this);
+    if (it == providers.end())
     {
-        s.second.remove_if([=] (signal_connection_t *connected)
-        {
-            if (connected == connection)
-            {
-                connected->priv->remove(this);
-
-                return true;
-            }
+        return;
+    }
 
-            return false;
-        });
+    for (auto& signal : it->second)
+    {
+        auto list = sprovider_priv->signals.find(signal);
+        if (list != sprovider_priv->signals.end())
+        {
+            list->second.connections.remove_all(connection);
+            sprovider_priv->update_listened(signal, list->second);
+        }
     }
+
+    providers.erase(it);
 }
 
+#ifdef WF_DEPRECATED_SIGNALS
 /* Deprecated: */
 void wf::signal_provider_t::connect_signal(std::string name,
     signal_callback_t *callback)
 {
-    sprovider_priv->deprecated_signals[name].push_back(callback);
+    sprovider_priv->connect(signal_id_t{name}.get_id()).deprecated.push_back(
+        callback);
 }
 
 /* Deprecated: */
 void wf::signal_provider_t::disconnect_signal(std::string name,
     signal_callback_t *callback)
 {
-    sprovider_priv->deprecated_signals[name].remove_all(callback);
+    uint32_t id = signal_id_t{name}.get_id();
+    auto it     = sprovider_priv->signals.find(id);
+    if (it != sprovider_priv->signals.end())
+    {
+        it->second.deprecated.remove_all(callback);
+        sprovider_priv->update_listened(id, it->second);
+    }
+}
+
+#endif
+
+bool wf::signal_provider_t::has_listeners(const signal_id_t& id) const
+{
+    return sprovider_priv->is_listened(id.get_id());
 }
 
 /* Emit the given signal. No type checking for data is required */
 void wf::signal_provider_t::emit_signal(std::string name, wf::signal_data_t *data)
 {
-    sprovider_priv->signals[name].for_each([data] (auto call)
+    emit_signal(signal_id_t{name}, data);
+}
+
+/**
+ * Call the connection's callback on behalf of the plugin which owns it, and
+ * account the time it takes if needed.
+ */
+static void emit_to_connection(wf::signal_connection_t *connection,
+    const wf::signal_id_t& id, wf::signal_data_t *data)
+{
+    auto& state = accounting_state_t::get();
+    const char *owner = connection->priv->owner;
+    if (!owner)
+    {
+        connection->emit(data);
+
+        return;
+    }
+
+    /* The connection may be destroyed by its own callback */
+    const char *previous = wf::signal_accounting::get_current_owner();
+    set_current_owner(owner);
+    if (!wf::trace::is_active() && (state.warning_threshold <= 0))
+    {
+        connection->emit(data);
+        set_current_owner(previous);
+
+        return;
+    }
+
+    int64_t start = wf::trace::get_time();
+    connection->emit(data);
+    int64_t end = wf::trace::get_time();
+    set_current_owner(previous);
+
+    if (wf::trace::is_recording())
+    {
+        auto& totals = state.totals[{owner, id.get_id()}];
+        totals.time += end - start;
+        totals.calls++;
+    }
+
+    if (wf::trace::is_active())
+    {
+        wf::trace::add_event(state.get_trace_name(owner, id), start, end);
+    }
+
+    if ((state.warning_threshold > 0) && (end - start > state.warning_threshold))
+    {
+        LOGW("Signal handler of ", owner, " for ", id.get_name(), " took ",
+            (end - start) / 1e6, "ms");
+    }
+}
+
+void wf::signal_provider_t::emit_signal(const signal_id_t& id,
+    wf::signal_data_t *data)
+{
+    if (!sprovider_priv->is_listened(id.get_id()))
     {
-        call->emit(data);
+        return;
+    }
+
+    auto it = sprovider_priv->signals.find(id.get_id());
+    if (it == sprovider_priv->signals.end())
+    {
+        return;
+    }
+
+    /* The listeners stay in the map while the signal is emitted, because
+     * entries are never erased from it */
+    auto& listeners = it->second;
+
+    /* Signal names are never freed, so they can be used in traces */
+    const char *name = id.get_name().c_str();
+    const char *previous = current_signal.load(std::memory_order_relaxed);
+    current_signal.store(name, std::memory_order_relaxed);
+    wf::trace::scope_t trace{wf::trace::is_active() ? name : nullptr};
+    listeners.connections.for_each([&] (auto call)
+    {
+        emit_to_connection(call, id, data);
     });
 
-    /* Deprecated: */
-    sprovider_priv->deprecated_signals[name].for_each([data] (auto call)
+#ifdef WF_DEPRECATED_SIGNALS
+    listeners.deprecated.for_each([data] (auto call)
     {
         (*call)(data);
     });
+#endif
+    current_signal.store(previous, std::memory_order_relaxed);
+}
+
+namespace
+{
+/**
+ * Maps the names of custom data types to their slot indices. Only types
+ * accessed with the typed object_base_t API get a slot, so that dynamic
+ * names do not grow the slots of every object.
+ */
+struct data_slot_registry_t
+{
+    std::unordered_map<std::string, uint32_t> slots;
+
+    static data_slot_registry_t& get()
+    {
+        static data_slot_registry_t registry;
+        return registry;
+    }
+
+    /** @return The slot for the given name, or -1 if it has none. */
+    int64_t find(const std::string& name) const
+    {
+        auto it = slots.find(name);
+        return it == slots.end() ? -1 : (int64_t)it->second;
+    }
+};
 }
 
 class wf::object_base_t::obase_impl
 {
   public:
+    /** Data stored for registered types, indexed by slot */
+    std::vector<std::unique_ptr<custom_data_t>> slots;
+    /** Data stored under names which are not a registered type */
     std::unordered_map<std::string, std::unique_ptr<custom_data_t>> data;
     uint32_t object_id;
 };
@@ -165,20 +524,110 @@ uint32_t wf::object_base_t::get_id() const
     return obase_priv->object_id;
 }
 
+uint32_t wf::object_base_t::_register_data_slot(const std::string& name)
+{
+    auto& registry = data_slot_registry_t::get();
+    auto it = registry.slots.find(name);
+    if (it != registry.slots.end())
+    {
+        return it->second;
+    }
+
+    uint32_t slot = registry.slots.size();
+    registry.slots[name] = slot;
+
+    return slot;
+}
+
+wf::custom_data_t*wf::object_base_t::_fetch_slot(uint32_t slot)
+{
+    auto& slots = obase_priv->slots;
+
+    return slot < slots.size() ? slots[slot].get() : nullptr;
+}
+
+void wf::object_base_t::_store_slot(std::unique_ptr<custom_data_t> data,
+    uint32_t slot)
+{
+    auto& slots = obase_priv->slots;
+    if (slot >= slots.size())
+    {
+        slots.resize(slot + 1);
+    }
+
+    /* The old data is destroyed after the slot has been updated, in case its
+     * destructor accesses the data of this object */
+    std::swap(slots[slot], data);
+}
+
+wf::custom_data_t*wf::object_base_t::_release_slot(uint32_t slot)
+{
+    auto& slots = obase_priv->slots;
+
+    return slot < slots.size() ? slots[slot].release() : nullptr;
+}
+
 bool wf::object_base_t::has_data(std::string name)
 {
-    return obase_priv->data[name] != nullptr;
+    return _fetch_data(name) != nullptr;
 }
 
 void wf::object_base_t::erase_data(std::string name)
 {
-    auto data = std::move(obase_priv->data[name]);
-    obase_priv->data.erase(name);
-    data.reset();
+    std::unique_ptr<custom_data_t> data{_fetch_erase(name)};
+}
+
+namespace
+{
+/**
+ * The number of custom data objects, by the name of their type. The map is
+ * never destroyed, because custom data may outlive static objects.
+ */
+std::unordered_map<const char*, int64_t>& custom_data_counts()
+{
+    static auto counts = new std::unordered_map<const char*, int64_t>();
+    return *counts;
+}
+}
+
+wf::custom_data_t::~custom_data_t()
+{
+    if (counted_type)
+    {
+        --custom_data_counts()[counted_type];
+    }
+}
+
+std::vector<wf::memory_accounting::custom_data_usage_t> wf::memory_accounting::
+get_custom_data_usage()
+{
+    /* The same type may have several names, from different plugins */
+    std::map<std::string, int64_t> by_type;
+    for (auto& [type, count] : custom_data_counts())
+    {
+        by_type[type] += count;
+    }
+
+    std::vector<custom_data_usage_t> usage;
+    for (auto& [type, count] : by_type)
+    {
+        if (count > 0)
+        {
+            usage.push_back({type, count});
+        }
+    }
+
+    return usage;
 }
 
 wf::custom_data_t*wf::object_base_t::_fetch_data(std::string name)
 {
+    auto slot = data_slot_registry_t::get().find(name);
+    if (slot >= 0)
+    {
+        return _fetch_slot(slot);
+    }
+
     auto it = obase_priv->data.find(name);
     if (it == obase_priv->data.end())
     {
@@ -190,8 +639,20 @@ wf::custom_data_t*wf::object_base_t::_fetch_data(std::string name)
 
 wf::custom_data_t*wf::object_base_t::_fetch_erase(std::string name)
 {
-    auto data = obase_priv->data[name].release();
-    erase_data(name);
+    auto slot = data_slot_registry_t::get().find(name);
+    if (slot >= 0)
+    {
+        return _release_slot(slot);
+    }
+
+    auto it = obase_priv->data.find(name);
+    if (it == obase_priv->data.end())
+    {
+        return nullptr;
+    }
+
+    auto data = it->second.release();
+    obase_priv->data.erase(it);
 
     return data;
 }
@@ -199,10 +660,27 @@ wf::custom_data_t*wf::object_base_t::_fetch_erase(std::string name)
 void wf::object_base_t::_store_data(std::unique_ptr<wf::custom_data_t> data,
     std::string name)
 {
-    obase_priv->data[name] = std::move(data);
+    if (data && !data->counted_type)
+    {
+        data->counted_type = typeid(*data).name();
+        ++custom_data_counts()[data->counted_type];
+    }
+
+    auto slot = data_slot_registry_t::get().find(name);
+    if (slot >= 0)
+    {
+        _store_slot(std::move(data), slot);
+    } else
+    {
+        std::swap(obase_priv->data[name], data);
+    }
 }
 
 void wf::object_base_t::_clear_data()
 {
+    /* Destroy the data after it has been removed from the object */
+    auto slots = std::move(obase_priv->slots);
+    auto data  = std::move(obase_priv->data);
+    obase_priv->slots.clear();
     obase_priv->data.clear();
 }
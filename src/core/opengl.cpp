@@ -1,12 +1,23 @@
 #include <wayfire/util/log.hpp>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include "opengl-priv.hpp"
+#include "program-cache.hpp"
 #include "wayfire/output.hpp"
 #include "core-impl.hpp"
+#include "signal-accounting.hpp"
+#include <wayfire/option-wrapper.hpp>
 #include "config.h"
 #include <wayfire/nonstd/wlroots-full.hpp>
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
 
 #include "shaders.tpp"
 
@@ -49,6 +60,15 @@ namespace OpenGL
  * Each of the following functions uses the currently bound context
  */
 program_t program, color_program;
+
+/* Persistent vertex buffer used for batched quads */
+GLuint batch_vbo = 0;
+size_t batch_vbo_size = 0;
+std::vector<GLfloat> batch_vertices;
+
+/* Handles for the uniforms used by the builtin programs */
+uniform_handle_t program_mvp, program_color;
+uniform_handle_t color_program_mvp, color_program_color;
 GLuint compile_shader(std::string source, GLuint type)
 {
     GLuint shader = GL_CALL(glCreateShader(type));
@@ -77,6 +97,15 @@ GLuint compile_shader(std::string source, GLuint type)
 /* Create a very simple gl program from the given shader sources */
 GLuint compile_program(std::string vertex_source, std::string frag_source)
 {
+    /* Compiling takes long on some drivers, so linked programs are cached
+     * across restarts */
+    auto& cache = wf::program_cache_t::get();
+    std::string sources = vertex_source + '\0' + frag_source;
+    if (GLuint cached = cache.load(sources))
+    {
+        return cached;
+    }
+
     auto vertex_shader   = compile_shader(vertex_source, GL_VERTEX_SHADER);
     auto fragment_shader = compile_shader(frag_source, GL_FRAGMENT_SHADER);
     auto result_program  = GL_CALL(glCreateProgram());
@@ -88,6 +117,8 @@ GLuint compile_program(std::string vertex_source, std::string frag_source)
     GL_CALL(glDeleteShader(vertex_shader));
     GL_CALL(glDeleteShader(fragment_shader));
 
+    cache.store(sources, result_program);
+
     return result_program;
 }
 
@@ -101,6 +132,13 @@ void init()
     color_program.set_simple(compile_program(default_vertex_shader_source,
         color_rect_fragment_source));
 
+    program_mvp   = program.get_uniform("MVP");
+    program_color = program.get_uniform("color");
+    color_program_mvp   = color_program.get_uniform("MVP");
+    color_program_color = color_program.get_uniform("color");
+
+    GL_CALL(glGenBuffers(1, &batch_vbo));
+
     render_end();
 }
 
@@ -109,6 +147,9 @@ void fini()
     render_begin();
     program.free_resources();
     color_program.free_resources();
+    GL_CALL(glDeleteBuffers(1, &batch_vbo));
+    batch_vbo = 0;
+    batch_vbo_size = 0;
     render_end();
 }
 
@@ -130,19 +171,371 @@ void unbind_output(wf::output_t *output)
     current_output_fb = 0;
 }
 
-void render_transformed_texture(wf::texture_t tex,
+namespace
+{
+/* The state last set through the wrappers, -1 where it is not known */
+struct gl_state_t
+{
+    int64_t draw_fb = -1;
+    int64_t read_fb = -1;
+    int64_t program = -1;
+    int viewport[4] = {-1, -1, -1, -1};
+
+    int blend = -1;
+    int64_t blend_src = -1;
+    int64_t blend_dst = -1;
+
+    /* Bitmasks of the attribute locations below 32 */
+    uint32_t known_attribs   = 0;
+    uint32_t enabled_attribs = 0;
+};
+
+gl_state_t gl_state;
+state_stats_t state_stats;
+
+/** Count a state change, @return Whether it should be skipped */
+bool is_redundant(bool redundant)
+{
+    if (redundant)
+    {
+        ++state_stats.elided;
+    } else
+    {
+        ++state_stats.issued;
+    }
+
+    return redundant;
+}
+
+void set_vertex_attrib(GLuint location, bool enabled)
+{
+    uint32_t bit = (location < 32) ? (1u << location) : 0;
+    bool known   = gl_state.known_attribs & bit;
+    if (is_redundant(known && (bool(gl_state.enabled_attribs & bit) == enabled)))
+    {
+        return;
+    }
+
+    if (enabled)
+    {
+        GL_CALL(glEnableVertexAttribArray(location));
+        gl_state.enabled_attribs |= bit;
+    } else
+    {
+        GL_CALL(glDisableVertexAttribArray(location));
+        gl_state.enabled_attribs &= ~bit;
+    }
+
+    gl_state.known_attribs |= bit;
+}
+
+/**
+ * The depth buffers attached with attach_depth_buffer(). There is one
+ * renderbuffer per size, shared by all framebuffers of that size, and it is
+ * deleted when no framebuffer uses it anymore.
+ */
+struct depth_buffer_pool_t
+{
+    struct buffer_t
+    {
+        GLuint renderbuffer;
+        int users = 0;
+    };
+
+    using dimensions_t = std::pair<int, int>;
+    std::map<dimensions_t, buffer_t> buffers;
+    /* The size of the depth buffer attached to each framebuffer */
+    std::unordered_map<GLuint, dimensions_t> attached;
+
+    /* GL_DEPTH_COMPONENT24 needs an extension on GLES 2.0 */
+    GLenum format = GL_NONE;
+
+    buffer_t& get_buffer(dimensions_t size)
+    {
+        auto it = buffers.find(size);
+        if (it != buffers.end())
+        {
+            return it->second;
+        }
+
+        if (format == GL_NONE)
+        {
+            auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+            format = (extensions && strstr(extensions, "GL_OES_depth24")) ?
+                GL_DEPTH_COMPONENT24 : GL_DEPTH_COMPONENT16;
+        }
+
+        auto& buffer = buffers[size];
+        GL_CALL(glGenRenderbuffers(1, &buffer.renderbuffer));
+        GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, buffer.renderbuffer));
+        GL_CALL(glRenderbufferStorage(GL_RENDERBUFFER, format,
+            size.first, size.second));
+        GL_CALL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+
+        int bytes = (format == GL_DEPTH_COMPONENT16) ? 2 : 4;
+        wf::gpu_memory::track(&buffer,
+            size_t(size.first) * size.second * bytes);
+        wf::gpu_memory::set_owner(&buffer, "depth buffers");
+
+        return buffer;
+    }
+
+    /** Drop the framebuffer's reference to its depth buffer, if any */
+    void release(GLuint fb)
+    {
+        auto it = attached.find(fb);
+        if (it == attached.end())
+        {
+            return;
+        }
+
+        auto buffer = buffers.find(it->second);
+        attached.erase(it);
+        if (--buffer->second.users == 0)
+        {
+            /* Still attached to other framebuffers, but it isn't used by any
+             * of them anymore */
+            GL_CALL(glDeleteRenderbuffers(1, &buffer->second.renderbuffer));
+            wf::gpu_memory::untrack(&buffer->second);
+            buffers.erase(buffer);
+        }
+    }
+};
+
+depth_buffer_pool_t depth_buffer_pool;
+
+/* Deleting a bound framebuffer binds the default one instead */
+void forget_framebuffer(GLuint fb)
+{
+    depth_buffer_pool.release(fb);
+    if (gl_state.draw_fb == fb)
+    {
+        gl_state.draw_fb = 0;
+    }
+
+    if (gl_state.read_fb == fb)
+    {
+        gl_state.read_fb = 0;
+    }
+}
+}
+
+void bind_framebuffer(GLenum target, GLuint fb)
+{
+    bool draw = (target != GL_READ_FRAMEBUFFER);
+    bool read = (target != GL_DRAW_FRAMEBUFFER);
+    if (is_redundant((!draw || (gl_state.draw_fb == fb)) &&
+        (!read || (gl_state.read_fb == fb))))
+    {
+        return;
+    }
+
+    GL_CALL(glBindFramebuffer(target, fb));
+    if (draw)
+    {
+        gl_state.draw_fb = fb;
+    }
+
+    if (read)
+    {
+        gl_state.read_fb = fb;
+    }
+}
+
+void set_viewport(int x, int y, int width, int height)
+{
+    auto& v = gl_state.viewport;
+    if (is_redundant((v[0] == x) && (v[1] == y) &&
+        (v[2] == width) && (v[3] == height)))
+    {
+        return;
+    }
+
+    GL_CALL(glViewport(x, y, width, height));
+    v[0] = x;
+    v[1] = y;
+    v[2] = width;
+    v[3] = height;
+}
+
+void use_program(GLuint program)
+{
+    if (is_redundant(gl_state.program == program))
+    {
+        return;
+    }
+
+    GL_CALL(glUseProgram(program));
+    gl_state.program = program;
+}
+
+void enable_blend(GLenum sfactor, GLenum dfactor)
+{
+    if (!is_redundant(gl_state.blend == 1))
+    {
+        GL_CALL(glEnable(GL_BLEND));
+        gl_state.blend = 1;
+    }
+
+    if (!is_redundant((gl_state.blend_src == sfactor) &&
+        (gl_state.blend_dst == dfactor)))
+    {
+        GL_CALL(glBlendFunc(sfactor, dfactor));
+        gl_state.blend_src = sfactor;
+        gl_state.blend_dst = dfactor;
+    }
+}
+
+void disable_blend()
+{
+    if (!is_redundant(gl_state.blend == 0))
+    {
+        GL_CALL(glDisable(GL_BLEND));
+        gl_state.blend = 0;
+    }
+}
+
+void enable_vertex_attrib(GLuint location)
+{
+    set_vertex_attrib(location, true);
+}
+
+void disable_vertex_attrib(GLuint location)
+{
+    set_vertex_attrib(location, false);
+}
+
+void attach_depth_buffer(GLuint fb, int width, int height)
+{
+    auto size = std::make_pair(width, height);
+    auto it   = depth_buffer_pool.attached.find(fb);
+    if ((it != depth_buffer_pool.attached.end()) && (it->second == size))
+    {
+        return;
+    }
+
+    /* Take the new reference first, so that a buffer of the same size is not
+     * deleted and created again */
+    auto& buffer = depth_buffer_pool.get_buffer(size);
+    ++buffer.users;
+    depth_buffer_pool.release(fb);
+
+    bind_framebuffer(GL_FRAMEBUFFER, fb);
+    GL_CALL(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, buffer.renderbuffer));
+    depth_buffer_pool.attached[fb] = size;
+}
+
+namespace
+{
+/* Either glInvalidateFramebuffer or glDiscardFramebufferEXT, which have the
+ * same signature */
+PFNGLDISCARDFRAMEBUFFEREXTPROC discard_framebuffer_fn = nullptr;
+bool discard_framebuffer_loaded = false;
+
+void load_discard_framebuffer()
+{
+    discard_framebuffer_loaded = true;
+
+    auto version = (const char*)glGetString(GL_VERSION);
+    if (version && strncmp(version, "OpenGL ES ", 10) == 0 &&
+        (atoi(version + 10) >= 3))
+    {
+        discard_framebuffer_fn = glInvalidateFramebuffer;
+
+        return;
+    }
+
+    auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (extensions && strstr(extensions, "GL_EXT_discard_framebuffer"))
+    {
+        discard_framebuffer_fn = (PFNGLDISCARDFRAMEBUFFEREXTPROC)
+            eglGetProcAddress("glDiscardFramebufferEXT");
+    }
+}
+}
+
+void discard_framebuffer(GLuint fb, bool color)
+{
+    if (!discard_framebuffer_loaded)
+    {
+        load_discard_framebuffer();
+    }
+
+    if (!discard_framebuffer_fn)
+    {
+        return;
+    }
+
+    GLenum attachments[2];
+    GLsizei count = 0;
+    if (color)
+    {
+        attachments[count++] = fb ? GL_COLOR_ATTACHMENT0 : GL_COLOR_EXT;
+    }
+
+    if (depth_buffer_pool.attached.count(fb))
+    {
+        attachments[count++] = GL_DEPTH_ATTACHMENT;
+    }
+
+    if (count > 0)
+    {
+        bind_framebuffer(GL_FRAMEBUFFER, fb);
+        GL_CALL(discard_framebuffer_fn(GL_FRAMEBUFFER, count, attachments));
+    }
+}
+
+void invalidate_state()
+{
+    gl_state = gl_state_t{};
+}
+
+state_stats_t get_state_stats()
+{
+    return state_stats;
+}
+
+namespace
+{
+/* Client-side vertex arrays, must stay alive until the quad is drawn */
+struct textured_quad_t
+{
+    GLfloat vertexData[8];
+    GLfloat coordData[8];
+};
+}
+
+/**
+ * Disable blending if the texture covers what is below it, which saves memory
+ * bandwidth. Blending has to be enabled again after drawing, other code
+ * expects it to be enabled.
+ */
+static void setup_texture_blend(const wf::texture_t& tex, glm::vec4 color,
+    uint32_t bits)
+{
+    bool opaque = (bits & TEXTURE_OPAQUE) ||
+        (tex.type == wf::TEXTURE_TYPE_RGBX);
+    if (opaque && (color.a == 1.0f))
+    {
+        disable_blend();
+    } else
+    {
+        enable_blend();
+    }
+}
+
+/**
+ * Bind the default program and set up everything needed to draw a textured
+ * quad with glDrawArrays(GL_TRIANGLE_FAN, 0, 4), so that it can be drawn
+ * several times with different scissor boxes.
+ */
+static void prepare_textured_quad(textured_quad_t& quad, wf::texture_t tex,
     const gl_geometry& g, const gl_geometry& texg,
     glm::mat4 model, glm::vec4 color, uint32_t bits)
 {
     program.use(tex.type);
 
-    GLfloat vertexData[] = {
-        g.x1, g.y2,
-        g.x2, g.y2,
-        g.x2, g.y1,
-        g.x1, g.y1,
-    };
-
     gl_geometry final_texg = (bits & TEXTURE_USE_TEX_GEOMETRY) ?
         texg : gl_geometry{0.0f, 0.0f, 1.0f, 1.0f};
 
@@ -158,24 +551,39 @@ void render_transformed_texture(wf::texture_t tex,
         final_texg.x2 = 1.0 - final_texg.x2;
     }
 
-    GLfloat coordData[] = {
-        final_texg.x1, final_texg.y1,
-        final_texg.x2, final_texg.y1,
-        final_texg.x2, final_texg.y2,
-        final_texg.x1, final_texg.y2,
+    quad = {
+        {
+            g.x1, g.y2,
+            g.x2, g.y2,
+            g.x2, g.y1,
+            g.x1, g.y1,
+        },
+        {
+            final_texg.x1, final_texg.y1,
+            final_texg.x2, final_texg.y1,
+            final_texg.x2, final_texg.y2,
+            final_texg.x1, final_texg.y2,
+        }
     };
 
     program.set_active_texture(tex);
-    program.attrib_pointer("position", 2, 0, vertexData);
-    program.attrib_pointer("uvPosition", 2, 0, coordData);
-    program.uniformMatrix4f("MVP", model);
-    program.uniform4f("color", color);
+    program.attrib_pointer("position", 2, 0, quad.vertexData);
+    program.attrib_pointer("uvPosition", 2, 0, quad.coordData);
+    program.uniformMatrix4f(program_mvp, model);
+    program.uniform4f(program_color, color);
 
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+    setup_texture_blend(tex, color, bits);
+}
 
+void render_transformed_texture(wf::texture_t tex,
+    const gl_geometry& g, const gl_geometry& texg,
+    glm::mat4 model, glm::vec4 color, uint32_t bits)
+{
+    textured_quad_t quad;
+    prepare_textured_quad(quad, tex, g, texg, model, color, bits);
+    GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
     program.deactivate();
+    enable_blend();
 }
 
 void render_transformed_texture(wf::texture_t texture,
@@ -200,6 +608,251 @@ void render_texture(wf::texture_t texture,
         framebuffer.get_orthographic_projection(), color, bits);
 }
 
+/**
+ * Add a sub-quad for each rectangle of the region to batch_vertices, with the
+ * same mapping as the full quad in render_transformed_texture().
+ */
+static void push_batch_quads(const wf::geometry_t& geometry,
+    const gl_geometry& texg, const wf::region_t& region)
+{
+    auto push_vertex = [&] (float x, float y)
+    {
+        float u = (x - geometry.x) / geometry.width;
+        float v = (geometry.y + geometry.height - y) / geometry.height;
+        batch_vertices.push_back(x);
+        batch_vertices.push_back(y);
+        batch_vertices.push_back(texg.x1 + (texg.x2 - texg.x1) * u);
+        batch_vertices.push_back(texg.y1 + (texg.y2 - texg.y1) * v);
+    };
+
+    for (const auto& rect : region)
+    {
+        push_vertex(rect.x1, rect.y1);
+        push_vertex(rect.x2, rect.y1);
+        push_vertex(rect.x2, rect.y2);
+        push_vertex(rect.x1, rect.y1);
+        push_vertex(rect.x2, rect.y2);
+        push_vertex(rect.x1, rect.y2);
+    }
+}
+
+/** Upload batch_vertices to batch_vbo */
+static void upload_batch_vertices()
+{
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, batch_vbo));
+    size_t bytes = batch_vertices.size() * sizeof(GLfloat);
+    if (bytes > batch_vbo_size)
+    {
+        GL_CALL(glBufferData(GL_ARRAY_BUFFER, bytes, batch_vertices.data(),
+            GL_STREAM_DRAW));
+        batch_vbo_size = bytes;
+    } else
+    {
+        /* Orphan the old storage, so that we don't wait for previous draws */
+        GL_CALL(glBufferData(GL_ARRAY_BUFFER, batch_vbo_size, NULL,
+            GL_STREAM_DRAW));
+        GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, bytes,
+            batch_vertices.data()));
+    }
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+/**
+ * Point the attributes of the active program to batch_vbo, which holds pairs
+ * of positions and texture coordinates.
+ */
+static void set_batch_attribs()
+{
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, batch_vbo));
+    const int stride = 4 * sizeof(GLfloat);
+    program.attrib_pointer("position", 2, stride, (void*)0);
+    program.attrib_pointer("uvPosition", 2, stride,
+        (void*)(2 * sizeof(GLfloat)));
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+/** Draw the triangles in batch_vertices with the given texture */
+static void draw_batch_vertices(const wf::texture_t& texture,
+    const wf::framebuffer_t& framebuffer, glm::vec4 color, uint32_t bits = 0)
+{
+    program.use(texture.type);
+    program.set_active_texture(texture);
+    upload_batch_vertices();
+    set_batch_attribs();
+
+    program.uniformMatrix4f(program_mvp,
+        framebuffer.get_orthographic_projection());
+    program.uniform4f(program_color, color);
+
+    setup_texture_blend(texture, color, bits);
+    GL_CALL(glDrawArrays(GL_TRIANGLES, 0, batch_vertices.size() / 4));
+
+    program.deactivate();
+    enable_blend();
+}
+
+void render_texture_damage(wf::texture_t texture,
+    const wf::framebuffer_t& framebuffer,
+    const wf::geometry_t& geometry, const wf::region_t& damage,
+    glm::vec4 color, uint32_t bits)
+{
+    /* Sub-quads match the scissor boxes exactly only if logical coordinates
+     * map to whole pixels. Otherwise, fall back to scissoring, but set up the
+     * GL state only once. */
+    if (framebuffer.has_nonstandard_transform ||
+        (framebuffer.scale != std::floor(framebuffer.scale)))
+    {
+        if (damage.empty())
+        {
+            return;
+        }
+
+        gl_geometry gg;
+        gg.x1 = geometry.x;
+        gg.y1 = geometry.y;
+        gg.x2 = gg.x1 + geometry.width;
+        gg.y2 = gg.y1 + geometry.height;
+
+        textured_quad_t quad;
+        prepare_textured_quad(quad, texture, gg, {},
+            framebuffer.get_orthographic_projection(), color,
+            bits & ~TEXTURE_USE_TEX_GEOMETRY);
+        for (const auto& rect : damage)
+        {
+            framebuffer.logic_scissor(wlr_box_from_pixman_box(rect));
+            GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        }
+
+        program.deactivate();
+        enable_blend();
+
+        return;
+    }
+
+    auto region = damage & geometry;
+    if (region.empty() || (geometry.width <= 0) || (geometry.height <= 0))
+    {
+        return;
+    }
+
+    gl_geometry texg = {0.0f, 0.0f, 1.0f, 1.0f};
+    if (bits & TEXTURE_TRANSFORM_INVERT_Y)
+    {
+        texg.y1 = 1.0 - texg.y1;
+        texg.y2 = 1.0 - texg.y2;
+    }
+
+    if (bits & TEXTURE_TRANSFORM_INVERT_X)
+    {
+        texg.x1 = 1.0 - texg.x1;
+        texg.x2 = 1.0 - texg.x2;
+    }
+
+    batch_vertices.clear();
+    push_batch_quads(geometry, texg, region);
+
+    /* The sub-quads are clipped already, but a scissor box from previous
+     * rendering may still be active. */
+    framebuffer.logic_scissor(wlr_box_from_pixman_box(region.get_extents()));
+    draw_batch_vertices(texture, framebuffer, color, bits);
+}
+
+void render_texture_batch(const wf::texture_t& texture,
+    const wf::framebuffer_t& framebuffer,
+    const std::vector<texture_batch_entry_t>& entries, glm::vec4 color)
+{
+    batch_vertices.clear();
+    pixman_box32_t extents = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+    for (auto& entry : entries)
+    {
+        if ((entry.geometry.width <= 0) || (entry.geometry.height <= 0))
+        {
+            continue;
+        }
+
+        auto region = *entry.damage & entry.geometry;
+        if (region.empty())
+        {
+            continue;
+        }
+
+        auto box = region.get_extents();
+        extents.x1 = std::min(extents.x1, box.x1);
+        extents.y1 = std::min(extents.y1, box.y1);
+        extents.x2 = std::max(extents.x2, box.x2);
+        extents.y2 = std::max(extents.y2, box.y2);
+        push_batch_quads(entry.geometry, entry.texture_box, region);
+    }
+
+    if (batch_vertices.empty())
+    {
+        return;
+    }
+
+    wf::texture_t plain = texture;
+    plain.invert_y     = false;
+    plain.has_viewport = false;
+    framebuffer.logic_scissor(wlr_box_from_pixman_box(extents));
+    draw_batch_vertices(plain, framebuffer, color);
+}
+
+void render_transformed_texture_batch(
+    const std::vector<transformed_texture_entry_t>& entries, glm::vec4 color)
+{
+    batch_vertices.clear();
+    for (auto& entry : entries)
+    {
+        float x1 = entry.geometry.x;
+        float y1 = entry.geometry.y;
+        float x2 = x1 + entry.geometry.width;
+        float y2 = y1 + entry.geometry.height;
+
+        /* The same quad as in render_transformed_texture() */
+        batch_vertices.insert(batch_vertices.end(), {
+            x1, y2, 0.0f, 0.0f,
+            x2, y2, 1.0f, 0.0f,
+            x2, y1, 1.0f, 1.0f,
+            x1, y1, 0.0f, 1.0f,
+        });
+    }
+
+    if (batch_vertices.empty())
+    {
+        return;
+    }
+
+    upload_batch_vertices();
+
+    /* Switching textures is cheap, the program has to be set up again only if
+     * the type of the texture changes */
+    int active_type = -1;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto& texture = entries[i].texture;
+        if (texture.type != active_type)
+        {
+            if (active_type >= 0)
+            {
+                program.deactivate();
+            }
+
+            program.use(texture.type);
+            set_batch_attribs();
+            program.uniform4f(program_color, color);
+            active_type = texture.type;
+        }
+
+        program.set_active_texture(texture);
+        program.uniformMatrix4f(program_mvp, entries[i].transform);
+        setup_texture_blend(texture, color, 0);
+        GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 4 * i, 4));
+    }
+
+    program.deactivate();
+    enable_blend();
+}
+
 void render_rectangle(wf::geometry_t geometry, wf::color_t color,
     glm::mat4 matrix)
 {
@@ -215,11 +868,11 @@ void render_rectangle(wf::geometry_t geometry, wf::color_t color,
     };
 
     color_program.attrib_pointer("position", 2, 0, vertexData);
-    color_program.uniformMatrix4f("MVP", matrix);
-    color_program.uniform4f("color", {color.r, color.g, color.b, color.a});
+    color_program.uniformMatrix4f(color_program_mvp, matrix);
+    color_program.uniform4f(color_program_color,
+        {color.r, color.g, color.b, color.a});
 
-    GL_CALL(glEnable(GL_BLEND));
-    GL_CALL(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
+    enable_blend();
     GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
 
     color_program.deactivate();
@@ -245,7 +898,17 @@ void render_begin(int32_t viewport_width, int32_t viewport_height, uint32_t fb)
 
     wlr_renderer_begin(wf::get_core_impl().renderer,
         viewport_width, viewport_height);
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+
+    /* wlr_renderer_begin() sets up the viewport and premultiplied blending */
+    invalidate_state();
+    gl_state.viewport[0] = 0;
+    gl_state.viewport[1] = 0;
+    gl_state.viewport[2] = viewport_width;
+    gl_state.viewport[3] = viewport_height;
+    gl_state.blend     = 1;
+    gl_state.blend_src = GL_ONE;
+    gl_state.blend_dst = GL_ONE_MINUS_SRC_ALPHA;
+    bind_framebuffer(GL_FRAMEBUFFER, fb);
 }
 
 void clear(wf::color_t col, uint32_t mask)
@@ -256,9 +919,10 @@ void clear(wf::color_t col, uint32_t mask)
 
 void render_end()
 {
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, current_output_fb));
+    bind_framebuffer(GL_FRAMEBUFFER, current_output_fb);
     wlr_renderer_scissor(wf::get_core().renderer, NULL);
     wlr_renderer_end(wf::get_core().renderer);
+    invalidate_state();
 }
 }
 
@@ -284,6 +948,271 @@ static std::string framebuffer_status_to_str(
     }
 }
 
+namespace
+{
+struct gpu_memory_state_t
+{
+    std::unordered_map<const void*, wf::gpu_memory::allocation_t> allocations;
+    size_t total = 0;
+
+    std::vector<std::function<void()>*> pressure_callbacks;
+    wf::wl_idle_call idle_pressure;
+    bool warned  = false;
+
+    std::vector<wf::gpu_memory::releasable_t*> releasables;
+    wf::wl_timer idle_release_timer;
+
+    static gpu_memory_state_t& get()
+    {
+        static gpu_memory_state_t state;
+        return state;
+    }
+
+    void check_limit()
+    {
+        /* Loaded lazily, GPU memory is first allocated after the config */
+        static wf::option_wrapper_t<int> soft_limit{"core/gpu_memory_soft_limit"};
+        size_t limit = size_t(std::max(0, (int)soft_limit)) * 1024 * 1024;
+        if ((limit == 0) || (total <= limit) || idle_pressure.is_connected())
+        {
+            return;
+        }
+
+        idle_pressure.run_once([=] ()
+        {
+            size_t before = total;
+            auto callbacks = pressure_callbacks;
+            for (auto& callback : callbacks)
+            {
+                (*callback)();
+            }
+
+            if (total > limit)
+            {
+                release_least_recently_used(total - limit);
+            }
+
+            if ((total > limit) && !warned)
+            {
+                LOGW("GPU memory use ", total / (1024 * 1024), "MiB is over the ",
+                    "soft limit, freed ", (before - total) / (1024 * 1024),
+                    "MiB from caches");
+                warned = true;
+            } else if (total <= limit)
+            {
+                warned = false;
+            }
+        });
+    }
+
+    /**
+     * Release the least recently used resources which have not been used
+     * recently, until their costs add up to the given amount.
+     */
+    void release_least_recently_used(size_t amount)
+    {
+        /* Releasing something which is drawn right now only makes it
+         * re-create the resource on the next frame */
+        static constexpr uint32_t MIN_IDLE_TIME = 5000;
+
+        uint32_t now = wf::get_current_time();
+        std::vector<wf::gpu_memory::releasable_t*> candidates;
+        for (auto& resource : releasables)
+        {
+            if (!resource->is_released() &&
+                (now - resource->get_last_use() >= MIN_IDLE_TIME))
+            {
+                candidates.push_back(resource);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [] (auto a, auto b)
+        {
+            return a->get_last_use() < b->get_last_use();
+        });
+
+        size_t released = 0;
+        for (auto& resource : candidates)
+        {
+            if (released >= amount)
+            {
+                break;
+            }
+
+            /* Releasing may unregister other resources */
+            if (std::count(releasables.begin(), releasables.end(), resource))
+            {
+                released += resource->get_cost();
+                resource->release();
+            }
+        }
+    }
+
+    /** Check the resources for idle ones every minute, if enabled */
+    void schedule_idle_release()
+    {
+        static wf::option_wrapper_t<int> timeout{
+            "core/gpu_idle_release_timeout"};
+        if ((timeout <= 0) || idle_release_timer.is_connected())
+        {
+            return;
+        }
+
+        idle_release_timer.set_timeout(60 * 1000, [=] ()
+        {
+            uint32_t idle_time = std::max(0, (int)timeout) * 60 * 1000;
+            uint32_t now = wf::get_current_time();
+            auto resources = releasables;
+            for (auto& resource : resources)
+            {
+                if (std::count(releasables.begin(), releasables.end(),
+                    resource) && !resource->is_released() &&
+                    (now - resource->get_last_use() >= idle_time))
+                {
+                    resource->release();
+                }
+            }
+
+            return (idle_time > 0) && std::any_of(releasables.begin(),
+                releasables.end(), [] (auto resource)
+            {
+                return !resource->is_released();
+            });
+        }, false);
+    }
+};
+}
+
+wf::gpu_memory::releasable_t::releasable_t(size_t cost,
+    std::function<void()> release, std::function<void()> recreate)
+{
+    this->cost = cost;
+    this->release_callback  = release;
+    this->recreate_callback = recreate;
+    this->last_use = wf::get_current_time();
+
+    auto& state = gpu_memory_state_t::get();
+    state.releasables.push_back(this);
+    state.schedule_idle_release();
+}
+
+wf::gpu_memory::releasable_t::~releasable_t()
+{
+    auto& releasables = gpu_memory_state_t::get().releasables;
+    releasables.erase(std::remove(releasables.begin(), releasables.end(), this),
+        releasables.end());
+}
+
+void wf::gpu_memory::releasable_t::use()
+{
+    last_use = wf::get_current_time();
+    if (released)
+    {
+        released = false;
+        if (recreate_callback)
+        {
+            recreate_callback();
+        }
+
+        gpu_memory_state_t::get().schedule_idle_release();
+    }
+}
+
+void wf::gpu_memory::releasable_t::release()
+{
+    if (!released)
+    {
+        released = true;
+        release_callback();
+    }
+}
+
+bool wf::gpu_memory::releasable_t::is_released() const
+{
+    return released;
+}
+
+void wf::gpu_memory::releasable_t::set_cost(size_t cost)
+{
+    this->cost = cost;
+}
+
+size_t wf::gpu_memory::releasable_t::get_cost() const
+{
+    return cost;
+}
+
+uint32_t wf::gpu_memory::releasable_t::get_last_use() const
+{
+    return last_use;
+}
+
+void wf::gpu_memory::track(const void *object, size_t bytes)
+{
+    auto& state = gpu_memory_state_t::get();
+    auto it     = state.allocations.find(object);
+    if (it == state.allocations.end())
+    {
+        const char *owner = wf::signal_accounting::get_current_owner();
+        it = state.allocations.insert({object,
+            {owner ? owner : "unknown", 0, 0}}).first;
+    }
+
+    state.total += bytes - it->second.bytes;
+    it->second.bytes = bytes;
+    it->second.since = wf::get_current_time();
+    state.check_limit();
+}
+
+void wf::gpu_memory::untrack(const void *object)
+{
+    auto& state = gpu_memory_state_t::get();
+    auto it     = state.allocations.find(object);
+    if (it != state.allocations.end())
+    {
+        state.total -= it->second.bytes;
+        state.allocations.erase(it);
+    }
+}
+
+void wf::gpu_memory::set_owner(const void *object, const std::string& owner)
+{
+    auto& allocations = gpu_memory_state_t::get().allocations;
+    auto it = allocations.find(object);
+    if (it != allocations.end())
+    {
+        it->second.owner = owner;
+    }
+}
+
+size_t wf::gpu_memory::get_total()
+{
+    return gpu_memory_state_t::get().total;
+}
+
+std::vector<wf::gpu_memory::allocation_t> wf::gpu_memory::get_allocations()
+{
+    std::vector<allocation_t> result;
+    for (auto& [object, allocation] : gpu_memory_state_t::get().allocations)
+    {
+        result.push_back(allocation);
+    }
+
+    return result;
+}
+
+void wf::gpu_memory::add_pressure_callback(std::function<void()> *callback)
+{
+    gpu_memory_state_t::get().pressure_callbacks.push_back(callback);
+}
+
+void wf::gpu_memory::rem_pressure_callback(std::function<void()> *callback)
+{
+    auto& callbacks = gpu_memory_state_t::get().pressure_callbacks;
+    callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), callback),
+        callbacks.end());
+}
+
 bool wf::framebuffer_base_t::allocate(int width, int height)
 {
     bool first_allocate = false;
@@ -316,12 +1245,13 @@ bool wf::framebuffer_base_t::allocate(int width, int height)
             GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
             GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
                 0, GL_RGBA, GL_UNSIGNED_BYTE, 0));
+            wf::gpu_memory::track(this, size_t(width) * height * 4);
         }
     }
 
     if (first_allocate)
     {
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
+        OpenGL::bind_framebuffer(GL_FRAMEBUFFER, fb);
         GL_CALL(glBindTexture(GL_TEXTURE_2D, tex));
         GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
             GL_TEXTURE_2D, tex, 0));
@@ -340,7 +1270,7 @@ bool wf::framebuffer_base_t::allocate(int width, int height)
     viewport_height = height;
 
     GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
-    GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, OpenGL::current_output_fb));
+    OpenGL::bind_framebuffer(GL_FRAMEBUFFER, OpenGL::current_output_fb);
 
     return is_resize || first_allocate;
 }
@@ -353,6 +1283,17 @@ void wf::framebuffer_base_t::copy_state(wf::framebuffer_base_t&& other)
     this->fb  = other.fb;
     this->tex = other.tex;
 
+    /* The allocation moves with the GL objects */
+    auto& allocations = gpu_memory_state_t::get().allocations;
+    auto it = allocations.find(&other);
+    if (it != allocations.end())
+    {
+        auto allocation = std::move(it->second);
+        allocations.erase(it);
+        wf::gpu_memory::untrack(this);
+        allocations[this] = std::move(allocation);
+    }
+
     other.reset();
 }
 
@@ -377,8 +1318,8 @@ wf::framebuffer_base_t& wf::framebuffer_base_t::operator =(
 
 void wf::framebuffer_base_t::bind() const
 {
-    GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fb));
-    GL_CALL(glViewport(0, 0, viewport_width, viewport_height));
+    OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, fb);
+    OpenGL::set_viewport(0, 0, viewport_width, viewport_height);
 }
 
 void wf::framebuffer_base_t::scissor(wlr_box box) const
@@ -393,6 +1334,7 @@ void wf::framebuffer_base_t::release()
     if ((fb != uint32_t(-1)) && (fb != 0))
     {
         GL_CALL(glDeleteFramebuffers(1, &fb));
+        OpenGL::forget_framebuffer(fb);
     }
 
     if ((tex != uint32_t(-1)) && ((fb != 0) || (tex != 0)))
@@ -405,6 +1347,7 @@ void wf::framebuffer_base_t::release()
 
 void wf::framebuffer_base_t::reset()
 {
+    wf::gpu_memory::untrack(this);
     fb  = -1;
     tex = -1;
     viewport_width = viewport_height = 0;
@@ -573,6 +1516,61 @@ class program_t::impl
         return uniforms[active_program_idx][name];
     }
 
+    /** Names of the uniforms which have a handle, indexed by handle */
+    std::vector<std::string> handle_names;
+    std::map<std::string, int> handle_by_name;
+
+    /* Locations of the uniforms with handles, -2 if not resolved yet */
+    static constexpr int UNRESOLVED = -2;
+    std::vector<int> handle_locs[wf::TEXTURE_TYPE_ALL];
+
+    uniform_handle_t uv_base;
+    uniform_handle_t uv_scale;
+
+    uniform_handle_t get_handle(const std::string& name)
+    {
+        auto it = handle_by_name.find(name);
+        if (it != handle_by_name.end())
+        {
+            return {it->second};
+        }
+
+        int index = handle_names.size();
+        handle_names.push_back(name);
+        handle_by_name[name] = index;
+        for (auto& locs : handle_locs)
+        {
+            locs.push_back(UNRESOLVED);
+        }
+
+        return {index};
+    }
+
+    /** Find the location of the uniform for the currently bound program */
+    int find_uniform_loc(uniform_handle_t uniform)
+    {
+        assert(uniform.index >= 0 && uniform.index < (int)handle_names.size());
+        int& loc = handle_locs[active_program_idx][uniform.index];
+        if (loc == UNRESOLVED)
+        {
+            loc = GL_CALL(glGetUniformLocation(id[active_program_idx],
+                handle_names[uniform.index].c_str()));
+        }
+
+        return loc;
+    }
+
+    /** Forget all resolved locations, needed when the programs change */
+    void reset_locations()
+    {
+        for (int i = 0; i < wf::TEXTURE_TYPE_ALL; i++)
+        {
+            uniforms[i].clear();
+            attribs[i].clear();
+            std::fill(handle_locs[i].begin(), handle_locs[i].end(), UNRESOLVED);
+        }
+    }
+
     std::map<std::string, int> attribs[wf::TEXTURE_TYPE_ALL];
     /** Find the attrib location for the currently bound program */
     int find_attrib_loc(const std::string& name)
@@ -597,6 +1595,9 @@ program_t::program_t()
     {
         this->priv->id[i] = 0;
     }
+
+    this->priv->uv_base  = priv->get_handle("_wayfire_uv_base");
+    this->priv->uv_scale = priv->get_handle("_wayfire_uv_scale");
 }
 
 void program_t::set_simple(GLuint program_id, wf::texture_type_t type)
@@ -662,6 +1663,8 @@ void program_t::free_resources()
             this->priv->id[i] = 0;
         }
     }
+
+    priv->reset_locations();
 }
 
 void program_t::use(wf::texture_type_t type)
@@ -672,7 +1675,7 @@ void program_t::use(wf::texture_type_t type)
             std::to_string(type));
     }
 
-    GL_CALL(glUseProgram(priv->id[type]));
+    use_program(priv->id[type]);
     priv->active_program_idx = type;
 }
 
@@ -717,13 +1720,55 @@ void program_t::uniformMatrix4f(const std::string& name, const glm::mat4& value)
     GL_CALL(glUniformMatrix4fv(loc, 1, GL_FALSE, &value[0][0]));
 }
 
+uniform_handle_t program_t::get_uniform(const std::string& name)
+{
+    return priv->get_handle(name);
+}
+
+void program_t::uniform1i(uniform_handle_t uniform, int value)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniform1i(loc, value));
+}
+
+void program_t::uniform1f(uniform_handle_t uniform, float value)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniform1f(loc, value));
+}
+
+void program_t::uniform2f(uniform_handle_t uniform, float x, float y)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniform2f(loc, x, y));
+}
+
+void program_t::uniform3f(uniform_handle_t uniform, float x, float y, float z)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniform3f(loc, x, y, z));
+}
+
+void program_t::uniform4f(uniform_handle_t uniform, const glm::vec4& value)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniform4f(loc, value.r, value.g, value.b, value.a));
+}
+
+void program_t::uniformMatrix4f(uniform_handle_t uniform,
+    const glm::mat4& value)
+{
+    int loc = priv->find_uniform_loc(uniform);
+    GL_CALL(glUniformMatrix4fv(loc, 1, GL_FALSE, &value[0][0]));
+}
+
 void program_t::attrib_pointer(const std::string& attrib,
     int size, int stride, const void *ptr, GLenum type)
 {
     int loc = priv->find_attrib_loc(attrib);
     priv->active_attrs.insert(loc);
 
-    GL_CALL(glEnableVertexAttribArray(loc));
+    enable_vertex_attrib(loc);
     GL_CALL(glVertexAttribPointer(loc, size, type, GL_FALSE, stride, ptr));
 }
 
@@ -757,8 +1802,8 @@ void program_t::set_active_texture(const wf::texture_t& texture)
         base.y   = 1.0 - base.y;
     }
 
-    uniform2f("_wayfire_uv_base", base.x, base.y);
-    uniform2f("_wayfire_uv_scale", scale.x, scale.y);
+    uniform2f(priv->uv_base, base.x, base.y);
+    uniform2f(priv->uv_scale, scale.x, scale.y);
 }
 
 void program_t::deactivate()
@@ -770,11 +1815,11 @@ void program_t::deactivate()
 
     for (int loc : priv->active_attrs)
     {
-        GL_CALL(glDisableVertexAttribArray(loc));
+        disable_vertex_attrib(loc);
     }
 
+    /* The program stays bound, the next use() of it is skipped */
     priv->active_attrs_divisors.clear();
     priv->active_attrs.clear();
-    GL_CALL(glUseProgram(0));
 }
 }
@@ -10,13 +10,17 @@
 #include "seat/seat.hpp"
 #include "seat/cursor.hpp"
 #include "core-impl.hpp"
+#include "client-accounting.hpp"
 
 #include <xf86drmMode.h>
 #include <sstream>
+#include <cmath>
 #include <cstring>
+#include <deque>
 #include <unordered_set>
 
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
 
 static wl_output_transform get_transform_from_string(std::string transform)
@@ -179,10 +183,7 @@ void transfer_views(wf::output_t *from, wf::output_t *to)
             view->surface_interface_t::set_output(to);
         }
 
-        for (auto& view : views)
-        {
-            wf::get_core().move_view_to_output(view, to, true);
-        }
+        wf::get_core().move_views_to_output(views, to, true);
     }
 
     /* just remove all other views - backgrounds, panels, etc.
@@ -223,6 +224,7 @@ bool output_state_t::operator ==(const output_state_t& other) const
     eq &= (mode.refresh == other.mode.refresh);
     eq &= (transform == other.transform);
     eq &= (scale == other.scale);
+    eq &= (vrr == other.vrr);
 
     return eq;
 }
@@ -241,6 +243,7 @@ struct output_layout_output_t
     wf::option_wrapper_t<wf::output_config::position_t> position_opt;
     wf::option_wrapper_t<double> scale_opt;
     wf::option_wrapper_t<std::string> transform_opt;
+    wf::option_wrapper_t<bool> vrr_opt;
 
     void initialize_config_options()
     {
@@ -250,6 +253,8 @@ struct output_layout_output_t
         position_opt.load_option(name + "/position");
         scale_opt.load_option(name + "/scale");
         transform_opt.load_option(name + "/transform");
+        vrr_opt.load_option(name + "/vrr");
+        match_refresh_opt.load_option(name + "/match_refresh_rate");
     }
 
     output_layout_output_t(wlr_output *handle)
@@ -273,6 +278,9 @@ struct output_layout_output_t
             });
             on_mode.connect(&handle->events.mode);
         }
+
+        match_refresh_opt.set_callback([=] () { update_refresh_matching(); });
+        update_refresh_matching();
     }
 
     /**
@@ -397,6 +405,7 @@ struct output_layout_output_t
 
         state.scale     = scale_opt;
         state.transform = get_transform_from_string(transform_opt);
+        state.vrr       = vrr_opt;
         return state;
     }
 
@@ -488,7 +497,7 @@ struct output_layout_output_t
             return;
         }
 
-        LOGD("output ", handle->name, ": adding custom mode ", mode->name);
+        LOGC(OUTPUT, "output ", handle->name, ": adding custom mode ", mode->name);
         if (wlr_output_is_drm(handle))
         {
             wlr_drm_connector_add_mode(handle, mode);
@@ -529,7 +538,7 @@ struct output_layout_output_t
         return is_mode_supported(state.mode);
     }
 
-    /** Change the output mode */
+    /** Set the pending output mode. It is committed by apply_state(). */
     void apply_mode(const wlr_output_mode& mode)
     {
         if (handle->current_mode)
@@ -539,9 +548,6 @@ struct output_layout_output_t
                 (handle->current_mode->height == mode.height) &&
                 (handle->current_mode->refresh == mode.refresh))
             {
-                /* Commit the enabling of the output */
-                wlr_output_commit(handle);
-
                 return;
             }
         }
@@ -561,8 +567,260 @@ struct output_layout_output_t
             wlr_output_set_custom_mode(handle, mode.width, mode.height,
                 mode.refresh);
         }
+    }
 
-        wlr_output_commit(handle);
+    /*
+     * Refresh rate matching: while a fullscreen view is scanned out directly
+     * and its client commits at a steady rate which doesn't fit the refresh
+     * rate, for ex. a video player, the output temporarily switches to a mode
+     * whose refresh rate is a multiple of the content rate, or to adaptive
+     * sync if there is no such mode. The configured state is restored when the
+     * view is no longer fullscreen, or for a while doesn't fit.
+     */
+    wf::option_wrapper_t<bool> match_refresh_opt;
+    wf::wl_timer refresh_match_timer;
+    static constexpr uint32_t REFRESH_MATCH_CHECK_MS = 500;
+    /* Checks in a row before the refresh rate is switched, and reverted */
+    static constexpr int REFRESH_MATCH_CHECKS  = 2;
+    static constexpr int REFRESH_REVERT_CHECKS = 4;
+
+    /* Whether a matching mode or adaptive sync is committed */
+    bool refresh_matched = false;
+    /* The view whose rate is matched, or which couldn't be matched. Only
+     * compared, because it may be gone. */
+    wf::view_interface_t *refresh_match_view = nullptr;
+    int refresh_match_checks = 0;
+
+    void update_refresh_matching()
+    {
+        refresh_match_timer.disconnect();
+        refresh_match_checks = 0;
+        refresh_match_view   = nullptr;
+        if (refresh_matched)
+        {
+            revert_refresh_match();
+        }
+
+        if (match_refresh_opt)
+        {
+            refresh_match_timer.set_timeout(REFRESH_MATCH_CHECK_MS, [=] ()
+            {
+                check_refresh_match();
+
+                return true;
+            }, false);
+        }
+    }
+
+    /** @return Whether refresh is a multiple of rate, both in mHz */
+    static bool is_refresh_multiple(int refresh, int rate)
+    {
+        if ((refresh <= 0) || (rate <= 0))
+        {
+            return false;
+        }
+
+        int64_t multiple = std::lround((double)refresh / rate);
+
+        return (multiple >= 1) &&
+               (std::abs(refresh - multiple * rate) * 100 <= refresh);
+    }
+
+    /** @return The fullscreen view on top of the current workspace, or null */
+    wayfire_view get_fullscreen_view()
+    {
+        if (!output || (current_state.source != OUTPUT_IMAGE_SOURCE_SELF) ||
+            output->workspace->get_promoted_views().empty())
+        {
+            return nullptr;
+        }
+
+        auto views = output->workspace->get_views_on_workspace(
+            output->workspace->get_current_workspace(), wf::VISIBLE_LAYERS);
+        if (!views.empty() && views.front()->is_mapped() &&
+            views.front()->fullscreen)
+        {
+            return views.front();
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @return The rate in mHz at which the client of the view commits, if the
+     *   view is scanned out and the rate is steady, or 0.
+     */
+    int get_content_rate(wayfire_view view)
+    {
+        if (!output->render->is_scanned_out(view))
+        {
+            return 0;
+        }
+
+        auto stats = client_accounting::find_client_stats(view->get_client());
+        if (!stats || !stats->steady_cadence || (stats->commit_interval_us <= 0))
+        {
+            return 0;
+        }
+
+        return 1'000'000'000ll / stats->commit_interval_us;
+    }
+
+    int get_configured_refresh()
+    {
+        return current_state.mode.refresh > 0 ?
+               current_state.mode.refresh : handle->refresh;
+    }
+
+    void check_refresh_match()
+    {
+        auto view = get_fullscreen_view();
+        if (view.get() != refresh_match_view)
+        {
+            /* The view left fullscreen, or another one is on top */
+            if (refresh_matched)
+            {
+                revert_refresh_match();
+            }
+
+            refresh_match_view   = view.get();
+            refresh_match_checks = 0;
+        }
+
+        int rate = view ? get_content_rate(view) : 0;
+        if (refresh_matched)
+        {
+            /* Popups and the like interrupt the scanout for a moment */
+            bool fits = is_refresh_multiple(handle->refresh, rate);
+            refresh_match_checks = fits ? 0 : refresh_match_checks + 1;
+            if (refresh_match_checks >= REFRESH_REVERT_CHECKS)
+            {
+                revert_refresh_match();
+            }
+
+            return;
+        }
+
+        /* Content at a higher rate than the output, for ex. games, is left
+         * alone, as is content which already fits */
+        if ((refresh_match_checks < 0) || (rate <= 0) ||
+            (rate >= get_configured_refresh()) ||
+            is_refresh_multiple(handle->refresh, rate))
+        {
+            refresh_match_checks = std::min(refresh_match_checks, 0);
+
+            return;
+        }
+
+        if (++refresh_match_checks >= REFRESH_MATCH_CHECKS)
+        {
+            apply_refresh_match(rate);
+        }
+    }
+
+    /**
+     * Find the mode with the current resolution whose refresh rate is the
+     * multiple of rate closest to the configured refresh rate.
+     */
+    wlr_output_mode *find_refresh_match(int rate)
+    {
+        int configured = get_configured_refresh();
+        wlr_output_mode *mode;
+        wlr_output_mode *best = NULL;
+        wl_list_for_each(mode, &handle->modes, link)
+        {
+            if ((mode->width != current_state.mode.width) ||
+                (mode->height != current_state.mode.height) ||
+                !is_refresh_multiple(mode->refresh, rate))
+            {
+                continue;
+            }
+
+            if (!best || (std::abs(mode->refresh - configured) <
+                          std::abs(best->refresh - configured)))
+            {
+                best = mode;
+            }
+        }
+
+        return best;
+    }
+
+    void apply_refresh_match(int rate)
+    {
+        /* Don't try again for the same view if nothing fits */
+        refresh_match_checks = -1;
+
+        /* Only DRM outputs have a list of modes */
+        auto mode = wlr_output_is_drm(handle) ? find_refresh_match(rate) : nullptr;
+        bool use_vrr = !mode && !current_state.vrr &&
+            (handle->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED);
+        if (mode)
+        {
+            wlr_output_set_mode(handle, mode);
+        } else if (use_vrr)
+        {
+            wlr_output_enable_adaptive_sync(handle, true);
+        } else
+        {
+            LOGC(OUTPUT, "output ", handle->name, ": no refresh rate matches ",
+                rate / 1000.0, "fps");
+
+            return;
+        }
+
+        if (!wlr_output_commit(handle))
+        {
+            wlr_output_rollback(handle);
+            LOGW("Failed to match the refresh rate of output ", handle->name);
+
+            return;
+        }
+
+        if (use_vrr &&
+            (handle->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED))
+        {
+            LOGC(OUTPUT, "output ", handle->name, ": no adaptive sync to match ",
+                rate / 1000.0, "fps");
+
+            return;
+        }
+
+        LOGI("output ", handle->name, ": matching ", rate / 1000.0, "fps with ",
+            use_vrr ? std::string("adaptive sync") :
+            std::to_string(mode->refresh / 1000.0) + "Hz");
+        refresh_matched = true;
+        refresh_match_checks = 0;
+        output->render->damage_whole();
+    }
+
+    /** Commit the configured mode and adaptive sync state again */
+    void revert_refresh_match()
+    {
+        refresh_matched = false;
+        refresh_match_checks = 0;
+        if (!output || (current_state.source != OUTPUT_IMAGE_SOURCE_SELF))
+        {
+            /* apply_state() has set up the output already */
+            return;
+        }
+
+        apply_mode(current_state.mode);
+        bool vrr_enabled =
+            (handle->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED);
+        if (vrr_enabled != current_state.vrr)
+        {
+            wlr_output_enable_adaptive_sync(handle, current_state.vrr);
+        }
+
+        if (!wlr_output_commit(handle))
+        {
+            wlr_output_rollback(handle);
+            LOGE("Failed to restore the refresh rate of output ", handle->name);
+        }
+
+        LOGC(OUTPUT, "output ", handle->name, ": refresh rate restored");
+        output->render->damage_whole();
     }
 
     /* Mirroring implementation */
@@ -570,11 +828,66 @@ struct output_layout_output_t
     wl_listener_wrapper on_frame;
     wlr_output *locked_cursors_on = NULL;
 
-    /** Render the output using texture as source */
+    /**
+     * The parts of the mirrored output which changed since our last repaint,
+     * in our buffer coordinates, and the repainted regions of the previous
+     * frames, newest first, so that buffers of any age can be updated.
+     */
+    wf::region_t mirror_damage;
+    std::deque<wf::region_t> mirror_damage_history;
+    static constexpr size_t MIRROR_DAMAGE_HISTORY = 4;
+
+    wlr_box get_buffer_box()
+    {
+        return {0, 0, handle->width, handle->height};
+    }
+
+    /** Collect the damage of a commit of the mirrored output. */
+    void add_mirrored_damage(wlr_output *from)
+    {
+        /* The damage can be reused only if the image isn't scaled */
+        if ((from->pending.committed & WLR_OUTPUT_STATE_DAMAGE) &&
+            (from->width == handle->width) && (from->height == handle->height))
+        {
+            mirror_damage |= wf::region_t{&from->pending.damage};
+        } else
+        {
+            mirror_damage |= get_buffer_box();
+        }
+    }
+
+    /** Render the damaged parts of the output using texture as source */
     void render_output(wlr_texture *texture)
     {
+        int buffer_age;
+        if (!wlr_output_attach_render(handle, &buffer_age))
+        {
+            return;
+        }
+
+        /* Repaint what changed since the buffer was last shown */
+        wf::region_t repaint = mirror_damage;
+        if ((buffer_age <= 0) ||
+            (buffer_age - 1 > (int)mirror_damage_history.size()))
+        {
+            repaint |= get_buffer_box();
+        } else
+        {
+            for (int i = 0; i < buffer_age - 1; i++)
+            {
+                repaint |= mirror_damage_history[i];
+            }
+        }
+
+        mirror_damage_history.push_front(mirror_damage);
+        if (mirror_damage_history.size() > MIRROR_DAMAGE_HISTORY)
+        {
+            mirror_damage_history.pop_back();
+        }
+
+        mirror_damage.clear();
+
         auto renderer = get_core().renderer;
-        wlr_output_attach_render(handle, NULL);
         wlr_renderer_begin(renderer, handle->width, handle->height);
 
         /* Project a box filling the whole screen */
@@ -582,18 +895,33 @@ struct output_layout_output_t
         wlr_matrix_projection(projection, handle->width, handle->height,
             WL_OUTPUT_TRANSFORM_NORMAL);
 
-        wlr_box geometry = {0, 0, handle->width, handle->height};
+        wlr_box geometry = get_buffer_box();
         wlr_matrix_project_box(box, &geometry, WL_OUTPUT_TRANSFORM_NORMAL,
             0.0, projection);
 
-        wlr_render_texture_with_matrix(renderer, texture, box, 1.0);
+        for (const auto& rect : repaint)
+        {
+            auto scissor = wlr_box_from_pixman_box(rect);
+            wlr_renderer_scissor(renderer, &scissor);
+            wlr_render_texture_with_matrix(renderer, texture, box, 1.0);
+        }
+
+        wlr_renderer_scissor(renderer, NULL);
         wlr_renderer_end(renderer);
+
+        wlr_output_set_damage(handle, repaint.to_pixman());
         wlr_output_commit(handle);
     }
 
     /* Load output contents and render them */
     void handle_frame()
     {
+        if (mirror_damage.empty())
+        {
+            /* Nothing changed on the mirrored output */
+            return;
+        }
+
         auto wo = get_core().output_layout->find_output(
             current_state.mirror_from);
         if (!wo)
@@ -616,9 +944,12 @@ struct output_layout_output_t
          * a texture from this and use it to render "our" output */
         auto texture = wlr_texture_from_dmabuf(
             get_core().renderer, &attributes);
-        render_output(texture);
+        if (texture)
+        {
+            render_output(texture);
+            wlr_texture_destroy(texture);
+        }
 
-        wlr_texture_destroy(texture);
         wlr_dmabuf_attributes_finish(&attributes);
     }
 
@@ -672,12 +1003,20 @@ struct output_layout_output_t
         wlr_output_lock_software_cursors(wo->handle, true);
         locked_cursors_on = wo->handle;
 
+        mirror_damage = get_buffer_box();
+        mirror_damage_history.clear();
         wlr_output_schedule_frame(handle);
-        on_mirrored_frame.set_callback([=] (void*)
+        on_mirrored_frame.set_callback([=] (void *data)
         {
-            /* The mirrored output was repainted, schedule repaint
-             * for us as well */
-            wlr_output_schedule_frame(handle);
+            /* The mirrored output shows a new buffer, schedule a repaint
+             * for us as well. Commits without a buffer, for ex. of hardware
+             * cursors or gamma, don't change the image. */
+            auto ev = static_cast<wlr_output_event_precommit*>(data);
+            if (ev->output->pending.committed & WLR_OUTPUT_STATE_BUFFER)
+            {
+                add_mirrored_damage(ev->output);
+                wlr_output_schedule_frame(handle);
+            }
         });
         on_mirrored_frame.connect(&wo->handle->events.precommit);
 
@@ -759,7 +1098,26 @@ struct output_layout_output_t
             changed_fields |= wf::OUTPUT_POSITION_CHANGE;
         }
 
-        this->current_state = state;
+        /* Committing an output may mean a modeset, which blocks for a few
+         * frames. If only the position changed, or nothing at all, e.g.
+         * because another output was plugged in, the output layout has
+         * already been updated and there is nothing to commit. */
+        bool needs_commit = !this->output ||
+            (state.source != OUTPUT_IMAGE_SOURCE_SELF) ||
+            (changed_fields & ~wf::OUTPUT_POSITION_CHANGE) ||
+            (this->current_state.vrr != state.vrr) ||
+            refresh_matched;
+
+        /* The new state replaces a matched refresh rate */
+        refresh_matched = false;
+        refresh_match_checks = 0;
+        this->current_state  = state;
+        if (!needs_commit)
+        {
+            emit_configuration_changed(changed_fields);
+
+            return;
+        }
 
         /* Even if output will remain mirrored, we can tear it down and set
          * up again, in case the output to mirror from changed */
@@ -774,6 +1132,8 @@ struct output_layout_output_t
             return;
         }
 
+        /* Stage the mode, transform, scale and adaptive sync state, so that
+         * they are committed together, with at most one modeset */
         set_enabled(!(state.source & OUTPUT_IMAGE_SOURCE_NONE));
         apply_mode(state.mode);
         if (state.source & OUTPUT_IMAGE_SOURCE_SELF)
@@ -790,9 +1150,29 @@ struct output_layout_output_t
                     state.scale);
             }
 
-            wlr_output_commit(handle);
+            bool vrr_enabled =
+                (handle->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED);
+            if (vrr_enabled != state.vrr)
+            {
+                wlr_output_enable_adaptive_sync(handle, state.vrr);
+            }
+        }
+
+        if (!wlr_output_commit(handle))
+        {
+            LOGE("Failed to commit the configuration of output ", handle->name);
+        }
+
+        if (state.source & OUTPUT_IMAGE_SOURCE_SELF)
+        {
+            if (state.vrr &&
+                (handle->adaptive_sync_status != WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED))
+            {
+                LOGW("Failed to enable adaptive sync on output ", handle->name);
+            }
 
             ensure_wayfire_output(get_effective_size());
+            output->render->set_dormant(state.source == OUTPUT_IMAGE_SOURCE_DPMS);
             output->render->damage_whole();
             emit_configuration_changed(changed_fields);
         } else /* state.source == OUTPUT_IMAGE_SOURCE_MIRROR */
@@ -936,6 +1316,8 @@ class output_layout_t::impl
             state.position  = {head->state.x, head->state.y};
             state.scale     = head->state.scale;
             state.transform = head->state.transform;
+            /* The output management protocol doesn't configure adaptive sync */
+            state.vrr = this->outputs[handle]->current_state.vrr;
         }
 
         return result;
@@ -1358,7 +1740,7 @@ class output_layout_t::impl
             {
                 remove_noop_output();
                 return false; // disconnect
-            });
+            }, false);
         }
 
         idle_update_configuration.run_once([=] ()
@@ -1389,7 +1771,7 @@ class output_layout_t::impl
 
     void set_power_mode(wlr_output_power_v1_set_mode_event *ev)
     {
-        LOGD("output: ", ev->output->name, " power mode: ", ev->mode);
+        LOGC(OUTPUT, "output: ", ev->output->name, " power mode: ", ev->mode);
         auto config = get_current_configuration();
         if (!config.count(ev->output))
         {
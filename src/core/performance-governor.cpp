@@ -0,0 +1,324 @@
+#include <wayfire/performance-governor.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+namespace
+{
+/* How often the frames of the outputs are checked */
+constexpr int EVALUATE_MS = 500;
+/* Overloaded checks in a row before the level is raised */
+constexpr int OVERLOAD_CHECKS = 2;
+/* Quiet checks in a row before the level is lowered */
+constexpr int RECOVER_CHECKS = 10;
+/* The percentage of missed frames above which a check is overloaded, and
+ * up to which it is quiet */
+constexpr int OVERLOAD_PERCENT = 20;
+constexpr int QUIET_PERCENT    = 5;
+/* Fewer frames tell nothing about the load */
+constexpr int MIN_FRAMES = 5;
+/* GPU times arrive a few frames later, when they are supported at all */
+constexpr uint64_t SETTLE_FRAMES = 8;
+/* The power supply is checked less often than the frames */
+constexpr int BATTERY_CHECK_INTERVAL = 20;
+
+std::string read_first_line(const std::filesystem::path& path)
+{
+    std::ifstream stream(path);
+    std::string line;
+    std::getline(stream, line);
+
+    return line;
+}
+
+/**
+ * @return Whether the system has external power supplies (mains or USB), and
+ *   none of them is online.
+ */
+bool is_on_battery()
+{
+    std::error_code error;
+    std::filesystem::directory_iterator it{"/sys/class/power_supply", error};
+    if (error)
+    {
+        return false;
+    }
+
+    bool has_external = false;
+    for (auto& entry : it)
+    {
+        auto type = read_first_line(entry.path() / "type");
+        if ((type != "Mains") && (type != "USB"))
+        {
+            continue;
+        }
+
+        has_external = true;
+        if (read_first_line(entry.path() / "online") == "1")
+        {
+            return false;
+        }
+    }
+
+    return has_external;
+}
+}
+
+class wf::performance_governor_t::impl
+{
+  public:
+    void init()
+    {
+        enabled.set_callback([=] () { update_enabled(); });
+        max_level.set_callback([=] () { set_level(level); });
+        battery_level.set_callback([=] () { set_level(level); });
+        max_fps.set_callback([=] () { update_frame_rate_cap(); });
+
+        on_output_added.set_callback([=] (wf::signal_data_t *data)
+        {
+            wf::get_signaled_output(data)->render->add_frame_rate_cap(&cap);
+        });
+
+        on_output_removed.set_callback([=] (wf::signal_data_t *data)
+        {
+            auto output = wf::get_signaled_output(data);
+            output->render->rem_frame_rate_cap(&cap);
+            last_frame_ids.erase(output);
+        });
+
+        wf::get_core().output_layout->connect_signal("output-added",
+            &on_output_added);
+        wf::get_core().output_layout->connect_signal("output-removed",
+            &on_output_removed);
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            output->render->add_frame_rate_cap(&cap);
+        }
+
+        wf::get_core().connect_signal("shutdown", &on_shutdown);
+        update_enabled();
+    }
+
+    /* Read by performance_governor_t::get_level() */
+    performance_level_t level = PERFORMANCE_LEVEL_FULL;
+
+  private:
+    wf::option_wrapper_t<bool> enabled{"core/performance_governor"};
+    wf::option_wrapper_t<int> max_level{"core/governor_max_level"};
+    wf::option_wrapper_t<int> battery_level{"core/governor_battery_level"};
+    wf::option_wrapper_t<int> max_fps{"core/governor_max_fps"};
+
+    wf::wl_timer evaluate_timer;
+    /* Added to all outputs, its max_fps is 0 below the minimal level */
+    wf::frame_rate_cap_t cap;
+
+    /* The last frame of each output which was checked */
+    std::map<wf::output_t*, uint64_t> last_frame_ids;
+    int overloaded_checks = 0;
+    int quiet_checks = 0;
+
+    bool on_battery = false;
+    int checks_since_battery = 0;
+
+    void update_enabled()
+    {
+        evaluate_timer.disconnect();
+        overloaded_checks = quiet_checks = 0;
+        if (!enabled)
+        {
+            set_level(PERFORMANCE_LEVEL_FULL);
+
+            return;
+        }
+
+        /* Only frames repainted from now on count */
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            auto frames = output->render->get_frame_stats();
+            last_frame_ids[output] = frames.empty() ? 0 : frames.back().frame_id;
+        }
+
+        on_battery = is_on_battery();
+        checks_since_battery = 0;
+        set_level(level);
+
+        evaluate_timer.set_timeout(EVALUATE_MS, [=] ()
+        {
+            evaluate();
+
+            return true;
+        }, false);
+    }
+
+    /**
+     * Count the frames of the output since the last check which are complete.
+     *
+     * @return The number of frames.
+     */
+    int count_frames(wf::output_t *output, int& missed)
+    {
+        auto frames = output->render->get_frame_stats();
+        if (frames.empty())
+        {
+            return 0;
+        }
+
+        auto& last_frame_id = last_frame_ids[output];
+        uint64_t newest = frames.back().frame_id;
+        int64_t refresh = output->handle->refresh > 0 ?
+            1'000'000'000'000ll / output->handle->refresh : 16'666'667;
+
+        int count = 0;
+        for (auto& frame : frames)
+        {
+            if (frame.frame_id <= last_frame_id)
+            {
+                continue;
+            }
+
+            if ((frame.gpu_time < 0) && (frame.frame_id + SETTLE_FRAMES > newest))
+            {
+                break;
+            }
+
+            last_frame_id = frame.frame_id;
+            ++count;
+            if (std::max(frame.total_time, frame.gpu_time) > refresh)
+            {
+                ++missed;
+            }
+        }
+
+        return count;
+    }
+
+    void evaluate()
+    {
+        if (++checks_since_battery >= BATTERY_CHECK_INTERVAL)
+        {
+            checks_since_battery = 0;
+            bool was_on_battery = on_battery;
+            on_battery = is_on_battery();
+            if (on_battery != was_on_battery)
+            {
+                LOGI("performance governor: running on ",
+                    on_battery ? "battery" : "external power");
+            }
+        }
+
+        int frames = 0, missed = 0;
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            frames += count_frames(output, missed);
+        }
+
+        if ((frames >= MIN_FRAMES) && (missed * 100 > frames * OVERLOAD_PERCENT))
+        {
+            quiet_checks = 0;
+            ++overloaded_checks;
+        } else if (missed * 100 <= frames * QUIET_PERCENT)
+        {
+            overloaded_checks = 0;
+            ++quiet_checks;
+        } else
+        {
+            overloaded_checks = quiet_checks = 0;
+        }
+
+        /* Each step needs a new series of checks, so that the effect of the
+         * previous step can be seen first */
+        if (overloaded_checks >= OVERLOAD_CHECKS)
+        {
+            overloaded_checks = 0;
+            set_level((performance_level_t)(level + 1));
+        } else if (quiet_checks >= RECOVER_CHECKS)
+        {
+            quiet_checks = 0;
+            set_level((performance_level_t)(level - 1));
+        } else
+        {
+            /* The minimum on battery may have changed */
+            set_level(level);
+        }
+    }
+
+    /** Set the level, clamped to the configured range, and notify plugins */
+    void set_level(performance_level_t new_level)
+    {
+        int lowest  = 0;
+        int highest = std::clamp((int)max_level, 0, (int)PERFORMANCE_LEVEL_MINIMAL);
+        if (enabled && on_battery)
+        {
+            lowest = std::clamp((int)battery_level, 0, highest);
+        }
+
+        if (!enabled)
+        {
+            highest = 0;
+        }
+
+        new_level = (performance_level_t)std::clamp((int)new_level, lowest, highest);
+        if (new_level == level)
+        {
+            return;
+        }
+
+        LOGD("performance governor: level ", (int)level, " -> ", (int)new_level);
+        performance_level_changed_signal data;
+        data.old_level = level;
+        data.level     = new_level;
+        level = new_level;
+        update_frame_rate_cap();
+        wf::get_core().emit_signal("performance-level-changed", &data);
+    }
+
+    void update_frame_rate_cap()
+    {
+        cap.max_fps = (level >= PERFORMANCE_LEVEL_MINIMAL) ?
+            std::max(0, (int)max_fps) : 0;
+    }
+
+    wf::signal_connection_t on_output_added;
+    wf::signal_connection_t on_output_removed;
+    wf::signal_connection_t on_shutdown = [=] (wf::signal_data_t*)
+    {
+        evaluate_timer.disconnect();
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            output->render->rem_frame_rate_cap(&cap);
+        }
+    };
+};
+
+wf::performance_governor_t& wf::performance_governor_t::get()
+{
+    static performance_governor_t governor;
+    return governor;
+}
+
+wf::performance_governor_t::performance_governor_t() :
+    priv(std::make_unique<impl>())
+{}
+
+wf::performance_governor_t::~performance_governor_t() = default;
+
+wf::performance_level_t wf::performance_governor_t::get_level() const
+{
+    return priv->level;
+}
+
+void wf::performance_governor_t::init()
+{
+    priv->init();
+}
@@ -0,0 +1,216 @@
+#include "program-cache.hpp"
+#include <wayfire/util/log.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <vector>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+namespace
+{
+PFNGLGETPROGRAMBINARYOESPROC get_program_binary = nullptr;
+PFNGLPROGRAMBINARYOESPROC program_binary = nullptr;
+
+/* The first bytes of each cache file, "WFPB" */
+constexpr uint32_t CACHE_MAGIC = 0x42504657;
+
+const char *get_gl_string(GLenum name)
+{
+    auto str = (const char*)glGetString(name);
+    return str ? str : "";
+}
+}
+
+wf::program_cache_t& wf::program_cache_t::get()
+{
+    static program_cache_t cache;
+    return cache;
+}
+
+void wf::program_cache_t::init()
+{
+    initialized = true;
+
+    auto extensions = get_gl_string(GL_EXTENSIONS);
+    if (!strstr(extensions, "GL_OES_get_program_binary"))
+    {
+        return;
+    }
+
+    GLint formats = 0;
+    GL_CALL(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats));
+    get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)
+        eglGetProcAddress("glGetProgramBinaryOES");
+    program_binary = (PFNGLPROGRAMBINARYOESPROC)
+        eglGetProcAddress("glProgramBinaryOES");
+    if ((formats <= 0) || !get_program_binary || !program_binary)
+    {
+        return;
+    }
+
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && *cache_home)
+    {
+        directory = cache_home;
+    } else if (getenv("HOME"))
+    {
+        directory = std::string(getenv("HOME")) + "/.cache";
+    } else
+    {
+        return;
+    }
+
+    directory += "/wayfire/shaders";
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error)
+    {
+        LOGW("Cannot create the shader cache in ", directory, ": ",
+            error.message());
+
+        return;
+    }
+
+    identity = std::string(get_gl_string(GL_VENDOR)) + "\n" +
+        get_gl_string(GL_RENDERER) + "\n" + get_gl_string(GL_VERSION) + "\n";
+    enabled = true;
+}
+
+std::string wf::program_cache_t::get_path(const std::string& sources)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016zx",
+        std::hash<std::string>{}(identity + sources));
+
+    return directory + "/" + name;
+}
+
+GLuint wf::program_cache_t::load(const std::string& sources)
+{
+    if (!initialized)
+    {
+        init();
+    }
+
+    if (!enabled)
+    {
+        return 0;
+    }
+
+    std::string path = get_path(sources);
+    std::ifstream file{path, std::ios::binary};
+    if (!file)
+    {
+        return 0;
+    }
+
+    /* The whole key is stored, so that hash collisions are detected */
+    uint32_t magic = 0, format = 0;
+    uint64_t key_size = 0, binary_size = 0;
+    file.read((char*)&magic, sizeof(magic));
+    file.read((char*)&format, sizeof(format));
+    file.read((char*)&key_size, sizeof(key_size));
+    if (!file || (magic != CACHE_MAGIC) ||
+        (key_size != identity.size() + sources.size()))
+    {
+        return 0;
+    }
+
+    std::string key(key_size, '\0');
+    file.read(&key[0], key_size);
+    file.read((char*)&binary_size, sizeof(binary_size));
+    if (!file || (key != identity + sources) || (binary_size > INT32_MAX))
+    {
+        return 0;
+    }
+
+    std::vector<char> binary(binary_size);
+    file.read(binary.data(), binary_size);
+    if (!file)
+    {
+        return 0;
+    }
+
+    GLuint program = GL_CALL(glCreateProgram());
+    GL_CALL(program_binary(program, format, binary.data(), binary_size));
+
+    GLint status = GL_FALSE;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    if (status == GL_FALSE)
+    {
+        /* For example, the driver was updated without changing its version
+         * string. The binary is replaced after compiling the sources. */
+        GL_CALL(glDeleteProgram(program));
+
+        return 0;
+    }
+
+    return program;
+}
+
+void wf::program_cache_t::store(const std::string& sources, GLuint program)
+{
+    if (!initialized)
+    {
+        init();
+    }
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    GLint status = GL_FALSE, length = 0;
+    GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
+    GL_CALL(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length));
+    if ((status == GL_FALSE) || (length <= 0))
+    {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GL_CALL(get_program_binary(program, length, &length, &format,
+        binary.data()));
+
+    /* Written to a temporary file first, so that a concurrent instance never
+     * reads a partial file */
+    std::string path = get_path(sources);
+    std::string temporary = path + "." + std::to_string(getpid());
+    {
+        std::ofstream file{temporary, std::ios::binary | std::ios::trunc};
+        uint32_t magic    = CACHE_MAGIC;
+        uint32_t format32 = format;
+        uint64_t key_size = identity.size() + sources.size();
+        uint64_t binary_size = length;
+
+        file.write((const char*)&magic, sizeof(magic));
+        file.write((const char*)&format32, sizeof(format32));
+        file.write((const char*)&key_size, sizeof(key_size));
+        file.write(identity.data(), identity.size());
+        file.write(sources.data(), sources.size());
+        file.write((const char*)&binary_size, sizeof(binary_size));
+        file.write(binary.data(), length);
+        if (!file)
+        {
+            std::remove(temporary.c_str());
+
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::remove(temporary.c_str());
+    }
+}
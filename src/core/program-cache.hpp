@@ -0,0 +1,54 @@
+#ifndef WF_PROGRAM_CACHE_HPP
+#define WF_PROGRAM_CACHE_HPP
+
+#include <wayfire/opengl.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <string>
+
+namespace wf
+{
+/**
+ * A persistent cache of linked GL programs, stored as program binaries under
+ * $XDG_CACHE_HOME/wayfire/shaders.
+ *
+ * The programs are keyed by their sources and by the vendor, renderer and
+ * version strings of the driver, so that updating the driver or switching to
+ * another GPU does not load incompatible binaries. The cache is disabled if
+ * the driver does not support GL_OES_get_program_binary, or if it has no
+ * binary formats.
+ *
+ * Both functions need a current GL context.
+ */
+class program_cache_t : public noncopyable_t
+{
+  public:
+    static program_cache_t& get();
+
+    /**
+     * Load the program for the given sources from the cache.
+     *
+     * @return The linked program, or 0 if it is not cached, or if the cached
+     *   binary was rejected by the driver.
+     */
+    GLuint load(const std::string& sources);
+
+    /** Store the binary of the given linked program. */
+    void store(const std::string& sources, GLuint program);
+
+  private:
+    program_cache_t() = default;
+
+    bool initialized = false;
+    bool enabled     = false;
+    /* The vendor, renderer and version of the driver */
+    std::string identity;
+    std::string directory;
+
+    void init();
+    /** @return The path of the cache file for the given sources */
+    std::string get_path(const std::string& sources);
+};
+}
+
+#endif /* end of include guard: WF_PROGRAM_CACHE_HPP */
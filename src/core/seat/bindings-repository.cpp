@@ -1,22 +1,27 @@
 #include "bindings-repository.hpp"
 #include <wayfire/core.hpp>
+#include <wayfire/signal-definitions.hpp>
 #include <algorithm>
 
-bool wf::bindings_repository_t::handle_key(const wf::keybinding_t& pressed,
-    uint32_t mod_binding_key)
+template<class Binding, class Callback>
+auto wf::bindings_repository_t::lookup(index_t<Callback>& index,
+    uint32_t modifiers, uint32_t code, const Binding& pressed,
+    const binding_container_t<Binding, Callback>& bindings) ->
+std::shared_ptr<const index_entry_t<Callback>>
 {
-    std::vector<std::function<bool()>> callbacks;
-    for (auto& binding : this->keys)
+    uint64_t hash_key = ((uint64_t)modifiers << 32) | code;
+    auto it = index.find(hash_key);
+    if (it != index.end())
+    {
+        return it->second;
+    }
+
+    auto entry = std::make_shared<index_entry_t<Callback>>();
+    for (auto& binding : bindings)
     {
         if (binding->activated_by->get_value() == pressed)
         {
-            /* We must be careful because the callback might be erased,
-             * so force copy the callback into the lambda */
-            auto callback = binding->callback;
-            callbacks.emplace_back([pressed, callback] ()
-            {
-                return (*callback)(pressed);
-            });
+            entry->bindings.push_back(binding->callback);
         }
     }
 
@@ -24,31 +29,49 @@ bool wf::bindings_repository_t::handle_key(const wf::keybinding_t& pressed,
     {
         if (binding->activated_by->get_value().has_match(pressed))
         {
-            /* We must be careful because the callback might be erased,
-             * so force copy the callback into the lambda */
-            auto callback = binding->callback;
-            callbacks.emplace_back([pressed, callback, mod_binding_key] ()
-            {
-                wf::activator_data_t ev = {
-                    .source = activator_source_t::KEYBINDING,
-                    .activation_data = pressed.get_key()
-                };
-
-                if (mod_binding_key)
-                {
-                    ev.source = activator_source_t::MODIFIERBINDING;
-                    ev.activation_data = mod_binding_key;
-                }
-
-                return (*callback)(ev);
-            });
+            entry->activators.push_back(binding->callback);
         }
     }
 
+    index[hash_key] = entry;
+    return entry;
+}
+
+void wf::bindings_repository_t::invalidate_index()
+{
+    key_index.clear();
+    button_index.clear();
+}
+
+bool wf::bindings_repository_t::handle_key(const wf::keybinding_t& pressed,
+    uint32_t mod_binding_key)
+{
+    /* We must be careful because the callbacks might be erased, so we hold a
+     * reference to the entry, which is not modified, even if it is dropped
+     * from the index. */
+    auto entry = lookup(key_index, pressed.get_modifiers(), pressed.get_key(),
+        pressed, this->keys);
+
     bool handled = false;
-    for (auto& cb : callbacks)
+    for (auto callback : entry->bindings)
     {
-        handled |= cb();
+        handled |= (*callback)(pressed);
+    }
+
+    for (auto callback : entry->activators)
+    {
+        wf::activator_data_t ev = {
+            .source = activator_source_t::KEYBINDING,
+            .activation_data = pressed.get_key()
+        };
+
+        if (mod_binding_key)
+        {
+            ev.source = activator_source_t::MODIFIERBINDING;
+            ev.activation_data = mod_binding_key;
+        }
+
+        handled |= (*callback)(ev);
     }
 
     return handled;
@@ -77,43 +100,23 @@ bool wf::bindings_repository_t::handle_axis(uint32_t modifiers,
 
 bool wf::bindings_repository_t::handle_button(const wf::buttonbinding_t& pressed)
 {
-    std::vector<std::function<bool()>> callbacks;
-    for (auto& binding : this->buttons)
-    {
-        if (binding->activated_by->get_value() == pressed)
-        {
-            /* We must be careful because the callback might be erased,
-             * so force copy the callback into the lambda */
-            auto callback = binding->callback;
-            callbacks.emplace_back([=] ()
-            {
-                return (*callback)(pressed);
-            });
-        }
-    }
+    /* See handle_key() */
+    auto entry = lookup(button_index, pressed.get_modifiers(),
+        pressed.get_button(), pressed, this->buttons);
 
-    for (auto& binding : this->activators)
+    bool binding_handled = false;
+    for (auto callback : entry->bindings)
     {
-        if (binding->activated_by->get_value().has_match(pressed))
-        {
-            /* We must be careful because the callback might be erased,
-             * so force copy the callback into the lambda */
-            auto callback = binding->callback;
-            callbacks.emplace_back([=] ()
-            {
-                wf::activator_data_t data = {
-                    .source = activator_source_t::BUTTONBINDING,
-                    .activation_data = pressed.get_button(),
-                };
-                return (*callback)(data);
-            });
-        }
+        binding_handled |= (*callback)(pressed);
     }
 
-    bool binding_handled = false;
-    for (auto call : callbacks)
+    for (auto callback : entry->activators)
     {
-        binding_handled |= call();
+        wf::activator_data_t data = {
+            .source = activator_source_t::BUTTONBINDING,
+            .activation_data = pressed.get_button(),
+        };
+        binding_handled |= (*callback)(data);
     }
 
     return binding_handled;
@@ -178,6 +181,7 @@ void wf::bindings_repository_t::rem_binding(void *callback)
     erase(axes);
     erase(activators);
 
+    invalidate_index();
     recreate_hotspots();
 }
 
@@ -198,14 +202,33 @@ void wf::bindings_repository_t::rem_binding(binding_t *binding)
     erase(axes);
     erase(activators);
 
+    invalidate_index();
     recreate_hotspots();
 }
 
 wf::bindings_repository_t::bindings_repository_t(wf::output_t *output) :
     hotspot_mgr(output)
 {
-    on_config_reload.set_callback([=] (wf::signal_data_t*)
+    on_config_reload.set_callback([=] (wf::signal_data_t *data)
     {
+        /* The bindings hold their options, so only the index and the hotspots
+         * need to be rebuilt, and only if a binding has changed. */
+        auto ev = static_cast<wf::reload_config_signal*>(data);
+        if (ev && std::none_of(ev->changed_options.begin(),
+            ev->changed_options.end(), [] (const auto& option)
+        {
+            return std::dynamic_pointer_cast<
+                wf::config::option_t<wf::keybinding_t>>(option) ||
+            std::dynamic_pointer_cast<
+                wf::config::option_t<wf::buttonbinding_t>>(option) ||
+            std::dynamic_pointer_cast<
+                wf::config::option_t<wf::activatorbinding_t>>(option);
+        }))
+        {
+            return;
+        }
+
+        invalidate_index();
         recreate_hotspots();
     });
 
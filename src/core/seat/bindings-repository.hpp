@@ -2,6 +2,7 @@
 
 #include "wayfire/geometry.hpp"
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <wayfire/bindings.hpp>
 #include <wayfire/config/option-wrapper.hpp>
@@ -58,6 +59,12 @@ class bindings_repository_t
      */
     void recreate_hotspots();
 
+    /**
+     * Drop the cached lookups of key and button bindings. Needs to be called
+     * whenever a binding is added.
+     */
+    void invalidate_index();
+
   private:
     // output_t directly pushes in the binding containers to avoid having the
     // same wrapped functions as in the output public API.
@@ -70,6 +77,32 @@ class bindings_repository_t
 
     hotspot_manager_t hotspot_mgr;
 
+    /**
+     * The callbacks of all bindings which match a key or button combination.
+     * Entries are filled on the first event with a given combination, so that
+     * subsequent events need a single lookup. Entries are immutable, so that
+     * the bindings can be safely changed while callbacks are being run.
+     */
+    template<class Callback>
+    struct index_entry_t
+    {
+        std::vector<Callback*> bindings;
+        std::vector<activator_callback*> activators;
+    };
+
+    template<class Callback>
+    using index_t =
+        std::unordered_map<uint64_t, std::shared_ptr<const index_entry_t<Callback>>>;
+
+    index_t<key_callback> key_index;
+    index_t<button_callback> button_index;
+
+    template<class Binding, class Callback>
+    std::shared_ptr<const index_entry_t<Callback>> lookup(
+        index_t<Callback>& index, uint32_t modifiers, uint32_t code,
+        const Binding& pressed,
+        const binding_container_t<Binding, Callback>& bindings);
+
     wf::signal_connection_t on_config_reload;
     wf::wl_idle_call idle_recreate_hotspots;
 };
@@ -11,6 +11,10 @@
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/util/log.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
 wf::cursor_t::cursor_t(wf::seat_t *seat)
 {
     cursor     = wlr_cursor_create();
@@ -23,9 +27,12 @@ wf::cursor_t::cursor_t(wf::seat_t *seat)
     wlr_cursor_warp(cursor, NULL, cursor->x, cursor->y);
     init_xcursor();
 
-    config_reloaded = [=] (wf::signal_data_t*)
+    config_reloaded = [=] (wf::signal_data_t *data)
     {
-        init_xcursor();
+        if (wf::config_section_changed(data, "input"))
+        {
+            init_xcursor();
+        }
     };
 
     wf::get_core().connect_signal("reload-config", &config_reloaded);
@@ -36,6 +43,41 @@ wf::cursor_t::cursor_t(wf::seat_t *seat)
         set_cursor(ev, true);
     });
     request_set_cursor.connect(&seat->seat->events.request_set_cursor);
+
+    on_client_surface_commit.set_callback([&] (void*)
+    {
+        client_hotspot.x -= client_surface->current.dx;
+        client_hotspot.y -= client_surface->current.dy;
+        update_client_cursor();
+    });
+    on_client_surface_destroy.set_callback([&] (void*)
+    {
+        /* No leave event for a surface which is going away */
+        client_surface_output = nullptr;
+        clear_client_cursor();
+        wlr_cursor_set_image(cursor, NULL, 0, 0, 0, 0, 0, 0);
+    });
+
+    /* New outputs and scales need the image too */
+    on_outputs_changed.set_callback([=] (wf::signal_data_t*)
+    {
+        if (client_surface && !client_surface_fallback)
+        {
+            shown_client_image = 0;
+            update_client_cursor();
+        }
+    });
+    on_output_removed.set_callback([=] (wf::signal_data_t *data)
+    {
+        if (wf::get_signaled_output(data) == client_surface_output)
+        {
+            client_surface_output = nullptr;
+        }
+    });
+    wf::get_core().output_layout->connect_signal("configuration-changed",
+        &on_outputs_changed);
+    wf::get_core().output_layout->connect_signal("output-removed",
+        &on_output_removed);
 }
 
 void wf::cursor_t::add_new_device(wlr_input_device *dev)
@@ -56,19 +98,42 @@ void wf::cursor_t::setup_listeners()
     });
     on_frame.connect(&cursor->events.frame);
 
+    on_motion.set_callback([&] (void *data)
+    {
+        set_touchscreen_mode(false);
+        auto ev = static_cast<wlr_event_pointer_motion*>(data);
+        if (seat->lpointer->handle_locked_pointer_motion(ev))
+        {
+            /* Locked pointers of fullscreen games skip the signals */
+            wf::record_input_event();
+            wlr_idle_notify_activity(core.protocols.idle, core.get_current_seat());
+
+            return;
+        }
+
+        static const wf::signal_id_t event_id{"pointer_motion"};
+        static const wf::signal_id_t post_event_id{"pointer_motion_post"};
+        emit_device_event_signal(event_id, ev);
+        seat->lpointer->handle_pointer_motion(ev);
+        wlr_idle_notify_activity(core.protocols.idle, core.get_current_seat());
+        emit_device_event_signal(post_event_id, ev);
+    });
+    on_motion.connect(&cursor->events.motion);
+
 #define setup_passthrough_callback(evname) \
     on_ ## evname.set_callback([&] (void *data) { \
         set_touchscreen_mode(false); \
         auto ev = static_cast<wlr_event_pointer_ ## evname*>(data); \
-        emit_device_event_signal("pointer_" #evname, ev); \
+        static const wf::signal_id_t event_id{"pointer_" #evname}; \
+        static const wf::signal_id_t post_event_id{"pointer_" #evname "_post"}; \
+        emit_device_event_signal(event_id, ev); \
         seat->lpointer->handle_pointer_ ## evname(ev); \
         wlr_idle_notify_activity(core.protocols.idle, core.get_current_seat()); \
-        emit_device_event_signal("pointer_" #evname "_post", ev); \
+        emit_device_event_signal(post_event_id, ev); \
     }); \
     on_ ## evname.connect(&cursor->events.evname);
 
     setup_passthrough_callback(button);
-    setup_passthrough_callback(motion);
     setup_passthrough_callback(motion_absolute);
     setup_passthrough_callback(axis);
     setup_passthrough_callback(swipe_begin);
@@ -87,14 +152,16 @@ void wf::cursor_t::setup_listeners()
     on_tablet_ ## evname.set_callback([&] (void *data) { \
         set_touchscreen_mode(false); \
         auto ev = static_cast<wlr_event_tablet_tool_ ## evname*>(data); \
-        emit_device_event_signal("tablet_" #evname, ev); \
+        static const wf::signal_id_t event_id{"tablet_" #evname}; \
+        static const wf::signal_id_t post_event_id{"tablet_" #evname "_post"}; \
+        emit_device_event_signal(event_id, ev); \
         if (ev->device->tablet->data) { \
             auto tablet = \
                 static_cast<wf::tablet_t*>(ev->device->tablet->data); \
             tablet->handle_ ## evname(ev); \
         } \
         wlr_idle_notify_activity(wf::get_core().protocols.idle, seat->seat); \
-        emit_device_event_signal("tablet_" #evname "_post", ev); \
+        emit_device_event_signal(post_event_id, ev); \
     }); \
     on_tablet_ ## evname.connect(&cursor->events.tablet_tool_ ## evname);
 
@@ -135,12 +202,66 @@ void wf::cursor_t::init_xcursor()
         }
     }
 
+    preload_cursors();
     set_cursor("default");
 }
 
 void wf::cursor_t::load_xcursor_scale(float scale)
 {
     wlr_xcursor_manager_load(xcursor, scale);
+    preload_cursors();
+}
+
+void wf::cursor_t::preload_cursors()
+{
+    cursor_cache.clear();
+    /* The images of the shown cursor may be missing for the new scale */
+    current_cursor.clear();
+
+    static const char *common_cursors[] = {
+        "left_ptr", "grabbing", "crosshair", "text",
+    };
+    for (auto name : common_cursors)
+    {
+        get_cursor_images(name);
+    }
+
+    /* The cursors used when resizing and hovering decorations */
+    const uint32_t all_edges =
+        WLR_EDGE_TOP | WLR_EDGE_BOTTOM | WLR_EDGE_LEFT | WLR_EDGE_RIGHT;
+    for (uint32_t edges = 1; edges <= all_edges; edges++)
+    {
+        bool invalid = ((edges & WLR_EDGE_TOP) && (edges & WLR_EDGE_BOTTOM)) ||
+            ((edges & WLR_EDGE_LEFT) && (edges & WLR_EDGE_RIGHT));
+        if (!invalid)
+        {
+            get_cursor_images(wlr_xcursor_get_resize_name((wlr_edges)edges));
+        }
+    }
+}
+
+const std::vector<wf::cursor_t::scaled_image_t>& wf::cursor_t::get_cursor_images(
+    const std::string& name)
+{
+    auto it = cursor_cache.find(name);
+    if (it != cursor_cache.end())
+    {
+        return it->second;
+    }
+
+    /* Only the first image of animated cursors is shown, like wlroots does */
+    std::vector<scaled_image_t> images;
+    wlr_xcursor_manager_theme *theme;
+    wl_list_for_each(theme, &xcursor->scaled_themes, link)
+    {
+        auto cursor = wlr_xcursor_theme_get_cursor(theme->theme, name.c_str());
+        if (cursor && (cursor->image_count > 0))
+        {
+            images.push_back({theme->scale, cursor->images[0]});
+        }
+    }
+
+    return cursor_cache[name] = std::move(images);
 }
 
 void wf::cursor_t::set_cursor(std::string name)
@@ -160,7 +281,23 @@ void wf::cursor_t::set_cursor(std::string name)
         name = "left_ptr";
     }
 
-    wlr_xcursor_manager_set_cursor_image(xcursor, name.c_str(), cursor);
+    /* Setting the image uploads it to every output again */
+    if (name == current_cursor)
+    {
+        return;
+    }
+
+    auto& images = get_cursor_images(name);
+    for (auto& scaled : images)
+    {
+        auto image = scaled.image;
+        wlr_cursor_set_image(cursor, image->buffer, image->width * 4,
+            image->width, image->height, image->hotspot_x, image->hotspot_y,
+            scaled.scale);
+    }
+
+    clear_client_cursor();
+    current_cursor = images.empty() ? "" : name;
 }
 
 void wf::cursor_t::unhide_cursor()
@@ -176,6 +313,8 @@ void wf::cursor_t::unhide_cursor()
 void wf::cursor_t::hide_cursor()
 {
     wlr_cursor_set_surface(cursor, NULL, 0, 0);
+    clear_client_cursor();
+    current_cursor.clear();
     this->hide_ref_counter++;
 }
 
@@ -213,11 +352,292 @@ void wf::cursor_t::set_cursor(
 
     if (!wf::get_core_impl().input->input_grabbed())
     {
-        wlr_cursor_set_surface(cursor, ev->surface,
-            ev->hotspot_x, ev->hotspot_y);
+        if (ev->surface && cache_client_cursors)
+        {
+            set_client_cursor(ev->surface, {ev->hotspot_x, ev->hotspot_y});
+        } else
+        {
+            clear_client_cursor();
+            wlr_cursor_set_surface(cursor, ev->surface,
+                ev->hotspot_x, ev->hotspot_y);
+        }
+
+        current_cursor.clear();
     }
 }
 
+/** FNV-1a on whole pixels, over the rows of the image and its parameters */
+static uint64_t hash_client_image(const uint8_t *data, int stride, int width,
+    int height, int scale, wf::point_t hotspot)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&] (uint32_t value)
+    {
+        hash = (hash ^ value) * 1099511628211ull;
+    };
+
+    for (int y = 0; y < height; y++)
+    {
+        auto row = (const uint32_t*)(data + (size_t)y * stride);
+        for (int x = 0; x < width; x++)
+        {
+            add(row[x]);
+        }
+    }
+
+    for (int param : {width, height, scale, hotspot.x, hotspot.y})
+    {
+        add(param);
+    }
+
+    /* 0 means that no image is shown */
+    return hash ? hash : 1;
+}
+
+/**
+ * Scale an image with bilinear filtering, like the texture of a cursor
+ * surface is scaled when rendered. The pixels are premultiplied, so the
+ * channels can be interpolated separately.
+ */
+static void scale_image(const uint32_t *src, int stride, int width, int height,
+    uint32_t *dst, int dst_width, int dst_height)
+{
+    auto channel = [] (uint32_t pixel, int shift)
+    {
+        return (float)((pixel >> shift) & 0xff);
+    };
+    auto mix = [] (float a, float b, float t)
+    {
+        return a * (1 - t) + b * t;
+    };
+
+    for (int y = 0; y < dst_height; y++)
+    {
+        float sy = std::clamp((y + 0.5f) * height / dst_height - 0.5f, 0.0f,
+            height - 1.0f);
+        int y0 = sy, y1 = std::min(y0 + 1, height - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < dst_width; x++)
+        {
+            float sx = std::clamp((x + 0.5f) * width / dst_width - 0.5f, 0.0f,
+                width - 1.0f);
+            int x0 = sx, x1 = std::min(x0 + 1, width - 1);
+            float fx = sx - x0;
+
+            uint32_t a = src[y0 * stride + x0], b = src[y0 * stride + x1],
+                c = src[y1 * stride + x0], d = src[y1 * stride + x1];
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                float top    = mix(channel(a, shift), channel(b, shift), fx);
+                float bottom = mix(channel(c, shift), channel(d, shift), fx);
+                uint32_t value = std::lround(mix(top, bottom, fy));
+                result |= std::min(value, 255u) << shift;
+            }
+
+            dst[y * dst_width + x] = result;
+        }
+    }
+}
+
+const wf::cursor_t::client_image_t& wf::cursor_t::get_client_image(
+    uint64_t hash, float output_scale, const uint32_t *data, int stride,
+    int width, int height, int scale)
+{
+    for (auto it = client_images.begin(); it != client_images.end(); ++it)
+    {
+        if ((it->hash == hash) && (it->output_scale == output_scale))
+        {
+            client_images.splice(client_images.begin(), client_images, it);
+            return client_images.front();
+        }
+    }
+
+    /* Enough for the frames of an animated cursor at a few scales */
+    const size_t max_cached = 64;
+    if (client_images.size() >= max_cached)
+    {
+        client_images.pop_back();
+    }
+
+    client_image_t image;
+    image.hash = hash;
+    image.output_scale = output_scale;
+    image.width  = std::max(1, (int)std::lround(width * output_scale / scale));
+    image.height = std::max(1, (int)std::lround(height * output_scale / scale));
+    image.hotspot.x = std::lround(client_hotspot.x * output_scale);
+    image.hotspot.y = std::lround(client_hotspot.y * output_scale);
+    image.pixels.resize((size_t)image.width * image.height);
+    scale_image(data, stride, width, height, image.pixels.data(),
+        image.width, image.height);
+
+    client_images.push_front(std::move(image));
+    return client_images.front();
+}
+
+void wf::cursor_t::set_client_cursor(wlr_surface *surface, wf::point_t hotspot)
+{
+    if ((surface == client_surface) && (hotspot == client_hotspot) &&
+        !client_surface_fallback)
+    {
+        /* Clients often set the same cursor again, on each enter */
+        return;
+    }
+
+    if ((surface != client_surface) || client_surface_fallback)
+    {
+        /* If another surface has the same image, it is not uploaded again */
+        uint64_t shown = shown_client_image;
+        clear_client_cursor();
+        shown_client_image = shown;
+
+        client_surface = surface;
+        on_client_surface_commit.connect(&surface->events.commit);
+        on_client_surface_destroy.connect(&surface->events.destroy);
+    }
+
+    client_hotspot = hotspot;
+    client_surface_fallback = false;
+    update_client_cursor();
+}
+
+void wf::cursor_t::update_client_cursor()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (!wlr_surface_has_buffer(client_surface))
+    {
+        if (shown_client_image)
+        {
+            wlr_cursor_set_image(cursor, NULL, 0, 0, 0, 0, 0, 0);
+            shown_client_image = 0;
+        }
+
+        wlr_surface_send_frame_done(client_surface, &now);
+
+        return;
+    }
+
+    auto resource = client_surface->buffer->resource;
+    auto shm = resource ? wl_shm_buffer_get(resource) : nullptr;
+    auto format = shm ? wl_shm_buffer_get_format(shm) : 0;
+    if (!shm ||
+        (client_surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL) ||
+        ((format != WL_SHM_FORMAT_ARGB8888) && (format != WL_SHM_FORMAT_XRGB8888)))
+    {
+        /* wlroots takes over the commits, the enter events and frame
+         * callbacks of the surface */
+        auto surface = client_surface;
+        auto hotspot = client_hotspot;
+        clear_client_cursor();
+        client_surface = surface;
+        client_surface_fallback = true;
+        on_client_surface_destroy.connect(&surface->events.destroy);
+        wlr_cursor_set_surface(cursor, surface, hotspot.x, hotspot.y);
+
+        return;
+    }
+
+    wl_shm_buffer_begin_access(shm);
+    auto data   = (const uint8_t*)wl_shm_buffer_get_data(shm);
+    int stride  = wl_shm_buffer_get_stride(shm);
+    int width   = wl_shm_buffer_get_width(shm);
+    int height  = wl_shm_buffer_get_height(shm);
+    int scale   = client_surface->current.scale;
+    uint64_t hash =
+        hash_client_image(data, stride, width, height, scale, client_hotspot);
+
+    if (hash != shown_client_image)
+    {
+        std::vector<uint32_t> opaque;
+        const uint32_t *pixels = (const uint32_t*)data;
+        int pixel_stride = stride / 4;
+        if (format == WL_SHM_FORMAT_XRGB8888)
+        {
+            opaque.resize((size_t)width * height);
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    opaque[y * width + x] =
+                        pixels[y * pixel_stride + x] | 0xff000000;
+                }
+            }
+
+            pixels = opaque.data();
+            pixel_stride = width;
+        }
+
+        std::vector<float> scales;
+        for (auto output : wf::get_core().output_layout->get_outputs())
+        {
+            float output_scale = output->handle->scale;
+            if (std::find(scales.begin(), scales.end(), output_scale) !=
+                scales.end())
+            {
+                continue;
+            }
+
+            scales.push_back(output_scale);
+            auto& image = get_client_image(hash, output_scale, pixels,
+                pixel_stride, width, height, scale);
+            wlr_cursor_set_image(cursor, (const uint8_t*)image.pixels.data(),
+                image.width * 4, image.width, image.height,
+                image.hotspot.x, image.hotspot.y, output_scale);
+        }
+
+        shown_client_image = hash;
+    }
+
+    wl_shm_buffer_end_access(shm);
+
+    update_client_cursor_output();
+    wlr_surface_send_frame_done(client_surface, &now);
+}
+
+void wf::cursor_t::clear_client_cursor()
+{
+    if (client_surface && client_surface_output && !client_surface_fallback)
+    {
+        wlr_surface_send_leave(client_surface, client_surface_output->handle);
+    }
+
+    on_client_surface_commit.disconnect();
+    on_client_surface_destroy.disconnect();
+    client_surface = nullptr;
+    client_surface_output = nullptr;
+    client_surface_fallback = false;
+    shown_client_image = 0;
+}
+
+void wf::cursor_t::update_client_cursor_output()
+{
+    if (!client_surface || client_surface_fallback)
+    {
+        return;
+    }
+
+    auto output = wf::get_core().output_layout->get_output_at(
+        cursor->x, cursor->y);
+    if (output == client_surface_output)
+    {
+        return;
+    }
+
+    if (client_surface_output)
+    {
+        wlr_surface_send_leave(client_surface, client_surface_output->handle);
+    }
+
+    if (output)
+    {
+        wlr_surface_send_enter(client_surface, output->handle);
+    }
+
+    client_surface_output = output;
+}
+
 void wf::cursor_t::set_touchscreen_mode(bool enabled)
 {
     if (this->touchscreen_mode_active == enabled)
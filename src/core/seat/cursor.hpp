@@ -3,6 +3,10 @@
 
 #include "seat.hpp"
 #include "wayfire/plugin.hpp"
+#include "wayfire/option-wrapper.hpp"
+#include <list>
+#include <unordered_map>
+#include <vector>
 
 namespace wf
 {
@@ -42,6 +46,78 @@ struct cursor_t
     void setup_listeners();
     void load_xcursor_scale(float scale);
 
+    /** The image of a cursor in one of the loaded scales of the theme */
+    struct scaled_image_t
+    {
+        float scale;
+        wlr_xcursor_image *image;
+    };
+
+    /**
+     * The images of the cursors which were used, by name, so that switching
+     * cursors does not search the theme. Cleared whenever the theme or its
+     * scales change.
+     */
+    std::unordered_map<std::string, std::vector<scaled_image_t>> cursor_cache;
+    const std::vector<scaled_image_t>& get_cursor_images(const std::string& name);
+    /** Fill the cache with the cursors which are commonly used */
+    void preload_cursors();
+
+    /**
+     * The name of the cursor which is shown, or empty if a client surface or
+     * no cursor is shown.
+     */
+    std::string current_cursor;
+
+    /**
+     * wlr_cursor_set_surface() uploads the image of a client cursor surface
+     * on each commit. Instead, client cursors in shm buffers are shown with
+     * wlr_cursor_set_image(), only when their contents change: the images
+     * are hashed, converted to each output scale once, and cached, so that
+     * the frames of animated cursors are converted only once. Setting the
+     * cursor which is already shown does nothing.
+     *
+     * Other buffers, and all buffers if input/cache_client_cursors is
+     * disabled, are shown with wlr_cursor_set_surface().
+     */
+    struct client_image_t
+    {
+        /* The hash of the buffer contents, its scale and the hotspot */
+        uint64_t hash;
+        float output_scale;
+        int width, height;
+        wf::point_t hotspot;
+        std::vector<uint32_t> pixels;
+    };
+
+    /* The most recently used images first */
+    std::list<client_image_t> client_images;
+    const client_image_t& get_client_image(uint64_t hash, float output_scale,
+        const uint32_t *data, int stride, int width, int height, int scale);
+
+    wlr_surface *client_surface = nullptr;
+    /* The hotspot in surface coordinates */
+    wf::point_t client_hotspot;
+    /* The hash of the shown client image, or 0 */
+    uint64_t shown_client_image = 0;
+    /* Whether the client surface is shown by wlroots */
+    bool client_surface_fallback = false;
+    /* The output which the client surface has entered */
+    wf::output_t *client_surface_output = nullptr;
+
+    wf::wl_listener_wrapper on_client_surface_commit, on_client_surface_destroy;
+    wf::signal_connection_t on_outputs_changed, on_output_removed;
+    wf::option_wrapper_t<bool> cache_client_cursors{"input/cache_client_cursors"};
+
+    void set_client_cursor(wlr_surface *surface, wf::point_t hotspot);
+    /** Show the current buffer of the client surface, if it changed */
+    void update_client_cursor();
+    /** Forget the client surface, when another cursor image is set */
+    void clear_client_cursor();
+
+    /** Update the output which the client cursor surface has entered */
+    void update_client_cursor_output();
+
     // Device event listeners
     wf::wl_listener_wrapper on_button, on_motion, on_motion_absolute, on_axis,
 
@@ -1,11 +1,161 @@
 #include "hotspot-manager.hpp"
+#include "wayfire/core.hpp"
+#include "wayfire/render-manager.hpp"
+#include <algorithm>
 
-void wf::hotspot_instance_t::process_input_motion(wf::point_t gc)
+wf::hotspot_dispatcher_t::hotspot_dispatcher_t(wf::output_t *output)
+{
+    this->output = output;
+
+    /* The post signals come after the cursor was moved */
+    on_motion.set_callback([=] (wf::signal_data_t*)
+    {
+        auto gcf = wf::get_core().get_cursor_position();
+        dispatch({(int)gcf.x, (int)gcf.y});
+    });
+    wf::get_core().connect_signal("pointer_motion_post", &on_motion);
+    wf::get_core().connect_signal("pointer_motion_absolute_post", &on_motion);
+    wf::get_core().connect_signal("tablet_axis_post", &on_motion);
+
+    on_touch_motion.set_callback([=] (wf::signal_data_t*)
+    {
+        auto gcf = wf::get_core().get_touch_position(0);
+        dispatch({(int)gcf.x, (int)gcf.y});
+    });
+    wf::get_core().connect_signal("touch_motion_post", &on_touch_motion);
+
+    /* Hotspots on a dormant output don't trigger, so the ones which contain
+     * the cursor now are left */
+    on_dormant_changed.set_callback([=] (wf::signal_data_t*)
+    {
+        auto gcf = wf::get_core().get_cursor_position();
+        dispatch({(int)gcf.x, (int)gcf.y});
+    });
+    output->connect_signal("dormant-changed", &on_dormant_changed);
+}
+
+wf::hotspot_dispatcher_t& wf::hotspot_dispatcher_t::get(wf::output_t *output)
+{
+    if (!output->has_data<hotspot_dispatcher_t>())
+    {
+        output->store_data(std::make_unique<hotspot_dispatcher_t>(output));
+    }
+
+    return *output->get_data<hotspot_dispatcher_t>();
+}
+
+void wf::hotspot_dispatcher_t::add_hotspot(hotspot_listener_t *hotspot)
+{
+    for (auto& edge : at_edge)
+    {
+        edge.erase(std::remove_if(edge.begin(), edge.end(),
+            [=] (const entry_t& entry) { return entry.hotspot == hotspot; }),
+            edge.end());
+    }
+
+    auto og = output->get_layout_geometry();
+    for (auto& rect : hotspot->get_hotspot_rects())
+    {
+        /* Index each rectangle at the edge it reaches the least far from, so
+         * that it is woken up only close to it */
+        int depth[4] = {
+            rect.y + rect.height - og.y,
+            og.y + og.height - rect.y,
+            rect.x + rect.width - og.x,
+            og.x + og.width - rect.x,
+        };
+        bool at[4] = {
+            rect.y <= og.y,
+            rect.y + rect.height >= og.y + og.height,
+            rect.x <= og.x,
+            rect.x + rect.width >= og.x + og.width,
+        };
+
+        int best = -1;
+        for (int i = 0; i < 4; i++)
+        {
+            if (at[i] && ((best < 0) || (depth[i] < depth[best])))
+            {
+                best = i;
+            }
+        }
+
+        if ((best >= 0) && (rect.width > 0) && (rect.height > 0))
+        {
+            at_edge[best].push_back({hotspot, depth[best]});
+        }
+    }
+}
+
+void wf::hotspot_dispatcher_t::rem_hotspot(hotspot_listener_t *hotspot)
+{
+    for (auto& edge : at_edge)
+    {
+        edge.erase(std::remove_if(edge.begin(), edge.end(),
+            [=] (const entry_t& entry) { return entry.hotspot == hotspot; }),
+            edge.end());
+    }
+
+    active.erase(std::remove(active.begin(), active.end(), hotspot),
+        active.end());
+}
+
+void wf::hotspot_dispatcher_t::dispatch(wf::point_t gc)
+{
+    std::vector<hotspot_listener_t*> woken;
+    woken.swap(active);
+
+    auto og = output->get_layout_geometry();
+    if (output->render->is_dormant())
+    {
+        gc = {og.x - 1, og.y - 1};
+    }
+
+    if (og & gc)
+    {
+        /* How far the point is from each edge, counting the pixels at the
+         * edge as 1, like the depth of the hotspots */
+        int distance[4] = {
+            gc.y - og.y + 1,
+            og.y + og.height - gc.y,
+            gc.x - og.x + 1,
+            og.x + og.width - gc.x,
+        };
+
+        for (int i = 0; i < 4; i++)
+        {
+            for (auto& entry : at_edge[i])
+            {
+                if ((distance[i] <= entry.depth) &&
+                    (std::find(woken.begin(), woken.end(), entry.hotspot) ==
+                     woken.end()))
+                {
+                    woken.push_back(entry.hotspot);
+                }
+            }
+        }
+    }
+
+    for (auto& hotspot : woken)
+    {
+        if (hotspot->process_input_motion(gc))
+        {
+            active.push_back(hotspot);
+        }
+    }
+}
+
+std::vector<wf::geometry_t> wf::hotspot_instance_t::get_hotspot_rects()
+{
+    return {hotspot_geometry[0], hotspot_geometry[1]};
+}
+
+bool wf::hotspot_instance_t::process_input_motion(wf::point_t gc)
 {
     if (!(hotspot_geometry[0] & gc) && !(hotspot_geometry[1] & gc))
     {
         timer.disconnect();
-        return;
+        return false;
     }
 
     if (!timer.is_connected())
@@ -16,6 +166,8 @@ void wf::hotspot_instance_t::process_input_motion(wf::point_t gc)
             return false;
         });
     }
+
+    return true;
 }
 
 wf::geometry_t wf::hotspot_instance_t::pin(wf::dimensions_t dim) noexcept
@@ -81,9 +233,6 @@ wf::hotspot_instance_t::hotspot_instance_t(wf::output_t *output, uint32_t edges,
     std::function<void(uint32_t)> callback)
 {
     output->connect_signal("configuration-changed", &on_output_config_changed);
-    wf::get_core().connect_signal("pointer_motion", &on_motion_event);
-    wf::get_core().connect_signal("tablet_axis", &on_motion_event);
-    wf::get_core().connect_signal("touch_motion", &on_touch_motion_event);
 
     this->edges = edges;
     this->along = along;
@@ -93,28 +242,20 @@ wf::hotspot_instance_t::hotspot_instance_t(wf::output_t *output, uint32_t edges,
     this->callback   = callback;
 
     recalc_geometry();
-
-    // callbacks
-    on_motion_event.set_callback([=] (wf::signal_data_t *data)
-    {
-        auto gcf = wf::get_core().get_cursor_position();
-        wf::point_t gc{(int)gcf.x, (int)gcf.y};
-        process_input_motion(gc);
-    });
-
-    on_touch_motion_event.set_callback([=] (wf::signal_data_t *data)
-    {
-        auto gcf = wf::get_core().get_touch_position(0);
-        wf::point_t gc{(int)gcf.x, (int)gcf.y};
-        process_input_motion(gc);
-    });
+    hotspot_dispatcher_t::get(output).add_hotspot(this);
 
     on_output_config_changed.set_callback([=] (wf::signal_data_t*)
     {
         recalc_geometry();
+        hotspot_dispatcher_t::get(output).add_hotspot(this);
     });
 }
 
+wf::hotspot_instance_t::~hotspot_instance_t()
+{
+    hotspot_dispatcher_t::get(output).rem_hotspot(this);
+}
+
 void wf::hotspot_manager_t::update_hotspots(const container_t& activators)
 {
     hotspots.clear();
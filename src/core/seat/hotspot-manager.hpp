@@ -27,14 +27,89 @@ struct output_binding_t : public binding_t
 template<class Option, class Callback> using binding_container_t =
     std::vector<std::unique_ptr<output_binding_t<Option, Callback>>>;
 
+/**
+ * A hotspot which gets the input motion from the hotspot dispatcher of its
+ * output.
+ */
+class hotspot_listener_t
+{
+  public:
+    virtual ~hotspot_listener_t() = default;
+
+    /**
+     * @return The rectangles of the hotspot in output-layout coordinates. Each
+     *   of them is at one or more edges of the output.
+     */
+    virtual std::vector<wf::geometry_t> get_hotspot_rects() = 0;
+
+    /**
+     * Handle the cursor or a touch point moving near the hotspot, or out of it.
+     *
+     * @return Whether the point is inside the hotspot. The hotspot then also
+     *   gets the next motion, wherever it goes.
+     */
+    virtual bool process_input_motion(wf::point_t gc) = 0;
+};
+
+/**
+ * Dispatches the input motion to the hotspots of an output.
+ *
+ * The hotspots are indexed by the edge of the output they are at. On each
+ * motion, the edges which the point is close enough to are found once, and
+ * only the hotspots at those edges and the hotspots which contained the
+ * previous point are woken up.
+ */
+class hotspot_dispatcher_t : public wf::custom_data_t
+{
+  public:
+    hotspot_dispatcher_t(wf::output_t *output);
+
+    /** @return The dispatcher of the output, created on first use. */
+    static hotspot_dispatcher_t& get(wf::output_t *output);
+
+    /**
+     * Start dispatching to the given hotspot. Must be called again when the
+     * rectangles of the hotspot change.
+     */
+    void add_hotspot(hotspot_listener_t *hotspot);
+
+    /** Stop dispatching to the given hotspot. */
+    void rem_hotspot(hotspot_listener_t *hotspot);
+
+  private:
+    struct entry_t
+    {
+        hotspot_listener_t *hotspot;
+        /* How far the hotspot reaches from the edge */
+        int depth;
+    };
+
+    wf::output_t *output;
+
+    /* The hotspots at the top, bottom, left and right edge */
+    std::vector<entry_t> at_edge[4];
+    /* The hotspots which contain the last point */
+    std::vector<hotspot_listener_t*> active;
+
+    wf::signal_connection_t on_motion;
+    wf::signal_connection_t on_touch_motion;
+    wf::signal_connection_t on_dormant_changed;
+
+    void dispatch(wf::point_t gc);
+};
+
 /**
  * Represents an instance of a hotspot.
  */
-class hotspot_instance_t : public noncopyable_t
+class hotspot_instance_t : public hotspot_listener_t, public noncopyable_t
 {
   public:
     hotspot_instance_t(wf::output_t *output, uint32_t edges, uint32_t along,
         uint32_t away, int32_t timeout, std::function<void(uint32_t)> callback);
+    ~hotspot_instance_t();
+
+    std::vector<wf::geometry_t> get_hotspot_rects() override;
+    bool process_input_motion(wf::point_t gc) override;
 
   private:
     /** The output this hotspot is on */
@@ -58,13 +133,8 @@ class hotspot_instance_t : public noncopyable_t
     /** Callback to execute */
     std::function<void(uint32_t)> callback;
 
-    wf::signal_connection_t on_motion_event;
-    wf::signal_connection_t on_touch_motion_event;
     wf::signal_connection_t on_output_config_changed;
 
-    /** Update state based on input motion */
-    void process_input_motion(wf::point_t gc);
-
     /** Calculate a rectangle with size @dim inside @og at the correct edges. */
     wf::geometry_t pin(wf::dimensions_t dim) noexcept;
 
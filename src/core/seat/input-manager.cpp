@@ -13,6 +13,7 @@
 #include "wayfire/workspace-manager.hpp"
 #include <wayfire/util/log.hpp>
 #include <wayfire/debug.hpp>
+#include <poll.h>
 
 #include "switch.hpp"
 #include "tablet.hpp"
@@ -46,6 +47,7 @@ void wf::input_manager_t::handle_new_input(wlr_input_device *dev)
     LOGI("handle new input: ", dev->name,
         ", default mapping: ", dev->output_name);
     input_devices.push_back(create_wf_device_for_device(dev));
+    watch_libinput_device(dev);
 
     wf::input_device_signal data;
     data.device = nonstd::make_observer(input_devices.back().get());
@@ -79,7 +81,8 @@ void wf::input_manager_t::refresh_device_mappings()
         auto wo = wf::get_core().output_layout->find_output(mapped_output);
         if (wo)
         {
-            LOGD("Mapping input ", dev->name, " to output ", wo->to_string(), ".");
+            LOGC(INPUT, "Mapping input ", dev->name, " to output ",
+                wo->to_string(), ".");
             wlr_cursor_map_input_to_output(cursor, dev, wo->handle);
         }
     }
@@ -129,6 +132,9 @@ wf::input_manager_t::input_manager_t()
 
     load_locked_mods_from_config(locked_mods);
 
+    /* Other idle work, like reflowing views, should see the new focus */
+    idle_update_cursor.set_priority(wf::IDLE_PRIORITY_HIGH);
+
     input_device_created.set_callback([&] (void *data)
     {
         auto dev = static_cast<wlr_input_device*>(data);
@@ -137,8 +143,13 @@ wf::input_manager_t::input_manager_t()
     });
     input_device_created.connect(&wf::get_core().backend->events.new_input);
 
-    config_updated = [=] (wf::signal_data_t*)
+    config_updated = [=] (wf::signal_data_t *data)
     {
+        if (!wf::config_section_changed(data, "input"))
+        {
+            return;
+        }
+
         for (auto& dev : input_devices)
         {
             dev->update_options();
@@ -256,19 +267,21 @@ wf::surface_interface_t*wf::input_manager_t::input_surface_at(
     global.x -= og.x;
     global.y -= og.y;
 
+    wf::surface_interface_t *surface = nullptr;
     for (auto& v : output->workspace->get_views_in_layer(wf::VISIBLE_LAYERS))
     {
-        for (auto& view : v->enumerate_views())
+        v->for_each_view([&] (wayfire_view view)
         {
-            if (!view->minimized && view->is_visible() &&
+            if (!surface && !view->minimized && view->is_visible() &&
                 can_focus_surface(view.get()))
             {
-                auto surface = view->map_input_coordinates(global, local);
-                if (surface)
-                {
-                    return surface;
-                }
+                surface = view->map_input_coordinates(global, local);
             }
+        });
+
+        if (surface)
+        {
+            return surface;
         }
     }
 
@@ -311,6 +324,92 @@ wf::bindings_repository_t& wf::input_manager_t::get_active_bindings()
     return impl->get_bindings();
 }
 
+void wf::record_input_event()
+{
+    auto& input = wf::get_core_impl().input;
+    if (!input)
+    {
+        return;
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    input->last_event_time = ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+    ++input->last_event_serial;
+    input->handle_input_event();
+}
+
+void wf::input_manager_t::watch_libinput_device(wlr_input_device *dev)
+{
+    if (!wlr_input_device_is_libinput(dev))
+    {
+        return;
+    }
+
+    auto handle = wlr_libinput_get_device_handle(dev);
+    int fd = libinput_get_fd(libinput_device_get_context(handle));
+    if (std::find(libinput_fds.begin(), libinput_fds.end(), fd) ==
+        libinput_fds.end())
+    {
+        libinput_fds.push_back(fd);
+    }
+}
+
+bool wf::input_manager_t::has_pending_input()
+{
+    if (libinput_fds.empty())
+    {
+        return false;
+    }
+
+    std::vector<pollfd> fds;
+    for (int fd : libinput_fds)
+    {
+        fds.push_back({fd, POLLIN, 0});
+    }
+
+    return poll(fds.data(), fds.size(), 0) > 0;
+}
+
+void wf::input_manager_t::run_after_input(std::function<void()> *callback)
+{
+    cancel_run_after_input(callback);
+    input_waiters.push_back(callback);
+}
+
+void wf::input_manager_t::cancel_run_after_input(std::function<void()> *callback)
+{
+    input_waiters.erase(std::remove(input_waiters.begin(), input_waiters.end(),
+        callback), input_waiters.end());
+}
+
+void wf::input_manager_t::handle_input_event()
+{
+    if (input_waiters.empty() || idle_input_handled.is_connected())
+    {
+        return;
+    }
+
+    /* The rest of the events read together with this one are handled in the
+     * same dispatch of the event loop, so wait until it is over */
+    idle_input_handled.run_once([=] ()
+    {
+        if (has_pending_input())
+        {
+            /* Even more input arrived in the meantime. The waiters have a
+             * timeout, so they don't starve. */
+            return;
+        }
+
+        auto waiters = std::move(input_waiters);
+        input_waiters.clear();
+        for (auto callback : waiters)
+        {
+            (*callback)();
+        }
+    });
+}
+
 wf::SurfaceMapStateListener::SurfaceMapStateListener()
 {
     on_surface_map_state_change = [=] (void *data)
@@ -4,6 +4,7 @@
 #include <map>
 #include <vector>
 #include <chrono>
+#include <functional>
 
 #include "seat.hpp"
 #include "bindings-repository.hpp"
@@ -83,18 +84,70 @@ class input_manager_t
 
     /** @return the bindings for the active output */
     wf::bindings_repository_t& get_active_bindings();
+
+    /**
+     * When the most recent input event was handled (CLOCK_MONOTONIC, in
+     * nanoseconds), or -1 if there has been none. The serial is incremented
+     * with each event.
+     */
+    int64_t last_event_time = -1;
+    uint64_t last_event_serial = 0;
+
+    /**
+     * @return Whether the libinput backend has events which haven't been read
+     *   yet, because the event loop is busy with other work.
+     */
+    bool has_pending_input();
+
+    /**
+     * Call the callback once the input events which are pending now have been
+     * handled, from an idle callback after the event loop has read them. Used
+     * by outputs to handle input before they are repainted.
+     *
+     * @param callback The callback to add. It must stay valid until it is
+     *   called or removed.
+     */
+    void run_after_input(std::function<void()> *callback);
+
+    /** Remove a callback added with run_after_input(). No-op if not added. */
+    void cancel_run_after_input(std::function<void()> *callback);
+
+    /** Called by record_input_event() */
+    void handle_input_event();
+
+  private:
+    /* The fds of the libinput contexts of the devices, usually just one */
+    std::vector<int> libinput_fds;
+    void watch_libinput_device(wlr_input_device *dev);
+
+    std::vector<std::function<void()>*> input_waiters;
+    wf::wl_idle_call idle_input_handled;
 };
+
+/** Record the time when an input event is handled, for frame_stats_t. */
+void record_input_event();
 }
 
 /**
  * Emit a signal for device events.
  */
 template<class EventType>
-void emit_device_event_signal(std::string event_name, EventType *event)
+void emit_device_event_signal(const wf::signal_id_t& event_id, EventType *event)
 {
+    wf::record_input_event();
+
     wf::input_event_signal<EventType> data;
     data.event = event;
-    wf::get_core().emit_signal(event_name, &data);
+    wf::get_core().emit_signal(event_id, &data);
+}
+
+/**
+ * Emit a signal for device events.
+ */
+template<class EventType>
+void emit_device_event_signal(std::string event_name, EventType *event)
+{
+    emit_device_event_signal(wf::signal_id_t{event_name}, event);
 }
 
 #endif /* end of include guard: INPUT_MANAGER_HPP */
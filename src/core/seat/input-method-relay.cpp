@@ -12,6 +12,8 @@ wf::input_method_relay::input_method_relay()
         auto wlr_text_input = static_cast<wlr_text_input_v3*>(data);
         text_inputs.push_back(std::make_unique<wf::text_input>(this,
             wlr_text_input));
+        auto client = wl_resource_get_client(wlr_text_input->resource);
+        client_inputs[client].push_back(text_inputs.back().get());
     });
 
     on_input_method_new.set_callback([&] (void *data)
@@ -84,6 +86,9 @@ wf::input_method_relay::input_method_relay()
         on_input_method_commit.disconnect();
         on_input_method_destroy.disconnect();
         input_method = nullptr;
+        idle_send_state.disconnect();
+        pending_state_input = nullptr;
+        sent_state.valid    = false;
 
         auto *text_input = find_focused_text_input();
         if (text_input != nullptr)
@@ -103,20 +108,84 @@ wf::input_method_relay::input_method_relay()
     wf::get_core().connect_signal("keyboard-focus-changed", &keyboard_focus_changed);
 }
 
-void wf::input_method_relay::send_im_state(wlr_text_input_v3 *input)
+void wf::input_method_relay::send_im_state(wlr_text_input_v3 *input, bool full)
 {
-    wlr_input_method_v2_send_surrounding_text(
-        input_method,
-        input->current.surrounding.text,
-        input->current.surrounding.cursor,
-        input->current.surrounding.anchor);
-    wlr_input_method_v2_send_text_change_cause(
-        input_method,
-        input->current.text_change_cause);
-    wlr_input_method_v2_send_content_type(input_method,
-        input->current.content_type.hint,
-        input->current.content_type.purpose);
+    if (pending_state_input == input)
+    {
+        idle_send_state.disconnect();
+        pending_state_input = nullptr;
+    }
+
+    auto& current = input->current;
+    im_state_t state;
+    state.valid = true;
+    state.has_surrounding  = current.surrounding.text != nullptr;
+    state.surrounding_text = current.surrounding.text ?
+        current.surrounding.text : "";
+    state.cursor = current.surrounding.cursor;
+    state.anchor = current.surrounding.anchor;
+    state.text_change_cause = current.text_change_cause;
+    state.hint    = current.content_type.hint;
+    state.purpose = current.content_type.purpose;
+
+    full |= !sent_state.valid;
+    bool surrounding_changed = full ||
+        (state.has_surrounding != sent_state.has_surrounding) ||
+        (state.surrounding_text != sent_state.surrounding_text) ||
+        (state.cursor != sent_state.cursor) || (state.anchor != sent_state.anchor);
+    bool cause_changed = surrounding_changed ||
+        (state.text_change_cause != sent_state.text_change_cause);
+    bool content_type_changed = full || (state.hint != sent_state.hint) ||
+        (state.purpose != sent_state.purpose);
+
+    if (!cause_changed && !content_type_changed)
+    {
+        return;
+    }
+
+    if (surrounding_changed)
+    {
+        wlr_input_method_v2_send_surrounding_text(
+            input_method,
+            current.surrounding.text,
+            current.surrounding.cursor,
+            current.surrounding.anchor);
+    }
+
+    if (cause_changed)
+    {
+        wlr_input_method_v2_send_text_change_cause(
+            input_method,
+            current.text_change_cause);
+    }
+
+    if (content_type_changed)
+    {
+        wlr_input_method_v2_send_content_type(input_method,
+            current.content_type.hint,
+            current.content_type.purpose);
+    }
+
     wlr_input_method_v2_send_done(input_method);
+    sent_state = std::move(state);
+}
+
+void wf::input_method_relay::schedule_im_state(wlr_text_input_v3 *input)
+{
+    if (pending_state_input && (pending_state_input != input))
+    {
+        send_im_state(pending_state_input);
+    }
+
+    pending_state_input = input;
+    idle_send_state.run_once([=] ()
+    {
+        pending_state_input = nullptr;
+        if (input_method)
+        {
+            send_im_state(input);
+        }
+    });
 }
 
 void wf::input_method_relay::disable_text_input(wlr_text_input_v3 *input)
@@ -129,11 +198,29 @@ void wf::input_method_relay::disable_text_input(wlr_text_input_v3 *input)
     }
 
     wlr_input_method_v2_send_deactivate(input_method);
-    send_im_state(input);
+    send_im_state(input, true);
 }
 
 void wf::input_method_relay::remove_text_input(wlr_text_input_v3 *input)
 {
+    if (pending_state_input == input)
+    {
+        idle_send_state.disconnect();
+        pending_state_input = nullptr;
+    }
+
+    auto client = wl_resource_get_client(input->resource);
+    auto& inputs = client_inputs[client];
+    inputs.erase(std::remove_if(inputs.begin(), inputs.end(),
+        [&] (const auto & inp)
+    {
+        return inp->input == input;
+    }), inputs.end());
+    if (inputs.empty())
+    {
+        client_inputs.erase(client);
+    }
+
     auto it = std::remove_if(text_inputs.begin(),
         text_inputs.end(),
         [&] (const auto & inp)
@@ -145,14 +232,18 @@ void wf::input_method_relay::remove_text_input(wlr_text_input_v3 *input)
 
 wf::text_input*wf::input_method_relay::find_focusable_text_input()
 {
-    auto it = std::find_if(text_inputs.begin(), text_inputs.end(),
-        [&] (const auto & text_input)
+    auto it = client_inputs.find(focused_client);
+    if (it == client_inputs.end())
     {
-        return text_input->pending_focused_surface != nullptr;
-    });
-    if (it != text_inputs.end())
+        return nullptr;
+    }
+
+    for (auto& text_input : it->second)
     {
-        return it->get();
+        if (text_input->pending_focused_surface != nullptr)
+        {
+            return text_input;
+        }
     }
 
     return nullptr;
@@ -160,14 +251,18 @@ wf::text_input*wf::input_method_relay::find_focusable_text_input()
 
 wf::text_input*wf::input_method_relay::find_focused_text_input()
 {
-    auto it = std::find_if(text_inputs.begin(), text_inputs.end(),
-        [&] (const auto & text_input)
+    auto it = client_inputs.find(focused_client);
+    if (it == client_inputs.end())
     {
-        return text_input->input->focused_surface != nullptr;
-    });
-    if (it != text_inputs.end())
+        return nullptr;
+    }
+
+    for (auto& text_input : it->second)
     {
-        return it->get();
+        if (text_input->input->focused_surface != nullptr)
+        {
+            return text_input;
+        }
     }
 
     return nullptr;
@@ -175,7 +270,27 @@ wf::text_input*wf::input_method_relay::find_focused_text_input()
 
 void wf::input_method_relay::set_focus(wlr_surface *surface)
 {
-    for (auto & text_input : text_inputs)
+    /* Only the text inputs of the previously and the newly focused client
+     * need to be updated */
+    std::vector<text_input*> affected;
+    auto new_client = surface ? wl_resource_get_client(surface->resource) :
+        nullptr;
+    for (auto client : {focused_client, new_client})
+    {
+        auto it = client_inputs.find(client);
+        if (it != client_inputs.end())
+        {
+            affected.insert(affected.end(), it->second.begin(), it->second.end());
+        }
+
+        if (focused_client == new_client)
+        {
+            break;
+        }
+    }
+
+    focused_client = new_client;
+    for (auto & text_input : affected)
     {
         if (text_input->pending_focused_surface != nullptr)
         {
@@ -231,7 +346,7 @@ wf::text_input::text_input(wf::input_method_relay *rel, wlr_text_input_v3 *in) :
         }
 
         wlr_input_method_v2_send_activate(relay->input_method);
-        relay->send_im_state(input);
+        relay->send_im_state(input, true);
     });
 
     on_text_input_commit.set_callback([&] (void *data)
@@ -253,7 +368,7 @@ wf::text_input::text_input(wf::input_method_relay *rel, wlr_text_input_v3 *in) :
             return;
         }
 
-        relay->send_im_state(input);
+        relay->schedule_im_state(input);
     });
 
     on_text_input_disable.set_callback([&] (void *data)
@@ -6,6 +6,8 @@
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 namespace wf
 {
@@ -21,6 +23,29 @@ class input_method_relay
     text_input *find_focused_text_input();
     void set_focus(wlr_surface*);
 
+    /* The text inputs of each client. Only the text inputs of the client with
+     * keyboard focus can be focused or have a pending focused surface. */
+    std::unordered_map<wl_client*, std::vector<text_input*>> client_inputs;
+    wl_client *focused_client = nullptr;
+
+    /** The text input state which was last sent to the input method */
+    struct im_state_t
+    {
+        bool valid = false;
+        bool has_surrounding = false;
+        std::string surrounding_text;
+        uint32_t cursor = 0, anchor = 0;
+        uint32_t text_change_cause = 0;
+        uint32_t hint = 0, purpose = 0;
+    };
+
+    im_state_t sent_state;
+
+    /* Commits of a text input are coalesced and sent to the input method once
+     * the pending events were dispatched */
+    wlr_text_input_v3 *pending_state_input = nullptr;
+    wf::wl_idle_call idle_send_state;
+
     wf::signal_connection_t keyboard_focus_changed{[this] (wf::signal_data_t *data)
         {
             auto ev = static_cast<wf::keyboard_focus_changed_signal*>(data);
@@ -34,7 +59,16 @@ class input_method_relay
     std::vector<std::unique_ptr<text_input>> text_inputs;
 
     input_method_relay();
-    void send_im_state(wlr_text_input_v3*);
+    /**
+     * Send the parts of the text input state which changed since they were
+     * last sent to the input method.
+     *
+     * @param full Whether to send all of the state, as needed after the
+     *   input method was (de)activated.
+     */
+    void send_im_state(wlr_text_input_v3*, bool full = false);
+    /** Send the text input state on idle, once for a burst of commits */
+    void schedule_im_state(wlr_text_input_v3*);
     void disable_text_input(wlr_text_input_v3*);
     void remove_text_input(wlr_text_input_v3*);
     ~input_method_relay();
@@ -1,8 +1,11 @@
+#include <algorithm>
 #include <cstring>
+#include <vector>
 #include <linux/input-event-codes.h>
 #include <xkbcommon/xkbcommon.h>
 
 #include <wayfire/util/log.hpp>
+#include <wayfire/trace.hpp>
 #include "pointer.hpp"
 #include "keyboard.hpp"
 #include "../core-impl.hpp"
@@ -15,16 +18,22 @@
 
 void wf::keyboard_t::setup_listeners()
 {
-    on_config_reload.set_callback([&] (signal_data_t*)
+    on_config_reload.set_callback([&] (signal_data_t *data)
     {
-        reload_input_options();
+        if (config_section_changed(data, "input"))
+        {
+            reload_input_options();
+        }
     });
     wf::get_core().connect_signal("reload-config", &on_config_reload);
 
     on_key.set_callback([&] (void *data)
     {
+        WF_TRACE_SCOPE("keyboard key");
+        static const wf::signal_id_t key_id{"keyboard_key"};
+        static const wf::signal_id_t key_post_id{"keyboard_key_post"};
         auto ev = static_cast<wlr_event_keyboard_key*>(data);
-        emit_device_event_signal("keyboard_key", ev);
+        emit_device_event_signal(key_id, ev);
 
         auto& seat = wf::get_core_impl().seat;
         seat->set_keyboard(this);
@@ -36,7 +45,7 @@ void wf::keyboard_t::setup_listeners()
         }
 
         wlr_idle_notify_activity(wf::get_core().protocols.idle, seat->seat);
-        emit_device_event_signal("keyboard_key_post", ev);
+        emit_device_event_signal(key_post_id, ev);
     });
 
     on_modifier.set_callback([&] (void *data)
@@ -94,6 +103,88 @@ static void set_locked_mod(xkb_mod_mask_t *mods, xkb_keymap *keymap, const char
     }
 }
 
+namespace
+{
+/**
+ * Compiled keymaps, shared by all keyboards. Compiling a keymap takes a lot
+ * longer than looking it up, and usually all keyboards use the same one.
+ */
+class keymap_cache_t
+{
+  public:
+    static keymap_cache_t& get()
+    {
+        static keymap_cache_t cache;
+        return cache;
+    }
+
+    /**
+     * Find or compile the keymap for the given names.
+     *
+     * @return A new reference to the keymap.
+     */
+    xkb_keymap *get_keymap(const std::string& rules, const std::string& model,
+        const std::string& layout, const std::string& variant,
+        const std::string& options)
+    {
+        std::vector<std::string> key = {rules, model, layout, variant, options};
+        for (auto& entry : entries)
+        {
+            if (entry.names == key)
+            {
+                return xkb_keymap_ref(entry.keymap);
+            }
+        }
+
+        xkb_rule_names names;
+        names.rules   = rules.c_str();
+        names.model   = model.c_str();
+        names.layout  = layout.c_str();
+        names.variant = variant.c_str();
+        names.options = options.c_str();
+        auto keymap = xkb_map_new_from_names(context, &names,
+            XKB_KEYMAP_COMPILE_NO_FLAGS);
+
+        if (!keymap)
+        {
+            LOGE("Could not create keymap with given configuration:",
+                " rules=\"", rules, "\" model=\"", model, "\" layout=\"", layout,
+                "\" variant=\"", variant, "\" options=\"", options, "\"");
+
+            // reset to NULL
+            std::memset(&names, 0, sizeof(names));
+            keymap = xkb_map_new_from_names(context, &names,
+                XKB_KEYMAP_COMPILE_NO_FLAGS);
+        }
+
+        if (entries.size() >= MAX_ENTRIES)
+        {
+            xkb_keymap_unref(entries.front().keymap);
+            entries.erase(entries.begin());
+        }
+
+        entries.push_back({key, keymap});
+
+        return xkb_keymap_ref(keymap);
+    }
+
+  private:
+    /* A few recent configurations, so that switching back and forth between
+     * them does not compile them again */
+    static constexpr size_t MAX_ENTRIES = 4;
+
+    struct entry_t
+    {
+        std::vector<std::string> names;
+        xkb_keymap *keymap;
+    };
+
+    /* Never destroyed, like the keymaps held by the keyboards */
+    xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    std::vector<entry_t> entries;
+};
+}
+
 void wf::keyboard_t::reload_input_options()
 {
     if (!this->dirty_options)
@@ -103,34 +194,8 @@ void wf::keyboard_t::reload_input_options()
 
     this->dirty_options = false;
 
-    auto ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-
-    /* Copy memory to stack, so that .c_str() is valid */
-    std::string rules   = this->rules;
-    std::string model   = this->model;
-    std::string layout  = this->layout;
-    std::string variant = this->variant;
-    std::string options = this->options;
-
-    xkb_rule_names names;
-    names.rules   = rules.c_str();
-    names.model   = model.c_str();
-    names.layout  = layout.c_str();
-    names.variant = variant.c_str();
-    names.options = options.c_str();
-    auto keymap = xkb_map_new_from_names(ctx, &names,
-        XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-    if (!keymap)
-    {
-        LOGE("Could not create keymap with given configuration:",
-            " rules=\"", rules, "\" model=\"", model, "\" layout=\"", layout,
-            "\" variant=\"", variant, "\" options=\"", options, "\"");
-
-        // reset to NULL
-        std::memset(&names, 0, sizeof(names));
-        keymap = xkb_map_new_from_names(ctx, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
-    }
+    auto keymap = keymap_cache_t::get().get_keymap(rules, model, layout,
+        variant, options);
 
     xkb_mod_mask_t locked_mods = 0;
 
@@ -144,9 +209,14 @@ void wf::keyboard_t::reload_input_options()
         set_locked_mod(&locked_mods, keymap, XKB_MOD_NAME_CAPS);
     }
 
-    wlr_keyboard_set_keymap(handle, keymap);
+    /* Setting the keymap serializes it and sends it to the clients again,
+     * which is unnecessary if only the repeat info has changed */
+    if (handle->keymap != keymap)
+    {
+        wlr_keyboard_set_keymap(handle, keymap);
+    }
+
     xkb_keymap_unref(keymap);
-    xkb_context_unref(ctx);
 
     wlr_keyboard_set_repeat_info(handle, repeat_rate, repeat_delay);
 
@@ -156,6 +226,44 @@ void wf::keyboard_t::reload_input_options()
 wf::keyboard_t::~keyboard_t()
 {}
 
+void wf::keyboard_t::start_grab_repeat(uint32_t key)
+{
+    stop_grab_repeat();
+    if ((repeat_rate <= 0) || (repeat_delay <= 0))
+    {
+        return;
+    }
+
+    repeating_key = key;
+    auto grab = wf::get_core_impl().input->active_grab;
+    repeat_delay_timer.set_timeout(repeat_delay, [=] ()
+    {
+        repeat_timer.set_timeout(std::max(1, 1000 / repeat_rate), [=] ()
+        {
+            /* The grab might have ended without the key being released */
+            auto active_grab = wf::get_core_impl().input->active_grab;
+            if ((active_grab != grab) || !grab->callbacks.keyboard.repeat)
+            {
+                repeating_key = 0;
+                return false;
+            }
+
+            grab->callbacks.keyboard.repeat(repeating_key);
+
+            return true;
+        });
+
+        return false;
+    });
+}
+
+void wf::keyboard_t::stop_grab_repeat()
+{
+    repeating_key = 0;
+    repeat_delay_timer.disconnect();
+    repeat_timer.disconnect();
+}
+
 static bool check_vt_switch(wlr_session *session, uint32_t key, uint32_t mods)
 {
     if (!session)
@@ -276,6 +384,16 @@ bool wf::keyboard_t::handle_keyboard_key(uint32_t key, uint32_t state)
     }
 
     auto mod = mod_from_key(key);
+    if ((state == WLR_KEY_PRESSED) && !mod && active_grab &&
+        active_grab->callbacks.keyboard.repeat)
+    {
+        /* Like clients, repeat only the last pressed key */
+        start_grab_repeat(key);
+    } else if ((state == WLR_KEY_RELEASED) && (key == repeating_key))
+    {
+        stop_grab_repeat();
+    }
+
     if (mod)
     {
         handle_keyboard_mod(mod, state);
@@ -312,12 +430,12 @@ bool wf::keyboard_t::handle_keyboard_key(uint32_t key, uint32_t state)
     {
         if (mod_binding_key != 0)
         {
-            int timeout = wf::option_wrapper_t<int>(
-                "input/modifier_binding_timeout");
+            static wf::option_wrapper_t<int> timeout{
+                "input/modifier_binding_timeout"};
             auto time_elapsed = duration_cast<milliseconds>(
                 steady_clock::now() - mod_binding_start);
 
-            if ((timeout <= 0) || (time_elapsed < milliseconds(timeout)))
+            if ((timeout <= 0) || (time_elapsed < milliseconds((int)timeout)))
             {
                 handled_in_plugin |= input->get_active_bindings().handle_key(
                     wf::keybinding_t{get_modifiers() | mod, 0}, mod_binding_key);
@@ -47,6 +47,12 @@ class keyboard_t
     std::chrono::steady_clock::time_point mod_binding_start;
 
     bool handle_keyboard_key(uint32_t key, uint32_t state);
+
+    /* Key repeat for grabs which request it */
+    wf::wl_timer repeat_delay_timer, repeat_timer;
+    uint32_t repeating_key = 0;
+    void start_grab_repeat(uint32_t key);
+    void stop_grab_repeat();
     void handle_keyboard_mod(uint32_t key, uint32_t state);
 
     /** Convert a key to a modifier */
@@ -2,12 +2,16 @@
 #include "cursor.hpp"
 #include "pointing-device.hpp"
 #include "input-manager.hpp"
+#include "../client-accounting.hpp"
 #include "wayfire/signal-definitions.hpp"
 
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
+#include <wayfire/trace.hpp>
 #include <wayfire/core.hpp>
 #include <wayfire/output-layout.hpp>
 #include <wayfire/compositor-surface.hpp>
+#include <algorithm>
 
 wf::pointer_t::pointer_t(nonstd::observer_ptr<wf::input_manager_t> input,
     nonstd::observer_ptr<seat_t> seat)
@@ -69,6 +73,7 @@ bool wf::pointer_t::focus_enabled() const
 void wf::pointer_t::update_cursor_position(uint32_t time_msec, bool real_update)
 {
     wf::pointf_t gc = seat->cursor->get_cursor_position();
+    seat->cursor->update_client_cursor_output();
 
     wf::pointf_t local = {0.0, 0.0};
     wf::surface_interface_t *new_focus = nullptr;
@@ -117,7 +122,7 @@ void wf::pointer_t::update_cursor_focus(
     bool focus_change = (cursor_focus != focus);
     if (focus_change)
     {
-        LOGD("change cursor focus ", cursor_focus, " -> ", focus);
+        LOGC(INPUT, "change cursor focus ", cursor_focus, " -> ", focus);
     }
 
     /* Send leave to old focus if compositor surface */
@@ -317,6 +322,9 @@ void wf::pointer_t::grab_surface(wf::surface_interface_t *surface)
 /* ----------------------- Input event processing --------------------------- */
 void wf::pointer_t::handle_pointer_button(wlr_event_pointer_button *ev)
 {
+    WF_TRACE_SCOPE("pointer button");
+    /* Buttons must go to the surface under the latest cursor position */
+    flush_pending_motion();
     seat->break_mod_bindings();
     bool handled_in_binding = false;
 
@@ -416,8 +424,33 @@ void wf::pointer_t::send_motion(uint32_t time_msec, wf::pointf_t local)
     }
 }
 
+bool wf::pointer_t::handle_locked_pointer_motion(wlr_event_pointer_motion *ev)
+{
+    if (!active_pointer_constraint || !cursor_focus ||
+        (active_pointer_constraint->type != WLR_POINTER_CONSTRAINT_V1_LOCKED) ||
+        input->input_grabbed())
+    {
+        return false;
+    }
+
+    auto view = dynamic_cast<wf::view_interface_t*>(
+        cursor_focus->get_main_surface());
+    if (!view || !view->fullscreen)
+    {
+        return false;
+    }
+
+    wlr_relative_pointer_manager_v1_send_relative_motion(
+        wf::get_core().protocols.relative_pointer, seat->seat,
+        (uint64_t)ev->time_msec * 1000, ev->delta_x, ev->delta_y,
+        ev->unaccel_dx, ev->unaccel_dy);
+
+    return true;
+}
+
 void wf::pointer_t::handle_pointer_motion(wlr_event_pointer_motion *ev)
 {
+    WF_TRACE_SCOPE("pointer motion");
     if (input->input_grabbed() &&
         input->active_grab->callbacks.pointer.relative_motion)
     {
@@ -453,7 +486,55 @@ void wf::pointer_t::handle_pointer_motion(wlr_event_pointer_motion *ev)
 
     /* XXX: maybe warp directly? */
     wlr_cursor_move(seat->cursor->cursor, ev->device, dx, dy);
-    update_cursor_position(ev->time_msec);
+    handle_relative_cursor_update(ev->time_msec);
+}
+
+void wf::pointer_t::handle_relative_cursor_update(uint32_t time_msec)
+{
+    /* A client which doesn't read its events would only queue up more */
+    bool backlogged = cursor_focus &&
+        wf::client_accounting::is_backlogged(cursor_focus->get_client());
+    if (!coalesce_motion && !backlogged)
+    {
+        update_cursor_position(time_msec);
+        return;
+    }
+
+    if (coalesced_motion_timer.is_connected())
+    {
+        motion_pending = true;
+        pending_motion_time = time_msec;
+        return;
+    }
+
+    update_cursor_position(time_msec);
+
+    auto gc     = seat->cursor->get_cursor_position();
+    auto output = wf::get_core().output_layout->get_output_at(gc.x, gc.y);
+    int32_t refresh   = output ? output->handle->refresh : 0;
+    uint32_t frame_ms = refresh > 0 ? std::max(1, 1000000 / refresh) : 16;
+
+    coalesced_motion_timer.set_timeout(frame_ms, [=] ()
+    {
+        if (!motion_pending)
+        {
+            return false;
+        }
+
+        /* Keep coalescing as long as the pointer keeps moving */
+        motion_pending = false;
+        update_cursor_position(pending_motion_time);
+        return true;
+    });
+}
+
+void wf::pointer_t::flush_pending_motion()
+{
+    if (motion_pending)
+    {
+        motion_pending = false;
+        update_cursor_position(pending_motion_time);
+    }
 }
 
 void wf::pointer_t::handle_pointer_motion_absolute(
@@ -483,11 +564,15 @@ void wf::pointer_t::handle_pointer_motion_absolute(
 
     // TODO: indirection via wf_cursor
     wlr_cursor_warp_absolute(seat->cursor->cursor, ev->device, ev->x, ev->y);
+    /* The update below includes any pending relative motion */
+    motion_pending = false;
     update_cursor_position(ev->time_msec);
 }
 
 void wf::pointer_t::handle_pointer_axis(wlr_event_pointer_axis *ev)
 {
+    WF_TRACE_SCOPE("pointer axis");
+    flush_pending_motion();
     bool handled_in_binding = input->get_active_bindings().handle_axis(
         seat->get_modifiers(), ev);
     seat->break_mod_bindings();
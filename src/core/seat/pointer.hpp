@@ -77,6 +77,16 @@ class pointer_t
     void handle_pointer_pinch_end(wlr_event_pointer_pinch_end *ev);
     void handle_pointer_frame();
 
+    /**
+     * Handle relative motion while a fullscreen surface has locked the pointer
+     * and no plugin has grabbed input. The cursor does not move, so only the
+     * relative motion is sent, without hit testing or any signals.
+     *
+     * @return Whether the event was handled, otherwise it has to go through
+     *   the regular motion path.
+     */
+    bool handle_locked_pointer_motion(wlr_event_pointer_motion *ev);
+
     /** Whether there are pressed buttons currently */
     bool has_pressed_buttons() const;
 
@@ -144,6 +154,27 @@ class pointer_t
      * focus
      */
     void send_motion(uint32_t time_msec, wf::pointf_t local);
+
+    /**
+     * When input/coalesce_motion is enabled, relative motion is delivered to
+     * hit-testing, grabs and clients at most once per frame of the output
+     * under the cursor. The first motion after an idle period is delivered
+     * immediately, subsequent motion in the same frame is merged into a single
+     * update at the end of the frame. Relative pointer events are not
+     * coalesced. Motion is coalesced in the same way, regardless of the
+     * option, while the focused client is backlogged (see
+     * client-accounting.hpp).
+     */
+    wf::option_wrapper_t<bool> coalesce_motion{"input/coalesce_motion"};
+    wf::wl_timer coalesced_motion_timer;
+    bool motion_pending = false;
+    uint32_t pending_motion_time = 0;
+
+    /** Handle a cursor position update caused by relative motion */
+    void handle_relative_cursor_update(uint32_t time_msec);
+
+    /** Deliver pending coalesced motion, if any */
+    void flush_pending_motion();
 };
 }
 
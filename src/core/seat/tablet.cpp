@@ -139,6 +139,13 @@ void wf::tablet_tool_t::update_tool_position()
 
 void wf::tablet_tool_t::set_focus(wf::surface_interface_t *surface)
 {
+    /* Nothing to do while the tool stays on the same surface, which is the
+     * case for most axis events */
+    if (surface && (surface == this->proximity_surface))
+    {
+        return;
+    }
+
     /* Unfocus old surface */
     if ((surface != this->proximity_surface) && this->proximity_surface)
     {
@@ -326,6 +333,22 @@ void wf::tablet_t::handle_axis(wlr_event_tablet_tool_axis *ev)
 {
     auto& input = wf::get_core_impl().input;
 
+    /* Tablets report pressure, tilt, etc. at a high rate, often without any
+     * motion. Then the tool stays on the same surface, and only the other
+     * axes need to be forwarded. */
+    bool moved = (ev->tool->type == WLR_TABLET_TOOL_TYPE_MOUSE) ?
+        ((ev->dx != 0) || (ev->dy != 0)) :
+        (ev->updated_axes & (WLR_TABLET_TOOL_AXIS_X | WLR_TABLET_TOOL_AXIS_Y));
+    if (!moved)
+    {
+        if (!input->input_grabbed())
+        {
+            ensure_tool(ev->tool)->passthrough_axis(ev);
+        }
+
+        return;
+    }
+
     /* Update cursor position */
     switch (ev->tool->type)
     {
@@ -48,8 +48,11 @@ wf::touch_interface_t::touch_interface_t(wlr_cursor *cursor, wlr_seat *seat,
 
     on_motion.set_callback([=] (void *data)
     {
+        static const wf::signal_id_t motion_id{"touch_motion"};
+        static const wf::signal_id_t post_motion_id{"touch_motion_post"};
+
         auto ev = static_cast<wlr_event_touch_motion*>(data);
-        emit_device_event_signal("touch_motion", ev);
+        emit_device_event_signal(motion_id, ev);
 
         double lx, ly;
         wlr_cursor_absolute_to_layout_coords(
@@ -61,7 +64,7 @@ wf::touch_interface_t::touch_interface_t(wlr_cursor *cursor, wlr_seat *seat,
         handle_touch_motion(ev->touch_id, ev->time_msec, point, true);
         wlr_idle_notify_activity(wf::get_core().protocols.idle,
             wf::get_core().get_current_seat());
-        emit_device_event_signal("touch_motion_post", ev);
+        emit_device_event_signal(post_motion_id, ev);
     });
 
     on_up.connect(&cursor->events.touch_up);
@@ -132,6 +135,7 @@ void wf::touch_interface_t::add_touch_gesture(
     nonstd::observer_ptr<touch::gesture_t> gesture)
 {
     this->gestures.emplace_back(gesture);
+    this->running_gestures.emplace_back(gesture);
 }
 
 void wf::touch_interface_t::rem_touch_gesture(
@@ -139,6 +143,18 @@ void wf::touch_interface_t::rem_touch_gesture(
 {
     gestures.erase(std::remove(gestures.begin(), gestures.end(), gesture),
         gestures.end());
+
+    if (in_gesture_update)
+    {
+        /* update_gestures() is iterating over the list, it removes the
+         * gesture afterwards */
+        std::replace(running_gestures.begin(), running_gestures.end(),
+            gesture, nonstd::observer_ptr<touch::gesture_t>(nullptr));
+    } else
+    {
+        running_gestures.erase(std::remove(running_gestures.begin(),
+            running_gestures.end(), gesture), running_gestures.end());
+    }
 }
 
 void wf::touch_interface_t::set_touch_focus(wf::surface_interface_t *surface,
@@ -194,16 +210,39 @@ void wf::touch_interface_t::set_touch_focus(wf::surface_interface_t *surface,
 
 void wf::touch_interface_t::update_gestures(const wf::touch::gesture_event_t& ev)
 {
-    for (auto& gesture : this->gestures)
+    if ((this->finger_state.fingers.size() == 1) &&
+        (ev.type == touch::EVENT_TYPE_TOUCH_DOWN))
     {
-        if ((this->finger_state.fingers.size() == 1) &&
-            (ev.type == touch::EVENT_TYPE_TOUCH_DOWN))
+        /* A new touch sequence starts, every gesture may match again */
+        for (auto& gesture : this->gestures)
         {
             gesture->reset(ev.time);
         }
 
-        gesture->update_state(ev);
+        running_gestures = gestures;
+    }
+
+    /* Gestures added by the callbacks get events starting with the next one */
+    in_gesture_update = true;
+    const size_t count = running_gestures.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (running_gestures[i])
+        {
+            running_gestures[i]->update_state(ev);
+        }
     }
+
+    in_gesture_update = false;
+
+    /* Completed and cancelled gestures ignore all events until they are
+     * reset, so there is no need to pass them the rest of the sequence */
+    running_gestures.erase(std::remove_if(running_gestures.begin(),
+        running_gestures.end(), [] (const auto& gesture)
+    {
+        return !gesture ||
+               (gesture->get_status() != touch::GESTURE_STATUS_RUNNING);
+    }), running_gestures.end());
 }
 
 void wf::touch_interface_t::handle_touch_down(int32_t id, uint32_t time,
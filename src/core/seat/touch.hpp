@@ -75,6 +75,9 @@ class touch_interface_t : public noncopyable_t
 
     void update_gestures(const wf::touch::gesture_event_t& event);
     std::vector<nonstd::observer_ptr<touch::gesture_t>> gestures;
+    /** The gestures which can still match the current touch sequence */
+    std::vector<nonstd::observer_ptr<touch::gesture_t>> running_gestures;
+    bool in_gesture_update = false;
 
     SurfaceMapStateListener on_surface_map_state_change;
     wf::signal_connection_t on_stack_order_changed;
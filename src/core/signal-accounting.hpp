@@ -0,0 +1,61 @@
+#ifndef WF_SIGNAL_ACCOUNTING_HPP
+#define WF_SIGNAL_ACCOUNTING_HPP
+
+#include <string>
+
+namespace wf
+{
+/**
+ * Accounting of the time signal handlers take, per plugin.
+ *
+ * Each signal connection is owned by the plugin which was being created,
+ * initialized, or whose signal handler was running when the connection was
+ * created. Handlers of owned connections are timed while a trace is recorded
+ * or when a warning threshold is set.
+ */
+namespace signal_accounting
+{
+/**
+ * Make the given plugin the owner of the connections created while the guard
+ * exists.
+ */
+class owner_guard_t
+{
+  public:
+    owner_guard_t(const std::string& owner);
+    ~owner_guard_t();
+
+    owner_guard_t(const owner_guard_t&) = delete;
+    owner_guard_t& operator =(const owner_guard_t&) = delete;
+
+  private:
+    const char *previous;
+};
+
+/**
+ * @return The plugin whose code is running, as far as it is known, or
+ *   nullptr. May be called from any thread, for ex. by the stall watchdog.
+ */
+const char *get_current_owner();
+
+/**
+ * @return The innermost signal which is being emitted, or nullptr. May be
+ *   called from any thread.
+ */
+const char *get_current_signal();
+
+/**
+ * Log a warning whenever a single signal handler takes longer than the given
+ * number of milliseconds. 0 disables the warning.
+ */
+void set_warning_threshold(int milliseconds);
+
+/** Forget the collected totals. */
+void reset_totals();
+
+/** Log the total time spent in the handlers of each plugin and signal. */
+void log_totals();
+}
+}
+
+#endif /* end of include guard: WF_SIGNAL_ACCOUNTING_HPP */
@@ -0,0 +1,385 @@
+#include <wayfire/task-executor.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/object.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+namespace
+{
+constexpr int NUM_PRIORITIES = wf::TASK_PRIORITY_HIGH + 1;
+
+enum task_status_t
+{
+    TASK_QUEUED,
+    TASK_RUNNING,
+    /* The work is done, the completion callback hasn't been called yet */
+    TASK_RAN,
+    TASK_FINISHED,
+    TASK_CANCELLED,
+};
+}
+
+struct wf::background_task_t::state_t
+{
+    std::function<void()> work;
+    std::function<void()> done;
+    task_priority_t priority;
+
+    std::mutex mutex;
+    std::condition_variable stopped_running;
+    task_status_t status = TASK_QUEUED;
+};
+
+namespace
+{
+using task_ptr = std::shared_ptr<wf::background_task_t::state_t>;
+
+/**
+ * The thread pool. The compositor thread distributes the tasks to the queues
+ * of the workers in turn, and each worker takes the task with the highest
+ * priority from its own queues, or from the back of the queues of the other
+ * workers if its own are empty.
+ */
+class task_executor_t
+{
+  public:
+    static task_executor_t& get()
+    {
+        static task_executor_t executor;
+        return executor;
+    }
+
+    ~task_executor_t()
+    {
+        stop();
+        if (event_fd >= 0)
+        {
+            close(event_fd);
+        }
+    }
+
+    void push(task_ptr task)
+    {
+        if (!ensure_started())
+        {
+            /* Without threads, block rather than drop the task */
+            if (run_task(task))
+            {
+                finish_task(task);
+            }
+
+            return;
+        }
+
+        auto& worker = *workers[next_worker];
+        next_worker = (next_worker + 1) % workers.size();
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.queues[task->priority].push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            ++queued;
+        }
+
+        wake.notify_one();
+    }
+
+  private:
+    struct worker_t
+    {
+        std::mutex mutex;
+        std::deque<task_ptr> queues[NUM_PRIORITIES];
+    };
+
+    std::vector<std::unique_ptr<worker_t>> workers;
+    std::vector<std::thread> threads;
+    size_t next_worker = 0;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    /* The tasks in all queues; incremented with sleep_mutex held */
+    std::atomic<int> queued{0};
+    bool stopping = false;
+
+    /* Tasks whose completion callback has to be called */
+    int event_fd = -1;
+    wl_event_source *event_source = nullptr;
+    std::mutex completed_mutex;
+    std::vector<task_ptr> completed;
+
+    bool ensure_started()
+    {
+        if (!threads.empty() || stopping)
+        {
+            return !threads.empty();
+        }
+
+        event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd < 0)
+        {
+            LOGE("Failed to create an eventfd for the thread pool: ",
+                strerror(errno));
+            stopping = true;
+
+            return false;
+        }
+
+        event_source = wl_event_loop_add_fd(wf::get_core().ev_loop, event_fd,
+            WL_EVENT_READABLE, [] (int, uint32_t, void *data)
+        {
+            ((task_executor_t*)data)->deliver_completed();
+            return 0;
+        }, this);
+
+        int num_threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        num_threads = std::max(1, num_threads);
+        for (int i = 0; i < num_threads; i++)
+        {
+            workers.push_back(std::make_unique<worker_t>());
+        }
+
+        for (int i = 0; i < num_threads; i++)
+        {
+            threads.emplace_back([=] () { worker_loop(i); });
+        }
+
+        wf::get_core().connect_signal("shutdown", &on_shutdown);
+
+        return true;
+    }
+
+    /** Stop the workers. Pending tasks are dropped. */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        threads.clear();
+        workers.clear();
+    }
+
+    task_ptr take_task(size_t index)
+    {
+        for (int priority = NUM_PRIORITIES - 1; priority >= 0; priority--)
+        {
+            for (size_t i = 0; i < workers.size(); i++)
+            {
+                auto& worker = *workers[(index + i) % workers.size()];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                auto& queue = worker.queues[priority];
+                if (queue.empty())
+                {
+                    continue;
+                }
+
+                /* Steal the task which was queued last, the owner of the
+                 * queue will get to its first tasks sooner */
+                task_ptr task;
+                if (i == 0)
+                {
+                    task = std::move(queue.front());
+                    queue.pop_front();
+                } else
+                {
+                    task = std::move(queue.back());
+                    queue.pop_back();
+                }
+
+                --queued;
+                return task;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void worker_loop(size_t index)
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                wake.wait(lock, [=] () { return stopping || (queued > 0); });
+                if (stopping)
+                {
+                    return;
+                }
+            }
+
+            if (auto task = take_task(index))
+            {
+                if (run_task(task))
+                {
+                    post_completed(std::move(task));
+                }
+            }
+        }
+    }
+
+    /** @return Whether the work of the task was run */
+    static bool run_task(const task_ptr& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(task->mutex);
+            if (task->status != TASK_QUEUED)
+            {
+                return false;
+            }
+
+            task->status = TASK_RUNNING;
+        }
+
+        task->work();
+
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->status = TASK_RAN;
+        task->stopped_running.notify_all();
+
+        return true;
+    }
+
+    void post_completed(task_ptr task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex);
+            completed.push_back(std::move(task));
+        }
+
+        uint64_t one = 1;
+        if (write(event_fd, &one, sizeof(one)) < 0)
+        {
+            /* The counter is full, so the compositor will wake up anyway */
+        }
+    }
+
+    void deliver_completed()
+    {
+        uint64_t count;
+        if (read(event_fd, &count, sizeof(count)) < 0)
+        {
+            /* Nothing new, or spurious wakeup */
+        }
+
+        std::vector<task_ptr> ready;
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex);
+            ready.swap(completed);
+        }
+
+        for (auto& task : ready)
+        {
+            finish_task(task);
+        }
+    }
+
+    /** Call the completion callback of a task which has run, if not cancelled */
+    static void finish_task(const task_ptr& task)
+    {
+        /* Only the compositor thread changes the status of a task which has
+         * run, so no lock is needed */
+        if (task->status != TASK_RAN)
+        {
+            return;
+        }
+
+        task->status = TASK_FINISHED;
+        /* The captures of the callbacks are destroyed on the compositor
+         * thread, which is what plugins expect */
+        task->work = nullptr;
+        auto done = std::move(task->done);
+        task->done = nullptr;
+        if (done)
+        {
+            done();
+        }
+    }
+
+    wf::signal_connection_t on_shutdown = [=] (wf::signal_data_t*)
+    {
+        stop();
+        if (event_source)
+        {
+            wl_event_source_remove(event_source);
+            event_source = nullptr;
+        }
+    };
+};
+}
+
+wf::background_task_t::background_task_t() = default;
+
+wf::background_task_t::~background_task_t()
+{
+    cancel();
+}
+
+void wf::background_task_t::submit(std::function<void()> work,
+    std::function<void()> done, task_priority_t priority)
+{
+    cancel();
+    state = std::make_shared<state_t>();
+    state->work     = std::move(work);
+    state->done     = std::move(done);
+    state->priority = priority;
+    task_executor_t::get().push(state);
+}
+
+void wf::background_task_t::cancel()
+{
+    if (!state)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->stopped_running.wait(lock, [=] ()
+        {
+            return state->status != TASK_RUNNING;
+        });
+
+        if (state->status != TASK_FINISHED)
+        {
+            state->status = TASK_CANCELLED;
+        }
+    }
+
+    /* No thread uses the callbacks of a task which isn't running */
+    state->work = nullptr;
+    state->done = nullptr;
+    state.reset();
+}
+
+bool wf::background_task_t::is_pending() const
+{
+    if (!state)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return (state->status != TASK_FINISHED) &&
+           (state->status != TASK_CANCELLED);
+}
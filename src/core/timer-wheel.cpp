@@ -0,0 +1,203 @@
+#include "timer-wheel.hpp"
+#include <wayfire/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <ctime>
+
+wf::timer_wheel_t& wf::timer_wheel_t::get()
+{
+    static timer_wheel_t wheel;
+    return wheel;
+}
+
+wf::timer_wheel_t::timer_wheel_t()
+{
+    for (auto& level : slots)
+    {
+        for (auto& slot : level)
+        {
+            wl_list_init(&slot);
+        }
+    }
+}
+
+uint64_t wf::timer_wheel_t::now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1'000'000;
+}
+
+void wf::timer_wheel_t::arm(wl_timer *timer, uint32_t timeout_ms, bool precise)
+{
+    cancel(timer);
+
+    /* Nothing is due until the next event, so the wheel can skip ahead. This
+     * keeps the timers in the lowest levels after the loop was idle. */
+    uint64_t time = now();
+    if (next_event() > time)
+    {
+        current = std::max(current, time);
+    }
+
+    uint64_t expires = time + timeout_ms;
+    uint64_t slack   = timeout_ms / 16;
+    if (!precise && (slack > 1))
+    {
+        /* Round up to a power of two, so that timers armed at about the same
+         * time expire together */
+        uint64_t granularity = 1ull << (63 - __builtin_clzll(slack));
+        expires = (expires + granularity - 1) & ~(granularity - 1);
+    }
+
+    timer->expires = expires;
+    insert(timer);
+    schedule(time);
+}
+
+void wf::timer_wheel_t::cancel(wl_timer *timer)
+{
+    /* The bit of the slot is cleared in next_event(), if it becomes empty */
+    wl_list_remove(&timer->_link.link);
+    wl_list_init(&timer->_link.link);
+}
+
+void wf::timer_wheel_t::insert(wl_timer *timer)
+{
+    timer->expires = std::max(timer->expires, current);
+
+    int level = 0;
+    while ((level < LEVELS - 1) &&
+           ((timer->expires >> (SLOT_BITS * (level + 1))) !=
+            (current >> (SLOT_BITS * (level + 1)))))
+    {
+        ++level;
+    }
+
+    int slot = (timer->expires >> (SLOT_BITS * level)) & (SLOTS - 1);
+    wl_list_insert(slots[level][slot].prev, &timer->_link.link);
+    occupied[level] |= 1ull << slot;
+}
+
+uint64_t wf::timer_wheel_t::next_event()
+{
+    uint64_t result = UINT64_MAX;
+    for (int level = 0; level < LEVELS; level++)
+    {
+        int shift = SLOT_BITS * level;
+        uint64_t index = (current >> shift) & (SLOTS - 1);
+        uint64_t turn  = (current >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+
+        /* The slots after the current one, and for the top level, which
+         * can wrap around, the slots in the next turn */
+        uint64_t mask = occupied[level] & ~((2ull << index) - 1);
+        if (!mask && (level == LEVELS - 1))
+        {
+            mask  = occupied[level];
+            turn += 1ull << (shift + SLOT_BITS);
+        }
+
+        while (mask)
+        {
+            int slot = __builtin_ctzll(mask);
+            if (!wl_list_empty(&slots[level][slot]))
+            {
+                result = std::min(result, turn + (uint64_t(slot) << shift));
+                break;
+            }
+
+            /* All of its timers were cancelled */
+            occupied[level] &= ~(1ull << slot);
+            mask &= ~(1ull << slot);
+        }
+    }
+
+    return result;
+}
+
+void wf::timer_wheel_t::process(uint64_t time)
+{
+    current = time;
+
+    /* Move the timers of the upper levels down, starting from the top, so
+     * that timers can move down several levels at once */
+    for (int level = LEVELS - 1; level > 0; level--)
+    {
+        int shift = SLOT_BITS * level;
+        if (time & ((1ull << shift) - 1))
+        {
+            continue;
+        }
+
+        int slot = (time >> shift) & (SLOTS - 1);
+        wl_list cascaded;
+        wl_list_init(&cascaded);
+        wl_list_insert_list(&cascaded, &slots[level][slot]);
+        wl_list_init(&slots[level][slot]);
+        occupied[level] &= ~(1ull << slot);
+
+        while (!wl_list_empty(&cascaded))
+        {
+            wl_timer::wheel_link *link =
+                wl_container_of(cascaded.next, link, link);
+            wl_list_remove(&link->link);
+            insert(link->self);
+        }
+    }
+
+    int slot = time & (SLOTS - 1);
+    wl_list due;
+    wl_list_init(&due);
+    wl_list_insert_list(&due, &slots[0][slot]);
+    wl_list_init(&slots[0][slot]);
+    occupied[0] &= ~(1ull << slot);
+
+    /* The callbacks may arm or cancel any timer, including the due ones */
+    while (!wl_list_empty(&due))
+    {
+        wl_timer::wheel_link *link = wl_container_of(due.next, link, link);
+        wl_list_remove(&link->link);
+        wl_list_init(&link->link);
+        link->self->execute();
+    }
+}
+
+void wf::timer_wheel_t::schedule(uint64_t time)
+{
+    uint64_t next = next_event();
+    if ((next == UINT64_MAX) || (armed_for && (armed_for <= next)))
+    {
+        return;
+    }
+
+    if (!source)
+    {
+        source = wl_event_loop_add_timer(wf::get_core().ev_loop,
+            handle_timeout, this);
+    }
+
+    /* Very long timeouts are split into several wakeups */
+    uint64_t delay = (next > time) ? std::min<uint64_t>(next - time, INT_MAX) : 1;
+    wl_event_source_timer_update(source, delay);
+    armed_for = time + delay;
+}
+
+int wf::timer_wheel_t::handle_timeout(void *data)
+{
+    auto wheel = (timer_wheel_t*)data;
+    wheel->armed_for = 0;
+
+    uint64_t time = now();
+    for (uint64_t next = wheel->next_event(); next <= time;
+         next = wheel->next_event())
+    {
+        wheel->process(next);
+    }
+
+    wheel->current = std::max(wheel->current, time);
+    wheel->schedule(time);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#ifndef WF_TIMER_WHEEL_HPP
+#define WF_TIMER_WHEEL_HPP
+
+#include <wayfire/util.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+
+#include <cstdint>
+#include <wayland-server-core.h>
+
+namespace wf
+{
+/**
+ * The timer wheel behind wl_timer. All pending timers are kept in a
+ * hierarchical wheel, and a single wl_event_loop timer is armed for the
+ * earliest time at which the wheel needs to be advanced.
+ *
+ * Level 0 of the wheel has a slot for each millisecond, each higher level
+ * a slot for each turn of the level below it. A timer is kept in the lowest
+ * level at which its expiry time is still in the same turn of the wheel as
+ * the current time, and it moves to the lower levels as time passes.
+ *
+ * Arming and removing a timer is O(1). The event loop timer is updated only
+ * when a timer is armed before the earliest pending wakeup. Removed timers
+ * may cause a spurious wakeup, after which the event loop timer is armed
+ * for the next timer again.
+ */
+class timer_wheel_t : public noncopyable_t
+{
+  public:
+    static timer_wheel_t& get();
+
+    /** Add the timer to the wheel, or move it if it is already pending */
+    void arm(wl_timer *timer, uint32_t timeout_ms, bool precise);
+    /** Remove the timer from the wheel. No-op if it isn't pending */
+    void cancel(wl_timer *timer);
+
+  private:
+    timer_wheel_t();
+
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS     = 1 << SLOT_BITS;
+    /* 2^36 milliseconds, enough for any 32-bit timeout */
+    static constexpr int LEVELS = 6;
+
+    /* The timers in each slot, and a bitmask of the non-empty slots */
+    wl_list slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS] = {0};
+
+    /* The time up to which the wheel has been advanced */
+    uint64_t current = 0;
+
+    wl_event_source *source = nullptr;
+    /* The time the event loop timer is armed for, 0 if it isn't */
+    uint64_t armed_for = 0;
+
+    /** @return The current time in milliseconds */
+    static uint64_t now();
+
+    void insert(wl_timer *timer);
+    /**
+     * @return The earliest time after the current time at which a slot needs
+     *   to be cascaded or fired, or UINT64_MAX if there are no timers.
+     */
+    uint64_t next_event();
+    /** Cascade and fire the slots due at the given time */
+    void process(uint64_t time);
+    /** Arm the event loop timer if the next event is earlier than it */
+    void schedule(uint64_t now);
+
+    static int handle_timeout(void *data);
+};
+}
+
+#endif /* end of include guard: WF_TIMER_WHEEL_HPP */
@@ -0,0 +1,187 @@
+#include <wayfire/trace.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+namespace
+{
+struct trace_event_t
+{
+    const char *name;
+    int64_t start;
+    int64_t end;
+};
+
+/* About 24MB, so that a forgotten recording cannot use up all memory */
+static constexpr size_t MAX_EVENTS = 1 << 20;
+
+std::vector<trace_event_t> events;
+bool overflowed = false;
+
+/*
+ * The flight recorder. Only the main thread writes to it, and it publishes
+ * each event by incrementing the head after writing it. Readers on other
+ * threads check the head again after copying, to find the events which may
+ * have been overwritten meanwhile.
+ */
+constexpr size_t FLIGHT_RECORDER_SIZE = 1024;
+struct ring_entry_t
+{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> start{0};
+    std::atomic<int64_t> end{0};
+};
+
+ring_entry_t ring[FLIGHT_RECORDER_SIZE];
+std::atomic<uint64_t> ring_head{0};
+bool flight_recorder = false;
+
+void write_escaped(std::ostream& out, const char *name)
+{
+    for (; *name; name++)
+    {
+        if ((*name == '"') || (*name == '\\'))
+        {
+            out << '\\';
+        }
+
+        out << *name;
+    }
+}
+}
+
+bool wf::trace::recording = false;
+bool wf::trace::active    = false;
+
+int64_t wf::trace::get_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+}
+
+void wf::trace::start_recording()
+{
+    events.clear();
+    events.reserve(4096);
+    overflowed = false;
+    recording  = true;
+    active     = true;
+}
+
+void wf::trace::start_flight_recorder()
+{
+    flight_recorder = true;
+    active = true;
+}
+
+size_t wf::trace::get_last_events(event_t *out, size_t max)
+{
+    max = std::min(max, FLIGHT_RECORDER_SIZE);
+    uint64_t head  = ring_head.load(std::memory_order_acquire);
+    uint64_t first = head - std::min<uint64_t>(head, max);
+    for (uint64_t i = first; i < head; i++)
+    {
+        auto& entry = ring[i % FLIGHT_RECORDER_SIZE];
+        out[i - first] = {
+            entry.name.load(std::memory_order_relaxed),
+            entry.start.load(std::memory_order_relaxed),
+            entry.end.load(std::memory_order_relaxed),
+        };
+    }
+
+    /* The writer may be writing the event after the new head, which uses the
+     * same slot as the one FLIGHT_RECORDER_SIZE events before it */
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t new_head = ring_head.load(std::memory_order_relaxed);
+    uint64_t valid    = new_head + 1 > FLIGHT_RECORDER_SIZE ?
+        new_head + 1 - FLIGHT_RECORDER_SIZE : 0;
+    if (valid <= first)
+    {
+        return head - first;
+    }
+
+    if (valid >= head)
+    {
+        return 0;
+    }
+
+    std::copy(out + (valid - first), out + (head - first), out);
+
+    return head - valid;
+}
+
+void wf::trace::add_event(const char *name, int64_t start, int64_t end)
+{
+    if (flight_recorder)
+    {
+        uint64_t head = ring_head.load(std::memory_order_relaxed);
+        auto& entry   = ring[head % FLIGHT_RECORDER_SIZE];
+        /* Readers which see any of the stores below also see the head */
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.name.store(name, std::memory_order_relaxed);
+        entry.start.store(start, std::memory_order_relaxed);
+        entry.end.store(end, std::memory_order_relaxed);
+        ring_head.store(head + 1, std::memory_order_release);
+    }
+
+    if (!recording)
+    {
+        return;
+    }
+
+    if (events.size() >= MAX_EVENTS)
+    {
+        if (!overflowed)
+        {
+            LOGW("trace: too many events, dropping the rest of the recording");
+            overflowed = true;
+        }
+
+        return;
+    }
+
+    events.push_back({name, start, end});
+}
+
+bool wf::trace::stop_recording(const std::string& path)
+{
+    recording = false;
+    active    = flight_recorder;
+
+    std::ofstream out{path};
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [\n";
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        auto& ev = events[i];
+        out << "{\"name\": \"";
+        write_escaped(out, ev.name);
+        out << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": " <<
+            ev.start / 1000.0 << ", \"dur\": " << (ev.end - ev.start) / 1000.0 <<
+            "}" << (i + 1 < events.size() ? ",\n" : "\n");
+    }
+
+    out << "], \"displayTimeUnit\": \"ms\"}\n";
+
+    size_t count = events.size();
+    events.clear();
+    events.shrink_to_fit();
+
+    if (!out)
+    {
+        LOGE("trace: failed to write ", path);
+
+        return false;
+    }
+
+    LOGI("trace: wrote ", count, " events to ", path);
+
+    return true;
+}
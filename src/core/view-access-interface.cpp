@@ -6,9 +6,54 @@
 #include <algorithm>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 namespace wf
 {
+namespace
+{
+enum class property_t
+{
+    APP_ID,
+    TITLE,
+    ROLE,
+    FULLSCREEN,
+    ACTIVATED,
+    MINIMIZED,
+    VISIBLE,
+    FOCUSABLE,
+    MAPPED,
+    TILED_LEFT,
+    TILED_RIGHT,
+    TILED_TOP,
+    TILED_BOTTOM,
+    MAXIMIZED,
+    FLOATING,
+    TYPE,
+};
+
+/* Rules query the same few identifiers over and over, so look them up in a
+ * table instead of comparing against every supported name in turn. */
+const std::unordered_map<std::string, property_t> properties = {
+    {"app_id", property_t::APP_ID},
+    {"title", property_t::TITLE},
+    {"role", property_t::ROLE},
+    {"fullscreen", property_t::FULLSCREEN},
+    {"activated", property_t::ACTIVATED},
+    {"minimized", property_t::MINIMIZED},
+    {"visible", property_t::VISIBLE},
+    {"focusable", property_t::FOCUSABLE},
+    {"mapped", property_t::MAPPED},
+    {"tiled-left", property_t::TILED_LEFT},
+    {"tiled-right", property_t::TILED_RIGHT},
+    {"tiled-top", property_t::TILED_TOP},
+    {"tiled-bottom", property_t::TILED_BOTTOM},
+    {"maximized", property_t::MAXIMIZED},
+    {"floating", property_t::FLOATING},
+    {"type", property_t::TYPE},
+};
+}
+
 view_access_interface_t::view_access_interface_t()
 {}
 
@@ -31,14 +76,36 @@ variant_t view_access_interface_t::get(const std::string & identifier, bool & er
         return out;
     }
 
-    if (identifier == "app_id")
-    {
-        out = _view->get_app_id();
-    } else if (identifier == "title")
+    auto it = properties.find(identifier);
+    if (it == properties.end())
     {
-        out = _view->get_title();
-    } else if (identifier == "role")
+        std::cerr << "View access interface: Get operation triggered to" <<
+            " unsupported view property " << identifier << std::endl;
+
+        return out;
+    }
+
+    switch (it->second)
     {
+      case property_t::APP_ID:
+        if (!_app_id)
+        {
+            _app_id = _view->get_app_id();
+        }
+
+        out = *_app_id;
+        break;
+
+      case property_t::TITLE:
+        if (!_title)
+        {
+            _title = _view->get_title();
+        }
+
+        out = *_title;
+        break;
+
+      case property_t::ROLE:
         switch (_view->role)
         {
           case VIEW_ROLE_TOPLEVEL:
@@ -60,93 +127,112 @@ variant_t view_access_interface_t::get(const std::string & identifier, bool & er
             error = true;
             break;
         }
-    } else if (identifier == "fullscreen")
-    {
+
+        break;
+
+      case property_t::FULLSCREEN:
         out = _view->fullscreen;
-    } else if (identifier == "activated")
-    {
+        break;
+
+      case property_t::ACTIVATED:
         out = _view->activated;
-    } else if (identifier == "minimized")
-    {
+        break;
+
+      case property_t::MINIMIZED:
         out = _view->minimized;
-    } else if (identifier == "visible")
-    {
+        break;
+
+      case property_t::VISIBLE:
         out = _view->is_visible();
-    } else if (identifier == "focusable")
-    {
+        break;
+
+      case property_t::FOCUSABLE:
         out = _view->is_focuseable();
-    } else if (identifier == "mapped")
-    {
+        break;
+
+      case property_t::MAPPED:
         out = _view->is_mapped();
-    } else if (identifier == "tiled-left")
-    {
+        break;
+
+      case property_t::TILED_LEFT:
         out = (_view->tiled_edges & WLR_EDGE_LEFT) > 0;
-    } else if (identifier == "tiled-right")
-    {
+        break;
+
+      case property_t::TILED_RIGHT:
         out = (_view->tiled_edges & WLR_EDGE_RIGHT) > 0;
-    } else if (identifier == "tiled-top")
-    {
+        break;
+
+      case property_t::TILED_TOP:
         out = (_view->tiled_edges & WLR_EDGE_TOP) > 0;
-    } else if (identifier == "tiled-bottom")
-    {
+        break;
+
+      case property_t::TILED_BOTTOM:
         out = (_view->tiled_edges & WLR_EDGE_BOTTOM) > 0;
-    } else if (identifier == "maximized")
-    {
+        break;
+
+      case property_t::MAXIMIZED:
         out = _view->tiled_edges == TILED_EDGES_ALL;
-    } else if (identifier == "floating")
-    {
+        break;
+
+      case property_t::FLOATING:
         out = _view->tiled_edges == 0;
-    } else if (identifier == "type")
-    {
-        do {
-            if (_view->role == VIEW_ROLE_TOPLEVEL)
-            {
-                out = std::string("toplevel");
-                break;
-            }
+        break;
 
-            if (_view->role == VIEW_ROLE_UNMANAGED)
-            {
-#if WF_HAS_XWAYLAND
-                auto surf = _view->get_wlr_surface();
-                if (surf && wlr_surface_is_xwayland_surface(surf))
-                {
-                    out = std::string("x-or");
-                    break;
-                }
+      case property_t::TYPE:
+        out = get_type();
+        break;
+    }
 
-#endif
-                out = std::string("unmanaged");
-                break;
-            }
+    return out;
+}
 
-            if (!_view->get_output())
-            {
-                out = std::string("unknown");
-                break;
-            }
+std::string view_access_interface_t::get_type()
+{
+    std::string out;
+    do {
+        if (_view->role == VIEW_ROLE_TOPLEVEL)
+        {
+            out = std::string("toplevel");
+            break;
+        }
 
-            uint32_t layer = _view->get_output()->workspace->get_view_layer(_view);
-            if ((layer == LAYER_BACKGROUND) || (layer == LAYER_BOTTOM))
-            {
-                out = std::string("background");
-            } else if (layer == LAYER_TOP)
-            {
-                out = std::string("panel");
-            } else if (layer == LAYER_LOCK)
+        if (_view->role == VIEW_ROLE_UNMANAGED)
+        {
+#if WF_HAS_XWAYLAND
+            auto surf = _view->get_wlr_surface();
+            if (surf && wlr_surface_is_xwayland_surface(surf))
             {
-                out = std::string("overlay");
+                out = std::string("x-or");
+                break;
             }
 
+#endif
+            out = std::string("unmanaged");
             break;
+        }
 
+        if (!_view->get_output())
+        {
             out = std::string("unknown");
-        } while (false);
-    } else
-    {
-        std::cerr << "View access interface: Get operation triggered to" <<
-            " unsupported view property " << identifier << std::endl;
-    }
+            break;
+        }
+
+        uint32_t layer = _view->get_output()->workspace->get_view_layer(_view);
+        if ((layer == LAYER_BACKGROUND) || (layer == LAYER_BOTTOM))
+        {
+            out = std::string("background");
+        } else if (layer == LAYER_TOP)
+        {
+            out = std::string("panel");
+        } else if (layer == LAYER_LOCK)
+        {
+            out = std::string("overlay");
+        }
+
+        break;
+
+        out = std::string("unknown");
+    } while (false);
 
     return out;
 }
@@ -154,5 +240,7 @@ variant_t view_access_interface_t::get(const std::string & identifier, bool & er
 void view_access_interface_t::set_view(wayfire_view view)
 {
     _view = view;
+    _app_id.reset();
+    _title.reset();
 }
 } // End namespace wf.
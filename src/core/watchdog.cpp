@@ -0,0 +1,284 @@
+#include "watchdog.hpp"
+#include "signal-accounting.hpp"
+#include <wayfire/core.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <wayfire/util/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace
+{
+/* A stalled compositor should not fill the disk */
+constexpr int MAX_REPORTS = 16;
+constexpr int MAX_TRACE_EVENTS = 64;
+constexpr int MAX_STACK_FRAMES = 128;
+/* How long to wait for the main thread to capture its stack */
+constexpr int STACK_TIMEOUT_MS = 100;
+
+/* Filled by the main thread from the stack capture signal handler */
+void *stack_frames[MAX_STACK_FRAMES];
+std::atomic<int> stack_size{-1};
+
+void capture_stack(int)
+{
+    int saved_errno = errno;
+    stack_size.store(backtrace(stack_frames, MAX_STACK_FRAMES),
+        std::memory_order_release);
+    errno = saved_errno;
+}
+
+int stack_signal()
+{
+    return SIGRTMIN;
+}
+}
+
+class wf::stall_watchdog_t::impl
+{
+  public:
+    impl(stall_watchdog_t *owner) : self(owner)
+    {}
+
+    ~impl()
+    {
+        stop();
+    }
+
+    void init()
+    {
+        threshold = threshold_opt;
+        if (threshold <= 0)
+        {
+            return;
+        }
+
+        const char *dir = getenv("XDG_RUNTIME_DIR");
+        report_prefix = std::string(dir ? dir : "/tmp") + "/wayfire-stall-" +
+            std::to_string(getpid()) + "-";
+
+        if (pipe2(wake_fds, O_CLOEXEC) < 0)
+        {
+            LOGE("watchdog: failed to create a pipe: ", strerror(errno));
+
+            return;
+        }
+
+        /* backtrace() loads its library on the first call, which must not
+         * happen in the signal handler */
+        void *frame;
+        backtrace(&frame, 1);
+
+        struct sigaction action = {};
+        action.sa_handler = capture_stack;
+        action.sa_flags   = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(stack_signal(), &action, nullptr);
+
+        main_thread = pthread_self();
+        wf::trace::start_flight_recorder();
+        self->enabled = true;
+        self->heartbeat();
+
+        int interval = std::max(10, threshold / 4);
+        heartbeat_timer.set_timeout(interval, [=] ()
+        {
+            self->heartbeat();
+            log_reports();
+
+            return true;
+        }, false);
+
+        watchdog_thread = std::thread([=] ()
+        {
+            watch();
+        });
+
+        wf::get_core().connect_signal("shutdown", &on_shutdown);
+        LOGI("watchdog: reporting main loop stalls over ", threshold, "ms");
+    }
+
+  private:
+    stall_watchdog_t *self;
+    wf::option_wrapper_t<int> threshold_opt{"core/stall_threshold_ms"};
+    /* The threshold in milliseconds, fixed at startup */
+    int threshold = 0;
+
+    std::string report_prefix;
+    pthread_t main_thread;
+    std::thread watchdog_thread;
+    /* Written to by the main thread to stop the watchdog thread */
+    int wake_fds[2] = {-1, -1};
+    wf::wl_timer heartbeat_timer;
+
+    /* The reports written by the watchdog thread, and those logged */
+    std::atomic<int> reports_written{0};
+    int reports_logged = 0;
+
+    void stop()
+    {
+        heartbeat_timer.disconnect();
+        if (watchdog_thread.joinable())
+        {
+            char c = 0;
+            while ((write(wake_fds[1], &c, 1) < 0) && (errno == EINTR))
+            {}
+
+            watchdog_thread.join();
+        }
+
+        for (int& fd : wake_fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        self->enabled = false;
+    }
+
+    /** @return The path of the n-th report */
+    std::string report_path(int n)
+    {
+        return report_prefix + std::to_string(n) + ".txt";
+    }
+
+    /** Called on the main thread, after a stall is over */
+    void log_reports()
+    {
+        int written = reports_written.load(std::memory_order_acquire);
+        for (; reports_logged < written; reports_logged++)
+        {
+            LOGE("watchdog: the main loop stalled, see ",
+                report_path(reports_logged));
+        }
+    }
+
+    /** @return Whether the thread should stop */
+    bool wait(int timeout_ms)
+    {
+        pollfd pfd = {wake_fds[0], POLLIN, 0};
+        int r = poll(&pfd, 1, timeout_ms);
+
+        return (r > 0) || ((r < 0) && (errno != EINTR));
+    }
+
+    /* The watchdog thread */
+    void watch()
+    {
+        /* Process-directed signals are for the main thread */
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+        const int64_t limit = threshold * 1'000'000ll;
+        int64_t reported = -1;
+        int reports = 0;
+        while (!wait(std::max(10, threshold / 4)))
+        {
+            int64_t heartbeat = self->last_heartbeat.load(
+                std::memory_order_relaxed);
+            int64_t stalled = wf::trace::get_time() - heartbeat;
+            if ((stalled < limit) || (heartbeat == reported) ||
+                (reports >= MAX_REPORTS))
+            {
+                continue;
+            }
+
+            /* Report each stall once */
+            reported = heartbeat;
+            if (write_report(report_path(reports), stalled))
+            {
+                reports_written.store(++reports, std::memory_order_release);
+            }
+        }
+    }
+
+    bool write_report(const std::string& path, int64_t stalled)
+    {
+        /* Capture the state first, the stall may end any moment */
+        const char *signal = wf::signal_accounting::get_current_signal();
+        const char *owner  = wf::signal_accounting::get_current_owner();
+        wf::trace::event_t events[MAX_TRACE_EVENTS];
+        size_t count = wf::trace::get_last_events(events, MAX_TRACE_EVENTS);
+
+        stack_size.store(-1, std::memory_order_relaxed);
+        pthread_kill(main_thread, stack_signal());
+        int waited = 0;
+        while ((stack_size.load(std::memory_order_acquire) < 0) &&
+               (waited < STACK_TIMEOUT_MS) && !wait(1))
+        {
+            ++waited;
+        }
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0600);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        int64_t now = wf::trace::get_time();
+        dprintf(fd, "Main loop stalled for %.1fms\n", stalled / 1e6);
+        dprintf(fd, "Signal: %s\nPlugin: %s\n",
+            signal ? signal : "(none)", owner ? owner : "(none)");
+
+        dprintf(fd, "\nLast trace events (start before now, duration):\n");
+        for (size_t i = 0; i < count; i++)
+        {
+            dprintf(fd, "  %10.3fms %8.3fms %s\n",
+                (now - events[i].start) / 1e6,
+                (events[i].end - events[i].start) / 1e6,
+                events[i].name ? events[i].name : "(unnamed)");
+        }
+
+        int frames = stack_size.load(std::memory_order_acquire);
+        if (frames > 0)
+        {
+            dprintf(fd, "\nMain thread stack:\n");
+            backtrace_symbols_fd(stack_frames, frames, fd);
+        } else
+        {
+            dprintf(fd, "\nThe main thread did not report its stack\n");
+        }
+
+        close(fd);
+
+        return true;
+    }
+
+    wf::signal_connection_t on_shutdown = [=] (wf::signal_data_t*)
+    {
+        stop();
+    };
+};
+
+wf::stall_watchdog_t& wf::stall_watchdog_t::get()
+{
+    static stall_watchdog_t watchdog;
+    return watchdog;
+}
+
+wf::stall_watchdog_t::stall_watchdog_t() : priv(std::make_unique<impl>(this))
+{}
+
+wf::stall_watchdog_t::~stall_watchdog_t() = default;
+
+void wf::stall_watchdog_t::init()
+{
+    priv->init();
+}
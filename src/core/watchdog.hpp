@@ -0,0 +1,55 @@
+#ifndef WF_WATCHDOG_HPP
+#define WF_WATCHDOG_HPP
+
+#include <wayfire/nonstd/noncopyable.hpp>
+#include <wayfire/trace.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace wf
+{
+/**
+ * A thread which notices when the main loop stops making progress for more
+ * than core/stall_threshold_ms, and writes a report about it.
+ *
+ * The main thread leaves a heartbeat on each repaint and from a timer which
+ * runs four times per threshold, so an idle compositor does not look stalled.
+ * When the watchdog is enabled, the trace flight recorder runs as well.
+ *
+ * A report contains the signal which is being emitted and the plugin which
+ * is handling it, the last trace events and the stack of the main thread. It
+ * is written to wayfire-stall-<pid>-<n>.txt in $XDG_RUNTIME_DIR (or /tmp),
+ * and logged once the main loop runs again.
+ */
+class stall_watchdog_t : public noncopyable_t
+{
+  public:
+    static stall_watchdog_t& get();
+
+    /** Start the watchdog, if enabled. Called once, at startup. */
+    void init();
+
+    /** Record that the main loop is making progress. */
+    void heartbeat()
+    {
+        if (enabled)
+        {
+            last_heartbeat.store(wf::trace::get_time(),
+                std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    stall_watchdog_t();
+    ~stall_watchdog_t();
+
+    bool enabled = false;
+    std::atomic<int64_t> last_heartbeat{0};
+
+    class impl;
+    std::unique_ptr<impl> priv;
+};
+}
+
+#endif /* end of include guard: WF_WATCHDOG_HPP */
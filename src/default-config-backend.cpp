@@ -5,6 +5,8 @@
 #include <wayfire/config-backend.hpp>
 #include <wayfire/plugin.hpp>
 #include <wayfire/core.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <map>
 
 #include <sys/inotify.h>
 #include <unistd.h>
@@ -16,22 +18,91 @@ static char buf[INOT_BUF_SIZE];
 static std::string config_dir, config_file;
 wf::config::config_manager_t *cfg_manager;
 
-static void reload_config(int fd)
+static void add_config_watches(int fd)
 {
-    wf::config::load_configuration_options_from_file(*cfg_manager, config_file);
     inotify_add_watch(fd, config_dir.c_str(), IN_CREATE);
     inotify_add_watch(fd, config_file.c_str(), IN_MODIFY);
 }
 
+static void reload_config(int fd)
+{
+    wf::config::load_configuration_options_from_file(*cfg_manager, config_file);
+    add_config_watches(fd);
+}
+
+/** The values of all options, by section and option name */
+using config_values_t = std::map<std::string, std::map<std::string, std::string>>;
+
+static config_values_t get_config_values()
+{
+    config_values_t values;
+    for (auto& section : cfg_manager->get_all_sections())
+    {
+        auto& section_values = values[section->get_name()];
+        for (auto& option : section->get_registered_options())
+        {
+            section_values[option->get_name()] = option->get_value_str();
+        }
+    }
+
+    return values;
+}
+
 static int handle_config_updated(int fd, uint32_t mask, void *data)
 {
     LOGD("Reloading configuration file");
 
     /* read, but don't use */
     read(fd, buf, INOT_BUF_SIZE);
+
+    auto old_values = get_config_values();
     reload_config(fd);
 
-    wf::get_core().emit_signal("reload-config", nullptr);
+    /* Tell the rest of the compositor only about what has actually changed,
+     * rewriting the file with the same contents is a no-op. */
+    wf::reload_config_signal ev;
+    for (auto& section : cfg_manager->get_all_sections())
+    {
+        auto old_section = old_values.find(section->get_name());
+        auto options     = section->get_registered_options();
+        if ((old_section == old_values.end()) ||
+            (old_section->second.size() != options.size()))
+        {
+            /* Sections added, or options added or removed */
+            ev.changed_sections.insert(section->get_name());
+        }
+
+        for (auto& option : options)
+        {
+            if ((old_section == old_values.end()) ||
+                (old_section->second[option->get_name()] !=
+                 option->get_value_str()))
+            {
+                ev.changed_options.push_back(option);
+                ev.changed_sections.insert(section->get_name());
+            }
+        }
+
+        if (old_section != old_values.end())
+        {
+            old_values.erase(old_section);
+        }
+    }
+
+    /* Removed sections */
+    for (auto& [name, _] : old_values)
+    {
+        ev.changed_sections.insert(name);
+    }
+
+    if (ev.changed_sections.empty())
+    {
+        LOGD("Configuration file reloaded, no options changed");
+
+        return 0;
+    }
+
+    wf::get_core().emit_signal("reload-config", &ev);
 
     return 0;
 }
@@ -55,8 +126,10 @@ class dynamic_ini_config_t : public wf::config_backend_t
         config = wf::config::build_configuration(
             get_xml_dirs(), SYSCONFDIR "/wayfire/defaults.ini", config_file);
 
+        /* build_configuration() has already read the config file, so
+         * parsing it again is only needed once it changes */
         int inotify_fd = inotify_init1(IN_CLOEXEC);
-        reload_config(inotify_fd);
+        add_config_watches(inotify_fd);
 
         wl_event_loop_add_fd(wl_display_get_event_loop(display),
             inotify_fd, WL_EVENT_READABLE, handle_config_updated, NULL);
@@ -15,6 +15,10 @@
 #include "wayfire/config-backend.hpp"
 #include "output/plugin-loader.hpp"
 #include "core/core-impl.hpp"
+#include "core/ipc.hpp"
+#include "core/metrics.hpp"
+#include "core/watchdog.hpp"
+#include "wayfire/performance-governor.hpp"
 #include "wayfire/output.hpp"
 
 wf_runtime_config runtime_config;
@@ -35,7 +39,9 @@ static void print_help()
     std::cout << " -B,  --config-backend    specify config backend to use" <<
         std::endl;
     std::cout << " -h,  --help              print this help" << std::endl;
-    std::cout << " -d,  --debug             enable debug logging" << std::endl;
+    std::cout << " -d,  --debug[=CATEGORIES] enable debug logging, and the debug" <<
+        " messages of the comma-separated CATEGORIES (render, input, output," <<
+        " view, plugin or all)" << std::endl;
     std::cout <<
         " -D,  --damage-debug      enable additional debug for damaged regions" <<
         std::endl;
@@ -46,15 +52,40 @@ static void print_help()
 
 namespace wf
 {
-namespace _safe_list_detail
+namespace log
 {
-wl_event_loop *event_loop;
-void idle_cleanup_func(void *data)
-{
-    auto priv = reinterpret_cast<std::function<void()>*>(data);
-    (*priv)();
+std::bitset<(size_t)logging_category::TOTAL> enabled_categories;
 }
 }
+
+/**
+ * Enable the debug messages of the given comma-separated categories.
+ */
+static void parse_debug_categories(const std::string& categories)
+{
+    static const std::map<std::string, wf::log::logging_category> names = {
+        {"render", wf::log::logging_category::RENDER},
+        {"input", wf::log::logging_category::INPUT},
+        {"output", wf::log::logging_category::OUTPUT},
+        {"view", wf::log::logging_category::VIEW},
+        {"plugin", wf::log::logging_category::PLUGIN},
+    };
+
+    std::stringstream stream(categories);
+    std::string category;
+    while (std::getline(stream, category, ','))
+    {
+        if (category == "all")
+        {
+            wf::log::enabled_categories.set();
+        } else if (names.count(category))
+        {
+            wf::log::enabled_categories.set((size_t)names.at(category));
+        } else
+        {
+            std::cerr << "Unrecognized debug category " << category << std::endl;
+        }
+    }
 }
 
 static bool drop_permissions(void)
@@ -183,7 +214,7 @@ int main(int argc, char *argv[])
         {
             "config-backend", required_argument, NULL, 'B'
         },
-        {"debug", no_argument, NULL, 'd'},
+        {"debug", optional_argument, NULL, 'd'},
         {"damage-debug", no_argument, NULL, 'D'},
         {"damage-rerender", no_argument, NULL, 'R'},
         {"help", no_argument, NULL, 'h'},
@@ -195,7 +226,7 @@ int main(int argc, char *argv[])
     std::string config_backend = WF_DEFAULT_CONFIG_BACKEND;
 
     int c, i;
-    while ((c = getopt_long(argc, argv, "c:B:dDhRv", opts, &i)) != -1)
+    while ((c = getopt_long(argc, argv, "c:B:d::DhRv", opts, &i)) != -1)
     {
         switch (c)
         {
@@ -221,6 +252,11 @@ int main(int argc, char *argv[])
 
           case 'd':
             log_level = wf::log::LOG_LEVEL_DEBUG;
+            if (optarg)
+            {
+                parse_debug_categories(optarg);
+            }
+
             break;
 
           case 'v':
@@ -247,10 +283,9 @@ int main(int argc, char *argv[])
 #endif
 
     LOGI("Starting wayfire version ", WAYFIRE_VERSION);
-    /* First create display and initialize safe-list's event loop, so that
-     * wf objects (which depend on safe-list) can work */
+    /* First create the display, so that wf objects which use its event loop
+     * can work */
     auto display = wl_display_create();
-    wf::_safe_list_detail::event_loop = wl_display_get_event_loop(display);
 
     auto& core = wf::get_core_impl();
 
@@ -307,6 +342,10 @@ int main(int argc, char *argv[])
     }
 
     setenv("WAYLAND_DISPLAY", core.wayland_display.c_str(), 1);
+    wf::ipc_server_t::get().init();
+    wf::metrics_server_t::get().init();
+    wf::stall_watchdog_t::get().init();
+    wf::performance_governor_t::get().init();
     core.post_init();
 
     wl_display_run(core.display);
@@ -3,6 +3,7 @@
 #include <wayfire/util/log.hpp>
 #include <wayfire/view.hpp>
 #include "../core/core-impl.hpp"
+#include "../view/view-impl.hpp"
 #include <wayfire/core.hpp>
 #include <map>
 #include <wayfire/signal-definitions.hpp>
@@ -30,7 +31,20 @@ static void handle_gtk_surface_set_dbus_properties(wl_client *client,
     auto surface = static_cast<wl_resource*>(wl_resource_get_user_data(resource));
     if (application_id)
     {
-        wf::get_core_impl().gtk_shell->surface_app_id[surface] = application_id;
+        auto& app_id = wf::get_core_impl().gtk_shell->surface_app_id[surface];
+        if (app_id == application_id)
+        {
+            return;
+        }
+
+        app_id = application_id;
+        /* Toplevels created before this request have sent the default app id */
+        auto view = dynamic_cast<wf::wlr_view_t*>(
+            wf::wl_surface_to_wayfire_view(surface).get());
+        if (view)
+        {
+            view->toplevel_schedule_update(wf::wlr_view_t::TOPLEVEL_UPDATE_APP_ID);
+        }
     }
 }
 
@@ -0,0 +1,230 @@
+#include "kde-blur.hpp"
+#include "kde-blur-protocol.h"
+#include <wayfire/util/log.hpp>
+#include <wayfire/view.hpp>
+#include "../core/core-impl.hpp"
+#include <wayfire/core.hpp>
+#include <map>
+#include <memory>
+#include <optional>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/kde-blur.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+#define KDE_BLUR_VERSION 1
+
+struct wf_kde_blur
+{
+    struct surface_state_t
+    {
+        /* Empty if the whole surface should be blurred */
+        std::optional<wf::region_t> region;
+        wf::wl_listener_wrapper on_destroy;
+    };
+
+    /* The surfaces with blur, by their wl_surface resource */
+    std::map<wl_resource*, std::unique_ptr<surface_state_t>> surfaces;
+};
+
+/**
+ * An org_kde_kwin_blur object. The region is double-buffered, and applied to
+ * the surface on commit.
+ */
+struct wf_kde_blur_object
+{
+    /* The wl_surface resource, or null after the surface is destroyed */
+    wl_resource *surface;
+    std::optional<wf::region_t> pending;
+    wf::wl_listener_wrapper on_surface_destroy;
+};
+
+static void notify_blur_changed(wl_resource *surface)
+{
+    wayfire_view view = wf::wl_surface_to_wayfire_view(surface);
+    if (view)
+    {
+        wf::blur_region_changed_signal data;
+        data.view = view;
+        view->emit_signal("blur-region-changed", &data);
+        if (view->get_output())
+        {
+            view->get_output()->emit_signal("view-blur-region-changed", &data);
+        }
+    }
+}
+
+/**
+ * Apply the pending region of the blur object to its surface.
+ */
+static void handle_blur_commit(wl_client *client, wl_resource *resource)
+{
+    auto blur = static_cast<wf_kde_blur_object*>(wl_resource_get_user_data(resource));
+    if (!blur->surface)
+    {
+        return;
+    }
+
+    auto shell = wf::get_core_impl().kde_blur;
+    auto& state = shell->surfaces[blur->surface];
+    if (!state)
+    {
+        state = std::make_unique<wf_kde_blur::surface_state_t>();
+        auto surface = blur->surface;
+        state->on_destroy.set_callback([=] (void*)
+        {
+            /* Destroys the listener which is running, so nothing may be
+             * accessed afterwards */
+            wf::get_core_impl().kde_blur->surfaces.erase(surface);
+        });
+        state->on_destroy.connect(
+            &wlr_surface_from_resource(blur->surface)->events.destroy);
+    }
+
+    state->region = blur->pending;
+    notify_blur_changed(blur->surface);
+}
+
+/**
+ * Set the pending region. A null region means the whole surface.
+ */
+static void handle_blur_set_region(wl_client *client, wl_resource *resource,
+    wl_resource *region)
+{
+    auto blur = static_cast<wf_kde_blur_object*>(wl_resource_get_user_data(resource));
+    if (region)
+    {
+        blur->pending = wf::region_t{wlr_region_from_resource(region)};
+    } else
+    {
+        blur->pending.reset();
+    }
+}
+
+/**
+ * Releasing the blur object keeps the blur of the surface, like in KWin.
+ */
+static void handle_blur_release(wl_client *client, wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void handle_blur_destroy(wl_resource *resource)
+{
+    delete static_cast<wf_kde_blur_object*>(wl_resource_get_user_data(resource));
+}
+
+static const struct org_kde_kwin_blur_interface kde_blur_impl = {
+    .commit     = handle_blur_commit,
+    .set_region = handle_blur_set_region,
+    .release    = handle_blur_release,
+};
+
+/**
+ * Create a blur object for the given surface.
+ */
+static void handle_blur_manager_create(wl_client *client, wl_resource *resource,
+    uint32_t id, wl_resource *surface)
+{
+    auto res = wl_resource_create(client, &org_kde_kwin_blur_interface,
+        wl_resource_get_version(resource), id);
+    if (!res)
+    {
+        wl_client_post_no_memory(client);
+
+        return;
+    }
+
+    auto blur = new wf_kde_blur_object;
+    blur->surface = surface;
+    blur->on_surface_destroy.set_callback([=] (void*)
+    {
+        blur->surface = nullptr;
+        blur->on_surface_destroy.disconnect();
+    });
+    blur->on_surface_destroy.connect(
+        &wlr_surface_from_resource(surface)->events.destroy);
+
+    wl_resource_set_implementation(res, &kde_blur_impl, blur,
+        handle_blur_destroy);
+}
+
+/**
+ * Stop blurring behind the surface.
+ */
+static void handle_blur_manager_unset(wl_client *client, wl_resource *resource,
+    wl_resource *surface)
+{
+    if (wf::get_core_impl().kde_blur->surfaces.erase(surface))
+    {
+        notify_blur_changed(surface);
+    }
+}
+
+static const struct org_kde_kwin_blur_manager_interface kde_blur_manager_impl = {
+    .create = handle_blur_manager_create,
+    .unset  = handle_blur_manager_unset,
+};
+
+/**
+ * The blur manager exists as long as the compositor runs.
+ */
+static void handle_blur_manager_destroy(wl_resource *resource)
+{}
+
+static void bind_kde_blur_manager(wl_client *client, void *data,
+    uint32_t version, uint32_t id)
+{
+    auto resource = wl_resource_create(client,
+        &org_kde_kwin_blur_manager_interface, KDE_BLUR_VERSION, id);
+    wl_resource_set_implementation(resource, &kde_blur_manager_impl, data,
+        handle_blur_manager_destroy);
+}
+
+/**
+ * Creates the wf_kde_blur object, there is one in the compositor.
+ */
+wf_kde_blur *wf_kde_blur_create(wl_display *display)
+{
+    wf_kde_blur *kde_blur = new wf_kde_blur;
+    wl_global *global = wl_global_create(display,
+        &org_kde_kwin_blur_manager_interface, KDE_BLUR_VERSION, kde_blur,
+        bind_kde_blur_manager);
+    if (global == NULL)
+    {
+        LOGE("Failed to create org_kde_kwin_blur_manager");
+
+        return nullptr;
+    }
+
+    return kde_blur;
+}
+
+bool get_kde_blur_region(wayfire_view view, wf::region_t& region)
+{
+    if (!view || !wf::get_core_impl().kde_blur)
+    {
+        return false;
+    }
+
+    auto surface = view->get_wlr_surface();
+    if (!surface)
+    {
+        return false;
+    }
+
+    auto& surfaces = wf::get_core_impl().kde_blur->surfaces;
+    auto it = surfaces.find(surface->resource);
+    if (it == surfaces.end())
+    {
+        return false;
+    }
+
+    if (it->second->region)
+    {
+        region = *it->second->region;
+    } else
+    {
+        region = wlr_box{0, 0, surface->current.width, surface->current.height};
+    }
+
+    return true;
+}
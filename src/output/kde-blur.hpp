@@ -0,0 +1,7 @@
+#pragma once
+
+#include <wayland-server-core.h>
+
+struct wf_kde_blur;
+
+wf_kde_blur *wf_kde_blur_create(wl_display *display);
@@ -2,6 +2,8 @@
 #include "plugin-loader.hpp"
 #include "../core/seat/bindings-repository.hpp"
 
+#include <list>
+#include <unordered_map>
 #include <unordered_set>
 #include <wayfire/nonstd/safe-list.hpp>
 
@@ -15,6 +17,7 @@ class output_impl_t : public output_t
     std::unique_ptr<wf::bindings_repository_t> bindings;
 
     signal_callback_t view_disappeared_cb;
+    signal_callback_t view_removed_cb;
     bool inhibited = false;
 
     enum focus_view_flags_t
@@ -43,6 +46,17 @@ class output_impl_t : public output_t
 
     wf::dimensions_t effective_size;
 
+    /* Focused views, most recently focused first, and their positions in the
+     * list, so that moving a view to the front doesn't need a search. */
+    std::list<wayfire_view> focus_history;
+    std::unordered_map<wf::view_interface_t*,
+        std::list<wayfire_view>::iterator> focus_history_pos;
+
+    /** Update the view's focus timestamp and move it to the front of the
+     * focus history. */
+    void update_focus_timestamp(wayfire_view view);
+    void remove_from_focus_history(wayfire_view view);
+
   public:
     output_impl_t(wlr_output *output, const wf::dimensions_t& effective_size);
     /**
@@ -67,6 +81,7 @@ class output_impl_t : public output_t
     bool call_plugin(const std::string& activator,
         const wf::activator_data_t& data) const override;
     wayfire_view get_active_view() const override;
+    std::vector<wayfire_view> get_focus_history() const override;
     void focus_view(wayfire_view v, bool raise) override;
     void refocus(wayfire_view skip_view, uint32_t layers) override;
     wf::dimensions_t get_screen_size() const override;
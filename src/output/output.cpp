@@ -10,6 +10,7 @@
 #include "../core/seat/input-manager.hpp"
 #include "../view/xdg-shell.hpp"
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
 
 #include <algorithm>
@@ -32,6 +33,16 @@ wf::output_impl_t::output_impl_t(wlr_output *handle,
     };
 
     connect_signal("view-disappeared", &view_disappeared_cb);
+
+    /* Minimized views stay in the focus history, they come back in the same
+     * place when restored. */
+    view_removed_cb = [=] (wf::signal_data_t *data)
+    {
+        remove_from_focus_history(get_signaled_view(data));
+    };
+
+    connect_signal("view-unmapped", &view_removed_cb);
+    connect_signal("view-detached", &view_removed_cb);
 }
 
 void wf::output_impl_t::start_plugins()
@@ -46,30 +57,49 @@ std::string wf::output_t::to_string() const
 
 void wf::output_impl_t::refocus(wayfire_view skip_view, uint32_t layers)
 {
-    wayfire_view next_focus = nullptr;
-    auto views = workspace->get_views_on_workspace(
-        workspace->get_current_workspace(), layers);
-
+    auto cws = workspace->get_current_workspace();
     const auto& suitable_for_focus = [&] (wayfire_view view)
     {
         return (view != skip_view) && view->is_mapped() &&
                view->get_keyboard_focus_surface() && !view->minimized;
     };
 
-    const auto& newer_than_candidate = [&] (wayfire_view view)
+    /* The focus history is sorted by last_focus_timestamp, so the first
+     * suitable view in it is the most recently focused one. Usually, it is
+     * one of the first few entries. */
+    for (auto& view : focus_history)
     {
-        return (!next_focus ||
-            (next_focus->last_focus_timestamp < view->last_focus_timestamp));
-    };
+        auto toplevel = view;
+        while (toplevel->parent)
+        {
+            toplevel = toplevel->parent;
+        }
 
-    for (auto toplevel : views)
+        if (suitable_for_focus(view) &&
+            (workspace->get_view_layer(toplevel) & layers) &&
+            workspace->view_visible_on(toplevel, cws))
+        {
+            focus_view(view, 0u);
+
+            return;
+        }
+    }
+
+    /* None of the candidates has been focused yet, take the topmost one */
+    wayfire_view next_focus = nullptr;
+    for (auto toplevel : workspace->get_views_on_workspace(cws, layers))
     {
-        for (auto& v : toplevel->enumerate_views())
+        toplevel->for_each_view([&] (wayfire_view v)
         {
-            if (suitable_for_focus(v) && newer_than_candidate(v))
+            if (!next_focus && suitable_for_focus(v))
             {
                 next_focus = v;
             }
+        });
+
+        if (next_focus)
+        {
+            break;
         }
     }
 
@@ -237,16 +267,43 @@ void wf::output_impl_t::update_active_view(wayfire_view v, uint32_t flags)
     }
 }
 
-static void update_focus_timestamp(wayfire_view view)
+void wf::output_impl_t::update_focus_timestamp(wayfire_view view)
+{
+    if (!view)
+    {
+        return;
+    }
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    view->last_focus_timestamp = ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+
+    auto it = focus_history_pos.find(view.get());
+    if (it != focus_history_pos.end())
+    {
+        focus_history.splice(focus_history.begin(), focus_history, it->second);
+    } else
+    {
+        focus_history.push_front(view);
+        focus_history_pos[view.get()] = focus_history.begin();
+    }
+}
+
+void wf::output_impl_t::remove_from_focus_history(wayfire_view view)
 {
-    if (view)
+    auto it = focus_history_pos.find(view.get());
+    if (it != focus_history_pos.end())
     {
-        timespec ts;
-        clock_gettime(CLOCK_MONOTONIC, &ts);
-        view->last_focus_timestamp = ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+        focus_history.erase(it->second);
+        focus_history_pos.erase(it);
     }
 }
 
+std::vector<wayfire_view> wf::output_impl_t::get_focus_history() const
+{
+    return {focus_history.begin(), focus_history.end()};
+}
+
 void wf::output_impl_t::focus_view(wayfire_view v, uint32_t flags)
 {
     static wf::option_wrapper_t<bool>
@@ -392,11 +449,11 @@ bool wf::output_impl_t::activate_plugin(const plugin_grab_interface_uptr& owner,
 
     if (active_plugins.find(owner.get()) != active_plugins.end())
     {
-        LOGD("output ", handle->name,
+        LOGC(PLUGIN, "output ", handle->name,
             ": activate plugin ", owner->name, " again");
     } else
     {
-        LOGD("output ", handle->name, ": activate plugin ", owner->name);
+        LOGC(PLUGIN, "output ", handle->name, ": activate plugin ", owner->name);
     }
 
     active_plugins.insert(owner.get());
@@ -414,7 +471,7 @@ bool wf::output_impl_t::deactivate_plugin(
     }
 
     active_plugins.erase(it);
-    LOGD("output ", handle->name, ": deactivate plugin ", owner->name);
+    LOGC(PLUGIN, "output ", handle->name, ": deactivate plugin ", owner->name);
 
     if (active_plugins.count(owner.get()) == 0)
     {
@@ -505,7 +562,9 @@ static wf::binding_t *push_binding(
 binding_t*output_impl_t::add_key(option_sptr_t<keybinding_t> key,
     wf::key_callback *callback)
 {
-    return push_binding(this->bindings->keys, key, callback);
+    auto result = push_binding(this->bindings->keys, key, callback);
+    this->bindings->invalidate_index();
+    return result;
 }
 
 binding_t*output_impl_t::add_axis(option_sptr_t<keybinding_t> axis,
@@ -517,13 +576,16 @@ binding_t*output_impl_t::add_axis(option_sptr_t<keybinding_t> axis,
 binding_t*output_impl_t::add_button(option_sptr_t<buttonbinding_t> button,
     wf::button_callback *callback)
 {
-    return push_binding(this->bindings->buttons, button, callback);
+    auto result = push_binding(this->bindings->buttons, button, callback);
+    this->bindings->invalidate_index();
+    return result;
 }
 
 binding_t*output_impl_t::add_activator(
     option_sptr_t<activatorbinding_t> activator, wf::activator_callback *callback)
 {
     auto result = push_binding(this->bindings->activators, activator, callback);
+    this->bindings->invalidate_index();
     this->bindings->recreate_hotspots();
     return result;
 }
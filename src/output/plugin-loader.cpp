@@ -3,14 +3,17 @@
 #include <set>
 #include <memory>
 #include <filesystem>
+#include <chrono>
 #include <dlfcn.h>
 
 #include "plugin-loader.hpp"
 #include "wayfire/output-layout.hpp"
 #include "wayfire/output.hpp"
 #include "../core/wm.hpp"
+#include "../core/signal-accounting.hpp"
 #include "wayfire/core.hpp"
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
 
 
 plugin_manager::plugin_manager(wf::output_t *o)
@@ -53,11 +56,116 @@ plugin_manager::~plugin_manager()
     loaded_plugins.clear();
 }
 
+namespace
+{
+/**
+ * A plugin library opened by plugin_manager. The library is shared by the
+ * plugin instances on all outputs, so it is opened and checked only once.
+ */
+struct plugin_library_t
+{
+    void *handle = nullptr;
+    void *new_instance = nullptr;
+    int refcount = 0;
+};
+
+std::unordered_map<std::string, plugin_library_t>& get_plugin_libraries()
+{
+    static std::unordered_map<std::string, plugin_library_t> libraries;
+
+    return libraries;
+}
+
+/** @return The name of the plugin with the given path, for ex. expo */
+std::string get_plugin_name(const std::string& path)
+{
+    auto name = std::filesystem::path(path).stem().string();
+    if (name.rfind("lib", 0) == 0)
+    {
+        name = name.substr(3);
+    }
+
+    return name;
+}
+
+/**
+ * Find the files of the plugins in the given list. The result for the last
+ * list is kept, so that each output does not look up the same files again.
+ */
+const std::vector<std::string>& resolve_plugin_paths(
+    const std::string& plugin_list)
+{
+    static std::string resolved_list;
+    static std::vector<std::string> resolved_paths;
+    if ((plugin_list == resolved_list) && !resolved_paths.empty())
+    {
+        return resolved_paths;
+    }
+
+    std::stringstream stream(plugin_list);
+    std::vector<std::string> next_plugins;
+
+    auto plugin_prefix = std::string(PLUGIN_PATH "/");
+    std::vector<std::string> plugin_prefixes;
+    if (char *plugin_path = getenv("WAYFIRE_PLUGIN_PATH"))
+    {
+        std::stringstream ss(plugin_path);
+        std::string entry;
+        while (std::getline(ss, entry, ':'))
+        {
+            plugin_prefixes.push_back(entry);
+        }
+    }
+
+    plugin_prefixes.push_back(PLUGIN_PATH);
+
+    std::string plugin_name;
+    while (stream >> plugin_name)
+    {
+        if (plugin_name.size())
+        {
+            if (plugin_name.at(0) == '/')
+            {
+                next_plugins.push_back(plugin_name);
+                continue;
+            }
+
+            for (std::filesystem::path plugin_prefix : plugin_prefixes)
+            {
+                auto plugin_path = plugin_prefix / ("lib" + plugin_name + ".so");
+                if (std::filesystem::exists(plugin_path))
+                {
+                    next_plugins.push_back(plugin_path);
+                    break;
+                }
+            }
+        }
+    }
+
+    resolved_list  = plugin_list;
+    resolved_paths = std::move(next_plugins);
+
+    return resolved_paths;
+}
+
+double milliseconds_since(std::chrono::steady_clock::time_point start)
+{
+    using namespace std::chrono;
+
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+}
+
 void plugin_manager::init_plugin(wayfire_plugin& p)
 {
+    auto start = std::chrono::steady_clock::now();
+
     p->grab_interface = std::make_unique<wf::plugin_grab_interface_t>(output);
     p->output = output;
     p->init();
+
+    LOGC(PLUGIN, "Initialized plugin ", p->grab_interface->name, " on ",
+        output->to_string(), " in ", milliseconds_since(start), "ms");
 }
 
 void plugin_manager::destroy_plugin(wayfire_plugin& p)
@@ -70,14 +178,24 @@ void plugin_manager::destroy_plugin(wayfire_plugin& p)
     auto handle = p->handle;
     p.reset();
 
-    /* dlopen()/dlclose() do reference counting, so we should close the plugin
-     * as many times as we opened it.
+    /* The library is closed when the last instance of the plugin is gone.
      *
      * We also need to close the handle after deallocating the plugin, otherwise
      * we unload its destructor before calling it. */
-    if (handle)
+    if (!handle)
     {
-        dlclose(handle);
+        return;
+    }
+
+    auto& libraries = get_plugin_libraries();
+    for (auto it = libraries.begin(); it != libraries.end(); ++it)
+    {
+        if ((it->second.handle == handle) && (--it->second.refcount == 0))
+        {
+            dlclose(handle);
+            libraries.erase(it);
+            break;
+        }
     }
 }
 
@@ -120,27 +238,38 @@ std::pair<void*, void*> wf::get_new_instance_handle(const std::string& path)
         return {nullptr, nullptr};
     }
 
-    LOGD("Loaded plugin ", path.c_str());
+    LOGC(PLUGIN, "Loaded plugin ", path.c_str());
 
     return {handle, new_instance_func_ptr};
 }
 
 wayfire_plugin plugin_manager::load_plugin_from_file(std::string path)
 {
-    auto [handle, new_instance_func_ptr] = wf::get_new_instance_handle(path);
-
-    if (new_instance_func_ptr)
+    auto& library = get_plugin_libraries()[path];
+    if (!library.handle)
     {
-        auto new_instance_func =
-            wf::union_cast<void*, wayfire_plugin_load_func>(new_instance_func_ptr);
+        auto start = std::chrono::steady_clock::now();
+        std::tie(library.handle, library.new_instance) =
+            wf::get_new_instance_handle(path);
+        if (!library.new_instance)
+        {
+            get_plugin_libraries().erase(path);
 
-        auto ptr = wayfire_plugin(new_instance_func());
-        ptr->handle = handle;
+            return nullptr;
+        }
 
-        return ptr;
+        LOGC(PLUGIN, "Opened plugin ", path, " in ", milliseconds_since(start),
+            "ms");
     }
 
-    return nullptr;
+    auto new_instance_func =
+        wf::union_cast<void*, wayfire_plugin_load_func>(library.new_instance);
+
+    auto ptr = wayfire_plugin(new_instance_func());
+    ptr->handle = library.handle;
+    ++library.refcount;
+
+    return ptr;
 }
 
 void plugin_manager::reload_dynamic_plugins()
@@ -153,45 +282,14 @@ void plugin_manager::reload_dynamic_plugins()
              "ensure your configuration file is set up properly.");
     }
 
-    std::stringstream stream(plugin_list);
-    std::vector<std::string> next_plugins;
-
-    auto plugin_prefix = std::string(PLUGIN_PATH "/");
-    std::vector<std::string> plugin_prefixes;
-    if (char *plugin_path = getenv("WAYFIRE_PLUGIN_PATH"))
+    /* Nothing to do if only other options changed */
+    if (plugin_list == current_plugin_list)
     {
-        std::stringstream ss(plugin_path);
-        std::string entry;
-        while (std::getline(ss, entry, ':'))
-        {
-            plugin_prefixes.push_back(entry);
-        }
+        return;
     }
 
-    plugin_prefixes.push_back(PLUGIN_PATH);
-
-    std::string plugin_name;
-    while (stream >> plugin_name)
-    {
-        if (plugin_name.size())
-        {
-            if (plugin_name.at(0) == '/')
-            {
-                next_plugins.push_back(plugin_name);
-                continue;
-            }
-
-            for (std::filesystem::path plugin_prefix : plugin_prefixes)
-            {
-                auto plugin_path = plugin_prefix / ("lib" + plugin_name + ".so");
-                if (std::filesystem::exists(plugin_path))
-                {
-                    next_plugins.push_back(plugin_path);
-                    break;
-                }
-            }
-        }
-    }
+    current_plugin_list = plugin_list;
+    const auto& next_plugins = resolve_plugin_paths(plugin_list);
 
     /* erase plugins that have been removed from the config */
     auto it = loaded_plugins.begin();
@@ -208,7 +306,7 @@ void plugin_manager::reload_dynamic_plugins()
             it->first) == next_plugins.end()) &&
             it->second->is_unloadable())
         {
-            LOGD("unload plugin ", it->first.c_str());
+            LOGC(PLUGIN, "unload plugin ", it->first.c_str());
             destroy_plugin(it->second);
             it = loaded_plugins.erase(it);
         } else
@@ -225,6 +323,8 @@ void plugin_manager::reload_dynamic_plugins()
             continue;
         }
 
+        /* Connections created by the plugin are accounted to it */
+        wf::signal_accounting::owner_guard_t owner{get_plugin_name(plugin)};
         auto ptr = load_plugin_from_file(plugin);
         if (ptr)
         {
@@ -240,13 +340,17 @@ static wayfire_plugin create_plugin()
     return std::unique_ptr<wf::plugin_interface_t>(new T);
 }
 
-void plugin_manager::load_static_plugins()
+template<class T>
+void plugin_manager::load_static_plugin(const std::string& name)
 {
-    loaded_plugins["_exit"]  = create_plugin<wayfire_exit>();
-    loaded_plugins["_focus"] = create_plugin<wayfire_focus>();
-    loaded_plugins["_close"] = create_plugin<wayfire_close>();
+    wf::signal_accounting::owner_guard_t owner{name};
+    loaded_plugins[name] = create_plugin<T>();
+    init_plugin(loaded_plugins[name]);
+}
 
-    init_plugin(loaded_plugins["_exit"]);
-    init_plugin(loaded_plugins["_focus"]);
-    init_plugin(loaded_plugins["_close"]);
+void plugin_manager::load_static_plugins()
+{
+    load_static_plugin<wayfire_exit>("_exit");
+    load_static_plugin<wayfire_focus>("_focus");
+    load_static_plugin<wayfire_close>("_close");
 }
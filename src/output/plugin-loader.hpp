@@ -27,12 +27,16 @@ struct plugin_manager
   private:
     wf::output_t *output;
     wf::option_wrapper_t<std::string> plugins_opt;
+    /* The value of plugins_opt the dynamic plugins were last loaded for */
+    std::string current_plugin_list;
     std::unordered_map<std::string, wayfire_plugin> loaded_plugins;
 
     void deinit_plugins(bool unloadable);
 
     wayfire_plugin load_plugin_from_file(std::string path);
     void load_static_plugins();
+    template<class T>
+    void load_static_plugin(const std::string& name);
 
     void init_plugin(wayfire_plugin& plugin);
     void destroy_plugin(wayfire_plugin& plugin);
@@ -6,13 +6,29 @@
 #include "wayfire/util.hpp"
 #include "wayfire/workspace-manager.hpp"
 #include "../core/seat/seat.hpp"
+#include "../core/seat/input-manager.hpp"
 #include "../core/opengl-priv.hpp"
+#include "../core/watchdog.hpp"
+#include "../view/surface-atlas.hpp"
+#include "../view/view-impl.hpp"
 #include "../main.hpp"
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <unordered_map>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/nonstd/safe-list.hpp>
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
+#include <wayfire/trace.hpp>
 #include <wayfire/nonstd/wlroots-full.hpp>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2ext.h>
+#include <cstring>
+#include <time.h>
 
 namespace wf
 {
@@ -27,6 +43,9 @@ struct output_damage_t
     wlr_output *output;
     wlr_output_damage *damage_manager;
     output_t *wo;
+    /* Damage is dropped and no frames are scheduled while the output is
+     * dormant, see render_manager::set_dormant() */
+    bool dormant = false;
 
     output_damage_t(output_t *output)
     {
@@ -44,30 +63,203 @@ struct output_damage_t
      */
     void damage(const wf::region_t& region)
     {
-        if (region.empty() || !damage_manager)
+        if (region.empty() || !damage_manager || dormant)
         {
             return;
         }
 
+        ++scene_serial;
+        bump_ws_serials(wlr_box_from_pixman_box(region.get_extents()));
+
         /* Wlroots expects damage after scaling */
         auto scaled_region = region * wo->handle->scale;
+        coalesce_damage(scaled_region);
         frame_damage |= scaled_region;
         wlr_output_damage_add(damage_manager, scaled_region.to_pixman());
     }
 
     void damage(const wf::geometry_t& box)
     {
-        if ((box.width <= 0) || (box.height <= 0) || !damage_manager)
+        if ((box.width <= 0) || (box.height <= 0) || !damage_manager ||
+            dormant)
         {
             return;
         }
 
+        ++scene_serial;
+        bump_ws_serials(box);
+
         /* Wlroots expects damage after scaling */
         auto scaled_box = box * wo->handle->scale;
         frame_damage |= scaled_box;
         wlr_output_damage_add_box(damage_manager, &scaled_box);
     }
 
+    /**
+     * Increases every time the output is damaged through Wayfire. Damage which
+     * wlroots adds on its own, for ex. when a software cursor moves, doesn't
+     * change it.
+     */
+    uint64_t scene_serial = 0;
+
+    /**
+     * Each workspace has a damage serial, which increases every time damage
+     * touches the workspace. Workspace streams remember the serial they were
+     * last rendered at, so that the render manager can tell whether their
+     * contents are still up to date.
+     */
+    uint64_t damage_serial = 0;
+    std::vector<uint64_t> ws_serials;
+    wf::dimensions_t serials_grid = {0, 0};
+
+    void ensure_ws_serials()
+    {
+        auto grid = wo->workspace->get_workspace_grid_size();
+        if (grid != serials_grid)
+        {
+            /* Workspaces changed, nothing rendered so far is reliable */
+            serials_grid = grid;
+            ws_serials.assign(grid.width * grid.height, ++damage_serial);
+        }
+    }
+
+    void bump_ws_serials(const wf::geometry_t& box)
+    {
+        if (!wo->workspace)
+        {
+            return;
+        }
+
+        ensure_ws_serials();
+        ++damage_serial;
+
+        /* Only the workspaces under the box can intersect it */
+        auto size  = wo->get_screen_size();
+        auto cws   = wo->workspace->get_current_workspace();
+        auto first = [] (int start, int pitch)
+        {
+            return (int)std::floor(1.0 * start / std::max(1, pitch));
+        };
+        int x1 = std::max(0, cws.x + first(box.x, size.width));
+        int y1 = std::max(0, cws.y + first(box.y, size.height));
+        int x2 = std::min(serials_grid.width - 1,
+            cws.x + first(box.x + box.width - 1, size.width));
+        int y2 = std::min(serials_grid.height - 1,
+            cws.y + first(box.y + box.height - 1, size.height));
+        for (int i = x1; i <= x2; i++)
+        {
+            for (int j = y1; j <= y2; j++)
+            {
+                wlr_box ws_box = get_ws_box({i, j}), intersection;
+                if (wlr_box_intersection(&intersection, &ws_box, &box))
+                {
+                    ws_serials[i * serials_grid.height + j] = damage_serial;
+                }
+            }
+        }
+    }
+
+    /**
+     * Get the damage serial of the given workspace. A return value of 0 means
+     * the workspace does not exist.
+     */
+    uint64_t get_ws_serial(wf::point_t ws)
+    {
+        ensure_ws_serials();
+        if ((ws.x < 0) || (ws.y < 0) ||
+            (ws.x >= serials_grid.width) || (ws.y >= serials_grid.height))
+        {
+            return 0;
+        }
+
+        return ws_serials[ws.x * serials_grid.height + ws.y];
+    }
+
+    /**
+     * Fragmented damage makes everything downstream iterate over many tiny
+     * rectangles, so regions with more than max_damage_rects rectangles get
+     * merged, at the cost of repainting some undamaged pixels.
+     */
+    wf::option_wrapper_t<int> max_damage_rects{"core/max_damage_rects"};
+    /* The number of rectangles merged away since the last frame */
+    uint32_t coalesced_rects = 0;
+
+    /* If the bounding box of the damage is at most this many times larger than
+     * the damage itself, use the bounding box */
+    static constexpr int64_t MAX_EXTENTS_OVERDRAW = 2;
+
+    static int64_t box_area(const wlr_box& box)
+    {
+        return int64_t(box.width) * box.height;
+    }
+
+    static wlr_box box_union(const wlr_box& a, const wlr_box& b)
+    {
+        int x1 = std::min(a.x, b.x);
+        int y1 = std::min(a.y, b.y);
+        int x2 = std::max(a.x + a.width, b.x + b.width);
+        int y2 = std::max(a.y + a.height, b.y + b.height);
+
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    void coalesce_damage(wf::region_t& region)
+    {
+        const int max_rects = max_damage_rects;
+        const int nrects    = region.end() - region.begin();
+        if ((max_rects <= 0) || (nrects <= max_rects))
+        {
+            return;
+        }
+
+        std::vector<wlr_box> boxes;
+        int64_t area = 0;
+        for (const auto& rect : region)
+        {
+            boxes.push_back(wlr_box_from_pixman_box(rect));
+            area += box_area(boxes.back());
+        }
+
+        auto extents = wlr_box_from_pixman_box(region.get_extents());
+        if (box_area(extents) <= area * MAX_EXTENTS_OVERDRAW)
+        {
+            region = extents;
+            coalesced_rects += nrects - 1;
+
+            return;
+        }
+
+        /* Pixman sorts the rectangles by bands, so neighbours in the list are
+         * usually close to each other. Repeatedly merge the neighbours whose
+         * bounding box adds the least overdraw. */
+        while ((int)boxes.size() > max_rects)
+        {
+            size_t best = 0;
+            int64_t best_cost = std::numeric_limits<int64_t>::max();
+            for (size_t i = 0; i + 1 < boxes.size(); i++)
+            {
+                int64_t cost = box_area(box_union(boxes[i], boxes[i + 1])) -
+                    box_area(boxes[i]) - box_area(boxes[i + 1]);
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best = i;
+                }
+            }
+
+            boxes[best] = box_union(boxes[best], boxes[best + 1]);
+            boxes.erase(boxes.begin() + best + 1);
+        }
+
+        region.clear();
+        for (const auto& box : boxes)
+        {
+            region |= box;
+        }
+
+        coalesced_rects += std::max(0, nrects - int(region.end() - region.begin()));
+    }
+
     wf::region_t acc_damage;
 
     /**
@@ -96,6 +288,67 @@ struct output_damage_t
         return true;
     }
 
+    /* eglSetDamageRegionKHR, or null if EGL_KHR_partial_update is missing */
+    static PFNEGLSETDAMAGEREGIONKHRPROC get_set_damage_region()
+    {
+        static PFNEGLSETDAMAGEREGIONKHRPROC set_damage_region = [] ()
+        {
+            auto display    = wf::get_core_impl().egl->display;
+            auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+            if (!extensions || !strstr(extensions, "EGL_KHR_partial_update"))
+            {
+                return (PFNEGLSETDAMAGEREGIONKHRPROC) nullptr;
+            }
+
+            return (PFNEGLSETDAMAGEREGIONKHRPROC)
+                eglGetProcAddress("eglSetDamageRegionKHR");
+        }();
+
+        return set_damage_region;
+    }
+
+    /**
+     * Declare which part of the output buffer is drawn in the current frame,
+     * using EGL_KHR_partial_update. Tile-based GPUs then only load and store
+     * the tiles in that region, instead of the whole buffer. The rest of the
+     * buffer keeps the contents indicated by its buffer age.
+     *
+     * Needs to be called after make_current(), before anything is drawn to
+     * the output buffer, and at most once per frame.
+     *
+     * @param region The region which will be drawn, in the same coordinates
+     *   as the damage passed to swap_buffers().
+     */
+    void set_damage_region(const wf::region_t& region)
+    {
+        auto set_damage_region = get_set_damage_region();
+        auto display = wf::get_core_impl().egl->display;
+        auto surface = eglGetCurrentSurface(EGL_DRAW);
+        if (!set_damage_region || (surface == EGL_NO_SURFACE))
+        {
+            return;
+        }
+
+        int w, h;
+        wlr_output_transformed_resolution(output, &w, &h);
+
+        /* EGL wants buffer coordinates with the origin in the bottom-left */
+        wf::region_t buffer_region = region;
+        wlr_region_transform(buffer_region.to_pixman(), buffer_region.to_pixman(),
+            wlr_output_transform_invert(output->transform), w, h);
+        wlr_region_transform(buffer_region.to_pixman(), buffer_region.to_pixman(),
+            WL_OUTPUT_TRANSFORM_FLIPPED_180, output->width, output->height);
+
+        std::vector<EGLint> rects;
+        for (const auto& rect : buffer_region)
+        {
+            rects.insert(rects.end(),
+                {rect.x1, rect.y1, rect.x2 - rect.x1, rect.y2 - rect.y1});
+        }
+
+        set_damage_region(display, surface, rects.data(), rects.size() / 4);
+    }
+
     /**
      * Accumulate damage from last frame.
      * Needs to be called after make_current()
@@ -103,6 +356,7 @@ struct output_damage_t
     void accumulate_damage()
     {
         frame_damage |= acc_damage;
+        coalesce_damage(frame_damage);
         if (runtime_config.no_damage_track)
         {
             frame_damage |= get_wlr_damage_box();
@@ -154,6 +408,11 @@ struct output_damage_t
      */
     void schedule_repaint()
     {
+        if (dormant)
+        {
+            return;
+        }
+
         wlr_output_schedule_frame(output);
         force_next_frame = true;
     }
@@ -211,19 +470,6 @@ struct output_damage_t
                 vsize.height * res.height,
             });
     }
-
-    wf::wl_idle_call idle_damage;
-    /**
-     * Same as render_manager::damage_whole_idle()
-     */
-    void damage_whole_idle()
-    {
-        damage_whole();
-        if (!idle_damage.is_connected())
-        {
-            idle_damage.run_once([&] () { damage_whole(); });
-        }
-    }
 };
 
 /**
@@ -255,11 +501,124 @@ struct effect_hook_manager_t
 
     void run_effects(output_effect_type_t type)
     {
+        static const char *trace_names[] = {
+            "effects: pre", "effects: damage", "effects: overlay", "effects: post"
+        };
+        WF_TRACE_SCOPE(trace_names[type]);
         effects[type].for_each([] (auto effect)
         { (*effect)(); });
     }
 };
 
+/**
+ * Keeps the overlay rectangles of an output and the geometry with which each
+ * of them was last damaged, so that moving a rectangle repaints its old area.
+ */
+struct overlay_rect_manager_t
+{
+    struct entry_t
+    {
+        overlay_rect_t *rect;
+        wf::geometry_t damaged;
+    };
+
+    std::vector<entry_t> rects;
+    output_damage_t *output_damage;
+
+    overlay_rect_manager_t(output_damage_t *output_damage)
+    {
+        this->output_damage = output_damage;
+    }
+
+    std::vector<entry_t>::iterator find(overlay_rect_t *rect)
+    {
+        return std::find_if(rects.begin(), rects.end(),
+            [=] (const entry_t& entry) { return entry.rect == rect; });
+    }
+
+    void add(overlay_rect_t *rect)
+    {
+        if (find(rect) == rects.end())
+        {
+            rects.push_back({rect, rect->geometry});
+            output_damage->damage(rect->geometry);
+        }
+    }
+
+    void update(overlay_rect_t *rect)
+    {
+        auto it = find(rect);
+        if (it != rects.end())
+        {
+            output_damage->damage(it->damaged);
+            output_damage->damage(rect->geometry);
+            it->damaged = rect->geometry;
+        }
+    }
+
+    void remove(overlay_rect_t *rect)
+    {
+        auto it = find(rect);
+        if (it != rects.end())
+        {
+            output_damage->damage(it->damaged);
+            rects.erase(it);
+        }
+    }
+
+    static void render_colored_rect(const wf::framebuffer_t& fb,
+        wf::geometry_t box, const wf::color_t& color)
+    {
+        wf::color_t premultiply{
+            color.r * color.a,
+            color.g * color.a,
+            color.b * color.a,
+            color.a};
+
+        OpenGL::render_rectangle(box, premultiply,
+            fb.get_orthographic_projection());
+    }
+
+    /** Draw all rectangles, inside the given damage only */
+    void render(const wf::framebuffer_t& fb, const wf::region_t& damage)
+    {
+        if (rects.empty())
+        {
+            return;
+        }
+
+        WF_TRACE_SCOPE("overlay rects");
+        OpenGL::render_begin(fb);
+        for (auto& entry : rects)
+        {
+            auto g = entry.rect->geometry;
+            int b  = std::max(0, std::min({entry.rect->border,
+                g.width / 2, g.height / 2}));
+            for (const auto& box : damage & g)
+            {
+                fb.logic_scissor(wlr_box_from_pixman_box(box));
+
+                /* The border parts must not overlap, otherwise the corners are
+                 * wrong if the border color has alpha != 1.0 */
+                auto& border_color = entry.rect->border_color;
+                render_colored_rect(fb, {g.x, g.y, g.width, b}, border_color);
+                render_colored_rect(fb, {g.x, g.y + g.height - b, g.width, b},
+                    border_color);
+                render_colored_rect(fb, {g.x, g.y + b, b, g.height - 2 * b},
+                    border_color);
+                render_colored_rect(fb,
+                    {g.x + g.width - b, g.y + b, b, g.height - 2 * b},
+                    border_color);
+                render_colored_rect(fb,
+                    {g.x + b, g.y + b, g.width - 2 * b, g.height - 2 * b},
+                    entry.rect->color);
+            }
+        }
+
+        OpenGL::render_end();
+    }
+};
+
 /**
  * A class to manage and run postprocessing effects
  */
@@ -271,6 +630,12 @@ struct postprocessing_manager_t
     /* Buffer to which other operations render to */
     static constexpr uint32_t default_out_buffer = 0;
 
+    /* Snippets are compiled together into fused_program, which is rebuilt
+     * lazily whenever the set of snippets changes. */
+    wf::safe_list_t<post_snippet_t*> post_snippets;
+    OpenGL::program_t fused_program;
+    bool fused_program_dirty = false;
+
     output_t *output;
     uint32_t output_width, output_height;
     postprocessing_manager_t(output_t *output)
@@ -278,6 +643,77 @@ struct postprocessing_manager_t
         this->output = output;
     }
 
+    ~postprocessing_manager_t()
+    {
+        OpenGL::render_begin();
+        fused_program.free_resources();
+        OpenGL::render_end();
+    }
+
+    bool has_effects() const
+    {
+        return post_effects.size() || post_snippets.size();
+    }
+
+    /**
+     * @return By how many pixels the swap damage needs to be expanded so that
+     * all pixels affected by the damage get postprocessed, or -1 if the whole
+     * output needs to be postprocessed.
+     */
+    int get_damage_footprint() const
+    {
+        /* Arbitrary post hooks may depend on the whole image */
+        if (post_effects.size())
+        {
+            return -1;
+        }
+
+        int footprint = 0;
+        post_snippets.for_each([&] (post_snippet_t *snippet)
+        {
+            if ((footprint < 0) || (snippet->sampling_radius < 0))
+            {
+                footprint = -1;
+            } else
+            {
+                footprint += snippet->sampling_radius;
+            }
+        });
+
+        return footprint;
+    }
+
+    /* The local box of each snippet in the last frame, in output pixels */
+    std::unordered_map<post_snippet_t*, wf::geometry_t> last_local_boxes;
+
+    /**
+     * Add the areas which snippets with a local box need to repaint to the
+     * given damage, see post_snippet_t::local_box.
+     */
+    void add_local_box_damage(wf::region_t& damage)
+    {
+        const double scale = output->handle->scale;
+        post_snippets.for_each([&] (post_snippet_t *snippet)
+        {
+            auto& last = last_local_boxes[snippet];
+            auto box   = snippet->local_box * scale;
+            if ((box.width <= 0) || (box.height <= 0))
+            {
+                box = {0, 0, 0, 0};
+            }
+
+            if (box != last)
+            {
+                damage |= last;
+                damage |= box;
+                last = box;
+            } else if (!(damage & box).empty())
+            {
+                damage |= box;
+            }
+        });
+    }
+
     void workaround_wlroots_backend_y_invert(wf::framebuffer_t& fb) const
     {
         /* Sometimes, the framebuffer by OpenGL is Y-inverted.
@@ -301,7 +737,7 @@ struct postprocessing_manager_t
 
     void allocate(int width, int height)
     {
-        if (post_effects.size() == 0)
+        if (!has_effects())
         {
             return;
         }
@@ -310,7 +746,12 @@ struct postprocessing_manager_t
         output_height = height;
 
         OpenGL::render_begin();
-        post_buffers[default_out_buffer].allocate(width, height);
+        if (post_buffers[default_out_buffer].allocate(width, height))
+        {
+            wf::gpu_memory::set_owner(&post_buffers[default_out_buffer],
+                "postprocessing");
+        }
+
         OpenGL::render_end();
     }
 
@@ -326,13 +767,151 @@ struct postprocessing_manager_t
         output->render->damage_whole_idle();
     }
 
+    void add_post_snippet(post_snippet_t *snippet)
+    {
+        post_snippets.push_back(snippet);
+        fused_program_dirty = true;
+        output->render->damage_whole_idle();
+    }
+
+    void rem_post_snippet(post_snippet_t *snippet)
+    {
+        post_snippets.remove_all(snippet);
+        last_local_boxes.erase(snippet);
+        fused_program_dirty = true;
+        output->render->damage_whole_idle();
+    }
+
+    /* Generate the fragment shader for the active snippets. Sampling at
+     * c1(c2(...cn(uv))) is the same as applying the coordinate effects
+     * c1, ..., cn one after another, so coordinate snippets are applied in
+     * reverse. Color effects are applied in order to the sampled color. */
+    std::string generate_fused_fragment_shader()
+    {
+        std::string source =
+            "#version 100\n"
+            "precision mediump float;\n"
+            "varying highp vec2 uvpos;\n"
+            "uniform sampler2D smp;\n";
+
+        std::vector<post_snippet_t*> coord, color;
+        post_snippets.for_each([&] (post_snippet_t *snippet)
+        {
+            source += snippet->source + "\n";
+            if (snippet->type == post_snippet_t::POST_SNIPPET_COORD)
+            {
+                coord.push_back(snippet);
+            } else
+            {
+                color.push_back(snippet);
+            }
+        });
+
+        source += "void main()\n{\n    highp vec2 uv = uvpos;\n";
+        for (auto snippet : wf::reverse(coord))
+        {
+            source += "    uv = " + snippet->function + "(uv);\n";
+        }
+
+        source += "    vec4 color = texture2D(smp, uv);\n";
+        for (auto snippet : color)
+        {
+            source += "    color = " + snippet->function + "(color);\n";
+        }
+
+        source += "    gl_FragColor = color;\n}\n";
+
+        return source;
+    }
+
+    /* Render the damaged parts of the source buffer to the destination with
+     * all snippets applied in a single pass. */
+    void run_fused_pass(const wf::framebuffer_base_t& source,
+        const wf::framebuffer_base_t& destination, const wf::region_t& damage)
+    {
+        static const char *vertex_shader =
+            R"(
+#version 100
+
+attribute mediump vec2 position;
+attribute highp vec2 uvPosition;
+
+varying highp vec2 uvpos;
+
+void main() {
+
+    gl_Position = vec4(position.xy, 0.0, 1.0);
+    uvpos = uvPosition;
+}
+)";
+
+        static const float vertexData[] = {
+            -1.0f, -1.0f,
+            1.0f, -1.0f,
+            1.0f, 1.0f,
+            -1.0f, 1.0f
+        };
+
+        static const float coordData[] = {
+            0.0f, 0.0f,
+            1.0f, 0.0f,
+            1.0f, 1.0f,
+            0.0f, 1.0f
+        };
+
+        OpenGL::render_begin(destination);
+        if (fused_program_dirty)
+        {
+            fused_program.free_resources();
+            fused_program.set_simple(OpenGL::compile_program(vertex_shader,
+                generate_fused_fragment_shader()));
+            fused_program_dirty = false;
+        }
+
+        fused_program.use(wf::TEXTURE_TYPE_RGBA);
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, source.tex));
+
+        fused_program.attrib_pointer("position", 2, 0, vertexData);
+        fused_program.attrib_pointer("uvPosition", 2, 0, coordData);
+        post_snippets.for_each([&] (post_snippet_t *snippet)
+        {
+            if (snippet->set_uniforms)
+            {
+                snippet->set_uniforms(fused_program, destination);
+            }
+        });
+
+        /* The damage is in output pixels, and the source buffer has the same
+         * layout as the output framebuffer */
+        wf::framebuffer_t damage_fb = get_target_framebuffer();
+        damage_fb.geometry.x = damage_fb.geometry.y = 0;
+        damage_fb.scale = 1;
+
+        OpenGL::disable_blend();
+        for (const auto& rect : damage)
+        {
+            damage_fb.logic_scissor(wlr_box_from_pixman_box(rect));
+            GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        }
+
+        OpenGL::enable_blend();
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+
+        fused_program.deactivate();
+        OpenGL::render_end();
+    }
+
     /* Run all postprocessing effects, rendering to alternating buffers and
      * finally to the screen.
      *
      * NB: 2 buffers just aren't enough. We render to the zero buffer, and then
      * we alternately render to the second and the third. The reason: We track
-     * damage. So, we need to keep the whole buffer each frame. */
-    void run_post_effects()
+     * damage. So, we need to keep the whole buffer each frame.
+     *
+     * Snippets don't need buffers of their own, they all run in one final
+     * pass after the post hooks, limited to the given damage. */
+    void run_post_effects(const wf::region_t& damage)
     {
         wf::framebuffer_base_t default_framebuffer;
         default_framebuffer.fb  = output_fb;
@@ -341,17 +920,22 @@ struct postprocessing_manager_t
         int last_buffer_idx = default_out_buffer;
         int next_buffer_idx = 1;
 
+        const bool has_snippets = post_snippets.size() > 0;
         post_effects.for_each([&] (auto post) -> void
         {
-            /* The last postprocessing hook renders directly to the screen, others to
-             * the currently free buffer */
+            /* The last postprocessing step renders directly to the screen,
+             * others to the currently free buffer */
             wf::framebuffer_base_t& next_buffer =
-                (post == post_effects.back() ? default_framebuffer :
-                    post_buffers[next_buffer_idx]);
+                (post == post_effects.back() && !has_snippets ?
+                    default_framebuffer : post_buffers[next_buffer_idx]);
 
             OpenGL::render_begin();
             /* Make sure we have the correct resolution */
-            next_buffer.allocate(output_width, output_height);
+            if (next_buffer.allocate(output_width, output_height))
+            {
+                wf::gpu_memory::set_owner(&next_buffer, "postprocessing");
+            }
+
             OpenGL::render_end();
 
             (*post)(post_buffers[last_buffer_idx], next_buffer);
@@ -359,6 +943,16 @@ struct postprocessing_manager_t
             last_buffer_idx  = next_buffer_idx;
             next_buffer_idx ^= 0b11; // alternate 1 and 2
         });
+
+        if (has_snippets)
+        {
+            OpenGL::render_begin();
+            default_framebuffer.allocate(output_width, output_height);
+            OpenGL::render_end();
+
+            run_fused_pass(post_buffers[last_buffer_idx], default_framebuffer,
+                damage);
+        }
     }
 
     wf::framebuffer_t get_target_framebuffer() const
@@ -370,7 +964,7 @@ struct postprocessing_manager_t
             (wl_output_transform)fb.wl_transform);
         fb.scale = output->handle->scale;
 
-        if (post_effects.size())
+        if (has_effects())
         {
             fb.fb  = post_buffers[default_out_buffer].fb;
             fb.tex = post_buffers[default_out_buffer].tex;
@@ -389,117 +983,524 @@ struct postprocessing_manager_t
 
     bool can_scanout() const
     {
-        return post_effects.size() == 0;
+        return !has_effects();
+    }
+
+    /**
+     * @return Whether the last post hook draws to the output buffer, which it
+     *   may do anywhere. Fused snippets only draw the damaged region.
+     */
+    bool draws_whole_output() const
+    {
+        return post_effects.size() && (post_snippets.size() == 0);
+    }
+
+    /**
+     * Tell the driver which buffer contents aren't needed by the next frame:
+     * the intermediate buffers of the post hooks, which are drawn in full
+     * every frame, and all depth buffers. The first buffer keeps the scene,
+     * because only its damaged parts are drawn again.
+     */
+    void discard_buffers()
+    {
+        OpenGL::render_begin();
+        for (int i = 0; i < 3; i++)
+        {
+            if (post_buffers[i].fb != (uint32_t)-1)
+            {
+                OpenGL::discard_framebuffer(post_buffers[i].fb,
+                    i != default_out_buffer);
+            }
+        }
+
+        if (output_fb != 0)
+        {
+            OpenGL::discard_framebuffer(output_fb, false);
+        }
+
+        OpenGL::render_end();
     }
 };
 
 /**
- * Responsible for attaching depth buffers to framebuffers.
- * It keeps at most 3 depth buffers at any given time to conserve
- * resources.
+ * Keeps copies of the output contents under the software cursors, so that
+ * frames in which only the cursors moved can be repainted by restoring the
+ * pixels under the old cursor positions and drawing the cursors again,
+ * without rendering any views.
+ *
+ * The copies are taken right before the cursors are drawn. They stay valid as
+ * long as the scene serial of the output doesn't change, i.e. as long as
+ * nothing but the cursors was damaged. Output, damage and buffer coordinates
+ * are assumed to be the same, so the render manager uses this only on
+ * untransformed outputs.
  */
-class depth_buffer_manager_t : public noncopyable_t
+class cursor_backing_store_t : public noncopyable_t
 {
   public:
-    void ensure_depth_buffer(int fb, int width, int height)
+    ~cursor_backing_store_t()
     {
-        /* If the backend doesn't have its own framebuffer, then the
-         * framebuffer is created with a depth buffer. */
-        if (fb == 0)
+        OpenGL::render_begin();
+        for (auto& backing : backings)
         {
-            return;
+            backing.pixels.release();
         }
 
-        attach_buffer(find_buffer(fb), fb, width, height);
+        OpenGL::render_end();
     }
 
-    ~depth_buffer_manager_t()
+    /** @return The boxes of the visible software cursors, clipped to the output */
+    static std::vector<wlr_box> get_cursor_boxes(wlr_output *output)
     {
-        OpenGL::render_begin();
-        for (auto& buffer : buffers)
+        std::vector<wlr_box> boxes;
+        wlr_box output_box = {0, 0, output->width, output->height};
+
+        wlr_output_cursor *cursor;
+        wl_list_for_each(cursor, &output->cursors, link)
         {
-            GL_CALL(glDeleteTextures(1, &buffer.tex));
+            if (!cursor->enabled || !cursor->visible ||
+                (output->hardware_cursor == cursor))
+            {
+                continue;
+            }
+
+            wlr_box box = {
+                (int)(cursor->x - cursor->hotspot_x),
+                (int)(cursor->y - cursor->hotspot_y),
+                cursor->width, cursor->height,
+            };
+
+            wlr_box clipped;
+            if (wlr_box_intersection(&clipped, &box, &output_box))
+            {
+                boxes.push_back(clipped);
+            }
         }
 
-        OpenGL::render_end();
+        return boxes;
     }
 
-  private:
-    static constexpr size_t MAX_BUFFERS = 3;
+    /** Mark all copies as out of date. */
+    void invalidate()
+    {
+        for (auto& backing : backings)
+        {
+            backing.valid = false;
+        }
+    }
 
-    struct depth_buffer_t
+    /** @return The union of the boxes which can be restored at the serial. */
+    wf::region_t get_restorable_region(uint64_t scene_serial) const
     {
-        GLuint tex = -1;
-        int attached_to = -1;
-        int width  = 0;
-        int height = 0;
+        wf::region_t region;
+        if (scene_serial != serial)
+        {
+            return region;
+        }
 
-        int64_t last_used = 0;
-    };
+        for (auto& backing : backings)
+        {
+            if (backing.valid)
+            {
+                region |= backing.box;
+            }
+        }
+
+        return region;
+    }
 
-    void attach_buffer(depth_buffer_t& buffer, int fb, int width, int height)
+    /**
+     * Copy the given boxes of the target framebuffer. The oldest copies are
+     * replaced when there is no free slot.
+     *
+     * Should be called between OpenGL::render_begin/end(target).
+     */
+    void save(const wf::framebuffer_base_t& target,
+        const std::vector<wlr_box>& boxes, uint64_t scene_serial)
     {
-        if ((buffer.attached_to == fb) &&
-            (buffer.width == width) &&
-            (buffer.height == height))
+        if (scene_serial != serial)
         {
-            return;
+            invalidate();
+            serial = scene_serial;
+        }
+
+        for (auto& box : boxes)
+        {
+            auto slot = &backings[0];
+            for (auto& backing : backings)
+            {
+                if (!backing.valid)
+                {
+                    slot = &backing;
+                    break;
+                }
+
+                if (backing.saved_at < slot->saved_at)
+                {
+                    slot = &backing;
+                }
+            }
+
+            if (slot->pixels.allocate(box.width, box.height))
+            {
+                wf::gpu_memory::set_owner(&slot->pixels, "cursor backing store");
+            }
+
+            slot->box      = box;
+            slot->valid    = true;
+            slot->saved_at = ++save_counter;
+            blit(target.fb, to_gl_box(target, box), slot->pixels.fb,
+                {0, 0, box.width, box.height});
         }
 
-        if (buffer.tex != (GLuint) - 1)
+        OpenGL::bind_framebuffer(GL_FRAMEBUFFER, target.fb);
+    }
+
+    /**
+     * Copy all valid copies back to the target framebuffer.
+     *
+     * Should be called between OpenGL::render_begin/end(target).
+     */
+    void restore(const wf::framebuffer_base_t& target)
+    {
+        for (auto& backing : backings)
         {
-            GL_CALL(glDeleteTextures(1, &buffer.tex));
+            if (backing.valid)
+            {
+                blit(backing.pixels.fb,
+                    {0, 0, backing.box.width, backing.box.height},
+                    target.fb, to_gl_box(target, backing.box));
+            }
         }
 
-        GL_CALL(glGenTextures(1, &buffer.tex));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-            width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL));
-        buffer.width  = width;
-        buffer.height = height;
+        OpenGL::bind_framebuffer(GL_FRAMEBUFFER, target.fb);
+    }
 
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, buffer.tex));
-        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, fb));
-        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-            GL_TEXTURE_2D, buffer.tex, 0));
-        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+  private:
+    /* Enough for a few cursors over the buffer ages of triple buffering */
+    static constexpr size_t MAX_BACKINGS = 8;
+
+    struct backing_t
+    {
+        wlr_box box;
+        wf::framebuffer_base_t pixels;
+        bool valid = false;
+        uint64_t saved_at = 0;
+    };
+
+    std::array<backing_t, MAX_BACKINGS> backings;
+    uint64_t serial = 0;
+    uint64_t save_counter = 0;
+
+    /* GL framebuffers have their origin in the bottom-left corner */
+    static wlr_box to_gl_box(const wf::framebuffer_base_t& fb, wlr_box box)
+    {
+        return {box.x, fb.viewport_height - box.y - box.height,
+            box.width, box.height};
+    }
+
+    static void blit(GLuint from, wlr_box src, GLuint to, wlr_box dst)
+    {
+        OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, from);
+        OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, to);
+        GL_CALL(glBlitFramebuffer(src.x, src.y, src.x + src.width,
+            src.y + src.height, dst.x, dst.y, dst.x + dst.width,
+            dst.y + dst.height, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+    }
+};
+
+/**
+ * Compares incrementally repainted frames with a repaint of the whole output,
+ * to find damage tracking bugs, see core/damage_check_interval.
+ *
+ * The comparison runs on the GPU: each TILE x TILE block of pixels is reduced
+ * to a single pixel of a mask, which is small enough to be read back.
+ */
+class damage_checker_t : public noncopyable_t
+{
+  public:
+    static constexpr int TILE = 16;
+
+    ~damage_checker_t()
+    {
+        OpenGL::render_begin();
+        reference.release();
+        frame_copy.release();
+        mask.release();
+        program.free_resources();
+        OpenGL::render_end();
+    }
+
+    /** @return The buffer for the full repaint, allocated to the given size */
+    const wf::framebuffer_base_t& get_reference(int width, int height)
+    {
+        OpenGL::render_begin();
+        if (reference.allocate(width, height))
+        {
+            wf::gpu_memory::set_owner(&reference, "damage check");
+        }
+
+        OpenGL::render_end();
 
-        buffer.attached_to = fb;
-        buffer.last_used   = get_current_time();
+        return reference;
     }
 
-    depth_buffer_t& find_buffer(int fb)
+    /**
+     * Compare the given frame with the reference buffer. The frame must have
+     * the same size as the reference.
+     *
+     * @return The tiles which differ, in framebuffer pixels with the origin in
+     *   the top-left corner, like the boxes from
+     *   framebuffer_t::framebuffer_box_from_geometry_box().
+     */
+    wf::region_t compare(const wf::framebuffer_base_t& frame)
     {
-        for (auto& buffer : buffers)
+        const int width  = reference.viewport_width;
+        const int height = reference.viewport_height;
+        const int mask_width  = (width + TILE - 1) / TILE;
+        const int mask_height = (height + TILE - 1) / TILE;
+
+        OpenGL::render_begin();
+        GLuint frame_tex = frame.tex;
+        if ((frame.tex == 0) || (frame.tex == (GLuint)-1))
+        {
+            /* The output framebuffer cannot be sampled */
+            if (frame_copy.allocate(width, height))
+            {
+                wf::gpu_memory::set_owner(&frame_copy, "damage check");
+            }
+
+            OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, frame.fb);
+            OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, frame_copy.fb);
+            GL_CALL(glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                GL_COLOR_BUFFER_BIT, GL_NEAREST));
+            frame_tex = frame_copy.tex;
+        }
+
+        if (mask.allocate(mask_width, mask_height))
         {
-            if (buffer.attached_to == fb)
+            wf::gpu_memory::set_owner(&mask, "damage check");
+        }
+
+        render_mask(frame_tex, width, height);
+
+        std::vector<uint8_t> pixels(mask_width * mask_height * 4);
+        OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, mask.fb);
+        GL_CALL(glReadPixels(0, 0, mask_width, mask_height, GL_RGBA,
+            GL_UNSIGNED_BYTE, pixels.data()));
+        OpenGL::render_end();
+
+        wf::region_t mismatch;
+        for (int y = 0; y < mask_height; y++)
+        {
+            for (int x = 0; x < mask_width; x++)
             {
-                return buffer;
+                if (pixels[(y * mask_width + x) * 4] > 127)
+                {
+                    mismatch |= wlr_box{x * TILE, height - (y + 1) * TILE,
+                        TILE, TILE};
+                }
             }
         }
 
-        /** New buffer? */
-        if (buffers.size() < MAX_BUFFERS)
+        return mismatch & wlr_box{0, 0, width, height};
+    }
+
+  private:
+    wf::framebuffer_base_t reference;
+    /* A copy of the frame, if it is not in a texture */
+    wf::framebuffer_base_t frame_copy;
+    wf::framebuffer_base_t mask;
+    OpenGL::program_t program;
+    bool program_compiled = false;
+
+    void render_mask(GLuint frame_tex, int width, int height)
+    {
+        static const char *vertex_shader =
+            R"(
+#version 100
+
+attribute mediump vec2 position;
+
+void main() {
+
+    gl_Position = vec4(position.xy, 0.0, 1.0);
+}
+)";
+
+        /* Colors may differ by rounding when the same surfaces are blended in
+         * another order, so small differences are ignored. */
+        static const char *fragment_shader =
+            R"(
+#version 100
+precision mediump float;
+
+uniform sampler2D frame;
+uniform sampler2D reference;
+uniform highp vec2 size;
+
+void main() {
+
+    highp vec2 origin = floor(gl_FragCoord.xy) * 16.0;
+    float difference = 0.0;
+    for (int i = 0; i < 16; i++)
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            highp vec2 uv = (origin + vec2(i, j) + 0.5) / size;
+            vec4 delta = abs(texture2D(frame, uv) - texture2D(reference, uv));
+            difference = max(difference,
+                max(max(delta.r, delta.g), max(delta.b, delta.a)));
+        }
+    }
+
+    gl_FragColor = vec4(step(2.5 / 255.0, difference), 0.0, 0.0, 1.0);
+}
+)";
+
+        static const float vertexData[] = {
+            -1.0f, -1.0f,
+            1.0f, -1.0f,
+            1.0f, 1.0f,
+            -1.0f, 1.0f
+        };
+
+        if (!program_compiled)
+        {
+            program.set_simple(OpenGL::compile_program(vertex_shader,
+                fragment_shader));
+            program_compiled = true;
+        }
+
+        mask.bind();
+        program.use(wf::TEXTURE_TYPE_RGBA);
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, frame_tex));
+        GL_CALL(glActiveTexture(GL_TEXTURE1));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, reference.tex));
+        program.uniform1i("frame", 0);
+        program.uniform1i("reference", 1);
+        program.uniform2f("size", width, height);
+        program.attrib_pointer("position", 2, 0, vertexData);
+
+        OpenGL::disable_blend();
+        GL_CALL(glDisable(GL_SCISSOR_TEST));
+        GL_CALL(glDrawArrays(GL_TRIANGLE_FAN, 0, 4));
+        OpenGL::enable_blend();
+
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        GL_CALL(glActiveTexture(GL_TEXTURE0));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+        program.deactivate();
+    }
+};
+
+/**
+ * The background layer of an output, rendered into a buffer of the output's
+ * size and drawn from there into each workspace stream with a single quad, as
+ * long as the views in it don't change. Background views are sticky, so they
+ * look the same on all workspaces.
+ */
+struct background_cache_t : public noncopyable_t
+{
+    /** A background view as it was when it was rendered */
+    struct entry_t
+    {
+        /* Only compared, the view may be gone */
+        wf::view_interface_t *view;
+        uint64_t contents_serial;
+        wf::geometry_t geometry;
+
+        bool operator ==(const entry_t& other) const
+        {
+            return (view == other.view) &&
+                   (contents_serial == other.contents_serial) &&
+                   (geometry == other.geometry);
+        }
+    };
+
+    wf::framebuffer_base_t buffer;
+    /* The background views at the last check, and the ones being checked */
+    std::vector<entry_t> contents;
+    std::vector<entry_t> next_contents;
+    /* The output geometry and scale at the last check */
+    wf::geometry_t geometry = {0, 0, 0, 0};
+    float scale = 0;
+    /* Whether the buffer shows the contents */
+    bool valid = false;
+    /* The opaque parts of the buffer, in output-local coordinates */
+    wf::region_t opaque;
+
+    ~background_cache_t()
+    {
+        if (buffer.tex != (GLuint)-1)
         {
-            buffers.push_back(depth_buffer_t{});
+            OpenGL::render_begin();
+            buffer.release();
+            OpenGL::render_end();
+        }
+    }
+};
+
+/**
+ * A moving histogram of the render times of the last frames.
+ */
+class render_time_model_t
+{
+  public:
+    /** Add the render time of a frame, in nanoseconds */
+    void add_sample(int64_t render_time)
+    {
+        size_t bucket = clamp(render_time / BUCKET_NSEC,
+            int64_t(0), int64_t(NUM_BUCKETS - 1));
+
+        histogram[bucket]++;
+        samples.push_back(bucket);
+        if (samples.size() > MAX_SAMPLES)
+        {
+            histogram[samples.front()]--;
+            samples.pop_front();
+        }
+    }
 
-            return buffers.back();
+    /**
+     * @return The render time in nanoseconds which is not exceeded by the
+     *   given fraction of the samples, or -1 if there are too few samples.
+     */
+    int64_t predict(double quantile) const
+    {
+        if (samples.size() < MIN_SAMPLES)
+        {
+            return -1;
         }
 
-        /** Evict oldest */
-        auto oldest = &buffers.front();
-        for (auto& buffer : buffers)
+        size_t target = std::ceil(quantile * samples.size());
+        size_t count  = 0;
+        for (size_t i = 0; i < NUM_BUCKETS; i++)
         {
-            if (buffer.last_used < oldest->last_used)
+            count += histogram[i];
+            if (count >= target)
             {
-                oldest = &buffer;
+                return (i + 1) * BUCKET_NSEC;
             }
         }
 
-        return *oldest;
+        return NUM_BUCKETS * BUCKET_NSEC;
+    }
+
+    void reset()
+    {
+        histogram.fill(0);
+        samples.clear();
     }
 
-    std::vector<depth_buffer_t> buffers;
+  private:
+    static constexpr int64_t BUCKET_NSEC = 250'000; // 0.25ms
+    static constexpr size_t NUM_BUCKETS  = 200; // up to 50ms
+    static constexpr size_t MAX_SAMPLES  = 120;
+    static constexpr size_t MIN_SAMPLES  = 10;
+
+    std::array<uint32_t, NUM_BUCKETS> histogram{};
+    std::deque<size_t> samples;
 };
 
 /**
@@ -521,15 +1522,16 @@ class depth_buffer_manager_t : public noncopyable_t
  * Thus, we need to dynamically guess this time based on the previous frames.
  * Currently, the following algorithm is implemented:
  *
- * Initially, the repaint delay is zero.
+ * The render times of the last frames are kept in a moving histogram, and the
+ * predicted render time is a high quantile of it. Repainting then starts at
+ * `refresh - predicted render time - margin`.
  *
- * If at some point Wayfire skips a frame, the delay is assumed too big and
- * reduced by `2^i`, where `i` is the amount of consecutive skipped frames.
+ * The histogram is reset whenever the set of active effects and renderers
+ * changes, because for example expo or cube render very differently from the
+ * regular desktop. Until enough frames have been measured, the delay is zero.
  *
- * If Wayfire renders in time for `increase_window` milliseconds, then the
- * delay is increased by one. If the next frame is delayed, then
- * `increase_window` is doubled, otherwise, it is halved
- * (but it must stay between `MIN_INCREASE_WINDOW` and `MAX_INCREASE_WINDOW`).
+ * If at some point Wayfire skips a frame, the margin is doubled, and it slowly
+ * decreases again while frames are rendered on time.
  */
 struct repaint_delay_manager_t
 {
@@ -553,6 +1555,35 @@ struct repaint_delay_manager_t
         last_pageflip = -1;
     }
 
+    /**
+     * Set the identifier of the active effects and renderers. When it changes,
+     * the render times measured so far are no longer representative.
+     */
+    void set_effect_set(uint64_t effect_set)
+    {
+        if (effect_set != current_effect_set)
+        {
+            current_effect_set = effect_set;
+            model.reset();
+        }
+    }
+
+    /**
+     * Set whether frames should be repainted right away. This is the case
+     * when a fullscreen client drives the refresh rate of an adaptive sync
+     * output, so waiting for the usual repaint point only adds latency.
+     */
+    void set_immediate(bool immediate)
+    {
+        this->immediate = immediate;
+    }
+
+    /** @return Whether the current frame is repainted without delay. */
+    bool is_immediate()
+    {
+        return immediate;
+    }
+
     /**
      * Starting a new frame.
      */
@@ -561,6 +1592,7 @@ struct repaint_delay_manager_t
         if (last_pageflip == -1)
         {
             last_pageflip = get_current_time();
+            update_delay();
             return;
         }
 
@@ -569,42 +1601,25 @@ struct repaint_delay_manager_t
         const int64_t last_frame_len = get_current_time() - last_pageflip;
         if (last_frame_len <= on_time_thresh)
         {
-            // We rendered last frame on time
-            if (get_current_time() - last_increase >= increase_window)
-            {
-                increase_window = clamp(int64_t(increase_window * 0.75),
-                    MIN_INCREASE_WINDOW, MAX_INCREASE_WINDOW);
-                update_delay(+1);
-                reset_increase_timer();
-
-                // If we manage the next few frames, then we have reached a new
-                // stable state
-                expand_inc_window_on_miss = 20;
-            } else
-            {
-                --expand_inc_window_on_miss;
-            }
-
-            // Stop exponential decrease
-            consecutive_decrease = 1;
+            // We rendered last frame on time, slowly go back to the base margin
+            margin = std::max(BASE_MARGIN, margin - MARGIN_DECAY);
         } else
         {
             // We missed last frame.
-            update_delay(-consecutive_decrease);
-            // Next decrease should be faster
-            consecutive_decrease = clamp(consecutive_decrease * 2, 1, 32);
-
-            // Next increase should be tried after a longer interval
-            if (expand_inc_window_on_miss >= 0)
-            {
-                increase_window = clamp(increase_window * 2,
-                    MIN_INCREASE_WINDOW, MAX_INCREASE_WINDOW);
-            }
-
-            reset_increase_timer();
+            margin = std::min(MAX_MARGIN, margin * 2);
         }
 
         last_pageflip = get_current_time();
+        update_delay();
+    }
+
+    /**
+     * Record the time which was needed to render the last frame, from the
+     * start of the repaint until the buffers were swapped, in nanoseconds.
+     */
+    void finish_frame(int64_t render_time)
+    {
+        model.add_sample(render_time);
     }
 
     /**
@@ -615,81 +1630,506 @@ struct repaint_delay_manager_t
         return delay;
     }
 
+    /**
+     * @return The render time in nanoseconds which was predicted for the
+     *   current frame, or -1 if there was no prediction.
+     */
+    int64_t get_predicted_render_time()
+    {
+        return predicted_render_time;
+    }
+
   private:
     int delay = 0;
+    int64_t predicted_render_time = -1;
+    bool immediate = false;
 
-    void update_delay(int delta)
+    void update_delay()
     {
+        predicted_render_time = -1;
+        if (immediate || (max_render_time == -1) || (refresh_nsec <= 0))
+        {
+            delay = 0;
+            return;
+        }
+
         int config_delay = std::max(0,
             (int)(this->refresh_nsec / 1e6) - max_render_time);
-
-        int min = 0;
-        int max = config_delay;
-        if (max_render_time == -1)
+        if (!dynamic_delay)
         {
-            max = 0;
-        } else if (!dynamic_delay)
-        {
-            min = config_delay;
-            max = config_delay;
+            delay = config_delay;
+            return;
         }
 
-        delay = clamp(delay + delta, min, max);
-    }
+        predicted_render_time = model.predict(PREDICTION_QUANTILE);
+        if (predicted_render_time < 0)
+        {
+            delay = 0;
+            return;
+        }
 
-    void reset_increase_timer()
-    {
-        last_increase = get_current_time();
+        int64_t start = refresh_nsec - predicted_render_time - margin;
+        delay = clamp(int(start / 1'000'000), 0, config_delay);
     }
 
-    static constexpr int64_t MIN_INCREASE_WINDOW = 200; // 200 ms
-    static constexpr int64_t MAX_INCREASE_WINDOW = 30'000; // 30s
-    int64_t increase_window = MIN_INCREASE_WINDOW;
-    int64_t last_increase   = 0;
-
-    // > 0 => Increase increase_window
-    int64_t expand_inc_window_on_miss = 0;
+    static constexpr double PREDICTION_QUANTILE = 0.95;
+    static constexpr int64_t BASE_MARGIN  = 1'000'000; // 1ms
+    static constexpr int64_t MAX_MARGIN   = 8'000'000; // 8ms
+    static constexpr int64_t MARGIN_DECAY = 10'000; // 0.01ms
+    int64_t margin = BASE_MARGIN;
 
-    // Expontential decrease in case of missed frames
-    int32_t consecutive_decrease = 1;
+    render_time_model_t model;
+    uint64_t current_effect_set = 0;
 
     // Time of last frame
     int64_t last_pageflip = -1; // -1 is invalid
 
-    int64_t refresh_nsec;
+    int64_t refresh_nsec = 0;
     wf::option_wrapper_t<int> max_render_time{"core/max_render_time"};
     wf::option_wrapper_t<bool> dynamic_delay{"workarounds/dynamic_repaint_delay"};
 
     wf::wl_listener_wrapper on_present;
 };
 
-class wf::render_manager::impl
+/**
+ * Collects statistics about the repainted frames of an output and stores them
+ * in a fixed-size ring buffer.
+ *
+ * CPU times are measured with CLOCK_MONOTONIC. GPU times are measured with
+ * GL_EXT_disjoint_timer_query if it is available. Since reading back a query
+ * result immediately would stall the pipeline, queries are polled at the
+ * start of the following frames, and the results are filled in later.
+ */
+class frame_profiler_t : public noncopyable_t
 {
   public:
-    wf::wl_listener_wrapper on_frame;
-    wf::wl_timer repaint_timer;
+    static constexpr size_t MAX_FRAMES = 128;
 
-    output_t *output;
-    wf::region_t swap_damage;
+    /** Measures the time until it goes out of scope and adds it to target. */
+    class section_timer_t
+    {
+      public:
+        section_timer_t(int64_t& target) : target(target), start(now())
+        {}
+
+        ~section_timer_t()
+        {
+            target += now() - start;
+        }
+
+      private:
+        int64_t& target;
+        int64_t start;
+    };
+
+    /** The statistics for the frame which is currently being repainted. */
+    frame_stats_t current;
+    /* How the next frame waited for input, copied when it is started */
+    int64_t next_input_yield_time = 0;
+    uint32_t next_input_yield_events = 0;
+
+    static int64_t now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+    }
+
+    /**
+     * Start a new frame. Should be called when the GL context of the output
+     * is current and before anything is rendered.
+     */
+    void start_frame(int repaint_delay, int64_t start_time)
+    {
+        current = frame_stats_t{};
+        current.frame_id      = ++frame_counter;
+        current.start_time    = start_time;
+        current.repaint_delay = repaint_delay;
+        current.input_yield_time   = next_input_yield_time;
+        current.input_yield_events = next_input_yield_events;
+        next_input_yield_time   = 0;
+        next_input_yield_events = 0;
+
+        auto& input = wf::get_core_impl().input;
+        if (input && (input->last_event_serial != input_serial))
+        {
+            input_serial = input->last_event_serial;
+            current.input_time = input->last_event_time;
+        }
+
+        init_timer_queries();
+        collect_timer_queries();
+        if (has_timer_query)
+        {
+            GLuint query;
+            if (free_queries.empty())
+            {
+                GL_CALL(glGenQueries(1, &query));
+            } else
+            {
+                query = free_queries.back();
+                free_queries.pop_back();
+            }
+
+            GL_CALL(glBeginQuery(GL_TIME_ELAPSED_EXT, query));
+            pending_queries.push_back({query, current.frame_id});
+        }
+    }
+
+    /**
+     * Finish the current frame and store it in the ring buffer. Should be
+     * called before swapping buffers.
+     *
+     * @param commit_seq The sequence number of the output commit which will
+     *   show the frame.
+     */
+    void end_frame(const wf::region_t& swap_damage, uint32_t commit_seq)
+    {
+        if (has_timer_query)
+        {
+            GL_CALL(glEndQuery(GL_TIME_ELAPSED_EXT));
+        }
+
+        for (const auto& rect : swap_damage)
+        {
+            current.damaged_pixels +=
+                uint64_t(rect.x2 - rect.x1) * uint64_t(rect.y2 - rect.y1);
+            ++current.damage_rects;
+        }
+
+        current.total_time = now() - current.start_time;
+        if (frames.size() < MAX_FRAMES)
+        {
+            frames.push_back(current);
+        } else
+        {
+            frames[next_slot] = current;
+        }
+
+        next_slot = (next_slot + 1) % MAX_FRAMES;
+
+        pending_presents.push_back({commit_seq, current.frame_id});
+        if (pending_presents.size() > MAX_FRAMES)
+        {
+            pending_presents.pop_front();
+        }
+    }
+
+    /** Fill in the presentation time of the frame shown by the given commit. */
+    void frame_presented(const wlr_output_event_present& ev)
+    {
+        /* Commits which are not ours, for ex. direct scanout, are skipped */
+        while (!pending_presents.empty() &&
+               (int32_t(pending_presents.front().first - ev.commit_seq) < 0))
+        {
+            pending_presents.pop_front();
+        }
+
+        if (pending_presents.empty() ||
+            (pending_presents.front().first != ev.commit_seq))
+        {
+            return;
+        }
+
+        auto frame = find_frame(pending_presents.front().second);
+        if (frame && ev.presented && ev.when)
+        {
+            frame->present_time =
+                ev.when->tv_sec * 1'000'000'000ll + ev.when->tv_nsec;
+        }
+
+        pending_presents.pop_front();
+    }
+
+    /**
+     * Measure committing the frame which was ended last to the output.
+     * Committing happens after end_frame(), because the statistics are
+     * stored before the buffers are swapped.
+     */
+    template<class Commit>
+    void commit_frame(Commit commit)
+    {
+        int64_t start = now();
+        commit();
+        if (auto frame = find_frame(current.frame_id))
+        {
+            frame->commit_time = now() - start;
+        }
+    }
+
+    /** @return The stored frames, oldest first. */
+    std::vector<frame_stats_t> get_frames() const
+    {
+        if (frames.size() < MAX_FRAMES)
+        {
+            return frames;
+        }
+
+        std::vector<frame_stats_t> result;
+        result.reserve(MAX_FRAMES);
+        result.insert(result.end(), frames.begin() + next_slot, frames.end());
+        result.insert(result.end(), frames.begin(), frames.begin() + next_slot);
+
+        return result;
+    }
+
+    ~frame_profiler_t()
+    {
+        if (pending_queries.empty() && free_queries.empty())
+        {
+            return;
+        }
+
+        OpenGL::render_begin();
+        for (auto& pending : pending_queries)
+        {
+            GL_CALL(glDeleteQueries(1, &pending.query));
+        }
+
+        for (auto& query : free_queries)
+        {
+            GL_CALL(glDeleteQueries(1, &query));
+        }
+
+        OpenGL::render_end();
+    }
+
+  private:
+    uint64_t frame_counter = 0;
+    std::vector<frame_stats_t> frames;
+    size_t next_slot = 0;
+    uint64_t input_serial = 0;
+
+    /* Commit sequence numbers and frame ids of frames not yet presented */
+    std::deque<std::pair<uint32_t, uint64_t>> pending_presents;
+
+    struct pending_query_t
+    {
+        GLuint query;
+        uint64_t frame_id;
+    };
+
+    bool checked_timer_query = false;
+    bool has_timer_query     = false;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_result = nullptr;
+    std::vector<pending_query_t> pending_queries;
+    std::vector<GLuint> free_queries;
+
+    void init_timer_queries()
+    {
+        if (checked_timer_query)
+        {
+            return;
+        }
+
+        checked_timer_query = true;
+        auto extensions = (const char*)glGetString(GL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+        {
+            LOGI("GL_EXT_disjoint_timer_query is not supported, "
+                 "GPU frame times will not be available.");
+            return;
+        }
+
+        get_query_result = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
+            "glGetQueryObjectui64vEXT");
+        has_timer_query = (get_query_result != nullptr);
+    }
+
+    frame_stats_t *find_frame(uint64_t frame_id)
+    {
+        for (auto& frame : frames)
+        {
+            if (frame.frame_id == frame_id)
+            {
+                return &frame;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /** Fill in the GPU time of all frames whose queries have finished. */
+    void collect_timer_queries()
+    {
+        if (!has_timer_query || pending_queries.empty())
+        {
+            return;
+        }
+
+        /* If a disjoint operation occurred, all pending results are garbage */
+        GLint disjoint = 0;
+        GL_CALL(glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint));
+
+        auto it = pending_queries.begin();
+        while (it != pending_queries.end())
+        {
+            GLuint available = 0;
+            GL_CALL(glGetQueryObjectuiv(it->query,
+                GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available)
+            {
+                /* Queries finish in order */
+                break;
+            }
+
+            GLuint64 elapsed = 0;
+            get_query_result(it->query, GL_QUERY_RESULT, &elapsed);
+            auto frame = find_frame(it->frame_id);
+            if (frame && !disjoint)
+            {
+                frame->gpu_time = elapsed;
+            }
+
+            free_queries.push_back(it->query);
+            ++it;
+        }
+
+        pending_queries.erase(pending_queries.begin(), it);
+    }
+};
+
+class wf::render_manager::impl
+{
+  public:
+    wf::wl_listener_wrapper on_frame;
+    wf::wl_listener_wrapper on_present;
+    wf::wl_timer repaint_timer;
+    wf::wl_timer frame_done_timer;
+    /* When the last frame was presented, on the presentation clock, or -1 */
+    int64_t last_present_time = -1;
+
+    output_t *output;
+    wf::region_t swap_damage;
     std::unique_ptr<output_damage_t> output_damage;
     std::unique_ptr<effect_hook_manager_t> effects;
+    std::unique_ptr<overlay_rect_manager_t> overlays;
     std::unique_ptr<postprocessing_manager_t> postprocessing;
-    std::unique_ptr<depth_buffer_manager_t> depth_buffer_manager;
     std::unique_ptr<repaint_delay_manager_t> delay_manager;
+    std::unique_ptr<frame_profiler_t> profiler;
+    std::unique_ptr<cursor_backing_store_t> cursor_backing;
+
+    /* Created when core/damage_check_interval is first enabled */
+    std::unique_ptr<damage_checker_t> damage_checker;
+    wf::option_wrapper_t<int> damage_check_interval{"core/damage_check_interval"};
+    int frames_since_damage_check = 0;
 
     wf::option_wrapper_t<wf::color_t> background_color_opt;
+    wf::option_wrapper_t<int> occluded_frame_rate{"core/occluded_frame_rate"};
+    uint32_t last_occluded_frame_done = 0;
+
+    /* The frame rate caps of the output option and of plugins */
+    wf::option_wrapper_t<int> max_render_fps;
+    std::vector<frame_rate_cap_t*> frame_rate_caps;
+    /* When the last frame was started, in milliseconds */
+    uint32_t last_frame_start = 0;
+    bool waiting_for_frame_cap = false;
+    wf::wl_timer frame_cap_timer;
+
+    /* The views in the visible layers, and the ones in the background layer,
+     * shared by the streams of a frame */
+    std::vector<wayfire_view> render_views_list;
+    std::vector<wayfire_view> background_views_list;
+    bool render_views_dirty = true;
+    background_cache_t background_cache;
+    wf::signal_connection_t on_stacking_changed = [=] (wf::signal_data_t*)
+    {
+        render_views_dirty = true;
+    };
+
+    /* The callbacks to run before the next frame, see run_before_paint(), and
+     * the ones being run */
+    std::vector<effect_hook_t*> before_paint;
+    std::vector<effect_hook_t*> running_before_paint;
+
+    void run_before_paint(effect_hook_t *callback)
+    {
+        if (std::find(before_paint.begin(), before_paint.end(),
+            callback) == before_paint.end())
+        {
+            before_paint.push_back(callback);
+        }
+
+        output_damage->schedule_repaint();
+    }
+
+    void rem_before_paint(effect_hook_t *callback)
+    {
+        for (auto list : {&before_paint, &running_before_paint})
+        {
+            list->erase(std::remove(list->begin(), list->end(), callback),
+                list->end());
+        }
+    }
+
+    void run_before_paint_callbacks()
+    {
+        /* Callbacks added while running are run before the next frame */
+        running_before_paint = std::move(before_paint);
+        before_paint.clear();
+        while (!running_before_paint.empty())
+        {
+            auto callback = running_before_paint.front();
+            running_before_paint.erase(running_before_paint.begin());
+            (*callback)();
+        }
+    }
+
+    effect_hook_t damage_whole_before_paint = [=] ()
+    {
+        output_damage->damage_whole();
+    };
+
+    /**
+     * Same as render_manager::damage_whole_idle()
+     */
+    void damage_whole_idle()
+    {
+        output_damage->damage_whole();
+        run_before_paint(&damage_whole_before_paint);
+    }
 
     impl(output_t *o) :
         output(o)
     {
         output_damage = std::make_unique<output_damage_t>(o);
         effects = std::make_unique<effect_hook_manager_t>();
+        overlays = std::make_unique<overlay_rect_manager_t>(output_damage.get());
         postprocessing = std::make_unique<postprocessing_manager_t>(o);
-        depth_buffer_manager = std::make_unique<depth_buffer_manager_t>();
         delay_manager = std::make_unique<repaint_delay_manager_t>(o);
+        profiler = std::make_unique<frame_profiler_t>();
+        cursor_backing = std::make_unique<cursor_backing_store_t>();
 
         on_frame.set_callback([&] (void*)
         {
+            if (output_damage->dormant)
+            {
+                return;
+            }
+
+            int cap_wait = get_frame_cap_wait();
+            if (cap_wait > 0)
+            {
+                /* Keep the damage and the frame callbacks until the cap
+                 * allows the next frame */
+                output->handle->frame_pending = true;
+                waiting_for_frame_cap = true;
+                delay_manager->skip_frame();
+                frame_cap_timer.set_timeout(cap_wait, [=] ()
+                {
+                    end_frame_cap_wait();
+
+                    return false;
+                });
+
+                return;
+            }
+
+            last_frame_start = wf::get_current_time();
+            update_bypass_view();
+            delay_manager->set_effect_set(get_effect_set());
+            delay_manager->set_immediate(use_adaptive_sync_scheduling());
             delay_manager->start_frame();
 
             auto repaint_delay = delay_manager->get_delay();
@@ -697,14 +2137,14 @@ class wf::render_manager::impl
             // https://github.com/swaywm/sway/pull/4588
             if (repaint_delay < 1)
             {
-                paint();
+                paint_after_input();
             } else
             {
                 output->handle->frame_pending = true;
                 repaint_timer.set_timeout(repaint_delay, [=] ()
                 {
                     output->handle->frame_pending = false;
-                    paint();
+                    paint_after_input();
                     return false;
                 });
             }
@@ -713,17 +2153,237 @@ class wf::render_manager::impl
         });
         on_frame.connect(&output_damage->damage_manager->events.frame);
 
+        on_present.set_callback([&] (void *data)
+        {
+            auto ev = static_cast<wlr_output_event_present*>(data);
+            profiler->frame_presented(*ev);
+            if (ev->presented && ev->when)
+            {
+                last_present_time =
+                    ev->when->tv_sec * 1'000'000'000ll + ev->when->tv_nsec;
+            }
+        });
+        on_present.connect(&output->handle->events.present);
+
         init_default_streams();
 
+        output->connect_signal("stack-order-changed", &on_stacking_changed);
+        output->connect_signal("view-layer-attached", &on_stacking_changed);
+        output->connect_signal("view-layer-detached", &on_stacking_changed);
+
+        max_render_fps.load_option(wf::get_core().config_backend->
+            get_output_section(output->handle)->get_name() + "/max_render_fps");
+        max_render_fps.set_callback([=] ()
+        {
+            end_frame_cap_wait();
+        });
+
         background_color_opt.load_option("core/background_color");
         background_color_opt.set_callback([=] ()
         {
-            output_damage->damage_whole_idle();
+            damage_whole_idle();
         });
 
         output_damage->schedule_repaint();
     }
 
+    ~impl()
+    {
+        if (wf::get_core_impl().input)
+        {
+            wf::get_core_impl().input->cancel_run_after_input(&resume_after_input);
+        }
+
+        if (bypass_view)
+        {
+            bypass_view->unref();
+        }
+    }
+
+    /** @return The lowest frame rate cap, or 0 if the frame rate isn't capped. */
+    int get_frame_rate_cap()
+    {
+        int cap = std::max(0, (int)max_render_fps);
+        for (auto& c : frame_rate_caps)
+        {
+            if ((c->max_fps > 0) && ((cap == 0) || (c->max_fps < cap)))
+            {
+                cap = c->max_fps;
+            }
+        }
+
+        return cap;
+    }
+
+    /**
+     * @return How many milliseconds the next frame has to wait because of the
+     *   frame rate cap, or 0 if it can start now.
+     */
+    int get_frame_cap_wait()
+    {
+        int cap = get_frame_rate_cap();
+        if (cap == 0)
+        {
+            return 0;
+        }
+
+        /* Frames start at vblank, so a frame which is up to half a refresh
+         * early is started, instead of waiting for the following vblank */
+        int refresh = (output->handle->refresh > 0) ?
+            1'000'000 / output->handle->refresh : 0;
+        int64_t since_last = uint32_t(wf::get_current_time() - last_frame_start);
+
+        return std::max<int64_t>(0, 1000 / cap - refresh / 2 - since_last);
+    }
+
+    /** Start the frame which waited for the frame rate cap, if any. */
+    void end_frame_cap_wait()
+    {
+        if (!waiting_for_frame_cap)
+        {
+            return;
+        }
+
+        frame_cap_timer.disconnect();
+        waiting_for_frame_cap = false;
+        output->handle->frame_pending = false;
+        wlr_output_schedule_frame(output->handle);
+    }
+
+    void add_frame_rate_cap(frame_rate_cap_t *cap)
+    {
+        if (std::find(frame_rate_caps.begin(), frame_rate_caps.end(), cap) ==
+            frame_rate_caps.end())
+        {
+            frame_rate_caps.push_back(cap);
+        }
+    }
+
+    void rem_frame_rate_cap(frame_rate_cap_t *cap)
+    {
+        auto it = std::find(frame_rate_caps.begin(), frame_rate_caps.end(), cap);
+        if (it != frame_rate_caps.end())
+        {
+            frame_rate_caps.erase(it);
+            end_frame_cap_wait();
+        }
+    }
+
+    /**
+     * @return Whether the output is repainted as soon as possible, instead of
+     *   at the point chosen by the repaint delay. This is done on adaptive sync
+     *   outputs while a fullscreen view is shown, so that the display refreshes
+     *   when the client commits a new buffer. The refresh rate is still limited
+     *   by the maximum of the output, because a new frame event only comes
+     *   after the previous frame has been shown.
+     */
+    bool use_adaptive_sync_scheduling()
+    {
+        bool immediate =
+            (output->handle->adaptive_sync_status ==
+                WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED) && !renderer &&
+            !output->workspace->get_promoted_views().empty();
+
+        if (immediate != delay_manager->is_immediate())
+        {
+            LOGC(RENDER, "Output ", output->to_string(),
+                ": adaptive sync scheduling ", immediate ? "enabled" : "disabled");
+        }
+
+        return immediate;
+    }
+
+    /**
+     * The fullscreen view which bypasses the compositor, see
+     * view_interface_t::should_bypass_compositor(). A reference is held, so
+     * that it is still valid as the previous view of the next signal.
+     */
+    wayfire_view bypass_view = nullptr;
+
+    void set_bypass_view(wayfire_view view)
+    {
+        if (view == bypass_view)
+        {
+            return;
+        }
+
+        if (view)
+        {
+            view->take_ref();
+        }
+
+        LOGC(RENDER, "Output ", output->to_string(), ": ",
+            view ? "view bypasses the compositor" : "compositor bypass ended");
+
+        wf::bypass_compositor_signal data;
+        data.view     = view;
+        data.previous = bypass_view;
+        bypass_view   = view;
+        output->render->emit_signal("bypass-compositor", &data);
+        if (data.previous)
+        {
+            data.previous->unref();
+        }
+    }
+
+    /**
+     * Check whether the view on top of the current workspace is fullscreen and
+     * bypasses the compositor. Done at the start of each frame, so that the
+     * plugins can drop their effects before the frame tries direct scanout.
+     */
+    void update_bypass_view()
+    {
+        wayfire_view found = nullptr;
+        if (!output->workspace->get_promoted_views().empty())
+        {
+            auto views = output->workspace->get_views_on_workspace(
+                output->workspace->get_current_workspace(), wf::VISIBLE_LAYERS);
+            if (!views.empty() && views.front()->is_mapped() &&
+                views.front()->fullscreen &&
+                views.front()->should_bypass_compositor())
+            {
+                found = views.front();
+            }
+        }
+
+        set_bypass_view(found);
+    }
+
+    /**
+     * @return An identifier of the active effect hooks, postprocessing hooks
+     *   and custom renderer, which changes when any of them changes.
+     */
+    uint64_t get_effect_set()
+    {
+        uint64_t result = 0;
+        auto mix = [&] (const void *ptr)
+        {
+            result ^= std::hash<const void*>{}(ptr) + 0x9e3779b97f4a7c15ull +
+                (result << 6) + (result >> 2);
+        };
+
+        for (int i = 0; i < OUTPUT_EFFECT_TOTAL; i++)
+        {
+            effects->effects[i].for_each([&] (effect_hook_t *hook)
+            {
+                mix(hook);
+            });
+        }
+
+        postprocessing->post_effects.for_each([&] (post_hook_t *hook)
+        {
+            mix(hook);
+        });
+        postprocessing->post_snippets.for_each([&] (post_snippet_t *snippet)
+        {
+            mix(snippet);
+        });
+
+        mix(renderer ? (const void*)renderer_serial : nullptr);
+
+        return result;
+    }
+
     /* A stream for each workspace */
     std::vector<std::vector<workspace_stream_t>> default_streams;
     /* The stream pointing to the current workspace */
@@ -745,10 +2405,13 @@ class wf::render_manager::impl
     }
 
     render_hook_t renderer;
+    /* Incremented each time the renderer changes */
+    uintptr_t renderer_serial = 0;
     void set_renderer(render_hook_t rh)
     {
         renderer = rh;
-        output_damage->damage_whole_idle();
+        ++renderer_serial;
+        damage_whole_idle();
     }
 
     int constant_redraw_counter = 0;
@@ -771,13 +2434,128 @@ class wf::render_manager::impl
         output_damage->schedule_repaint();
     }
 
+    /* See render_manager::set_magnified_viewport() */
+    wf::pointf_t viewport_origin = {0, 0};
+    double viewport_scale = 1;
+    bool viewport_moved   = false;
+    /* Scene damage outside of the viewport, in output pixels. It is composited
+     * once it becomes visible. */
+    wf::region_t hidden_damage;
+
+    bool has_viewport() const
+    {
+        return (viewport_scale > 1) && postprocessing->has_effects();
+    }
+
+    void set_magnified_viewport(wf::pointf_t origin, double scale)
+    {
+        if (scale <= 1)
+        {
+            if (viewport_scale > 1)
+            {
+                viewport_scale = 1;
+                hidden_damage.clear();
+                output_damage->damage_whole();
+            }
+
+            return;
+        }
+
+        if ((origin.x != viewport_origin.x) || (origin.y != viewport_origin.y) ||
+            (scale != viewport_scale))
+        {
+            viewport_origin = origin;
+            viewport_scale  = scale;
+            viewport_moved  = true;
+            output_damage->schedule_repaint();
+        }
+    }
+
+    /**
+     * @return The part of the output which is visible through the viewport, in
+     *   output pixels, with a margin for texture filtering.
+     */
+    wf::geometry_t get_viewport_source_box()
+    {
+        auto size = output->get_screen_size();
+        double s  = output->handle->scale;
+        double w  = size.width / viewport_scale;
+        double h  = size.height / viewport_scale;
+        int x1 = std::floor(viewport_origin.x * s) - 1;
+        int y1 = std::floor(viewport_origin.y * s) - 1;
+        int x2 = std::ceil((viewport_origin.x + w) * s) + 1;
+        int y2 = std::ceil((viewport_origin.y + h) * s) + 1;
+
+        return {x1, y1, x2 - x1, y2 - y1};
+    }
+
+    /**
+     * Composite only the damage inside the viewport. The rest is kept until
+     * the viewport moves over it.
+     */
+    void clip_damage_to_viewport()
+    {
+        auto& damage = output_damage->frame_damage;
+        damage |= hidden_damage;
+
+        auto source = get_viewport_source_box();
+        hidden_damage = damage ^ source;
+        damage &= source;
+    }
+
+    /**
+     * @return The output pixels which show the given scene damage, once it is
+     *   magnified, together with the pixels which are outdated in the current
+     *   output buffer.
+     */
+    wf::region_t map_damage_from_viewport(const wf::region_t& damage)
+    {
+        auto whole = output_damage->get_wlr_damage_box();
+        if (viewport_moved)
+        {
+            viewport_moved = false;
+
+            return whole;
+        }
+
+        double s = output->handle->scale;
+        wf::point_t offset = {
+            -(int)std::floor(viewport_origin.x * s),
+            -(int)std::floor(viewport_origin.y * s),
+        };
+
+        /* The margin covers rounding of the offset and texture filtering */
+        wf::region_t mapped = (damage + offset) * viewport_scale;
+        mapped.expand_edges(2 * (int)std::ceil(viewport_scale) + 1);
+        mapped |= output_damage->acc_damage;
+        mapped &= whole;
+
+        return mapped;
+    }
+
+    int frame_hold_counter = 0;
+    void add_frame_hold(bool add)
+    {
+        frame_hold_counter += add ? 1 : -1;
+        if (frame_hold_counter < 0)
+        {
+            LOGE("frame_hold_counter got below 0!");
+            frame_hold_counter = 0;
+        }
+
+        if (frame_hold_counter == 0)
+        {
+            output_damage->schedule_repaint();
+        }
+    }
+
     int output_inhibit_counter = 0;
     void add_inhibit(bool add)
     {
         output_inhibit_counter += add ? 1 : -1;
         if (output_inhibit_counter == 0)
         {
-            output_damage->damage_whole_idle();
+            damage_whole_idle();
 
             wf::output_start_rendering_signal data;
             data.output = output;
@@ -785,6 +2563,61 @@ class wf::render_manager::impl
         }
     }
 
+    void set_dormant(bool dormant)
+    {
+        if (output_damage->dormant == dormant)
+        {
+            return;
+        }
+
+        if (dormant)
+        {
+            /* Drop the frame in flight, and stop sending frame callbacks, so
+             * that clients shown only on this output stop drawing */
+            repaint_timer.disconnect();
+            input_yield_timer.disconnect();
+            if (wf::get_core_impl().input)
+            {
+                wf::get_core_impl().input->cancel_run_after_input(
+                    &resume_after_input);
+            }
+
+            frame_done_timer.disconnect();
+            frame_cap_timer.disconnect();
+            waiting_for_frame_cap = false;
+            output->handle->frame_pending = false;
+            output_damage->frame_damage.clear();
+            output_damage->dormant = true;
+
+            for (auto& v : output->workspace->get_views_in_layer(wf::ALL_LAYERS))
+            {
+                v->for_each_view([&] (wayfire_view view)
+                {
+                    if (view->get_visibility_state() !=
+                        wf::VIEW_VISIBILITY_OFF_WORKSPACE)
+                    {
+                        view->set_visibility_state(wf::VIEW_VISIBILITY_OCCLUDED);
+                    }
+                }, true);
+            }
+        } else
+        {
+            /* Nothing was tracked meanwhile, so the first frame is a full
+             * repaint. It also sends the frame callbacks again. */
+            output_damage->dormant = false;
+            output_damage->damage_whole();
+            output_damage->schedule_repaint();
+        }
+
+        LOGC(RENDER, "Output ", output->to_string(),
+            dormant ? ": dormant" : ": awake");
+        wf::output_dormant_changed_signal data;
+        data.output  = output;
+        data.dormant = dormant;
+        output->emit_signal("dormant-changed", &data);
+        wf::get_core().emit_signal("output-dormant-changed", &data);
+    }
+
     /* Actual rendering functions */
 
     /**
@@ -804,36 +2637,170 @@ class wf::render_manager::impl
      */
     void default_renderer()
     {
-        if (runtime_config.damage_debug)
+        if (runtime_config.damage_debug)
+        {
+            /* Clear the screen to yellow, so that the repainted parts are
+             * visible */
+            swap_damage |= output_damage->get_wlr_damage_box();
+
+            OpenGL::render_begin(output->handle->width, output->handle->height,
+                postprocessing->output_fb);
+            OpenGL::clear({1, 1, 0, 1});
+            OpenGL::render_end();
+        }
+
+        auto cws = output->workspace->get_current_workspace();
+        auto target_stream = &default_streams[cws.x][cws.y];
+        if (current_ws_stream.get() != target_stream)
+        {
+            if (current_ws_stream)
+            {
+                workspace_stream_stop(*current_ws_stream);
+            }
+
+            current_ws_stream = nonstd::make_observer(target_stream);
+            workspace_stream_start(*current_ws_stream);
+        } else
+        {
+            workspace_stream_update(*current_ws_stream);
+        }
+    }
+
+    /** @return Whether the surface is opaque and covers the whole output */
+    bool covers_output(const wf::surface_iterator_t& it)
+    {
+        auto size = it.surface->get_size();
+        wf::geometry_t box = {it.position.x, it.position.y, size.width,
+            size.height};
+        if (box != output->get_relative_geometry())
+        {
+            return false;
+        }
+
+        wf::region_t non_opaque = box;
+        non_opaque ^= it.surface->get_opaque_region(it.position);
+
+        return non_opaque.empty();
+    }
+
+    /**
+     * Find the topmost visible surface in the topmost view with visible
+     * surfaces. Views and surfaces which are unmapped, have no size or are
+     * outside of the output do not need composition, so they do not prevent
+     * scanout. Surfaces and views below the found surface are ignored if it
+     * covers the whole output and is opaque, because they are hidden then,
+     * like the background subsurface of a video player.
+     *
+     * @param view Set to the view containing the found surface.
+     * @return The found surface, or a null surface if other surfaces are
+     *   visible too or none at all.
+     */
+    wf::surface_iterator_t find_scanout_surface(
+        const std::vector<wayfire_view>& views, wayfire_view& view)
+    {
+        auto output_box = output->get_relative_geometry();
+        wf::surface_iterator_t found = {nullptr, {0, 0}};
+        for (auto& v : views)
+        {
+            if (!v->is_visible())
+            {
+                continue;
+            }
+
+            // Unmapped views are rendered from a snapshot, and transformed
+            // views may render anything, so both need composition.
+            if (!v->is_mapped() || v->has_transformer())
+            {
+                return {nullptr, {0, 0}};
+            }
+
+            auto obox = v->get_output_geometry();
+            bool multiple = false;
+            bool occludes = false;
+            v->for_each_surface([&] (const wf::surface_iterator_t& child)
+            {
+                auto size = child.surface->get_size();
+                wf::geometry_t box = {child.position.x, child.position.y,
+                    size.width, size.height};
+                if (!child.surface->is_mapped() ||
+                    (size.width <= 0) || (size.height <= 0) ||
+                    !(box & output_box) || occludes)
+                {
+                    return;
+                }
+
+                if (found.surface)
+                {
+                    multiple = true;
+                    return;
+                }
+
+                found    = child;
+                view     = v;
+                occludes = covers_output(child);
+            }, {obox.x, obox.y});
+
+            if (multiple)
+            {
+                return {nullptr, {0, 0}};
+            }
+
+            if (found.surface)
+            {
+                break;
+            }
+        }
+
+        return found;
+    }
+
+    /** @return Whether a visible cursor on the output is not on a hardware plane */
+    bool needs_software_cursor()
+    {
+        wlr_output_cursor *cursor;
+        wl_list_for_each(cursor, &output->handle->cursors, link)
+        {
+            if (cursor->enabled && cursor->visible &&
+                (output->handle->hardware_cursor != cursor))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    wayfire_view last_scanout;
+
+    /**
+     * @return Whether a screencopy client waits for a copy of the next frame
+     *   of the output. wlroots copies the frame from the buffer which was
+     *   rendered by the compositor, with a GPU blit for dmabufs, and only
+     *   the damage since the client's last copy is reported to clients which
+     *   copy with damage. A directly scanned out buffer is not rendered, so
+     *   the frame has to be composited while a copy is pending.
+     */
+    bool has_pending_screencopy()
+    {
+        auto manager = wf::get_core().protocols.screencopy;
+        if (!manager)
         {
-            /* Clear the screen to yellow, so that the repainted parts are
-             * visible */
-            swap_damage |= output_damage->get_wlr_damage_box();
-
-            OpenGL::render_begin(output->handle->width, output->handle->height,
-                postprocessing->output_fb);
-            OpenGL::clear({1, 1, 0, 1});
-            OpenGL::render_end();
+            return false;
         }
 
-        auto cws = output->workspace->get_current_workspace();
-        auto target_stream = &default_streams[cws.x][cws.y];
-        if (current_ws_stream.get() != target_stream)
+        wlr_screencopy_frame_v1 *frame;
+        wl_list_for_each(frame, &manager->frames, link)
         {
-            if (current_ws_stream)
+            if ((frame->output == output->handle) &&
+                (frame->shm_buffer || frame->dma_buffer))
             {
-                workspace_stream_stop(*current_ws_stream);
+                return true;
             }
-
-            current_ws_stream = nonstd::make_observer(target_stream);
-            workspace_stream_start(*current_ws_stream);
-        } else
-        {
-            workspace_stream_update(*current_ws_stream);
         }
+
+        return false;
     }
 
-    wayfire_view last_scanout;
     /**
      * Try to directly scanout a view
      */
@@ -841,9 +2808,11 @@ class wf::render_manager::impl
     {
         const bool can_scanout =
             !wf::get_core_impl().seat->drag_active &&
+            !has_pending_screencopy() &&
             !output_inhibit_counter &&
             !renderer &&
             effects->can_scanout() &&
+            overlays->rects.empty() &&
             postprocessing->can_scanout();
 
         if (!can_scanout)
@@ -854,40 +2823,37 @@ class wf::render_manager::impl
         auto views = output->workspace->get_views_on_workspace(
             output->workspace->get_current_workspace(), wf::VISIBLE_LAYERS);
 
-        if (views.empty())
+        wayfire_view candidate = nullptr;
+        auto scanout = find_scanout_surface(views, candidate);
+        if (!scanout.surface)
         {
             return false;
         }
 
-        auto candidate = views.front();
-
-        // The candidate must cover the whole output
-        if (candidate->get_output_geometry() != output->get_relative_geometry())
+        // The surface must be opaque and cover the whole output
+        if (!covers_output(scanout))
         {
             return false;
         }
 
-        // The view must have only a single surface and no transformers
-        if (candidate->has_transformer() ||
-            !candidate->priv->surface_children_above.empty() ||
-            !candidate->children.empty())
+        // The view must have no child views
+        if (!candidate->children.empty())
         {
             return false;
         }
 
         // Must have a wlr surface with the correct scale and transform
-        auto surface = candidate->get_wlr_surface();
-        if (!surface ||
+        auto surface = scanout.surface->get_wlr_surface();
+        if (!surface || !surface->buffer ||
             (surface->current.scale != output->handle->scale) ||
             (surface->current.transform != output->handle->transform))
         {
             return false;
         }
 
-        // Finally, the opaque region must be the full surface.
-        wf::region_t non_opaque = output->get_relative_geometry();
-        non_opaque ^= candidate->get_opaque_region(wf::point_t{0, 0});
-        if (!non_opaque.empty())
+        // A software cursor would not be drawn on the scanned out buffer, so
+        // the cursor must be hidden or use a hardware plane.
+        if (needs_software_cursor())
         {
             return false;
         }
@@ -901,14 +2867,14 @@ class wf::render_manager::impl
             if (candidate != last_scanout)
             {
                 last_scanout = candidate;
-                LOGD("Scanned out ",
+                LOGC(RENDER, "Scanned out ",
                     candidate->get_title(), ",", candidate->get_app_id());
             }
 
             return true;
         } else
         {
-            LOGD("Failed to scan out view ", candidate->get_title());
+            LOGC(RENDER, "Failed to scan out view ", candidate->get_title());
             return false;
         }
     }
@@ -926,6 +2892,26 @@ class wf::render_manager::impl
      * Render an output. Either calls the built-in renderer, or the render hook
      * of a plugin
      */
+    /**
+     * @return The part of the output buffer which render_output() and the
+     *   software cursors draw, when there are no postprocessing effects.
+     *   Custom renderers, overlay effects and the black image of inhibited
+     *   outputs may draw anywhere.
+     */
+    wf::region_t get_output_buffer_repaint()
+    {
+        if (renderer || output_inhibit_counter || runtime_config.damage_debug ||
+            (effects->effects[OUTPUT_EFFECT_OVERLAY].size() > 0))
+        {
+            return output_damage->get_wlr_damage_box();
+        }
+
+        wf::region_t repaint =
+            output_damage->get_scheduled_damage() * output->handle->scale;
+
+        return repaint & output_damage->get_wlr_damage_box();
+    }
+
     void render_output()
     {
         if (renderer)
@@ -939,6 +2925,87 @@ class wf::render_manager::impl
                 output_damage->get_scheduled_damage() * output->handle->scale;
             swap_damage &= output_damage->get_wlr_damage_box();
             default_renderer();
+            overlays->render(postprocessing->get_target_framebuffer(),
+                output_damage->get_scheduled_damage());
+        }
+    }
+
+    /**
+     * Every core/damage_check_interval frames, repaint the whole current
+     * workspace into a separate buffer, and compare it with the incrementally
+     * repainted frame. Any difference means that some change was not damaged,
+     * or that the damage was not repainted correctly.
+     */
+    void check_damage()
+    {
+        if ((damage_check_interval <= 0) || renderer || !current_ws_stream ||
+            runtime_config.damage_debug || output_inhibit_counter ||
+            has_viewport())
+        {
+            return;
+        }
+
+        if (++frames_since_damage_check < damage_check_interval)
+        {
+            return;
+        }
+
+        frames_since_damage_check = 0;
+        if (!damage_checker)
+        {
+            damage_checker = std::make_unique<damage_checker_t>();
+        }
+
+        auto& stream = *current_ws_stream;
+        auto target  = postprocessing->get_target_framebuffer();
+        auto& reference = damage_checker->get_reference(
+            target.viewport_width, target.viewport_height);
+
+        workspace_stream_repaint_t repaint;
+        repaint.ws_damage = output_damage->get_ws_box(stream.ws);
+        repaint.fb    = target;
+        repaint.fb.fb = reference.fb;
+        repaint.fb.tex = reference.tex;
+        repaint.ws_dx  = repaint.ws_dy = 0;
+        repaint.to_render = surface_pool.acquire_list();
+
+        ++stream_update_depth;
+        check_schedule_surfaces(repaint, stream);
+        clear_empty_areas(repaint, stream.background.a < 0 ?
+            (wf::color_t)background_color_opt : stream.background);
+        render_views(repaint);
+        unschedule_drag_icon();
+        surface_pool.release_list(std::move(repaint.to_render));
+        if (--stream_update_depth == 0)
+        {
+            surface_pool.reset();
+        }
+
+        overlays->render(repaint.fb, output->get_relative_geometry());
+
+        auto mismatch = damage_checker->compare(target);
+        if (mismatch.empty())
+        {
+            return;
+        }
+
+        LOGE("Damage check on ", output->to_string(), ": frame ",
+            profiler->current.frame_id, " differs from a full repaint in ",
+            wlr_box_from_pixman_box(mismatch.get_extents()),
+            " (framebuffer pixels)");
+        for (auto& v : get_render_views())
+        {
+            v->for_each_view([&] (wayfire_view view)
+            {
+                auto box = target.framebuffer_box_from_geometry_box(
+                    view->get_bounding_box());
+                if (view->is_visible() && !(mismatch & box).empty())
+                {
+                    LOGE("Damage check: the mismatch overlaps view \"",
+                        view->get_title(), "\" (", view->get_app_id(), ") at ",
+                        view->get_bounding_box());
+                }
+            });
         }
     }
 
@@ -950,8 +3017,13 @@ class wf::render_manager::impl
 
         postprocessing->set_output_framebuffer(current_fb);
         const auto& default_fb = postprocessing->get_target_framebuffer();
-        depth_buffer_manager->ensure_depth_buffer(
-            default_fb.fb, default_fb.viewport_width, default_fb.viewport_height);
+        /* If the backend doesn't have its own framebuffer, then the
+         * framebuffer is created with a depth buffer. */
+        if (default_fb.fb != 0)
+        {
+            OpenGL::attach_depth_buffer(default_fb.fb,
+                default_fb.viewport_width, default_fb.viewport_height);
+        }
 
         for (auto& row : this->default_streams)
         {
@@ -962,12 +3034,151 @@ class wf::render_manager::impl
         }
     }
 
+    /**
+     * @return Whether frames in which only software cursors moved may be
+     *   repainted from the cursor backing store. This needs the default
+     *   renderer without any effects drawing on top of the scene, and an
+     *   untransformed output.
+     */
+    bool can_repaint_cursors_only()
+    {
+        return !renderer && effects->can_scanout() &&
+               overlays->rects.empty() &&
+               !postprocessing->has_effects() && !constant_redraw_counter &&
+               !output_inhibit_counter && !runtime_config.damage_debug &&
+               (output->handle->transform == WL_OUTPUT_TRANSFORM_NORMAL) &&
+               !wl_list_empty(&output->handle->cursors);
+    }
+
+    /**
+     * Repaint the frame by restoring the pixels under the old software cursor
+     * positions and drawing the cursors again, if nothing else changed. The
+     * output must be current.
+     *
+     * @return Whether the frame was repainted.
+     */
+    bool repaint_cursors_only(int64_t repaint_start)
+    {
+        if (!can_repaint_cursors_only())
+        {
+            return false;
+        }
+
+        /* Everything which the buffer needs repainted must be under an old
+         * cursor, whose pixels are saved, or under a current cursor */
+        auto boxes = cursor_backing_store_t::get_cursor_boxes(output->handle);
+        auto repaint = cursor_backing->get_restorable_region(
+            output_damage->scene_serial);
+        if (repaint.empty())
+        {
+            return false;
+        }
+
+        for (auto& box : boxes)
+        {
+            repaint |= box;
+        }
+
+        if (!(output_damage->acc_damage ^ repaint).empty())
+        {
+            return false;
+        }
+
+        update_bound_output();
+        profiler->start_frame(delay_manager->get_delay(), repaint_start);
+        profiler->current.adaptive_sync = delay_manager->is_immediate();
+        profiler->current.cursor_only   = true;
+
+        output_damage->set_damage_region(repaint);
+        auto& target = postprocessing->get_target_framebuffer();
+        OpenGL::render_begin(target);
+        cursor_backing->restore(target);
+        cursor_backing->save(target, boxes, output_damage->scene_serial);
+        wlr_output_render_software_cursors(output->handle, repaint.to_pixman());
+        OpenGL::render_end();
+
+        emit_frame_ready(repaint);
+        profiler->end_frame(repaint, output->handle->commit_seq);
+        OpenGL::unbind_output(output);
+        profiler->commit_frame([&] ()
+        {
+            output_damage->swap_buffers(repaint);
+        });
+        delay_manager->finish_frame(frame_profiler_t::now() - repaint_start);
+        post_paint();
+
+        return true;
+    }
+
+    wf::option_wrapper_t<int> max_input_yield{"core/max_input_yield"};
+    wf::wl_timer input_yield_timer;
+    int64_t input_yield_start = 0;
+    uint64_t input_yield_serial = 0;
+
+    /**
+     * Repaint the output, unless input events are waiting to be read. Then
+     * the input is handled first, so that long repaints, of this or of other
+     * outputs, don't delay it, and the output is repainted right after it, or
+     * after core/max_input_yield milliseconds at the latest.
+     */
+    void paint_after_input()
+    {
+        auto& input = wf::get_core_impl().input;
+        if ((max_input_yield <= 0) || !input || !input->has_pending_input())
+        {
+            profiler->next_input_yield_time   = 0;
+            profiler->next_input_yield_events = 0;
+            paint();
+
+            return;
+        }
+
+        output->handle->frame_pending = true;
+        input_yield_start  = frame_profiler_t::now();
+        input_yield_serial = input->last_event_serial;
+        input->run_after_input(&resume_after_input);
+        input_yield_timer.set_timeout(max_input_yield, [=] ()
+        {
+            resume_after_input();
+
+            return false;
+        });
+    }
+
+    std::function<void()> resume_after_input = [=] ()
+    {
+        auto& input = wf::get_core_impl().input;
+        input->cancel_run_after_input(&resume_after_input);
+        input_yield_timer.disconnect();
+        output->handle->frame_pending = false;
+
+        profiler->next_input_yield_time =
+            frame_profiler_t::now() - input_yield_start;
+        profiler->next_input_yield_events =
+            input->last_event_serial - input_yield_serial;
+        paint();
+    };
+
     /**
      * Repaints the whole output, includes all effects and hooks
      */
     void paint()
     {
+        WF_TRACE_SCOPE("paint");
+        wf::stall_watchdog_t::get().heartbeat();
+        const int64_t repaint_start = frame_profiler_t::now();
+        /* Promotions and the like do not signal a stacking change */
+        render_views_dirty = true;
+        if (frame_hold_counter)
+        {
+            /* Keep the damage, it is drawn when the hold is released */
+            wlr_output_rollback(output->handle);
+            delay_manager->skip_frame();
+            return;
+        }
+
         /* Part 1: frame setup: query damage, etc. */
+        run_before_paint_callbacks();
         effects->run_effects(OUTPUT_EFFECT_PRE);
         effects->run_effects(OUTPUT_EFFECT_DAMAGE);
 
@@ -975,6 +3186,7 @@ class wf::render_manager::impl
         {
             // Yet another optimization: if we can directly scanout, we should
             // stop the rest of the repaint cycle.
+            cursor_backing->invalidate();
             return;
         } else
         {
@@ -999,31 +3211,94 @@ class wf::render_manager::impl
             return;
         }
 
+        if (repaint_cursors_only(repaint_start))
+        {
+            return;
+        }
+
         // Accumulate damage now, when we are sure we will render the frame.
         // Doing this earlier may mean that the damage from the previous frames
         // creeps into the current frame damage, if we had skipped a frame.
         output_damage->accumulate_damage();
+        if (has_viewport())
+        {
+            clip_damage_to_viewport();
+        }
+
+        /* Without postprocessing, the scene is drawn to the output buffer */
+        if (!postprocessing->has_effects())
+        {
+            output_damage->set_damage_region(get_output_buffer_repaint());
+        }
+
+        /* Damage which arrives during the repaint isn't drawn in this frame */
+        const uint64_t scene_serial = output_damage->scene_serial;
 
         update_bound_output();
+        profiler->start_frame(delay_manager->get_delay(), repaint_start);
+        profiler->current.predicted_render_time =
+            delay_manager->get_predicted_render_time();
+        profiler->current.adaptive_sync = delay_manager->is_immediate();
 
         /* Part 2: call the renderer, which sets swap_damage and
          * draws the scenegraph */
         render_output();
+        check_damage();
 
         /* Part 3: finalize the scene: overlay effects and sw cursors */
         effects->run_effects(OUTPUT_EFFECT_OVERLAY);
 
-        if (postprocessing->post_effects.size())
+        if (postprocessing->has_effects() && !has_viewport())
         {
-            swap_damage |= output_damage->get_wlr_damage_box();
+            int footprint = postprocessing->get_damage_footprint();
+            if (footprint < 0)
+            {
+                swap_damage |= output_damage->get_wlr_damage_box();
+            } else
+            {
+                if (footprint > 0)
+                {
+                    swap_damage.expand_edges(footprint);
+                }
+
+                postprocessing->add_local_box_damage(swap_damage);
+                swap_damage &= output_damage->get_wlr_damage_box();
+            }
         }
 
         OpenGL::render_begin(postprocessing->get_target_framebuffer());
+        if (can_repaint_cursors_only())
+        {
+            cursor_backing->save(postprocessing->get_target_framebuffer(),
+                cursor_backing_store_t::get_cursor_boxes(output->handle),
+                scene_serial);
+        } else
+        {
+            cursor_backing->invalidate();
+        }
+
         wlr_output_render_software_cursors(output->handle, swap_damage.to_pixman());
         OpenGL::render_end();
 
         /* Part 4: postprocessing effects */
-        postprocessing->run_post_effects();
+        if (has_viewport())
+        {
+            swap_damage = map_damage_from_viewport(swap_damage);
+        }
+
+        if (postprocessing->has_effects())
+        {
+            output_damage->set_damage_region(output_inhibit_counter ||
+                postprocessing->draws_whole_output() ?
+                output_damage->get_wlr_damage_box() : swap_damage);
+        }
+
+        {
+            frame_profiler_t::section_timer_t timer{
+                profiler->current.postprocessing_time};
+            postprocessing->run_post_effects(swap_damage);
+        }
+
         if (output_inhibit_counter)
         {
             OpenGL::render_begin(output->handle->width, output->handle->height,
@@ -1033,12 +3308,44 @@ class wf::render_manager::impl
         }
 
         /* Part 5: finalize frame: swap buffers, send frame_done, etc */
+        emit_frame_ready(swap_damage);
+        profiler->current.coalesced_damage_rects = output_damage->coalesced_rects;
+        output_damage->coalesced_rects = 0;
+        profiler->end_frame(swap_damage, output->handle->commit_seq);
+        postprocessing->discard_buffers();
         OpenGL::unbind_output(output);
-        output_damage->swap_buffers(swap_damage);
+        profiler->commit_frame([&] ()
+        {
+            output_damage->swap_buffers(swap_damage);
+        });
         swap_damage.clear();
+        delay_manager->finish_frame(frame_profiler_t::now() - repaint_start);
         post_paint();
     }
 
+    /**
+     * Emit frame-ready with the finished contents of the output framebuffer.
+     * The signal data is built only if somebody listens, because this happens
+     * every frame.
+     */
+    void emit_frame_ready(const wf::region_t& damage)
+    {
+        static const wf::signal_id_t frame_ready{"frame-ready"};
+        if (!output->render->has_listeners(frame_ready))
+        {
+            return;
+        }
+
+        wf::framebuffer_base_t fb;
+        fb.fb  = postprocessing->output_fb;
+        fb.tex = 0;
+        fb.viewport_width  = output->handle->width;
+        fb.viewport_height = output->handle->height;
+
+        frame_ready_signal data{fb, damage};
+        output->render->emit_signal(frame_ready, &data);
+    }
+
     /**
      * Execute post-paint actions.
      */
@@ -1053,61 +3360,232 @@ class wf::render_manager::impl
     }
 
     /**
-     * Send frame_done to clients.
+     * Update the visibility state of the views and send frame callbacks to
+     * the visible surfaces.
+     *
+     * When no custom renderer is active, views are visited from the top of the
+     * stack down, and each view is compared with the opaque regions of the
+     * views above it. Views which are fully hidden get their frame callbacks
+     * only core/occluded_frame_rate times per second, so that hidden clients
+     * don't keep rendering at the full refresh rate.
      */
-    void send_frame_done()
+    /**
+     * Clients which commit without damage, for ex. to pace themselves, only
+     * need a frame callback. Send it at about the time of the next vblank
+     * instead of repainting the output.
+     */
+    void schedule_frame_done()
     {
-        /* TODO: do this only if the view isn't fully occluded by another */
-        std::vector<wayfire_view> visible_views;
-        if (renderer)
-        {
-            visible_views = output->workspace->get_views_in_layer(
-                wf::VISIBLE_LAYERS);
-        } else
+        if (!output->handle->enabled || output_damage->dormant ||
+            output->handle->frame_pending ||
+            !output_damage->frame_damage.empty() || constant_redraw_counter ||
+            frame_done_timer.is_connected())
         {
-            visible_views = output->workspace->get_views_on_workspace(
-                output->workspace->get_current_workspace(),
-                wf::MIDDLE_LAYERS);
+            /* Either nothing is shown, or a frame which sends the frame
+             * callbacks is already coming */
+            return;
+        }
 
-            // send to all panels/backgrounds/etc
-            auto additional_views = output->workspace->get_views_in_layer(
-                wf::BELOW_LAYERS | wf::ABOVE_LAYERS);
+        timespec ts;
+        clock_gettime(
+            wlr_backend_get_presentation_clock(wf::get_core_impl().backend), &ts);
+        int64_t now     = ts.tv_sec * 1'000'000'000ll + ts.tv_nsec;
+        int64_t refresh = output->handle->refresh > 0 ?
+            1'000'000'000'000ll / output->handle->refresh : 16'666'667;
 
-            visible_views.insert(visible_views.end(),
-                additional_views.begin(), additional_views.end());
+        int64_t next_vblank = now + refresh;
+        if ((last_present_time > 0) && (last_present_time <= now))
+        {
+            next_vblank = last_present_time +
+                ((now - last_present_time) / refresh + 1) * refresh;
         }
 
+        int delay =
+            std::max<int64_t>(1, (next_vblank - now + 999'999) / 1'000'000);
+        frame_done_timer.set_timeout(delay, [=] ()
+        {
+            /* If damage arrived meanwhile, the repaint sends them */
+            if (output_damage->frame_damage.empty())
+            {
+                send_frame_done();
+            }
+
+            return false;
+        });
+    }
+
+    void send_frame_done()
+    {
         timespec repaint_ended;
         clockid_t presentation_clock =
             wlr_backend_get_presentation_clock(wf::get_core_impl().backend);
         clock_gettime(presentation_clock, &repaint_ended);
-        for (auto& v : visible_views)
+
+        auto send_to_view = [&] (wayfire_view view)
+        {
+            view->for_each_surface([&] (const wf::surface_iterator_t& child)
+            {
+                child.surface->send_frame_done(repaint_ended);
+            });
+        };
+
+        for (auto& v : output->workspace->get_views_in_layer(wf::LAYER_MINIMIZED))
+        {
+            v->set_visibility_state(wf::VIEW_VISIBILITY_OFF_WORKSPACE);
+        }
+
+        auto views = output->workspace->get_views_in_layer(wf::VISIBLE_LAYERS);
+        if (renderer)
         {
-            for (auto& view : v->enumerate_views())
+            /* The renderer may show any workspace, in any way */
+            for (auto& v : views)
             {
-                if (!view->is_mapped())
+                v->for_each_view([&] (wayfire_view view)
                 {
-                    continue;
+                    view->set_visibility_state(wf::VIEW_VISIBILITY_VISIBLE);
+                    send_to_view(view);
+                }, true);
+            }
+
+            return;
+        }
+
+        /* Occluded views are sent a frame callback every 1000/rate ms */
+        bool send_occluded = true;
+        int rate = occluded_frame_rate;
+        if (rate > 0)
+        {
+            uint32_t now = wf::get_current_time();
+            send_occluded = (now - last_occluded_frame_done >= 1000u / rate);
+            if (send_occluded)
+            {
+                last_occluded_frame_done = now;
+            }
+        }
+
+        auto cws = output->workspace->get_current_workspace();
+        auto output_box = output->get_relative_geometry();
+        wf::region_t covered;
+        for (auto& v : views)
+        {
+            if ((output->workspace->get_view_layer(v) & wf::MIDDLE_LAYERS) &&
+                !output->workspace->view_visible_on(v, cws))
+            {
+                v->for_each_view([&] (wayfire_view view)
+                {
+                    view->set_visibility_state(wf::VIEW_VISIBILITY_OFF_WORKSPACE);
+                }, true);
+
+                continue;
+            }
+
+            v->for_each_view([&] (wayfire_view view)
+            {
+                wf::region_t full{view->get_bounding_box()};
+                wf::region_t shown = full & output_box;
+                shown ^= covered;
+
+                auto state = wf::VIEW_VISIBILITY_OCCLUDED;
+                if (!shown.empty())
+                {
+                    state = (full ^ shown).empty() ?
+                        wf::VIEW_VISIBILITY_VISIBLE : wf::VIEW_VISIBILITY_PARTIAL;
                 }
 
-                for (auto& child : view->enumerate_surfaces())
+                if (view->is_visible())
                 {
-                    child.surface->send_frame_done(repaint_ended);
+                    covered |= view->get_transformed_opaque_region();
                 }
-            }
+
+                view->set_visibility_state(state);
+                if ((state != wf::VIEW_VISIBILITY_OCCLUDED) || send_occluded)
+                {
+                    send_to_view(view);
+                }
+            }, true);
+        }
+    }
+
+    /* Workspace stream implementation */
+    void workspace_stream_start(workspace_stream_t& stream)
+    {
+        stream.running = true;
+
+        /* If nothing on the workspace changed since the stream was stopped,
+         * its buffer can be reused as it is. Otherwise, damage the whole
+         * workspace region, so that we get a full repaint when updating the
+         * workspace */
+        if (!is_stream_up_to_date(stream))
+        {
+            stream.rendered_serial = 0;
+            output_damage->damage(output_damage->get_ws_box(stream.ws));
+        }
+
+        /* Keep the level of detail the stream was last used with, so that a
+         * restarted scaled stream does not get repainted at full size first */
+        workspace_stream_update(stream, stream.scale_x, stream.scale_y);
+    }
+
+    /** The lowest level of detail a workspace stream is rendered at */
+    static constexpr float MIN_STREAM_SCALE = 1.0 / 8;
+
+    /**
+     * Convert the scale requested for a stream to the level of detail it is
+     * rendered at. Levels are powers of two, so that consumers which animate
+     * their scale (e.g. zooming out in expo) do not repaint the whole stream
+     * on every frame.
+     */
+    static float get_stream_lod_scale(float scale_x, float scale_y)
+    {
+        float scale = std::max(scale_x, scale_y);
+        float lod   = 1.0;
+        while ((lod > MIN_STREAM_SCALE) && (lod / 2 >= scale))
+        {
+            lod /= 2;
         }
+
+        return lod;
+    }
+
+    /** Get the size of the stream buffer at the stream's current scale */
+    wf::dimensions_t get_stream_buffer_size(const workspace_stream_t& stream)
+    {
+        return {
+            std::max(1, (int)std::ceil(output->handle->width * stream.scale_x)),
+            std::max(1, (int)std::ceil(output->handle->height * stream.scale_y)),
+        };
     }
 
-    /* Workspace stream implementation */
-    void workspace_stream_start(workspace_stream_t& stream)
+    /**
+     * Check whether the contents of the stream's own buffer still match the
+     * workspace, i.e. whether no damage has touched the workspace since the
+     * stream was last rendered. Streams which render directly to the output
+     * framebuffer are never up to date, since the output buffers are swapped.
+     */
+    bool is_stream_up_to_date(const workspace_stream_t& stream)
     {
-        stream.running = true;
-        stream.scale_x = stream.scale_y = 1;
+        if ((stream.buffer.tex == 0) || (stream.buffer.tex == (uint32_t)-1) ||
+            (stream.buffer.fb == (uint32_t)-1))
+        {
+            return false;
+        }
+
+        auto size = get_stream_buffer_size(stream);
+        if ((stream.buffer.viewport_width != size.width) ||
+            (stream.buffer.viewport_height != size.height))
+        {
+            return false;
+        }
+
+        if (runtime_config.no_damage_track ||
+            (stream.rendered_ws != stream.ws) ||
+            (stream.rendered_background != stream.background))
+        {
+            return false;
+        }
 
-        /* damage the whole workspace region, so that we get a full repaint
-         * when updating the workspace */
-        output_damage->damage(output_damage->get_ws_box(stream.ws));
-        workspace_stream_update(stream, 1, 1);
+        return (stream.rendered_serial != 0) &&
+               (stream.rendered_serial == output_damage->get_ws_serial(stream.ws));
     }
 
     /**
@@ -1117,6 +3595,8 @@ class wf::render_manager::impl
     {
         wf::surface_interface_t *surface = nullptr;
         wf::view_interface_t *view = nullptr;
+        /* Drawn from the background cache, at pos */
+        bool background = false;
 
         /* For views, this is the delta in framebuffer coordinates.
          * For surfaces, this is the coordinates of the surface inside the
@@ -1125,7 +3605,72 @@ class wf::render_manager::impl
         wf::region_t damage;
     };
 
-    using damaged_surface = std::unique_ptr<damaged_surface_t>;
+    /**
+     * Storage for the damaged surfaces of the repaint lists. Entries are reused
+     * between frames, so that building the repaint lists does not allocate
+     * memory in steady state.
+     *
+     * The pool is reset after each (top-level) workspace stream update.
+     */
+    struct damaged_surface_pool_t
+    {
+        /* A deque keeps references stable when growing */
+        std::deque<damaged_surface_t> surfaces;
+        size_t used = 0;
+
+        /* Vectors for the repaint lists, with their capacity preserved */
+        std::vector<std::vector<damaged_surface_t*>> free_lists;
+
+        damaged_surface_t& acquire()
+        {
+            if (used == surfaces.size())
+            {
+                surfaces.emplace_back();
+            }
+
+            auto& ds = surfaces[used++];
+            ds.surface    = nullptr;
+            ds.view       = nullptr;
+            ds.background = false;
+            ds.pos = {0, 0};
+
+            return ds;
+        }
+
+        /** Return the last acquired entry to the pool */
+        void release_last()
+        {
+            --used;
+        }
+
+        std::vector<damaged_surface_t*> acquire_list()
+        {
+            if (free_lists.empty())
+            {
+                return {};
+            }
+
+            auto list = std::move(free_lists.back());
+            free_lists.pop_back();
+
+            return list;
+        }
+
+        void release_list(std::vector<damaged_surface_t*>&& list)
+        {
+            list.clear();
+            free_lists.push_back(std::move(list));
+        }
+
+        void reset()
+        {
+            used = 0;
+        }
+    };
+
+    damaged_surface_pool_t surface_pool;
+    /* How many workspace stream updates are currently running */
+    int stream_update_depth = 0;
 
     /**
      * Represents the state while calculating what parts of the output
@@ -1133,7 +3678,7 @@ class wf::render_manager::impl
      */
     struct workspace_stream_repaint_t
     {
-        std::vector<damaged_surface> to_render;
+        std::vector<damaged_surface_t*> to_render;
         wf::region_t ws_damage;
         wf::framebuffer_t fb;
 
@@ -1150,18 +3695,22 @@ class wf::render_manager::impl
     void schedule_snapshotted_view(workspace_stream_repaint_t& repaint,
         wayfire_view view, wf::point_t view_delta)
     {
-        auto ds = damaged_surface(new damaged_surface_t);
-
         auto bbox = view->get_bounding_box() + view_delta;
-        ds->damage = (repaint.ws_damage & bbox) + -view_delta;
-        if (!ds->damage.empty())
+        auto& ds  = surface_pool.acquire();
+        ds.damage = repaint.ws_damage;
+        ds.damage &= bbox;
+        if (ds.damage.empty())
         {
-            ds->pos  = -view_delta;
-            ds->view = view.get();
-            repaint.ws_damage ^=
-                view->get_transformed_opaque_region() + view_delta;
-            repaint.to_render.push_back(std::move(ds));
+            surface_pool.release_last();
+            return;
         }
+
+        ds.damage += -view_delta;
+        ds.pos     = -view_delta;
+        ds.view    = view.get();
+        repaint.ws_damage.subtract_translated(
+            view->get_transformed_opaque_region(), view_delta);
+        repaint.to_render.push_back(&ds);
     }
 
     /**
@@ -1181,7 +3730,6 @@ class wf::render_manager::impl
             return;
         }
 
-        auto ds = damaged_surface(new damaged_surface_t);
         wlr_box obox = {
             .x     = pos.x,
             .y     = pos.y,
@@ -1189,16 +3737,49 @@ class wf::render_manager::impl
             .height = surface->get_size().height
         };
 
-        ds->damage = repaint.ws_damage & obox;
-        if (!ds->damage.empty())
+        auto& ds = surface_pool.acquire();
+        ds.damage = repaint.ws_damage;
+        ds.damage &= obox;
+        if (ds.damage.empty())
+        {
+            surface_pool.release_last();
+            return;
+        }
+
+        ds.pos     = pos;
+        ds.surface = surface;
+
+        /* Subtract opaque region from workspace damage. The views below
+         * won't be visible, so no need to damage them */
+        repaint.ws_damage ^= ds.surface->get_opaque_region(pos);
+        repaint.to_render.push_back(&ds);
+    }
+
+    /**
+     * Schedule the surfaces of a view, skipping the subsurface trees which are
+     * outside of the remaining damage.
+     */
+    void schedule_view_surfaces(workspace_stream_repaint_t& repaint,
+        wayfire_view view, wf::point_t origin)
+    {
+        auto& surfaces = view->view_impl->get_cached_surfaces(view.get());
+        size_t i = 0;
+        while ((i < surfaces.size()) && !repaint.ws_damage.empty())
         {
-            ds->pos     = pos;
-            ds->surface = surface;
+            auto& entry = surfaces[i];
+            if (entry.subtree_end)
+            {
+                auto box = pixman_box_from_wlr_box(entry.subtree_box + origin);
+                if (pixman_region32_contains_rectangle(
+                    repaint.ws_damage.to_pixman(), &box) == PIXMAN_REGION_OUT)
+                {
+                    i = entry.subtree_end;
+                    continue;
+                }
+            }
 
-            /* Subtract opaque region from workspace damage. The views below
-             * won't be visible, so no need to damage them */
-            repaint.ws_damage ^= ds->surface->get_opaque_region(pos);
-            repaint.to_render.push_back(std::move(ds));
+            schedule_surface(repaint, entry.surface, entry.position + origin);
+            ++i;
         }
     }
 
@@ -1221,10 +3802,10 @@ class wf::render_manager::impl
         offset.x -= og.x;
         offset.y -= og.y;
 
-        for (auto& child : drag_icon->enumerate_surfaces(offset))
+        drag_icon->for_each_surface([&] (const auto& child)
         {
             schedule_surface(repaint, child.surface, child.position);
-        }
+        }, offset);
     }
 
     /**
@@ -1239,25 +3820,196 @@ class wf::render_manager::impl
         }
     }
 
+    const std::vector<wayfire_view>& get_render_views()
+    {
+        if (render_views_dirty)
+        {
+            render_views_list =
+                output->workspace->get_views_in_layer(wf::VISIBLE_LAYERS);
+            background_views_list =
+                output->workspace->get_views_in_layer(wf::LAYER_BACKGROUND);
+            render_views_dirty = false;
+        }
+
+        return render_views_list;
+    }
+
+    /**
+     * Check whether the background views can be drawn from the cache, and
+     * render them into it if needed. Views whose contents change are drawn
+     * directly, until they have stayed the same between two checks.
+     *
+     * @return Whether the background is drawn from the cache.
+     */
+    bool prepare_background_cache()
+    {
+        auto& cache = background_cache;
+        auto& next  = cache.next_contents;
+        next.clear();
+        for (auto& view : background_views_list)
+        {
+            /* The cache is drawn at the same place on all workspaces, without
+             * transformers or child views */
+            if (!view->sticky || !view->is_mapped() || view->has_transformer() ||
+                !view->children.empty())
+            {
+                cache.contents.clear();
+                cache.valid = false;
+
+                return false;
+            }
+
+            if (view->is_visible())
+            {
+                next.push_back({view.get(), view->view_impl->contents_serial,
+                    view->get_output_geometry()});
+            }
+        }
+
+        auto geometry = output->get_relative_geometry();
+        float scale   = output->handle->scale;
+        if ((next != cache.contents) || (geometry != cache.geometry) ||
+            (scale != cache.scale))
+        {
+            std::swap(cache.contents, next);
+            cache.geometry = geometry;
+            cache.scale    = scale;
+            cache.valid    = false;
+
+            return false;
+        }
+
+        if (!cache.valid && !cache.contents.empty())
+        {
+            render_background_cache();
+        }
+
+        return cache.valid;
+    }
+
+    /** Render the visible background views into the background cache */
+    void render_background_cache()
+    {
+        WF_TRACE_SCOPE("background cache");
+        auto& cache = background_cache;
+        int width   = std::ceil(cache.geometry.width * cache.scale);
+        int height  = std::ceil(cache.geometry.height * cache.scale);
+        width  = std::max(1, width);
+        height = std::max(1, height);
+
+        OpenGL::render_begin();
+        if (cache.buffer.allocate(width, height))
+        {
+            wf::gpu_memory::set_owner(&cache.buffer, "background cache");
+        }
+
+        cache.buffer.bind();
+        OpenGL::clear({0, 0, 0, 0});
+        OpenGL::render_end();
+
+        workspace_stream_repaint_t repaint;
+        repaint.fb.fb  = cache.buffer.fb;
+        repaint.fb.tex = cache.buffer.tex;
+        repaint.fb.viewport_width  = width;
+        repaint.fb.viewport_height = height;
+        repaint.fb.geometry = cache.geometry;
+        repaint.fb.scale    = cache.scale;
+        repaint.ws_damage  |= cache.geometry;
+        repaint.ws_dx = repaint.ws_dy = 0;
+
+        repaint.to_render = surface_pool.acquire_list();
+        for (auto& view : background_views_list)
+        {
+            if (view->is_visible())
+            {
+                auto origin = view->get_output_geometry();
+                schedule_view_surfaces(repaint, view, {origin.x, origin.y});
+            }
+        }
+
+        /* What is left of the damage could be seen through */
+        cache.opaque.clear();
+        cache.opaque |= cache.geometry;
+        cache.opaque ^= repaint.ws_damage;
+
+        render_views(repaint);
+        surface_pool.release_list(std::move(repaint.to_render));
+        cache.valid = true;
+    }
+
+    /** Add the background cache to the bottom of the repaint list */
+    void schedule_background_cache(workspace_stream_repaint_t& repaint)
+    {
+        wf::point_t pos = {repaint.ws_dx, repaint.ws_dy};
+        auto& ds = surface_pool.acquire();
+        ds.damage = repaint.ws_damage;
+        ds.damage &= background_cache.geometry + pos;
+        if (ds.damage.empty())
+        {
+            surface_pool.release_last();
+            return;
+        }
+
+        ds.pos = pos;
+        ds.background = true;
+        repaint.ws_damage.subtract_translated(background_cache.opaque, pos);
+        repaint.to_render.push_back(&ds);
+    }
+
     /**
      * Iterate all visible surfaces on the workspace, and check whether
      * they need repaint.
+     *
+     * Note that this has to run on the main thread, like the rest of the
+     * frame preparation: it calls into views and surfaces, whose state (and
+     * the underlying wlroots objects) may only be accessed from the event
+     * loop, and it may emit signals which plugins handle synchronously.
      */
     void check_schedule_surfaces(workspace_stream_repaint_t& repaint,
         workspace_stream_t& stream)
     {
-        auto views = output->workspace->get_views_on_workspace(stream.ws,
-            wf::VISIBLE_LAYERS);
-
         schedule_drag_icon(repaint);
-        for (auto& v : views)
+        auto& views = get_render_views();
+
+        /* The background views are at the bottom of the list */
+        size_t background_start = views.size();
+        if (!background_views_list.empty() && prepare_background_cache())
+        {
+            background_start = views.size() - background_views_list.size();
+        }
+
+        for (size_t i = 0; i < views.size(); i++)
         {
-            for (auto& view : v->enumerate_views(false))
+            auto& v = views[i];
+            /* Everything below is hidden by the views above */
+            if (repaint.ws_damage.empty())
+            {
+                return;
+            }
+
+            if (i == background_start)
+            {
+                schedule_background_cache(repaint);
+
+                return;
+            }
+
+            if (!output->workspace->view_visible_on(v, stream.ws))
+            {
+                continue;
+            }
+
+            v->for_each_view([&] (wayfire_view view)
             {
+                if (repaint.ws_damage.empty())
+                {
+                    return;
+                }
+
                 wf::point_t view_delta{0, 0};
-                if (!view->is_visible() || repaint.ws_damage.empty())
+                if (!view->is_visible())
                 {
-                    continue;
+                    return;
                 }
 
                 if (view->sticky)
@@ -1265,6 +4017,16 @@ class wf::render_manager::impl
                     view_delta = {repaint.ws_dx, repaint.ws_dy};
                 }
 
+                /* Skip views outside of the remaining damage before going
+                 * through their surfaces */
+                auto bbox = pixman_box_from_wlr_box(
+                    view->get_bounding_box() + view_delta);
+                if (pixman_region32_contains_rectangle(
+                    repaint.ws_damage.to_pixman(), &bbox) == PIXMAN_REGION_OUT)
+                {
+                    return;
+                }
+
                 /* We use the snapshot of a view on either of the following
                  * conditions:
                  *
@@ -1282,12 +4044,9 @@ class wf::render_manager::impl
                     /* Make sure view position is relative to the workspace
                      * being rendered */
                     auto obox = view->get_output_geometry() + view_delta;
-                    for (auto& child : view->enumerate_surfaces({obox.x, obox.y}))
-                    {
-                        schedule_surface(repaint, child.surface, child.position);
-                    }
+                    schedule_view_surfaces(repaint, view, {obox.x, obox.y});
                 }
-            }
+            }, false);
         }
     }
 
@@ -1300,31 +4059,41 @@ class wf::render_manager::impl
         workspace_stream_repaint_t repaint;
         repaint.ws_damage = output_damage->get_ws_damage(stream.ws);
 
+        /* Streams which render directly to the output cannot be scaled */
+        float lod = get_stream_lod_scale(scale_x, scale_y);
+        if ((stream.buffer.tex != 0) &&
+            ((lod != stream.scale_x) || (lod != stream.scale_y)))
+        {
+            /* The buffer is reallocated, so everything needs to be repainted */
+            stream.scale_x = stream.scale_y = lod;
+            repaint.ws_damage |= output_damage->get_ws_box(stream.ws);
+        }
+
         /* we don't have to update anything */
         if (repaint.ws_damage.empty())
         {
             return repaint;
         }
 
-        if ((scale_x != stream.scale_x) || (scale_y != stream.scale_y))
+        auto size = get_stream_buffer_size(stream);
+        OpenGL::render_begin();
+        if (stream.buffer.allocate(size.width, size.height))
         {
-            /* FIXME: enable scaled rendering */
-            // stream->scale_x = scale_x;
-            // stream->scale_y = scale_y;
-
-            // ws_damage |= get_damage_box();
+            wf::gpu_memory::set_owner(&stream.buffer, "workspace stream");
         }
 
-        OpenGL::render_begin();
-        stream.buffer.allocate(output->handle->width, output->handle->height);
         OpenGL::render_end();
 
         repaint.fb = postprocessing->get_target_framebuffer();
         if ((stream.buffer.tex != 0))
         {
-            /* Use the workspace buffers */
+            /* Use the workspace buffers. Views are rendered with the stream's
+             * level of detail applied on top of the output scale. */
             repaint.fb.fb  = stream.buffer.fb;
             repaint.fb.tex = stream.buffer.tex;
+            repaint.fb.viewport_width  = size.width;
+            repaint.fb.viewport_height = size.height;
+            repaint.fb.scale *= stream.scale_x;
         }
 
         auto g   = output->get_relative_geometry();
@@ -1360,20 +4129,68 @@ class wf::render_manager::impl
         }
     }
 
+    /* The surfaces which are drawn from the atlas together, reused */
+    std::vector<wf::surface_atlas_t::draw_t> atlas_draws;
+
+    /**
+     * Collect the surfaces from index i down which can be drawn from the
+     * atlas, and draw them together.
+     *
+     * @return The index of the last drawn surface.
+     */
+    size_t render_atlas_surfaces(workspace_stream_repaint_t& repaint, size_t i)
+    {
+        auto& atlas = wf::surface_atlas_t::get();
+        atlas_draws.clear();
+        for (; i != (size_t)-1; i--)
+        {
+            auto ds   = repaint.to_render[i];
+            auto slot = ds->view ? nullptr : atlas.find(ds->surface, repaint.fb);
+            if (!slot)
+            {
+                break;
+            }
+
+            auto size = ds->surface->get_size();
+            atlas_draws.push_back({slot,
+                {ds->pos.x, ds->pos.y, size.width, size.height}, &ds->damage});
+            send_sampled_on_output(ds->surface);
+        }
+
+        atlas.render(repaint.fb, atlas_draws);
+
+        return i + 1;
+    }
+
     void render_views(workspace_stream_repaint_t& repaint)
     {
         wf::geometry_t fb_geometry = repaint.fb.geometry;
+        auto& atlas = wf::surface_atlas_t::get();
 
-        for (auto& ds : wf::reverse(repaint.to_render))
+        /* From the bottom-most surface to the topmost one */
+        for (size_t i = repaint.to_render.size(); i-- > 0;)
         {
-            if (ds->view)
+            auto ds = repaint.to_render[i];
+            if (ds->background)
+            {
+                repaint.fb.geometry = fb_geometry;
+                OpenGL::render_begin(repaint.fb);
+                OpenGL::render_texture_damage(
+                    wf::texture_t{background_cache.buffer.tex}, repaint.fb,
+                    background_cache.geometry + ds->pos, ds->damage);
+                OpenGL::render_end();
+            } else if (!ds->view && atlas.find(ds->surface, repaint.fb))
+            {
+                repaint.fb.geometry = fb_geometry;
+                i = render_atlas_surfaces(repaint, i);
+            } else if (ds->view)
             {
                 repaint.fb.geometry = fb_geometry + ds->pos;
                 ds->view->render_transformed(repaint.fb, ds->damage);
-                for (auto& child : ds->view->enumerate_surfaces({0, 0}))
+                ds->view->for_each_surface([&] (const auto& child)
                 {
                     send_sampled_on_output(child.surface);
-                }
+                });
             } else
             {
                 repaint.fb.geometry = fb_geometry;
@@ -1390,6 +4207,33 @@ class wf::render_manager::impl
     void workspace_stream_update(workspace_stream_t& stream,
         float scale_x = 1, float scale_y = 1)
     {
+        WF_TRACE_SCOPE("workspace_stream_update");
+        ++stream_update_depth;
+        repaint_stream(stream, scale_x, scale_y);
+        if (--stream_update_depth == 0)
+        {
+            surface_pool.reset();
+        }
+    }
+
+    void repaint_stream(workspace_stream_t& stream,
+        float scale_x, float scale_y)
+    {
+        /* Several plugins may update the same stream in a single frame, or
+         * the frame damage may only come from the output's buffer age. Either
+         * way, there is nothing new to draw in the stream's buffer. */
+        float lod = get_stream_lod_scale(scale_x, scale_y);
+        if ((lod == stream.scale_x) && (lod == stream.scale_y) &&
+            is_stream_up_to_date(stream))
+        {
+            return;
+        }
+
+        /* Damage which arrives during the repaint bumps the serial again */
+        stream.rendered_ws         = stream.ws;
+        stream.rendered_serial     = output_damage->get_ws_serial(stream.ws);
+        stream.rendered_background = stream.background;
+
         workspace_stream_repaint_t repaint =
             calculate_repaint_for_stream(stream, scale_x, scale_y);
 
@@ -1398,28 +4242,46 @@ class wf::render_manager::impl
             return;
         }
 
+        repaint.to_render = surface_pool.acquire_list();
+
         {
             stream_signal_t data(stream.ws, repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-pre", &data);
+            static const wf::signal_id_t stream_pre{"workspace-stream-pre"};
+            output->render->emit_signal(stream_pre, &data);
         }
 
-        check_schedule_surfaces(repaint, stream);
-
-        if (stream.background.a < 0)
         {
-            clear_empty_areas(repaint, background_color_opt);
-        } else
+            frame_profiler_t::section_timer_t timer{
+                profiler->current.schedule_surfaces_time};
+            check_schedule_surfaces(repaint, stream);
+        }
+
         {
-            clear_empty_areas(repaint, stream.background);
+            frame_profiler_t::section_timer_t timer{
+                profiler->current.clear_empty_areas_time};
+            if (stream.background.a < 0)
+            {
+                clear_empty_areas(repaint, background_color_opt);
+            } else
+            {
+                clear_empty_areas(repaint, stream.background);
+            }
         }
 
-        render_views(repaint);
+        {
+            frame_profiler_t::section_timer_t timer{
+                profiler->current.render_views_time};
+            render_views(repaint);
+        }
 
         unschedule_drag_icon();
         {
             stream_signal_t data(stream.ws, repaint.ws_damage, repaint.fb);
-            output->render->emit_signal("workspace-stream-post", &data);
+            static const wf::signal_id_t stream_post{"workspace-stream-post"};
+            output->render->emit_signal(stream_post, &data);
         }
+
+        surface_pool.release_list(std::move(repaint.to_render));
     }
 
     void workspace_stream_stop(workspace_stream_t& stream)
@@ -1442,6 +4304,21 @@ void render_manager::set_redraw_always(bool always)
     pimpl->set_redraw_always(always);
 }
 
+void render_manager::set_magnified_viewport(wf::pointf_t origin, double scale)
+{
+    pimpl->set_magnified_viewport(origin, scale);
+}
+
+wayfire_view render_manager::get_bypass_compositor_view()
+{
+    return pimpl->bypass_view;
+}
+
+bool render_manager::is_scanned_out(wayfire_view view)
+{
+    return view && (view == pimpl->last_scanout);
+}
+
 wf::region_t render_manager::get_swap_damage()
 {
     return pimpl->get_swap_damage();
@@ -1452,11 +4329,41 @@ void render_manager::schedule_redraw()
     pimpl->output_damage->schedule_repaint();
 }
 
+void render_manager::schedule_frame_done()
+{
+    pimpl->schedule_frame_done();
+}
+
 void render_manager::add_inhibit(bool add)
 {
     pimpl->add_inhibit(add);
 }
 
+void render_manager::set_dormant(bool dormant)
+{
+    pimpl->set_dormant(dormant);
+}
+
+bool render_manager::is_dormant() const
+{
+    return pimpl->output_damage->dormant;
+}
+
+void render_manager::add_frame_hold(bool add)
+{
+    pimpl->add_frame_hold(add);
+}
+
+void render_manager::add_frame_rate_cap(frame_rate_cap_t *cap)
+{
+    pimpl->add_frame_rate_cap(cap);
+}
+
+void render_manager::rem_frame_rate_cap(frame_rate_cap_t *cap)
+{
+    pimpl->rem_frame_rate_cap(cap);
+}
+
 void render_manager::add_effect(effect_hook_t *hook, output_effect_type_t type)
 {
     pimpl->effects->add_effect(hook, type);
@@ -1477,11 +4384,49 @@ void render_manager::rem_post(post_hook_t *hook)
     pimpl->postprocessing->rem_post(hook);
 }
 
+void render_manager::add_post_snippet(post_snippet_t *snippet)
+{
+    pimpl->postprocessing->add_post_snippet(snippet);
+}
+
+void render_manager::rem_post_snippet(post_snippet_t *snippet)
+{
+    pimpl->postprocessing->rem_post_snippet(snippet);
+}
+
+void render_manager::add_overlay_rect(overlay_rect_t *rect)
+{
+    pimpl->overlays->add(rect);
+}
+
+void render_manager::update_overlay_rect(overlay_rect_t *rect)
+{
+    pimpl->overlays->update(rect);
+}
+
+void render_manager::rem_overlay_rect(overlay_rect_t *rect)
+{
+    pimpl->overlays->remove(rect);
+}
+
 wf::region_t render_manager::get_scheduled_damage()
 {
     return pimpl->output_damage->get_scheduled_damage();
 }
 
+void render_manager::damage_animation_bounds(animation_bounds_t& bounds,
+    const wf::region_t& current)
+{
+    pimpl->output_damage->damage(bounds.damaged | current);
+    bounds.damaged = current;
+}
+
+void render_manager::end_animation_bounds(animation_bounds_t& bounds)
+{
+    pimpl->output_damage->damage(bounds.damaged);
+    bounds.damaged.clear();
+}
+
 void render_manager::damage_whole()
 {
     pimpl->output_damage->damage_whole();
@@ -1489,7 +4434,17 @@ void render_manager::damage_whole()
 
 void render_manager::damage_whole_idle()
 {
-    pimpl->output_damage->damage_whole_idle();
+    pimpl->damage_whole_idle();
+}
+
+void render_manager::run_before_paint(effect_hook_t *callback)
+{
+    pimpl->run_before_paint(callback);
+}
+
+void render_manager::rem_before_paint(effect_hook_t *callback)
+{
+    pimpl->rem_before_paint(callback);
 }
 
 void render_manager::damage(const wlr_box& box)
@@ -1520,13 +4475,23 @@ void render_manager::workspace_stream_start(workspace_stream_t& stream)
 void render_manager::workspace_stream_update(workspace_stream_t& stream,
     float scale_x, float scale_y)
 {
-    pimpl->workspace_stream_update(stream);
+    pimpl->workspace_stream_update(stream, scale_x, scale_y);
 }
 
 void render_manager::workspace_stream_stop(workspace_stream_t& stream)
 {
     pimpl->workspace_stream_stop(stream);
 }
+
+const std::vector<wayfire_view>& render_manager::get_render_views()
+{
+    return pimpl->get_render_views();
+}
+
+std::vector<frame_stats_t> render_manager::get_frame_stats() const
+{
+    return pimpl->profiler->get_frames();
+}
 } // namespace wf
 
 /* End render_manager */
@@ -9,6 +9,7 @@
 #include "wayfire-shell-unstable-v2-protocol.h"
 #include "wayfire/signal-definitions.hpp"
 #include "../view/view-impl.hpp"
+#include "../core/seat/hotspot-manager.hpp"
 #include <wayfire/util/log.hpp>
 
 /* ----------------------------- wfs_hotspot -------------------------------- */
@@ -18,41 +19,26 @@ static void handle_hotspot_destroy(wl_resource *resource);
  * Represents a zwf_shell_hotspot_v2.
  * Lifetime is managed by the resource.
  */
-class wfs_hotspot : public noncopyable_t
+class wfs_hotspot : public wf::hotspot_listener_t, public noncopyable_t
 {
   private:
+    wf::output_t *output;
     wf::geometry_t hotspot_geometry;
 
     bool hotspot_triggered = false;
-    wf::wl_idle_call idle_check_input;
     wf::wl_timer timer;
 
     uint32_t timeout_ms;
     wl_resource *hotspot_resource;
 
-    wf::signal_callback_t on_motion_event = [=] (wf::signal_data_t *data)
-    {
-        idle_check_input.run_once([=] ()
-        {
-            auto gcf = wf::get_core().get_cursor_position();
-            wf::point_t gc{(int)gcf.x, (int)gcf.y};
-            process_input_motion(gc);
-        });
-    };
+    wf::signal_callback_t on_output_removed;
 
-    wf::signal_callback_t on_touch_motion_event = [=] (wf::signal_data_t *data)
+    std::vector<wf::geometry_t> get_hotspot_rects() override
     {
-        idle_check_input.run_once([=] ()
-        {
-            auto gcf = wf::get_core().get_touch_position(0);
-            wf::point_t gc{(int)gcf.x, (int)gcf.y};
-            process_input_motion(gc);
-        });
-    };
-
-    wf::signal_callback_t on_output_removed;
+        return {hotspot_geometry};
+    }
 
-    void process_input_motion(wf::point_t gc)
+    bool process_input_motion(wf::point_t gc) override
     {
         if (!(hotspot_geometry & gc))
         {
@@ -65,14 +51,14 @@ class wfs_hotspot : public noncopyable_t
             hotspot_triggered = false;
             timer.disconnect();
 
-            return;
+            return false;
         }
 
         if (hotspot_triggered)
         {
             /* Hotspot was already triggered, wait for the next time the cursor
              * enters the hotspot area to trigger again */
-            return;
+            return true;
         }
 
         if (!timer.is_connected())
@@ -84,6 +70,8 @@ class wfs_hotspot : public noncopyable_t
                 return false;
             });
         }
+
+        return true;
     }
 
     wf::geometry_t calculate_hotspot_geometry(wf::output_t *output,
@@ -119,9 +107,11 @@ class wfs_hotspot : public noncopyable_t
     wfs_hotspot(wf::output_t *output, uint32_t edge_mask,
         uint32_t distance, uint32_t timeout, wl_client *client, uint32_t id)
     {
+        this->output     = output;
         this->timeout_ms = timeout;
-        this->hotspot_geometry =
-            calculate_hotspot_geometry(output, edge_mask, distance);
+        this->hotspot_geometry = output ?
+            calculate_hotspot_geometry(output, edge_mask, distance) :
+            wf::geometry_t{0, 0, 0, 0};
 
         hotspot_resource =
             wl_resource_create(client, &zwf_hotspot_v2_interface, 1, id);
@@ -129,20 +119,23 @@ class wfs_hotspot : public noncopyable_t
             handle_hotspot_destroy);
 
         // setup output destroy listener
-        on_output_removed = [this, output] (wf::signal_data_t *data)
+        on_output_removed = [this] (wf::signal_data_t *data)
         {
             auto ev = static_cast<wf::output_removed_signal*>(data);
-            if (ev->output == output)
+            if (this->output && (ev->output == this->output))
             {
                 /* Make hotspot inactive by setting the region to empty */
                 hotspot_geometry = {0, 0, 0, 0};
                 process_input_motion({0, 0});
+                wf::hotspot_dispatcher_t::get(this->output).rem_hotspot(this);
+                this->output = nullptr;
             }
         };
 
-        wf::get_core().connect_signal("pointer_motion", &on_motion_event);
-        wf::get_core().connect_signal("tablet_axis", &on_motion_event);
-        wf::get_core().connect_signal("touch_motion", &on_touch_motion_event);
+        if (output)
+        {
+            wf::hotspot_dispatcher_t::get(output).add_hotspot(this);
+        }
 
         wf::get_core().output_layout->connect_signal("output-removed",
             &on_output_removed);
@@ -150,9 +143,10 @@ class wfs_hotspot : public noncopyable_t
 
     ~wfs_hotspot()
     {
-        wf::get_core().disconnect_signal("pointer_motion", &on_motion_event);
-        wf::get_core().disconnect_signal("tablet_axis", &on_motion_event);
-        wf::get_core().disconnect_signal("touch_motion", &on_touch_motion_event);
+        if (output)
+        {
+            wf::hotspot_dispatcher_t::get(output).rem_hotspot(this);
+        }
 
         wf::get_core().output_layout->disconnect_signal("output-removed",
             &on_output_removed);
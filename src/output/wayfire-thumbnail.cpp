@@ -0,0 +1,448 @@
+/**
+ * Implementation of the wayfire-thumbnail-unstable-v1 protocol
+ */
+#include "wayfire/core.hpp"
+#include "wayfire/opengl.hpp"
+#include "wayfire/option-wrapper.hpp"
+#include "wayfire/output.hpp"
+#include "wayfire-thumbnail.hpp"
+#include "wayfire-thumbnail-unstable-v1-protocol.h"
+#include "../core/core-impl.hpp"
+#include "../view/view-impl.hpp"
+#include <wayfire/util/log.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unistd.h>
+
+/* ------------------------------ dmabuf export ----------------------------- */
+namespace
+{
+PFNEGLCREATEIMAGEKHRPROC create_image = nullptr;
+PFNEGLDESTROYIMAGEKHRPROC destroy_image = nullptr;
+PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC export_query = nullptr;
+PFNEGLEXPORTDMABUFIMAGEMESAPROC export_image = nullptr;
+
+/** @return Whether GL textures can be exported as dmabufs */
+bool load_dmabuf_export()
+{
+    static const bool supported = [] ()
+    {
+        auto display    = wf::get_core_impl().egl->display;
+        auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions ||
+            !strstr(extensions, "EGL_KHR_gl_texture_2D_image") ||
+            !strstr(extensions, "EGL_MESA_image_dma_buf_export"))
+        {
+            LOGI("Window thumbnails need EGL_KHR_gl_texture_2D_image and "
+                 "EGL_MESA_image_dma_buf_export, they are disabled");
+
+            return false;
+        }
+
+        create_image = (PFNEGLCREATEIMAGEKHRPROC)
+            eglGetProcAddress("eglCreateImageKHR");
+        destroy_image = (PFNEGLDESTROYIMAGEKHRPROC)
+            eglGetProcAddress("eglDestroyImageKHR");
+        export_query = (PFNEGLEXPORTDMABUFIMAGEQUERYMESAPROC)
+            eglGetProcAddress("eglExportDMABUFImageQueryMESA");
+        export_image = (PFNEGLEXPORTDMABUFIMAGEMESAPROC)
+            eglGetProcAddress("eglExportDMABUFImageMESA");
+
+        return create_image && destroy_image && export_query && export_image;
+    }();
+
+    return supported;
+}
+
+/** @return The biggest size with the aspect of size which fits in max_size */
+wf::dimensions_t fit_size(wf::dimensions_t size, wf::dimensions_t max_size)
+{
+    double scale = std::min({1.0,
+        1.0 * max_size.width / std::max(1, size.width),
+        1.0 * max_size.height / std::max(1, size.height)});
+
+    return {
+        std::max(1, (int)std::round(size.width * scale)),
+        std::max(1, (int)std::round(size.height * scale)),
+    };
+}
+}
+
+/* ------------------------------ wfs_thumbnail ----------------------------- */
+static void handle_thumbnail_destroy(wl_resource *resource);
+static void handle_zwf_thumbnail_destroy(wl_client*, wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static struct zwf_thumbnail_v1_interface zwf_thumbnail_impl = {
+    .destroy = handle_zwf_thumbnail_destroy,
+};
+
+class wfs_thumbnail;
+
+/**
+ * Updates the changed thumbnails together, at most core/thumbnail_max_fps
+ * times per second.
+ */
+class thumbnail_scheduler_t : public noncopyable_t
+{
+  public:
+    static thumbnail_scheduler_t& get()
+    {
+        static thumbnail_scheduler_t scheduler;
+        return scheduler;
+    }
+
+    void add(wfs_thumbnail *thumbnail);
+    void remove(wfs_thumbnail *thumbnail);
+    /** Update the thumbnail with the next batch */
+    void schedule(wfs_thumbnail *thumbnail);
+
+  private:
+    wf::option_wrapper_t<int> max_fps{"core/thumbnail_max_fps"};
+    std::vector<wfs_thumbnail*> thumbnails;
+    std::vector<wfs_thumbnail*> scheduled;
+    wf::wl_timer timer;
+
+    void update();
+};
+
+/**
+ * Represents a zwf_thumbnail_v1.
+ * Lifetime is managed by the wl_resource
+ */
+class wfs_thumbnail : public noncopyable_t
+{
+    wl_resource *resource;
+    wayfire_view view;
+    wf::dimensions_t max_size;
+
+    /* The thumbnail, and the EGL image it was exported with */
+    wf::framebuffer_base_t buffer;
+    EGLImageKHR image = EGL_NO_IMAGE_KHR;
+    bool failed = false;
+
+    wf::signal_connection_t on_damage = [=] (wf::signal_data_t*)
+    {
+        thumbnail_scheduler_t::get().schedule(this);
+    };
+
+    wf::signal_connection_t on_unmap = [=] (wf::signal_data_t*)
+    {
+        close();
+        zwf_thumbnail_v1_send_closed(resource);
+    };
+
+    void close()
+    {
+        on_damage.disconnect();
+        on_unmap.disconnect();
+        view = nullptr;
+    }
+
+    void release_image()
+    {
+        if (image != EGL_NO_IMAGE_KHR)
+        {
+            destroy_image(wf::get_core_impl().egl->display, image);
+            image = EGL_NO_IMAGE_KHR;
+        }
+    }
+
+    /** Export the buffer and send it to the client. */
+    bool export_buffer()
+    {
+        release_image();
+        auto egl = wf::get_core_impl().egl;
+        const EGLint attribs[] = {EGL_NONE};
+        image = create_image(egl->display, egl->context, EGL_GL_TEXTURE_2D_KHR,
+            (EGLClientBuffer)(uintptr_t)buffer.tex, attribs);
+        if (image == EGL_NO_IMAGE_KHR)
+        {
+            return false;
+        }
+
+        int fourcc = 0, planes = 0;
+        EGLuint64KHR modifier = 0;
+        if (!export_query(egl->display, image, &fourcc, &planes, &modifier) ||
+            (planes != 1))
+        {
+            return false;
+        }
+
+        int fd = -1;
+        EGLint stride = 0, offset = 0;
+        if (!export_image(egl->display, image, &fd, &stride, &offset))
+        {
+            return false;
+        }
+
+        /* The fd is duplicated when the event is sent */
+        zwf_thumbnail_v1_send_buffer(resource, fd, buffer.viewport_width,
+            buffer.viewport_height, fourcc, modifier >> 32,
+            modifier & 0xffffffff, offset, stride);
+        ::close(fd);
+
+        return true;
+    }
+
+    void fail()
+    {
+        close();
+        OpenGL::render_begin();
+        release_image();
+        buffer.release();
+        OpenGL::render_end();
+
+        failed = true;
+        zwf_thumbnail_v1_send_failed(resource);
+    }
+
+  public:
+    wfs_thumbnail(wayfire_view view, wf::dimensions_t max_size,
+        wl_client *client, uint32_t version, uint32_t id)
+    {
+        this->view     = view;
+        this->max_size = max_size;
+
+        resource = wl_resource_create(client, &zwf_thumbnail_v1_interface,
+            version, id);
+        wl_resource_set_implementation(resource, &zwf_thumbnail_impl,
+            this, handle_thumbnail_destroy);
+
+        if (!view || !view->is_mapped())
+        {
+            this->view = nullptr;
+            zwf_thumbnail_v1_send_closed(resource);
+
+            return;
+        }
+
+        if (!load_dmabuf_export())
+        {
+            fail();
+
+            return;
+        }
+
+        view->connect_signal("region-damaged", &on_damage);
+        view->connect_signal("unmapped", &on_unmap);
+        thumbnail_scheduler_t::get().add(this);
+    }
+
+    ~wfs_thumbnail()
+    {
+        close();
+        thumbnail_scheduler_t::get().remove(this);
+
+        OpenGL::render_begin();
+        release_image();
+        buffer.release();
+        OpenGL::render_end();
+    }
+
+    /** Draw the thumbnail from the snapshot of the view. */
+    void update()
+    {
+        if (!view || failed || !view->get_output())
+        {
+            return;
+        }
+
+        /* Only the damaged parts of the snapshot are drawn again */
+        view->take_snapshot();
+        auto& snapshot = view->view_impl->offscreen_buffer;
+        if (!snapshot.valid())
+        {
+            return;
+        }
+
+        auto size = fit_size(wf::dimensions(snapshot.geometry), max_size);
+
+        OpenGL::render_begin();
+        bool reallocated = buffer.allocate(size.width, size.height);
+        if (reallocated)
+        {
+            wf::gpu_memory::set_owner(&buffer, "thumbnails");
+        }
+
+        wf::framebuffer_t target;
+        target.fb  = buffer.fb;
+        target.tex = buffer.tex;
+        target.viewport_width  = buffer.viewport_width;
+        target.viewport_height = buffer.viewport_height;
+        target.geometry = snapshot.geometry;
+        /* Clients expect the first row of the dmabuf to be the top */
+        target.has_nonstandard_transform = true;
+        target.transform = glm::scale(glm::mat4(1.0), glm::vec3(1, -1, 1));
+
+        target.bind();
+        OpenGL::clear({0, 0, 0, 0});
+        OpenGL::render_texture(wf::texture_t{snapshot.tex}, target,
+            snapshot.geometry);
+        GL_CALL(glFlush());
+        OpenGL::render_end();
+        target.reset();
+
+        if (reallocated && !export_buffer())
+        {
+            fail();
+
+            return;
+        }
+
+        zwf_thumbnail_v1_send_ready(resource);
+    }
+};
+
+static void handle_thumbnail_destroy(wl_resource *resource)
+{
+    auto thumbnail = (wfs_thumbnail*)wl_resource_get_user_data(resource);
+    delete thumbnail;
+
+    wl_resource_set_user_data(resource, nullptr);
+}
+
+void thumbnail_scheduler_t::add(wfs_thumbnail *thumbnail)
+{
+    thumbnails.push_back(thumbnail);
+    schedule(thumbnail);
+}
+
+void thumbnail_scheduler_t::remove(wfs_thumbnail *thumbnail)
+{
+    for (auto list : {&thumbnails, &scheduled})
+    {
+        list->erase(std::remove(list->begin(), list->end(), thumbnail),
+            list->end());
+    }
+}
+
+void thumbnail_scheduler_t::schedule(wfs_thumbnail *thumbnail)
+{
+    if (std::find(scheduled.begin(), scheduled.end(), thumbnail) ==
+        scheduled.end())
+    {
+        scheduled.push_back(thumbnail);
+    }
+
+    if (!timer.is_connected())
+    {
+        timer.set_timeout(1000 / std::max(1, (int)max_fps), [=] ()
+        {
+            update();
+
+            return false;
+        });
+    }
+}
+
+void thumbnail_scheduler_t::update()
+{
+    /* Updating may send events, and the destroyed thumbnails are removed
+     * from the list right away */
+    auto batch = std::move(scheduled);
+    scheduled.clear();
+    for (auto thumbnail : batch)
+    {
+        if (std::find(thumbnails.begin(), thumbnails.end(), thumbnail) !=
+            thumbnails.end())
+        {
+            thumbnail->update();
+        }
+    }
+}
+
+/* ----------------------------- manager ------------------------------------ */
+/** @return The view of a zwlr_foreign_toplevel_handle_v1, if any */
+static wayfire_view find_toplevel_view(wl_resource *toplevel)
+{
+    if (!toplevel || strcmp(wl_resource_get_class(toplevel),
+        "zwlr_foreign_toplevel_handle_v1"))
+    {
+        return nullptr;
+    }
+
+    auto handle = wl_resource_get_user_data(toplevel);
+    if (!handle)
+    {
+        /* The toplevel is already gone */
+        return nullptr;
+    }
+
+    for (auto& view : wf::get_core().get_all_views())
+    {
+        auto wlr_view = dynamic_cast<wf::wlr_view_t*>(view.get());
+        if (wlr_view && (wlr_view->toplevel_handle == handle))
+        {
+            return view;
+        }
+    }
+
+    return nullptr;
+}
+
+static void zwf_thumbnail_manager_get_thumbnail(wl_client *client,
+    wl_resource *resource, uint32_t id, wl_resource *toplevel,
+    uint32_t max_width, uint32_t max_height)
+{
+    wf::dimensions_t max_size = {
+        (int)std::clamp(max_width, 1u, 4096u),
+        (int)std::clamp(max_height, 1u, 4096u),
+    };
+
+    /* Will be freed when the resource is destroyed */
+    new wfs_thumbnail(find_toplevel_view(toplevel), max_size, client,
+        wl_resource_get_version(resource), id);
+}
+
+static void zwf_thumbnail_manager_destroy(wl_client*, wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+const struct zwf_thumbnail_manager_v1_interface zwf_thumbnail_manager_v1_impl =
+{
+    zwf_thumbnail_manager_get_thumbnail,
+    zwf_thumbnail_manager_destroy,
+};
+
+void bind_zwf_thumbnail_manager(wl_client *client, void *data,
+    uint32_t version, uint32_t id)
+{
+    auto resource =
+        wl_resource_create(client, &zwf_thumbnail_manager_v1_interface, 1, id);
+    wl_resource_set_implementation(resource,
+        &zwf_thumbnail_manager_v1_impl, NULL, NULL);
+}
+
+struct wayfire_thumbnail
+{
+    wl_global *manager;
+};
+
+wayfire_thumbnail *wayfire_thumbnail_create(wl_display *display)
+{
+    wayfire_thumbnail *wt = new wayfire_thumbnail;
+
+    wt->manager = wl_global_create(display,
+        &zwf_thumbnail_manager_v1_interface, 1, NULL, bind_zwf_thumbnail_manager);
+
+    if (wt->manager == NULL)
+    {
+        LOGE("Failed to create wayfire_thumbnail interface");
+        delete wt;
+
+        return NULL;
+    }
+
+    return wt;
+}
@@ -0,0 +1,4 @@
+#include <wayland-client.h>
+
+struct wayfire_thumbnail;
+wayfire_thumbnail *wayfire_thumbnail_create(wl_display *display);
@@ -7,54 +7,16 @@
 #include <wayfire/opengl.hpp>
 #include <list>
 #include <algorithm>
+#include <cmath>
+#include <unordered_map>
 #include <wayfire/nonstd/reverse.hpp>
 #include <wayfire/util/log.hpp>
+#include <wayfire/debug.hpp>
 
 #include "../view/view-impl.hpp"
 
 namespace wf
 {
-/** Find a smart pointer inside a list */
-template<class Haystack, class Needle>
-typename std::list<Haystack>::iterator find_in(std::list<Haystack>& hay,
-    const Needle& needle)
-{
-    return std::find_if(std::begin(hay), std::end(hay), [=] (const auto& elem)
-    {
-        return elem.get() == needle.get();
-    });
-}
-
-/** Bring to front or lower to back inside a container of smart pointers */
-template<class Haystack, class Needle>
-void raise_to_front(std::list<Haystack>& hay, const Needle& needle,
-    bool reverse = false)
-{
-    auto it = find_in(hay, needle);
-    hay.splice(reverse ? hay.end() : hay.begin(), hay, it);
-}
-
-/** Reorder list so that @element is directly above @below. */
-template<class Haystack, class Needle>
-void reorder_above(
-    std::list<Haystack>& list, const Needle& element, const Needle& below)
-{
-    auto element_it = find_in(list, element);
-    auto pos = find_in(list, below);
-    list.splice(pos, list, element_it);
-}
-
-/** Reorder list so that @element is directly below @above. */
-template<class Haystack, class Needle>
-void reorder_below(
-    std::list<Haystack>& list, const Needle& element, const Needle& above)
-{
-    auto element_it = find_in(list, element);
-    auto pos = find_in(list, above);
-    assert(pos != list.end());
-    list.splice(std::next(pos), list, element_it);
-}
-
 /**
  * Remove needle from haystack, where both needle and elements in haystack are
  * smart pointers.
@@ -86,6 +48,9 @@ struct sublayer_t
     /** The sublayer mode */
     sublayer_mode_t mode;
 
+    /** The position of the sublayer in its layer's list for the mode */
+    std::list<std::unique_ptr<sublayer_t>>::iterator position;
+
     /**
      * Whether the sublayer is created artificially to hold a single view.
      * In those cases, the sublayer is destroyed as soon as the view is moved
@@ -110,22 +75,41 @@ struct layer_container_t
     /** List of sublayers docked above */
     sublayer_container_t above;
 
-    void remove_sublayer(nonstd::observer_ptr<sublayer_t> sublayer)
+    sublayer_container_t& get_container(sublayer_mode_t mode)
     {
-        for (auto container : {& below, & floating, & above})
+        switch (mode)
         {
-            remove_from(*container, sublayer);
+          case SUBLAYER_DOCKED_BELOW:
+            return below;
+
+          case SUBLAYER_DOCKED_ABOVE:
+            return above;
+
+          default:
+            return floating;
         }
     }
+
+    void remove_sublayer(nonstd::observer_ptr<sublayer_t> sublayer)
+    {
+        get_container(sublayer->mode).erase(sublayer->position);
+    }
 };
 
 /**
  * output_layer_manager_t is a part of the workspace_manager module. It provides
  * the functionality related to layers and sublayers.
+ *
+ * Each view and each sublayer remembers its position in the list which contains
+ * it, so restacking and removal don't need to search the lists.
  */
 class output_layer_manager_t
 {
     layer_container_t layers[TOTAL_LAYERS];
+    uint64_t generation = 0;
+
+    /** The views which have is_promoted set */
+    std::vector<wayfire_view> promoted;
 
   public:
     output_layer_manager_t()
@@ -146,6 +130,24 @@ class output_layer_manager_t
         return view->view_impl->sublayer;
     }
 
+    std::list<wayfire_view>::iterator& get_view_position(wayfire_view view)
+    {
+        return view->view_impl->sublayer_pos;
+    }
+
+    /** @return A counter which is incremented on each stacking order change. */
+    uint64_t get_generation() const
+    {
+        return generation;
+    }
+
+    /** Indicate that the stacking order has changed in a way which isn't
+     * tracked by the layer manager, for ex. promoted views have changed. */
+    void stacking_changed()
+    {
+        ++generation;
+    }
+
     uint32_t get_view_layer(wayfire_view view)
     {
         /*
@@ -171,7 +173,7 @@ class output_layer_manager_t
 
         view->damage();
 
-        remove_from(sublayer->views, view);
+        sublayer->views.erase(get_view_position(view));
         if (sublayer->is_single_view)
         {
             sublayer->layer->remove_sublayer(sublayer);
@@ -179,6 +181,54 @@ class output_layer_manager_t
 
         /* Reset the view's sublayer */
         sublayer = nullptr;
+        set_promoted(view, false);
+        stacking_changed();
+    }
+
+    /** Promote the view to the fullscreen layer or demote it back */
+    void set_promoted(wayfire_view view, bool promote)
+    {
+        if (view->view_impl->is_promoted == promote)
+        {
+            return;
+        }
+
+        view->view_impl->is_promoted = promote;
+        if (promote)
+        {
+            promoted.push_back(view);
+        } else
+        {
+            remove_from(promoted, view);
+        }
+
+        stacking_changed();
+    }
+
+    /**
+     * @return The topmost view in the layer for which pred returns true,
+     *   ignoring promotion, or nullptr if there is none.
+     */
+    template<class Predicate>
+    wayfire_view find_top_view(layer_t layer_e, Predicate pred)
+    {
+        auto& layer = this->layers[layer_index_from_mask(layer_e)];
+        for (const auto& sublayers :
+             {& layer.above, & layer.floating, & layer.below})
+        {
+            for (const auto& sublayer : *sublayers)
+            {
+                for (auto& view : sublayer->views)
+                {
+                    if (pred(view))
+                    {
+                        return view;
+                    }
+                }
+            }
+        }
+
+        return nullptr;
     }
 
     void add_view_to_sublayer(wayfire_view view,
@@ -187,6 +237,8 @@ class output_layer_manager_t
         remove_view(view);
         get_view_sublayer(view) = sublayer;
         sublayer->views.push_front(view);
+        get_view_position(view) = sublayer->views.begin();
+        stacking_changed();
     }
 
     nonstd::observer_ptr<sublayer_t> create_sublayer(layer_t layer_mask,
@@ -200,19 +252,15 @@ class output_layer_manager_t
         sublayer->mode  = mode;
         sublayer->is_single_view = false;
 
-        switch (mode)
+        auto& container = layer.get_container(mode);
+        if (mode == SUBLAYER_DOCKED_BELOW)
         {
-          case SUBLAYER_DOCKED_BELOW:
-            layer.below.emplace_back(std::move(sublayer));
-            break;
-
-          case SUBLAYER_DOCKED_ABOVE:
-            layer.above.emplace_front(std::move(sublayer));
-            break;
-
-          case SUBLAYER_FLOATING:
-            layer.floating.emplace_front(std::move(sublayer));
-            break;
+            container.emplace_back(std::move(sublayer));
+            ptr->position = std::prev(container.end());
+        } else
+        {
+            container.emplace_front(std::move(sublayer));
+            ptr->position = container.begin();
         }
 
         return ptr;
@@ -222,7 +270,9 @@ class output_layer_manager_t
     void add_view_to_layer(wayfire_view view, layer_t layer)
     {
         view->damage();
-        add_view_to_sublayer(view, create_sublayer(layer, SUBLAYER_FLOATING));
+        auto sublayer = create_sublayer(layer, SUBLAYER_FLOATING);
+        sublayer->is_single_view = true;
+        add_view_to_sublayer(view, sublayer);
         view->damage();
     }
 
@@ -235,10 +285,13 @@ class output_layer_manager_t
         assert(sublayer);
         if (sublayer->mode == SUBLAYER_FLOATING)
         {
-            raise_to_front(sublayer->layer->floating, sublayer);
+            auto& floating = sublayer->layer->floating;
+            floating.splice(floating.begin(), floating, sublayer->position);
         }
 
-        raise_to_front(sublayer->views, view);
+        sublayer->views.splice(sublayer->views.begin(), sublayer->views,
+            get_view_position(view));
+        stacking_changed();
     }
 
     wayfire_view get_front_view(wf::layer_t layer)
@@ -261,9 +314,11 @@ class output_layer_manager_t
         auto below_sublayer = get_view_sublayer(below);
         assert(view_sublayer->layer == below_sublayer->layer);
 
+        auto& views = view_sublayer->views;
         if (view_sublayer == below_sublayer)
         {
-            reorder_above(view_sublayer->views, view, below);
+            views.splice(get_view_position(below), views, get_view_position(view));
+            stacking_changed();
 
             return;
         }
@@ -274,8 +329,10 @@ class output_layer_manager_t
             return;
         }
 
-        reorder_above(view_sublayer->layer->floating, view_sublayer, below_sublayer);
-        raise_to_front(view_sublayer->views, view, true); // bring to back == reverse
+        auto& floating = view_sublayer->layer->floating;
+        floating.splice(below_sublayer->position, floating, view_sublayer->position);
+        views.splice(views.end(), views, get_view_position(view));
+        stacking_changed();
     }
 
     /** Precondition: view and above are in the same layer */
@@ -287,9 +344,12 @@ class output_layer_manager_t
         auto above_sublayer = get_view_sublayer(above);
         assert(view_sublayer->layer == above_sublayer->layer);
 
+        auto& views = view_sublayer->views;
         if (view_sublayer == above_sublayer)
         {
-            reorder_below(view_sublayer->views, view, above);
+            views.splice(std::next(get_view_position(above)), views,
+                get_view_position(view));
+            stacking_changed();
 
             return;
         }
@@ -300,8 +360,11 @@ class output_layer_manager_t
             return;
         }
 
-        reorder_below(view_sublayer->layer->floating, view_sublayer, above_sublayer);
-        raise_to_front(view_sublayer->views, view);
+        auto& floating = view_sublayer->layer->floating;
+        floating.splice(std::next(above_sublayer->position), floating,
+            view_sublayer->position);
+        views.splice(views.begin(), views, get_view_position(view));
+        stacking_changed();
     }
 
     void push_views(std::vector<wayfire_view>& into, layer_t layer_e,
@@ -358,10 +421,7 @@ class output_layer_manager_t
 
     std::vector<wayfire_view> get_promoted_views()
     {
-        std::vector<wayfire_view> views;
-        push_views(views, LAYER_WORKSPACE, true);
-
-        return views;
+        return promoted;
     }
 
     /**
@@ -385,6 +445,7 @@ class output_layer_manager_t
         }
 
         sublayer->layer->remove_sublayer(sublayer);
+        stacking_changed();
     }
 };
 
@@ -445,9 +506,29 @@ class output_viewport_manager_t
         wf::geometry_t workspace_relative_geometry;
         wlr_box view_bbox = view->get_bounding_box();
 
-        for (int horizontal = 0; horizontal < this->vwidth; horizontal++)
+        /* Workspaces outside of the bounding box can't reach the threshold, so
+         * only the range of workspaces under it is checked. Sticky views and a
+         * zero threshold may match any workspace though. */
+        int x1 = 0, y1 = 0, x2 = vwidth - 1, y2 = vheight - 1;
+        if (!view->sticky && (threshold > 0))
+        {
+            auto size = output->get_screen_size();
+            auto first = [] (int start, int pitch)
+            {
+                return (int)std::floor(1.0 * start / std::max(1, pitch));
+            };
+
+            x1 = std::max(x1, current_vx + first(view_bbox.x, size.width));
+            y1 = std::max(y1, current_vy + first(view_bbox.y, size.height));
+            x2 = std::min(x2, current_vx +
+                first(view_bbox.x + view_bbox.width - 1, size.width));
+            y2 = std::min(y2, current_vy +
+                first(view_bbox.y + view_bbox.height - 1, size.height));
+        }
+
+        for (int horizontal = x1; horizontal <= x2; horizontal++)
         {
-            for (int vertical = 0; vertical < this->vheight; vertical++)
+            for (int vertical = y1; vertical <= y2; vertical++)
             {
                 wf::point_t ws = {horizontal, vertical};
                 if (output->workspace->view_visible_on(view, ws))
@@ -673,6 +754,295 @@ class output_viewport_manager_t
     }
 };
 
+/**
+ * workspace_view_index_t is a spatial index which speeds up queries for the
+ * views visible on a given workspace.
+ *
+ * Each view is assigned to a bucket for every workspace its wm geometry
+ * overlaps. Views whose visibility cannot be determined from their wm geometry
+ * alone (views with transformers and sticky views) are kept in a separate list
+ * and tested on each query.
+ *
+ * The buckets of a view are updated when its geometry, transformers or sticky
+ * state change. Changes which affect all views (changing the current workspace
+ * or the output size) invalidate the whole index, which is then rebuilt on the
+ * next query. The stacking order is cached as a rank for each view and
+ * recomputed lazily after the stacking order changes.
+ */
+class workspace_view_index_t
+{
+  public:
+    workspace_view_index_t(output_t *output,
+        output_layer_manager_t& layer_manager,
+        output_viewport_manager_t& viewport_manager) :
+        output(output), layer_manager(layer_manager),
+        viewport_manager(viewport_manager)
+    {
+        on_view_changed.set_callback([=] (signal_data_t *data)
+        {
+            if (geometry_dirty)
+            {
+                /* Everything will be recomputed on the next query anyway */
+                return;
+            }
+
+            auto view = get_signaled_view(data);
+            auto it   = entries.find(view.get());
+            if (it != entries.end())
+            {
+                update_buckets(view, it->second);
+            }
+        });
+    }
+
+    /** Indicate that the buckets of all views need to be recomputed. */
+    void invalidate_geometry()
+    {
+        geometry_dirty = true;
+    }
+
+    /** Drop the view from the index, it has been removed from its layer. */
+    void remove_view(wayfire_view view)
+    {
+        auto it = entries.find(view.get());
+        if (it != entries.end())
+        {
+            remove_from_buckets(view, it->second);
+            entries.erase(it);
+        }
+
+        view->disconnect_signal(&on_view_changed);
+    }
+
+    /** Same as output_viewport_manager_t::get_views_on_workspace() */
+    std::vector<wayfire_view> get_views_on_workspace(wf::point_t ws,
+        uint32_t layers_mask)
+    {
+        if (!viewport_manager.is_workspace_valid(ws))
+        {
+            return viewport_manager.get_views_on_workspace(ws, layers_mask);
+        }
+
+        refresh();
+
+        auto& bucket = buckets[bucket_index(ws)];
+        candidates.clear();
+        for (auto& view : bucket)
+        {
+            auto& entry = entries[view.get()];
+            if (entry.layer & layers_mask)
+            {
+                candidates.push_back({entry.rank, view});
+            }
+        }
+
+        for (auto& view : unindexed)
+        {
+            auto& entry = entries[view.get()];
+            if ((entry.layer & layers_mask) &&
+                viewport_manager.view_visible_on(view, ws))
+            {
+                candidates.push_back({entry.rank, view});
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+            [] (const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<wayfire_view> result;
+        result.reserve(candidates.size());
+        for (auto& candidate : candidates)
+        {
+            result.push_back(candidate.second);
+        }
+
+        return result;
+    }
+
+  private:
+    output_t *output;
+    output_layer_manager_t& layer_manager;
+    output_viewport_manager_t& viewport_manager;
+
+    struct entry_t
+    {
+        /** Position in the stacking order, lower is on top */
+        size_t rank = 0;
+        /** The layer of the view */
+        uint32_t layer = 0;
+        /** Whether the view is in the unindexed list */
+        bool unindexed = false;
+        /** The range of workspaces the view is in, inclusive */
+        wf::point_t first = {0, 0};
+        wf::point_t last  = {-1, -1};
+    };
+
+    std::unordered_map<view_interface_t*, entry_t> entries;
+    std::vector<std::vector<wayfire_view>> buckets;
+    std::vector<wayfire_view> unindexed;
+    std::vector<std::pair<size_t, wayfire_view>> candidates;
+
+    /** The generation of the layer manager the ranks were computed for */
+    uint64_t stacking_generation = 0;
+    bool geometry_dirty = true;
+
+    signal_connection_t on_view_changed;
+
+    size_t bucket_index(wf::point_t ws)
+    {
+        return ws.x * viewport_manager.get_workspace_grid_size().height + ws.y;
+    }
+
+    void remove_from_buckets(wayfire_view view, entry_t& entry)
+    {
+        if (entry.unindexed)
+        {
+            remove_from(unindexed, view);
+            entry.unindexed = false;
+        }
+
+        for (int i = entry.first.x; i <= entry.last.x; i++)
+        {
+            for (int j = entry.first.y; j <= entry.last.y; j++)
+            {
+                remove_from(buckets[bucket_index({i, j})], view);
+            }
+        }
+
+        entry.first = {0, 0};
+        entry.last  = {-1, -1};
+    }
+
+    void update_buckets(wayfire_view view, entry_t& entry)
+    {
+        remove_from_buckets(view, entry);
+        if (view->has_transformer() || view->sticky)
+        {
+            entry.unindexed = true;
+            unindexed.push_back(view);
+
+            return;
+        }
+
+        auto grid = viewport_manager.get_workspace_grid_size();
+        auto cws  = viewport_manager.get_current_workspace();
+        auto og   = output->get_relative_geometry();
+        auto wm   = view->get_wm_geometry();
+        if ((og.width <= 0) || (og.height <= 0))
+        {
+            return;
+        }
+
+        /* Candidate workspaces, which are then checked exactly in the same way
+         * as output_viewport_manager_t::view_visible_on() does */
+        auto floor_div = [] (int a, int b)
+        {
+            return (a >= 0) ? a / b : -((-a + b - 1) / b);
+        };
+
+        int x1 = std::max(0, cws.x + floor_div(wm.x, og.width) - 1);
+        int y1 = std::max(0, cws.y + floor_div(wm.y, og.height) - 1);
+        int x2 = std::min(grid.width - 1,
+            cws.x + floor_div(wm.x + wm.width, og.width) + 1);
+        int y2 = std::min(grid.height - 1,
+            cws.y + floor_div(wm.y + wm.height, og.height) + 1);
+
+        wf::point_t first = {grid.width, grid.height}, last = {-1, -1};
+        for (int i = x1; i <= x2; i++)
+        {
+            for (int j = y1; j <= y2; j++)
+            {
+                auto g = og;
+                g.x += (i - cws.x) * og.width;
+                g.y += (j - cws.y) * og.height;
+                if (g & wm)
+                {
+                    first = {std::min(first.x, i), std::min(first.y, j)};
+                    last  = {std::max(last.x, i), std::max(last.y, j)};
+                }
+            }
+        }
+
+        /* A rectangle always overlaps a rectangular range of workspaces */
+        for (int i = first.x; i <= last.x; i++)
+        {
+            for (int j = first.y; j <= last.y; j++)
+            {
+                buckets[bucket_index({i, j})].push_back(view);
+            }
+        }
+
+        entry.first = first;
+        entry.last  = last;
+        if (last.x < 0)
+        {
+            entry.first = {0, 0};
+        }
+    }
+
+    void refresh()
+    {
+        if (stacking_generation != layer_manager.get_generation())
+        {
+            refresh_stacking();
+        }
+
+        if (geometry_dirty)
+        {
+            geometry_dirty = false;
+            auto grid = viewport_manager.get_workspace_grid_size();
+            buckets.assign(grid.width * grid.height, {});
+            unindexed.clear();
+            for (auto& [view, entry] : entries)
+            {
+                entry.unindexed = false;
+                entry.first     = {0, 0};
+                entry.last      = {-1, -1};
+                update_buckets(wayfire_view{view}, entry);
+            }
+        }
+    }
+
+    void refresh_stacking()
+    {
+        stacking_generation = layer_manager.get_generation();
+        auto views = layer_manager.get_views_in_layer(ALL_LAYERS);
+
+        std::unordered_map<view_interface_t*, entry_t> updated;
+        updated.reserve(views.size());
+        for (size_t i = 0; i < views.size(); i++)
+        {
+            auto& view = views[i];
+            auto it    = entries.find(view.get());
+            if (it != entries.end())
+            {
+                updated[view.get()] = it->second;
+                entries.erase(it);
+            } else
+            {
+                view->connect_signal("geometry-changed", &on_view_changed);
+                view->connect_signal("transformer-changed", &on_view_changed);
+                view->connect_signal("set-sticky", &on_view_changed);
+                geometry_dirty = true;
+            }
+
+            auto& entry = updated[view.get()];
+            entry.rank  = i;
+            entry.layer = layer_manager.get_view_layer(view);
+        }
+
+        /* Views which are no longer in any layer but have not been removed via
+         * remove_view(). They might be already destroyed, so we do not touch
+         * them and just rebuild the buckets without them. */
+        if (!entries.empty())
+        {
+            geometry_dirty = true;
+        }
+
+        entries = std::move(updated);
+    }
+};
+
 /**
  * output_workarea_manager_t provides workarea-related functionality from the
  * workspace_manager module
@@ -683,6 +1053,7 @@ class output_workarea_manager_t
     std::vector<workspace_manager::anchored_area*> anchors;
 
     output_t *output;
+    wf::wl_idle_call idle_reflow;
 
   public:
     output_workarea_manager_t(output_t *output)
@@ -739,8 +1110,18 @@ class output_workarea_manager_t
         anchors.erase(it, anchors.end());
     }
 
+    void schedule_reflow()
+    {
+        if (!idle_reflow.is_connected())
+        {
+            idle_reflow.run_once([=] () { reflow_reserved_areas(); });
+        }
+    }
+
     void reflow_reserved_areas()
     {
+        /* A pending reflow would only repeat this one */
+        idle_reflow.disconnect();
         auto old_workarea = current_workarea;
 
         current_workarea = output->get_relative_geometry();
@@ -819,6 +1200,7 @@ class workspace_manager::impl
         }
 
         output_geometry = output->get_relative_geometry();
+        view_index.invalidate_geometry();
         workarea_manager.reflow_reserved_areas();
     };
 
@@ -841,11 +1223,13 @@ class workspace_manager::impl
     output_layer_manager_t layer_manager;
     output_viewport_manager_t viewport_manager;
     output_workarea_manager_t workarea_manager;
+    workspace_view_index_t view_index;
 
     impl(output_t *o) :
         layer_manager(),
         viewport_manager(o),
-        workarea_manager(o)
+        workarea_manager(o),
+        view_index(o, layer_manager, viewport_manager)
     {
         output = o;
         output_geometry = output->get_relative_geometry();
@@ -898,6 +1282,8 @@ class workspace_manager::impl
 
     void set_workspace(wf::point_t ws, const std::vector<wayfire_view>& fixed)
     {
+        /* Workspace-relative coordinates of all views change */
+        view_index.invalidate_geometry();
         viewport_manager.set_workspace(ws, fixed);
         check_autohide_panels();
     }
@@ -921,6 +1307,8 @@ class workspace_manager::impl
 
     void emit_stack_order_changed()
     {
+        layer_manager.stacking_changed();
+
         stack_order_changed_signal data;
         data.output = output;
         output->emit_signal("stack-order-changed", &data);
@@ -930,26 +1318,27 @@ class workspace_manager::impl
     void update_promoted_views()
     {
         auto vp = viewport_manager.get_current_workspace();
-        auto already_promoted = viewport_manager.get_promoted_views(vp);
-        for (auto& view : already_promoted)
-        {
-            view->view_impl->is_promoted = false;
-        }
-
-        auto views = viewport_manager.get_views_on_workspace(
-            vp, LAYER_WORKSPACE);
 
-        /* Do not consider unmapped views or views which are not visible */
-        auto it = std::remove_if(views.begin(), views.end(),
-            [] (wayfire_view view) -> bool
+        /* Do not consider unmapped views or views which are not visible. We
+         * stop at the first match, so usually only a few views are checked. */
+        auto top = layer_manager.find_top_view(LAYER_WORKSPACE,
+            [&] (wayfire_view view)
         {
-            return !view->is_mapped() || !view->is_visible();
+            return view->is_mapped() && view->is_visible() &&
+            viewport_manager.view_visible_on(view, vp);
         });
-        views.erase(it, views.end());
 
-        if (!views.empty() && views.front()->fullscreen)
+        for (auto& view : viewport_manager.get_promoted_views(vp))
+        {
+            if ((view != top) || !top->fullscreen)
+            {
+                layer_manager.set_promoted(view, false);
+            }
+        }
+
+        if (top && top->fullscreen)
         {
-            views.front()->view_impl->is_promoted = true;
+            layer_manager.set_promoted(top, true);
         }
 
         check_autohide_panels();
@@ -1024,7 +1413,7 @@ class workspace_manager::impl
             return;
         }
 
-        LOGD("restack ", view->get_title(), " on top of ", below->get_title());
+        LOGC(VIEW, "restack ", view->get_title(), " on top of ", below->get_title());
 
         layer_manager.restack_above(view, below);
         update_promoted_views();
@@ -1057,6 +1446,7 @@ class workspace_manager::impl
     {
         uint32_t view_layer = layer_manager.get_view_layer(view);
         layer_manager.remove_view(view);
+        view_index.remove_view(view);
 
         view_layer_detached_signal data;
         data.view = view;
@@ -1094,7 +1484,7 @@ bool workspace_manager::view_visible_on(wayfire_view view, wf::point_t ws)
 std::vector<wayfire_view> workspace_manager::get_views_on_workspace(wf::point_t ws,
     uint32_t layer_mask)
 {
-    return pimpl->viewport_manager.get_views_on_workspace(ws, layer_mask);
+    return pimpl->view_index.get_views_on_workspace(ws, layer_mask);
 }
 
 std::vector<wayfire_view> workspace_manager::get_views_on_workspace_sublayer(
@@ -1160,6 +1550,11 @@ std::vector<wayfire_view> workspace_manager::get_views_in_layer(uint32_t layers_
     return pimpl->layer_manager.get_views_in_layer(layers_mask);
 }
 
+uint64_t workspace_manager::get_stacking_generation()
+{
+    return pimpl->layer_manager.get_generation();
+}
+
 std::vector<wayfire_view> workspace_manager::get_views_in_sublayer(
     nonstd::observer_ptr<sublayer_t> sublayer)
 {
@@ -1230,6 +1625,11 @@ void workspace_manager::reflow_reserved_areas()
     return pimpl->workarea_manager.reflow_reserved_areas();
 }
 
+void workspace_manager::schedule_reflow_reserved_areas()
+{
+    return pimpl->workarea_manager.schedule_reflow();
+}
+
 wf::geometry_t workspace_manager::get_workarea()
 {
     return pimpl->workarea_manager.get_workarea();
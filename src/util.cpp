@@ -1,6 +1,7 @@
 #include "wayfire/util.hpp"
 #include <wayfire/debug.hpp>
 #include <wayfire/core.hpp>
+#include "core/timer-wheel.hpp"
 #include <sstream>
 #include <iomanip>
 #include <ctime>
@@ -167,6 +168,38 @@ pixman_box32_t pixman_box_from_wlr_box(const wlr_box& box)
     };
 }
 
+/* A pixman region without data consists of exactly one rectangle, its
+ * extents. Empty regions point to a static empty data block instead. */
+static bool is_single_box(const pixman_region32_t& region)
+{
+    return region.data == nullptr;
+}
+
+/* Intersect a single-box region with the given box in place */
+static void intersect_single_box(pixman_region32_t& region, const wlr_box& box)
+{
+    auto& ext = region.extents;
+    int x1    = std::max(ext.x1, box.x);
+    int y1    = std::max(ext.y1, box.y);
+    int x2    = std::min(ext.x2, box.x + box.width);
+    int y2    = std::min(ext.y2, box.y + box.height);
+
+    if ((x1 < x2) && (y1 < y2))
+    {
+        ext = {x1, y1, x2, y2};
+    } else
+    {
+        pixman_region32_clear(&region);
+    }
+}
+
+/* Check whether the box contains the given extents */
+static bool box_contains(const wlr_box& box, const pixman_box32_t& ext)
+{
+    return box.x <= ext.x1 && box.y <= ext.y1 &&
+           box.x + box.width >= ext.x2 && box.y + box.height >= ext.y2;
+}
+
 wf::region_t::region_t()
 {
     pixman_region32_init(&_region);
@@ -281,6 +314,18 @@ wf::region_t& wf::region_t::operator +=(const wf::point_t& vector)
     return *this;
 }
 
+wf::region_t& wf::region_t::subtract_translated(const wf::region_t& other,
+    const wf::point_t& vector)
+{
+    /* Translating is cheap and doesn't allocate, so move this region into the
+     * coordinate system of other and back, instead of copying other. */
+    pixman_region32_translate(&_region, -vector.x, -vector.y);
+    pixman_region32_subtract(&_region, &_region, other.unconst());
+    pixman_region32_translate(&_region, vector.x, vector.y);
+
+    return *this;
+}
+
 wf::region_t wf::region_t::operator *(float scale) const
 {
     wf::region_t result;
@@ -299,6 +344,14 @@ wf::region_t& wf::region_t::operator *=(float scale)
 /* Region intersection */
 wf::region_t wf::region_t::operator &(const wlr_box& box) const
 {
+    if (is_single_box(_region))
+    {
+        wf::region_t result{*this};
+        intersect_single_box(result._region, box);
+
+        return result;
+    }
+
     wf::region_t result;
     pixman_region32_intersect_rect(result.to_pixman(), this->unconst(),
         box.x, box.y, box.width, box.height);
@@ -317,6 +370,13 @@ wf::region_t wf::region_t::operator &(const wf::region_t& other) const
 
 wf::region_t& wf::region_t::operator &=(const wlr_box& box)
 {
+    if (is_single_box(_region))
+    {
+        intersect_single_box(_region, box);
+
+        return *this;
+    }
+
     pixman_region32_intersect_rect(this->to_pixman(), this->to_pixman(),
         box.x, box.y, box.width, box.height);
 
@@ -351,6 +411,22 @@ wf::region_t wf::region_t::operator |(const wf::region_t& other) const
 
 wf::region_t& wf::region_t::operator |=(const wlr_box& other)
 {
+    if (is_single_box(_region) && (other.width > 0) && (other.height > 0))
+    {
+        if (box_contains(other, _region.extents))
+        {
+            _region.extents = pixman_box_from_wlr_box(other);
+
+            return *this;
+        }
+
+        if (box_contains(wlr_box_from_pixman_box(_region.extents),
+            pixman_box_from_wlr_box(other)))
+        {
+            return *this;
+        }
+    }
+
     pixman_region32_union_rect(this->to_pixman(), this->to_pixman(),
         other.x, other.y, other.width, other.height);
 
@@ -465,14 +541,6 @@ static void handle_idle_listener(void *data)
     call->execute();
 }
 
-static int handle_timeout(void *data)
-{
-    auto timer = (wf::wl_timer*)(data);
-    timer->execute();
-
-    return 0;
-}
-
 namespace wf
 {
 wl_listener_wrapper::wl_listener_wrapper()
@@ -523,7 +591,80 @@ void wl_listener_wrapper::emit(void *data)
     }
 }
 
-wl_idle_call::wl_idle_call() = default;
+/**
+ * The queue of the idle calls on the default event loop. It has a single idle
+ * source, added when the first call is scheduled.
+ */
+class idle_queue_t
+{
+  public:
+    static idle_queue_t& get()
+    {
+        static idle_queue_t queue;
+        return queue;
+    }
+
+    void add(wl_idle_call *call)
+    {
+        wl_list_insert(pending[call->priority].prev, &call->_link.link);
+        if (!source)
+        {
+            source = wl_event_loop_add_idle(get_core().ev_loop, handle_idle, this);
+        }
+    }
+
+  private:
+    wl_list pending[IDLE_PRIORITY_LOW + 1];
+    wl_event_source *source = NULL;
+
+    idle_queue_t()
+    {
+        for (auto& list : pending)
+        {
+            wl_list_init(&list);
+        }
+    }
+
+    /** @return The next call to run, or NULL if the queue is empty */
+    wl_idle_call *pop()
+    {
+        for (auto& list : pending)
+        {
+            if (!wl_list_empty(&list))
+            {
+                wl_idle_call::queue_link *link =
+                    wl_container_of(list.next, link, link);
+                wl_list_remove(&link->link);
+                wl_list_init(&link->link);
+
+                return link->self;
+            }
+        }
+
+        return NULL;
+    }
+
+    static void handle_idle(void *data)
+    {
+        auto queue = (idle_queue_t*)data;
+
+        /* Calls scheduled by the callbacks run in the same pass, so the
+         * source is kept until the queue is empty */
+        while (auto call = queue->pop())
+        {
+            call->execute();
+        }
+
+        queue->source = NULL;
+    }
+};
+
+wl_idle_call::wl_idle_call()
+{
+    _link.self = this;
+    wl_list_init(&_link.link);
+}
+
 wl_idle_call::~wl_idle_call()
 {
     disconnect();
@@ -541,15 +682,25 @@ void wl_idle_call::set_callback(callback_t call)
     this->call = call;
 }
 
+void wl_idle_call::set_priority(idle_priority_t priority)
+{
+    this->priority = priority;
+}
+
 void wl_idle_call::run_once()
 {
-    if (!call || source)
+    if (!call || is_connected())
     {
         return;
     }
 
-    auto use_loop = loop ?: get_core().ev_loop;
-    source = wl_event_loop_add_idle(use_loop, handle_idle_listener, this);
+    if (!loop || (loop == get_core().ev_loop))
+    {
+        idle_queue_t::get().add(this);
+    } else
+    {
+        source = wl_event_loop_add_idle(loop, handle_idle_listener, this);
+    }
 }
 
 void wl_idle_call::run_once(callback_t cb)
@@ -560,6 +711,8 @@ void wl_idle_call::run_once(callback_t cb)
 
 void wl_idle_call::disconnect()
 {
+    wl_list_remove(&_link.link);
+    wl_list_init(&_link.link);
     if (!source)
     {
         return;
@@ -571,7 +724,7 @@ void wl_idle_call::disconnect()
 
 bool wl_idle_call::is_connected()
 {
-    return source;
+    return source || !wl_list_empty(&_link.link);
 }
 
 void wl_idle_call::execute()
@@ -583,15 +736,18 @@ void wl_idle_call::execute()
     }
 }
 
+wl_timer::wl_timer()
+{
+    _link.self = this;
+    wl_list_init(&_link.link);
+}
+
 wl_timer::~wl_timer()
 {
-    if (source)
-    {
-        wl_event_source_remove(source);
-    }
+    timer_wheel_t::get().cancel(this);
 }
 
-void wl_timer::set_timeout(uint32_t timeout_ms, callback_t call)
+void wl_timer::set_timeout(uint32_t timeout_ms, callback_t call, bool precise)
 {
     if (timeout_ms == 0)
     {
@@ -600,29 +756,22 @@ void wl_timer::set_timeout(uint32_t timeout_ms, callback_t call)
         return;
     }
 
-    this->call    = call;
-    this->timeout = timeout_ms;
-    if (!source)
-    {
-        source = wl_event_loop_add_timer(get_core().ev_loop, handle_timeout, this);
-    }
-
-    wl_event_source_timer_update(source, timeout_ms);
+    this->call      = call;
+    this->timeout   = timeout_ms;
+    this->precise   = precise;
+    this->connected = true;
+    timer_wheel_t::get().arm(this, timeout_ms, precise);
 }
 
 void wl_timer::disconnect()
 {
-    if (source)
-    {
-        wl_event_source_remove(source);
-    }
-
-    source = NULL;
+    timer_wheel_t::get().cancel(this);
+    connected = false;
 }
 
 bool wl_timer::is_connected()
 {
-    return source != NULL;
+    return connected;
 }
 
 void wl_timer::execute()
@@ -630,9 +779,9 @@ void wl_timer::execute()
     if (call)
     {
         bool repeat = call();
-        if (repeat)
+        if (repeat && connected)
         {
-            wl_event_source_timer_update(source, this->timeout);
+            timer_wheel_t::get().arm(this, timeout, precise);
         }
     }
 }
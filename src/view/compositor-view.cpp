@@ -3,6 +3,7 @@
 #include <wayfire/opengl.hpp>
 #include <wayfire/compositor-view.hpp>
 #include <wayfire/signal-definitions.hpp>
+#include "view-impl.hpp"
 #include <cstring>
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -104,6 +105,7 @@ void wf::mirror_view_t::move(int x, int y)
 
     damage();
     emit_signal("geometry-changed", &data);
+    view_impl->queue_frame_geometry(this, data.old_geometry);
 }
 
 wf::geometry_t wf::mirror_view_t::get_output_geometry()
@@ -246,6 +248,7 @@ void wf::color_rect_view_t::move(int x, int y)
 
     damage();
     emit_signal("geometry-changed", &data);
+    view_impl->queue_frame_geometry(this, data.old_geometry);
 }
 
 void wf::color_rect_view_t::resize(int w, int h)
@@ -259,6 +262,7 @@ void wf::color_rect_view_t::resize(int w, int h)
 
     damage();
     emit_signal("geometry-changed", &data);
+    view_impl->queue_frame_geometry(this, data.old_geometry);
 }
 
 wf::geometry_t wf::color_rect_view_t::get_output_geometry()
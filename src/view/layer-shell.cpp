@@ -17,13 +17,56 @@ static const uint32_t both_vert =
 static const uint32_t both_horiz =
     ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
 
+/** What identifies the contents of a shm buffer, see has_new_contents() */
+struct buffer_contents_t
+{
+    bool valid = false;
+    uint64_t hash;
+    int32_t width, height, stride;
+    uint32_t format;
+    int32_t scale;
+    int32_t transform;
+
+    bool operator ==(const buffer_contents_t& other) const
+    {
+        return valid && other.valid && (hash == other.hash) &&
+               (width == other.width) && (height == other.height) &&
+               (stride == other.stride) && (format == other.format) &&
+               (scale == other.scale) && (transform == other.transform);
+    }
+};
+
+/** A fast hash which is good enough to tell two buffers apart. */
+static uint64_t hash_buffer_contents(const uint8_t *data, size_t size)
+{
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+
+    for (; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * prime;
+    }
+
+    return hash;
+}
+
 class wayfire_layer_shell_view : public wf::wlr_view_t
 {
     wf::wl_listener_wrapper on_map, on_unmap, on_destroy, on_new_popup;
     wf::wl_listener_wrapper on_commit_unmapped;
 
+    buffer_contents_t last_contents;
+
   protected:
     void initialize() override;
+    bool has_new_contents() override;
 
   public:
     wlr_layer_surface_v1 *lsurface;
@@ -292,7 +335,7 @@ struct wf_layer_shell_manager
         }
 
         set_exclusive_zone(view);
-        view->get_output()->workspace->reflow_reserved_areas();
+        view->get_output()->workspace->schedule_reflow_reserved_areas();
     }
 
     uint32_t determine_focused_layer()
@@ -326,14 +369,14 @@ struct wf_layer_shell_manager
         auto focus_mask = determine_focused_layer();
         focused_layer_request_uid = wf::get_core().focus_layer(focus_mask,
             focused_layer_request_uid);
-        output->workspace->reflow_reserved_areas();
+        output->workspace->schedule_reflow_reserved_areas();
     }
 };
 
 wayfire_layer_shell_view::wayfire_layer_shell_view(wlr_layer_surface_v1 *lsurf) :
     wf::wlr_view_t(), lsurface(lsurf)
 {
-    LOGD("Create a layer surface: namespace ", lsurf->namespace_t,
+    LOGC(VIEW, "Create a layer surface: namespace ", lsurf->namespace_t,
         " layer ", lsurf->current.layer);
 
     role = wf::VIEW_ROLE_DESKTOP_ENVIRONMENT;
@@ -442,6 +485,7 @@ void wayfire_layer_shell_view::map(wlr_surface *surface)
     handle_app_id_changed(nonull(lsurface->namespace_t));
 
     get_output()->workspace->add_view(self(), get_layer());
+    last_contents.valid = false;
     wf::wlr_view_t::map(surface);
     wf_layer_shell_manager::get_instance().handle_map(this);
 }
@@ -452,6 +496,74 @@ void wayfire_layer_shell_view::unmap()
     wf_layer_shell_manager::get_instance().handle_unmap(this);
 }
 
+/*
+ * Panels and docks often commit a new buffer with the same contents, for ex.
+ * a clock every second. Shm buffers which are damaged as a whole and are
+ * small enough are hashed, so that such commits don't repaint the output.
+ */
+bool wayfire_layer_shell_view::has_new_contents()
+{
+    static wf::option_wrapper_t<bool> skip_identical{
+        "core/layer_shell_skip_identical"};
+    static wf::option_wrapper_t<int> hash_budget{"core/layer_shell_hash_budget"};
+
+    auto previous = last_contents;
+    last_contents.valid = false;
+    if (!skip_identical || !surface || !surface->buffer ||
+        !surface->buffer->resource)
+    {
+        return true;
+    }
+
+    wf::region_t damage;
+    wlr_surface_get_effective_damage(surface, damage.to_pixman());
+    if (damage.empty())
+    {
+        /* Nothing will be repainted anyway, and the contents stay the same */
+        last_contents = previous;
+
+        return true;
+    }
+
+    /* Hashing pays off only if the whole surface would be repainted */
+    wf::region_t whole{wlr_box{0, 0, surface->current.width,
+        surface->current.height}};
+    if (!(whole ^ damage).empty())
+    {
+        return true;
+    }
+
+    auto shm = wl_shm_buffer_get(surface->buffer->resource);
+    if (!shm)
+    {
+        return true;
+    }
+
+    buffer_contents_t contents;
+    contents.width     = wl_shm_buffer_get_width(shm);
+    contents.height    = wl_shm_buffer_get_height(shm);
+    contents.stride    = wl_shm_buffer_get_stride(shm);
+    contents.format    = wl_shm_buffer_get_format(shm);
+    contents.scale     = surface->current.scale;
+    contents.transform = surface->current.transform;
+
+    size_t size = size_t(contents.stride) * contents.height;
+    if (size > size_t(std::max(0, (int)hash_budget)) * 1024)
+    {
+        return true;
+    }
+
+    wl_shm_buffer_begin_access(shm);
+    contents.hash = hash_buffer_contents(
+        (const uint8_t*)wl_shm_buffer_get_data(shm), size);
+    wl_shm_buffer_end_access(shm);
+    contents.valid = true;
+
+    last_contents = contents;
+
+    return !(contents == previous);
+}
+
 void wayfire_layer_shell_view::commit()
 {
     wf::wlr_view_t::commit();
@@ -534,7 +646,7 @@ void wayfire_layer_shell_view::remove_anchored(bool reflow)
 
         if (reflow)
         {
-            get_output()->workspace->reflow_reserved_areas();
+            get_output()->workspace->schedule_reflow_reserved_areas();
         }
     }
 }
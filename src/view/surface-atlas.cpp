@@ -0,0 +1,274 @@
+#include "surface-atlas.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+wf::surface_atlas_t& wf::surface_atlas_t::get()
+{
+    static surface_atlas_t atlas;
+    return atlas;
+}
+
+wf::surface_atlas_t::surface_atlas_t()
+{
+    max_size.set_callback([=] ()
+    {
+        /* Surfaces are added again when they are committed */
+        clear();
+    });
+}
+
+void wf::surface_atlas_t::update_surface(wf::surface_interface_t *surface,
+    wlr_surface *buffer)
+{
+    int limit    = std::min((int)max_size, MAX_CELL_SIZE);
+    auto texture = (buffer && buffer->buffer) ? buffer->buffer->texture : nullptr;
+    if ((limit <= 0) || !texture ||
+        ((int)texture->width > limit) || ((int)texture->height > limit) ||
+        buffer->current.viewport.has_src ||
+        (buffer->current.transform != WL_OUTPUT_TRANSFORM_NORMAL))
+    {
+        remove_surface(surface);
+        return;
+    }
+
+    int cell_size = MIN_CELL_SIZE;
+    while (cell_size < (int)std::max(texture->width, texture->height))
+    {
+        cell_size *= 2;
+    }
+
+    auto it = slots.find(surface);
+    if ((it != slots.end()) && (it->second.page->cell_size != cell_size))
+    {
+        remove_surface(surface);
+        it = slots.end();
+    }
+
+    if (it == slots.end())
+    {
+        slot_t slot;
+        if (!allocate_cell(cell_size, slot))
+        {
+            return;
+        }
+
+        it = slots.emplace(surface, slot).first;
+    }
+
+    auto& slot = it->second;
+    slot.surface = buffer;
+    slot.width   = texture->width;
+    slot.height  = texture->height;
+    slot.dirty   = true;
+}
+
+void wf::surface_atlas_t::remove_surface(wf::surface_interface_t *surface)
+{
+    auto it = slots.find(surface);
+    if (it != slots.end())
+    {
+        free_cell(it->second);
+        slots.erase(it);
+    }
+}
+
+wf::surface_atlas_t::slot_t*wf::surface_atlas_t::find(
+    wf::surface_interface_t *surface, const wf::framebuffer_t& fb)
+{
+    if (slots.empty() || fb.has_nonstandard_transform ||
+        (fb.scale != std::floor(fb.scale)))
+    {
+        return nullptr;
+    }
+
+    auto it = slots.find(surface);
+    if (it == slots.end())
+    {
+        return nullptr;
+    }
+
+    auto size = surface->get_size();
+    if ((it->second.width != size.width * fb.scale) ||
+        (it->second.height != size.height * fb.scale))
+    {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+wf::geometry_t wf::surface_atlas_t::get_cell_box(const slot_t& slot)
+{
+    int per_row = PAGE_SIZE / slot.page->cell_size;
+
+    return {
+        (slot.cell % per_row) * slot.page->cell_size,
+        (slot.cell / per_row) * slot.page->cell_size,
+        slot.width,
+        slot.height,
+    };
+}
+
+bool wf::surface_atlas_t::allocate_cell(int cell_size, slot_t& slot)
+{
+    auto it = std::find_if(pages.begin(), pages.end(), [&] (const auto& page)
+    {
+        return (page->cell_size == cell_size) && !page->free_cells.empty();
+    });
+
+    if (it == pages.end())
+    {
+        auto page = std::make_unique<page_t>();
+        page->cell_size = cell_size;
+
+        OpenGL::render_begin();
+        bool allocated = page->buffer.allocate(PAGE_SIZE, PAGE_SIZE);
+        OpenGL::render_end();
+        if (!allocated)
+        {
+            return false;
+        }
+
+        wf::gpu_memory::set_owner(&page->buffer, "surface atlas");
+
+        /* Hand out the cells from the top left */
+        int per_row = PAGE_SIZE / cell_size;
+        for (int i = per_row * per_row - 1; i >= 0; i--)
+        {
+            page->free_cells.push_back(i);
+        }
+
+        pages.push_back(std::move(page));
+        it = std::prev(pages.end());
+    }
+
+    slot.page = it->get();
+    slot.cell = slot.page->free_cells.back();
+    slot.page->free_cells.pop_back();
+
+    return true;
+}
+
+void wf::surface_atlas_t::free_cell(slot_t& slot)
+{
+    auto page = slot.page;
+    page->free_cells.push_back(slot.cell);
+
+    int per_row = PAGE_SIZE / page->cell_size;
+    if ((int)page->free_cells.size() < per_row * per_row)
+    {
+        return;
+    }
+
+    OpenGL::render_begin();
+    page->buffer.release();
+    OpenGL::render_end();
+    pages.erase(std::find_if(pages.begin(), pages.end(), [&] (const auto& p)
+    {
+        return p.get() == page;
+    }));
+}
+
+void wf::surface_atlas_t::clear()
+{
+    slots.clear();
+    OpenGL::render_begin();
+    for (auto& page : pages)
+    {
+        page->buffer.release();
+    }
+
+    OpenGL::render_end();
+    pages.clear();
+}
+
+void wf::surface_atlas_t::copy_dirty(const std::vector<draw_t>& draws)
+{
+    page_t *bound = nullptr;
+    wf::framebuffer_t target;
+    target.geometry = {0, 0, PAGE_SIZE, PAGE_SIZE};
+    target.viewport_width  = PAGE_SIZE;
+    target.viewport_height = PAGE_SIZE;
+
+    for (auto& draw : draws)
+    {
+        auto& slot = *draw.slot;
+        if (!slot.dirty)
+        {
+            continue;
+        }
+
+        if (slot.page != bound)
+        {
+            if (bound)
+            {
+                OpenGL::render_end();
+            }
+
+            bound      = slot.page;
+            target.fb  = bound->buffer.fb;
+            target.tex = bound->buffer.tex;
+            OpenGL::render_begin(target);
+        }
+
+        /* Premultiplied pixels blended onto a cleared cell stay the same */
+        auto box = get_cell_box(slot);
+        target.logic_scissor(box);
+        OpenGL::clear({0, 0, 0, 0}, GL_COLOR_BUFFER_BIT);
+        OpenGL::render_texture(wf::texture_t{slot.surface}, target, box);
+        slot.dirty = false;
+    }
+
+    if (bound)
+    {
+        OpenGL::render_end();
+    }
+
+    /* The target only borrows the page buffers */
+    target.reset();
+}
+
+void wf::surface_atlas_t::render(const wf::framebuffer_t& fb,
+    const std::vector<draw_t>& draws)
+{
+    copy_dirty(draws);
+
+    page_t *page = nullptr;
+    auto flush   = [&] ()
+    {
+        if (page && !batch.empty())
+        {
+            OpenGL::render_texture_batch(wf::texture_t{page->buffer.tex}, fb,
+                batch);
+        }
+
+        batch.clear();
+    };
+
+    OpenGL::render_begin(fb);
+    for (auto& draw : draws)
+    {
+        if (draw.slot->page != page)
+        {
+            flush();
+            page = draw.slot->page;
+        }
+
+        /* The cell in texture coordinates, see OpenGL::render_texture_damage()
+         * for the mapping of the quad */
+        auto box = get_cell_box(*draw.slot);
+        const float size = PAGE_SIZE;
+        gl_geometry texture_box = {
+            box.x / size,
+            (PAGE_SIZE - box.y - box.height) / size,
+            (box.x + box.width) / size,
+            (PAGE_SIZE - box.y) / size,
+        };
+
+        batch.push_back({draw.geometry, texture_box, draw.damage});
+    }
+
+    flush();
+    OpenGL::render_end();
+}
@@ -0,0 +1,114 @@
+#ifndef WF_SURFACE_ATLAS_HPP
+#define WF_SURFACE_ATLAS_HPP
+
+#include <wayfire/surface.hpp>
+#include <wayfire/opengl.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/nonstd/noncopyable.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace wf
+{
+/**
+ * A texture atlas for the buffers of small surfaces, like tooltips, menus and
+ * panel applets. The buffer of each small surface is copied into a cell of a
+ * shared atlas page when it is committed, so that consecutive small surfaces
+ * can be drawn from the same texture with a single draw call.
+ *
+ * Each page holds cells of a single size, a power of two, so that cells can
+ * be reused without fragmentation. The atlas is disabled unless the option
+ * core/small_surface_atlas is set.
+ */
+class surface_atlas_t : public noncopyable_t
+{
+  public:
+    static surface_atlas_t& get();
+
+    struct page_t;
+
+    /** The cell of a surface in the atlas */
+    struct slot_t
+    {
+        wlr_surface *surface = nullptr;
+        page_t *page = nullptr;
+        int cell     = 0;
+        /* The size of the buffer, in pixels */
+        int width    = 0;
+        int height   = 0;
+        /* Whether the buffer has not been copied to the cell yet */
+        bool dirty   = true;
+    };
+
+    /** A surface to be drawn from the atlas, see render() */
+    struct draw_t
+    {
+        slot_t *slot;
+        wf::geometry_t geometry;
+        const wf::region_t *damage;
+    };
+
+    /**
+     * Update the slot of a surface after its buffer changed. Surfaces which
+     * are too large, have no buffer, or a viewport or buffer transform are
+     * removed from the atlas.
+     */
+    void update_surface(wf::surface_interface_t *surface, wlr_surface *buffer);
+
+    /** Remove the surface from the atlas, if it is in it. */
+    void remove_surface(wf::surface_interface_t *surface);
+
+    /**
+     * @return The slot of the surface, if it is in the atlas and can be drawn
+     *   from it on the given framebuffer, otherwise nullptr. Cells are only
+     *   drawn with one texel per pixel, so neighbouring cells never bleed
+     *   into each other.
+     */
+    slot_t *find(wf::surface_interface_t *surface, const wf::framebuffer_t& fb);
+
+    /**
+     * Draw the given surfaces in order. Consecutive surfaces on the same page
+     * are drawn with a single draw call.
+     *
+     * Must be called outside of a rendering block.
+     */
+    void render(const wf::framebuffer_t& fb, const std::vector<draw_t>& draws);
+
+    struct page_t
+    {
+        int cell_size;
+        wf::framebuffer_base_t buffer;
+        std::vector<int> free_cells;
+    };
+
+  private:
+    surface_atlas_t();
+
+    /** The size of a page, in pixels */
+    static constexpr int PAGE_SIZE = 1024;
+    static constexpr int MIN_CELL_SIZE = 16;
+    static constexpr int MAX_CELL_SIZE = 256;
+
+    wf::option_wrapper_t<int> max_size{"core/small_surface_atlas"};
+
+    std::vector<std::unique_ptr<page_t>> pages;
+    std::unordered_map<wf::surface_interface_t*, slot_t> slots;
+    std::vector<OpenGL::texture_batch_entry_t> batch;
+
+    /** @return A free cell of the given size, allocating a page if needed */
+    bool allocate_cell(int cell_size, slot_t& slot);
+    void free_cell(slot_t& slot);
+    /** Remove all surfaces and free the pages */
+    void clear();
+
+    /** @return The position of the cell in its page */
+    static wf::geometry_t get_cell_box(const slot_t& slot);
+    /** Copy the buffers of the dirty surfaces to their cells */
+    void copy_dirty(const std::vector<draw_t>& draws);
+};
+}
+
+#endif /* end of include guard: WF_SURFACE_ATLAS_HPP */
@@ -2,6 +2,7 @@
 #define SURFACE_IMPL_HPP
 
 #include <wayfire/opengl.hpp>
+#include <wayfire/render-manager.hpp>
 #include <wayfire/surface.hpp>
 #include <wayfire/util.hpp>
 
@@ -38,6 +39,8 @@ class wlr_surface_base_t
     wf::wl_listener_wrapper on_commit, on_destroy, on_new_subsurface;
 
     void apply_surface_damage();
+    /** Expand the given surface-local damage if needed and apply it */
+    void apply_surface_damage(wf::region_t dmg);
     wlr_surface_base_t(wf::surface_interface_t *self);
     /* Pointer to this as surface_interface, see requirement above */
     wf::surface_interface_t *_as_si = nullptr;
@@ -64,12 +67,44 @@ class wlr_surface_base_t
     virtual void _simple_render(const wf::framebuffer_t& fb, int x, int y,
         const wf::region_t& damage);
 
+    /**
+     * Get the texture of the current buffer. The texture attributes are
+     * looked up once per commit, not once per frame. The surface must have a
+     * buffer.
+     */
+    wf::texture_t get_texture();
+
   protected:
     virtual void map(wlr_surface *surface);
     virtual void unmap();
     virtual void commit();
 
     virtual wlr_buffer *get_buffer();
+
+    /**
+     * @return Whether the buffer of the current commit may look different
+     *   than the previous one. If not, the commit damages nothing.
+     */
+    virtual bool has_new_contents()
+    {
+        return true;
+    }
+
+  private:
+    wf::texture_t cached_texture;
+    bool cached_texture_valid = false;
+
+    /*
+     * The damage of the commits of a rate limited client (see
+     * client-accounting.hpp), applied right before the next repaint of
+     * merged_output.
+     */
+    wf::region_t merged_damage;
+    wf::output_t *merged_output = nullptr;
+    wf::effect_hook_t flush_merged_damage;
+    /** Apply the damage of the current commit, or merge it */
+    void merge_or_apply_damage();
+    void cancel_merged_damage();
 };
 
 /**
@@ -1,14 +1,30 @@
 #include <algorithm>
+#include <cmath>
 #include <map>
 #include <wayfire/util/log.hpp>
 #include "surface-impl.hpp"
 #include "subsurface.hpp"
+#include "surface-atlas.hpp"
+#include "view-impl.hpp"
 #include "wayfire/opengl.hpp"
 #include "../core/core-impl.hpp"
+#include "../core/client-accounting.hpp"
 #include "wayfire/output.hpp"
 #include <wayfire/util/log.hpp>
 #include "wayfire/render-manager.hpp"
 #include "wayfire/signal-definitions.hpp"
+#include "wayfire/trace.hpp"
+
+/** Drop the cached surface regions of the view which contains the surface */
+static void invalidate_view_surface_cache(wf::surface_interface_t *surface)
+{
+    auto view = dynamic_cast<wf::view_interface_t*>(surface->get_main_surface());
+    if (view)
+    {
+        view->view_impl->surface_cache_valid = false;
+        ++view->view_impl->contents_serial;
+    }
+}
 
 /****************************
 * surface_interface_t functions
@@ -32,6 +48,7 @@ void wf::surface_interface_t::add_subsurface(
     ev.subsurface   = {subsurface};
 
     container.insert(container.begin(), std::move(subsurface));
+    invalidate_view_surface_cache(this);
     this->emit_signal("subsurface-added", &ev);
 }
 
@@ -52,6 +69,7 @@ void wf::surface_interface_t::remove_subsurface(
 
     remove_from(priv->surface_children_above);
     remove_from(priv->surface_children_below);
+    invalidate_view_surface_cache(this);
 }
 
 wf::surface_interface_t::~surface_interface_t()
@@ -71,35 +89,54 @@ std::vector<wf::surface_iterator_t> wf::surface_interface_t::enumerate_surfaces(
     wf::point_t surface_origin)
 {
     std::vector<wf::surface_iterator_t> result;
-    auto add_surfaces_recursive = [&] (surface_interface_t *child)
+    for_each_surface([&] (const surface_iterator_t& it)
     {
-        if (!child->is_mapped())
-        {
-            return;
-        }
+        result.push_back(it);
+    }, surface_origin);
 
-        auto child_surfaces = child->enumerate_surfaces(
-            child->get_offset() + surface_origin);
-        result.insert(result.end(),
-            child_surfaces.begin(), child_surfaces.end());
-    };
+    return result;
+}
 
+void wf::surface_interface_t::visit_surfaces(const surface_callback_t& callback,
+    wf::point_t surface_origin)
+{
     for (auto& child : priv->surface_children_above)
     {
-        add_surfaces_recursive(child.get());
+        if (child->is_mapped())
+        {
+            child->visit_surfaces(callback, child->get_offset() + surface_origin);
+        }
     }
 
     if (is_mapped())
     {
-        result.push_back({this, surface_origin});
+        callback({this, surface_origin});
     }
 
     for (auto& child : priv->surface_children_below)
     {
-        add_surfaces_recursive(child.get());
+        if (child->is_mapped())
+        {
+            child->visit_surfaces(callback, child->get_offset() + surface_origin);
+        }
     }
+}
 
-    return result;
+bool wf::surface_interface_t::has_mapped_subsurfaces()
+{
+    for (auto children :
+         {& priv->surface_children_above, & priv->surface_children_below})
+    {
+        for (auto& child : *children)
+        {
+            if (child->is_mapped())
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
 }
 
 wf::output_t*wf::surface_interface_t::get_output()
@@ -246,10 +283,18 @@ wf::wlr_surface_base_t::wlr_surface_base_t(surface_interface_t *self)
 
     on_new_subsurface.set_callback(handle_new_subsurface);
     on_commit.set_callback([&] (void*) { commit(); });
+    flush_merged_damage = [=] ()
+    {
+        merged_output = nullptr;
+        apply_surface_damage(std::move(merged_damage));
+    };
 }
 
 wf::wlr_surface_base_t::~wlr_surface_base_t()
-{}
+{
+    cancel_merged_damage();
+    wf::surface_atlas_t::get().remove_surface(_as_si);
+}
 
 
 
@@ -292,6 +337,9 @@ void wf::wlr_surface_base_t::map(wlr_surface *surface)
     this->surface = surface;
 
     _as_si->priv->wsurface = surface;
+    cached_texture_valid   = false;
+    invalidate_view_surface_cache(_as_si);
+    wf::surface_atlas_t::get().update_surface(_as_si, surface);
 
     /* force surface_send_enter(), and also check whether parent surface
      * output hasn't changed while we were unmapped */
@@ -315,6 +363,7 @@ void wf::wlr_surface_base_t::map(wlr_surface *surface)
 void wf::wlr_surface_base_t::unmap()
 {
     assert(this->surface);
+    cancel_merged_damage();
     apply_surface_damage();
     _as_si->damage_surface_box({.x = 0, .y = 0,
         .width = _get_size().width, .height = _get_size().height});
@@ -322,6 +371,9 @@ void wf::wlr_surface_base_t::unmap()
     this->surface->data = NULL;
     this->surface = nullptr;
     this->_as_si->priv->wsurface = nullptr;
+    this->cached_texture_valid   = false;
+    invalidate_view_surface_cache(_as_si);
+    wf::surface_atlas_t::get().remove_surface(_as_si);
     emit_map_state_change(_as_si);
 
     on_new_subsurface.disconnect();
@@ -339,6 +391,62 @@ wlr_buffer*wf::wlr_surface_base_t::get_buffer()
     return nullptr;
 }
 
+/*
+ * When the buffer of a surface is scaled to the output, the texture is sampled
+ * with bilinear filtering: output pixel j covers [j, j + 1) / scale in logical
+ * coordinates, and reads the texels whose centers are less than one texel away
+ * from the center of the pixel. A damaged edge therefore affects the pixels
+ * whose centers are less than half a texel outside of it.
+ *
+ * The functions below return how many logical pixels a damaged edge has to
+ * move outwards, so that after scaling the damage covers those pixels. The
+ * edge is in output-local logical coordinates, so that it is aligned to the
+ * pixel grid of the output.
+ */
+static int filter_expansion_before(int edge, double half_texel, double scale)
+{
+    /* The first pixel whose center is after edge - half_texel */
+    int first = std::floor((edge - half_texel) * scale - 0.5) + 1;
+
+    return std::max(0, edge - (int)std::floor(first / scale));
+}
+
+static int filter_expansion_after(int edge, double half_texel, double scale)
+{
+    /* The last pixel whose center is before edge + half_texel */
+    int last = std::ceil((edge + half_texel) * scale - 0.5) - 1;
+
+    return std::max(0, (int)std::floor(last / scale) + 1 - edge);
+}
+
+/**
+ * Expand the damage of a surface by the footprint of the bilinear filter.
+ *
+ * @param origin The position of the surface in output-local coordinates.
+ */
+static wf::region_t expand_by_filter_footprint(const wf::region_t& damage,
+    wf::point_t origin, int buffer_scale, double scale)
+{
+    const double half_texel = 0.5 / buffer_scale;
+
+    wf::region_t expanded;
+    for (const auto& rect : damage)
+    {
+        int left   = filter_expansion_before(rect.x1 + origin.x, half_texel, scale);
+        int top    = filter_expansion_before(rect.y1 + origin.y, half_texel, scale);
+        int right  = filter_expansion_after(rect.x2 + origin.x, half_texel, scale);
+        int bottom = filter_expansion_after(rect.y2 + origin.y, half_texel, scale);
+        expanded |= wlr_box{
+            rect.x1 - left,
+            rect.y1 - top,
+            rect.x2 - rect.x1 + left + right,
+            rect.y2 - rect.y1 + top + bottom,
+        };
+    }
+
+    return expanded;
+}
+
 void wf::wlr_surface_base_t::apply_surface_damage()
 {
     if (!_as_si->get_output() || !_is_mapped())
@@ -348,11 +456,46 @@ void wf::wlr_surface_base_t::apply_surface_damage()
 
     wf::region_t dmg;
     wlr_surface_get_effective_damage(surface, dmg.to_pixman());
+    apply_surface_damage(std::move(dmg));
+}
+
+void wf::wlr_surface_base_t::apply_surface_damage(wf::region_t dmg)
+{
+    if (!_as_si->get_output() || !_is_mapped() || dmg.empty())
+    {
+        return;
+    }
 
-    if ((surface->current.scale != 1) ||
-        (surface->current.scale != _as_si->get_output()->handle->scale))
+    /* If the buffer scale matches the output, each texel lands exactly on one
+     * output pixel, because surfaces are at integer logical positions */
+    double scale = _as_si->get_output()->handle->scale;
+    if (surface->current.scale == scale)
+    {
+        _as_si->damage_surface_region(dmg);
+
+        return;
+    }
+
+    /* Find where the surface is shown on the output. Transformers render the
+     * view at an arbitrary place, so expand conservatively for them. */
+    wf::point_t origin = {0, 0};
+    auto root = _as_si;
+    while (root->priv->parent_surface)
+    {
+        origin = origin + root->get_offset();
+        root   = root->priv->parent_surface;
+    }
+
+    auto view = dynamic_cast<wf::view_interface_t*>(root);
+    if (!view || view->has_transformer())
     {
         dmg.expand_edges(1);
+    } else
+    {
+        auto obox = view->get_output_geometry();
+        origin = origin + wf::point_t{obox.x, obox.y};
+        dmg    = expand_by_filter_footprint(dmg, origin,
+            surface->current.scale, scale);
     }
 
     _as_si->damage_surface_region(dmg);
@@ -360,18 +503,67 @@ void wf::wlr_surface_base_t::apply_surface_damage()
 
 void wf::wlr_surface_base_t::commit()
 {
-    apply_surface_damage();
+    WF_TRACE_SCOPE("surface commit");
+    /* The buffer, and with it the texture, can change only on commit */
+    cached_texture_valid = false;
+    /* Subsurfaces may have moved even if the contents are the same */
+    invalidate_view_surface_cache(_as_si);
+    if (has_new_contents())
+    {
+        wf::surface_atlas_t::get().update_surface(_as_si, surface);
+        merge_or_apply_damage();
+    }
+
     if (_as_si->get_output())
     {
-        /* we schedule redraw, because the surface might expect
-         * a frame callback */
-        _as_si->get_output()->render->schedule_redraw();
+        /* The damage, if any, has scheduled a repaint already, but the
+         * surface might expect a frame callback in any case */
+        _as_si->get_output()->render->schedule_frame_done();
     }
 }
 
+void wf::wlr_surface_base_t::merge_or_apply_damage()
+{
+    auto output = _as_si->get_output();
+    if (!output ||
+        !wf::client_accounting::account_commit(wl_resource_get_client(
+            surface->resource)))
+    {
+        apply_surface_damage();
+
+        return;
+    }
+
+    /* The surface contents are read only when painting, so damaging them
+     * once before the repaint shows the same as damaging on every commit */
+    wf::region_t dmg;
+    wlr_surface_get_effective_damage(surface, dmg.to_pixman());
+    merged_damage |= dmg;
+    merged_output  = output;
+    output->render->run_before_paint(&flush_merged_damage);
+}
+
+void wf::wlr_surface_base_t::cancel_merged_damage()
+{
+    if (merged_output)
+    {
+        merged_output->render->rem_before_paint(&flush_merged_damage);
+        merged_output = nullptr;
+    }
+
+    merged_damage.clear();
+}
+
 void wf::wlr_surface_base_t::update_output(wf::output_t *old_output,
     wf::output_t *new_output)
 {
+    /* Don't leave the hook on the old output, which may be going away */
+    if (merged_output && (merged_output != new_output))
+    {
+        merged_output->render->rem_before_paint(&flush_merged_damage);
+        flush_merged_damage();
+    }
+
     /* We should send send_leave only if the output is different from the last. */
     if (old_output && (old_output != new_output) && surface)
     {
@@ -384,6 +576,17 @@ void wf::wlr_surface_base_t::update_output(wf::output_t *old_output,
     }
 }
 
+wf::texture_t wf::wlr_surface_base_t::get_texture()
+{
+    if (!cached_texture_valid)
+    {
+        cached_texture = wf::texture_t{surface};
+        cached_texture_valid = true;
+    }
+
+    return cached_texture;
+}
+
 void wf::wlr_surface_base_t::_simple_render(const wf::framebuffer_t& fb,
     int x, int y, const wf::region_t& damage)
 {
@@ -394,13 +597,33 @@ void wf::wlr_surface_base_t::_simple_render(const wf::framebuffer_t& fb,
 
     auto size = this->_get_size();
     wf::geometry_t geometry = {x, y, size.width, size.height};
-    wf::texture_t texture{surface};
+    wf::texture_t texture = get_texture();
+
+    /* Draw the opaque parts without blending. RGBX textures are opaque
+     * everywhere, see TEXTURE_OPAQUE. */
+    wf::region_t opaque;
+    if (texture.type != wf::TEXTURE_TYPE_RGBX)
+    {
+        opaque = _as_si->get_opaque_region({x, y});
+        /* When scaling, the pixels at the edges of the opaque region blend
+         * in texels from outside of it */
+        if (fb.scale != surface->current.scale)
+        {
+            opaque.expand_edges(-1);
+        }
+
+        opaque &= damage;
+    }
 
     OpenGL::render_begin(fb);
-    for (const auto& rect : damage)
+    if (opaque.empty())
+    {
+        OpenGL::render_texture_damage(texture, fb, geometry, damage);
+    } else
     {
-        fb.logic_scissor(wlr_box_from_pixman_box(rect));
-        OpenGL::render_texture(texture, fb, geometry);
+        OpenGL::render_texture_damage(texture, fb, geometry, opaque,
+            glm::vec4(1.f), OpenGL::TEXTURE_OPAQUE);
+        OpenGL::render_texture_damage(texture, fb, geometry, damage ^ opaque);
     }
 
     OpenGL::render_end();
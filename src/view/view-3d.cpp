@@ -43,6 +43,43 @@ void wf::view_transformer_t::render_with_damage(wf::texture_t src_tex,
     }
 }
 
+/**
+ * Transform the opaque region with a transformer which maps axis-aligned
+ * rectangles to axis-aligned rectangles. Only the pixels which are fully
+ * covered by a transformed rectangle are kept. Scaled rectangles lose one more
+ * pixel on each side, because their edges are filtered with the pixels
+ * outside of them.
+ */
+static wf::region_t transform_opaque_rects(wf::view_transformer_t *transformer,
+    wf::geometry_t box, const wf::region_t& region)
+{
+    wf::region_t result;
+    for (const auto& rect : region)
+    {
+        auto p1 = transformer->transform_point(box, {1.0 * rect.x1, 1.0 * rect.y1});
+        auto p2 = transformer->transform_point(box, {1.0 * rect.x2, 1.0 * rect.y2});
+
+        int x1 = std::ceil(std::min(p1.x, p2.x));
+        int y1 = std::ceil(std::min(p1.y, p2.y));
+        int x2 = std::floor(std::max(p1.x, p2.x));
+        int y2 = std::floor(std::max(p1.y, p2.y));
+        if ((x2 - x1 != rect.x2 - rect.x1) || (y2 - y1 != rect.y2 - rect.y1))
+        {
+            x1++;
+            y1++;
+            x2--;
+            y2--;
+        }
+
+        if ((x1 < x2) && (y1 < y2))
+        {
+            result |= wf::geometry_t{x1, y1, x2 - x1, y2 - y1};
+        }
+    }
+
+    return result;
+}
+
 struct transformable_quad
 {
     gl_geometry geometry;
@@ -104,45 +141,48 @@ wf::view_2D::view_2D(wayfire_view view)
     this->view = view;
 }
 
-static void rotate_xy(float& x, float& y, float angle)
+void wf::view_2D::update_linear()
 {
-    auto v   = glm::vec4{x, y, 0, 1};
-    auto rot = glm::rotate(glm::mat4(1.0), angle, {0, 0, 1});
-    v = rot * v;
-    x = v.x;
-    y = v.y;
+    if ((linear.angle == angle) &&
+        (linear.scale_x == scale_x) && (linear.scale_y == scale_y))
+    {
+        return;
+    }
+
+    /* Scale first, then rotate counter-clockwise */
+    float c = std::cos(angle), s = std::sin(angle);
+    linear.matrix = glm::mat2{c, s, -s, c} *
+        glm::mat2{scale_x, 0.0f, 0.0f, scale_y};
+    linear.inverse = glm::mat2{1.0f / scale_x, 0.0f, 0.0f, 1.0f / scale_y} *
+        glm::mat2{c, -s, s, c};
+
+    linear.angle   = angle;
+    linear.scale_x = scale_x;
+    linear.scale_y = scale_y;
 }
 
 wf::pointf_t wf::view_2D::transform_point(
     wf::geometry_t geometry, wf::pointf_t point)
 {
-    auto p2 = get_center_relative_coords(view->get_wm_geometry(), point);
-    float x = p2.x, y = p2.y;
-
-    x *= scale_x;
-    y *= scale_y;
-    rotate_xy(x, y, angle);
-    x += translation_x;
-    y -= translation_y;
-
-    auto r = get_absolute_coords_from_relative(view->get_wm_geometry(), {x, y});
+    update_linear();
+    auto wm = view->get_wm_geometry();
+    auto p2 = get_center_relative_coords(wm, point);
+    auto v  = linear.matrix * glm::vec2{p2.x, p2.y};
 
-    return r;
+    return get_absolute_coords_from_relative(wm,
+        {v.x + translation_x, v.y - translation_y});
 }
 
 wf::pointf_t wf::view_2D::untransform_point(
     wf::geometry_t geometry, wf::pointf_t point)
 {
-    point = get_center_relative_coords(view->get_wm_geometry(), point);
-    float x = point.x, y = point.y;
+    update_linear();
+    auto wm = view->get_wm_geometry();
+    point = get_center_relative_coords(wm, point);
+    auto v = linear.inverse *
+        glm::vec2{point.x - translation_x, point.y + translation_y};
 
-    x -= translation_x;
-    y += translation_y;
-    rotate_xy(x, y, -angle);
-    x /= scale_x;
-    y /= scale_y;
-
-    return get_absolute_coords_from_relative(view->get_wm_geometry(), {x, y});
+    return get_absolute_coords_from_relative(wm, {v.x, v.y});
 }
 
 void wf::view_2D::render_box(wf::texture_t src_tex, wlr_box src_box,
@@ -151,12 +191,8 @@ void wf::view_2D::render_box(wf::texture_t src_tex, wlr_box src_box,
     auto quad =
         center_geometry(fb.geometry, src_box, get_center(view->get_wm_geometry()));
 
-    quad.geometry.x1 *= scale_x;
-    quad.geometry.x2 *= scale_x;
-    quad.geometry.y1 *= scale_y;
-    quad.geometry.y2 *= scale_y;
-
-    auto rotate    = glm::rotate(glm::mat4(1.0), angle, {0, 0, 1});
+    update_linear();
+    auto rotate    = glm::mat4(linear.matrix);
     auto translate = glm::translate(glm::mat4(1.0),
     {quad.off_x + translation_x,
         quad.off_y - translation_y, 0});
@@ -173,6 +209,39 @@ void wf::view_2D::render_box(wf::texture_t src_tex, wlr_box src_box,
     OpenGL::render_end();
 }
 
+std::optional<wf::affine_transform_t> wf::view_2D::get_affine_transform(
+    wf::geometry_t geometry)
+{
+    /* The same transformation as in render_box(), but in output-local
+     * coordinates, where Y points down */
+    update_linear();
+    auto center = get_center(view->get_wm_geometry());
+    auto flip_y = glm::scale(glm::mat4(1.0), {1.0f, -1.0f, 1.0f});
+
+    affine_transform_t transform;
+    transform.matrix =
+        glm::translate(glm::mat4(1.0),
+            {center.x + translation_x, center.y + translation_y, 0}) *
+        flip_y * glm::mat4(linear.matrix) * flip_y *
+        glm::translate(glm::mat4(1.0), {-center.x, -center.y, 0});
+    transform.alpha = alpha;
+
+    return transform;
+}
+
+wf::region_t wf::view_2D::transform_opaque_region(
+    wf::geometry_t box, wf::region_t region)
+{
+    update_linear();
+    if ((alpha < 1.0f) || (linear.matrix[0][1] != 0.0f) ||
+        (linear.matrix[1][0] != 0.0f))
+    {
+        return {};
+    }
+
+    return transform_opaque_rects(this, box, region);
+}
+
 const float wf::view_3D::fov = PI / 4;
 glm::mat4 wf::view_3D::default_view_matrix()
 {
@@ -193,14 +262,32 @@ wf::view_3D::view_3D(wayfire_view view)
     view_proj  = default_proj_matrix() * default_view_matrix();
 }
 
-/* TODO: cache total_transform, because it is often unnecessarily recomputed */
 glm::mat4 wf::view_3D::calculate_total_transform()
 {
     auto og = view->get_output()->get_relative_geometry();
+    int output_size = std::min(og.width, og.height);
+
+    /* The matrices are set directly by the plugins, so they are compared
+     * instead of tracking when they change */
+    if (cached.valid && (cached.output_size == output_size) &&
+        (cached.translation == translation) && (cached.view_proj == view_proj) &&
+        (cached.rotation == rotation) && (cached.scaling == scaling))
+    {
+        return cached.total;
+    }
+
     glm::mat4 depth_scale =
-        glm::scale(glm::mat4(1.0), {1, 1, 2.0 / std::min(og.width, og.height)});
+        glm::scale(glm::mat4(1.0), {1, 1, 2.0 / output_size});
+
+    cached.valid       = true;
+    cached.output_size = output_size;
+    cached.translation = translation;
+    cached.view_proj   = view_proj;
+    cached.rotation    = rotation;
+    cached.scaling     = scaling;
+    cached.total = translation * view_proj * depth_scale * rotation * scaling;
 
-    return translation * view_proj * depth_scale * rotation * scaling;
+    return cached.total;
 }
 
 wf::pointf_t wf::view_3D::transform_point(
@@ -226,6 +313,22 @@ wf::pointf_t wf::view_3D::transform_point(
     return get_absolute_coords_from_relative(geometry, {v.x, v.y});
 }
 
+wf::region_t wf::view_3D::transform_opaque_region(
+    wf::geometry_t box, wf::region_t region)
+{
+    /* The view stays axis-aligned if X and Y after the projection do not
+     * depend on each other, and the W coordinate depends on neither, for
+     * example without rotation and with the default projection */
+    auto m = calculate_total_transform();
+    if ((color.a < 1.0f) || (m[1][0] != 0.0f) || (m[0][1] != 0.0f) ||
+        (m[0][3] != 0.0f) || (m[1][3] != 0.0f))
+    {
+        return {};
+    }
+
+    return transform_opaque_rects(this, box, region);
+}
+
 /* TODO: is there a way to realiably reverse projective transformations? */
 wf::pointf_t wf::view_3D::untransform_point(wf::geometry_t geometry,
     wf::pointf_t point)
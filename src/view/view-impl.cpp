@@ -6,6 +6,7 @@
 #include "wayfire/signal-definitions.hpp"
 #include "wayfire/workspace-manager.hpp"
 #include <wayfire/util/log.hpp>
+#include <algorithm>
 
 #include "xdg-shell.hpp"
 
@@ -25,7 +26,7 @@ void wf::wlr_view_t::set_role(view_role_t new_role)
 void wf::wlr_view_t::handle_app_id_changed(std::string new_app_id)
 {
     this->app_id = new_app_id;
-    toplevel_send_app_id();
+    toplevel_schedule_update(TOPLEVEL_UPDATE_APP_ID);
 
     app_id_changed_signal data;
     data.view = self();
@@ -39,8 +40,48 @@ std::string wf::wlr_view_t::get_app_id()
 
 void wf::wlr_view_t::handle_title_changed(std::string new_title)
 {
+    if (new_title == this->title)
+    {
+        return;
+    }
+
     this->title = new_title;
-    toplevel_send_title();
+    if (title_change_pending)
+    {
+        /* The signal will carry the latest title anyway */
+        return;
+    }
+
+    /* Some clients change their title many times per second, for ex. to show
+     * progress. Notify about it at most once per output frame. */
+    uint32_t frame_ms = 1000 / 60;
+    if (get_output() && (get_output()->handle->refresh > 0))
+    {
+        frame_ms = 1000000 / get_output()->handle->refresh;
+    }
+
+    uint32_t elapsed = wf::get_current_time() - last_title_change;
+    if (elapsed >= frame_ms)
+    {
+        emit_title_changed();
+
+        return;
+    }
+
+    title_change_pending = true;
+    title_change_timer.set_timeout(frame_ms - elapsed, [=] ()
+    {
+        emit_title_changed();
+
+        return false;
+    });
+}
+
+void wf::wlr_view_t::emit_title_changed()
+{
+    title_change_pending = false;
+    last_title_change    = wf::get_current_time();
+    toplevel_schedule_update(TOPLEVEL_UPDATE_TITLE);
 
     title_changed_signal data;
     data.view = self();
@@ -103,6 +144,22 @@ wf::region_t wf::wlr_view_t::get_transformed_opaque_region()
     return region;
 }
 
+void wf::wlr_view_t::emit_geometry_changed_signal(
+    view_geometry_changed_signal& data)
+{
+    /* Emitted very often, so avoid looking up the signal names each time */
+    static const wf::signal_id_t geometry_changed{"geometry-changed"};
+    static const wf::signal_id_t view_geometry_changed{"view-geometry-changed"};
+
+    emit_signal(geometry_changed, &data);
+    view_impl->queue_frame_geometry(this, data.old_geometry);
+    wf::get_core().emit_signal(view_geometry_changed, &data);
+    if (get_output())
+    {
+        get_output()->emit_signal(view_geometry_changed, &data);
+    }
+}
+
 void wf::wlr_view_t::set_position(int x, int y,
     wf::geometry_t old_geometry, bool send_signal)
 {
@@ -130,12 +187,7 @@ void wf::wlr_view_t::set_position(int x, int y,
 
     if (send_signal)
     {
-        emit_signal("geometry-changed", &data);
-        wf::get_core().emit_signal("view-geometry-changed", &data);
-        if (get_output())
-        {
-            get_output()->emit_signal("view-geometry-changed", &data);
-        }
+        emit_geometry_changed_signal(data);
     }
 
     last_bounding_box = get_bounding_box();
@@ -194,12 +246,7 @@ void wf::wlr_view_t::update_size()
     /* Damage new size */
     last_bounding_box = get_bounding_box();
     view_damage_raw(self(), last_bounding_box);
-    emit_signal("geometry-changed", &data);
-    wf::get_core().emit_signal("view-geometry-changed", &data);
-    if (get_output())
-    {
-        get_output()->emit_signal("view-geometry-changed", &data);
-    }
+    emit_geometry_changed_signal(data);
 
     if (view_impl->frame)
     {
@@ -467,11 +514,46 @@ void wf::wlr_view_t::destroy_toplevel()
     toplevel_handle_v1_minimize_request.disconnect();
     toplevel_handle_v1_set_rectangle_request.disconnect();
     toplevel_handle_v1_close_request.disconnect();
+    toplevel_update_idle.disconnect();
+    toplevel_pending_updates = 0;
+    toplevel_sent_title.clear();
+    toplevel_sent_app_id.clear();
 
     wlr_foreign_toplevel_handle_v1_destroy(toplevel_handle);
     toplevel_handle = nullptr;
 }
 
+void wf::wlr_view_t::toplevel_schedule_update(uint32_t parts)
+{
+    if (!toplevel_handle)
+    {
+        return;
+    }
+
+    toplevel_pending_updates |= parts;
+    toplevel_update_idle.run_once([=] ()
+    {
+        uint32_t pending = toplevel_pending_updates;
+        toplevel_pending_updates = 0;
+        if (pending & TOPLEVEL_UPDATE_TITLE)
+        {
+            toplevel_send_title();
+        }
+
+        if (pending & TOPLEVEL_UPDATE_APP_ID)
+        {
+            toplevel_send_app_id();
+        }
+
+        /* The state setters of wlroots skip values which didn't change, so
+         * focusing views back and forth sends nothing. */
+        if (pending & TOPLEVEL_UPDATE_STATE)
+        {
+            toplevel_send_state();
+        }
+    });
+}
+
 void wf::wlr_view_t::toplevel_send_title()
 {
     if (!toplevel_handle)
@@ -479,8 +561,25 @@ void wf::wlr_view_t::toplevel_send_title()
         return;
     }
 
+    if (get_title() == toplevel_sent_title)
+    {
+        return;
+    }
+
+    toplevel_sent_title = get_title();
     wlr_foreign_toplevel_handle_v1_set_title(toplevel_handle,
-        get_title().c_str());
+        toplevel_sent_title.c_str());
+}
+
+void wf::wlr_view_t::toplevel_set_app_id(const std::string& app_id)
+{
+    if (!toplevel_handle || (app_id == toplevel_sent_app_id))
+    {
+        return;
+    }
+
+    toplevel_sent_app_id = app_id;
+    wlr_foreign_toplevel_handle_v1_set_app_id(toplevel_handle, app_id.c_str());
 }
 
 void wf::wlr_view_t::toplevel_send_app_id()
@@ -510,7 +609,7 @@ void wf::wlr_view_t::toplevel_send_app_id()
         app_id = default_app_id;
     }
 
-    wlr_foreign_toplevel_handle_v1_set_app_id(toplevel_handle, app_id.c_str());
+    toplevel_set_app_id(app_id);
 }
 
 void wf::wlr_view_t::toplevel_send_state()
@@ -551,7 +650,7 @@ void wf::wlr_view_t::toplevel_update_output(wf::output_t *wo, bool enter)
 
 void wf::wlr_view_t::desktop_state_updated()
 {
-    toplevel_send_state();
+    toplevel_schedule_update(TOPLEVEL_UPDATE_STATE);
 }
 
 void wf::init_desktop_apis()
@@ -615,3 +714,170 @@ wayfire_view wf::wl_surface_to_wayfire_view(wl_resource *resource)
 
     return view ? view->self() : nullptr;
 }
+
+wf::offscreen_buffer_pool_t& wf::offscreen_buffer_pool_t::get()
+{
+    static offscreen_buffer_pool_t pool;
+
+    return pool;
+}
+
+wf::offscreen_buffer_pool_t::offscreen_buffer_pool_t()
+{
+    on_memory_pressure = [=] ()
+    {
+        OpenGL::render_begin();
+        for (auto& free : free_buffers)
+        {
+            free.buffer.release();
+        }
+
+        OpenGL::render_end();
+        free_buffers.clear();
+    };
+    wf::gpu_memory::add_pressure_callback(&on_memory_pressure);
+}
+
+bool wf::offscreen_buffer_pool_t::allocate(wf::framebuffer_base_t& buffer,
+    int width, int height, std::function<bool()> can_evict,
+    std::function<void()> on_downsample)
+{
+    bool undefined = false;
+    if (buffer.fb == (uint32_t)-1)
+    {
+        auto it = std::find_if(free_buffers.begin(), free_buffers.end(),
+            [&] (const free_buffer_t& free)
+        {
+            return free.buffer.viewport_width == width &&
+            free.buffer.viewport_height == height;
+        });
+
+        if (it != free_buffers.end())
+        {
+            buffer = std::move(it->buffer);
+            free_buffers.erase(it);
+        }
+
+        undefined = true;
+    }
+
+    undefined |= buffer.allocate(width, height);
+    used_buffers[&buffer] = {++use_counter, std::move(can_evict),
+        std::move(on_downsample)};
+    enforce_budget(&buffer);
+
+    return undefined;
+}
+
+void wf::offscreen_buffer_pool_t::release(wf::framebuffer_base_t& buffer)
+{
+    used_buffers.erase(&buffer);
+    if (buffer.fb == (uint32_t)-1)
+    {
+        return;
+    }
+
+    wf::gpu_memory::set_owner(&buffer, "free offscreen buffers");
+    free_buffers.push_back({std::move(buffer), ++use_counter});
+    enforce_budget(nullptr);
+}
+
+void wf::offscreen_buffer_pool_t::enforce_budget(wf::framebuffer_base_t *keep)
+{
+    auto size_of = [] (const wf::framebuffer_base_t& buffer)
+    {
+        return int64_t(buffer.viewport_width) * buffer.viewport_height * 4;
+    };
+
+    const int64_t budget = int64_t(budget_mb) * 1024 * 1024;
+    int64_t total = 0;
+    for (auto& [buffer, used] : used_buffers)
+    {
+        total += size_of(*buffer);
+    }
+
+    for (auto& free : free_buffers)
+    {
+        total += size_of(free.buffer);
+    }
+
+    /* Released buffers go first, oldest first. They are kept in the order
+     * they were released. */
+    while (total > budget && !free_buffers.empty())
+    {
+        total -= size_of(free_buffers.front().buffer);
+        free_buffers.front().buffer.release();
+        free_buffers.erase(free_buffers.begin());
+    }
+
+    while (total > budget)
+    {
+        auto victim = used_buffers.end();
+        for (auto it = used_buffers.begin(); it != used_buffers.end(); ++it)
+        {
+            if ((it->first == keep) || !it->second.can_evict ||
+                !it->second.can_evict())
+            {
+                continue;
+            }
+
+            if ((victim == used_buffers.end()) ||
+                (it->second.last_used < victim->second.last_used))
+            {
+                victim = it;
+            }
+        }
+
+        if (victim != used_buffers.end())
+        {
+            total -= size_of(*victim->first);
+            victim->first->release();
+            used_buffers.erase(victim);
+            continue;
+        }
+
+        /* Nothing can be freed, reduce the resolution of the least recently
+         * used buffers which allow it instead */
+        for (auto it = used_buffers.begin(); it != used_buffers.end(); ++it)
+        {
+            if ((it->first == keep) || !it->second.on_downsample ||
+                (it->first->viewport_width < 2 * MIN_DOWNSAMPLE_SIZE) ||
+                (it->first->viewport_height < 2 * MIN_DOWNSAMPLE_SIZE))
+            {
+                continue;
+            }
+
+            if ((victim == used_buffers.end()) ||
+                (it->second.last_used < victim->second.last_used))
+            {
+                victim = it;
+            }
+        }
+
+        if (victim == used_buffers.end())
+        {
+            break;
+        }
+
+        total -= size_of(*victim->first);
+        downsample(*victim->first);
+        total += size_of(*victim->first);
+        victim->second.on_downsample();
+    }
+}
+
+void wf::offscreen_buffer_pool_t::downsample(wf::framebuffer_base_t& buffer)
+{
+    int width  = buffer.viewport_width;
+    int height = buffer.viewport_height;
+
+    wf::framebuffer_base_t half;
+    half.allocate(width / 2, height / 2);
+
+    OpenGL::bind_framebuffer(GL_READ_FRAMEBUFFER, buffer.fb);
+    OpenGL::bind_framebuffer(GL_DRAW_FRAMEBUFFER, half.fb);
+    GL_CALL(glBlitFramebuffer(0, 0, width, height, 0, 0, width / 2, height / 2,
+        GL_COLOR_BUFFER_BIT, GL_LINEAR));
+
+    buffer = std::move(half);
+}
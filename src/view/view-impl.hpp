@@ -4,6 +4,10 @@
 #include <wayfire/nonstd/safe-list.hpp>
 #include <wayfire/view.hpp>
 #include <wayfire/opengl.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <unordered_map>
+#include <list>
 
 #include "surface-impl.hpp"
 #include <wayfire/nonstd/wlroots-full.hpp>
@@ -16,12 +20,95 @@ struct wlr_seat;
 namespace wf
 {
 struct sublayer_t;
+struct view_geometry_changed_signal;
+
+/**
+ * A global pool for the offscreen buffers of views, i.e. their snapshots and
+ * the intermediate buffers of transformers.
+ *
+ * Released buffers are kept for reuse by buffers of the same size, e.g. when
+ * scale is activated again. If the buffers take more memory than the budget
+ * given by core/offscreen_buffer_budget, the least recently used released
+ * buffers are freed first, then the least recently used evictable buffers.
+ * As a last resort, buffers which can't be regenerated but allow it are
+ * downsampled to half their resolution.
+ *
+ * All functions should be called inside render_begin/end().
+ */
+class offscreen_buffer_pool_t : public noncopyable_t
+{
+  public:
+    static offscreen_buffer_pool_t& get();
+
+    /**
+     * Make sure the buffer is allocated with the given size, reusing a
+     * released buffer if possible, and mark it as recently used.
+     *
+     * @param can_evict If set, the pool may free the buffer when it is over
+     *   budget and can_evict() returns true. The owner then finds the buffer
+     *   invalid. Otherwise, the buffer is never taken away.
+     *
+     * @param on_downsample If set, the pool may replace the buffer with a
+     *   copy at half the resolution when it is over budget and the buffer
+     *   can't be evicted. on_downsample() is called afterwards.
+     *
+     * @return true if the contents of the buffer are undefined.
+     */
+    bool allocate(wf::framebuffer_base_t& buffer, int width, int height,
+        std::function<bool()> can_evict = nullptr,
+        std::function<void()> on_downsample = nullptr);
+
+    /** Give the buffer back to the pool. No-op if it isn't allocated. */
+    void release(wf::framebuffer_base_t& buffer);
+
+  private:
+    offscreen_buffer_pool_t();
+
+    /** Free the released buffers when GPU memory runs low */
+    std::function<void()> on_memory_pressure;
+
+    struct used_buffer_t
+    {
+        uint64_t last_used;
+        std::function<bool()> can_evict;
+        std::function<void()> on_downsample;
+    };
+
+    /* Buffers are not downsampled below this size */
+    static constexpr int MIN_DOWNSAMPLE_SIZE = 64;
+
+    struct free_buffer_t
+    {
+        wf::framebuffer_base_t buffer;
+        uint64_t last_used;
+    };
+
+    std::unordered_map<wf::framebuffer_base_t*, used_buffer_t> used_buffers;
+    std::vector<free_buffer_t> free_buffers;
+    uint64_t use_counter = 0;
+
+    wf::option_wrapper_t<int> budget_mb{"core/offscreen_buffer_budget"};
+
+    /** Free buffers until the pool fits in the budget, never touching keep */
+    void enforce_budget(wf::framebuffer_base_t *keep);
+
+    /** Replace the buffer with a copy at half its resolution */
+    void downsample(wf::framebuffer_base_t& buffer);
+};
+
 struct view_transform_block_t : public noncopyable_t
 {
     std::string plugin_name = "";
     std::unique_ptr<wf::view_transformer_t> transform;
     wf::framebuffer_t fb;
 
+    /**
+     * The parts of fb which are out of date, in the coordinate system of the
+     * view after applying this transformer (i.e the same as fb.geometry).
+     * Only used for transformers which render to an intermediate buffer.
+     */
+    wf::region_t cached_damage;
+
     view_transform_block_t();
     ~view_transform_block_t();
 };
@@ -61,9 +148,65 @@ class view_interface_t::view_priv_impl
     int in_continuous_move   = 0;
     int in_continuous_resize = 0;
     int visibility_counter   = 1;
+    view_visibility_t visibility_state = VIEW_VISIBILITY_VISIBLE;
 
     wf::safe_list_t<std::shared_ptr<view_transform_block_t>> transforms;
 
+    /**
+     * Carry the given damage through the transformer chain, adding it to the
+     * cached damage of each transformer's intermediate buffer.
+     *
+     * @param view_box The untransformed bounding box of the view.
+     * @param damage The damaged box, before applying any transformers.
+     */
+    void damage_transformers(wf::geometry_t view_box, wlr_box damage);
+
+    /**
+     * A mapped surface of the view, with its position relative to the origin
+     * of the view's output geometry.
+     */
+    struct cached_surface_t
+    {
+        wf::surface_interface_t *surface;
+        wf::point_t position;
+        /**
+         * If a subsurface tree of the view starts here, the index after its
+         * last surface and the bounding box of the tree. Otherwise 0.
+         */
+        size_t subtree_end = 0;
+        wf::geometry_t subtree_box;
+    };
+
+    /**
+     * The opaque region and the bounding box of all surfaces of the view, and
+     * the surfaces themselves, relative to the origin of the view's output
+     * geometry and before applying transformers.
+     *
+     * They are invalidated when a surface of the view is committed, mapped or
+     * unmapped, when subsurfaces are added or removed, or when the view size
+     * changes.
+     */
+    wf::region_t cached_opaque_region;
+    wf::geometry_t cached_bounding_box;
+    wf::dimensions_t cached_size = {0, 0};
+    bool surface_cache_valid = false;
+    /* Incremented whenever the surface cache is invalidated, so that buffers
+     * showing the surfaces of the view can tell when they are outdated */
+    uint64_t contents_serial = 0;
+    std::vector<cached_surface_t> cached_surfaces;
+    /* The shrink constraint the cached opaque region was calculated with */
+    int opaque_region_shrink = 0;
+
+    /** Recalculate the cached regions if they are invalid */
+    void update_surface_cache(wf::view_interface_t *self);
+
+    /**
+     * The mapped surfaces of the view, in the order of for_each_surface(),
+     * cached together with the regions above.
+     */
+    const std::vector<cached_surface_t>& get_cached_surfaces(
+        wf::view_interface_t *self);
+
     struct offscreen_buffer_t : public wf::framebuffer_t
     {
         wf::region_t cached_damage;
@@ -77,10 +220,31 @@ class view_interface_t::view_priv_impl
 
     /** The sublayer of the view. For workspace-manager. */
     nonstd::observer_ptr<sublayer_t> sublayer;
+    /** The position of the view in its sublayer. For workspace-manager. */
+    std::list<wayfire_view>::iterator sublayer_pos;
     /* Promoted to the fullscreen layer? For workspace-manager. */
     bool is_promoted = false;
 
+    /**
+     * Schedule geometry-changed-frame after a change of the wm geometry, for
+     * the next repaint of the view's output, or when idle without an output.
+     */
+    void queue_frame_geometry(wf::view_interface_t *self,
+        wf::geometry_t old_geometry);
+    /** Emit the pending geometry-changed-frame now, if any */
+    void flush_frame_geometry(wf::view_interface_t *self);
+    /** Drop the pending geometry-changed-frame, if any */
+    void cancel_frame_geometry();
+
   private:
+    /* The wm geometry before the first change since the last
+     * geometry-changed-frame, valid while one is pending */
+    wf::geometry_t frame_old_geometry;
+    bool frame_geometry_pending = false;
+    wf::output_t *frame_geometry_output = nullptr;
+    wf::effect_hook_t emit_frame_geometry;
+    wf::wl_idle_call idle_frame_geometry;
+
     /** Last geometry the view has had in non-tiled and non-fullscreen state.
      * -1 as width/height means that no such geometry has been stored. */
     wf::geometry_t last_windowed_geometry = {0, 0, -1, -1};
@@ -135,12 +299,33 @@ class wlr_view_t :
     virtual void set_output(wf::output_t*) override;
     bool has_client_decoration = true;
 
+    enum toplevel_update_t
+    {
+        TOPLEVEL_UPDATE_TITLE  = (1 << 0),
+        TOPLEVEL_UPDATE_APP_ID = (1 << 1),
+        TOPLEVEL_UPDATE_STATE  = (1 << 2),
+    };
+
+    /**
+     * Send the given parts (a bitmask of toplevel_update_t) of the toplevel
+     * to foreign-toplevel clients when the event loop goes idle. Repeated
+     * changes until then result in a single update with the final state.
+     */
+    void toplevel_schedule_update(uint32_t parts);
+
   protected:
     std::string title, app_id;
     /** Used by view implementations when the app id changes */
     void handle_app_id_changed(std::string new_app_id);
-    /** Used by view implementations when the title changes */
+    /**
+     * Used by view implementations when the title changes.
+     * The title-changed signal is emitted at most once per output frame.
+     */
     void handle_title_changed(std::string new_title);
+    void emit_title_changed();
+    bool title_change_pending  = false;
+    uint32_t last_title_change = 0;
+    wf::wl_timer title_change_timer;
     /* Update the minimize hint */
     void handle_minimize_hint(wf::surface_interface_t *relative_to,
         const wlr_box& hint);
@@ -171,6 +356,9 @@ class wlr_view_t :
     /** Update the view size to the actual dimensions of its surface */
     virtual void update_size();
 
+    /** Emit geometry-changed on the view, its output and core */
+    void emit_geometry_changed_signal(view_geometry_changed_signal& data);
+
     /** Last request to the client */
     wf::dimensions_t last_size_request = {0, 0};
     virtual bool should_resize_client(wf::dimensions_t request,
@@ -208,6 +396,14 @@ class wlr_view_t :
     virtual void toplevel_send_state();
     virtual void toplevel_update_output(wf::output_t *output, bool enter);
 
+    /* Send the app id, unless the clients already have it */
+    void toplevel_set_app_id(const std::string& app_id);
+
+    uint32_t toplevel_pending_updates = 0;
+    wf::wl_idle_call toplevel_update_idle;
+    /* What has been sent to the clients, to skip redundant updates */
+    std::string toplevel_sent_title, toplevel_sent_app_id;
+
     virtual void desktop_state_updated() override;
 
   public:
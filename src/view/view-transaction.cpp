@@ -0,0 +1,201 @@
+#include <wayfire/view-transaction.hpp>
+#include <wayfire/core.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/option-wrapper.hpp>
+#include <wayfire/util.hpp>
+#include <algorithm>
+
+class wf::view_transaction_t::impl
+{
+  public:
+    struct pending_view_t
+    {
+        wayfire_view view;
+        wf::dimensions_t size;
+    };
+
+    std::vector<pending_view_t> views;
+    std::vector<wf::output_t*> held_outputs;
+
+    wf::wl_timer timeout;
+    wf::signal_connection_t on_geometry_changed;
+    bool done = false;
+
+    bool all_views_ready() const
+    {
+        return std::all_of(views.begin(), views.end(),
+            [] (const pending_view_t& pending)
+        {
+            auto g = pending.view->get_wm_geometry();
+
+            return !pending.view->is_mapped() ||
+                   wf::dimensions_t{g.width, g.height} == pending.size;
+        });
+    }
+};
+
+namespace
+{
+/**
+ * Keeps track of the open transactions and of the closed transactions which
+ * are still waiting for their views.
+ */
+class transaction_manager_t
+{
+  public:
+    static transaction_manager_t& get()
+    {
+        /* Never destroyed, so that no wayland resources are freed after the
+         * display is gone */
+        static auto manager = new transaction_manager_t();
+
+        return *manager;
+    }
+
+    std::vector<wf::view_transaction_t*> open;
+
+    void start_waiting(std::unique_ptr<wf::view_transaction_t::impl> tx)
+    {
+        auto raw = tx.get();
+        for (auto& pending : raw->views)
+        {
+            pending.view->take_ref();
+            pending.view->connect_signal("geometry-changed",
+                &raw->on_geometry_changed);
+
+            auto output = pending.view->get_output();
+            if (output && (std::find(raw->held_outputs.begin(),
+                raw->held_outputs.end(), output) == raw->held_outputs.end()))
+            {
+                output->render->add_frame_hold(true);
+                raw->held_outputs.push_back(output);
+            }
+        }
+
+        raw->on_geometry_changed.set_callback([=] (wf::signal_data_t*)
+        {
+            if (raw->all_views_ready())
+            {
+                finish(raw);
+            }
+        });
+
+        raw->timeout.set_timeout(timeout_ms, [=] ()
+        {
+            finish(raw);
+
+            return false;
+        }, false);
+
+        waiting.push_back(std::move(tx));
+    }
+
+  private:
+    std::vector<std::unique_ptr<wf::view_transaction_t::impl>> waiting;
+    wf::wl_idle_call idle_cleanup;
+    wf::option_wrapper_t<int> timeout_ms{"core/transaction_timeout"};
+
+    wf::signal_connection_t on_output_removed = [=] (wf::signal_data_t *data)
+    {
+        auto output = wf::get_signaled_output(data);
+        for (auto& tx : waiting)
+        {
+            auto& outputs = tx->held_outputs;
+            outputs.erase(std::remove(outputs.begin(), outputs.end(), output),
+                outputs.end());
+        }
+    };
+
+    transaction_manager_t()
+    {
+        wf::get_core().output_layout->connect_signal("output-pre-remove",
+            &on_output_removed);
+    }
+
+    /* Show the new layout. The transaction is freed later, because this may
+     * run from its own timer or signal handler. */
+    void finish(wf::view_transaction_t::impl *tx)
+    {
+        if (tx->done)
+        {
+            return;
+        }
+
+        tx->done = true;
+        for (auto& output : tx->held_outputs)
+        {
+            output->render->add_frame_hold(false);
+        }
+
+        tx->held_outputs.clear();
+        idle_cleanup.run_once([=] () { cleanup(); });
+    }
+
+    void cleanup()
+    {
+        auto it = std::stable_partition(waiting.begin(), waiting.end(),
+            [] (const auto& tx) { return !tx->done; });
+
+        std::vector<std::unique_ptr<wf::view_transaction_t::impl>> finished;
+        std::move(it, waiting.end(), std::back_inserter(finished));
+        waiting.erase(it, waiting.end());
+
+        for (auto& tx : finished)
+        {
+            tx->on_geometry_changed.disconnect();
+            for (auto& pending : tx->views)
+            {
+                pending.view->unref();
+            }
+        }
+    }
+};
+}
+
+wf::view_transaction_t::view_transaction_t()
+{
+    priv = std::make_unique<impl>();
+    transaction_manager_t::get().open.push_back(this);
+}
+
+wf::view_transaction_t::~view_transaction_t()
+{
+    auto& open = transaction_manager_t::get().open;
+    open.erase(std::remove(open.begin(), open.end(), this), open.end());
+
+    if (!priv->views.empty() && !priv->all_views_ready())
+    {
+        transaction_manager_t::get().start_waiting(std::move(priv));
+    }
+}
+
+void wf::view_transaction_t::add_view(wayfire_view view, wf::dimensions_t size)
+{
+    auto g = view->get_wm_geometry();
+    if (!view->is_mapped() || (wf::dimensions_t{g.width, g.height} == size))
+    {
+        return;
+    }
+
+    for (auto& pending : priv->views)
+    {
+        if (pending.view == view)
+        {
+            pending.size = size;
+
+            return;
+        }
+    }
+
+    priv->views.push_back({view, size});
+}
+
+wf::view_transaction_t*wf::view_transaction_t::get_open()
+{
+    auto& open = transaction_manager_t::get().open;
+
+    return open.empty() ? nullptr : open.back();
+}
@@ -5,6 +5,7 @@
 #include "wayfire/output.hpp"
 #include "wayfire/view.hpp"
 #include "wayfire/view-transform.hpp"
+#include "wayfire/view-transaction.hpp"
 #include "wayfire/decorator.hpp"
 #include "wayfire/workspace-manager.hpp"
 #include "wayfire/render-manager.hpp"
@@ -12,8 +13,10 @@
 #include "../output/gtk-shell.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <glm/glm.hpp>
 #include "wayfire/signal-definitions.hpp"
+#include "wayfire/trace.hpp"
 
 static void reposition_relative_to_parent(wayfire_view view)
 {
@@ -148,22 +151,30 @@ void wf::view_interface_t::set_toplevel_parent(wayfire_view new_parent)
 
 std::vector<wayfire_view> wf::view_interface_t::enumerate_views(
     bool mapped_only)
+{
+    std::vector<wayfire_view> result;
+    for_each_view([&] (wayfire_view view)
+    {
+        result.push_back(view);
+    }, mapped_only);
+
+    return result;
+}
+
+void wf::view_interface_t::visit_views(
+    const std::function<void(wayfire_view)>& callback, bool mapped_only)
 {
     if (!this->is_mapped() && mapped_only)
     {
-        return {};
+        return;
     }
 
-    std::vector<wayfire_view> result;
     for (auto& v : this->children)
     {
-        auto cdr = v->enumerate_views(mapped_only);
-        result.insert(result.end(), cdr.begin(), cdr.end());
+        v->visit_views(callback, mapped_only);
     }
 
-    result.push_back(self());
-
-    return result;
+    callback(self());
 }
 
 void wf::view_interface_t::set_role(view_role_t new_role)
@@ -185,6 +196,12 @@ wayfire_view wf::view_interface_t::self()
 /** Set the view's output. */
 void wf::view_interface_t::set_output(wf::output_t *new_output)
 {
+    /* The pending signal belongs to the repaint of the old output */
+    if (get_output() != new_output)
+    {
+        view_impl->flush_frame_geometry(this);
+    }
+
     /* Make sure the view doesn't stay on the old output */
     if (get_output() && (get_output() != new_output))
     {
@@ -223,6 +240,11 @@ void wf::view_interface_t::resize(int w, int h)
 
 void wf::view_interface_t::set_geometry(wf::geometry_t g)
 {
+    if (auto tx = view_transaction_t::get_open())
+    {
+        tx->add_view(self(), {g.width, g.height});
+    }
+
     move(g.x, g.y);
     resize(g.width, g.height);
 }
@@ -344,22 +366,40 @@ wf::surface_interface_t*wf::view_interface_t::map_input_coordinates(
         return nullptr;
     }
 
+    /* Surfaces cannot receive input outside of the view's bounding box, and
+     * checking it is much cheaper than untransforming the point through all
+     * transformers and enumerating surfaces. This matters because the input
+     * manager asks every view, on every pointer motion. */
+    if (!(get_bounding_box() & cursor))
+    {
+        return nullptr;
+    }
+
     auto view_relative_coordinates =
         global_to_local_point(cursor, nullptr);
 
-    for (auto& child : enumerate_surfaces({0, 0}))
+    wf::surface_interface_t *result = nullptr;
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
-        local.x = view_relative_coordinates.x - child.position.x;
-        local.y = view_relative_coordinates.y - child.position.y;
+        if (result)
+        {
+            return;
+        }
+
+        wf::pointf_t child_local = {
+            view_relative_coordinates.x - child.position.x,
+            view_relative_coordinates.y - child.position.y,
+        };
 
         if (child.surface->accepts_input(
-            std::floor(local.x), std::floor(local.y)))
+            std::floor(child_local.x), std::floor(child_local.y)))
         {
-            return child.surface;
+            local  = child_local;
+            result = child.surface;
         }
-    }
+    });
 
-    return nullptr;
+    return result;
 }
 
 bool wf::view_interface_t::is_focuseable() const
@@ -391,6 +431,31 @@ void wf::view_interface_t::set_minimized(bool minim)
     desktop_state_updated();
 }
 
+wf::view_visibility_t wf::view_interface_t::get_visibility_state() const
+{
+    return view_impl->visibility_state;
+}
+
+void wf::view_interface_t::set_visibility_state(view_visibility_t state)
+{
+    if (view_impl->visibility_state == state)
+    {
+        return;
+    }
+
+    wf::view_visibility_changed_signal data;
+    data.view      = self();
+    data.old_state = view_impl->visibility_state;
+    data.state     = state;
+    view_impl->visibility_state = state;
+
+    this->emit_signal("visibility-changed", &data);
+    if (this->get_output())
+    {
+        this->get_output()->emit_signal("view-visibility-changed", &data);
+    }
+}
+
 void wf::view_interface_t::set_sticky(bool sticky)
 {
     if (this->sticky == sticky)
@@ -561,6 +626,67 @@ void wf::view_interface_t::view_priv_impl::update_windowed_geometry(
     }
 }
 
+void wf::view_interface_t::view_priv_impl::queue_frame_geometry(
+    wf::view_interface_t *self, wf::geometry_t old_geometry)
+{
+    if (frame_geometry_pending)
+    {
+        return;
+    }
+
+    frame_geometry_pending = true;
+    frame_old_geometry     = old_geometry;
+    frame_geometry_output  = self->get_output();
+    emit_frame_geometry    = [=] ()
+    {
+        flush_frame_geometry(self);
+    };
+
+    if (frame_geometry_output)
+    {
+        frame_geometry_output->render->run_before_paint(&emit_frame_geometry);
+    } else
+    {
+        idle_frame_geometry.run_once(emit_frame_geometry);
+    }
+}
+
+void wf::view_interface_t::view_priv_impl::flush_frame_geometry(
+    wf::view_interface_t *self)
+{
+    if (!frame_geometry_pending)
+    {
+        return;
+    }
+
+    cancel_frame_geometry();
+
+    /* Nothing to report if the view is back where it started */
+    if (frame_old_geometry == self->get_wm_geometry())
+    {
+        return;
+    }
+
+    view_geometry_changed_signal data;
+    data.view = self->self();
+    data.old_geometry = frame_old_geometry;
+
+    static const wf::signal_id_t geometry_changed_frame{"geometry-changed-frame"};
+    self->emit_signal(geometry_changed_frame, &data);
+}
+
+void wf::view_interface_t::view_priv_impl::cancel_frame_geometry()
+{
+    if (frame_geometry_output)
+    {
+        frame_geometry_output->render->rem_before_paint(&emit_frame_geometry);
+        frame_geometry_output = nullptr;
+    }
+
+    idle_frame_geometry.disconnect();
+    frame_geometry_pending = false;
+}
+
 wf::geometry_t wf::view_interface_t::view_priv_impl::calculate_windowed_geometry(
     wf::output_t *output)
 {
@@ -746,6 +872,7 @@ void wf::view_interface_t::damage()
 {
     auto bbox = get_untransformed_bounding_box();
     view_impl->offscreen_buffer.cached_damage |= bbox;
+    view_impl->damage_transformers(bbox, bbox);
     view_damage_raw(self(), transform_region(bbox));
 }
 
@@ -764,6 +891,11 @@ bool wf::view_interface_t::should_be_decorated()
     return false;
 }
 
+bool wf::view_interface_t::should_bypass_compositor()
+{
+    return false;
+}
+
 nonstd::observer_ptr<wf::surface_interface_t> wf::view_interface_t::get_decoration()
 {
     return this->view_impl->decoration;
@@ -870,6 +1002,10 @@ void wf::view_interface_t::add_transformer(
     });
 
     damage();
+
+    view_transformer_changed_signal data;
+    data.view = self();
+    emit_signal("transformer-changed", &data);
 }
 
 nonstd::observer_ptr<wf::view_transformer_t> wf::view_interface_t::get_transformer(
@@ -895,6 +1031,11 @@ void wf::view_interface_t::pop_transformer(
         return tr->transform.get() == transformer.get();
     });
 
+    /* The input of every transformer after the removed one has changed, so
+     * their intermediate buffers need to be fully redrawn */
+    auto bbox = get_untransformed_bounding_box();
+    view_impl->damage_transformers(bbox, bbox);
+
     /* Since we can remove transformers while rendering the output, damaging it
      * won't help at this stage (damage is already calculated).
      *
@@ -903,6 +1044,10 @@ void wf::view_interface_t::pop_transformer(
     {
         get_output()->render->damage_whole_idle();
     }
+
+    view_transformer_changed_signal data;
+    data.view = self();
+    emit_signal("transformer-changed", &data);
 }
 
 void wf::view_interface_t::pop_transformer(std::string name)
@@ -922,17 +1067,90 @@ wf::geometry_t wf::view_interface_t::get_untransformed_bounding_box()
         return view_impl->offscreen_buffer.geometry;
     }
 
-    auto bbox = get_output_geometry();
-    wf::region_t bounding_region = bbox;
+    auto og = get_output_geometry();
+    view_impl->update_surface_cache(this);
+
+    return view_impl->cached_bounding_box + wf::point_t{og.x, og.y};
+}
+
+void wf::view_interface_t::view_priv_impl::update_surface_cache(
+    wf::view_interface_t *self)
+{
+    int shrink = surface_interface_t::get_active_shrink_constraint();
+    auto og    = self->get_output_geometry();
+    if (surface_cache_valid && (opaque_region_shrink == shrink) &&
+        (cached_size == wf::dimensions(og)))
+    {
+        return;
+    }
+
+    wf::region_t bounding_region = wf::geometry_t{0, 0, og.width, og.height};
+
+    cached_opaque_region.clear();
+    cached_surfaces.clear();
+
+    /* Add the surfaces of the tree in the order of for_each_surface(), and
+     * remember where it ends, so that it can be skipped as a whole */
+    auto add_tree = [&] (wf::surface_interface_t *root, wf::point_t origin)
+    {
+        size_t start = cached_surfaces.size();
+        wf::region_t tree_region;
+        root->for_each_surface([&] (const wf::surface_iterator_t& child)
+        {
+            auto dim = child.surface->get_size();
+            tree_region |= {child.position.x, child.position.y,
+                dim.width, dim.height};
+            cached_opaque_region |=
+                child.surface->get_opaque_region(child.position);
+            cached_surfaces.push_back({child.surface, child.position});
+        }, origin);
+
+        bounding_region |= tree_region;
+        if (cached_surfaces.size() > start)
+        {
+            cached_surfaces[start].subtree_end = cached_surfaces.size();
+            cached_surfaces[start].subtree_box =
+                wlr_box_from_pixman_box(tree_region.get_extents());
+        }
+    };
+
+    for (auto& child : self->priv->surface_children_above)
+    {
+        if (child->is_mapped())
+        {
+            add_tree(child.get(), child->get_offset());
+        }
+    }
+
+    if (self->is_mapped())
+    {
+        auto dim = self->get_size();
+        bounding_region |= {0, 0, dim.width, dim.height};
+        cached_opaque_region |= self->get_opaque_region({0, 0});
+        cached_surfaces.push_back({self, {0, 0}});
+    }
 
-    for (auto& child : enumerate_surfaces({bbox.x, bbox.y}))
+    for (auto& child : self->priv->surface_children_below)
     {
-        auto dim = child.surface->get_size();
-        bounding_region |= {child.position.x, child.position.y,
-            dim.width, dim.height};
+        if (child->is_mapped())
+        {
+            add_tree(child.get(), child->get_offset());
+        }
     }
 
-    return wlr_box_from_pixman_box(bounding_region.get_extents());
+    cached_bounding_box  = wlr_box_from_pixman_box(bounding_region.get_extents());
+    cached_size          = wf::dimensions(og);
+    surface_cache_valid  = true;
+    opaque_region_shrink = shrink;
+}
+
+const std::vector<wf::view_interface_t::view_priv_impl::cached_surface_t>&
+wf::view_interface_t::view_priv_impl::get_cached_surfaces(
+    wf::view_interface_t *self)
+{
+    update_surface_cache(self);
+
+    return cached_surfaces;
 }
 
 wlr_box wf::view_interface_t::get_bounding_box(std::string transformer)
@@ -962,13 +1180,32 @@ wlr_box wf::view_interface_t::transform_region(const wlr_box& region,
             return;
         }
 
-        box  = tr->transform->get_bounding_box(view, box);
-        view = tr->transform->get_bounding_box(view, view);
+        /* When the whole view is transformed, for ex. by get_bounding_box(),
+         * both boxes are the same */
+        if (box == view)
+        {
+            box = view = tr->transform->get_bounding_box(view, view);
+        } else
+        {
+            box  = tr->transform->get_bounding_box(view, box);
+            view = tr->transform->get_bounding_box(view, view);
+        }
     });
 
     return box;
 }
 
+void wf::view_interface_t::view_priv_impl::damage_transformers(
+    wf::geometry_t view_box, wlr_box damage)
+{
+    transforms.for_each([&] (auto& tr)
+    {
+        damage   = tr->transform->get_bounding_box(view_box, damage);
+        view_box = tr->transform->get_bounding_box(view_box, view_box);
+        tr->cached_damage |= damage;
+    });
+}
+
 wlr_box wf::view_interface_t::transform_region(const wlr_box& region,
     std::string transformer)
 {
@@ -1004,19 +1241,20 @@ bool wf::view_interface_t::intersects_region(const wlr_box& region)
     }
 
     auto origin = get_output_geometry();
-    for (auto& child : enumerate_surfaces({origin.x, origin.y}))
+    bool intersects = false;
+    for_each_surface([&] (const wf::surface_iterator_t& child)
     {
-        wlr_box box = {child.position.x, child.position.y,
-            child.surface->get_size().width, child.surface->get_size().height};
-        box = transform_region(box);
-
-        if (region & box)
+        if (intersects)
         {
-            return true;
+            return;
         }
-    }
 
-    return false;
+        wlr_box box = {child.position.x, child.position.y,
+            child.surface->get_size().width, child.surface->get_size().height};
+        intersects = region & transform_region(box);
+    }, {origin.x, origin.y});
+
+    return intersects;
 }
 
 wf::region_t wf::view_interface_t::get_transformed_opaque_region()
@@ -1029,15 +1267,12 @@ wf::region_t wf::view_interface_t::get_transformed_opaque_region()
     auto obox = get_untransformed_bounding_box();
     auto og   = get_output_geometry();
 
-    wf::region_t opaque;
-    for (auto& surf : enumerate_surfaces({og.x, og.y}))
-    {
-        opaque |= surf.surface->get_opaque_region(surf.position);
-    }
+    view_impl->update_surface_cache(this);
+    wf::region_t opaque =
+        view_impl->cached_opaque_region + wf::point_t{og.x, og.y};
 
     auto bbox = obox;
-    this->view_impl->transforms.for_each(
-        [&] (const std::shared_ptr<view_transform_block_t> tr)
+    this->view_impl->transforms.for_each([&] (auto& tr)
     {
         opaque = tr->transform->transform_opaque_region(bbox, opaque);
         bbox   = tr->transform->get_bounding_box(bbox, bbox);
@@ -1046,6 +1281,105 @@ wf::region_t wf::view_interface_t::get_transformed_opaque_region()
     return opaque;
 }
 
+/** @return The bounding box of the box after applying the matrix to it */
+static wf::geometry_t transform_box(const glm::mat4& matrix, wf::geometry_t box)
+{
+    float x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+    for (auto corner : {glm::vec4{box.x, box.y, 0, 1},
+        glm::vec4{box.x + box.width, box.y, 0, 1},
+        glm::vec4{box.x, box.y + box.height, 0, 1},
+        glm::vec4{box.x + box.width, box.y + box.height, 0, 1}})
+    {
+        auto p = matrix * corner;
+        x1 = std::min(x1, p.x);
+        y1 = std::min(y1, p.y);
+        x2 = std::max(x2, p.x);
+        y2 = std::max(y2, p.y);
+    }
+
+    int x = std::floor(x1), y = std::floor(y1);
+
+    return {x, y, (int)std::ceil(x2) - x, (int)std::ceil(y2) - y};
+}
+
+/**
+ * Render the surfaces of a mapped view directly to the framebuffer, if all of
+ * its transformers are affine and all of its surfaces have a texture. This
+ * avoids the snapshot and the offscreen buffers of the transformers.
+ *
+ * @return false if the view cannot be rendered this way.
+ */
+static bool render_affine(wf::view_interface_t *view,
+    const wf::framebuffer_t& framebuffer, const wf::region_t& damage)
+{
+    bool affine = true;
+    wf::affine_transform_t total;
+    auto bbox = view->get_untransformed_bounding_box();
+    view->view_impl->transforms.for_each([&] (auto& tr)
+    {
+        auto transform = affine ?
+            tr->transform->get_affine_transform(bbox) : std::nullopt;
+        if (!transform)
+        {
+            affine = false;
+
+            return;
+        }
+
+        total.matrix = transform->matrix * total.matrix;
+        total.alpha *= transform->alpha;
+        bbox = tr->transform->get_bounding_box(bbox, bbox);
+    });
+
+    if (!affine)
+    {
+        return false;
+    }
+
+    auto origin   = wf::origin(view->get_output_geometry());
+    auto surfaces = view->enumerate_surfaces(origin);
+    for (auto& child : surfaces)
+    {
+        if (!dynamic_cast<wf::wlr_surface_base_t*>(child.surface))
+        {
+            return false;
+        }
+    }
+
+    auto projection = framebuffer.get_orthographic_projection() * total.matrix;
+    OpenGL::render_begin(framebuffer);
+    for (auto& child : wf::reverse(surfaces))
+    {
+        auto surface = dynamic_cast<wf::wlr_surface_base_t*>(child.surface);
+        auto wlr_surface = child.surface->get_wlr_surface();
+        if (!wlr_surface || !wlr_surface_has_buffer(wlr_surface))
+        {
+            continue;
+        }
+
+        auto size = child.surface->get_size();
+        wf::geometry_t box = {child.position.x, child.position.y,
+            size.width, size.height};
+        auto surface_damage = damage & transform_box(total.matrix, box);
+        if (surface_damage.empty())
+        {
+            continue;
+        }
+
+        auto texture = surface->get_texture();
+        for (const auto& rect : surface_damage)
+        {
+            framebuffer.logic_scissor(wlr_box_from_pixman_box(rect));
+            OpenGL::render_transformed_texture(texture, box, projection,
+                {1.0f, 1.0f, 1.0f, total.alpha});
+        }
+    }
+
+    OpenGL::render_end();
+
+    return true;
+}
+
 bool wf::view_interface_t::render_transformed(const wf::framebuffer_t& framebuffer,
     const wf::region_t& damage)
 {
@@ -1054,15 +1388,24 @@ bool wf::view_interface_t::render_transformed(const wf::framebuffer_t& framebuff
         return false;
     }
 
+    WF_TRACE_SCOPE("render_transformed");
+
+    if (is_mapped() && render_affine(this, framebuffer, damage))
+    {
+        return true;
+    }
+
     wf::geometry_t obox = get_untransformed_bounding_box();
     wf::texture_t previous_texture;
     float texture_scale;
 
-    if (is_mapped() && (enumerate_surfaces().size() == 1) && get_wlr_surface())
+    if (is_mapped() && !has_mapped_subsurfaces() && get_wlr_surface())
     {
         /* Optimized case: there is a single mapped surface.
          * We can directly start with its texture */
-        previous_texture = wf::texture_t{this->get_wlr_surface()};
+        auto surface_base = dynamic_cast<wf::wlr_surface_base_t*>(this);
+        previous_texture = surface_base ? surface_base->get_texture() :
+            wf::texture_t{this->get_wlr_surface()};
         texture_scale    = this->get_wlr_surface()->current.scale;
     } else
     {
@@ -1082,6 +1425,10 @@ bool wf::view_interface_t::render_transformed(const wf::framebuffer_t& framebuff
     /* final_transform is the one that should render to the screen */
     std::shared_ptr<view_transform_block_t> final_transform = nullptr;
 
+    /* The region which was redrawn by the previous intermediate transformer,
+     * in its own coordinate system. */
+    wf::region_t previous_damage;
+
     /* Render the view passing its snapshot through the transformers.
      * For each transformer except the last we render on offscreen buffers,
      * and the last one is rendered to the real fb. */
@@ -1102,18 +1449,52 @@ bool wf::view_interface_t::render_transformed(const wf::framebuffer_t& framebuff
         int scaled_width  = transformed_box.width * texture_scale;
         int scaled_height = transformed_box.height * texture_scale;
 
-        /* Prepare buffer to store result after the transform */
+        /* Prepare buffer to store result after the transform. Only the parts
+         * which were damaged since the last time are redrawn, unless the
+         * buffer had to be reallocated or moved. */
         OpenGL::render_begin();
-        transform->fb.allocate(scaled_width, scaled_height);
+        bool reallocated = offscreen_buffer_pool_t::get().allocate(
+            transform->fb, scaled_width, scaled_height);
+        if (reallocated)
+        {
+            wf::gpu_memory::set_owner(&transform->fb,
+                "transformer " + transform->plugin_name);
+        }
+
+        if (reallocated || (transform->fb.geometry != transformed_box) ||
+            (transform->fb.scale != texture_scale))
+        {
+            transform->cached_damage |= transformed_box;
+        }
+
+        /* Whatever the previous transformer redrew has to be redrawn here too */
+        for (const auto& rect : previous_damage)
+        {
+            transform->cached_damage |= transform->transform->get_bounding_box(
+                obox, wlr_box_from_pixman_box(rect));
+        }
+
+        transform->cached_damage &= transformed_box;
         transform->fb.scale    = texture_scale;
         transform->fb.geometry = transformed_box;
         transform->fb.bind(); // bind buffer to clear it
-        OpenGL::clear({0, 0, 0, 0});
+        for (const auto& rect : transform->cached_damage)
+        {
+            transform->fb.logic_scissor(wlr_box_from_pixman_box(rect));
+            OpenGL::clear({0, 0, 0, 0});
+        }
+
         OpenGL::render_end();
 
         /* Actually render the transform to the next framebuffer */
-        transform->transform->render_with_damage(previous_texture, obox,
-            wf::region_t{transformed_box}, transform->fb);
+        if (!transform->cached_damage.empty())
+        {
+            transform->transform->render_with_damage(previous_texture, obox,
+                transform->cached_damage, transform->fb);
+        }
+
+        previous_damage = std::move(transform->cached_damage);
+        transform->cached_damage.clear();
 
         previous_transform = transform;
         previous_texture   = previous_transform->fb.tex;
@@ -1130,25 +1511,14 @@ bool wf::view_interface_t::render_transformed(const wf::framebuffer_t& framebuff
     if (final_transform == nullptr)
     {
         OpenGL::render_begin(framebuffer);
-        auto matrix = framebuffer.get_orthographic_projection();
-        gl_geometry src_geometry = {
-            1.0f * obox.x, 1.0f * obox.y,
-            1.0f * obox.x + 1.0f * obox.width,
-            1.0f * obox.y + 1.0f * obox.height,
-        };
-
-        for (const auto& rect : damage)
-        {
-            framebuffer.logic_scissor(wlr_box_from_pixman_box(rect));
-            OpenGL::render_transformed_texture(previous_texture, src_geometry,
-                {}, matrix);
-        }
-
+        OpenGL::render_texture_damage(previous_texture, framebuffer, obox,
+            damage);
         OpenGL::render_end();
     } else
     {
         /* Regular case, just call the last transformer, but render directly
          * to the target framebuffer */
+        final_transform->cached_damage.clear();
         final_transform->transform->render_with_damage(previous_texture, obox,
             damage, framebuffer);
     }
@@ -1161,7 +1531,7 @@ wf::view_transform_block_t::view_transform_block_t()
 wf::view_transform_block_t::~view_transform_block_t()
 {
     OpenGL::render_begin();
-    this->fb.release();
+    offscreen_buffer_pool_t::get().release(this->fb);
     OpenGL::render_end();
 }
 
@@ -1179,6 +1549,29 @@ void wf::view_interface_t::take_snapshot()
 
     float scale = get_output()->handle->scale;
 
+    /* The snapshot of a mapped view can be regenerated at any time, so the
+     * pool may take its buffer away to stay within its budget. Once the view
+     * is unmapped, e.g. during a close animation, the snapshot can only be
+     * downsampled. */
+    int scaled_width  = buffer_geometry.width * scale;
+    int scaled_height = buffer_geometry.height * scale;
+    OpenGL::render_begin();
+    bool reallocated = offscreen_buffer_pool_t::get().allocate(offscreen_buffer,
+        scaled_width, scaled_height, [this] () { return is_mapped(); },
+        [this] ()
+    {
+        auto& buffer = view_impl->offscreen_buffer;
+        buffer.scale = (float)buffer.viewport_width /
+            std::max(1, buffer.geometry.width);
+    });
+    OpenGL::render_end();
+
+    if (reallocated)
+    {
+        wf::gpu_memory::set_owner(&offscreen_buffer, "view snapshot");
+        offscreen_buffer.cached_damage |= buffer_geometry;
+    }
+
     offscreen_buffer.cached_damage &= buffer_geometry;
     /* Nothing has changed, the last buffer is still valid */
     if (offscreen_buffer.cached_damage.empty())
@@ -1186,16 +1579,7 @@ void wf::view_interface_t::take_snapshot()
         return;
     }
 
-    int scaled_width  = buffer_geometry.width * scale;
-    int scaled_height = buffer_geometry.height * scale;
-    if ((scaled_width != offscreen_buffer.viewport_width) ||
-        (scaled_height != offscreen_buffer.viewport_height))
-    {
-        offscreen_buffer.cached_damage |= buffer_geometry;
-    }
-
     OpenGL::render_begin();
-    offscreen_buffer.allocate(scaled_width, scaled_height);
     offscreen_buffer.scale = scale;
     offscreen_buffer.bind();
     for (auto& box : offscreen_buffer.cached_damage)
@@ -1278,7 +1662,7 @@ void wf::view_interface_t::deinitialize()
     this->_clear_data();
 
     OpenGL::render_begin();
-    this->view_impl->offscreen_buffer.release();
+    offscreen_buffer_pool_t::get().release(this->view_impl->offscreen_buffer);
     OpenGL::render_end();
 }
 
@@ -1286,6 +1670,7 @@ wf::view_interface_t::~view_interface_t()
 {
     /* Note: at this point, it is invalid to call most functions */
     unset_toplevel_parent(self());
+    view_impl->cancel_frame_geometry();
 }
 
 void wf::view_interface_t::damage_surface_box(const wlr_box& box)
@@ -1296,6 +1681,7 @@ void wf::view_interface_t::damage_surface_box(const wlr_box& box)
     damaged.x += obox.x;
     damaged.y += obox.y;
     view_impl->offscreen_buffer.cached_damage |= damaged;
+    view_impl->damage_transformers(get_untransformed_bounding_box(), damaged);
     view_damage_raw(self(), transform_region(damaged));
 }
 
@@ -1331,7 +1717,8 @@ void wf::view_damage_raw(wayfire_view view, const wlr_box& box)
         output->render->damage(box);
     }
 
-    view->emit_signal("region-damaged", nullptr);
+    static const wf::signal_id_t region_damaged{"region-damaged"};
+    view->emit_signal(region_damaged, nullptr);
 }
 
 void wf::view_interface_t::destruct()
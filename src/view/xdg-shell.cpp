@@ -1,5 +1,6 @@
 #include <wayfire/util/log.hpp>
 #include <wayfire/debug.hpp>
+#include <wayfire/trace.hpp>
 #include "wayfire/core.hpp"
 #include "surface-impl.hpp"
 #include "wayfire/output.hpp"
@@ -317,6 +318,7 @@ void wayfire_xdg_view::map(wlr_surface *surface)
 
 void wayfire_xdg_view::commit()
 {
+    WF_TRACE_SCOPE("xdg_view commit");
     wlr_view_t::commit();
 
     /* On each commit, check whether the window geometry of the xdg_surface
@@ -7,13 +7,76 @@
 #include "wayfire/decorator.hpp"
 #include "wayfire/output-layout.hpp"
 #include "wayfire/signal-definitions.hpp"
+#include "wayfire/view-transaction.hpp"
 #include "../core/core-impl.hpp"
 #include "../core/seat/cursor.hpp"
 #include "../core/seat/input-manager.hpp"
 #include "view-impl.hpp"
 
+#include <functional>
+#include <map>
+#include <signal.h>
+
 #if WF_HAS_XWAYLAND
 
+static wlr_xwayland *xwayland_handle = nullptr;
+
+/**
+ * In lazy mode, Xwayland is started by wlroots on the first connection to the
+ * X11 socket. When the last X11 surface is gone for
+ * core/xwayland_idle_timeout seconds, the server is stopped, and wlroots
+ * listens on the same socket again, so DISPLAY stays valid.
+ */
+struct xwayland_idle_shutdown_t
+{
+    wf::option_wrapper_t<int> idle_timeout{"core/xwayland_idle_timeout"};
+    bool lazy    = false;
+    int surfaces = 0;
+    wf::wl_timer idle_timer;
+
+    static xwayland_idle_shutdown_t& get()
+    {
+        static xwayland_idle_shutdown_t state;
+        return state;
+    }
+
+    void surface_created()
+    {
+        ++surfaces;
+        idle_timer.disconnect();
+    }
+
+    void surface_destroyed()
+    {
+        if (--surfaces == 0)
+        {
+            arm();
+        }
+    }
+
+    void arm()
+    {
+        /* wlroots does not restart servers which died within a few seconds */
+        int timeout = idle_timeout;
+        if (!lazy || (timeout <= 0))
+        {
+            return;
+        }
+
+        idle_timer.set_timeout(std::max(timeout, 10) * 1000, [=] ()
+        {
+            auto server = xwayland_handle ? xwayland_handle->server : nullptr;
+            if ((surfaces == 0) && server && (server->pid > 0))
+            {
+                LOGI("Stopping idle Xwayland, it will be started again on demand");
+                kill(server->pid, SIGTERM);
+            }
+
+            return false;
+        }, false);
+    }
+};
+
 class wayfire_xwayland_view_base : public wf::wlr_view_t
 {
   protected:
@@ -21,6 +84,10 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
     static xcb_atom_t _NET_WM_WINDOW_TYPE_DIALOG;
     static xcb_atom_t _NET_WM_WINDOW_TYPE_SPLASH;
 
+  public:
+    static xcb_atom_t _NET_WM_BYPASS_COMPOSITOR;
+
+  protected:
     static void load_atom(xcb_connection_t *connection,
         xcb_atom_t& atom, const std::string& name)
     {
@@ -55,6 +122,8 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
             "_NET_WM_WINDOW_TYPE_DIALOG");
         load_atom(connection, _NET_WM_WINDOW_TYPE_SPLASH,
             "_NET_WM_WINDOW_TYPE_SPLASH");
+        load_atom(connection, _NET_WM_BYPASS_COMPOSITOR,
+            "_NET_WM_BYPASS_COMPOSITOR");
 
         xcb_disconnect(connection);
         return true;
@@ -69,6 +138,13 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
     /** The geometry requested by the client */
     bool self_positioned = false;
 
+    /**
+     * Configures are sent once per event loop iteration, because each one is
+     * a separate request to Xwayland, flushed immediately.
+     */
+    wf::wl_idle_call idle_configure;
+    wf::dimensions_t pending_configure_size;
+
     wf::signal_connection_t output_geometry_changed{[this] (wf::signal_data_t*)
         {
             if (is_mapped())
@@ -127,7 +203,9 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
   public:
     wayfire_xwayland_view_base(wlr_xwayland_surface *xww) :
         wlr_view_t(), xw(xww)
-    {}
+    {
+        xwayland_idle_shutdown_t::get().surface_created();
+    }
 
     virtual void initialize() override
     {
@@ -151,6 +229,7 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
             {
                 /* If the view is not mapped yet, let it be configured as it
                  * wishes. We will position it properly in ::map() */
+                idle_configure.disconnect();
                 wlr_xwayland_surface_configure(xw,
                     ev->x, ev->y, ev->width, ev->height);
 
@@ -202,7 +281,7 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
         });
         on_or_changed.set_callback([&] (void*)
         {
-            recreate_view_with_or_type();
+            update_role();
         });
         on_set_decorations.set_callback([&] (void*)
         {
@@ -214,7 +293,7 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
         });
         on_set_window_type.set_callback([&] (void*)
         {
-            recreate_view_with_or_type();
+            update_role();
         });
 
         handle_title_changed(nonull(xw->title));
@@ -234,14 +313,16 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
     }
 
     /**
-     * Destroy the view, and create a new one with the correct override-redirect
-     * type.
+     * Switch the view between the managed and the unmanaged role, if
+     * is_unmanaged() has changed.
      */
-    virtual void recreate_view_with_or_type();
+    virtual bool update_role() = 0;
 
     virtual void destroy() override
     {
         this->xw = nullptr;
+        idle_configure.disconnect();
+        xwayland_idle_shutdown_t::get().surface_destroyed();
         output_geometry_changed.disconnect();
 
         on_map.disconnect();
@@ -398,6 +479,11 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
 
     void set_geometry(wf::geometry_t geometry) override
     {
+        if (auto tx = wf::view_transaction_t::get_open())
+        {
+            tx->add_view(self(), {geometry.width, geometry.height});
+        }
+
         wlr_view_t::move(geometry.x, geometry.y);
         resize(geometry.width, geometry.height);
     }
@@ -418,6 +504,23 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
             return;
         }
 
+        pending_configure_size = {width, height};
+        if (!idle_configure.is_connected())
+        {
+            idle_configure.run_once([=] () { flush_configure(); });
+        }
+    }
+
+    /** Send the last requested configure, if it changes anything. */
+    void flush_configure()
+    {
+        if (!xw)
+        {
+            return;
+        }
+
+        int width  = pending_configure_size.width;
+        int height = pending_configure_size.height;
         auto output_geometry = get_output_geometry();
 
         int configure_x = output_geometry.x;
@@ -430,6 +533,12 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
             configure_y += real_output.y;
         }
 
+        if ((xw->x == configure_x) && (xw->y == configure_y) &&
+            (xw->width == width) && (xw->height == height))
+        {
+            return;
+        }
+
         wlr_xwayland_surface_configure(xw,
             configure_x, configure_y, width, height);
     }
@@ -470,31 +579,451 @@ class wayfire_xwayland_view_base : public wf::wlr_view_t
 xcb_atom_t wayfire_xwayland_view_base::_NET_WM_WINDOW_TYPE_NORMAL;
 xcb_atom_t wayfire_xwayland_view_base::_NET_WM_WINDOW_TYPE_DIALOG;
 xcb_atom_t wayfire_xwayland_view_base::_NET_WM_WINDOW_TYPE_SPLASH;
-
-class wayfire_unmanaged_xwayland_view : public wayfire_xwayland_view_base
+xcb_atom_t wayfire_xwayland_view_base::_NET_WM_BYPASS_COMPOSITOR;
+
+/**
+ * Watches _NET_WM_BYPASS_COMPOSITOR on the managed X11 windows, which wlroots
+ * does not read. The windows are watched on a separate X11 connection, which
+ * is dispatched from the event loop. Requests never wait for their replies,
+ * because Xwayland may be waiting for the compositor at the same time.
+ */
+class xwayland_bypass_watcher_t
 {
-  protected:
-    wf::wl_listener_wrapper on_set_geometry;
-
   public:
-    wayfire_unmanaged_xwayland_view(wlr_xwayland_surface *xww);
+    using callback_t = std::function<void (bool)>;
 
-    int global_x, global_y;
+    static xwayland_bypass_watcher_t& get()
+    {
+        static xwayland_bypass_watcher_t watcher;
+        return watcher;
+    }
 
-    void map(wlr_surface *surface) override;
-    void destroy() override;
+    /** Connect to a newly started Xwayland server. */
+    void connect(const char *display_name)
+    {
+        disconnect();
+        if (wayfire_xwayland_view_base::_NET_WM_BYPASS_COMPOSITOR == XCB_ATOM_NONE)
+        {
+            return;
+        }
 
-    bool should_be_decorated() override;
+        connection = xcb_connect(display_name, NULL);
+        if (!connection || xcb_connection_has_error(connection))
+        {
+            LOGE("Failed to connect to Xwayland for the bypass-compositor hints");
+            disconnect();
 
-    ~wayfire_unmanaged_xwayland_view()
-    {}
+            return;
+        }
+
+        source = wl_event_loop_add_fd(wf::get_core().ev_loop,
+            xcb_get_file_descriptor(connection), WL_EVENT_READABLE,
+            [] (int, uint32_t mask, void *data)
+        {
+            ((xwayland_bypass_watcher_t*)data)->dispatch(mask);
+            return 0;
+        }, this);
+
+        for (auto& [window, callback] : windows)
+        {
+            watch_window(window);
+        }
+
+        xcb_flush(connection);
+    }
+
+    /**
+     * Start watching the given window. The callback is called with the new
+     * value whenever the property is read.
+     */
+    void watch(xcb_window_t window, callback_t callback)
+    {
+        windows[window] = callback;
+        if (connection)
+        {
+            watch_window(window);
+            xcb_flush(connection);
+        }
+    }
+
+    void unwatch(xcb_window_t window)
+    {
+        windows.erase(window);
+    }
+
+  private:
+    xcb_connection_t *connection = nullptr;
+    wl_event_source *source = nullptr;
+    std::map<xcb_window_t, callback_t> windows;
+    /* The property reads which have not been answered yet */
+    std::vector<std::pair<xcb_window_t, xcb_get_property_cookie_t>> pending;
+
+    void disconnect()
+    {
+        if (source)
+        {
+            wl_event_source_remove(source);
+            source = nullptr;
+        }
+
+        if (connection)
+        {
+            xcb_disconnect(connection);
+            connection = nullptr;
+        }
+
+        pending.clear();
+    }
+
+    void watch_window(xcb_window_t window)
+    {
+        /* Event masks are per client, so this doesn't change what the window
+         * manager of wlroots or the client itself receive */
+        uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+        xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK,
+            &mask);
+        read_property(window);
+    }
+
+    void read_property(xcb_window_t window)
+    {
+        pending.push_back({window, xcb_get_property(connection, 0, window,
+            wayfire_xwayland_view_base::_NET_WM_BYPASS_COMPOSITOR,
+            XCB_ATOM_CARDINAL, 0, 1)});
+    }
+
+    void dispatch(uint32_t mask)
+    {
+        if ((mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR)) ||
+            xcb_connection_has_error(connection))
+        {
+            /* Xwayland was stopped, a new connection is made when it starts */
+            disconnect();
+
+            return;
+        }
+
+        /* Errors for windows which are already gone also arrive as events,
+         * and are ignored */
+        while (auto event = xcb_poll_for_event(connection))
+        {
+            if ((event->response_type & ~0x80) == XCB_PROPERTY_NOTIFY)
+            {
+                auto ev = (xcb_property_notify_event_t*)event;
+                if ((ev->atom ==
+                     wayfire_xwayland_view_base::_NET_WM_BYPASS_COMPOSITOR) &&
+                    windows.count(ev->window))
+                {
+                    read_property(ev->window);
+                }
+            }
+
+            free(event);
+        }
+
+        /* Replies are handled in the order of the requests */
+        while (!pending.empty())
+        {
+            void *reply = nullptr;
+            xcb_generic_error_t *error = nullptr;
+            if (!xcb_poll_for_reply(connection, pending.front().second.sequence,
+                &reply, &error))
+            {
+                break;
+            }
+
+            auto window = pending.front().first;
+            pending.erase(pending.begin());
+
+            auto property = (xcb_get_property_reply_t*)reply;
+            /* 1 requests bypassing the compositor, 0 and 2 do not */
+            bool bypass = property && (property->format == 32) &&
+                (xcb_get_property_value_length(property) >= 4) &&
+                (*(uint32_t*)xcb_get_property_value(property) == 1);
+
+            free(reply);
+            free(error);
+
+            auto it = windows.find(window);
+            if (it != windows.end())
+            {
+                it->second(bypass);
+            }
+        }
+
+        xcb_flush(connection);
+    }
 };
 
+/**
+ * An Xwayland view. Override-redirect windows and the windows which behave
+ * like them (see is_unmanaged()) are unmanaged views: they position themselves
+ * in the global coordinate space and live in the unmanaged layer. All other
+ * windows are regular toplevels.
+ *
+ * The role of a window is a state of the view, which is switched in place
+ * whenever the override-redirect flag, the window type or the parent of the
+ * window change, see update_role().
+ */
 class wayfire_xwayland_view : public wayfire_xwayland_view_base
 {
     wf::wl_listener_wrapper on_request_move, on_request_resize,
         on_request_maximize, on_request_minimize, on_request_activate,
-        on_request_fullscreen, on_set_parent, on_set_hints;
+        on_request_fullscreen, on_set_parent, on_set_hints, on_set_geometry;
+
+    wf::option_wrapper_t<bool> hide_occluded{"workarounds/xwayland_hide_occluded"};
+    /* _NET_WM_BYPASS_COMPOSITOR is 1 */
+    bool bypass_compositor = false;
+
+    /* Whether the view currently has the unmanaged role */
+    bool unmanaged = false;
+    /* The last global position of an unmanaged view */
+    int global_x, global_y;
+
+    /**
+     * @return Whether _NET_WM_STATE_HIDDEN should be set, i.e. whether the view
+     *   is minimized or, if enabled, can't be seen.
+     */
+    bool should_be_hidden()
+    {
+        auto state = get_visibility_state();
+
+        return minimized || (hide_occluded &&
+            ((state == wf::VIEW_VISIBILITY_OCCLUDED) ||
+                (state == wf::VIEW_VISIBILITY_OFF_WORKSPACE)));
+    }
+
+    /** Connect the listeners of the current role, and disconnect the others. */
+    void update_role_listeners()
+    {
+        if (unmanaged)
+        {
+            xwayland_bypass_watcher_t::get().unwatch(xw->window_id);
+            on_set_hints.disconnect();
+            on_request_move.disconnect();
+            on_request_resize.disconnect();
+            on_request_activate.disconnect();
+            on_request_maximize.disconnect();
+            on_request_minimize.disconnect();
+            on_request_fullscreen.disconnect();
+            on_set_geometry.connect(&xw->events.set_geometry);
+
+            return;
+        }
+
+        on_set_geometry.disconnect();
+        on_set_hints.connect(&xw->events.set_hints);
+        on_request_move.connect(&xw->events.request_move);
+        on_request_resize.connect(&xw->events.request_resize);
+        on_request_activate.connect(&xw->events.request_activate);
+        on_request_maximize.connect(&xw->events.request_maximize);
+        on_request_minimize.connect(&xw->events.request_minimize);
+        on_request_fullscreen.connect(&xw->events.request_fullscreen);
+
+        xwayland_bypass_watcher_t::get().watch(xw->window_id, [=] (bool bypass)
+        {
+            set_bypass_compositor(bypass);
+        });
+    }
+
+    void set_bypass_compositor(bool bypass)
+    {
+        if (bypass != bypass_compositor)
+        {
+            bypass_compositor = bypass;
+            wf::bypass_compositor_changed_signal data;
+            data.view = self();
+            emit_signal("bypass-compositor-changed", &data);
+        }
+    }
+
+    /** Set the toplevel parent of a managed view from the X11 window */
+    void update_parent()
+    {
+        auto parent = xw->parent ?
+            wf::wf_view_from_void(xw->parent->data)->self() : nullptr;
+
+        // Make sure the parent is mapped, and that we are not a toplevel view
+        if (parent)
+        {
+            if (!parent->is_mapped() ||
+                this->has_type(_NET_WM_WINDOW_TYPE_NORMAL))
+            {
+                parent = nullptr;
+            }
+        }
+
+        set_toplevel_parent(parent);
+    }
+
+    /** Move an unmanaged view to the global position of its window */
+    void update_global_position()
+    {
+        geometry.x = global_x = xw->x;
+        geometry.y = global_y = xw->y;
+
+        if (get_output())
+        {
+            auto real_output = get_output()->get_layout_geometry();
+            geometry.x -= real_output.x;
+            geometry.y -= real_output.y;
+        }
+
+        wf::wlr_view_t::move(geometry.x, geometry.y);
+    }
+
+    /* Only actual override-redirect views should get their focus disabled */
+    bool wants_keyboard_focus()
+    {
+        return !xw->override_redirect || wlr_xwayland_or_surface_wants_focus(xw);
+    }
+
+    void map_unmanaged(wlr_surface *surface)
+    {
+        /* move to the output where our center is
+         * FIXME: this is a bad idea, because a dropdown menu might get sent to
+         * an incorrect output. However, no matter how we calculate the real
+         * output, we just can't be 100% compatible because in X all windows are
+         * positioned in a global coordinate space */
+        auto wo = wf::get_core().output_layout->get_output_at(
+            xw->x + surface->current.width / 2, xw->y + surface->current.height / 2);
+
+        if (!wo)
+        {
+            /* if surface center is outside of anything, try to check the output
+             * where the pointer is */
+            auto gc = wf::get_core().get_cursor_position();
+            wo = wf::get_core().output_layout->get_output_at(gc.x, gc.y);
+        }
+
+        if (!wo)
+        {
+            wo = wf::get_core().get_active_output();
+        }
+
+        assert(wo);
+
+        auto real_output_geometry = wo->get_layout_geometry();
+
+        global_x = xw->x;
+        global_y = xw->y;
+        wf::wlr_view_t::move(xw->x - real_output_geometry.x,
+            xw->y - real_output_geometry.y);
+
+        if (wo != get_output())
+        {
+            if (get_output())
+            {
+                get_output()->workspace->remove_view(self());
+            }
+
+            set_output(wo);
+        }
+
+        damage();
+
+        /* We update the keyboard focus before emitting the map event, so that
+         * plugins can detect that this view can have keyboard focus. */
+        view_impl->keyboard_focus_enabled = wants_keyboard_focus();
+
+        get_output()->workspace->add_view(self(), wf::LAYER_UNMANAGED);
+        wf::wlr_view_t::map(surface);
+
+        if (view_impl->keyboard_focus_enabled)
+        {
+            get_output()->focus_view(self(), true);
+        }
+    }
+
+    void map_managed(wlr_surface *surface)
+    {
+        if (xw->maximized_horz && xw->maximized_vert)
+        {
+            if ((xw->width > 0) && (xw->height > 0))
+            {
+                /* Save geometry which the window has put itself in */
+                wf::geometry_t save_geometry = {
+                    xw->x, xw->y, xw->width, xw->height
+                };
+
+                /* Make sure geometry is properly visible on the view output */
+                save_geometry = wf::clamp(save_geometry,
+                    get_output()->workspace->get_workarea());
+                view_impl->update_windowed_geometry(self(), save_geometry);
+            }
+
+            tile_request(wf::TILED_EDGES_ALL);
+        }
+
+        if (xw->fullscreen)
+        {
+            fullscreen_request(get_output(), true);
+        }
+
+        if (!this->tiled_edges && !xw->fullscreen)
+        {
+            configure_request({xw->x, xw->y, xw->width, xw->height});
+        }
+
+        wf::wlr_view_t::map(surface);
+        create_toplevel();
+    }
+
+    /**
+     * Move a mapped view which just became unmanaged to the unmanaged layer,
+     * dropping the state which only managed views have.
+     */
+    void switch_to_unmanaged()
+    {
+        if (parent)
+        {
+            set_toplevel_parent(nullptr);
+        }
+
+        if (fullscreen)
+        {
+            set_fullscreen(false);
+        }
+
+        if (tiled_edges)
+        {
+            set_tiled(0);
+        }
+
+        if (minimized)
+        {
+            set_minimized(false);
+        }
+
+        /* Plugins release their grabs, and the focus moves on */
+        wf::view_disappeared_signal data;
+        data.view = self();
+        get_output()->emit_signal("view-disappeared", &data);
+
+        get_output()->workspace->remove_view(self());
+        update_global_position();
+        view_impl->keyboard_focus_enabled = wants_keyboard_focus();
+        get_output()->workspace->add_view(self(), wf::LAYER_UNMANAGED);
+
+        if (view_impl->keyboard_focus_enabled)
+        {
+            get_output()->focus_view(self(), true);
+        }
+    }
+
+    /** Move a mapped view which just became managed to the workspace layer. */
+    void switch_to_managed()
+    {
+        get_output()->workspace->remove_view(self());
+        update_parent();
+        if (!parent)
+        {
+            get_output()->workspace->add_view(self(), wf::LAYER_WORKSPACE);
+        }
+
+        create_toplevel();
+        get_output()->focus_view(self(), true);
+    }
 
   public:
     wayfire_xwayland_view(wlr_xwayland_surface *xww) :
@@ -503,8 +1032,10 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
 
     virtual void initialize() override
     {
-        LOGE("new xwayland surface ", xw->title,
-            " class: ", xw->class_t, " instance: ", xw->instance);
+        unmanaged = is_unmanaged();
+        role = unmanaged ? wf::VIEW_ROLE_UNMANAGED : wf::VIEW_ROLE_TOPLEVEL;
+        LOGE("new ", unmanaged ? "unmanaged " : "", "xwayland surface ",
+            xw->title, " class: ", xw->class_t, " instance: ", xw->instance);
         wayfire_xwayland_view_base::initialize();
 
         on_request_move.set_callback([&] (void*) { move_request(); });
@@ -543,27 +1074,10 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
         on_set_parent.set_callback([&] (void*)
         {
             /* Menus, etc. with TRANSIENT_FOR but not dialogs */
-            if (is_unmanaged())
+            if (!update_role() && !unmanaged)
             {
-                recreate_view_with_or_type();
-
-                return;
-            }
-
-            auto parent = xw->parent ?
-                wf::wf_view_from_void(xw->parent->data)->self() : nullptr;
-
-            // Make sure the parent is mapped, and that we are not a toplevel view
-            if (parent)
-            {
-                if (!parent->is_mapped() ||
-                    this->has_type(_NET_WM_WINDOW_TYPE_NORMAL))
-                {
-                    parent = nullptr;
-                }
+                update_parent();
             }
-
-            set_toplevel_parent(parent);
         });
 
         on_set_hints.set_callback([&] (void*)
@@ -578,25 +1092,104 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
             wf::get_core().emit_signal("view-hints-changed", &data);
             this->emit_signal("hints-changed", &data);
         });
-        on_set_parent.connect(&xw->events.set_parent);
-        on_set_hints.connect(&xw->events.set_hints);
 
-        on_request_move.connect(&xw->events.request_move);
-        on_request_resize.connect(&xw->events.request_resize);
-        on_request_activate.connect(&xw->events.request_activate);
-        on_request_maximize.connect(&xw->events.request_maximize);
-        on_request_minimize.connect(&xw->events.request_minimize);
-        on_request_fullscreen.connect(&xw->events.request_fullscreen);
+        on_set_geometry.set_callback([&] (void*)
+        {
+            /* Xwayland O-R views manage their position on their own. So we need
+             * to update their position on each commit, if the position changed.
+             */
+            if ((global_x != xw->x) || (global_y != xw->y))
+            {
+                update_global_position();
+            }
+        });
+
+        on_set_parent.connect(&xw->events.set_parent);
+        update_role_listeners();
 
         xw->data = dynamic_cast<wf::view_interface_t*>(this);
         // set initial parent
-        on_set_parent.emit(nullptr);
+        if (!unmanaged)
+        {
+            update_parent();
+        }
+    }
+
+    /**
+     * Switch the role of the view if the window should now be treated
+     * differently. A mapped view stays mapped and keeps its transformers,
+     * custom data and output, and is only moved to the layer of its new role.
+     *
+     * @return Whether the role was switched.
+     */
+    bool update_role() override
+    {
+        bool should_be_unmanaged = is_unmanaged();
+        if (should_be_unmanaged == unmanaged)
+        {
+            return false;
+        }
+
+        LOGD("xwayland surface ", xw->title, " becomes ",
+            should_be_unmanaged ? "unmanaged" : "managed");
+
+        bool was_decorated = should_be_decorated();
+        unmanaged = should_be_unmanaged;
+        update_role_listeners();
+        if (unmanaged)
+        {
+            set_bypass_compositor(false);
+        }
+
+        set_role(unmanaged ? wf::VIEW_ROLE_UNMANAGED : wf::VIEW_ROLE_TOPLEVEL);
+        if (!is_mapped())
+        {
+            /* Everything else is set up in map() */
+            view_impl->keyboard_focus_enabled = true;
+            if (!unmanaged)
+            {
+                update_parent();
+            } else if (parent)
+            {
+                /* Unmapped views are in no layer */
+                set_toplevel_parent(nullptr);
+                if (get_output())
+                {
+                    get_output()->workspace->remove_view(self());
+                }
+            }
+
+            return true;
+        }
+
+        if (unmanaged)
+        {
+            switch_to_unmanaged();
+        } else
+        {
+            view_impl->keyboard_focus_enabled = true;
+            switch_to_managed();
+        }
+
+        if (was_decorated != should_be_decorated())
+        {
+            wf::view_decoration_state_updated_signal data;
+            data.view = self();
+            this->emit_signal("decoration-state-updated", &data);
+            get_output()->emit_signal("view-decoration-state-updated", &data);
+        }
+
+        damage();
+
+        return true;
     }
 
     virtual void destroy() override
     {
+        xwayland_bypass_watcher_t::get().unwatch(xw->window_id);
         on_set_parent.disconnect();
         on_set_hints.disconnect();
+        on_set_geometry.disconnect();
         on_request_move.disconnect();
         on_request_resize.disconnect();
         on_request_activate.disconnect();
@@ -607,8 +1200,30 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
         wayfire_xwayland_view_base::destroy();
     }
 
+    bool should_bypass_compositor() override
+    {
+        return !unmanaged && bypass_compositor;
+    }
+
+    bool should_be_decorated() override
+    {
+        if (unmanaged)
+        {
+            return !xw->override_redirect && !this->has_client_decoration;
+        }
+
+        return wayfire_xwayland_view_base::should_be_decorated();
+    }
+
     void emit_view_map() override
     {
+        if (unmanaged)
+        {
+            wayfire_xwayland_view_base::emit_view_map();
+
+            return;
+        }
+
         /* Some X clients position themselves on map, and others let the window
          * manager determine this. We try to heuristically guess which of the
          * two cases we're dealing with by checking whether we have recevied
@@ -619,40 +1234,24 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
 
     void map(wlr_surface *surface) override
     {
-        if (xw->maximized_horz && xw->maximized_vert)
+        if (unmanaged)
         {
-            if ((xw->width > 0) && (xw->height > 0))
-            {
-                /* Save geometry which the window has put itself in */
-                wf::geometry_t save_geometry = {
-                    xw->x, xw->y, xw->width, xw->height
-                };
-
-                /* Make sure geometry is properly visible on the view output */
-                save_geometry = wf::clamp(save_geometry,
-                    get_output()->workspace->get_workarea());
-                view_impl->update_windowed_geometry(self(), save_geometry);
-            }
-
-            tile_request(wf::TILED_EDGES_ALL);
-        }
-
-        if (xw->fullscreen)
+            map_unmanaged(surface);
+        } else
         {
-            fullscreen_request(get_output(), true);
+            map_managed(surface);
         }
-
-        if (!this->tiled_edges && !xw->fullscreen)
-        {
-            configure_request({xw->x, xw->y, xw->width, xw->height});
-        }
-
-        wf::wlr_view_t::map(surface);
-        create_toplevel();
     }
 
     void commit() override
     {
+        if (unmanaged)
+        {
+            wf::wlr_view_t::commit();
+
+            return;
+        }
+
         if (!xw->has_alpha)
         {
             pixman_region32_union_rect(
@@ -673,7 +1272,7 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
 
         /* We don't send updates while in continuous move, because that means
          * too much configure requests. Instead, we set it at the end */
-        if (!view_impl->in_continuous_move)
+        if (!unmanaged && !view_impl->in_continuous_move)
         {
             send_configure();
         }
@@ -681,6 +1280,12 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
 
     void resize(int w, int h) override
     {
+        /* Unmanaged views choose their size on their own */
+        if (unmanaged)
+        {
+            return;
+        }
+
         if (view_impl->frame)
         {
             view_impl->frame->calculate_resize_size(w, h);
@@ -701,7 +1306,7 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
 
     virtual void request_native_size() override
     {
-        if (!is_mapped() || !xw->size_hints)
+        if (unmanaged || !is_mapped() || !xw->size_hints)
         {
             return;
         }
@@ -719,7 +1324,7 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
     void set_tiled(uint32_t edges) override
     {
         wf::wlr_view_t::set_tiled(edges);
-        if (xw)
+        if (xw && !unmanaged)
         {
             wlr_xwayland_surface_set_maximized(xw, !!edges);
         }
@@ -751,14 +1356,13 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
             app_id = default_app_id;
         }
 
-        wlr_foreign_toplevel_handle_v1_set_app_id(
-            toplevel_handle, app_id.c_str());
+        toplevel_set_app_id(app_id);
     }
 
     void set_fullscreen(bool full) override
     {
         wf::wlr_view_t::set_fullscreen(full);
-        if (xw)
+        if (xw && !unmanaged)
         {
             wlr_xwayland_surface_set_fullscreen(xw, full);
         }
@@ -767,164 +1371,22 @@ class wayfire_xwayland_view : public wayfire_xwayland_view_base
     void set_minimized(bool minimized) override
     {
         wf::wlr_view_t::set_minimized(minimized);
-        if (xw)
-        {
-            wlr_xwayland_surface_set_minimized(xw, minimized);
-        }
-    }
-};
-
-wayfire_unmanaged_xwayland_view::wayfire_unmanaged_xwayland_view(
-    wlr_xwayland_surface *xww) :
-    wayfire_xwayland_view_base(xww)
-{
-    LOGE("new unmanaged xwayland surface ", xw->title, " class: ", xw->class_t,
-        " instance: ", xw->instance);
-
-    xw->data = this;
-    role     = wf::VIEW_ROLE_UNMANAGED;
-
-    on_set_geometry.set_callback([&] (void*)
-    {
-        /* Xwayland O-R views manage their position on their own. So we need to
-         * update their position on each commit, if the position changed. */
-        if ((global_x != xw->x) || (global_y != xw->y))
+        if (xw && !unmanaged)
         {
-            geometry.x = global_x = xw->x;
-            geometry.y = global_y = xw->y;
-
-            if (get_output())
-            {
-                auto real_output = get_output()->get_layout_geometry();
-                geometry.x -= real_output.x;
-                geometry.y -= real_output.y;
-            }
-
-            wf::wlr_view_t::move(geometry.x, geometry.y);
+            wlr_xwayland_surface_set_minimized(xw, should_be_hidden());
         }
-    });
-
-    on_set_geometry.connect(&xw->events.set_geometry);
-}
-
-void wayfire_unmanaged_xwayland_view::map(wlr_surface *surface)
-{
-    /* move to the output where our center is
-     * FIXME: this is a bad idea, because a dropdown menu might get sent to
-     * an incorrect output. However, no matter how we calculate the real
-     * output, we just can't be 100% compatible because in X all windows are
-     * positioned in a global coordinate space */
-    auto wo = wf::get_core().output_layout->get_output_at(
-        xw->x + surface->current.width / 2, xw->y + surface->current.height / 2);
-
-    if (!wo)
-    {
-        /* if surface center is outside of anything, try to check the output
-         * where the pointer is */
-        auto gc = wf::get_core().get_cursor_position();
-        wo = wf::get_core().output_layout->get_output_at(gc.x, gc.y);
-    }
-
-    if (!wo)
-    {
-        wo = wf::get_core().get_active_output();
     }
 
-    assert(wo);
-
-    auto real_output_geometry = wo->get_layout_geometry();
-
-    global_x = xw->x;
-    global_y = xw->y;
-    wf::wlr_view_t::move(xw->x - real_output_geometry.x,
-        xw->y - real_output_geometry.y);
-
-    if (wo != get_output())
+    void set_visibility_state(wf::view_visibility_t state) override
     {
-        if (get_output())
+        wf::wlr_view_t::set_visibility_state(state);
+        if (xw && !unmanaged && (xw->minimized != should_be_hidden()))
         {
-            get_output()->workspace->remove_view(self());
+            wlr_xwayland_surface_set_minimized(xw, should_be_hidden());
         }
-
-        set_output(wo);
     }
+};
 
-    damage();
-
-    /* We update the keyboard focus before emitting the map event, so that
-     * plugins can detect that this view can have keyboard focus.
-     *
-     * Note: only actual override-redirect views should get their focus disabled */
-    view_impl->keyboard_focus_enabled = (!xw->override_redirect ||
-        wlr_xwayland_or_surface_wants_focus(xw));
-
-    get_output()->workspace->add_view(self(), wf::LAYER_UNMANAGED);
-    wf::wlr_view_t::map(surface);
-
-    if (view_impl->keyboard_focus_enabled)
-    {
-        get_output()->focus_view(self(), true);
-    }
-}
-
-bool wayfire_unmanaged_xwayland_view::should_be_decorated()
-{
-    return (!xw->override_redirect && !this->has_client_decoration);
-}
-
-void wayfire_unmanaged_xwayland_view::destroy()
-{
-    on_set_geometry.disconnect();
-    wayfire_xwayland_view_base::destroy();
-}
-
-void wayfire_xwayland_view_base::recreate_view_with_or_type()
-{
-    /*
-     * Copy xw and mapped status into the stack, because "this" may be destroyed
-     * at some point of this function.
-     */
-    auto xw_surf    = this->xw;
-    bool was_mapped = is_mapped();
-    bool is_unmanaged = this->is_unmanaged();
-
-    bool is_currently_unmanaged =
-        (dynamic_cast<wayfire_unmanaged_xwayland_view*>(this) != nullptr);
-    if (is_currently_unmanaged == is_unmanaged)
-    {
-        // Nothing changed
-        return;
-    }
-
-    // destroy the view (unmap + destroy)
-    if (was_mapped)
-    {
-        unmap();
-    }
-
-    destroy();
-
-    // create the new view
-    std::unique_ptr<wayfire_xwayland_view_base> new_view;
-    if (is_unmanaged)
-    {
-        new_view = std::make_unique<wayfire_unmanaged_xwayland_view>(xw_surf);
-    } else
-    {
-        new_view = std::make_unique<wayfire_xwayland_view>(xw_surf);
-    }
-
-    // create copy for mapping later
-    auto raw_ptr = new_view.get();
-    wf::get_core().add_view(std::move(new_view));
-
-    if (was_mapped)
-    {
-        raw_ptr->map(xw_surf->surface);
-    }
-}
-
-static wlr_xwayland *xwayland_handle = nullptr;
 #endif
 
 void wf::init_xwayland()
@@ -942,15 +1404,7 @@ void wf::init_xwayland()
     on_created.set_callback([] (void *data)
     {
         auto xsurf = (wlr_xwayland_surface*)data;
-        if (xsurf->override_redirect)
-        {
-            wf::get_core().add_view(
-                std::make_unique<wayfire_unmanaged_xwayland_view>(xsurf));
-        } else
-        {
-            wf::get_core().add_view(
-                std::make_unique<wayfire_xwayland_view>(xsurf));
-        }
+        wf::get_core().add_view(std::make_unique<wayfire_xwayland_view>(xsurf));
     });
 
     on_ready.set_callback([&] (void *data)
@@ -963,13 +1417,23 @@ void wf::init_xwayland()
             LOGD("Successfully loaded Xwayland atoms.");
         }
 
+        xwayland_bypass_watcher_t::get().connect(xwayland_handle->display_name);
+
         wlr_xwayland_set_seat(xwayland_handle,
             wf::get_core().get_current_seat());
         xwayland_update_default_cursor();
+
+        /* Stop again if no X11 client shows up */
+        if (xwayland_idle_shutdown_t::get().surfaces == 0)
+        {
+            xwayland_idle_shutdown_t::get().arm();
+        }
     });
 
+    static wf::option_wrapper_t<bool> lazy{"core/xwayland_lazy"};
+    xwayland_idle_shutdown_t::get().lazy = lazy;
     xwayland_handle = wlr_xwayland_create(wf::get_core().display,
-        wf::get_core_impl().compositor, false);
+        wf::get_core_impl().compositor, lazy);
 
     if (xwayland_handle)
     {
@@ -1002,13 +1466,58 @@ void wf::xwayland_update_default_cursor()
 #endif
 }
 
+#if WF_HAS_XWAYLAND
+/**
+ * Raising X11 windows is deferred to the end of the event loop iteration,
+ * so that when the focus changes several times in a row, only the surface
+ * which ends up focused is restacked.
+ */
+struct xwayland_restack_t
+{
+    wlr_xwayland_surface *pending = nullptr;
+    wf::wl_listener_wrapper on_pending_destroy;
+    wf::wl_idle_call idle_restack;
+
+    xwayland_restack_t()
+    {
+        on_pending_destroy.set_callback([=] (void*)
+        {
+            pending = nullptr;
+            on_pending_destroy.disconnect();
+            idle_restack.disconnect();
+        });
+    }
+
+    void bring_to_front(wlr_xwayland_surface *xw)
+    {
+        if (xw != pending)
+        {
+            on_pending_destroy.disconnect();
+            on_pending_destroy.connect(&xw->events.destroy);
+            pending = xw;
+        }
+
+        if (!idle_restack.is_connected())
+        {
+            idle_restack.run_once([=] ()
+            {
+                wlr_xwayland_surface_restack(pending, NULL, XCB_STACK_MODE_ABOVE);
+                on_pending_destroy.disconnect();
+                pending = nullptr;
+            });
+        }
+    }
+};
+
+#endif
+
 void wf::xwayland_bring_to_front(wlr_surface *surface)
 {
 #if WF_HAS_XWAYLAND
     if (wlr_surface_is_xwayland_surface(surface))
     {
-        auto xw = wlr_xwayland_surface_from_wlr_surface(surface);
-        wlr_xwayland_surface_restack(xw, NULL, XCB_STACK_MODE_ABOVE);
+        static xwayland_restack_t restack;
+        restack.bring_to_front(wlr_xwayland_surface_from_wlr_surface(surface));
     }
 
 #endif